@@ -0,0 +1,152 @@
+#!/bin/sh
+#
+#    backup.sh
+#    This file is part of "Sauvegarde" project.
+#
+#    (C) Copyright 2019 Olivier Delhomme
+#     e-mail : olivier.delhomme@free.fr
+#
+#    "Sauvegarde" is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    "Sauvegarde" is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+#
+# End to end backup benchmark: starts cdpfglserver with its storage in
+# tmpfs, generates a tree (small files, large files and duplicated data)
+# and measures how fast cdpfglclient saves it. It is run by 'make bench'
+# from the top build directory. cdpfglclient uses fanotify and thus needs
+# to be run as root.
+#
+# usage: bench/backup.sh [builddir]
+
+BUILDDIR=${1:-.}
+SERVER=$BUILDDIR/server/cdpfglserver
+CLIENT=$BUILDDIR/client/cdpfglclient
+PORT=${BENCH_PORT:-15468}
+SMALL_FILES=${BENCH_SMALL_FILES:-5000}
+LARGE_FILES=${BENCH_LARGE_FILES:-4}
+DEDUP_COPIES=${BENCH_DEDUP_COPIES:-4}
+TIMEOUT=${BENCH_TIMEOUT:-600}
+
+if [ "$(id -u)" != "0" ]; then
+    echo "backup.sh: cdpfglclient needs to be run as root, skipping end to end benchmark"
+    exit 0
+fi
+
+if [ ! -x "$SERVER" ] || [ ! -x "$CLIENT" ]; then
+    echo "backup.sh: $SERVER or $CLIENT not found (run make first)"
+    exit 1
+fi
+
+if [ -d /dev/shm ]; then
+    WORKDIR=$(mktemp -d /dev/shm/cdpfglbench-XXXXXX)
+else
+    WORKDIR=$(mktemp -d /tmp/cdpfglbench-XXXXXX)
+fi
+
+TREE=$WORKDIR/tree
+SERVER_PID=""
+CLIENT_PID=""
+
+cleanup()
+{
+    [ -n "$CLIENT_PID" ] && kill "$CLIENT_PID" 2>/dev/null
+    [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$WORKDIR"
+}
+
+trap cleanup EXIT INT TERM
+
+# Generates the tree to be saved
+mkdir -p "$TREE/small" "$TREE/large" "$TREE/dedup"
+
+i=0
+while [ $i -lt "$SMALL_FILES" ]; do
+    d=$TREE/small/$((i / 100))
+    [ -d "$d" ] || mkdir -p "$d"
+    head -c 4096 /dev/urandom > "$d/file$i"
+    i=$((i + 1))
+done
+
+i=0
+while [ $i -lt "$LARGE_FILES" ]; do
+    head -c 67108864 /dev/urandom > "$TREE/large/file$i"
+    i=$((i + 1))
+done
+
+head -c 33554432 /dev/urandom > "$TREE/dedup/original"
+i=0
+while [ $i -lt "$DEDUP_COPIES" ]; do
+    cp "$TREE/dedup/original" "$TREE/dedup/copy$i"
+    i=$((i + 1))
+done
+
+NB_FILES=$(find "$TREE" | wc -l)
+NB_BYTES=$(du -sb "$TREE" | cut -f1)
+
+cat > "$WORKDIR/server.conf" <<CONF
+[All]
+debug-mode=false
+[Server]
+server-port=$PORT
+backend=file
+[File_Backend]
+file-directory=$WORKDIR/server
+CONF
+
+cat > "$WORKDIR/client.conf" <<CONF
+[All]
+debug-mode=false
+[Client]
+directory-list=$TREE
+cache-directory=$WORKDIR/client
+cache-db-name=filecache.db
+[Server]
+server-ip=localhost
+server-port=$PORT
+CONF
+
+"$SERVER" -c "$WORKDIR/server.conf" > "$WORKDIR/server.log" 2>&1 &
+SERVER_PID=$!
+
+n=0
+until curl -s "http://localhost:$PORT/Version" > /dev/null; do
+    n=$((n + 1))
+    if [ $n -gt 100 ]; then
+        echo "backup.sh: cdpfglserver did not start (see $WORKDIR/server.log)"
+        exit 1
+    fi
+    sleep 0.1
+done
+
+START=$(date +%s.%N)
+"$CLIENT" -c "$WORKDIR/client.conf" > "$WORKDIR/client.log" 2>&1 &
+CLIENT_PID=$!
+
+FILES=0
+while [ "$FILES" -lt "$NB_FILES" ]; do
+    sleep 0.2
+    FILES=$(curl -s "http://localhost:$PORT/Stats.json" | sed -n 's/.*"files": *\([0-9]*\).*/\1/p')
+    FILES=${FILES:-0}
+    ELAPSED=$(echo "$(date +%s.%N) - $START" | bc)
+    if [ "$(echo "$ELAPSED > $TIMEOUT" | bc)" = "1" ]; then
+        echo "backup.sh: timeout, only $FILES files of $NB_FILES were saved"
+        exit 1
+    fi
+done
+
+ELAPSED=$(echo "$(date +%s.%N) - $START" | bc)
+
+echo "end to end backup: $NB_FILES files, $NB_BYTES bytes in $ELAPSED s"
+echo "$NB_FILES $NB_BYTES $ELAPSED" | awk '{ printf("end to end backup: %.1f MB/s, %.1f files/s\n", $2 / $3 / 1048576, $1 / $3); }'
+DEDUP=$(curl -s "http://localhost:$PORT/Stats.json" | sed -n 's/.*"dedup size": *\([0-9]*\).*/\1/p')
+echo "end to end backup: dedup size $DEDUP bytes"
@@ -33,25 +33,46 @@
 static GSList *make_regex_exclude_list(GSList *exclude_list);
 static gboolean exclude_file(GSList *regex_exclude_list, gchar *filename);
 static main_struct_t *init_main_structure(options_t *opt);
-static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize, gshort cmptype);
-static meta_data_t *get_meta_data_from_fileinfo(file_event_t *file_event, filter_file_t *filter, options_t *opt);
-static gchar *send_meta_data_to_server(main_struct_t *main_struct, meta_data_t *meta, gboolean data_sent);
-static GList *find_hash_in_list(GList *hash_data_list, guint8 *hash);
-static GList *send_data_to_server(main_struct_t *main_struct, GList *hash_data_list, gchar *answer);
-static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_data_list, gchar *answer);
+static void adjust_compression_to_server(options_t *opt, comm_t *comm);
+static GList *calculate_hash_data_list_for_file(buffer_pool_t *pool, chunker_t *chunker, GFile *a_file, gint64 blocksize, gshort cmptype);
+static meta_data_t *get_meta_data_from_fileinfo(file_event_t *file_event, filter_file_t *filter, options_t *opt, tuner_t *tuner);
+static gchar *send_meta_data_to_server(main_struct_t *main_struct, comm_t *comm, meta_data_t *meta, gboolean data_sent);
+static GList *send_needed_data_to_server(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, gchar *answer, GList **pending);
+static GList *send_all_data_to_server(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, gchar *answer);
+static GList *send_pending_data_to_server(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, GList *pending);
 static void iterate_over_enum(main_struct_t *main_struct, gchar *directory, GFileEnumerator *file_enum);
 static void carve_one_directory(gpointer data, gpointer user_data);
+static void push_directory_to_carve(gpointer data, gpointer user_data);
 static gpointer carve_all_directories(gpointer data);
 static gpointer save_one_file_threaded(gpointer data);
 static void free_filter_file_t(filter_file_t *filter);
 static void free_file_event_t(file_event_t *file_event);
-static gint insert_array_in_root_and_send(main_struct_t *main_struct, json_t *array);
-static void process_small_file_not_in_cache(main_struct_t *main_struct, meta_data_t *meta);
-static GList *lets_send_all_that_now(main_struct_t *main_struct, GList *hash_data_list, GList *saved_list, gsize read_bytes);
-static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_t *meta);
-static gint64 calculate_file_blocksize(options_t *opt, gint64 size);
+static gboolean load_file_event_fileinfo(file_event_t *file_event);
+static void free_client_meta_data_t(gpointer data);
+static gint insert_array_in_root_and_send(main_struct_t *main_struct, comm_t *comm, json_t *array, GList *hash_list);
+static data_request_t *new_data_request_t(main_struct_t *main_struct, GList *hash_list);
+static void data_request_done(gint success, gchar *url, gchar *readbuffer, size_t length, gchar *answer, gpointer user_data);
+static gint send_binary_array(main_struct_t *main_struct, comm_t *comm, GByteArray *bin_array, GList *hash_list);
+static void add_blocks_the_server_has(main_struct_t *main_struct, GHashTable *index, GList *pending);
+static gchar *send_meta_array_to_server(main_struct_t *main_struct, comm_t *comm, GList *meta_list);
+static gchar *send_hash_array_to_server(comm_t *comm, GList *hash_data_list);
+static gboolean add_small_file_to_worker(worker_t *worker, meta_data_t *meta);
+static void send_small_files_of_worker(worker_t *worker);
+static GList *remove_known_blocks(GList *hash_data_list);
+static GList *remove_blocks_known_by_server(known_t *known, GList *hash_data_list);
+static GList *lets_send_all_that_now(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, GList *saved_list, gsize read_bytes, guint64 *sent);
+static worker_t *new_worker_t(main_struct_t *main_struct, gchar *conn, guint number);
+static void hash_one_block(gpointer data, gpointer user_data);
+static batch_t *new_batch_t(buffer_pool_t *pool, gshort cmptype, delta_t *delta);
+static void add_block_to_batch(GThreadPool *hash_pool, batch_t *batch, guchar *buffer, gssize read);
+static GList *wait_for_batch(batch_t *batch);
+static GList *send_batch(main_struct_t *main_struct, comm_t *comm, batch_t *batch, GList *saved_list, guint64 *sent);
+static void process_file_not_in_cache(main_struct_t *main_struct, comm_t *comm, meta_data_t *meta);
+static gsize get_batch_size(main_struct_t *main_struct, comm_t *comm, gint64 blocksize);
+static gint64 calculate_file_blocksize(options_t *opt, tuner_t *tuner, gint64 size);
 static gpointer reconnected(gpointer data);
 static gboolean client_signal_handler(gpointer user_data);
+static gboolean save_scheduler_stats(gpointer user_data);
 static gpointer fanotify_loop_thread(gpointer data);
 static void install_client_signal_traps(main_struct_t *main_struct);
 
@@ -111,6 +132,23 @@ static gboolean exclude_file(GSList *regex_exclude_list, gchar *filename)
 }
 
 
+/**
+ * Falls back to zlib when the selected compression type is one that the
+ * server does not advertise (it could not uncompress such blocks).
+ * @param opt is the options_t * structure whose cmptype may be changed.
+ * @param comm is the communication structure of a server that has
+ *        already been asked for its version.
+ */
+static void adjust_compression_to_server(options_t *opt, comm_t *comm)
+{
+    if ((opt->cmptype == COMPRESS_LZ4_TYPE && comm->lz4 == FALSE) || (opt->cmptype == COMPRESS_ZSTD_TYPE && comm->zstd == FALSE))
+        {
+            print_debug(_("Server does not know compression type %d: using zlib instead.\n"), opt->cmptype);
+            opt->cmptype = COMPRESS_ZLIB_TYPE;
+        }
+}
+
+
 /**
  * Inits the main structure.
  * @note With sqlite version > 3.7.7 we should use URI filename.
@@ -122,6 +160,8 @@ static main_struct_t *init_main_structure(options_t *opt)
 {
     main_struct_t *main_struct = NULL;
     gchar *conn = NULL;
+    gchar *name = NULL;
+    guint i = 0;
 
     g_assert_nonnull(opt);
 
@@ -131,6 +171,8 @@ static main_struct_t *init_main_structure(options_t *opt)
     g_assert_nonnull(main_struct);
 
     main_struct->database = open_database(opt->dircache, opt->dbname);
+    main_struct->spool = open_spool(opt->dircache);
+    main_struct->delta_key = delta_load_key(main_struct->database);
 
     main_struct->opt = opt;
     main_struct->hostname = g_get_host_name();
@@ -139,8 +181,14 @@ static main_struct_t *init_main_structure(options_t *opt)
         {
             conn = make_connexion_string(opt->srv_conf);
             main_struct->comm = init_comm_struct(conn, opt->cmptype);
+            main_struct->comm->pending_list = TRUE;
             main_struct->reconnected = init_comm_struct(conn, opt->cmptype);
-            free_variable(conn);
+
+            /* Asking the server for its version tells which protocols it knows */
+            is_server_alive(main_struct->comm);
+            adjust_compression_to_server(opt, main_struct->comm);
+            main_struct->comm->cmptype = opt->cmptype;
+            main_struct->reconnected->cmptype = opt->cmptype;
         }
     else
         {
@@ -148,21 +196,71 @@ static main_struct_t *init_main_structure(options_t *opt)
             main_struct->comm = NULL;
         }
 
+    main_struct->known = open_known(opt->dircache, conn, main_struct->comm != NULL ? main_struct->comm->epoch : NULL);
+
     main_struct->fanotify_fd = start_fanotify(opt);
 
     /* inits the queue that will wait for events on files */
-    main_struct->save_queue = g_async_queue_new();
+    main_struct->scheduler = new_scheduler_t(opt->dircache, (gint64) opt->live_budget * 1048576, (gint64) opt->carve_budget * 1048576, (guint) opt->threads, opt->low_memory);
     main_struct->dir_queue = g_async_queue_new();
     main_struct->regex_exclude_list = make_regex_exclude_list(opt->exclude_list);
 
-    /* Thread initialization */
-    main_struct->save_one_file = g_thread_new("save_one_file", save_one_file_threaded, main_struct);
-    main_struct->carve_all_directories = g_thread_new("carve_all_directories", carve_all_directories, main_struct);
+    /* Threads initialization: blocks of big files are hashed by hash_pool and
+     * every worker saves files popped from the scheduler
+     */
+    if (opt->low_memory == TRUE)
+        {
+            main_struct->buffer_pool = new_buffer_pool_t((guint64) opt->threads * CLIENT_LOW_MEMORY_POOL_SIZE_PER_THREAD);
+        }
+    else
+        {
+            main_struct->buffer_pool = new_buffer_pool_t((guint64) opt->threads * CLIENT_POOL_SIZE_PER_THREAD);
+        }
+    main_struct->chunker = NULL;
+    main_struct->tuner = NULL;
+
+    if (opt->cdc == TRUE)
+        {
+            main_struct->chunker = new_chunker_t(opt->cdc_min, opt->cdc_avg, opt->cdc_max);
+        }
+    else if (opt->auto_tune == TRUE)
+        {
+            /* Content defined blocks have no class block size to tune */
+            main_struct->tuner = new_tuner_t();
+        }
+
+    main_struct->hash_pool = g_thread_pool_new(hash_one_block, NULL, opt->threads, FALSE, NULL);
+    main_struct->workers = g_ptr_array_new();
+
+    for (i = 0; i < (guint) opt->threads && conn != NULL; i++)
+        {
+            g_ptr_array_add(main_struct->workers, new_worker_t(main_struct, conn, i));
+        }
+    free_variable(conn);
+
+    /* Carvers share dir_queue: directories found while saving are pushed
+     * into it and the first carver that is free enumerates them.
+     */
+    main_struct->carvers = g_ptr_array_new();
+
+    if (opt->noscan == FALSE)
+        {
+            g_slist_foreach(opt->dirname_list, push_directory_to_carve, main_struct);
+
+            for (i = 0; i < (guint) opt->carvers; i++)
+                {
+                    name = g_strdup_printf("carve_all_directories-%u", i);
+                    g_ptr_array_add(main_struct->carvers, g_thread_new(name, carve_all_directories, main_struct));
+                    free_variable(name);
+                }
+        }
+
     main_struct->reconn_thread = g_thread_new("reconnected", reconnected, main_struct);
     main_struct->fanotify_loop = g_thread_new("fanotify-loop", fanotify_loop_thread, main_struct);
 
     /* Main loop creation (used to trap signals into main loop run) */
     main_struct->loop = g_main_loop_new(g_main_context_default(), FALSE);
+    g_timeout_add_seconds(SCHEDULER_STATS_INTERVAL, save_scheduler_stats, main_struct->scheduler);
 
     print_debug(_("Main structure initialized !\n"));
 
@@ -171,30 +269,38 @@ static main_struct_t *init_main_structure(options_t *opt)
 
 
 /**
- * Calculates hashs for each block of blocksize bytes long on the file
- * and returns a list of all hashs in correct order stored in a binary
- * form to save space.
+ * Calculates hashs for each block of blocksize bytes long (or each
+ * content defined block when chunker is not NULL) on the file and
+ * returns a list of all hashs in correct order stored in a binary
+ * form to save space. Buffers come from pool and go back to it when
+ * the list is freed. Holes and blocks of zeros get the zero hash and
+ * no data (they are not hashed).
  * @note This technique has some limits in term of memory footprint
  *       because one file is entirely in memory at a time. Saving huge
  *       files may not be possible with this, depending on the size of
  *       the file and the size of the memory.
  * @todo Imagine a new way to checksum huge files because of limitations.
  *       May be with the local sqlite database ?
+ * @param pool is the pool of buffers to use.
+ * @param chunker is the content defined chunking to use (NULL for fixed
+ *        size blocks).
  * @param a_file is the file from which we want the hashs.
  * @param blocksize is the blocksize to be used to calculate hashs upon.
+ * @param cmptype is the compression type to use.
  * @returns a GSList * list of hashs stored in a binary form.
  */
-static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize, gshort cmptype)
+static GList *calculate_hash_data_list_for_file(buffer_pool_t *pool, chunker_t *chunker, GFile *a_file, gint64 blocksize, gshort cmptype)
 {
     GFileInputStream *stream = NULL;
+    block_reader_t *reader = NULL;
     GError *error = NULL;
     GList *hash_data_list = NULL;
     hash_data_t *hash_data = NULL;
     gssize size_read = 0;
     guchar *buffer = NULL;
-    GChecksum *checksum = NULL;
     guint8 *a_hash = NULL;
-    gsize digest_len = HASH_LEN;
+    gchar *filename = NULL;
+    gint64 span = trace_begin();
 
     if (a_file != NULL)
         {
@@ -202,33 +308,34 @@ static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize,
 
             if (stream != NULL && error == NULL)
                 {
+                    filename = g_file_get_path(a_file);
+                    reader = new_block_reader_t((GInputStream *) stream, chunker, blocksize, filename);
+                    free_variable(filename);
+                    a_hash = (guint8 *) buffer_pool_alloc(pool, HASH_LEN);
 
-                    checksum = g_checksum_new(G_CHECKSUM_SHA256);
-                    buffer = (guchar *) g_malloc(blocksize);
-                    a_hash = (guint8 *) g_malloc(digest_len);
+                    size_read = block_reader_read(reader, pool, &buffer, &error);
 
-                    size_read = g_input_stream_read((GInputStream *) stream, buffer, blocksize, NULL, &error);
-
-                    while (size_read != 0 && error == NULL)
+                    while (size_read > 0 && error == NULL)
                         {
-                            g_checksum_update(checksum, buffer, size_read);
-                            g_checksum_get_digest(checksum, a_hash, &digest_len);
-
-                            /* Need to save data and read in hash_data_t structure */
-                            hash_data = new_hash_data_t(buffer, size_read, a_hash, cmptype);
-                            if (cmptype != COMPRESS_NONE_TYPE)
+                            if (buffer == NULL || is_zero_buffer(buffer, size_read) == TRUE)
                                 {
-                                    free_variable(buffer); /* buffer has been compressed and is no longer needed in the program */
+                                    buffer_pool_release(pool, buffer);
+                                    make_zero_hash(size_read, a_hash);
+                                    hash_data = new_hash_data_t_from_pool(pool, NULL, size_read, a_hash, COMPRESS_NONE_TYPE);
+                                }
+                            else
+                                {
+                                    calculate_hash_into(buffer, size_read, a_hash);
+
+                                    /* Need to save data and read in hash_data_t structure (buffer is compressed or owned by it) */
+                                    hash_data = new_hash_data_t_from_pool(pool, buffer, size_read, a_hash, cmptype);
                                 }
 
                             hash_data_list = g_list_prepend(hash_data_list, hash_data);
-                            g_checksum_reset(checksum);
-                            digest_len = HASH_LEN;
 
-                            buffer = (guchar *) g_malloc(blocksize);
-                            a_hash = (guint8 *) g_malloc(digest_len);
+                            a_hash = (guint8 *) buffer_pool_alloc(pool, HASH_LEN);
 
-                            size_read = g_input_stream_read((GInputStream *) stream, buffer, blocksize, NULL, &error);
+                            size_read = block_reader_read(reader, pool, &buffer, &error);
                         }
 
                     if (error != NULL)
@@ -244,10 +351,9 @@ static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize,
                             hash_data_list = g_list_reverse(hash_data_list);
                         }
 
-                    free_variable(buffer);
-                    free_variable(a_hash);
+                    buffer_pool_release(pool, a_hash);
+                    free_block_reader_t(reader);
 
-                    g_checksum_free(checksum);
                     g_input_stream_close((GInputStream *) stream, NULL, NULL);
                     free_object(stream);
                 }
@@ -258,12 +364,16 @@ static GList *calculate_hash_data_list_for_file(GFile *a_file, gint64 blocksize,
                 }
         }
 
+    trace_end(span, "calculate_hash_data_list_for_file");
+
     return hash_data_list;
 }
 
 
 /**
- * Gets the attributes of a file
+ * Gets the attributes of a file. Owner and group names are interned (a
+ * few names are shared by millions of files): they must not be freed,
+ * see free_client_meta_data_t().
  * @param meta is the structure where to store meta data (attributes) of
  *        the file
  * @param fileinfo is a glib structure that contains a lot of informations
@@ -274,8 +384,8 @@ static void get_file_attributes(meta_data_t *meta, GFileInfo *fileinfo)
     if (meta != NULL)
         {
             meta->inode = g_file_info_get_attribute_uint64(fileinfo, G_FILE_ATTRIBUTE_UNIX_INODE);
-            meta->owner = g_file_info_get_attribute_as_string(fileinfo, G_FILE_ATTRIBUTE_OWNER_USER);
-            meta->group = g_file_info_get_attribute_as_string(fileinfo, G_FILE_ATTRIBUTE_OWNER_GROUP);
+            meta->owner = (gchar *) g_intern_string(g_file_info_get_attribute_string(fileinfo, G_FILE_ATTRIBUTE_OWNER_USER));
+            meta->group = (gchar *) g_intern_string(g_file_info_get_attribute_string(fileinfo, G_FILE_ATTRIBUTE_OWNER_GROUP));
             meta->uid = g_file_info_get_attribute_uint32(fileinfo, G_FILE_ATTRIBUTE_UNIX_UID);
             meta->gid = g_file_info_get_attribute_uint32(fileinfo, G_FILE_ATTRIBUTE_UNIX_GID);
             meta->atime = g_file_info_get_attribute_uint64(fileinfo, G_FILE_ATTRIBUTE_TIME_ACCESS);
@@ -287,7 +397,7 @@ static void get_file_attributes(meta_data_t *meta, GFileInfo *fileinfo)
              /* Do the right things with specific cases */
             if (meta->file_type == G_FILE_TYPE_SYMBOLIC_LINK)
                 {
-                    meta->link = (gchar *) g_file_info_get_attribute_byte_string(fileinfo, G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET);
+                    meta->link = g_strdup(g_file_info_get_attribute_byte_string(fileinfo, G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET));
                 }
             else
                 {
@@ -309,33 +419,35 @@ static void get_file_attributes(meta_data_t *meta, GFileInfo *fileinfo)
  *        that is set to TRUE if the file has been filtered out and FALSE
  *        otherwise.
  * @param opt are the selected options for the program.
+ * @param tuner is the block size of each class of files (NULL unless
+ *        auto-tune mode).
  * @returns a newly allocated and filled meta_data_t * structure.
  */
-static meta_data_t *get_meta_data_from_fileinfo(file_event_t *file_event, filter_file_t *filter, options_t *opt)
+static meta_data_t *get_meta_data_from_fileinfo(file_event_t *file_event, filter_file_t *filter, options_t *opt, tuner_t *tuner)
 {
     meta_data_t *meta = NULL;
-    gchar *directory = NULL;
+    gchar *path = NULL;
     GFileInfo *fileinfo = NULL;
 
     if (file_event != NULL)
         {
-            directory = file_event->directory;
+            path = file_event->path;
             fileinfo = file_event->fileinfo;
         }
 
-    if (directory != NULL && fileinfo != NULL &&  filter != NULL && filter->database != NULL)
+    if (path != NULL && fileinfo != NULL &&  filter != NULL && filter->database != NULL)
         {
             /* filling meta data for the file represented by fileinfo */
             meta = new_meta_data_t();
 
             meta->file_type = g_file_info_get_file_type(fileinfo);
-            meta->name = g_build_path(G_DIR_SEPARATOR_S, directory, g_file_info_get_name(fileinfo), NULL);
+            meta->name = g_strdup(path);
 
             if (exclude_file(filter->regex_exclude_list, meta->name) == FALSE)
                 {
                     /* fills meta_data_t *meta structure */
                     get_file_attributes(meta, fileinfo);
-                    meta->blocksize = calculate_file_blocksize(opt, meta->size);
+                    meta->blocksize = calculate_file_blocksize(opt, tuner, meta->size);
 
                     /* We need to determine if the file has already been saved by looking into the local database
                      * This is usefull only when carving directories at the begining of the process as when called
@@ -357,13 +469,13 @@ static meta_data_t *get_meta_data_from_fileinfo(file_event_t *file_event, filter
 /**
  * Sends meta data to the server and returns it's answer or NULL in
  * case of an error.
- * @param main_struct : main structure of the program (contains pointers
- *        to the communication socket.
+ * @param main_struct : main structure of the program.
+ * @param comm is the comm_t * structure used to talk to the server.
  * @param meta : the meta_data_t * structure to be saved.
  * @returns a newly allocated gchar * string that may be freed when no
  *          longer needed.
  */
-static gchar *send_meta_data_to_server(main_struct_t *main_struct, meta_data_t *meta, gboolean data_sent)
+static gchar *send_meta_data_to_server(main_struct_t *main_struct, comm_t *comm, meta_data_t *meta, gboolean data_sent)
 {
     gchar *json_str = NULL;
     gchar *answer = NULL;
@@ -372,6 +484,7 @@ static gchar *send_meta_data_to_server(main_struct_t *main_struct, meta_data_t *
     json_t *array = NULL;
 
     g_assert_nonnull(main_struct);
+    g_assert_nonnull(comm);
 
     if (meta != NULL && main_struct->hostname != NULL)
         {
@@ -379,31 +492,31 @@ static gchar *send_meta_data_to_server(main_struct_t *main_struct, meta_data_t *
 
             /* Sends meta data here: readbuffer is the buffer sent to server */
             print_debug(_("Sending meta data: %s\n"), json_str);
-            main_struct->comm->readbuffer = json_str;
-            success = post_url(main_struct->comm, "/Meta.json");
+            comm->readbuffer = json_str;
+            success = post_url(comm, "/Meta.json");
 
             if (success == CURLE_OK)
                 {
-                    answer = g_strdup(main_struct->comm->buffer);
-                    free_variable(main_struct->comm->buffer);
+                    answer = g_strdup(comm->buffer);
+                    free_variable(comm->buffer);
                 }
             else
                 {
                     /* Need to manage HTTP errors ? */
-                    /* Saving meta data that should have been sent to sqlite database */
-                    db_save_buffer(main_struct->database, "/Meta.json", main_struct->comm->readbuffer);
+                    /* Saving meta data that should have been sent into the spool */
+                    spool_append(main_struct->spool, "/Meta.json", comm->readbuffer, strlen(comm->readbuffer));
 
                     /* An error occured -> we need the whole hash list to be saved
                      * we are building a 'fake' answer with the whole hash list.
                      */
-                    array = convert_hash_list_to_json(meta->hash_data_list);
+                    array = convert_hash_array_to_json(meta->hashs, meta->nb_hashs);
                     root = json_object();
                     insert_json_value_into_json_root(root, "hash_list", array);
                     answer = json_dumps(root, 0);
                     json_decref(root);
                 }
 
-            free_variable(main_struct->comm->readbuffer);
+            free_variable(comm->readbuffer);
         }
 
     return answer;
@@ -411,42 +524,55 @@ static gchar *send_meta_data_to_server(main_struct_t *main_struct, meta_data_t *
 
 
 /**
- * Finds a hash in the hash data list and returns the hash_data_t that
- * corresponds to it. In normal operations it should always find
- * something.
- * @param hash_data_list is the list to look into for the hash 'hash'
- * @param hash is the hash to look for.
- * @returns the GList * pointer that contains hash_data_t structure that
- *          corresponds to the hash 'hash'.
+ * @param main_struct : main structure of the program.
+ * @param hash_list is the list of hash_data_t * (only hashs) of the
+ *        blocks sent by the request. It is owned by the request.
+ * @returns a newly allocated data_request_t * that is freed by
+ *          data_request_done().
  */
-static GList *find_hash_in_list(GList *hash_data_list, guint8 *hash)
+static data_request_t *new_data_request_t(main_struct_t *main_struct, GList *hash_list)
 {
-    GList *iter = hash_data_list;
-    hash_data_t *found = NULL;
-    gboolean ok = FALSE;
+    data_request_t *request = NULL;
 
-    while (iter != NULL && ok == FALSE)
-        {
-            found = iter->data;
+    request = (data_request_t *) g_malloc0(sizeof(data_request_t));
+    g_assert_nonnull(request);
 
-            if (compare_two_hashs(hash, found->hash) == 0)
-                {
-                    ok = TRUE;
-                }
-            else
-                {
-                   iter = g_list_next(iter);
-                }
-        }
+    request->spool = main_struct->spool;
+    request->known = main_struct->known;
+    request->hash_list = hash_list;
+
+    return request;
+}
+
+
+/**
+ * Called when an asynchronous data request completes: the blocks the
+ * server acknowledged are added to the known cache and the buffer that
+ * could not be sent is saved into the spool. Binary arrays are spooled
+ * as is and are replayed to /Data_Array.bin.
+ * @param success is the CURLcode of the request.
+ * @param url is the url where the request was sent.
+ * @param readbuffer is the buffer that was sent.
+ * @param length is the number of bytes of readbuffer.
+ * @param answer is what the server answered (unused).
+ * @param user_data is the data_request_t * of the request. It is freed
+ *        here.
+ */
+static void data_request_done(gint success, gchar *url, gchar *readbuffer, size_t length, gchar *answer, gpointer user_data)
+{
+    data_request_t *request = (data_request_t *) user_data;
 
-    if (ok == TRUE)
+    if (success == CURLE_OK)
         {
-            return iter;
+            known_add_list(request->known, request->hash_list);
         }
     else
         {
-            return NULL;
+            spool_append(request->spool, url, readbuffer, length);
         }
+
+    g_list_free_full(request->hash_list, free_hdt_struct);
+    free_variable(request);
 }
 
 
@@ -454,51 +580,140 @@ static GList *find_hash_in_list(GList *hash_data_list, guint8 *hash)
  * Inserts the array into a root json_t * structure and dumps it into a
  * buffer that is send to the server and then freed.
  * @param main_struct : main structure of the program.
+ * @param comm is the comm_t * structure used to talk to the server.
  * @param array is the json_t * array to be sent to the server
+ * @param hash_list is the list of hash_data_t * (only hashs) of the
+ *        blocks in array. It is freed here or once the request
+ *        completes.
+ * @returns the CURLcode of the request.
  */
-static gint insert_array_in_root_and_send(main_struct_t *main_struct, json_t *array)
+static gint insert_array_in_root_and_send(main_struct_t *main_struct, comm_t *comm, json_t *array, GList *hash_list)
 {
     json_t *root = NULL;
+    gchar *json_str = NULL;
     gint success = CURLE_FAILED_INIT;
 
     g_assert_nonnull(main_struct);
 
-    if (main_struct->comm != NULL && array != NULL)
+    if (comm != NULL && array != NULL)
         {
 
             root = json_object();
             insert_json_value_into_json_root(root, "data_array", array);
 
-            /* readbuffer is the buffer sent to server */
-            main_struct->comm->readbuffer = json_dumps(root, 0);
+            /* json_str is owned by the request from now on */
+            json_str = json_dumps(root, 0);
+            success = post_url_async(comm, "/Data_Array.json", json_str, strlen(json_str), data_request_done, new_data_request_t(main_struct, hash_list));
+
+            json_decref(root);
+        }
+    else
+        {
+            g_list_free_full(hash_list, free_hdt_struct);
+        }
+
+    return success;
+}
+
+
+/**
+ * Sends a binary data array to the server (/Data_Array.bin) and frees
+ * it. If the server can not be reached the request is spooled as is
+ * (a binary /Data_Array.bin request) through main_struct->spool by
+ * data_request_done() and is sent again once reconnected.
+ * @param main_struct : main structure of the program.
+ * @param comm is the comm_t * structure used to talk to the server.
+ * @param bin_array is the GByteArray filled with
+ *        append_hash_data_t_to_binary_array(). It is freed here.
+ * @param hash_list is the list of hash_data_t * (only hashs) of the
+ *        blocks in bin_array. It is freed here or once the request
+ *        completes.
+ * @returns the CURLcode of the request.
+ */
+static gint send_binary_array(main_struct_t *main_struct, comm_t *comm, GByteArray *bin_array, GList *hash_list)
+{
+    gint success = CURLE_FAILED_INIT;
+    gsize length = 0;
+    gchar *data = NULL;
 
-            success = post_url(main_struct->comm, "/Data_Array.json");
+    g_assert_nonnull(main_struct);
 
-            if (success != CURLE_OK)
+    if (comm != NULL && bin_array != NULL)
+        {
+            /* data is owned by the request from now on */
+            length = bin_array->len;
+            data = (gchar *) g_byte_array_free(bin_array, FALSE);
+            success = post_url_async(comm, "/Data_Array.bin", data, length, data_request_done, new_data_request_t(main_struct, hash_list));
+        }
+    else
+        {
+            if (bin_array != NULL)
                 {
-                    db_save_buffer(main_struct->database, "/Data_Array.json", main_struct->comm->readbuffer);
+                    g_byte_array_free(bin_array, TRUE);
                 }
 
-            free_variable(main_struct->comm->readbuffer);
-            json_decref(root);
-            free_variable(main_struct->comm->buffer);
-
+            g_list_free_full(hash_list, free_hdt_struct);
         }
 
     return success;
 }
 
 
+/**
+ * Adds to the known cache the blocks that the server told it has: the
+ * ones left in index that it did not ask for and that no other client
+ * promised to send.
+ * @param main_struct : main structure of the program.
+ * @param index is the index (see new_hash_index_from_list()) of the
+ *        blocks that the server did not ask for.
+ * @param pending is the list of hashs (hash_data_t *) that another
+ *        client is to send (may be NULL).
+ */
+static void add_blocks_the_server_has(main_struct_t *main_struct, GHashTable *index, GList *pending)
+{
+    GHashTableIter iter;
+    gpointer value = NULL;
+    GList *told = NULL;
+    hash_data_t *hash_data = NULL;
+
+    while (pending != NULL)
+        {
+            hash_data = pending->data;
+            g_hash_table_remove(index, hash_data->hash);
+            pending = g_list_next(pending);
+        }
+
+    g_hash_table_iter_init(&iter, index);
+
+    while (g_hash_table_iter_next(&iter, NULL, &value) == TRUE)
+        {
+            told = g_list_prepend(told, ((GList *) value)->data);
+        }
+
+    known_add_list(main_struct->known, told);
+    g_list_free(told);
+}
+
+
 /**
  * Sends data as requested by the server 'cdpfglserver' in a buffered way.
+ * When the server understands it, data is sent in binary form to
+ * /Data_Array.bin (no base64 nor JSON) and in JSON to /Data_Array.json
+ * otherwise. Blocks are added to the known cache once the server
+ * acknowledged them or told that it has them.
  * @param main_struct : main structure of the program.
+ * @param comm is the comm_t * structure used to talk to the server. It
+ *        must not be shared with an other thread.
  * @param hash_data_list : list of hash_data_t * pointers containing
  *                          all the data to be saved.
  * @param answer is the request sent back by server when we had send
  *        meta data.
- * @note using directly main_struct->comm->buffer -> not threadable as is.
+ * @param[out] pending is set to the list of hashs (hash_data_t * with
+ *             only a hash) that the server says another client is to
+ *             send ("pending_list") or to NULL.
+ * @returns the list of hash_data_t * that the server did not need.
  */
-static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_data_list, gchar *answer)
+static GList *send_needed_data_to_server(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, gchar *answer, GList **pending)
 {
     json_t *root = NULL;
     json_t *array = NULL;
@@ -510,68 +725,129 @@ static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_da
     gint bytes = 0;
     json_t *to_insert = NULL;
     gint64 limit = 0;
-    a_clock_t *elapsed = NULL;
+    gint64 elapsed = 0;
+    GHashTable *index = NULL;
+    GByteArray *bin_array = NULL;
+    gboolean binary = FALSE;
+    GList *batch = NULL;          /** batch is the list of the hashs of the blocks of the batch being filled */
 
     g_assert_nonnull(main_struct);
 
+    *pending = NULL;
+
     if (answer != NULL && hash_data_list != NULL && main_struct->opt != NULL)
         {
             root = load_json(answer);
 
-            limit = main_struct->opt->buffersize;
+            limit = get_batch_size(main_struct, comm, 0);
 
             if (root != NULL)
                 {
                     /* This hash_list is the needed hashs from server */
                     hash_list = extract_glist_from_array(root, "hash_list", TRUE);
+
+                    if (json_object_get(root, "pending_list") != NULL)
+                        {
+                            *pending = extract_glist_from_array(root, "pending_list", TRUE);
+                        }
+
                     json_decref(root);
 
-                    array = json_array();
+                    binary = (comm != NULL && comm->binary == TRUE);
+
+                    if (binary == TRUE)
+                        {
+                            bin_array = g_byte_array_new();
+                        }
+                    else
+                        {
+                            array = json_array();
+                        }
 
                     head = hash_list;
+                    /* hash_data_list contains all hashs and their associated data for the file
+                     * being processed */
+                    index = new_hash_index_from_list(hash_data_list);
 
                     while (hash_list != NULL)
                         {
                             hash_data = hash_list->data;
-                            /* hash_data_list contains all hashs and their associated data for the file
-                             * being processed */
-                            iter = find_hash_in_list(hash_data_list, hash_data->hash);
-                            found = iter->data;
+                            iter = g_hash_table_lookup(index, hash_data->hash);
+
+                            if (iter != NULL)
+                                {
+                                    found = iter->data;
 
-                            to_insert = convert_hash_data_t_to_json(found);
-                            json_array_append_new(array, to_insert);
+                                    if (binary == TRUE)
+                                        {
+                                            append_hash_data_t_to_binary_array(bin_array, found);
+                                        }
+                                    else
+                                        {
+                                            to_insert = convert_hash_data_t_to_json(found);
+                                            json_array_append_new(array, to_insert);
+                                        }
 
-                            bytes = bytes + found->read;
+                                    bytes = bytes + found->read;
+                                    batch = g_list_prepend(batch, copy_only_hash(found, NULL));
 
-                            hash_data_list = g_list_remove_link(hash_data_list, iter);
-                            /* iter is now a single element list and we can delete
-                             * data in this element and then remove this single element list
-                             */
-                            g_list_free_full(iter, free_hdt_struct);
+                                    g_hash_table_remove(index, found->hash);
+                                    hash_data_list = g_list_remove_link(hash_data_list, iter);
+                                    /* iter is now a single element list and we can delete
+                                     * data in this element and then remove this single element list
+                                     */
+                                    g_list_free_full(iter, free_hdt_struct);
+                                }
 
                             if (bytes >= limit)
                                 {
-                                    /* when we've got opt->buffersize bytes of data send them ! */
-                                    elapsed = new_clock_t();
-                                    insert_array_in_root_and_send(main_struct, array);
-                                    array = json_array();
+                                    /* when we've got a batch of data send them ! */
+                                    elapsed = trace_begin();
+                                    if (binary == TRUE)
+                                        {
+                                            send_binary_array(main_struct, comm, bin_array, batch);
+                                            bin_array = g_byte_array_new();
+                                        }
+                                    else
+                                        {
+                                            insert_array_in_root_and_send(main_struct, comm, array, batch);
+                                            array = json_array();
+                                        }
+                                    batch = NULL;
                                     bytes = 0;
-                                    end_clock(elapsed, "insert_array_in_root_and_send");
+                                    trace_end(elapsed, "insert_array_in_root_and_send");
                                 }
 
                             hash_list = g_list_next(hash_list);
                         }
 
+                    /* Blocks left in index are the ones the server did not ask for */
+                    add_blocks_the_server_has(main_struct, index, *pending);
+                    g_hash_table_destroy(index);
+
                     if (bytes > 0)
                         {
-                            /* Send the rest of the data (less than opt->buffersize bytes) */
-                            elapsed = new_clock_t();
-                            insert_array_in_root_and_send(main_struct, array);
-                            end_clock(elapsed, "insert_array_in_root_and_send");
+                            /* Send the rest of the data (less than a batch) */
+                            elapsed = trace_begin();
+                            if (binary == TRUE)
+                                {
+                                    send_binary_array(main_struct, comm, bin_array, batch);
+                                }
+                            else
+                                {
+                                    insert_array_in_root_and_send(main_struct, comm, array, batch);
+                                }
+                            trace_end(elapsed, "insert_array_in_root_and_send");
+                        }
+                    else if (binary == TRUE)
+                        {
+                            g_byte_array_free(bin_array, TRUE);
+                            g_list_free_full(batch, free_hdt_struct);
                         }
                     else
                         {
                             json_decref(array);
+                            g_list_free_full(batch, free_hdt_struct);
                         }
 
                     if (head != NULL)
@@ -590,78 +866,94 @@ static GList *send_all_data_to_server(main_struct_t *main_struct, GList *hash_da
 
 
 /**
- * Sends data as requested by the server 'cdpfglserver'.
+ * Sends data as requested by the server (see send_needed_data_to_server())
+ * and then waits for the hashs that the server says another client is
+ * to send ("pending_list"): see send_pending_data_to_server().
  * @param main_struct : main structure of the program.
+ * @param comm is the comm_t * structure used to talk to the server. It
+ *        must not be shared with an other thread.
  * @param hash_data_list : list of hash_data_t * pointers containing
  *                          all the data to be saved.
  * @param answer is the request sent back by server when we had send
  *        meta data.
- * @note using directly main_struct->comm->buffer -> not threadable as is.
+ * @returns the list of hash_data_t * that the server did not need.
  */
-static GList *send_data_to_server(main_struct_t *main_struct, GList *hash_data_list, gchar *answer)
+static GList *send_all_data_to_server(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, gchar *answer)
 {
-    json_t *root = NULL;
-    GList *hash_list = NULL;         /** hash_list is local to this function */
-    GList *head = NULL;
-    gint success = CURLE_FAILED_INIT;
-    GList *iter = NULL;
-    hash_data_t *found = NULL;
-    hash_data_t *hash_data = NULL;
+    GList *pending = NULL;
 
-    g_assert_nonnull(main_struct);
+    hash_data_list = send_needed_data_to_server(main_struct, comm, hash_data_list, answer, &pending);
 
-    if (main_struct->comm != NULL && answer != NULL &&  hash_data_list!= NULL)
+    if (pending != NULL)
         {
-            root = load_json(answer);
-
-            if (root != NULL)
-                {
-                    /* This hash_list is the needed hashs from server */
-                    hash_list = extract_glist_from_array(root, "hash_list", TRUE);
-                    json_decref(root);
-                    head = hash_list;
-
-                    while (hash_list != NULL)
-                        {
-                            hash_data = hash_list->data;
-                            /* hash_data_list contains all hashs and their associated data */
-                            iter = find_hash_in_list(hash_data_list, hash_data->hash);
-                            found = iter->data;
+            hash_data_list = send_pending_data_to_server(main_struct, comm, hash_data_list, pending);
+        }
 
-                            /* readbuffer is the buffer sent to server  */
-                            main_struct->comm->readbuffer = convert_hash_data_t_to_string(found);
-                            success = post_url(main_struct->comm, "/Data.json");
+    return hash_data_list;
+}
 
-                            if (success != CURLE_OK)
-                                {
-                                    db_save_buffer(main_struct->database, "/Data.json", main_struct->comm->readbuffer);
-                                }
 
-                            free_variable(main_struct->comm->readbuffer);
+/**
+ * Waits for blocks that the server says another client is to send and
+ * asks the server again about them until none is pending: the promise
+ * of that client is then either stored (the server does not need them
+ * anymore) or expired (the server asks for them and they are sent). The
+ * time between two questions doubles from CLIENT_PENDING_MIN_WAIT up to
+ * CLIENT_PENDING_MAX_WAIT. Once this function returns the server has
+ * (or is storing) every block of hash_data_list that it needed.
+ * @param main_struct : main structure of the program.
+ * @param comm is the comm_t * structure used to talk to the server.
+ * @param hash_data_list is the list of hash_data_t * not sent yet.
+ * @param pending is the list of pending hashs (hash_data_t * with only
+ *        a hash). It is freed here.
+ * @returns the list of hash_data_t * that the server did not need.
+ */
+static GList *send_pending_data_to_server(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, GList *pending)
+{
+    GHashTable *index = NULL;
+    GList *iter = NULL;
+    GList *found = NULL;
+    GList *waiting = NULL;
+    hash_data_t *hash_data = NULL;
+    gchar *answer = NULL;
+    guint wait = CLIENT_PENDING_MIN_WAIT;
 
-                            hash_data_list = g_list_remove_link(hash_data_list, iter);
-                            /* iter is now a single element list and we can delete
-                             * data in this element and then remove this single element list
-                             */
-                            g_list_free_full(iter, free_hdt_struct);
+    while (pending != NULL)
+        {
+            waiting = NULL;
+            index = new_hash_index_from_list(hash_data_list);
 
-                            free_variable(main_struct->comm->buffer);
-                            hash_list = g_list_next(hash_list);
-                        }
+            for (iter = pending; iter != NULL; iter = g_list_next(iter))
+                {
+                    hash_data = iter->data;
+                    found = g_hash_table_lookup(index, hash_data->hash);
 
-                    if (head != NULL)
+                    if (found != NULL)
                         {
-                            g_list_free_full(head, free_hdt_struct);
+                            g_hash_table_remove(index, hash_data->hash);
+                            hash_data_list = g_list_remove_link(hash_data_list, found);
+                            waiting = g_list_concat(found, waiting);
                         }
                 }
-            else
+
+            g_hash_table_destroy(index);
+            g_list_free_full(pending, free_hdt_struct);
+            pending = NULL;
+
+            if (waiting != NULL)
                 {
-                    print_error(__FILE__, __LINE__, _("Error while loading JSON answer from server\n"));
+                    print_debug(_("Waiting %u s for %u blocks promised by another client\n"), wait, g_list_length(waiting));
+                    g_usleep((gulong) wait * G_USEC_PER_SEC);
+                    wait = MIN(2 * wait, CLIENT_PENDING_MAX_WAIT);
+
+                    answer = send_hash_array_to_server(comm, waiting);
+                    waiting = send_needed_data_to_server(main_struct, comm, waiting, answer, &pending);
+                    hash_data_list = g_list_concat(waiting, hash_data_list);
+                    free_variable(answer);
                 }
         }
 
     return hash_data_list;
-
 }
 
 
@@ -670,8 +962,10 @@ static GList *send_data_to_server(main_struct_t *main_struct, GList *hash_data_l
  *          with free_file_event_t() when no longer needed
  * @param directory is the directory where the event occured
  * @param fileinfo is fileinfo of the file on which the event occured
+ * @param compact is TRUE when only the path of the file has to be kept
+ *        (low memory mode).
  */
-file_event_t *new_file_event_t(gchar *directory, GFileInfo *fileinfo)
+file_event_t *new_file_event_t(gchar *directory, GFileInfo *fileinfo, gboolean compact)
 {
     file_event_t *file_event = NULL;
 
@@ -679,8 +973,16 @@ file_event_t *new_file_event_t(gchar *directory, GFileInfo *fileinfo)
     file_event = (file_event_t *) g_malloc(sizeof(file_event_t));
     g_assert_nonnull(file_event);
 
-    file_event->directory = g_strdup(directory);
-    file_event->fileinfo = g_file_info_dup(fileinfo);
+    file_event->path = g_build_path(G_DIR_SEPARATOR_S, directory, g_file_info_get_name(fileinfo), NULL);
+
+    if (compact == TRUE)
+        {
+            file_event->fileinfo = NULL;
+        }
+    else
+        {
+            file_event->fileinfo = g_file_info_dup(fileinfo);
+        }
 
     return file_event;
 }
@@ -695,13 +997,62 @@ static void free_file_event_t(file_event_t *file_event)
 {
     if (file_event != NULL)
         {
-            free_variable(file_event->directory);
+            free_variable(file_event->path);
             free_object(file_event->fileinfo);
             free_variable(file_event);
         }
 }
 
 
+/**
+ * Queries the fileinfo of a compact file event (low memory mode) just
+ * before saving the file.
+ * @param file_event is the event of the file to be saved.
+ * @returns TRUE if file_event has a fileinfo, FALSE if the file could not
+ *          be queried (it may have been removed meanwhile).
+ */
+static gboolean load_file_event_fileinfo(file_event_t *file_event)
+{
+    GFile *file = NULL;
+    GError *error = NULL;
+
+    if (file_event->fileinfo == NULL)
+        {
+            file = g_file_new_for_path(file_event->path);
+            file_event->fileinfo = g_file_query_info(file, CLIENT_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, &error);
+
+            if (error != NULL)
+                {
+                    print_debug(_("Unable to get meta data for file %s: %s\n"), file_event->path, error->message);
+                    free_error(error);
+                }
+
+            free_object(file);
+        }
+
+    return (file_event->fileinfo != NULL);
+}
+
+
+/**
+ * Frees a meta_data_t structure made by the client: owner and group
+ * names are interned and are not freed. May be used with
+ * g_list_free_full().
+ * @param data is the meta_data_t * structure to be freed.
+ */
+static void free_client_meta_data_t(gpointer data)
+{
+    meta_data_t *meta = (meta_data_t *) data;
+
+    if (meta != NULL)
+        {
+            meta->owner = NULL;
+            meta->group = NULL;
+            free_meta_data_t(meta, TRUE);
+        }
+}
+
+
 /**
  * @returns a newly allocated filter_file_t * structure that must be freed
  *          with free_filter_t() when no longer needed.
@@ -745,23 +1096,38 @@ static void free_filter_file_t(filter_file_t *filter)
 
 /**
  * Threaded function that saves one file by getting it's meta-data and
- * it's data and sends them to the server in order to be saved.
- * @param data must be main_struct_t * pointer.
+ * it's data and sends them to the server in order to be saved. Many of
+ * these threads pop file events from the same scheduler (live events
+ * first).
+ * @param data must be a worker_t * pointer.
  */
 static gpointer save_one_file_threaded(gpointer data)
 {
-    main_struct_t *main_struct = (main_struct_t *) data;
+    worker_t *worker = (worker_t *) data;
+    main_struct_t *main_struct = NULL;
     file_event_t *file_event = NULL;
+    gint class = SCHEDULER_LIVE;
 
-    g_assert_nonnull(main_struct);
+    g_assert_nonnull(worker);
+    main_struct = worker->main_struct;
 
-    if (main_struct->save_queue != NULL)
+    if (main_struct != NULL && main_struct->scheduler != NULL)
         {
             while (1)
                 {
-                    file_event = g_async_queue_pop(main_struct->save_queue);
-                    save_one_file(main_struct, file_event);
+                    file_event = scheduler_try_pop(main_struct->scheduler, &class);
+
+                    if (file_event == NULL)
+                        {
+                            /* Nothing to do: sends waiting small files and completes in flight requests before sleeping */
+                            send_small_files_of_worker(worker);
+                            comm_wait_all_requests(worker->comm);
+                            file_event = scheduler_pop(main_struct->scheduler, &class);
+                        }
+
+                    save_one_file(worker, file_event);
                     free_file_event_t(file_event);
+                    scheduler_done(main_struct->scheduler, class);
                 }
         }
 
@@ -770,50 +1136,106 @@ static gpointer save_one_file_threaded(gpointer data)
 
 
 /**
- * Calculates the block size to be used upon a file
+ * Creates a new worker with its own connexion to the server and starts
+ * its thread.
+ * @param main_struct : main structure of the program.
+ * @param conn is the connexion string to the server.
+ * @param number is the number of the worker (used to name the thread).
+ * @returns a newly allocated worker_t * structure.
+ */
+static worker_t *new_worker_t(main_struct_t *main_struct, gchar *conn, guint number)
+{
+    worker_t *worker = NULL;
+    gchar *name = NULL;
+
+    worker = (worker_t *) g_malloc0(sizeof(worker_t));
+    g_assert_nonnull(worker);
+
+    worker->main_struct = main_struct;
+    worker->comm = init_comm_struct(conn, main_struct->opt->cmptype);
+    worker->comm->pending_list = TRUE;
+    worker->small_files = NULL;
+    worker->small_data = NULL;
+    worker->small_count = 0;
+    worker->small_bytes = 0;
+
+    /* Protocols have already been negotiated with main_struct->comm */
+    if (main_struct->comm != NULL)
+        {
+            worker->comm->binary = main_struct->comm->binary;
+            worker->comm->meta_array = main_struct->comm->meta_array;
+        }
+
+    /* Data requests may be in flight while the next meta data are sent */
+    if (main_struct->opt->low_memory == TRUE)
+        {
+            comm_enable_multi(worker->comm, CLIENT_LOW_MEMORY_MAX_IN_FLIGHT);
+        }
+    else
+        {
+            comm_enable_multi(worker->comm, CLIENT_MAX_IN_FLIGHT);
+        }
+
+    name = g_strdup_printf("save_one_file-%u", number);
+    worker->thread = g_thread_new(name, save_one_file_threaded, worker);
+    free_variable(name);
+
+    return worker;
+}
+
+
+/**
+ * Calculates the block size to be used upon a file. It does not change
+ * any option: the size of the batches of big files is chosen by
+ * get_batch_size().
  * @param opt are the selected options for the program.
+ * @param tuner is the block size of each class of files (NULL unless
+ *        auto-tune mode).
  * @param size is the size of the considered file.
  */
-static gint64 calculate_file_blocksize(options_t *opt, gint64 size)
+static gint64 calculate_file_blocksize(options_t *opt, tuner_t *tuner, gint64 size)
 {
 
-    if (opt != NULL && opt->adaptive == TRUE)
+    if (opt != NULL && opt->cdc == TRUE)
+        {
+            /* Blocks are content defined: blocksize is their maximum size */
+            return opt->cdc_max;
+        }
+    else if (opt != NULL && opt->adaptive == TRUE)
         {
             if (size < 32768)            /* max 64 blocks       */
                 {
-                    return 512;
+                    return tuner_get_blocksize(tuner, size, 512);
                 }
             else if (size < 262144)      /* max 128 blocks      */
                 {
-                    return 2048;
+                    return tuner_get_blocksize(tuner, size, 2048);
                 }
             else if (size < 1048576)     /* max 128 blocks      */
                 {
-                    return 8192;
+                    return tuner_get_blocksize(tuner, size, 8192);
                 }
             else if (size < 8388608)     /* max 512 blocks      */
                 {
-                    return 16384;
+                    return tuner_get_blocksize(tuner, size, 16384);
                 }
             else if (size < 67108864)    /* max 1024 blocks     */
                 {
-                    return 65536;
+                    return tuner_get_blocksize(tuner, size, 65536);
                 }
             else if (size < 134217728)   /* max 1024 blocks     */
                 {
-                    opt->buffersize = (CLIENT_MIN_BUFFER) * 2;
-                    return 131072;
+                    return tuner_get_blocksize(tuner, size, 131072);
                 }
             else                         /* at least 512 blocks */
                 {
-                    opt->buffersize = (CLIENT_MIN_BUFFER) * 4;
-                    return 262144;
+                    return tuner_get_blocksize(tuner, size, 262144);
                 }
         }
     else if (opt != NULL)
         {
             /* default case */
-             return opt->blocksize;
+             return tuner_get_blocksize(tuner, size, opt->blocksize);
         }
     else
         {
@@ -824,66 +1246,218 @@ static gint64 calculate_file_blocksize(options_t *opt, gint64 size)
 
 
 /**
- * Process the file that is not already in our local cache
- * @param main_struct : main structure of the program
- * @param meta is the meta data of the file to be processed (it does
- *             not contain any hashs at that point).
+ * Sends meta data of many files in one /Meta_Array.json request and
+ * returns the server's answer: the union of the hashs needed for all
+ * those files. Files whose blocks are all known by the server are sent
+ * with data_sent set so that the server does not look their hashs up.
+ * In case of an error the request is saved in the spool and the answer
+ * is made of every hash of the files.
+ * @param main_struct : main structure of the program.
+ * @param comm is the comm_t * structure used to talk to the server.
+ * @param meta_list is a GList of meta_data_t * structures.
+ * @returns a newly allocated gchar * string that may be freed when no
+ *          longer needed.
  */
-static void process_small_file_not_in_cache(main_struct_t *main_struct, meta_data_t *meta)
+static gchar *send_meta_array_to_server(main_struct_t *main_struct, comm_t *comm, GList *meta_list)
 {
-    GFile *a_file = NULL;
+    gchar *json_str = NULL;
     gchar *answer = NULL;
-    gint success = 0;      /** success returns a CURL Error status such as CURLE_OK for instance */
-    a_clock_t *mesure_time = NULL;
-    gshort cmptype = COMPRESS_NONE_TYPE;
+    gint success = CURLE_FAILED_INIT;
+    json_t *root = NULL;
+    json_t *array = NULL;
+    json_t *hashs = NULL;
+    GList *iter = NULL;
+    meta_data_t *meta = NULL;
 
     g_assert_nonnull(main_struct);
+    g_assert_nonnull(comm);
 
-    if (main_struct->opt != NULL && meta != NULL)
+    if (meta_list != NULL && main_struct->hostname != NULL)
         {
-            cmptype = main_struct->opt->cmptype;
-
-            print_debug(_("Processing small file: %s\n"), meta->name);
+            root = json_object();
+            array = json_array();
 
-            if (meta->file_type == G_FILE_TYPE_REGULAR)
+            for (iter = meta_list; iter != NULL; iter = g_list_next(iter))
                 {
-                    mesure_time = new_clock_t();
+                    meta = iter->data;
+                    json_array_append_new(array, convert_meta_data_to_json(meta, main_struct->hostname, known_contains_all(main_struct->known, meta->hashs, meta->nb_hashs)));
+                }
 
-                    /* Calculates hashs and takes care of data */
-                    a_file = g_file_new_for_path(meta->name);
-                    meta->hash_data_list = calculate_hash_data_list_for_file(a_file, meta->blocksize, cmptype);
-                    free_object(a_file);
-
-                    end_clock(mesure_time, "calculate_hash_data_list");
-                }
+            insert_json_value_into_json_root(root, "file_list", array);
+            json_str = json_dumps(root, 0);
+            json_decref(root);
 
-            mesure_time = new_clock_t();
-            answer = send_meta_data_to_server(main_struct, meta, FALSE);
-            end_clock(mesure_time, "send_meta_data_to_server");
+            print_debug(_("Sending meta data of %u files\n"), g_list_length(meta_list));
+            comm->readbuffer = json_str;
+            success = post_url(comm, "/Meta_Array.json");
 
-            mesure_time = new_clock_t();
-            if (meta->size < meta->blocksize)
+            if (success == CURLE_OK)
                 {
-                    /* Only one block to send (size is less than blocksize's value) */
-                     meta->hash_data_list = send_data_to_server(main_struct, meta->hash_data_list, answer);
+                    answer = g_strdup(comm->buffer);
+                    free_variable(comm->buffer);
                 }
             else
                 {
-                    /* A least 2 blocks to send */
-                    meta->hash_data_list = send_all_data_to_server(main_struct, meta->hash_data_list, answer);
+                    spool_append(main_struct->spool, "/Meta_Array.json", comm->readbuffer, strlen(comm->readbuffer));
+
+                    /* As in send_meta_data_to_server() a 'fake' answer with every hash is built */
+                    array = json_array();
+
+                    for (iter = meta_list; iter != NULL; iter = g_list_next(iter))
+                        {
+                            meta = iter->data;
+                            hashs = convert_hash_array_to_json(meta->hashs, meta->nb_hashs);
+                            json_array_extend(array, hashs);
+                            json_decref(hashs);
+                        }
+
+                    root = json_object();
+                    insert_json_value_into_json_root(root, "hash_list", array);
+                    answer = json_dumps(root, 0);
+                    json_decref(root);
                 }
-            end_clock(mesure_time, "send_(all)_data_to_server");
 
-            free_variable(answer); /* Not used by now */
+            free_variable(comm->readbuffer);
+            comm->readbuffer = NULL;
+        }
 
-            if (success == CURLE_OK)
+    return answer;
+}
+
+
+/**
+ * Gives the size of a batch. It is opt->buffersize or, in auto-tune
+ * mode, the size tuned from the latency and the bandwidth measured on
+ * comm. Files with big blocks (adaptive mode) get batches of at least
+ * 2 or 4 times CLIENT_MIN_BUFFER.
+ * @param main_struct : main structure of the program
+ * @param comm is the comm_t * structure used to talk to the server.
+ * @param blocksize is the block size of the file (0 when unknown).
+ * @returns the number of bytes of file data in a batch: at most half
+ *          of opt->memory_limit as two batches of a file may be in
+ *          memory at the same time.
+ */
+static gsize get_batch_size(main_struct_t *main_struct, comm_t *comm, gint64 blocksize)
+{
+    options_t *opt = main_struct->opt;
+    gsize size = (gsize) opt->buffersize;
+    gsize tuned = 0;
+
+    if (opt->auto_tune == TRUE)
+        {
+            tuned = comm_get_tuned_size(comm, TUNER_MIN_BUFFER, TUNER_MAX_BUFFER);
+
+            if (tuned > 0)
+                {
+                    size = tuned;
+                }
+        }
+
+    if (opt->adaptive == TRUE && opt->cdc == FALSE && blocksize >= 262144)
+        {
+            size = MAX(size, (gsize) (CLIENT_MIN_BUFFER) * 4);
+        }
+    else if (opt->adaptive == TRUE && opt->cdc == FALSE && blocksize >= 131072)
+        {
+            size = MAX(size, (gsize) (CLIENT_MIN_BUFFER) * 2);
+        }
+
+    if (opt->memory_limit > 0 && size > (gsize) opt->memory_limit / 2)
+        {
+            size = (gsize) opt->memory_limit / 2;
+        }
+
+    return size;
+}
+
+
+/**
+ * Keeps a small file in the worker to send it later along with others
+ * (one /Meta_Array.json request and data arrays for all of them)
+ * when the server understands /Meta_Array.json.
+ * @param worker is the worker_t * structure of the calling thread.
+ * @param meta is the meta_data_t * of a file that is not in the cache.
+ *        When TRUE is returned its ownership is transfered to the
+ *        worker. Its blocks (with data) are kept in worker->small_data
+ *        and meta only gets their hashs.
+ * @returns TRUE if the worker kept the file and FALSE if it has to be
+ *          processed right now.
+ */
+static gboolean add_small_file_to_worker(worker_t *worker, meta_data_t *meta)
+{
+    main_struct_t *main_struct = worker->main_struct;
+    GFile *a_file = NULL;
+    GList *hash_data_list = NULL;
+
+    if (worker->comm->meta_array == FALSE || meta->size >= (guint64) get_batch_size(main_struct, worker->comm, meta->blocksize))
+        {
+            return FALSE;
+        }
+
+    if (meta->file_type == G_FILE_TYPE_REGULAR)
+        {
+            a_file = g_file_new_for_path(meta->name);
+            hash_data_list = calculate_hash_data_list_for_file(main_struct->buffer_pool, main_struct->chunker, a_file, meta->blocksize, main_struct->opt->cmptype);
+            meta->hashs = make_hash_array_from_hash_data_list(hash_data_list, &meta->nb_hashs);
+            worker->small_data = g_list_concat(g_list_reverse(hash_data_list), worker->small_data);
+            free_object(a_file);
+        }
+
+    worker->small_files = g_list_prepend(worker->small_files, meta);
+    worker->small_count = worker->small_count + 1;
+    worker->small_bytes = worker->small_bytes + meta->size;
+
+    return TRUE;
+}
+
+
+/**
+ * Sends every small file kept by the worker: meta data go in one
+ * /Meta_Array.json request and needed data in data arrays of at most
+ * opt->buffersize bytes. Files are then saved in the local cache.
+ * @param worker is the worker_t * structure of the calling thread.
+ */
+static void send_small_files_of_worker(worker_t *worker)
+{
+    main_struct_t *main_struct = worker->main_struct;
+    GList *meta_list = NULL;
+    GList *iter = NULL;
+    GList *hash_data_list = NULL;
+    gchar *answer = NULL;
+    gint64 mesure_time = 0;
+
+    if (worker->small_files != NULL)
+        {
+            meta_list = g_list_reverse(worker->small_files);
+            worker->small_files = NULL;
+            /* Data of all files is sent as if it were only one file */
+            hash_data_list = g_list_reverse(worker->small_data);
+            worker->small_data = NULL;
+            worker->small_count = 0;
+            worker->small_bytes = 0;
+
+            mesure_time = trace_begin();
+            answer = send_meta_array_to_server(main_struct, worker->comm, meta_list);
+            trace_end(mesure_time, "send_meta_array_to_server");
+
+            /* Blocks of zeros are never sent */
+            hash_data_list = remove_known_blocks(hash_data_list);
+
+            mesure_time = trace_begin();
+            hash_data_list = send_all_data_to_server(main_struct, worker->comm, hash_data_list, answer);
+            trace_end(mesure_time, "send_all_data_to_server");
+
+            g_list_free_full(hash_data_list, free_hdt_struct);
+            free_variable(answer);
+
+            mesure_time = trace_begin();
+            for (iter = meta_list; iter != NULL; iter = g_list_next(iter))
                 {
-                    /* Everything has been transmitted so we can save meta data into the local db cache */
-                    /* This is usefull for file carving to avoid sending too much things to the server  */
-                    mesure_time = new_clock_t();
-                    db_save_meta_data(main_struct->database, meta, TRUE);
-                    end_clock(mesure_time, "db_save_meta_data");
+                    db_save_meta_data(main_struct->database, iter->data, TRUE);
                 }
+            trace_end(mesure_time, "db_save_meta_data");
+
+            g_list_free_full(meta_list, free_client_meta_data_t);
         }
 }
 
@@ -938,134 +1512,425 @@ static gchar *send_hash_array_to_server(comm_t *comm, GList *hash_data_list)
 }
 
 
-static GList *lets_send_all_that_now(main_struct_t *main_struct, GList *hash_data_list, GList *saved_list, gsize read_bytes)
+/**
+ * Removes from a list the blocks that have been found in the previous
+ * version of the file and the blocks of zeros (those have a hash but
+ * no data).
+ * @param hash_data_list is a list of hash_data_t *.
+ * @returns the list without those blocks (that are freed).
+ */
+static GList *remove_known_blocks(GList *hash_data_list)
+{
+    GList *iter = hash_data_list;
+    GList *next = NULL;
+    hash_data_t *hash_data = NULL;
+
+    while (iter != NULL)
+        {
+            next = g_list_next(iter);
+            hash_data = (hash_data_t *) iter->data;
+
+            if (hash_data != NULL && hash_data->data == NULL)
+                {
+                    free_hash_data_t(hash_data);
+                    hash_data_list = g_list_delete_link(hash_data_list, iter);
+                }
+
+            iter = next;
+        }
+
+    return hash_data_list;
+}
+
+
+/**
+ * Removes from a list the blocks that the server is known to have (see
+ * known.h).
+ * @param known is the cache of hashs known by the server.
+ * @param hash_data_list is a list of hash_data_t *.
+ * @returns the list without those blocks (that are freed).
+ */
+static GList *remove_blocks_known_by_server(known_t *known, GList *hash_data_list)
+{
+    GList *iter = hash_data_list;
+    GList *next = NULL;
+    hash_data_t *hash_data = NULL;
+
+    while (iter != NULL)
+        {
+            next = g_list_next(iter);
+            hash_data = (hash_data_t *) iter->data;
+
+            if (hash_data != NULL && known_lookup(known, hash_data->hash) == TRUE)
+                {
+                    free_hash_data_t(hash_data);
+                    hash_data_list = g_list_delete_link(hash_data_list, iter);
+                }
+
+            iter = next;
+        }
+
+    return hash_data_list;
+}
+
+
+/**
+ * Sends a buffer's worth of blocks to the server: first their hashs and
+ * then the data of the blocks that the server needs. Blocks that the
+ * server is known to have are not proposed to it.
+ * @param main_struct : main structure of the program
+ * @param comm is the comm_t * structure used to talk to the server.
+ * @param hash_data_list is the list of blocks to be sent (in reverse
+ *        order). It is freed here.
+ * @param saved_list is the list of hashs already sent for this file (in
+ *        reverse order).
+ * @param read_bytes is the number of bytes of hash_data_list.
+ * @param[in,out] sent is increased by the number of blocks whose data
+ *                were sent to the server (may be NULL).
+ * @returns saved_list with the hashs of hash_data_list prepended.
+ */
+static GList *lets_send_all_that_now(main_struct_t *main_struct, comm_t *comm, GList *hash_data_list, GList *saved_list, gsize read_bytes, guint64 *sent)
 {
     GList *hdl_copy = NULL;
-    a_clock_t *elapsed = NULL;
+    gint64 elapsed = 0;
     gchar *answer = NULL;
+    guint nb_asked = 0;
 
-    elapsed = new_clock_t();
+    elapsed = trace_begin();
     print_debug(_("Sending data: %d bytes\n"), read_bytes);
     /* 0. Save the list in order to keep hashs for meta-data */
     hdl_copy = g_list_copy_deep(hash_data_list, copy_only_hash, NULL);
     saved_list = g_list_concat(hdl_copy, saved_list);
 
+    /* Unchanged blocks of the previous version (no data) are already on the server */
+    hash_data_list = remove_known_blocks(hash_data_list);
+    hash_data_list = remove_blocks_known_by_server(main_struct->known, hash_data_list);
+
     /* 1. Send an array of hashs to Hash_Array.json server url */
-    answer = send_hash_array_to_server(main_struct->comm, hash_data_list);
+    answer = send_hash_array_to_server(comm, hash_data_list);
 
     /* 2. Keep only hashs that are needed (answer from the server) */
-    hash_data_list = send_all_data_to_server(main_struct, hash_data_list, answer);
+    nb_asked = g_list_length(hash_data_list);
+    hash_data_list = send_all_data_to_server(main_struct, comm, hash_data_list, answer);
+
+    if (sent != NULL && answer != NULL)
+        {
+            /* Blocks that are left are the ones the server did not need */
+            *sent = *sent + nb_asked - g_list_length(hash_data_list);
+        }
+    else if (sent != NULL)
+        {
+            /* Without answer nothing is known to be deduplicated */
+            *sent = *sent + nb_asked;
+        }
 
     /* 3. free memory of this list if any is left */
     g_list_free_full(hash_data_list, free_hdt_struct);
+    free_variable(answer);
+
+    trace_end(elapsed, "lets_send_all_that_now");
+
+    return saved_list;
+}
+
+
+/**
+ * Calculates the hash of one block and compresses it. This is the
+ * function run by the threads of main_struct->hash_pool. A block that
+ * is unchanged since the previous version of the file gets the hash it
+ * had then and no data. Holes and blocks of zeros get the zero hash
+ * and no data.
+ * @param data is the block_t * to be processed.
+ * @param user_data is not used.
+ */
+static void hash_one_block(gpointer data, gpointer user_data)
+{
+    block_t *block = (block_t *) data;
+    batch_t *batch = NULL;
+    guint8 *a_hash = NULL;
+    guint8 *known = NULL;
+    gint64 span = 0;
+
+    g_assert_nonnull(block);
+    batch = block->batch;
+    span = trace_begin();
+
+    a_hash = (guint8 *) buffer_pool_alloc(batch->pool, HASH_LEN);
+
+    if (block->buffer == NULL || is_zero_buffer(block->buffer, block->read) == TRUE)
+        {
+            buffer_pool_release(batch->pool, block->buffer);
+            make_zero_hash(block->read, a_hash);
+            block->hash_data = new_hash_data_t_from_pool(batch->pool, NULL, block->read, a_hash, COMPRESS_NONE_TYPE);
+        }
+    else
+        {
+            if (batch->delta != NULL)
+                {
+                    delta_fingerprint(batch->delta->key, block->buffer, block->read, block->fingerprint);
+                    known = delta_lookup(batch->delta, block->fingerprint, block->read);
+                }
+
+            if (known != NULL)
+                {
+                    memcpy(a_hash, known, HASH_LEN);
+                    buffer_pool_release(batch->pool, block->buffer);
+                    block->hash_data = new_hash_data_t_from_pool(batch->pool, NULL, block->read, a_hash, COMPRESS_NONE_TYPE);
+                }
+            else
+                {
+                    calculate_hash_into(block->buffer, block->read, a_hash);
+
+                    /* buffer is compressed or owned by hash_data from now on */
+                    block->hash_data = new_hash_data_t_from_pool(batch->pool, block->buffer, block->read, a_hash, batch->cmptype);
+                }
+        }
+    block->buffer = NULL;
+
+    trace_end(span, "hash_one_block");
+
+    g_mutex_lock(&batch->mutex);
+    batch->pending = batch->pending - 1;
+    if (batch->pending == 0)
+        {
+            g_cond_signal(&batch->cond);
+        }
+    g_mutex_unlock(&batch->mutex);
+}
+
+
+/**
+ * @returns a newly allocated empty batch_t * structure.
+ * @param pool is the pool where blocks and their buffers come from.
+ * @param cmptype is the compression type to be used on the blocks.
+ * @param delta is the delta_t structure of the file (may be NULL).
+ */
+static batch_t *new_batch_t(buffer_pool_t *pool, gshort cmptype, delta_t *delta)
+{
+    batch_t *batch = NULL;
+
+    batch = (batch_t *) g_malloc0(sizeof(batch_t));
+    g_assert_nonnull(batch);
+
+    g_mutex_init(&batch->mutex);
+    g_cond_init(&batch->cond);
+    batch->pending = 0;
+    batch->blocks = g_ptr_array_new();
+    batch->read_bytes = 0;
+    batch->cmptype = cmptype;
+    batch->pool = pool;
+    batch->delta = delta;
+
+    return batch;
+}
 
-    end_clock(elapsed, "lets_send_all_that_now");
+
+/**
+ * Adds a block to the batch and pushes it to the hash pool.
+ * @param hash_pool is the pool of threads that hashes blocks.
+ * @param batch is the batch where to add the block.
+ * @param buffer is the data of the block (allocated from batch->pool,
+ *        its ownership is transfered) or NULL for a hole.
+ * @param read is the number of bytes in buffer (or in the hole).
+ */
+static void add_block_to_batch(GThreadPool *hash_pool, batch_t *batch, guchar *buffer, gssize read)
+{
+    block_t *block = NULL;
+
+    block = (block_t *) buffer_pool_alloc(batch->pool, sizeof(block_t));
+
+    block->buffer = buffer;
+    block->read = read;
+    block->hash_data = NULL;
+    block->batch = batch;
+
+    g_ptr_array_add(batch->blocks, block);
+
+    /* Holes are not read and do not fill the batch */
+    if (buffer != NULL)
+        {
+            batch->read_bytes = batch->read_bytes + read;
+        }
+
+    g_mutex_lock(&batch->mutex);
+    batch->pending = batch->pending + 1;
+    g_mutex_unlock(&batch->mutex);
+
+    g_thread_pool_push(hash_pool, block, NULL);
+}
+
+
+/**
+ * Waits until every block of the batch has been processed and frees
+ * the batch. Blocks are recorded in the delta_t structure of the batch
+ * in file order.
+ * @param batch is the batch to wait for.
+ * @returns the list of hash_data_t * of the batch in reverse order (as
+ *          expected by lets_send_all_that_now()).
+ */
+static GList *wait_for_batch(batch_t *batch)
+{
+    GList *hash_data_list = NULL;
+    block_t *block = NULL;
+    guint i = 0;
+
+    if (batch != NULL)
+        {
+            g_mutex_lock(&batch->mutex);
+            while (batch->pending > 0)
+                {
+                    g_cond_wait(&batch->cond, &batch->mutex);
+                }
+            g_mutex_unlock(&batch->mutex);
+
+            for (i = 0; i < batch->blocks->len; i++)
+                {
+                    block = g_ptr_array_index(batch->blocks, i);
+
+                    if (batch->delta != NULL && is_zero_hash(block->hash_data->hash, NULL) == FALSE)
+                        {
+                            if (block->hash_data->data == NULL)
+                                {
+                                    batch->delta->reused = batch->delta->reused + 1;
+                                }
+                            delta_add_block(batch->delta, block->fingerprint, block->read, block->hash_data->hash);
+                        }
+
+                    hash_data_list = g_list_prepend(hash_data_list, block->hash_data);
+                    buffer_pool_release(batch->pool, block);
+                }
+
+            g_ptr_array_free(batch->blocks, TRUE);
+            g_mutex_clear(&batch->mutex);
+            g_cond_clear(&batch->cond);
+            free_variable(batch);
+        }
+
+    return hash_data_list;
+}
+
+
+/**
+ * Waits for a batch and sends it to the server.
+ * @param main_struct : main structure of the program
+ * @param comm is the comm_t * structure used to talk to the server.
+ * @param batch is the batch to be sent (may be NULL). It is freed here.
+ * @param saved_list is the list of hashs already sent for this file (in
+ *        reverse order).
+ * @param[in,out] sent is increased by the number of blocks whose data
+ *                were sent to the server (may be NULL).
+ * @returns saved_list with the hashs of the batch prepended.
+ */
+static GList *send_batch(main_struct_t *main_struct, comm_t *comm, batch_t *batch, GList *saved_list, guint64 *sent)
+{
+    GList *hash_data_list = NULL;
+    gsize read_bytes = 0;
+
+    if (batch != NULL)
+        {
+            read_bytes = batch->read_bytes;
+            hash_data_list = wait_for_batch(batch);
+            saved_list = lets_send_all_that_now(main_struct, comm, hash_data_list, saved_list, read_bytes, sent);
+        }
 
     return saved_list;
 }
 
 
 /**
- * Process the file that is not already in our local cache
+ * Process the file that is not already in our local cache. The file is
+ * read in batches of get_batch_size() bytes whatever its size is: at
+ * most two batches are in memory. Blocks of a batch are hashed and
+ * compressed by the threads of main_struct->hash_pool while the
+ * previous batch is being sent to the server. Blocks found unchanged in
+ * the previous version of the file (see delta.h) are not hashed again
+ * nor sent. Holes of sparse files are not read and, like blocks of
+ * zeros, only get the zero hash. Files that are not regular ones only
+ * have meta data.
  * @param main_struct : main structure of the program
+ * @param comm is the comm_t * structure used to talk to the server.
  * @param meta is the meta data of the file to be processed (it does
  *             not contain any hashs at that point).
  */
-static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_t *meta)
+static void process_file_not_in_cache(main_struct_t *main_struct, comm_t *comm, meta_data_t *meta)
 {
     GFile *a_file = NULL;
     gchar *answer = NULL;
     GFileInputStream *stream = NULL;
     GError *error = NULL;
-    GList *hash_data_list = NULL;
     GList *saved_list = NULL;
-    hash_data_t *hash_data = NULL;
+    block_reader_t *reader = NULL;
+    batch_t *batch = NULL;
+    batch_t *previous = NULL;
     gssize size_read = 0;
     guchar *buffer = NULL;
-    GChecksum *checksum = NULL;
-    guint8 *a_hash = NULL;
-    gsize digest_len = HASH_LEN;
-    gsize read_bytes = 0;
-    a_clock_t *elapsed = NULL;
-    gshort cmptype = COMPRESS_NONE_TYPE;
+    gint64 elapsed = 0;
+    delta_t *delta = NULL;
+    gboolean read_ok = FALSE;
+    gsize batch_size = 0;
+    guint64 sent = 0;
 
     g_assert_nonnull(main_struct);
 
     if (main_struct->opt != NULL && meta != NULL)
         {
-            cmptype = main_struct->opt->cmptype;
-
+            batch_size = get_batch_size(main_struct, comm, meta->blocksize);
             a_file = g_file_new_for_path(meta->name);
             print_debug(_("Processing file: %s\n"), meta->name);
 
-            if (a_file != NULL)
+            if (a_file != NULL && meta->file_type != G_FILE_TYPE_REGULAR)
+                {
+                    read_ok = TRUE;
+                }
+            else if (a_file != NULL)
                 {
+                    delta = new_delta_t(main_struct->database, meta->name, main_struct->delta_key);
                     stream = g_file_read(a_file, NULL, &error);
 
                     if (stream != NULL && error == NULL)
                         {
+                            reader = new_block_reader_t((GInputStream *) stream, main_struct->chunker, meta->blocksize, meta->name);
+                            size_read = block_reader_read(reader, main_struct->buffer_pool, &buffer, &error);
 
-                            checksum = g_checksum_new(G_CHECKSUM_SHA256);
-                            buffer = (guchar *) g_malloc(meta->blocksize);
-                            a_hash = (guint8 *) g_malloc(digest_len);
-
-                            size_read = g_input_stream_read((GInputStream *) stream, buffer, meta->blocksize, NULL, &error);
-                            read_bytes = read_bytes + size_read;
-
-                            while (size_read != 0 && error == NULL)
+                            while (size_read > 0 && error == NULL)
                                 {
-                                    g_checksum_update(checksum, buffer, size_read);
-                                    g_checksum_get_digest(checksum, a_hash, &digest_len);
-
-                                    /* Need to save 'data', 'read' and digest hash in an hash_data_t structure */
-                                    hash_data = new_hash_data_t(buffer, size_read, a_hash, cmptype);
-                                    hash_data_list = g_list_prepend(hash_data_list, hash_data);
-                                    if (cmptype != COMPRESS_NONE_TYPE)
+                                    if (batch == NULL)
                                         {
-                                            free_variable(buffer); /* buffer has been compressed and is no longer needed in the program */
+                                            batch = new_batch_t(main_struct->buffer_pool, main_struct->opt->cmptype, delta);
                                         }
 
-                                    g_checksum_reset(checksum);
-                                    digest_len = HASH_LEN;
+                                    add_block_to_batch(main_struct->hash_pool, batch, buffer, size_read);
 
-                                    if (read_bytes >= main_struct->opt->buffersize)
+                                    if (batch->read_bytes >= batch_size)
                                         {
-                                            /* Buffer is full so we need to send it to the server */
-                                            saved_list = lets_send_all_that_now(main_struct, hash_data_list, saved_list, read_bytes);
-                                            hash_data_list = NULL;
-                                            read_bytes = 0;
+                                            /* Buffer is full: sends the previous one while this one is being hashed */
+                                            saved_list = send_batch(main_struct, comm, previous, saved_list, &sent);
+                                            previous = batch;
+                                            batch = NULL;
                                         }
 
-                                    buffer = (guchar *) g_malloc(meta->blocksize);
-                                    a_hash = (guint8 *) g_malloc(digest_len);
-                                    size_read = g_input_stream_read((GInputStream *) stream, buffer, meta->blocksize, NULL, &error);
-                                    read_bytes = read_bytes + size_read;
+                                    size_read = block_reader_read(reader, main_struct->buffer_pool, &buffer, &error);
                                 }
 
                             if (error != NULL)
                                 {
                                     print_error(__FILE__, __LINE__, _("Error while reading file: %s\n"), error->message);
                                     free_error(error);
-                                    g_list_free_full(hash_data_list, free_hdt_struct);
-                                    hash_data_list =  NULL;
+                                    g_list_free_full(wait_for_batch(previous), free_hdt_struct);
+                                    g_list_free_full(wait_for_batch(batch), free_hdt_struct);
                                 }
                             else
                                 {
-                                    if (read_bytes > 0)
-                                        {
-                                            /* Last buffer for that file : send it to the server */
-                                            saved_list = lets_send_all_that_now(main_struct, hash_data_list, saved_list, read_bytes);
-                                            hash_data_list = NULL;
-                                            read_bytes = 0;
-                                        }
+                                    /* Last buffers for that file : send them to the server */
+                                    saved_list = send_batch(main_struct, comm, previous, saved_list, &sent);
+                                    saved_list = send_batch(main_struct, comm, batch, saved_list, &sent);
 
                                     /* get the list in correct order (because we prepended the hashs to get speed when inserting hashs in the list) */
                                     saved_list = g_list_reverse(saved_list);
+                                    read_ok = TRUE;
                                 }
 
-                            free_variable(buffer);
-                            free_variable(a_hash);
-                            g_checksum_free(checksum);
+                            free_block_reader_t(reader);
                             g_input_stream_close((GInputStream *) stream, NULL, NULL);
                             free_object(stream);
                         }
@@ -1074,21 +1939,38 @@ static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_
                             print_error(__FILE__, __LINE__, _("Unable to open file for reading: %s\n"), error->message);
                             free_error(error);
                         }
+                }
 
-                    meta->hash_data_list = saved_list;
-                    answer = send_meta_data_to_server(main_struct, meta, TRUE);
+            if (a_file != NULL)
+                {
+                    meta->hashs = make_hash_array_from_hash_data_list(saved_list, &meta->nb_hashs);
+                    g_list_free_full(saved_list, free_hdt_struct);
+                    answer = send_meta_data_to_server(main_struct, comm, meta, TRUE);
 
                     if (answer != NULL)
                         {   /** @todo may be we should check that answer is something that tells that everything went Ok. */
                             /* Everything has been transmitted so we can save meta data into the local db cache */
                             /* This is usefull for file carving to avoid sending too much things to the server  */
-                            elapsed = new_clock_t();
+                            elapsed = trace_begin();
                             db_save_meta_data(main_struct->database, meta, TRUE);
-                            end_clock(elapsed, "db_save_meta_data");
+                            trace_end(elapsed, "db_save_meta_data");
+
+                            if (read_ok == TRUE && delta != NULL)
+                                {
+                                    delta_save(delta, main_struct->database, meta->name);
+                                }
+
+                            if (read_ok == TRUE && meta->file_type == G_FILE_TYPE_REGULAR)
+                                {
+                                    tuner_record_file(main_struct->tuner, meta->size, meta->nb_hashs, sent);
+                                }
                         }
 
+                    free_variable(answer);
                     free_object(a_file);
                 }
+
+            free_delta_t(delta);
         }
 }
 
@@ -1096,31 +1978,36 @@ static void process_big_file_not_in_cache(main_struct_t *main_struct, meta_data_
 /**
  * This function gets meta data and data from a file and sends them
  * to the server in order to save the file located in the directory
- * 'directory' and represented by 'fileinfo' variable.
- * @param main_struct : main structure of the program
- * @param directory is the directory we are iterating over
- * @param fileinfo is a glib structure that contains all meta data and
- *        more for a file.
- * @note This function is not threadable as is. One may have problems
- *       when writing to the database for instance.
+ * 'directory' and represented by 'fileinfo' variable. Small files may
+ * be kept by the worker to be sent later along with others.
+ * @param worker is the worker_t * structure of the calling thread. Its
+ *        comm_t structure is used to talk to the server.
+ * @param file_event contains the path and the fileinfo of the file to
+ *        be saved (fileinfo is queried here in low memory mode).
  */
-void save_one_file(main_struct_t *main_struct, file_event_t *file_event)
+void save_one_file(worker_t *worker, file_event_t *file_event)
 {
+    main_struct_t *main_struct = NULL;
+    comm_t *comm = NULL;
+    gboolean kept = FALSE;
     meta_data_t *meta = NULL;
-    a_clock_t *my_clock = NULL;
+    gint64 span = 0;
     gchar *message = NULL;
     gchar *another_dir = NULL;
     filter_file_t *filter = NULL;
 
+    g_assert_nonnull(worker);
+    main_struct = worker->main_struct;
+    comm = worker->comm;
     g_assert_nonnull(main_struct);
 
-    if (file_event != NULL)
+    if (file_event != NULL && load_file_event_fileinfo(file_event) == TRUE)
         {
-            my_clock = new_clock_t();
+            span = trace_begin();
 
             /* Get data and meta_data for a file. */
             filter = new_filter_t(main_struct->database, main_struct->regex_exclude_list, FALSE);
-            meta = get_meta_data_from_fileinfo(file_event, filter, main_struct->opt);
+            meta = get_meta_data_from_fileinfo(file_event, filter, main_struct->opt, main_struct->tuner);
 
             /* We want to save all files that are not excluded ie filter->excluded not TRUE */
             if (meta != NULL && filter != NULL && filter->excluded == FALSE)
@@ -1128,13 +2015,11 @@ void save_one_file(main_struct_t *main_struct, file_event_t *file_event)
                     if (meta->in_cache == FALSE)
                         {
                              /* File is not in cache thus unknown thus we need to save it */
-                            if (meta->size < CLIENT_SMALL_FILE_SIZE)
-                                {
-                                    process_small_file_not_in_cache(main_struct, meta);
-                                }
-                            else
+                            kept = add_small_file_to_worker(worker, meta);
+
+                            if (kept == FALSE)
                                 {
-                                    process_big_file_not_in_cache(main_struct, meta);
+                                    process_file_not_in_cache(main_struct, comm, meta);
                                 }
                         }
 
@@ -1146,13 +2031,18 @@ void save_one_file(main_struct_t *main_struct, file_event_t *file_event)
 
                         }
                     message = g_strdup_printf(_("processing file %s"), meta->name);
-                    free_meta_data_t(meta, FALSE);
+
+                    if (kept == FALSE)
+                        {
+                            free_client_meta_data_t(meta);
+                        }
+
                     free_filter_file_t(filter);
                 }
             else if (meta != NULL && filter != NULL && filter->excluded == TRUE)
                 {
                     message = g_strdup_printf(_("processing excluded file %s"), meta->name);
-                    free_meta_data_t(meta, FALSE);
+                    free_client_meta_data_t(meta);
                     free_filter_file_t(filter);
                 }
             else
@@ -1161,8 +2051,14 @@ void save_one_file(main_struct_t *main_struct, file_event_t *file_event)
                     print_error(__FILE__, __LINE__, message);
                 }
 
-            end_clock(my_clock, message);
+            trace_end(span, "save_one_file");
+            print_debug("%s\n", message);
             free_variable(message);
+
+            if (worker->small_count >= CLIENT_MAX_META_ARRAY || worker->small_bytes >= get_batch_size(main_struct, worker->comm, 0))
+                {
+                    send_small_files_of_worker(worker);
+                }
         }
 }
 
@@ -1189,11 +2085,11 @@ static void iterate_over_enum(main_struct_t *main_struct, gchar *directory, GFil
             while (error == NULL && fileinfo != NULL)
                 {
                     /* file_event is used and freed in the thread
-                     * save_one_file_threaded where the queue save_queue
-                     * is used
+                     * save_one_file_threaded where the scheduler is used.
+                     * Carvers wait here when too many files are queued.
                      */
-                    file_event = new_file_event_t(directory, fileinfo);
-                    g_async_queue_push(main_struct->save_queue, file_event);
+                    file_event = new_file_event_t(directory, fileinfo, main_struct->opt->low_memory);
+                    scheduler_push(main_struct->scheduler, file_event, SCHEDULER_CARVE, g_file_info_get_size(fileinfo));
 
                     free_object(fileinfo);
 
@@ -1224,7 +2120,7 @@ static void carve_one_directory(gpointer data, gpointer user_data)
     if (directory != NULL)
         {
             a_dir = g_file_new_for_path(directory);
-            file_enum = g_file_enumerate_children(a_dir, "*", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, &error);
+            file_enum = g_file_enumerate_children(a_dir, CLIENT_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, &error);
 
             if (error == NULL && file_enum != NULL)
                 {
@@ -1244,9 +2140,29 @@ static void carve_one_directory(gpointer data, gpointer user_data)
 
 
 /**
- * Does carve all directories from the list in the option list.
- * This function is a thread that is run at the end of the initialisation
- * of main_struct structure.
+ * Call back for the g_slist_foreach function that pushes one directory
+ * of the option list into dir_queue.
+ * @param data is an element of opt->list ie: a gchar * that represents
+ *        a directory name
+ * @param user_data is the main_struct_t * pointer to the main structure.
+ */
+static void push_directory_to_carve(gpointer data, gpointer user_data)
+{
+    gchar *directory = (gchar *) data;
+    main_struct_t *main_struct = (main_struct_t *) user_data;
+
+    if (directory != NULL && main_struct != NULL)
+        {
+            g_async_queue_push(main_struct->dir_queue, g_strdup(directory));
+        }
+}
+
+
+/**
+ * Does carve directories popped from dir_queue. Directories of the
+ * option list are pushed into it at initialisation and sub directories
+ * are pushed by save_one_file(). opt->carvers threads run this function
+ * from the end of the initialisation of main_struct structure.
  * @param data: main structure of the program that contains also
  *        the options structure that should have a list of directories
  *        to save.
@@ -1260,8 +2176,6 @@ static gpointer carve_all_directories(gpointer data)
 
     if (main_struct->opt != NULL && main_struct->opt->noscan == FALSE)
         {
-            g_slist_foreach(main_struct->opt->dirname_list, carve_one_directory, main_struct);
-
             directory = g_async_queue_pop(main_struct->dir_queue);
 
             while (directory != NULL)
@@ -1278,35 +2192,61 @@ static gpointer carve_all_directories(gpointer data)
 
 /**
  * Manages reconnections to the server and the data that may have been
- * saved in local buffers while the server was unreachable.
+ * saved in the spool (or in local buffers by older versions) while the
+ * server was unreachable. Spooled requests are replayed as soon as the
+ * server answers. While it does not the time between two attempts
+ * doubles from CLIENT_RECONNECT_MIN_SLEEP_TIME up to
+ * CLIENT_RECONNECT_SLEEP_TIME. The epoch of the store of the server is
+ * checked at least every CLIENT_RECONNECT_SLEEP_TIME: the known cache
+ * is emptied when it changes.
  * @param data: main structure of the program that contains also
  *        the options structure.
  */
 static gpointer reconnected(gpointer data)
 {
     main_struct_t *main_struct = (main_struct_t *) data;
+    guint backoff = CLIENT_RECONNECT_MIN_SLEEP_TIME;
+    gboolean pending = FALSE;
 
-    while (main_struct != NULL)
+    while (main_struct != NULL && main_struct->reconnected != NULL)
         {
-            if (db_is_there_buffers_to_transmit(main_struct->database))
+            pending = spool_has_records(main_struct->spool) || db_is_there_buffers_to_transmit(main_struct->database);
+
+            if (pending == FALSE)
+                {
+                    /* Nothing to transmit: waits for a request to be spooled */
+                    backoff = CLIENT_RECONNECT_MIN_SLEEP_TIME;
+                    spool_wait(main_struct->spool, (gint64) CLIENT_RECONNECT_SLEEP_TIME * G_USEC_PER_SEC);
+
+                    /* The server may have deleted blocks (new epoch) in the meantime */
+                    if (is_server_alive(main_struct->reconnected) == TRUE)
+                        {
+                            known_set_epoch(main_struct->known, main_struct->reconnected->epoch);
+                        }
+                }
+            else if (is_server_alive(main_struct->reconnected))
                 {
-                    if (is_server_alive(main_struct->reconnected))
+                    print_debug(_("We have data and meta data to transmit to server\n"));
+                    known_set_epoch(main_struct->known, main_struct->reconnected->epoch);
+
+                    /* Buffers saved in the database by older versions are transmitted first */
+                    db_transmit_buffers(main_struct->database, main_struct->reconnected);
+
+                    if (spool_replay(main_struct->spool, main_struct->reconnected->conn, main_struct->opt->cmptype, SPOOL_REPLAY_THREADS) == TRUE &&
+                        db_is_there_buffers_to_transmit(main_struct->database) == FALSE)
                         {
-                            print_debug(_("We have data and meta data to transmit to server\n"));
-                            /* we need to do the job: transmit again the data
-                             * sleep until we'll implement something
-                             */
-                            db_transmit_buffers(main_struct->database, main_struct->reconnected);
-                            sleep(CLIENT_RECONNECT_SLEEP_TIME);
+                            backoff = CLIENT_RECONNECT_MIN_SLEEP_TIME;
                         }
                     else
                         {
-                            sleep(CLIENT_RECONNECT_SLEEP_TIME);
+                            sleep(backoff);
+                            backoff = MIN(backoff * 2, CLIENT_RECONNECT_SLEEP_TIME);
                         }
                 }
             else
                 {
-                    sleep(CLIENT_RECONNECT_SLEEP_TIME);
+                    sleep(backoff);
+                    backoff = MIN(backoff * 2, CLIENT_RECONNECT_SLEEP_TIME);
                 }
         }
 
@@ -1336,6 +2276,17 @@ static gboolean client_signal_handler(gpointer user_data)
     close_database(main_struct->database);
     print_debug(_("\tDatabase closed.\n"));
 
+    free_spool_t(main_struct->spool);
+    print_debug(_("\tSpool closed.\n"));
+
+    known_save(main_struct->known);
+    print_debug(_("\tCache of known hashs saved.\n"));
+
+    scheduler_save_stats(main_struct->scheduler);
+    print_debug(_("\tScheduler's metrics saved.\n"));
+
+    trace_dump();
+
     free_options_t(main_struct->opt);
 
     /** we can remove the handler as we are exiting the program anyway */
@@ -1343,6 +2294,20 @@ static gboolean client_signal_handler(gpointer user_data)
 }
 
 
+/**
+ * Periodically writes the metrics of the scheduler (queue depths and
+ * waiting times of live and carve events) into the cache directory.
+ * @param user_data must be a scheduler_t * pointer.
+ * @returns TRUE to be called again.
+ */
+static gboolean save_scheduler_stats(gpointer user_data)
+{
+    scheduler_save_stats((scheduler_t *) user_data);
+
+    return TRUE;
+}
+
+
 /**
  * Thread helper for fanotify's loop
  * @param data must be main_struct_t * pointer.
@@ -1415,10 +2380,9 @@ int main(int argc, char **argv)
     g_assert_nonnull(opt);
 
     /**
-     * Inits the main structure and launches two threads one that
-     * will save the files with an asynchronous queue and a second
-     * that will do directory carving. Threads communicates with
-     * the asynchronous queue.
+     * Inits the main structure and launches the threads that save
+     * files and the ones that do directory carving. Threads
+     * communicates with the scheduler (live events first).
      */
     main_struct = init_main_structure(opt);
     install_client_signal_traps(main_struct);
@@ -38,6 +38,7 @@
 #include <gio/gio.h>
 #include <glib/gi18n-lib.h>
 #include <glib-unix.h>
+#include <glib/gstdio.h>
 #include <errno.h>
 
 #include <signal.h>
@@ -52,6 +53,11 @@
 #include "libcdpfgl.h"
 
 #include "options.h"
+#include "delta.h"
+#include "spool.h"
+#include "known.h"
+#include "tuner.h"
+#include "scheduler.h"
 
 
 /**
@@ -85,6 +91,14 @@
 #define CLIENT_BLOCK_SIZE (16384)
 
 
+/**
+ * @def CLIENT_CDC_AVG_SIZE
+ * default average size in bytes of content defined blocks. Minimum and
+ * maximum sizes default to a fourth and to four times this size.
+ */
+#define CLIENT_CDC_AVG_SIZE (16384)
+
+
 /**
  * @def CLIENT_MIN_BUFFER
  *
@@ -95,34 +109,168 @@
 
 
 /**
- * @def CLIENT_SMALL_FILE_SIZE
+ * @def CLIENT_MEMORY_LIMIT
+ *
+ * defines the default maximum number of bytes of file data that one
+ * worker keeps in memory: two batches of blocks of a file (one being
+ * hashed and one being sent) or the small files waiting to be sent
+ * together. 16777216 == 16 MB.
+ */
+#define CLIENT_MEMORY_LIMIT (16777216)
+
+
+/**
+ * @def CLIENT_POOL_SIZE_PER_THREAD
+ *
+ * defines how many bytes of free buffers the buffer pool may keep for
+ * each thread. A worker has at most two buffers of blocks in flight
+ * (read and compressed) and a batch may grow up to 4 MB in adaptive
+ * mode or up to half of the memory limit in auto-tune mode.
+ * 16777216 == 16 MB.
+ */
+#define CLIENT_POOL_SIZE_PER_THREAD (16777216)
+
+
+/**
+ * @def CLIENT_MAX_IN_FLIGHT
+ * Defines the maximum number of data requests that each thread that
+ * saves files may have in flight (each one uses its own connection to
+ * the server).
+ */
+#define CLIENT_MAX_IN_FLIGHT (4)
+
+
+/**
+ * @def CLIENT_MAX_META_ARRAY
+ * Defines the maximum number of small files whose meta data are sent
+ * in one /Meta_Array.json request. Files are also sent as soon as
+ * their data reach the size of a batch.
+ */
+#define CLIENT_MAX_META_ARRAY (1024)
+
+
+/**
+ * @def CLIENT_QUIET_PERIOD
+ * Defines the default time (in milliseconds) without any event on a
+ * file before it is saved. Files closed and reopened many times per
+ * second are thus saved once per burst.
+ */
+#define CLIENT_QUIET_PERIOD (2000)
+
+
+/**
+ * @def CLIENT_MAX_DELAY
+ * Defines the default maximum time (in milliseconds) a file may wait
+ * in the pending set: a file that never stops being written is saved
+ * at least that often.
+ */
+#define CLIENT_MAX_DELAY (30000)
+
+
+/**
+ * @def CLIENT_CARVERS
+ * Defines the default number of threads that enumerate directories
+ * while carving. Enumeration mostly waits for the filesystem (NFS or
+ * large trees) so more than one thread helps even on one processor.
+ */
+#define CLIENT_CARVERS (4)
+
+
+/**
+ * @def CLIENT_LIVE_BUDGET
+ * Defines the default number of MB per second that files changed while
+ * the client runs (fanotify events) may read. 0 means no limit.
+ */
+#define CLIENT_LIVE_BUDGET (0)
+
+
+/**
+ * @def CLIENT_CARVE_BUDGET
+ * Defines the default number of MB per second that files found while
+ * carving directories may read. 0 means no limit.
+ */
+#define CLIENT_CARVE_BUDGET (0)
+
+
+/**
+ * @def CLIENT_LOW_MEMORY_LIMIT
+ * Defines the maximum number of bytes of file data that one worker
+ * keeps in memory in low memory mode (unless --memory-limit is given
+ * on the command line). 4194304 == 4 MB.
  *
- * defines the size under which a file is considered as small (ie that
- * may be totaly in memory).
- * 134217728 == 128 MB.
- * 134217 == 134 KB (only for tests since there is still no command line
- * or configuration file option to set this).
+ * @def CLIENT_LOW_MEMORY_POOL_SIZE_PER_THREAD
+ * Defines how many bytes of free buffers the buffer pool may keep for
+ * each thread in low memory mode.
+ *
+ * @def CLIENT_LOW_MEMORY_MAX_IN_FLIGHT
+ * Defines the number of data requests that one worker may have in
+ * flight in low memory mode: the data of a request is only kept until
+ * the next one is sent.
  */
-#define CLIENT_SMALL_FILE_SIZE (134217728)
+#define CLIENT_LOW_MEMORY_LIMIT (4194304)
+#define CLIENT_LOW_MEMORY_POOL_SIZE_PER_THREAD (4194304)
+#define CLIENT_LOW_MEMORY_MAX_IN_FLIGHT (1)
+
+
+/**
+ * @def CLIENT_FILE_ATTRIBUTES
+ * Defines the attributes requested when enumerating a directory or
+ * querying a file: only those used by get_meta_data_from_fileinfo().
+ * Asking for "*" makes gio compute expensive ones (content type, icons,
+ * access rights, selinux context...).
+ */
+#define CLIENT_FILE_ATTRIBUTES ("standard::name,standard::type,standard::size,standard::symlink-target,unix::inode,unix::uid,unix::gid,unix::mode,owner::user,owner::group,time::access,time::changed,time::modified")
 
 
 /**
  * @def CLIENT_RECONNECT_SLEEP_TIME
  *
- * defines sleep times before trying to reconnect or reading the
- * database.
+ * defines the maximum sleep time before trying to reconnect or reading
+ * the database.
  */
 #define CLIENT_RECONNECT_SLEEP_TIME (5*60)  /* Sleeps for 5 minutes */
 
 
+/**
+ * @def CLIENT_RECONNECT_MIN_SLEEP_TIME
+ *
+ * defines the first sleep time (in seconds) after the server has been
+ * found unreachable. It doubles at each failed attempt up to
+ * CLIENT_RECONNECT_SLEEP_TIME.
+ */
+#define CLIENT_RECONNECT_MIN_SLEEP_TIME (1)
+
+
+/**
+ * @def CLIENT_PENDING_MIN_WAIT
+ *
+ * defines the first time (in seconds) waited before asking the server
+ * again about blocks that another client is to send. It doubles each
+ * time they are still pending up to CLIENT_PENDING_MAX_WAIT.
+ */
+#define CLIENT_PENDING_MIN_WAIT (1)
+
+
+/**
+ * @def CLIENT_PENDING_MAX_WAIT
+ *
+ * defines the maximum time (in seconds) waited before asking the server
+ * again about blocks that another client is to send.
+ */
+#define CLIENT_PENDING_MAX_WAIT (16)
+
+
 /**
  * @struct file_event_t
  * @brief stores all the necessary things to manage an event on a file.
+ *
+ * In low memory mode only the path is kept while the event waits in the
+ * scheduler: the fileinfo is queried again when the file is saved.
  */
 typedef struct
 {
-    gchar *directory;
-    GFileInfo *fileinfo;
+    gchar *path;         /**< whole path of the file                                    */
+    GFileInfo *fileinfo; /**< attributes of the file (NULL until saved in low memory mode) */
 } file_event_t;
 
 
@@ -148,38 +296,112 @@ typedef struct
     options_t *opt;                 /**< Options of the program from the command line                                                     */
     const gchar *hostname;          /**< Name of the current machine                                                                      */
     db_t *database;                 /**< Database structure that stores everything that is related to the database                        */
-    comm_t *comm;                   /**< This is used to communicate with the 'server' program                                            */
+    spool_t *spool;                 /**< Requests that could not be sent while the server was unreachable                                 */
+    known_t *known;                 /**< Hashs that the server is known to have (they are not proposed to it again)                       */
+    comm_t *comm;                   /**< Used to negotiate protocols with the 'server' program (workers have their own comm_t)        */
     comm_t *reconnected;            /**< Used to save modifications when the server comes back after an outage or being unreachable       */
     gint fanotify_fd;               /**< fanotify handler                                                                                 */
-    GThread *save_one_file;         /**< thread that is used to save one file at a time (directory carving and live backup runs together) */
-    GThread *carve_all_directories; /**< thread used to carve all directories and let fanotify executing itself                           */
+    GPtrArray *workers;             /**< worker_t * threads that save files (directory carving and live backup runs together)             */
+    GThreadPool *hash_pool;         /**< pool of threads that hashes and compresses blocks of big files                                   */
+    buffer_pool_t *buffer_pool;     /**< buffers (blocks, hashs, compressed data) reused by read loops, compressor and JSON encoder      */
+    chunker_t *chunker;             /**< content defined chunking parameters (NULL when blocks have a fixed size)                        */
+    guint8 *delta_key;              /**< secret key of the fingerprints of the blocks of big files (see delta.h)                          */
+    tuner_t *tuner;                 /**< block size of each class of files (NULL unless auto-tune mode)                                   */
+    GPtrArray *carvers;             /**< GThread * threads that carve directories popped from dir_queue and let fanotify executing itself */
     GThread *reconn_thread;         /**< thread used to transmit buffers saved when server was unreachable                                */
-    GAsyncQueue *save_queue;        /**< Queue where is sent all file_event_t structures upon event or while directory carving.           */
-    GAsyncQueue *dir_queue;         /**< A queue to collect directories when carving to avoid thread collision                            */
+    scheduler_t *scheduler;         /**< Queues of file_event_t structures upon event (live) or while directory carving (carve).          */
+    GAsyncQueue *dir_queue;         /**< Directories to be carved, shared by every carver thread (the first one free takes the next one)  */
     GSList *regex_exclude_list;     /**< List of regular expressions used to exclude directories or files.                                */
     GMainLoop* loop;                /**< Main loop in glib                                                                                */
     GThread *fanotify_loop;         /**< thread used for the infinite loop checking fanotify envents.                                     */
 } main_struct_t;
 
 
+/**
+ * @struct worker_t
+ * @brief A thread that saves files popped from the scheduler. Each worker
+ *        has its own communication handle with the server.
+ */
+typedef struct
+{
+    main_struct_t *main_struct;     /**< main structure of the program                       */
+    comm_t *comm;                   /**< used by this worker only to talk to the server      */
+    GThread *thread;                /**< thread running save_one_file_threaded()             */
+    GList *small_files;             /**< meta_data_t * of small files to be sent together    */
+    GList *small_data;              /**< hash_data_t * of those files in reverse order       */
+    guint small_count;              /**< number of files in small_files                      */
+    gsize small_bytes;              /**< number of bytes of data of the files in small_files */
+} worker_t;
+
+
+/**
+ * @struct batch_t
+ * @brief A buffer's worth of blocks of a big file whose hashs are being
+ *        calculated (and data compressed) by the threads of hash_pool.
+ */
+typedef struct
+{
+    GMutex mutex;                   /**< protects pending                                    */
+    GCond cond;                     /**< signaled when pending reaches 0                     */
+    guint pending;                  /**< number of blocks not yet processed                  */
+    GPtrArray *blocks;              /**< block_t * in file order                             */
+    gsize read_bytes;               /**< number of bytes read into blocks                    */
+    gshort cmptype;                 /**< compression type to use on blocks                   */
+    buffer_pool_t *pool;            /**< pool where blocks and their buffers come from       */
+    delta_t *delta;                 /**< blocks of the previous version of the file          */
+} batch_t;
+
+
+/**
+ * @struct block_t
+ * @brief One block of a batch_t to be hashed (and compressed).
+ */
+typedef struct
+{
+    guchar *buffer;                 /**< data read from the file                             */
+    gssize read;                    /**< number of bytes in buffer                           */
+    hash_data_t *hash_data;         /**< result: hash and (compressed) data of the block     */
+    batch_t *batch;                 /**< batch this block belongs to                         */
+    guint8 fingerprint[DELTA_FINGERPRINT_LEN]; /**< fingerprint of the block (see delta.h)  */
+} block_t;
+
+
+/**
+ * @struct data_request_t
+ * @brief What an asynchronous data request needs once it completes: the
+ *        hashs are added to the known cache if the server acknowledged
+ *        them and the request is spooled otherwise.
+ */
+typedef struct
+{
+    spool_t *spool;                 /**< spool of the client                                 */
+    known_t *known;                 /**< cache of hashs known by the server                  */
+    GList *hash_list;               /**< hash_data_t * (only hashs) of the sent blocks       */
+} data_request_t;
+
+
 /**
  * This function gets meta data and data from a file and sends them
  * to the server in order to save the file located in the directory
- * 'directory' and represented by 'fileinfo' variable.
- * @param main_struct : main structure of the program
- * @param directory is the directory we are iterating over
- * @param fileinfo is a glib structure that contains all meta data and
- *        more for a file.
+ * 'directory' and represented by 'fileinfo' variable. Small files may
+ * be kept by the worker to be sent later along with others.
+ * @param worker is the worker_t * structure of the calling thread. Its
+ *        comm_t structure is used to talk to the server.
+ * @param file_event contains the path and the fileinfo of the file to
+ *        be saved (fileinfo is queried here in low memory mode).
  */
-extern void save_one_file(main_struct_t *main_struct, file_event_t *file_event);
+extern void save_one_file(worker_t *worker, file_event_t *file_event);
 
 
 /**
- * @returns a newly alloacted file_event_t * structure that must be freed
- * when no longer needed
- * @param
+ * @returns a newly allocated file_event_t * structure that must be freed
+ *          when no longer needed
+ * @param directory is the directory where the event occured
+ * @param fileinfo is fileinfo of the file on which the event occured
+ * @param compact is TRUE when only the path of the file has to be kept
+ *        (low memory mode).
  */
-extern file_event_t *new_file_event_t(gchar *directory, GFileInfo *fileinfo);
+extern file_event_t *new_file_event_t(gchar *directory, GFileInfo *fileinfo, gboolean compact);
 
 #include "m_fanotify.h"
 
@@ -0,0 +1,320 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    delta.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file delta.c
+ *
+ * This file contains the functions used to save big files incrementally:
+ * blocks of the previous version of a file are found again with their
+ * fingerprint and their hash is reused instead of being calculated.
+ */
+
+#include "client.h"
+
+static guint record_hash(gconstpointer key);
+static gboolean record_equal(gconstpointer a, gconstpointer b);
+
+
+/**
+ * @def ROTL64
+ * Rotates a 64 bits value x to the left by b bits.
+ */
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+
+/**
+ * @def SIPROUND
+ * One round of SipHash over its four 64 bits states.
+ */
+#define SIPROUND(v0, v1, v2, v3)                                                  \
+    do                                                                            \
+        {                                                                         \
+            v0 = v0 + v1; v1 = ROTL64(v1, 13); v1 = v1 ^ v0; v0 = ROTL64(v0, 32); \
+            v2 = v2 + v3; v3 = ROTL64(v3, 16); v3 = v3 ^ v2;                      \
+            v0 = v0 + v3; v3 = ROTL64(v3, 21); v3 = v3 ^ v0;                      \
+            v2 = v2 + v1; v1 = ROTL64(v1, 17); v1 = v1 ^ v2; v2 = ROTL64(v2, 32); \
+        } while (0)
+
+
+/**
+ * Loads the secret key of the fingerprints from the client's cache
+ * database or makes a new random one and saves it there.
+ * @param database is the client's cache database.
+ * @returns a newly allocated buffer of DELTA_KEY_LEN bytes.
+ */
+guint8 *delta_load_key(db_t *database)
+{
+    guint8 *key = NULL;
+    gsize length = 0;
+    gint fd = -1;
+    guint i = 0;
+
+    key = db_get_file_blocks(database, DELTA_KEY_NAME, &length);
+
+    if (key == NULL || length != DELTA_KEY_LEN)
+        {
+            free_variable(key);
+            key = (guint8 *) g_malloc0(DELTA_KEY_LEN);
+            fd = open("/dev/urandom", O_RDONLY);
+
+            if (fd < 0 || read(fd, key, DELTA_KEY_LEN) != DELTA_KEY_LEN)
+                {
+                    for (i = 0; i < DELTA_KEY_LEN; i++)
+                        {
+                            key[i] = (guint8) g_random_int_range(0, 256);
+                        }
+                }
+
+            if (fd >= 0)
+                {
+                    close(fd);
+                }
+
+            db_save_file_blocks(database, DELTA_KEY_NAME, key, DELTA_KEY_LEN);
+        }
+
+    return key;
+}
+
+
+/**
+ * @param key is a record (its fingerprint is uniformly distributed).
+ * @returns a hash value for key.
+ */
+static guint record_hash(gconstpointer key)
+{
+    guint hash = 0;
+
+    memcpy(&hash, key, sizeof(guint));
+
+    return hash;
+}
+
+
+/**
+ * @param a is a record
+ * @param b is a record
+ * @returns TRUE if a and b have the same fingerprint and length.
+ */
+static gboolean record_equal(gconstpointer a, gconstpointer b)
+{
+    return (memcmp(a, b, DELTA_FINGERPRINT_LEN + 8) == 0);
+}
+
+
+/**
+ * Creates a delta_t structure loaded with the blocks of the last saved
+ * version of a file.
+ * @param database is the client's cache database.
+ * @param name is the filename.
+ * @param key is the secret key of the fingerprints as returned by
+ *        delta_load_key(). It must live longer than the structure.
+ * @returns a newly allocated delta_t structure that may be freed with
+ *          free_delta_t() when no longer needed.
+ */
+delta_t *new_delta_t(db_t *database, gchar *name, guint8 *key)
+{
+    delta_t *delta = NULL;
+    gsize offset = 0;
+
+    delta = (delta_t *) g_malloc0(sizeof(delta_t));
+    g_assert_nonnull(delta);
+
+    delta->previous = db_get_file_blocks(database, name, &delta->length);
+    delta->index = g_hash_table_new(record_hash, record_equal);
+    delta->next = g_byte_array_new();
+    delta->reused = 0;
+    delta->key = key;
+
+    if (delta->previous != NULL)
+        {
+            for (offset = 0; offset + DELTA_RECORD_SIZE <= delta->length; offset = offset + DELTA_RECORD_SIZE)
+                {
+                    g_hash_table_insert(delta->index, delta->previous + offset, delta->previous + offset);
+                }
+        }
+
+    return delta;
+}
+
+
+/**
+ * Frees a delta_t structure
+ * @param delta is the structure to be freed.
+ */
+void free_delta_t(delta_t *delta)
+{
+    if (delta != NULL)
+        {
+            g_hash_table_destroy(delta->index);
+
+            if (delta->next != NULL)
+                {
+                    g_byte_array_free(delta->next, TRUE);
+                }
+
+            free_variable(delta->previous);
+            free_variable(delta);
+        }
+}
+
+
+/**
+ * Calculates the keyed fingerprint of a block (SipHash-1-3 with a 128
+ * bits output). It is several times faster than SHA256 and is used only
+ * to find unchanged blocks. Without the key nobody can build a block
+ * whose fingerprint collides with the one of another block.
+ * @param key is the secret key (DELTA_KEY_LEN bytes).
+ * @param buffer is the data of the block.
+ * @param length is the number of bytes in buffer.
+ * @param[out] fingerprint is where to write the DELTA_FINGERPRINT_LEN
+ *             bytes of the fingerprint.
+ */
+void delta_fingerprint(guint8 *key, guchar *buffer, gsize length, guint8 *fingerprint)
+{
+    guint64 k0 = 0;
+    guint64 k1 = 0;
+    guint64 v0 = 0;
+    guint64 v1 = 0;
+    guint64 v2 = 0;
+    guint64 v3 = 0;
+    guint64 word = 0;
+    gsize i = 0;
+
+    memcpy(&k0, key, 8);
+    memcpy(&k1, key + 8, 8);
+    k0 = GUINT64_FROM_LE(k0);
+    k1 = GUINT64_FROM_LE(k1);
+
+    v0 = k0 ^ G_GUINT64_CONSTANT(0x736f6d6570736575);
+    v1 = k1 ^ G_GUINT64_CONSTANT(0x646f72616e646f6d) ^ 0xee;
+    v2 = k0 ^ G_GUINT64_CONSTANT(0x6c7967656e657261);
+    v3 = k1 ^ G_GUINT64_CONSTANT(0x7465646279746573);
+
+    for (i = 0; i + 8 <= length; i = i + 8)
+        {
+            memcpy(&word, buffer + i, 8);
+            word = GUINT64_FROM_LE(word);
+            v3 = v3 ^ word;
+            SIPROUND(v0, v1, v2, v3);
+            v0 = v0 ^ word;
+        }
+
+    /* Last word: remaining bytes and the length in its most significant byte */
+    word = 0;
+    memcpy(&word, buffer + i, length - i);
+    word = GUINT64_FROM_LE(word) | ((guint64) length << 56);
+    v3 = v3 ^ word;
+    SIPROUND(v0, v1, v2, v3);
+    v0 = v0 ^ word;
+
+    v2 = v2 ^ 0xee;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    put_guint64_into_buffer(fingerprint, v0 ^ v1 ^ v2 ^ v3);
+
+    v1 = v1 ^ 0xdd;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    put_guint64_into_buffer(fingerprint + 8, v0 ^ v1 ^ v2 ^ v3);
+}
+
+
+/**
+ * Looks for a block in the previous version of the file.
+ * @param delta is the delta_t structure of the file.
+ * @param fingerprint is the fingerprint of the block.
+ * @param length is the length of the block.
+ * @returns the hash (HASH_LEN bytes owned by delta) of the block if it
+ *          is in the previous version or NULL.
+ */
+guint8 *delta_lookup(delta_t *delta, guint8 *fingerprint, gsize length)
+{
+    guint8 key[DELTA_FINGERPRINT_LEN + 8];
+    guint8 *record = NULL;
+
+    if (delta != NULL && delta->previous != NULL)
+        {
+            memcpy(key, fingerprint, DELTA_FINGERPRINT_LEN);
+            put_guint64_into_buffer(key + DELTA_FINGERPRINT_LEN, (guint64) length);
+
+            record = g_hash_table_lookup(delta->index, key);
+        }
+
+    if (record != NULL)
+        {
+            return record + DELTA_FINGERPRINT_LEN + 8;
+        }
+    else
+        {
+            return NULL;
+        }
+}
+
+
+/**
+ * Appends a block to the list of blocks of the version being saved.
+ * Blocks must be added in file order. Blocks beyond DELTA_MAX_BLOCKS
+ * drop the whole list.
+ * @param delta is the delta_t structure of the file.
+ * @param fingerprint is the fingerprint of the block.
+ * @param length is the length of the block.
+ * @param hash is the hash of the block.
+ */
+void delta_add_block(delta_t *delta, guint8 *fingerprint, gsize length, guint8 *hash)
+{
+    guint8 record[DELTA_RECORD_SIZE];
+
+    if (delta != NULL && delta->next != NULL)
+        {
+            if (delta->next->len >= (guint) DELTA_MAX_BLOCKS * DELTA_RECORD_SIZE)
+                {
+                    g_byte_array_free(delta->next, TRUE);
+                    delta->next = NULL;
+                }
+            else
+                {
+                    memcpy(record, fingerprint, DELTA_FINGERPRINT_LEN);
+                    put_guint64_into_buffer(record + DELTA_FINGERPRINT_LEN, (guint64) length);
+                    memcpy(record + DELTA_FINGERPRINT_LEN + 8, hash, HASH_LEN);
+                    g_byte_array_append(delta->next, record, DELTA_RECORD_SIZE);
+                }
+        }
+}
+
+
+/**
+ * Saves the list of blocks of the version that has just been saved
+ * into the client's cache database.
+ * @param delta is the delta_t structure of the file.
+ * @param database is the client's cache database.
+ * @param name is the filename.
+ */
+void delta_save(delta_t *delta, db_t *database, gchar *name)
+{
+    if (delta != NULL && delta->next != NULL && delta->next->len > 0)
+        {
+            db_save_file_blocks(database, name, delta->next->data, delta->next->len);
+            print_debug(_("%" G_GUINT64_FORMAT " blocks of %s were unchanged\n"), delta->reused, name);
+        }
+}
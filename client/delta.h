@@ -0,0 +1,172 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    delta.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file delta.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used to save big files incrementally. The client cache keeps, for each
+ * big file, the list of its blocks: a fast 128 bits fingerprint, the
+ * length and the SHA256 hash of each block. Fingerprints are keyed with a
+ * random secret of the client (see delta_load_key()) so that nobody can
+ * build a block whose fingerprint collides with another one. When the
+ * file is saved again,
+ * a block whose fingerprint and length are in the previous list gets its
+ * hash from there: it is neither hashed, nor compressed nor proposed to
+ * the server that already has it.
+ */
+#ifndef _CLIENT_DELTA_H_
+#define _CLIENT_DELTA_H_
+
+
+/**
+ * @def DELTA_FINGERPRINT_LEN
+ * Length in bytes of the fingerprint of a block.
+ */
+#define DELTA_FINGERPRINT_LEN (16)
+
+
+/**
+ * @def DELTA_KEY_LEN
+ * Length in bytes of the secret key of the fingerprints.
+ */
+#define DELTA_KEY_LEN (16)
+
+
+/**
+ * @def DELTA_KEY_NAME
+ * Name under which the secret key is saved with the lists of blocks of
+ * the files (no file has an empty name). A new key makes every saved
+ * list useless: files are then entirely hashed once again.
+ */
+#define DELTA_KEY_NAME ("")
+
+
+/**
+ * @def DELTA_RECORD_SIZE
+ * Size of one record in the list of blocks of a file: fingerprint
+ * (DELTA_FINGERPRINT_LEN), length (8) and hash (HASH_LEN).
+ */
+#define DELTA_RECORD_SIZE (DELTA_FINGERPRINT_LEN + 8 + HASH_LEN)
+
+
+/**
+ * @def DELTA_MAX_BLOCKS
+ * Maximum number of blocks recorded for one file (about 220 MB of
+ * records). Bigger files are always entirely hashed.
+ */
+#define DELTA_MAX_BLOCKS (4194304)
+
+
+/**
+ * @struct delta_t
+ * @brief Blocks of the previous version of a file and blocks of the
+ *        version being saved.
+ *
+ * previous and index are only read once the structure is created: they
+ * may be used by every thread of hash_pool at the same time. next is
+ * only filled by the thread that waits for the batches.
+ */
+typedef struct
+{
+    guint8 *previous;    /**< records of the previous version (may be NULL)                       */
+    gsize length;        /**< number of bytes of previous                                         */
+    GHashTable *index;   /**< record (fingerprint and length) -> record, in previous              */
+    GByteArray *next;    /**< records of the version being saved (NULL if the file is too big)    */
+    guint64 reused;      /**< number of blocks whose hash has been taken from previous            */
+    guint8 *key;         /**< secret key of the fingerprints (DELTA_KEY_LEN bytes, not owned)     */
+} delta_t;
+
+
+/**
+ * Loads the secret key of the fingerprints from the client's cache
+ * database or makes a new random one and saves it there.
+ * @param database is the client's cache database.
+ * @returns a newly allocated buffer of DELTA_KEY_LEN bytes.
+ */
+extern guint8 *delta_load_key(db_t *database);
+
+
+/**
+ * Creates a delta_t structure loaded with the blocks of the last saved
+ * version of a file.
+ * @param database is the client's cache database.
+ * @param name is the filename.
+ * @param key is the secret key of the fingerprints as returned by
+ *        delta_load_key(). It must live longer than the structure.
+ * @returns a newly allocated delta_t structure that may be freed with
+ *          free_delta_t() when no longer needed.
+ */
+extern delta_t *new_delta_t(db_t *database, gchar *name, guint8 *key);
+
+
+/**
+ * Frees a delta_t structure
+ * @param delta is the structure to be freed.
+ */
+extern void free_delta_t(delta_t *delta);
+
+
+/**
+ * Calculates the keyed fingerprint of a block (SipHash-1-3 with a 128
+ * bits output). It is several times faster than SHA256 and is used only
+ * to find unchanged blocks.
+ * @param key is the secret key (DELTA_KEY_LEN bytes).
+ * @param buffer is the data of the block.
+ * @param length is the number of bytes in buffer.
+ * @param[out] fingerprint is where to write the DELTA_FINGERPRINT_LEN
+ *             bytes of the fingerprint.
+ */
+extern void delta_fingerprint(guint8 *key, guchar *buffer, gsize length, guint8 *fingerprint);
+
+
+/**
+ * Looks for a block in the previous version of the file.
+ * @param delta is the delta_t structure of the file.
+ * @param fingerprint is the fingerprint of the block.
+ * @param length is the length of the block.
+ * @returns the hash (HASH_LEN bytes owned by delta) of the block if it
+ *          is in the previous version or NULL.
+ */
+extern guint8 *delta_lookup(delta_t *delta, guint8 *fingerprint, gsize length);
+
+
+/**
+ * Appends a block to the list of blocks of the version being saved.
+ * Blocks must be added in file order.
+ * @param delta is the delta_t structure of the file.
+ * @param fingerprint is the fingerprint of the block.
+ * @param length is the length of the block.
+ * @param hash is the hash of the block.
+ */
+extern void delta_add_block(delta_t *delta, guint8 *fingerprint, gsize length, guint8 *hash);
+
+
+/**
+ * Saves the list of blocks of the version that has just been saved
+ * into the client's cache database.
+ * @param delta is the delta_t structure of the file.
+ * @param database is the client's cache database.
+ * @param name is the filename.
+ */
+extern void delta_save(delta_t *delta, db_t *database, gchar *name);
+
+#endif /* #ifndef _CLIENT_DELTA_H_ */
@@ -0,0 +1,438 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    known.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file known.c
+ *
+ * This file contains the functions of the cache of hashs known by the
+ * server. It avoids asking the server about blocks it already has.
+ */
+
+#include "client.h"
+
+static gboolean is_free_slot(guint8 *slot);
+static gboolean table_find_slot(known_table_t *table, guint8 *hash, guint64 *slot);
+static void table_insert(known_table_t *table, guint8 *hash);
+static void table_clear(known_table_t *table);
+static void rotate_generations(known_t *known, gint64 now);
+static void append_table_to_array(GByteArray *array, known_table_t *table);
+static gchar *make_identity(known_t *known);
+static void load_known(known_t *known);
+
+
+/**
+ * @param slot is a slot of HASH_LEN bytes.
+ * @returns TRUE if the slot is free (only zeros).
+ */
+static gboolean is_free_slot(guint8 *slot)
+{
+    guint i = 0;
+
+    while (i < HASH_LEN && slot[i] == 0)
+        {
+            i++;
+        }
+
+    return (i == HASH_LEN);
+}
+
+
+/**
+ * Finds the slot of a hash in the table with linear probing.
+ * @param table is the table.
+ * @param hash is the binary hash to look for.
+ * @param[out] slot is the slot where hash is or the first free slot
+ *             where it should be inserted.
+ * @returns TRUE if hash is in the table, FALSE otherwise.
+ */
+static gboolean table_find_slot(known_table_t *table, guint8 *hash, guint64 *slot)
+{
+    guint64 i = 0;
+    gboolean found = FALSE;
+
+    /* SHA256 hashs are uniformly distributed: their first bytes are used as is */
+    memcpy(&i, hash, sizeof(guint64));
+    i = i & (KNOWN_CAPACITY - 1);
+
+    while (is_free_slot(table->slots + i * HASH_LEN) == FALSE && found == FALSE)
+        {
+            if (memcmp(table->slots + i * HASH_LEN, hash, HASH_LEN) == 0)
+                {
+                    found = TRUE;
+                }
+            else
+                {
+                    i = (i + 1) & (KNOWN_CAPACITY - 1);
+                }
+        }
+
+    *slot = i;
+
+    return found;
+}
+
+
+/**
+ * Inserts a hash into a table that is not full.
+ * @param table is the table.
+ * @param hash is the binary hash to insert.
+ */
+static void table_insert(known_table_t *table, guint8 *hash)
+{
+    guint64 slot = 0;
+
+    if (is_free_slot(hash) == FALSE && table_find_slot(table, hash, &slot) == FALSE)
+        {
+            memcpy(table->slots + slot * HASH_LEN, hash, HASH_LEN);
+            table->count++;
+        }
+}
+
+
+/**
+ * Empties a table
+ * @param table is the table.
+ */
+static void table_clear(known_table_t *table)
+{
+    memset(table->slots, 0, KNOWN_CAPACITY * HASH_LEN);
+    table->count = 0;
+}
+
+
+/**
+ * Starts a new generation when the current one is full or old enough
+ * and forgets everything when the current one is older than KNOWN_TTL.
+ * Caller must hold the mutex.
+ * @param known is the cache of hashs known by the server.
+ * @param now is the current unix time.
+ */
+static void rotate_generations(known_t *known, gint64 now)
+{
+    known_table_t swap;
+
+    if (now - known->since >= KNOWN_TTL || now < known->since)
+        {
+            table_clear(&known->current);
+            table_clear(&known->previous);
+            known->since = now;
+        }
+    else if (now - known->since >= KNOWN_TTL / 2 || known->current.count * 4 >= KNOWN_CAPACITY * 3)
+        {
+            swap = known->previous;
+            known->previous = known->current;
+            known->current = swap;
+            table_clear(&known->current);
+            known->since = now;
+        }
+}
+
+
+/**
+ * Appends every hash of a table to an array.
+ * @param array is the array where to append hashs.
+ * @param table is the table.
+ */
+static void append_table_to_array(GByteArray *array, known_table_t *table)
+{
+    guint64 i = 0;
+
+    for (i = 0; i < KNOWN_CAPACITY; i++)
+        {
+            if (is_free_slot(table->slots + i * HASH_LEN) == FALSE)
+                {
+                    g_byte_array_append(array, table->slots + i * HASH_LEN, HASH_LEN);
+                }
+        }
+}
+
+
+/**
+ * @param known is the cache of hashs known by the server.
+ * @returns a newly allocated string that identifies the server and the
+ *          epoch of its store (it is saved with the cache).
+ */
+static gchar *make_identity(known_t *known)
+{
+    return g_strdup_printf("%s %s", known->conn, known->epoch != NULL ? known->epoch : "");
+}
+
+
+/**
+ * Loads the saved cache if it has been made for the same server and the
+ * same epoch of its store. The file is trusted only if its size matches
+ * its header.
+ * @param known is the cache of hashs known by the server.
+ */
+static void load_known(known_t *known)
+{
+    gchar *contents = NULL;
+    gsize length = 0;
+    guint8 *buffer = NULL;
+    guint32 conn_len = 0;
+    guint64 nb_current = 0;
+    guint64 nb_previous = 0;
+    guint64 i = 0;
+    guint8 *hashs = NULL;
+    gchar *identity = NULL;
+
+    identity = make_identity(known);
+
+    if (g_file_get_contents(known->filename, &contents, &length, NULL) == TRUE && length >= KNOWN_HEADER_SIZE)
+        {
+            buffer = (guint8 *) contents;
+            conn_len = get_guint32_from_buffer(buffer + 4);
+            nb_current = get_guint64_from_buffer(buffer + 16);
+            nb_previous = get_guint64_from_buffer(buffer + 24);
+
+            if (get_guint32_from_buffer(buffer) == KNOWN_MAGIC && nb_current < KNOWN_CAPACITY && nb_previous < KNOWN_CAPACITY &&
+                length == KNOWN_HEADER_SIZE + conn_len + (nb_current + nb_previous) * HASH_LEN &&
+                conn_len == strlen(identity) && memcmp(buffer + KNOWN_HEADER_SIZE, identity, conn_len) == 0)
+                {
+                    known->since = (gint64) get_guint64_from_buffer(buffer + 8);
+                    hashs = buffer + KNOWN_HEADER_SIZE + conn_len;
+
+                    for (i = 0; i < nb_current; i++)
+                        {
+                            table_insert(&known->current, hashs + i * HASH_LEN);
+                        }
+
+                    hashs = hashs + nb_current * HASH_LEN;
+
+                    for (i = 0; i < nb_previous; i++)
+                        {
+                            table_insert(&known->previous, hashs + i * HASH_LEN);
+                        }
+
+                    print_debug(_("Loaded %" G_GUINT64_FORMAT " hashs known by the server\n"), nb_current + nb_previous);
+                }
+        }
+
+    free_variable(contents);
+    free_variable(identity);
+}
+
+
+/**
+ * Opens the cache of hashs known by the server conn. The saved cache is
+ * loaded unless it was made for another server or another epoch of its
+ * store.
+ * @param directory is the cache directory of the client.
+ * @param conn is the connexion string of the server (may be NULL).
+ * @param epoch is the epoch of the store of the server as told by
+ *        /Version.json (may be NULL).
+ * @returns a newly allocated known_t structure that may be freed with
+ *          free_known_t() when no longer needed.
+ */
+known_t *open_known(gchar *directory, gchar *conn, gchar *epoch)
+{
+    known_t *known = NULL;
+
+    g_assert_nonnull(directory);
+
+    known = (known_t *) g_malloc0(sizeof(known_t));
+    g_assert_nonnull(known);
+
+    known->filename = g_build_filename(directory, KNOWN_FILENAME, NULL);
+    known->conn = g_strdup(conn != NULL ? conn : "");
+    known->epoch = g_strdup(epoch);
+    g_mutex_init(&known->mutex);
+    known->current.slots = (guint8 *) g_malloc0(KNOWN_CAPACITY * HASH_LEN);
+    known->previous.slots = (guint8 *) g_malloc0(KNOWN_CAPACITY * HASH_LEN);
+    known->since = g_get_real_time() / G_USEC_PER_SEC;
+
+    load_known(known);
+    rotate_generations(known, g_get_real_time() / G_USEC_PER_SEC);
+
+    return known;
+}
+
+
+/**
+ * Saves the cache into its file.
+ * @param known is the cache of hashs known by the server.
+ */
+void known_save(known_t *known)
+{
+    GByteArray *array = NULL;
+    guint8 header[KNOWN_HEADER_SIZE];
+    GError *error = NULL;
+    gchar *identity = NULL;
+
+    if (known != NULL)
+        {
+            g_mutex_lock(&known->mutex);
+
+            identity = make_identity(known);
+
+            put_guint32_into_buffer(header, KNOWN_MAGIC);
+            put_guint32_into_buffer(header + 4, strlen(identity));
+            put_guint64_into_buffer(header + 8, (guint64) known->since);
+            put_guint64_into_buffer(header + 16, known->current.count);
+            put_guint64_into_buffer(header + 24, known->previous.count);
+
+            array = g_byte_array_sized_new(KNOWN_HEADER_SIZE + strlen(identity) + (known->current.count + known->previous.count) * HASH_LEN);
+            g_byte_array_append(array, header, KNOWN_HEADER_SIZE);
+            g_byte_array_append(array, (guint8 *) identity, strlen(identity));
+            append_table_to_array(array, &known->current);
+            append_table_to_array(array, &known->previous);
+
+            g_mutex_unlock(&known->mutex);
+
+            if (g_file_set_contents(known->filename, (gchar *) array->data, array->len, &error) == FALSE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while saving %s: %s\n"), known->filename, error->message);
+                    free_error(error);
+                }
+
+            g_byte_array_free(array, TRUE);
+            free_variable(identity);
+        }
+}
+
+
+/**
+ * Forgets every hash of the cache if the epoch of the store of the
+ * server has changed: blocks it had may have been deleted since.
+ * @param known is the cache of hashs known by the server.
+ * @param epoch is the epoch of the store of the server as told by
+ *        /Version.json (may be NULL).
+ */
+void known_set_epoch(known_t *known, gchar *epoch)
+{
+    if (known != NULL)
+        {
+            g_mutex_lock(&known->mutex);
+
+            if (g_strcmp0(known->epoch, epoch) != 0)
+                {
+                    print_debug(_("Epoch of the server changed: forgetting %" G_GUINT64_FORMAT " known hashs\n"), known->current.count + known->previous.count);
+                    table_clear(&known->current);
+                    table_clear(&known->previous);
+                    known->since = g_get_real_time() / G_USEC_PER_SEC;
+                    free_variable(known->epoch);
+                    known->epoch = g_strdup(epoch);
+                }
+
+            g_mutex_unlock(&known->mutex);
+        }
+}
+
+
+/**
+ * Saves and frees the cache
+ * @param known is the known_t structure to be freed.
+ */
+void free_known_t(known_t *known)
+{
+    if (known != NULL)
+        {
+            known_save(known);
+            g_mutex_clear(&known->mutex);
+            free_variable(known->current.slots);
+            free_variable(known->previous.slots);
+            free_variable(known->conn);
+            free_variable(known->epoch);
+            free_variable(known->filename);
+            free_variable(known);
+        }
+}
+
+
+/**
+ * @param known is the cache of hashs known by the server.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if the server is known to have the block of this hash.
+ */
+gboolean known_lookup(known_t *known, guint8 *hash)
+{
+    guint64 slot = 0;
+    gboolean found = FALSE;
+
+    if (is_zero_hash(hash, NULL) == TRUE)
+        {
+            /* Blocks of zeros are never stored: the server never needs them */
+            found = TRUE;
+        }
+    else if (known != NULL && hash != NULL)
+        {
+            g_mutex_lock(&known->mutex);
+
+            rotate_generations(known, g_get_real_time() / G_USEC_PER_SEC);
+            found = table_find_slot(&known->current, hash, &slot) || table_find_slot(&known->previous, hash, &slot);
+
+            g_mutex_unlock(&known->mutex);
+        }
+
+    return found;
+}
+
+
+/**
+ * Adds the hashs of a list to the cache (the server told that it has
+ * them or it acknowledged them).
+ * @param known is the cache of hashs known by the server.
+ * @param hash_data_list is a list of hash_data_t *.
+ */
+void known_add_list(known_t *known, GList *hash_data_list)
+{
+    hash_data_t *hash_data = NULL;
+
+    if (known != NULL)
+        {
+            g_mutex_lock(&known->mutex);
+
+            while (hash_data_list != NULL)
+                {
+                    hash_data = hash_data_list->data;
+
+                    if (hash_data != NULL && hash_data->hash != NULL && is_zero_hash(hash_data->hash, NULL) == FALSE)
+                        {
+                            rotate_generations(known, g_get_real_time() / G_USEC_PER_SEC);
+                            table_insert(&known->current, hash_data->hash);
+                        }
+
+                    hash_data_list = g_list_next(hash_data_list);
+                }
+
+            g_mutex_unlock(&known->mutex);
+        }
+}
+
+
+/**
+ * @param known is the cache of hashs known by the server.
+ * @param hashs is an array of nb_hashs * HASH_LEN bytes.
+ * @param nb_hashs is the number of hashs in hashs.
+ * @returns TRUE if every hash of the array is known by the server.
+ */
+gboolean known_contains_all(known_t *known, guint8 *hashs, guint64 nb_hashs)
+{
+    gboolean all = (known != NULL);
+    guint64 i = 0;
+
+    for (i = 0; all == TRUE && hashs != NULL && i < nb_hashs; i++)
+        {
+            all = known_lookup(known, hashs + i * HASH_LEN);
+        }
+
+    return all;
+}
@@ -0,0 +1,173 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    known.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file known.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the cache of hashs known by the server. Hashs that the server said
+ * it has (or that have been sent to it) are kept, in two generations, in
+ * tables of whole hashs: a Bloom filter is not used because a false
+ * positive would mean a block never sent. Blocks whose hash is in the
+ * cache are not proposed again to the server. The cache is saved next
+ * to the database of the client.
+ */
+#ifndef _CLIENT_KNOWN_H_
+#define _CLIENT_KNOWN_H_
+
+
+/**
+ * @def KNOWN_FILENAME
+ * Name of the file (in the cache directory) where the cache is saved.
+ */
+#define KNOWN_FILENAME ("known.cache")
+
+
+/**
+ * @def KNOWN_CAPACITY
+ * Number of slots of the table of each generation (must be a power of
+ * two). A generation holds at most 3/4 of it: 196608 hashs (8 MB).
+ */
+#define KNOWN_CAPACITY (262144)
+
+
+/**
+ * @def KNOWN_TTL
+ * Maximum time (in seconds) a hash is trusted to be known by the server.
+ * The current generation becomes the previous one after KNOWN_TTL / 2
+ * and the previous one is then forgotten. It is shorter than the default
+ * age under which the server's garbage collector keeps unreferenced
+ * blocks. Default is 12 hours.
+ */
+#define KNOWN_TTL (43200)
+
+
+/**
+ * @def KNOWN_MAGIC
+ * Magic number that begins the file of the cache ("CDKN").
+ */
+#define KNOWN_MAGIC (0x4e4b4443)
+
+
+/**
+ * @def KNOWN_HEADER_SIZE
+ * Size of the header of the file of the cache: magic (4), length of the
+ * connexion string (4), creation time of the current generation (8) and
+ * number of hashs of the current (8) and previous (8) generations. The
+ * connexion string and the hashs of both generations follow it.
+ */
+#define KNOWN_HEADER_SIZE (4 + 4 + 8 + 8 + 8)
+
+
+/**
+ * @struct known_table_t
+ * @brief Open addressing table of whole hashs (a slot of zeros is free).
+ */
+typedef struct
+{
+    guint8 *slots;      /**< KNOWN_CAPACITY * HASH_LEN bytes of hashs */
+    guint64 count;      /**< number of hashs in the table             */
+} known_table_t;
+
+
+/**
+ * @struct known_t
+ * @brief Hashs known by the server. Workers use it at the same time:
+ *        everything is protected by mutex. The cache is only valid for
+ *        one epoch of the store of the server: it changes when the
+ *        server deletes blocks (or when its store is a new one).
+ */
+typedef struct
+{
+    gchar *filename;          /**< file where the cache is saved                 */
+    gchar *conn;              /**< server the hashs are known by                 */
+    gchar *epoch;             /**< epoch of the store of the server (may be NULL) */
+    GMutex mutex;             /**< protects everything in this structure         */
+    known_table_t current;    /**< hashs learnt since since                      */
+    known_table_t previous;   /**< hashs learnt in the previous generation       */
+    gint64 since;             /**< unix time when the current generation began  */
+} known_t;
+
+
+/**
+ * Opens the cache of hashs known by the server conn. The saved cache is
+ * loaded unless it was made for another server or another epoch of its
+ * store.
+ * @param directory is the cache directory of the client.
+ * @param conn is the connexion string of the server (may be NULL).
+ * @param epoch is the epoch of the store of the server as told by
+ *        /Version.json (may be NULL).
+ * @returns a newly allocated known_t structure that may be freed with
+ *          free_known_t() when no longer needed.
+ */
+extern known_t *open_known(gchar *directory, gchar *conn, gchar *epoch);
+
+
+/**
+ * Saves the cache into its file.
+ * @param known is the cache of hashs known by the server.
+ */
+extern void known_save(known_t *known);
+
+
+/**
+ * Forgets every hash of the cache if the epoch of the store of the
+ * server has changed: blocks it had may have been deleted since.
+ * @param known is the cache of hashs known by the server.
+ * @param epoch is the epoch of the store of the server as told by
+ *        /Version.json (may be NULL).
+ */
+extern void known_set_epoch(known_t *known, gchar *epoch);
+
+
+/**
+ * Saves and frees the cache
+ * @param known is the known_t structure to be freed.
+ */
+extern void free_known_t(known_t *known);
+
+
+/**
+ * @param known is the cache of hashs known by the server.
+ * @param hash is a binary hash (HASH_LEN bytes).
+ * @returns TRUE if the server is known to have the block of this hash.
+ */
+extern gboolean known_lookup(known_t *known, guint8 *hash);
+
+
+/**
+ * Adds the hashs of a list to the cache (the server told that it has
+ * them or it acknowledged them).
+ * @param known is the cache of hashs known by the server.
+ * @param hash_data_list is a list of hash_data_t *.
+ */
+extern void known_add_list(known_t *known, GList *hash_data_list);
+
+
+/**
+ * @param known is the cache of hashs known by the server.
+ * @param hashs is an array of nb_hashs * HASH_LEN bytes.
+ * @param nb_hashs is the number of hashs in hashs.
+ * @returns TRUE if every hash of the array is known by the server.
+ */
+extern gboolean known_contains_all(known_t *known, guint8 *hashs, guint64 nb_hashs);
+
+#endif /* #ifndef _CLIENT_KNOWN_H_ */
@@ -36,7 +36,9 @@ static char *get_program_name_from_pid(int pid);
 static void prepare_before_saving(main_struct_t *main_struct, gchar *path);
 static GSList *does_event_concerns_monitored_directory(gchar *path, GSList *dir_list);
 static gboolean filter_out_if_necessary(GSList *head, struct fanotify_event_metadata *event);
-static void event_process(main_struct_t *main_struct, struct fanotify_event_metadata *event, GSList *dir_list);
+static void event_process(main_struct_t *main_struct, struct fanotify_event_metadata *event, GSList *dir_list, GHashTable *pending);
+static void add_pending_file(main_struct_t *main_struct, GHashTable *pending, gchar *path);
+static gint save_pending_files(main_struct_t *main_struct, GHashTable *pending);
 
 
 /**
@@ -185,16 +187,16 @@ static void prepare_before_saving(main_struct_t *main_struct, gchar *path)
         {
             directory = g_path_get_dirname(path);
             file = g_file_new_for_path(path);
-            fileinfo = g_file_query_info(file, "*", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, &error);
+            fileinfo = g_file_query_info(file, CLIENT_FILE_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, &error);
 
             if (error == NULL && fileinfo != NULL)
                 {
                     /* file_event is used and freed in the thread
-                     * save_one_file_threaded where the queue save_queue
-                     * is used
+                     * save_one_file_threaded where the scheduler is used:
+                     * live events are saved before carved ones.
                      */
-                    file_event = new_file_event_t(directory, fileinfo);
-                    g_async_queue_push(main_struct->save_queue, file_event);
+                    file_event = new_file_event_t(directory, fileinfo, main_struct->opt->low_memory);
+                    scheduler_push(main_struct->scheduler, file_event, SCHEDULER_LIVE, g_file_info_get_size(fileinfo));
 
                     free_object(fileinfo);
                     free_object(file);
@@ -279,14 +281,105 @@ static gboolean filter_out_if_necessary(GSList *head, struct fanotify_event_meta
 }
 
 
+/**
+ * Adds a file to the pending set or, if it is already pending, pushes
+ * its quiet period further. When opt->quiet_period is 0 the file is
+ * saved immediately.
+ * @param main_struct is the main structure
+ * @param pending is the pending set: path (gchar *) -> pending_file_t *
+ * @param path is the entire path and name of the considered file.
+ */
+static void add_pending_file(main_struct_t *main_struct, GHashTable *pending, gchar *path)
+{
+    pending_file_t *file = NULL;
+    gint64 now = 0;
+
+    if (main_struct->opt->quiet_period <= 0)
+        {
+            prepare_before_saving(main_struct, path);
+        }
+    else
+        {
+            now = g_get_monotonic_time();
+            file = g_hash_table_lookup(pending, path);
+
+            if (file == NULL)
+                {
+                    file = (pending_file_t *) g_malloc(sizeof(pending_file_t));
+                    g_assert_nonnull(file);
+
+                    file->first = now;
+                    g_hash_table_insert(pending, g_strdup(path), file);
+                }
+
+            file->last = now;
+        }
+}
+
+
+/**
+ * Saves pending files whose quiet period is over (no event since
+ * opt->quiet_period milliseconds) or that have been waiting for more
+ * than opt->max_delay milliseconds (a file that is written continuously
+ * is saved at least that often).
+ * @param main_struct is the main structure
+ * @param pending is the pending set: path (gchar *) -> pending_file_t *
+ * @returns the number of milliseconds before the next pending file is
+ *          due or -1 if there is no more pending file (to be used as
+ *          poll's timeout).
+ */
+static gint save_pending_files(main_struct_t *main_struct, GHashTable *pending)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+    pending_file_t *file = NULL;
+    gint64 now = g_get_monotonic_time();
+    gint64 quiet = (gint64) main_struct->opt->quiet_period * 1000;
+    gint64 max_delay = (gint64) main_struct->opt->max_delay * 1000;
+    gint64 due = 0;
+    gint64 next = -1;
+
+    g_hash_table_iter_init(&iter, pending);
+
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        {
+            file = (pending_file_t *) value;
+            due = MIN(file->last + quiet, file->first + max_delay);
+
+            if (due <= now)
+                {
+                    prepare_before_saving(main_struct, (gchar *) key);
+                    g_hash_table_iter_remove(&iter);
+                }
+            else if (next < 0 || due - now < next)
+                {
+                    next = due - now;
+                }
+        }
+
+    if (next < 0)
+        {
+            return -1;
+        }
+    else
+        {
+            /* rounded up not to wake up just before due time */
+            return (gint) ((next + 999) / 1000);
+        }
+}
+
+
 /**
  * Processes events
  * @param main_struct is the maion structure
  * @param event is the fanotify's structure event
  * @param dir_list MUST be a list of gchar * g_utf8_casefold()
  *        transformed.
+ * @param pending is the set of files waiting for their quiet period
+ *        to end.
  */
-static void event_process(main_struct_t *main_struct, struct fanotify_event_metadata *event, GSList *dir_list)
+static void event_process(main_struct_t *main_struct, struct fanotify_event_metadata *event, GSList *dir_list, GHashTable *pending)
 {
     gchar *path = NULL;
     gboolean to_save = FALSE;
@@ -314,8 +407,8 @@ static void event_process(main_struct_t *main_struct, struct fanotify_event_meta
                      *   }
                      */
 
-                    /* Saving the file effectively */
-                    prepare_before_saving(main_struct, path);
+                    /* Bursts of events on the same file end in only one save */
+                    add_pending_file(main_struct, pending, path);
 
                     fflush(stdout);
                 }
@@ -388,7 +481,8 @@ static GSList *transform_to_utf8_casefold(GSList *dir_list)
 
 
 /**
- * fanotify main loop
+ * fanotify main loop. poll() waits at most until the next pending file
+ * is due.
  * @todo simplify code (CCN is 12 already !)
  */
 void fanotify_loop(main_struct_t *main_struct)
@@ -398,7 +492,9 @@ void fanotify_loop(main_struct_t *main_struct)
     ssize_t length = 0;
     struct fanotify_event_metadata *fe_mdata = NULL;
     GSList *dir_list_utf8 = NULL;
+    GHashTable *pending = NULL;
     gint fanotify_fd = 0;
+    gint timeout = -1;
 
 
     if (main_struct != NULL)
@@ -411,11 +507,12 @@ void fanotify_loop(main_struct_t *main_struct)
             fds[FD_POLL_FANOTIFY].events = POLLIN;
 
             dir_list_utf8 = transform_to_utf8_casefold(main_struct->opt->dirname_list);
+            pending = g_hash_table_new_full(g_str_hash, g_str_equal, free_variable, free_variable);
 
             while (1)
                 {
-                    /* Block until there is something to be read */
-                    if (poll(fds, FD_POLL_MAX, -1) < 0)
+                    /* Block until there is something to be read or a pending file is due */
+                    if (poll(fds, FD_POLL_MAX, timeout) < 0)
                         {
                             print_error(__FILE__, __LINE__, _("Couldn't poll(): '%s'\n"), strerror(errno));
                         }
@@ -431,7 +528,7 @@ void fanotify_loop(main_struct_t *main_struct)
 
                                     while (FAN_EVENT_OK(fe_mdata, length))
                                         {
-                                            event_process(main_struct, fe_mdata, dir_list_utf8);
+                                            event_process(main_struct, fe_mdata, dir_list_utf8, pending);
 
                                             if (fe_mdata->fd > 0)
                                                 {
@@ -442,6 +539,8 @@ void fanotify_loop(main_struct_t *main_struct)
                                         }
                                 }
                         }
+
+                    timeout = save_pending_files(main_struct, pending);
                 }
         }
 }
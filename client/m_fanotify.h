@@ -30,6 +30,18 @@
 
 #define FANOTIFY_BUFFER_SIZE 49152    /* for 24 bytes events this is 2046 events */
 
+
+/**
+ * @struct pending_file_t
+ * @brief A file that has been closed after a write and that waits for
+ *        its quiet period to end before being saved.
+ */
+typedef struct
+{
+    gint64 first;   /**< monotonic time (microseconds) of the first event not saved yet */
+    gint64 last;    /**< monotonic time (microseconds) of the last event                */
+} pending_file_t;
+
 /* Enumerate list of FDs to poll */
 enum {
   FD_POLL_SIGNAL = 0,
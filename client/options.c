@@ -90,6 +90,13 @@ static void print_selected_options(options_t *opt)
                     fprintf(stdout, _("Blocksize: adaptive mode\n"));
                 }
 
+            if (opt->cdc == TRUE)
+                {
+                    blocksize = g_strdup_printf("%" G_GINT64_FORMAT "/%" G_GINT64_FORMAT "/%" G_GINT64_FORMAT, opt->cdc_min, opt->cdc_avg, opt->cdc_max);
+                    fprintf(stdout, _("Content defined blocks (min/avg/max): %s\n"), blocksize);
+                    free_variable(blocksize);
+                }
+
             print_string_option(_("Configuration file: %s\n"), opt->configfile);
             print_string_option(_("Cache directory: %s\n"), opt->dircache);
             print_string_option(_("Cache database name: %s\n"), opt->dbname);
@@ -99,6 +106,23 @@ static void print_selected_options(options_t *opt)
                     fprintf(stdout, _("Server's port number: %d\n"), opt->srv_conf->port);
                 }
             fprintf(stdout, _("Buffersize: %d\n"), opt->buffersize);
+            fprintf(stdout, _("Threads: %d\n"), opt->threads);
+            fprintf(stdout, _("Carvers: %d\n"), opt->carvers);
+            fprintf(stdout, _("Quiet period: %d ms\n"), opt->quiet_period);
+            fprintf(stdout, _("Maximum delay: %d ms\n"), opt->max_delay);
+            fprintf(stdout, _("Memory limit: %d\n"), opt->memory_limit);
+            fprintf(stdout, _("Live budget: %d MB/s\n"), opt->live_budget);
+            fprintf(stdout, _("Carve budget: %d MB/s\n"), opt->carve_budget);
+
+            if (opt->low_memory == TRUE)
+                {
+                    fprintf(stdout, _("Low memory mode\n"));
+                }
+
+            if (opt->auto_tune == TRUE)
+                {
+                    fprintf(stdout, _("Auto-tune mode\n"));
+                }
         }
 }
 
@@ -137,12 +161,41 @@ static void read_from_group_client(options_t *opt, GKeyFile *keyfile, gchar *fil
             /* Adaptative mode for blocksize ? */
             opt->adaptive = read_boolean_from_file(keyfile, filename, GN_CLIENT, KN_ADAPTIVE, _("Could not load adaptive configuration from file."));
 
+            /* Content defined chunking */
+            opt->cdc = read_boolean_from_file(keyfile, filename, GN_CLIENT, KN_CDC, _("Could not load cdc configuration from file."));
+            opt->cdc_min = read_int64_from_file(keyfile, filename, GN_CLIENT, KN_CDC_MIN_SIZE, _("Could not load cdc minimum size from file"), opt->cdc_min);
+            opt->cdc_avg = read_int64_from_file(keyfile, filename, GN_CLIENT, KN_CDC_AVG_SIZE, _("Could not load cdc average size from file"), opt->cdc_avg);
+            opt->cdc_max = read_int64_from_file(keyfile, filename, GN_CLIENT, KN_CDC_MAX_SIZE, _("Could not load cdc maximum size from file"), opt->cdc_max);
+
             /* Scanning option */
             opt->noscan = read_boolean_from_file(keyfile, filename, GN_CLIENT, KN_NOSCAN, _("Could not load scan configuration from file."));
 
             /* Buffer size to be used to send data to server */
             opt->buffersize = read_int_from_file(keyfile, filename, GN_CLIENT, KN_BUFFER_SIZE, _("Could not load buffersize from file"), CLIENT_MIN_BUFFER);
 
+            /* Number of threads used to save files */
+            opt->threads = read_int_from_file(keyfile, filename, GN_CLIENT, KN_THREADS, _("Could not load number of threads from file"), opt->threads);
+
+            /* Number of threads used to enumerate directories */
+            opt->carvers = read_int_from_file(keyfile, filename, GN_CLIENT, KN_CARVERS, _("Could not load number of carvers from file"), opt->carvers);
+
+            /* Coalescing of fanotify's events */
+            opt->quiet_period = read_int_from_file(keyfile, filename, GN_CLIENT, KN_QUIET_PERIOD, _("Could not load quiet period from file"), opt->quiet_period);
+            opt->max_delay = read_int_from_file(keyfile, filename, GN_CLIENT, KN_MAX_DELAY, _("Could not load maximum delay from file"), opt->max_delay);
+
+            /* Memory used by each thread for the data of files */
+            opt->memory_limit = read_int_from_file(keyfile, filename, GN_CLIENT, KN_MEMORY_LIMIT, _("Could not load memory limit from file"), opt->memory_limit);
+
+            /* Bytes per second read by live and carve saves */
+            opt->live_budget = read_int_from_file(keyfile, filename, GN_CLIENT, KN_LIVE_BUDGET, _("Could not load live budget from file"), opt->live_budget);
+            opt->carve_budget = read_int_from_file(keyfile, filename, GN_CLIENT, KN_CARVE_BUDGET, _("Could not load carve budget from file"), opt->carve_budget);
+
+            /* Fitting into small memory systems */
+            opt->low_memory = read_boolean_from_file(keyfile, filename, GN_CLIENT, KN_LOW_MEMORY, _("Could not load low memory configuration from file."));
+
+            /* Tuning batch sizes and block sizes from measures */
+            opt->auto_tune = read_boolean_from_file(keyfile, filename, GN_CLIENT, KN_AUTO_TUNE, _("Could not load auto-tune configuration from file."));
+
             /* Compression type if any */
             cmptype = read_int_from_file(keyfile, filename, GN_CLIENT, KN_COMPRESSION_TYPE, _("Compression type not defined in configuration file"), opt->cmptype);
             set_compression_type(opt, cmptype);
@@ -237,11 +290,22 @@ options_t *manage_command_line_options(int argc, char **argv)
     gboolean version = FALSE;      /** True if -v was selected on the command line            */
     gint debug = -4;               /** 0 == FALSE and other values == TRUE                    */
     gint adaptive = -1;            /** 0 == FALSE and other positive values == TRUE           */
+    gint cdc = -1;                 /** 0 == FALSE and other positive values == TRUE           */
+    gint low_memory = -1;          /** 0 == FALSE and other positive values == TRUE           */
+    gint auto_tune = -1;           /** 0 == FALSE and other positive values == TRUE           */
     gchar **dirname_array = NULL;  /** array of dirnames left on the command line             */
     gchar **exclude_array = NULL;  /** array of dirnames and filenames to be excluded         */
     gchar *configfile = NULL;      /** filename for the configuration file if any             */
+    gchar *trace = NULL;           /** filename where to write the trace if any               */
     gint64 blocksize = 0;          /** computed block size in bytes                           */
     gint buffersize = 0;           /** buffer size used to send data to server                */
+    gint threads = 0;              /** number of threads used to save files                   */
+    gint carvers = 0;              /** number of threads used to enumerate directories        */
+    gint quiet_period = -1;        /** milliseconds without event before saving a file        */
+    gint max_delay = 0;            /** maximum milliseconds before saving a pending file      */
+    gint memory_limit = 0;         /** maximum bytes of file data kept in memory by a thread  */
+    gint live_budget = -1;         /** MB per second read by files changed while running      */
+    gint carve_budget = -1;        /** MB per second read by files found while carving        */
     gchar *dircache = NULL;        /** Directory used to store cache files                    */
     gchar *dbname = NULL;          /** Database filename where data and meta data are cached  */
     gchar *ip =  NULL;             /** IP address where is located server's program           */
@@ -257,6 +321,7 @@ options_t *manage_command_line_options(int argc, char **argv)
         { "configuration", 'c', 0, G_OPTION_ARG_STRING, &configfile, N_("Specify an alternative configuration file."), N_("FILENAME")},
         { "blocksize", 'b', 0, G_OPTION_ARG_INT64, &blocksize, N_("Fixed block SIZE used to compute hashs."), N_("SIZE")},
         { "adaptive", 'a', 0, G_OPTION_ARG_INT, &adaptive, N_("Adapative block size used to compute hashs."), N_("BOOLEAN")},
+        { "cdc", 'k', 0, G_OPTION_ARG_INT, &cdc, N_("Content defined blocks (rolling hash boundaries) used to compute hashs."), N_("BOOLEAN")},
         { "buffersize", 's', 0, G_OPTION_ARG_INT, &buffersize, N_("SIZE of the cache used to send data to server."), N_("SIZE")},
         { "dircache", 'r', 0, G_OPTION_ARG_STRING, &dircache, N_("Directory DIRNAME where to cache files."), N_("DIRNAME")},
         { "dbname", 'f', 0, G_OPTION_ARG_STRING, &dbname, N_("Database FILENAME."), N_("FILENAME")},
@@ -264,7 +329,17 @@ options_t *manage_command_line_options(int argc, char **argv)
         { "port", 'p', 0, G_OPTION_ARG_INT, &port, N_("Port NUMBER on which to listen."), N_("NUMBER")},
         { "exclude", 'x', 0, G_OPTION_ARG_FILENAME_ARRAY, &exclude_array, N_("Exclude FILENAME from being saved."), N_("FILENAME")},
         { "no-scan", 'n', 0, G_OPTION_ARG_NONE, &noscan, N_("Does not do the first directory scan."), NULL},
-        { "compression", 'z', 0, G_OPTION_ARG_INT, &cmptype, N_("Compression type to use: 0 is NONE, 1 is ZLIB"), N_("NUMBER")},
+        { "compression", 'z', 0, G_OPTION_ARG_INT, &cmptype, N_("Compression type to use: 0 is NONE, 1 is ZLIB, 2 is LZ4, 3 is ZSTD"), N_("NUMBER")},
+        { "threads", 't', 0, G_OPTION_ARG_INT, &threads, N_("NUMBER of threads used to save files (default is one per processor)."), N_("NUMBER")},
+        { "carvers", 'w', 0, G_OPTION_ARG_INT, &carvers, N_("NUMBER of threads used to enumerate directories while carving."), N_("NUMBER")},
+        { "quiet-period", 'q', 0, G_OPTION_ARG_INT, &quiet_period, N_("MILLISECONDS without event on a file before saving it (0 saves on every event)."), N_("MILLISECONDS")},
+        { "max-delay", 'm', 0, G_OPTION_ARG_INT, &max_delay, N_("Maximum MILLISECONDS a modified file may wait before being saved."), N_("MILLISECONDS")},
+        { "memory-limit", 'l', 0, G_OPTION_ARG_INT, &memory_limit, N_("Maximum SIZE of file data that one thread keeps in memory."), N_("SIZE")},
+        { "live-budget", 'L', 0, G_OPTION_ARG_INT, &live_budget, N_("Maximum MB per second read to save files changed while running (0 means no limit)."), N_("NUMBER")},
+        { "carve-budget", 'C', 0, G_OPTION_ARG_INT, &carve_budget, N_("Maximum MB per second read to save files found while carving (0 means no limit)."), N_("NUMBER")},
+        { "low-memory", 'M', 0, G_OPTION_ARG_INT, &low_memory, N_("Low memory mode to fit into small memory systems."), N_("BOOLEAN")},
+        { "auto-tune", 'A', 0, G_OPTION_ARG_INT, &auto_tune, N_("Tunes batch sizes and block sizes from measured latency, bandwidth and deduplication."), N_("BOOLEAN")},
+        { "trace", 'T', 0, G_OPTION_ARG_FILENAME, &trace, N_("Records the duration of the main steps and writes them as a Chrome trace (JSON) into FILENAME when the program ends."), N_("FILENAME")},
         { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &dirname_array, "", NULL},
         { NULL }
     };
@@ -286,7 +361,20 @@ options_t *manage_command_line_options(int argc, char **argv)
     opt->dbname = g_strdup("filecache.db");
     opt->buffersize = -1;
     opt->adaptive = FALSE;
+    opt->cdc = FALSE;
+    opt->cdc_min = CLIENT_CDC_AVG_SIZE / 4;
+    opt->cdc_avg = CLIENT_CDC_AVG_SIZE;
+    opt->cdc_max = CLIENT_CDC_AVG_SIZE * 4;
     opt->cmptype = 0;
+    opt->threads = -1;
+    opt->carvers = CLIENT_CARVERS;
+    opt->quiet_period = CLIENT_QUIET_PERIOD;
+    opt->max_delay = CLIENT_MAX_DELAY;
+    opt->memory_limit = CLIENT_MEMORY_LIMIT;
+    opt->live_budget = CLIENT_LIVE_BUDGET;
+    opt->carve_budget = CLIENT_CARVE_BUDGET;
+    opt->low_memory = FALSE;
+    opt->auto_tune = FALSE;
     opt->srv_conf = NULL;
 
     srv_conf = new_srv_conf_t();
@@ -324,6 +412,8 @@ options_t *manage_command_line_options(int argc, char **argv)
      *    as every string has been copied with g_strdup().
      */
     set_debug_mode_upon_cmdl(debug);
+    init_tracing(trace);
+    free_variable(trace);
 
     opt->dirname_list = convert_gchar_array_to_GSList(dirname_array, opt->dirname_list);
     opt->exclude_list = convert_gchar_array_to_GSList(exclude_array, opt->exclude_list);
@@ -362,6 +452,15 @@ options_t *manage_command_line_options(int argc, char **argv)
             opt->adaptive = FALSE;
         }
 
+    if (cdc > 0)
+        {
+            opt->cdc = TRUE;
+        }
+    else if (cdc == 0)
+        {
+            opt->cdc = FALSE;
+        }
+
     if (buffersize > 0)
         {
             opt->buffersize = buffersize;
@@ -371,6 +470,92 @@ options_t *manage_command_line_options(int argc, char **argv)
             opt->buffersize = CLIENT_MIN_BUFFER;
         }
 
+    if (threads > 0)
+        {
+            opt->threads = threads;
+        }
+    else if (opt->threads <= 0)
+        {
+            opt->threads = g_get_num_processors();
+        }
+
+    if (carvers > 0)
+        {
+            opt->carvers = carvers;
+        }
+    else if (opt->carvers <= 0)
+        {
+            opt->carvers = CLIENT_CARVERS;
+        }
+
+    if (quiet_period >= 0)
+        {
+            opt->quiet_period = quiet_period;
+        }
+    else if (opt->quiet_period < 0)
+        {
+            opt->quiet_period = CLIENT_QUIET_PERIOD;
+        }
+
+    if (max_delay > 0)
+        {
+            opt->max_delay = max_delay;
+        }
+    else if (opt->max_delay <= 0)
+        {
+            opt->max_delay = CLIENT_MAX_DELAY;
+        }
+
+    if (low_memory > 0)
+        {
+            opt->low_memory = TRUE;
+        }
+    else if (low_memory == 0)
+        {
+            opt->low_memory = FALSE;
+        }
+
+    if (auto_tune > 0)
+        {
+            opt->auto_tune = TRUE;
+        }
+    else if (auto_tune == 0)
+        {
+            opt->auto_tune = FALSE;
+        }
+
+    if (memory_limit > 0)
+        {
+            opt->memory_limit = memory_limit;
+        }
+    else if (opt->memory_limit <= 0)
+        {
+            opt->memory_limit = CLIENT_MEMORY_LIMIT;
+        }
+
+    if (opt->low_memory == TRUE && memory_limit <= 0 && opt->memory_limit > CLIENT_LOW_MEMORY_LIMIT)
+        {
+            opt->memory_limit = CLIENT_LOW_MEMORY_LIMIT;
+        }
+
+    if (live_budget >= 0)
+        {
+            opt->live_budget = live_budget;
+        }
+    else if (opt->live_budget < 0)
+        {
+            opt->live_budget = CLIENT_LIVE_BUDGET;
+        }
+
+    if (carve_budget >= 0)
+        {
+            opt->carve_budget = carve_budget;
+        }
+    else if (opt->carve_budget < 0)
+        {
+            opt->carve_budget = CLIENT_CARVE_BUDGET;
+        }
+
     free_variable(ip);
     free_variable(dbname);
     free_variable(dircache);
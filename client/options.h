@@ -49,6 +49,19 @@ typedef struct
     gboolean adaptive;    /**< adaptive will make client compute hashs with an adaptive blocksize if TRUE             */
     gboolean noscan;      /**< noscan will avoid the first directory scan when set to TRUE. default = FALSE           */
     gshort cmptype;       /**< compression type to be used when communicating. See compress.h for available types     */
+    gint threads;         /**< number of threads that save files and that hash and compress blocks of big files        */
+    gint carvers;         /**< number of threads that enumerate directories while carving                             */
+    gint quiet_period;    /**< milliseconds without event on a file before it is saved (0 saves on every event)       */
+    gint max_delay;       /**< maximum milliseconds a file written continuously may wait before being saved            */
+    gint memory_limit;    /**< maximum bytes of file data that one worker keeps in memory                              */
+    gint live_budget;     /**< MB per second that files changed while running may read (0 means no limit)             */
+    gint carve_budget;    /**< MB per second that files found while carving may read (0 means no limit)               */
+    gboolean low_memory;  /**< TRUE to fit into small memory systems (compact events, bounded queues and less in flight) */
+    gboolean auto_tune;   /**< TRUE to tune batch sizes from each connection and block sizes from deduplication         */
+    gboolean cdc;         /**< cdc will make client cut files into content defined blocks if TRUE                      */
+    gint64 cdc_min;       /**< minimum size in bytes of a content defined block                                        */
+    gint64 cdc_avg;       /**< average size in bytes of a content defined block                                        */
+    gint64 cdc_max;       /**< maximum size in bytes of a content defined block                                        */
 } options_t;
 
 
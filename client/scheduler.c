@@ -0,0 +1,407 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    scheduler.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file scheduler.c
+ *
+ * This file contains the functions of the priority scheduler of file
+ * events used by 'cdpfglclient' workers.
+ */
+
+#include "client.h"
+
+static void init_class(sched_class_t *sclass, gint64 budget, guint max_depth, guint max_running, gint64 now);
+static void refill_tokens(sched_class_t *sclass, gint64 now);
+static sched_item_t *take_item(scheduler_t *sched, gint64 now, gint *class, gint64 *wakeup);
+static void add_class_to_keyfile(GKeyFile *keyfile, const gchar *group, sched_class_t *sclass, gint64 now);
+
+
+/**
+ * Inits one priority class
+ * @param sclass is the class to be initialized.
+ * @param budget is the number of bytes per second allowed to this class
+ *        (0 means no limit).
+ * @param max_depth is the maximum number of waiting events (0 means no
+ *        limit).
+ * @param max_running is the maximum number of events of this class
+ *        saved at once (0 means no limit).
+ * @param now is the current monotonic time.
+ */
+static void init_class(sched_class_t *sclass, gint64 budget, guint max_depth, guint max_running, gint64 now)
+{
+    sclass->queue = g_queue_new();
+    sclass->max_depth = max_depth;
+    sclass->budget = budget;
+    sclass->tokens = budget;
+    sclass->refilled = now;
+    sclass->running = 0;
+    sclass->max_running = max_running;
+    sclass->pushed = 0;
+    sclass->popped = 0;
+    sclass->bytes = 0;
+    sclass->wait_total = 0;
+    sclass->wait_max = 0;
+}
+
+
+/**
+ * Refills the token bucket of a class with the bytes allowed since the
+ * last refill (at most one second of budget is kept).
+ * @param sclass is the class (scheduler's mutex must be held).
+ * @param now is the current monotonic time.
+ */
+static void refill_tokens(sched_class_t *sclass, gint64 now)
+{
+    gint64 elapsed = 0;
+
+    if (sclass->budget > 0 && now > sclass->refilled)
+        {
+            elapsed = MIN(now - sclass->refilled, G_USEC_PER_SEC);
+            sclass->tokens = MIN(sclass->tokens + (elapsed * sclass->budget) / G_USEC_PER_SEC, sclass->budget);
+            sclass->refilled = now;
+        }
+}
+
+
+/**
+ * Takes the first event that may be given to a worker: classes are
+ * looked at in priority order and a class is skipped when it is empty,
+ * when its budget is spent or when enough of its events are running.
+ * @param sched is the scheduler (its mutex must be held).
+ * @param now is the current monotonic time.
+ * @param[out] class is the class of the returned event.
+ * @param[out] wakeup is lowered to the time when a spent budget allows
+ *             a waiting event again (left as is otherwise).
+ * @returns the item or NULL if no event may be given now.
+ */
+static sched_item_t *take_item(scheduler_t *sched, gint64 now, gint *class, gint64 *wakeup)
+{
+    sched_class_t *sclass = NULL;
+    sched_item_t *item = NULL;
+    gint64 when = 0;
+    gint c = 0;
+
+    for (c = 0; c < SCHEDULER_CLASSES && item == NULL; c++)
+        {
+            sclass = &sched->classes[c];
+            refill_tokens(sclass, now);
+
+            if (g_queue_is_empty(sclass->queue) == FALSE && (sclass->max_running == 0 || sclass->running < sclass->max_running))
+                {
+                    if (sclass->budget == 0 || sclass->tokens > 0)
+                        {
+                            if (sclass->max_depth > 0 && g_queue_get_length(sclass->queue) >= sclass->max_depth)
+                                {
+                                    g_cond_broadcast(&sched->room);
+                                }
+
+                            item = (sched_item_t *) g_queue_pop_head(sclass->queue);
+
+                            sclass->tokens = sclass->tokens - (gint64) item->bytes;
+                            sclass->running++;
+                            sclass->popped++;
+                            sclass->bytes = sclass->bytes + item->bytes;
+                            sclass->wait_total = sclass->wait_total + (now - item->queued);
+                            sclass->wait_max = MAX(sclass->wait_max, now - item->queued);
+                            *class = c;
+                        }
+                    else
+                        {
+                            when = now + ((1 - sclass->tokens) * G_USEC_PER_SEC) / sclass->budget + 1;
+                            *wakeup = MIN(*wakeup, when);
+                        }
+                }
+        }
+
+    return item;
+}
+
+
+/**
+ * Creates a new scheduler.
+ * @param dircache is the cache directory where metrics are written.
+ * @param live_budget is the number of bytes per second allowed to live
+ *        events (0 means no limit).
+ * @param carve_budget is the number of bytes per second allowed to
+ *        carve events (0 means no limit).
+ * @param workers is the number of workers that pop events: carve events
+ *        are never given to all of them so that one is always free to
+ *        take a live event.
+ * @param low_memory is TRUE when both queues have to be limited to
+ *        SCHEDULER_LOW_MEMORY_MAX_DEPTH events.
+ * @returns a newly allocated scheduler_t structure that may be freed
+ *          with free_scheduler_t() when no longer needed.
+ */
+scheduler_t *new_scheduler_t(gchar *dircache, gint64 live_budget, gint64 carve_budget, guint workers, gboolean low_memory)
+{
+    scheduler_t *sched = NULL;
+    gint64 now = g_get_monotonic_time();
+    guint live_depth = 0;
+    guint carve_depth = SCHEDULER_CARVE_MAX_DEPTH;
+
+    if (low_memory == TRUE)
+        {
+            live_depth = SCHEDULER_LOW_MEMORY_MAX_DEPTH;
+            carve_depth = SCHEDULER_LOW_MEMORY_MAX_DEPTH;
+        }
+
+    sched = (scheduler_t *) g_malloc0(sizeof(scheduler_t));
+    g_assert_nonnull(sched);
+
+    g_mutex_init(&sched->mutex);
+    g_cond_init(&sched->cond);
+    g_cond_init(&sched->room);
+
+    init_class(&sched->classes[SCHEDULER_LIVE], live_budget, live_depth, 0, now);
+    init_class(&sched->classes[SCHEDULER_CARVE], carve_budget, carve_depth, workers > 1 ? workers - 1 : 0, now);
+
+    sched->filename = g_build_filename(dircache, SCHEDULER_STATS_FILENAME, NULL);
+
+    return sched;
+}
+
+
+/**
+ * Frees a scheduler. Events still queued are dropped (they are not
+ * freed).
+ * @param sched is the scheduler_t structure to be freed.
+ */
+void free_scheduler_t(scheduler_t *sched)
+{
+    gint c = 0;
+
+    if (sched != NULL)
+        {
+            for (c = 0; c < SCHEDULER_CLASSES; c++)
+                {
+                    g_queue_free_full(sched->classes[c].queue, g_free);
+                }
+
+            g_cond_clear(&sched->room);
+            g_cond_clear(&sched->cond);
+            g_mutex_clear(&sched->mutex);
+            free_variable(sched->filename);
+            free_variable(sched);
+        }
+}
+
+
+/**
+ * Queues an event. Waits while the queue of the class is full.
+ * @param sched is the scheduler.
+ * @param data is the event to be queued.
+ * @param class is SCHEDULER_LIVE or SCHEDULER_CARVE.
+ * @param bytes is the number of bytes that saving this event is expected
+ *        to read (the size of the file).
+ */
+void scheduler_push(scheduler_t *sched, gpointer data, gint class, guint64 bytes)
+{
+    sched_class_t *sclass = NULL;
+    sched_item_t *item = NULL;
+
+    if (sched != NULL && data != NULL && class >= 0 && class < SCHEDULER_CLASSES)
+        {
+            item = (sched_item_t *) g_malloc(sizeof(sched_item_t));
+            g_assert_nonnull(item);
+
+            item->data = data;
+            item->bytes = bytes;
+
+            g_mutex_lock(&sched->mutex);
+
+            sclass = &sched->classes[class];
+
+            while (sclass->max_depth > 0 && g_queue_get_length(sclass->queue) >= sclass->max_depth)
+                {
+                    g_cond_wait(&sched->room, &sched->mutex);
+                }
+
+            item->queued = g_get_monotonic_time();
+            g_queue_push_tail(sclass->queue, item);
+            sclass->pushed++;
+
+            g_cond_signal(&sched->cond);
+            g_mutex_unlock(&sched->mutex);
+        }
+}
+
+
+/**
+ * Takes the next event without waiting: a live event if any and if its
+ * budget allows it, a carve event otherwise.
+ * @param sched is the scheduler.
+ * @param[out] class is the class of the returned event.
+ * @returns the event or NULL if no event may be given now.
+ */
+gpointer scheduler_try_pop(scheduler_t *sched, gint *class)
+{
+    sched_item_t *item = NULL;
+    gpointer data = NULL;
+    gint64 wakeup = G_MAXINT64;
+
+    if (sched != NULL && class != NULL)
+        {
+            g_mutex_lock(&sched->mutex);
+            item = take_item(sched, g_get_monotonic_time(), class, &wakeup);
+            g_mutex_unlock(&sched->mutex);
+
+            if (item != NULL)
+                {
+                    data = item->data;
+                    free_variable(item);
+                }
+        }
+
+    return data;
+}
+
+
+/**
+ * Takes the next event and waits until there is one that its budget
+ * allows.
+ * @param sched is the scheduler.
+ * @param[out] class is the class of the returned event.
+ * @returns the event (never NULL).
+ */
+gpointer scheduler_pop(scheduler_t *sched, gint *class)
+{
+    sched_item_t *item = NULL;
+    gpointer data = NULL;
+    gint64 wakeup = G_MAXINT64;
+
+    if (sched != NULL && class != NULL)
+        {
+            g_mutex_lock(&sched->mutex);
+
+            item = take_item(sched, g_get_monotonic_time(), class, &wakeup);
+
+            while (item == NULL)
+                {
+                    if (wakeup == G_MAXINT64)
+                        {
+                            g_cond_wait(&sched->cond, &sched->mutex);
+                        }
+                    else
+                        {
+                            g_cond_wait_until(&sched->cond, &sched->mutex, wakeup);
+                        }
+
+                    wakeup = G_MAXINT64;
+                    item = take_item(sched, g_get_monotonic_time(), class, &wakeup);
+                }
+
+            g_mutex_unlock(&sched->mutex);
+
+            data = item->data;
+            free_variable(item);
+        }
+
+    return data;
+}
+
+
+/**
+ * Tells the scheduler that an event returned by scheduler_pop() or
+ * scheduler_try_pop() has been saved.
+ * @param sched is the scheduler.
+ * @param class is the class of that event.
+ */
+void scheduler_done(scheduler_t *sched, gint class)
+{
+    if (sched != NULL && class >= 0 && class < SCHEDULER_CLASSES)
+        {
+            g_mutex_lock(&sched->mutex);
+
+            if (sched->classes[class].running > 0)
+                {
+                    sched->classes[class].running--;
+                }
+
+            g_cond_signal(&sched->cond);
+            g_mutex_unlock(&sched->mutex);
+        }
+}
+
+
+/**
+ * Adds the metrics of one class into a group of keyfile
+ * @param keyfile is the keyfile to be filled.
+ * @param group is the name of the group of that class.
+ * @param sclass is the class (scheduler's mutex must be held).
+ * @param now is the current monotonic time.
+ */
+static void add_class_to_keyfile(GKeyFile *keyfile, const gchar *group, sched_class_t *sclass, gint64 now)
+{
+    sched_item_t *oldest = (sched_item_t *) g_queue_peek_head(sclass->queue);
+    gint64 average = 0;
+
+    if (sclass->popped > 0)
+        {
+            average = sclass->wait_total / (gint64) sclass->popped;
+        }
+
+    g_key_file_set_uint64(keyfile, group, "depth", g_queue_get_length(sclass->queue));
+    g_key_file_set_int64(keyfile, group, "oldest-wait-ms", oldest != NULL ? (now - oldest->queued) / 1000 : 0);
+    g_key_file_set_int64(keyfile, group, "average-wait-ms", average / 1000);
+    g_key_file_set_int64(keyfile, group, "maximum-wait-ms", sclass->wait_max / 1000);
+    g_key_file_set_uint64(keyfile, group, "running", sclass->running);
+    g_key_file_set_uint64(keyfile, group, "pushed", sclass->pushed);
+    g_key_file_set_uint64(keyfile, group, "popped", sclass->popped);
+    g_key_file_set_uint64(keyfile, group, "bytes", sclass->bytes);
+    g_key_file_set_int64(keyfile, group, "budget", sclass->budget);
+}
+
+
+/**
+ * Writes the metrics of each class (depth, age of the oldest waiting
+ * event, waiting times, counts and budget) into the metrics file.
+ * @param sched is the scheduler.
+ */
+void scheduler_save_stats(scheduler_t *sched)
+{
+    GKeyFile *keyfile = NULL;
+    GError *error = NULL;
+    gchar *contents = NULL;
+    gsize length = 0;
+    gint64 now = 0;
+
+    if (sched != NULL)
+        {
+            keyfile = g_key_file_new();
+
+            g_mutex_lock(&sched->mutex);
+            now = g_get_monotonic_time();
+            add_class_to_keyfile(keyfile, "Live", &sched->classes[SCHEDULER_LIVE], now);
+            add_class_to_keyfile(keyfile, "Carve", &sched->classes[SCHEDULER_CARVE], now);
+            g_mutex_unlock(&sched->mutex);
+
+            contents = g_key_file_to_data(keyfile, &length, NULL);
+
+            if (g_file_set_contents(sched->filename, contents, length, &error) == FALSE && error != NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while writing scheduler's metrics to %s: %s\n"), sched->filename, error->message);
+                    free_error(error);
+                }
+
+            free_variable(contents);
+            g_key_file_free(keyfile);
+        }
+}
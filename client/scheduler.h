@@ -0,0 +1,214 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    scheduler.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file scheduler.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the scheduler of file events. Events come from fanotify (live
+ * changes) or from directory carving and are queued in two priority
+ * classes: workers always take live events first so that a change is
+ * saved quickly even when millions of carved files are waiting. Each
+ * class may be limited to a number of bytes per second.
+ */
+#ifndef _CLIENT_SCHEDULER_H_
+#define _CLIENT_SCHEDULER_H_
+
+
+/**
+ * @def SCHEDULER_LIVE
+ * Priority class of events coming from fanotify.
+ */
+#define SCHEDULER_LIVE (0)
+
+/**
+ * @def SCHEDULER_CARVE
+ * Priority class of events coming from directory carving.
+ */
+#define SCHEDULER_CARVE (1)
+
+/**
+ * @def SCHEDULER_CLASSES
+ * Number of priority classes.
+ */
+#define SCHEDULER_CLASSES (2)
+
+
+/**
+ * @def SCHEDULER_CARVE_MAX_DEPTH
+ * Maximum number of carve events that may wait in the queue. Carvers
+ * wait when it is reached: enumerating a huge tree does not fill the
+ * memory with events that will not be saved before long.
+ */
+#define SCHEDULER_CARVE_MAX_DEPTH (65536)
+
+
+/**
+ * @def SCHEDULER_LOW_MEMORY_MAX_DEPTH
+ * Maximum number of events of each class that may wait in the queue in
+ * low memory mode. Live events are limited too: fanotify's thread then
+ * waits and the kernel keeps the events meanwhile.
+ */
+#define SCHEDULER_LOW_MEMORY_MAX_DEPTH (1024)
+
+
+/**
+ * @def SCHEDULER_STATS_FILENAME
+ * Name of the file (in the cache directory) where the metrics of the
+ * scheduler are written.
+ */
+#define SCHEDULER_STATS_FILENAME ("scheduler.stats")
+
+
+/**
+ * @def SCHEDULER_STATS_INTERVAL
+ * Time in seconds between two writes of the metrics of the scheduler.
+ */
+#define SCHEDULER_STATS_INTERVAL (10)
+
+
+/**
+ * @struct sched_item_t
+ * @brief One queued event.
+ */
+typedef struct
+{
+    gpointer data;    /**< the event itself (a file_event_t *)                  */
+    guint64 bytes;    /**< bytes that saving this event is expected to read     */
+    gint64 queued;    /**< monotonic time (in µs) when the event was queued     */
+} sched_item_t;
+
+
+/**
+ * @struct sched_class_t
+ * @brief Queue, budget and metrics of one priority class.
+ *
+ * The budget is a token bucket of bytes: it is refilled at budget bytes
+ * per second up to one second of budget and an event is given to a
+ * worker only when the bucket is not empty. Big files make the bucket
+ * go below zero and the class then waits for it to be refilled.
+ */
+typedef struct
+{
+    GQueue *queue;        /**< sched_item_t * waiting events (oldest first)              */
+    guint max_depth;      /**< maximum number of waiting events (0 means no limit)       */
+    gint64 budget;        /**< bytes per second allowed to this class (0 means no limit) */
+    gint64 tokens;        /**< bytes that may still be given without waiting             */
+    gint64 refilled;      /**< monotonic time (in µs) of the last refill of tokens       */
+    guint running;        /**< number of events of this class being saved                */
+    guint max_running;    /**< maximum number of events saved at once (0 means no limit) */
+    guint64 pushed;       /**< number of events queued since the beginning               */
+    guint64 popped;       /**< number of events given to workers since the beginning     */
+    guint64 bytes;        /**< number of bytes given to workers since the beginning      */
+    gint64 wait_total;    /**< sum of the times (in µs) events waited in the queue       */
+    gint64 wait_max;      /**< maximum time (in µs) an event waited in the queue         */
+} sched_class_t;
+
+
+/**
+ * @struct scheduler_t
+ * @brief Priority scheduler of file events shared by carvers, fanotify
+ *        and workers.
+ */
+typedef struct
+{
+    GMutex mutex;                              /**< Protects everything in this structure          */
+    GCond cond;                                /**< Signaled when an event may be given to workers */
+    GCond room;                                /**< Signaled when a queue is no longer full        */
+    sched_class_t classes[SCHEDULER_CLASSES];  /**< Live and carve classes                         */
+    gchar *filename;                           /**< File where metrics are written                 */
+} scheduler_t;
+
+
+/**
+ * Creates a new scheduler.
+ * @param dircache is the cache directory where metrics are written.
+ * @param live_budget is the number of bytes per second allowed to live
+ *        events (0 means no limit).
+ * @param carve_budget is the number of bytes per second allowed to
+ *        carve events (0 means no limit).
+ * @param workers is the number of workers that pop events: carve events
+ *        are never given to all of them so that one is always free to
+ *        take a live event.
+ * @param low_memory is TRUE when both queues have to be limited to
+ *        SCHEDULER_LOW_MEMORY_MAX_DEPTH events.
+ * @returns a newly allocated scheduler_t structure that may be freed
+ *          with free_scheduler_t() when no longer needed.
+ */
+extern scheduler_t *new_scheduler_t(gchar *dircache, gint64 live_budget, gint64 carve_budget, guint workers, gboolean low_memory);
+
+
+/**
+ * Frees a scheduler. Events still queued are dropped (they are not
+ * freed).
+ * @param sched is the scheduler_t structure to be freed.
+ */
+extern void free_scheduler_t(scheduler_t *sched);
+
+
+/**
+ * Queues an event. Waits while the queue of the class is full.
+ * @param sched is the scheduler.
+ * @param data is the event to be queued.
+ * @param class is SCHEDULER_LIVE or SCHEDULER_CARVE.
+ * @param bytes is the number of bytes that saving this event is expected
+ *        to read (the size of the file).
+ */
+extern void scheduler_push(scheduler_t *sched, gpointer data, gint class, guint64 bytes);
+
+
+/**
+ * Takes the next event without waiting: a live event if any and if its
+ * budget allows it, a carve event otherwise.
+ * @param sched is the scheduler.
+ * @param[out] class is the class of the returned event.
+ * @returns the event or NULL if no event may be given now.
+ */
+extern gpointer scheduler_try_pop(scheduler_t *sched, gint *class);
+
+
+/**
+ * Takes the next event and waits until there is one that its budget
+ * allows.
+ * @param sched is the scheduler.
+ * @param[out] class is the class of the returned event.
+ * @returns the event (never NULL).
+ */
+extern gpointer scheduler_pop(scheduler_t *sched, gint *class);
+
+
+/**
+ * Tells the scheduler that an event returned by scheduler_pop() or
+ * scheduler_try_pop() has been saved.
+ * @param sched is the scheduler.
+ * @param class is the class of that event.
+ */
+extern void scheduler_done(scheduler_t *sched, gint class);
+
+
+/**
+ * Writes the metrics of each class (depth, age of the oldest waiting
+ * event, waiting times, counts and budget) into the metrics file.
+ * @param sched is the scheduler.
+ */
+extern void scheduler_save_stats(scheduler_t *sched);
+
+#endif /* #ifndef _CLIENT_SCHEDULER_H_ */
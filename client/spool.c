@@ -0,0 +1,553 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    spool.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file spool.c
+ *
+ * This file contains the functions of the offline spool: requests that
+ * could not be sent to the server are appended to segment files and
+ * segments are replayed in parallel when the server is back.
+ */
+
+#include "client.h"
+
+/**
+ * @struct replay_t
+ * @brief Shared by the threads that replay the segments of a spool.
+ */
+typedef struct
+{
+    spool_t *spool;     /**< spool being replayed                             */
+    gchar *conn;        /**< connexion string of the server                   */
+    gshort cmptype;     /**< compression type used by the client               */
+    GMutex mutex;       /**< protects next and failed                         */
+    guint32 next;       /**< number of the next segment to be replayed        */
+    guint32 last;       /**< segments from next to last - 1 are to be replayed */
+    guint32 failed;     /**< lowest number of a segment not entirely replayed */
+} replay_t;
+
+static gchar *make_segment_filename(spool_t *spool, guint32 number, gchar *extension);
+static gboolean write_all(gint fd, guint8 *buffer, guint64 length);
+static void close_segment(spool_t *spool);
+static guint64 read_segment_position(gchar *posname);
+static void write_segment_position(gchar *posname, guint64 pos);
+static gboolean replay_segment(spool_t *spool, comm_t *comm, guint32 number);
+static gpointer replay_segments_thread(gpointer data);
+
+
+/**
+ * @param spool is the spool of the client.
+ * @param number is the number of the segment.
+ * @param extension is the extension of the file ("spool" or "pos").
+ * @returns a newly allocated filename of the segment that may be freed
+ *          with free_variable() when no longer needed.
+ */
+static gchar *make_segment_filename(spool_t *spool, guint32 number, gchar *extension)
+{
+    return g_strdup_printf("%s/%08x.%s", spool->directory, number, extension);
+}
+
+
+/**
+ * Writes the whole buffer into fd even if write() writes it in parts.
+ * @param fd is the file descriptor where to write.
+ * @param buffer is the buffer to be written.
+ * @param length is the number of bytes of buffer.
+ * @returns TRUE if everything has been written, FALSE otherwise.
+ */
+static gboolean write_all(gint fd, guint8 *buffer, guint64 length)
+{
+    ssize_t written = 0;
+
+    while (length > 0)
+        {
+            written = write(fd, buffer, length);
+
+            if (written < 0 && errno != EINTR)
+                {
+                    return FALSE;
+                }
+            else if (written > 0)
+                {
+                    buffer = buffer + written;
+                    length = length - written;
+                }
+        }
+
+    return TRUE;
+}
+
+
+/**
+ * Closes the segment we are appending to: it may now be replayed and
+ * records will go into the next one.
+ * @param spool is the spool of the client (mutex must be held).
+ */
+static void close_segment(spool_t *spool)
+{
+    if (spool->fd >= 0)
+        {
+            fdatasync(spool->fd);
+            close(spool->fd);
+            spool->fd = -1;
+            spool->segment++;
+            spool->size = 0;
+        }
+}
+
+
+/**
+ * Opens the spool located in directory (creates it if needed). Segments
+ * left by a previous run are kept to be replayed.
+ * @param directory is the cache directory of the client.
+ * @returns a newly allocated spool_t structure that may be freed with
+ *          free_spool_t() when no longer needed.
+ */
+spool_t *open_spool(gchar *directory)
+{
+    spool_t *spool = NULL;
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    guint number = 0;
+    gboolean found = FALSE;
+
+    g_assert_nonnull(directory);
+
+    spool = (spool_t *) g_malloc0(sizeof(spool_t));
+    g_assert_nonnull(spool);
+
+    spool->directory = g_build_filename(directory, SPOOL_DIRNAME, NULL);
+    g_mutex_init(&spool->mutex);
+    g_cond_init(&spool->cond);
+    spool->fd = -1;
+    spool->size = 0;
+    spool->first = 0;
+    spool->segment = 0;
+
+    if (g_mkdir_with_parents(spool->directory, S_IRWXU) != 0)
+        {
+            print_error(__FILE__, __LINE__, _("Unable to create directory %s: %s\n"), spool->directory, g_strerror(errno));
+        }
+
+    /* A new segment is always opened after the ones of a previous run:
+     * their end may have been torn by a crash.
+     */
+    dir = g_dir_open(spool->directory, 0, NULL);
+
+    if (dir != NULL)
+        {
+            while ((name = g_dir_read_name(dir)) != NULL)
+                {
+                    if (g_str_has_suffix(name, ".spool") && sscanf(name, "%8x", &number) == 1)
+                        {
+                            if (found == FALSE || number < spool->first)
+                                {
+                                    spool->first = number;
+                                }
+
+                            if (found == FALSE || number >= spool->segment)
+                                {
+                                    spool->segment = number + 1;
+                                }
+
+                            found = TRUE;
+                        }
+                }
+
+            g_dir_close(dir);
+        }
+
+    return spool;
+}
+
+
+/**
+ * Closes the current segment and frees the spool
+ * @param spool is the spool_t structure to be freed.
+ */
+void free_spool_t(spool_t *spool)
+{
+    if (spool != NULL)
+        {
+            g_mutex_lock(&spool->mutex);
+            close_segment(spool);
+            g_mutex_unlock(&spool->mutex);
+
+            g_mutex_clear(&spool->mutex);
+            g_cond_clear(&spool->cond);
+            free_variable(spool->directory);
+            free_variable(spool);
+        }
+}
+
+
+/**
+ * Appends a request that could not be sent to the current segment.
+ * @param spool is the spool of the client.
+ * @param url is the url where the request should have been sent.
+ * @param buffer is the payload of the request.
+ * @param length is the number of bytes of buffer.
+ * @returns TRUE if the request has been written, FALSE otherwise.
+ */
+gboolean spool_append(spool_t *spool, gchar *url, gchar *buffer, guint64 length)
+{
+    guint8 header[SPOOL_RECORD_HEADER_SIZE];
+    gchar *filename = NULL;
+    gsize url_len = 0;
+    gboolean written = FALSE;
+
+    if (spool != NULL && url != NULL && buffer != NULL)
+        {
+            url_len = strlen(url);
+
+            put_guint32_into_buffer(header, SPOOL_MAGIC);
+            put_guint16_into_buffer(header + 4, (guint16) url_len);
+            put_guint16_into_buffer(header + 6, 0);
+            put_guint64_into_buffer(header + 8, length);
+
+            g_mutex_lock(&spool->mutex);
+
+            if (spool->fd < 0)
+                {
+                    filename = make_segment_filename(spool, spool->segment, "spool");
+                    spool->fd = g_open(filename, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+                    spool->size = 0;
+
+                    if (spool->fd < 0)
+                        {
+                            print_error(__FILE__, __LINE__, _("Unable to open file %s: %s\n"), filename, g_strerror(errno));
+                        }
+
+                    free_variable(filename);
+                }
+
+            if (spool->fd >= 0)
+                {
+                    written = write_all(spool->fd, header, SPOOL_RECORD_HEADER_SIZE) &&
+                              write_all(spool->fd, (guint8 *) url, url_len) &&
+                              write_all(spool->fd, (guint8 *) buffer, length);
+
+                    if (written == TRUE)
+                        {
+                            spool->size = spool->size + SPOOL_RECORD_HEADER_SIZE + url_len + length;
+
+                            if (spool->size >= SPOOL_SEGMENT_SIZE)
+                                {
+                                    close_segment(spool);
+                                }
+
+                            g_cond_broadcast(&spool->cond);
+                        }
+                    else
+                        {
+                            /* Removes the partial record that would end the segment */
+                            print_error(__FILE__, __LINE__, _("Error while writing to the spool: %s\n"), g_strerror(errno));
+                            if (ftruncate(spool->fd, spool->size) != 0)
+                                {
+                                    print_error(__FILE__, __LINE__, _("Error while truncating the spool: %s\n"), g_strerror(errno));
+                                }
+                        }
+                }
+
+            g_mutex_unlock(&spool->mutex);
+        }
+
+    return written;
+}
+
+
+/**
+ * @param spool is the spool of the client.
+ * @returns TRUE if some requests are waiting to be replayed.
+ */
+gboolean spool_has_records(spool_t *spool)
+{
+    gboolean has_records = FALSE;
+
+    if (spool != NULL)
+        {
+            g_mutex_lock(&spool->mutex);
+            has_records = (spool->first != spool->segment || spool->size > 0);
+            g_mutex_unlock(&spool->mutex);
+        }
+
+    return has_records;
+}
+
+
+/**
+ * Waits until a request is appended to the spool or timeout is
+ * reached.
+ * @param spool is the spool of the client.
+ * @param timeout is the maximum time to wait in microseconds.
+ * @returns TRUE if some requests are waiting to be replayed.
+ */
+gboolean spool_wait(spool_t *spool, gint64 timeout)
+{
+    gboolean has_records = FALSE;
+    gint64 end_time = 0;
+
+    if (spool != NULL)
+        {
+            end_time = g_get_monotonic_time() + timeout;
+
+            g_mutex_lock(&spool->mutex);
+
+            has_records = (spool->first != spool->segment || spool->size > 0);
+
+            while (has_records == FALSE && g_cond_wait_until(&spool->cond, &spool->mutex, end_time) == TRUE)
+                {
+                    has_records = (spool->first != spool->segment || spool->size > 0);
+                }
+
+            g_mutex_unlock(&spool->mutex);
+        }
+
+    return has_records;
+}
+
+
+/**
+ * @param posname is the filename where the progress of the replay of a
+ *        segment is saved.
+ * @returns the offset in the segment of the first record that has not
+ *          been sent yet (0 if none has been sent).
+ */
+static guint64 read_segment_position(gchar *posname)
+{
+    gchar *contents = NULL;
+    gsize length = 0;
+    guint64 pos = 0;
+
+    if (g_file_get_contents(posname, &contents, &length, NULL) == TRUE && length == sizeof(guint64))
+        {
+            pos = get_guint64_from_buffer((guint8 *) contents);
+        }
+
+    free_variable(contents);
+
+    return pos;
+}
+
+
+/**
+ * Saves the progress of the replay of a segment.
+ * @param posname is the filename where to save it.
+ * @param pos is the offset in the segment of the first record that has
+ *        not been sent yet.
+ */
+static void write_segment_position(gchar *posname, guint64 pos)
+{
+    guint8 buffer[sizeof(guint64)];
+    GError *error = NULL;
+
+    put_guint64_into_buffer(buffer, pos);
+
+    if (g_file_set_contents(posname, (gchar *) buffer, sizeof(guint64), &error) == FALSE)
+        {
+            print_error(__FILE__, __LINE__, _("Error while writing %s: %s\n"), posname, error->message);
+            free_error(error);
+        }
+}
+
+
+/**
+ * Sends every record of a closed segment that has not been sent yet.
+ * @param spool is the spool of the client.
+ * @param comm is the comm_t * structure used by this thread only.
+ * @param number is the number of the segment to be replayed.
+ * @returns TRUE if the segment has been entirely replayed (and removed),
+ *          FALSE if a request failed.
+ */
+static gboolean replay_segment(spool_t *spool, comm_t *comm, guint32 number)
+{
+    gchar *filename = make_segment_filename(spool, number, "spool");
+    gchar *posname = make_segment_filename(spool, number, "pos");
+    GMappedFile *map = NULL;
+    guint8 *contents = NULL;
+    guint64 size = 0;
+    guint64 pos = 0;
+    guint16 url_len = 0;
+    guint64 length = 0;
+    gchar *url = NULL;
+    gint success = CURLE_OK;
+    gboolean done = TRUE;
+
+    map = g_mapped_file_new(filename, FALSE, NULL);
+
+    if (map != NULL)
+        {
+            contents = (guint8 *) g_mapped_file_get_contents(map);
+            size = g_mapped_file_get_length(map);
+            pos = read_segment_position(posname);
+
+            while (done == TRUE && contents != NULL && pos + SPOOL_RECORD_HEADER_SIZE <= size)
+                {
+                    url_len = get_guint16_from_buffer(contents + pos + 4);
+                    length = get_guint64_from_buffer(contents + pos + 8);
+
+                    if (get_guint32_from_buffer(contents + pos) != SPOOL_MAGIC || pos + SPOOL_RECORD_HEADER_SIZE + url_len + length > size)
+                        {
+                            print_error(__FILE__, __LINE__, _("Segment %s is truncated at offset %" G_GUINT64_FORMAT "\n"), filename, pos);
+                            pos = size;
+                        }
+                    else
+                        {
+                            url = g_strndup((gchar *) contents + pos + SPOOL_RECORD_HEADER_SIZE, url_len);
+                            comm->readbuffer = (gchar *) contents + pos + SPOOL_RECORD_HEADER_SIZE + url_len;
+                            success = post_binary_url(comm, url, length);
+                            comm->readbuffer = NULL;
+
+                            if (success == CURLE_OK)
+                                {
+                                    free_variable(comm->buffer);
+                                    pos = pos + SPOOL_RECORD_HEADER_SIZE + url_len + length;
+                                    write_segment_position(posname, pos);
+                                }
+                            else
+                                {
+                                    done = FALSE;
+                                }
+
+                            free_variable(url);
+                        }
+                }
+
+            g_mapped_file_unref(map);
+        }
+
+    if (done == TRUE)
+        {
+            g_unlink(filename);
+            g_unlink(posname);
+        }
+
+    free_variable(filename);
+    free_variable(posname);
+
+    return done;
+}
+
+
+/**
+ * Thread that replays segments one after the other with its own
+ * connection to the server until there is no more segment to be
+ * replayed or a request fails.
+ * @param data is the replay_t * structure shared by replay threads.
+ * @returns NULL.
+ */
+static gpointer replay_segments_thread(gpointer data)
+{
+    replay_t *replay = (replay_t *) data;
+    comm_t *comm = NULL;
+    guint32 number = 0;
+    gboolean go_on = TRUE;
+
+    comm = init_comm_struct(replay->conn, replay->cmptype);
+
+    while (go_on == TRUE)
+        {
+            g_mutex_lock(&replay->mutex);
+            number = replay->next;
+            go_on = (number != replay->last && replay->failed == replay->last);
+            replay->next = go_on ? number + 1 : number;
+            g_mutex_unlock(&replay->mutex);
+
+            if (go_on == TRUE && replay_segment(replay->spool, comm, number) == FALSE)
+                {
+                    /* The server is unreachable again: other threads will stop too */
+                    g_mutex_lock(&replay->mutex);
+                    replay->failed = MIN(replay->failed, number);
+                    g_mutex_unlock(&replay->mutex);
+                    go_on = FALSE;
+                }
+        }
+
+    free_comm_t(comm);
+
+    return NULL;
+}
+
+
+/**
+ * Closes the current segment and replays every closed segment with
+ * threads threads. A segment is removed once all its records have been
+ * sent. Replay of a segment stops at the first request that fails.
+ * @param spool is the spool of the client.
+ * @param conn is the connexion string of the server.
+ * @param cmptype is the compression type used by the client.
+ * @param threads is the number of segments replayed at the same time.
+ * @returns TRUE if every segment has been replayed, FALSE otherwise.
+ */
+gboolean spool_replay(spool_t *spool, gchar *conn, gshort cmptype, guint threads)
+{
+    replay_t replay;
+    GThread **thread_list = NULL;
+    guint i = 0;
+    guint n = 0;
+
+    if (spool == NULL || conn == NULL)
+        {
+            return FALSE;
+        }
+
+    g_mutex_lock(&spool->mutex);
+    close_segment(spool);
+    replay.spool = spool;
+    replay.conn = conn;
+    replay.cmptype = cmptype;
+    replay.next = spool->first;
+    replay.last = spool->segment;
+    replay.failed = spool->segment;
+    g_mutex_unlock(&spool->mutex);
+
+    n = MIN(MAX(threads, 1), replay.last - replay.next);
+
+    if (n > 0)
+        {
+            print_debug(_("Replaying %u spool segments with %u threads\n"), replay.last - replay.next, n);
+
+            g_mutex_init(&replay.mutex);
+            thread_list = (GThread **) g_malloc0(n * sizeof(GThread *));
+
+            for (i = 0; i < n; i++)
+                {
+                    thread_list[i] = g_thread_new("replay-segments", replay_segments_thread, &replay);
+                }
+
+            for (i = 0; i < n; i++)
+                {
+                    g_thread_join(thread_list[i]);
+                }
+
+            free_variable(thread_list);
+            g_mutex_clear(&replay.mutex);
+
+            /* Segments after the one that failed may have been replayed:
+             * replay_segment() simply skips them next time.
+             */
+            g_mutex_lock(&spool->mutex);
+            spool->first = replay.failed;
+            g_mutex_unlock(&spool->mutex);
+        }
+
+    return (replay.failed == replay.last);
+}
@@ -0,0 +1,156 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    spool.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file spool.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the offline spool. When the server can not be reached, requests
+ * that could not be sent are appended, as is (binary arrays stay binary),
+ * to segment files in the spool directory of the cache. Closed segments
+ * are replayed in parallel when the server comes back.
+ */
+#ifndef _CLIENT_SPOOL_H_
+#define _CLIENT_SPOOL_H_
+
+
+/**
+ * @def SPOOL_DIRNAME
+ * Name of the spool directory in the client's cache directory.
+ */
+#define SPOOL_DIRNAME ("spool")
+
+
+/**
+ * @def SPOOL_SEGMENT_SIZE
+ * Size (in bytes) above which a new segment file is opened. Default is
+ * 64 MB.
+ */
+#define SPOOL_SEGMENT_SIZE (67108864)
+
+
+/**
+ * @def SPOOL_MAGIC
+ * Magic number that begins every record in a segment file ("CDSP"). A
+ * record that does not begin with it is the torn end of a segment.
+ */
+#define SPOOL_MAGIC (0x50534443)
+
+
+/**
+ * @def SPOOL_RECORD_HEADER_SIZE
+ * Size of the header written before each record in a segment file:
+ * magic (4), url length (2), padding (2) and payload length (8). The url
+ * and then the payload follow the header.
+ */
+#define SPOOL_RECORD_HEADER_SIZE (4 + 2 + 2 + 8)
+
+
+/**
+ * @def SPOOL_REPLAY_THREADS
+ * Number of segments replayed at the same time, each one with its own
+ * connection to the server.
+ */
+#define SPOOL_REPLAY_THREADS (4)
+
+
+/**
+ * @struct spool_t
+ * @brief Segment files of requests that could not be sent.
+ *
+ * Segments are named XXXXXXXX.spool and are numbered. Records are only
+ * appended to the current segment, segments first to current - 1 are
+ * closed and may be replayed. The replay progress of a segment is kept
+ * in a XXXXXXXX.pos file next to it in order not to send again, after a
+ * restart, what has already been sent. Requests are spooled by workers
+ * and replayed by the reconnection thread: everything is protected by
+ * mutex.
+ */
+typedef struct
+{
+    gchar *directory;   /**< directory where segment files are            */
+    GMutex mutex;       /**< protects everything in this structure        */
+    GCond cond;         /**< signaled when a record has been appended     */
+    guint32 first;      /**< number of the oldest segment not yet replayed */
+    guint32 segment;    /**< number of the segment we are appending to    */
+    gint fd;            /**< file descriptor of that segment (-1 if none) */
+    guint64 size;       /**< number of bytes written into that segment    */
+} spool_t;
+
+
+/**
+ * Opens the spool located in directory (creates it if needed). Segments
+ * left by a previous run are kept to be replayed.
+ * @param directory is the cache directory of the client.
+ * @returns a newly allocated spool_t structure that may be freed with
+ *          free_spool_t() when no longer needed.
+ */
+extern spool_t *open_spool(gchar *directory);
+
+
+/**
+ * Closes the current segment and frees the spool
+ * @param spool is the spool_t structure to be freed.
+ */
+extern void free_spool_t(spool_t *spool);
+
+
+/**
+ * Appends a request that could not be sent to the current segment.
+ * @param spool is the spool of the client.
+ * @param url is the url where the request should have been sent.
+ * @param buffer is the payload of the request.
+ * @param length is the number of bytes of buffer.
+ * @returns TRUE if the request has been written, FALSE otherwise.
+ */
+extern gboolean spool_append(spool_t *spool, gchar *url, gchar *buffer, guint64 length);
+
+
+/**
+ * @param spool is the spool of the client.
+ * @returns TRUE if some requests are waiting to be replayed.
+ */
+extern gboolean spool_has_records(spool_t *spool);
+
+
+/**
+ * Waits until a request is appended to the spool or timeout is
+ * reached.
+ * @param spool is the spool of the client.
+ * @param timeout is the maximum time to wait in microseconds.
+ * @returns TRUE if some requests are waiting to be replayed.
+ */
+extern gboolean spool_wait(spool_t *spool, gint64 timeout);
+
+
+/**
+ * Closes the current segment and replays every closed segment with
+ * threads threads. A segment is removed once all its records have been
+ * sent. Replay of a segment stops at the first request that fails.
+ * @param spool is the spool of the client.
+ * @param conn is the connexion string of the server.
+ * @param cmptype is the compression type used by the client.
+ * @param threads is the number of segments replayed at the same time.
+ * @returns TRUE if every segment has been replayed, FALSE otherwise.
+ */
+extern gboolean spool_replay(spool_t *spool, gchar *conn, gshort cmptype, guint threads);
+
+#endif /* #ifndef _CLIENT_SPOOL_H_ */
@@ -0,0 +1,215 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    tuner.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file tuner.c
+ *
+ * This file contains the functions of the auto-tuning of the block size
+ * of each class of files from the deduplication ratio measured upon
+ * the files of the class.
+ */
+
+#include "client.h"
+
+static void decide_class_shift(tuner_class_t *class, guint number);
+
+
+/**
+ * Upper limits (excluded) of the size of the files of each class but
+ * the last one. They are the ones of the adaptive mode.
+ */
+static const gint64 class_limits[TUNER_NB_CLASSES - 1] = {32768, 262144, 1048576, 8388608, 67108864, 134217728};
+
+
+/**
+ * Creates a new tuner where no class has changed its block size yet.
+ * @returns a newly allocated tuner_t structure that may be freed with
+ *          free_tuner_t() when no longer needed.
+ */
+tuner_t *new_tuner_t(void)
+{
+    tuner_t *tuner = NULL;
+    gint64 now = g_get_monotonic_time();
+    guint i = 0;
+
+    tuner = (tuner_t *) g_malloc0(sizeof(tuner_t));
+    g_assert_nonnull(tuner);
+
+    g_mutex_init(&tuner->mutex);
+
+    for (i = 0; i < TUNER_NB_CLASSES; i++)
+        {
+            /* A first change may only happen after TUNER_MIN_INTERVAL */
+            tuner->classes[i].shift = 0;
+            tuner->classes[i].warming = FALSE;
+            tuner->classes[i].changed = now;
+        }
+
+    return tuner;
+}
+
+
+/**
+ * Frees the tuner
+ * @param tuner is the tuner_t structure to be freed.
+ */
+void free_tuner_t(tuner_t *tuner)
+{
+    if (tuner != NULL)
+        {
+            g_mutex_clear(&tuner->mutex);
+            free_variable(tuner);
+        }
+}
+
+
+/**
+ * @param size is the size of a file.
+ * @returns the class of the file (from 0 to TUNER_NB_CLASSES - 1).
+ */
+guint tuner_get_class(gint64 size)
+{
+    guint class = 0;
+
+    while (class < TUNER_NB_CLASSES - 1 && size >= class_limits[class])
+        {
+            class++;
+        }
+
+    return class;
+}
+
+
+/**
+ * Gives the block size to use for a file.
+ * @param tuner is the tuner (may be NULL).
+ * @param size is the size of the file.
+ * @param blocksize is the block size the file would have without
+ *        auto-tuning.
+ * @returns blocksize with the power of two of the class of the file
+ *          applied (blocksize when tuner is NULL).
+ */
+gint64 tuner_get_blocksize(tuner_t *tuner, gint64 size, gint64 blocksize)
+{
+    gint shift = 0;
+
+    if (tuner != NULL)
+        {
+            g_mutex_lock(&tuner->mutex);
+            shift = tuner->classes[tuner_get_class(size)].shift;
+            g_mutex_unlock(&tuner->mutex);
+
+            /* Stops at TUNER_MIN_BLOCKSIZE and TUNER_MAX_BLOCKSIZE */
+            while (shift > 0 && blocksize * 2 <= TUNER_MAX_BLOCKSIZE)
+                {
+                    blocksize = blocksize * 2;
+                    shift--;
+                }
+
+            while (shift < 0 && blocksize / 2 >= TUNER_MIN_BLOCKSIZE)
+                {
+                    blocksize = blocksize / 2;
+                    shift++;
+                }
+        }
+
+    return blocksize;
+}
+
+
+/**
+ * Decides whether the block size of a class has to change from the
+ * files measured since the last decision and begins a new measure.
+ * @param class is the class of files (mutex must be held).
+ * @param number is the number of the class (for debug messages).
+ */
+static void decide_class_shift(tuner_class_t *class, guint number)
+{
+    gint64 now = g_get_monotonic_time();
+    gdouble ratio = 0;
+    gint shift = class->shift;
+
+    ratio = 1 - ((gdouble) class->sent / (gdouble) class->blocks);
+
+    if (class->warming == TRUE)
+        {
+            /* These files were the first ones saved with the new block size */
+            class->warming = FALSE;
+        }
+    else if (now - class->changed >= (gint64) TUNER_MIN_INTERVAL * G_USEC_PER_SEC)
+        {
+            if (ratio < TUNER_LOW_DEDUP && shift < TUNER_MAX_SHIFT)
+                {
+                    shift++;
+                }
+            else if (ratio >= TUNER_HIGH_DEDUP && ratio < TUNER_FULL_DEDUP && shift > TUNER_MIN_SHIFT)
+                {
+                    shift--;
+                }
+
+            if (shift != class->shift)
+                {
+                    print_debug(_("Class %u of files: deduplication ratio is %.2f, block size power of two goes from %d to %d\n"), number, ratio, class->shift, shift);
+                    class->shift = shift;
+                    class->warming = TRUE;
+                    class->changed = now;
+                }
+        }
+
+    class->files = 0;
+    class->blocks = 0;
+    class->sent = 0;
+}
+
+
+/**
+ * Records how a file has been deduplicated. The block size of its class
+ * may change when enough files have been measured.
+ * @param tuner is the tuner (may be NULL).
+ * @param size is the size of the file.
+ * @param blocks is the number of blocks of the file.
+ * @param sent is the number of these blocks whose data had to be sent
+ *        to the server.
+ */
+void tuner_record_file(tuner_t *tuner, gint64 size, guint64 blocks, guint64 sent)
+{
+    tuner_class_t *class = NULL;
+    guint number = 0;
+
+    if (tuner != NULL && blocks > 0)
+        {
+            number = tuner_get_class(size);
+
+            g_mutex_lock(&tuner->mutex);
+
+            class = &tuner->classes[number];
+            class->files = class->files + 1;
+            class->blocks = class->blocks + blocks;
+            class->sent = class->sent + MIN(sent, blocks);
+
+            if (class->files >= TUNER_MIN_FILES && class->blocks >= TUNER_MIN_BLOCKS)
+                {
+                    decide_class_shift(class, number);
+                }
+
+            g_mutex_unlock(&tuner->mutex);
+        }
+}
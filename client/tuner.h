@@ -0,0 +1,195 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    tuner.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file tuner.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the auto-tuning of the client. Files are put into classes by their
+ * size (the ones of the adaptive mode). For each class the ratio of
+ * blocks that the server already had (or that are unchanged since the
+ * previous version of the file) is measured and the block size of the
+ * class is doubled when almost nothing is deduplicated or halved when
+ * files are partly deduplicated. The size of the batches sent to the
+ * server is tuned from the latency and bandwidth measured on each
+ * connection (see comm_get_tuned_size()).
+ */
+#ifndef _CLIENT_TUNER_H_
+#define _CLIENT_TUNER_H_
+
+
+/**
+ * @def TUNER_NB_CLASSES
+ * Number of classes of files (by size).
+ */
+#define TUNER_NB_CLASSES (7)
+
+
+/**
+ * @def TUNER_MIN_SHIFT
+ * Minimum power of two applied to the block size of a class (-2 divides
+ * it by 4).
+ *
+ * @def TUNER_MAX_SHIFT
+ * Maximum power of two applied to the block size of a class (2
+ * multiplies it by 4).
+ */
+#define TUNER_MIN_SHIFT (-2)
+#define TUNER_MAX_SHIFT (2)
+
+
+/**
+ * @def TUNER_MIN_BLOCKSIZE
+ * Block size (in bytes) under which a class never goes.
+ *
+ * @def TUNER_MAX_BLOCKSIZE
+ * Block size (in bytes) above which a class never goes.
+ */
+#define TUNER_MIN_BLOCKSIZE (512)
+#define TUNER_MAX_BLOCKSIZE (1048576)
+
+
+/**
+ * @def TUNER_MIN_FILES
+ * Number of files of a class that have to be measured before its block
+ * size may change.
+ *
+ * @def TUNER_MIN_BLOCKS
+ * Number of blocks of these files that have to be measured before the
+ * block size of the class may change.
+ */
+#define TUNER_MIN_FILES (16)
+#define TUNER_MIN_BLOCKS (1024)
+
+
+/**
+ * @def TUNER_MIN_INTERVAL
+ * Minimum time (in seconds) between two changes of the block size of a
+ * class. Blocks of a file saved with a new block size can not be found
+ * unchanged in its previous version: the files measured just after a
+ * change are not taken into account either. Default is 30 minutes.
+ */
+#define TUNER_MIN_INTERVAL (1800)
+
+
+/**
+ * @def TUNER_LOW_DEDUP
+ * Deduplication ratio under which the block size of a class is doubled
+ * (small blocks only cost hashs).
+ *
+ * @def TUNER_HIGH_DEDUP
+ * Deduplication ratio above which the block size of a class is halved
+ * (smaller blocks would keep more of partly changed files) ...
+ *
+ * @def TUNER_FULL_DEDUP
+ * ... unless it is above this one (files are mostly unchanged).
+ */
+#define TUNER_LOW_DEDUP (0.05)
+#define TUNER_HIGH_DEDUP (0.30)
+#define TUNER_FULL_DEDUP (0.95)
+
+
+/**
+ * @def TUNER_MIN_BUFFER
+ * Minimum size (in bytes) of a batch tuned from the measures of a
+ * connection.
+ *
+ * @def TUNER_MAX_BUFFER
+ * Maximum size (in bytes) of a batch tuned from the measures of a
+ * connection (it is also limited by the memory limit).
+ */
+#define TUNER_MIN_BUFFER (262144)
+#define TUNER_MAX_BUFFER (16777216)
+
+
+/**
+ * @struct tuner_class_t
+ * @brief Block size and measures of a class of files.
+ */
+typedef struct
+{
+    gint shift;         /**< power of two applied to the block size of the class       */
+    guint64 files;      /**< files measured since the last decision                    */
+    guint64 blocks;     /**< blocks of these files                                     */
+    guint64 sent;       /**< blocks of these files whose data had to be sent           */
+    gboolean warming;   /**< TRUE while the files measured follow a change             */
+    gint64 changed;     /**< monotonic time (in µs) of the last change                 */
+} tuner_class_t;
+
+
+/**
+ * @struct tuner_t
+ * @brief Auto-tuning of the block size of each class of files. Workers
+ *        use it at the same time: everything is protected by mutex.
+ */
+typedef struct
+{
+    GMutex mutex;                              /**< protects everything in this structure */
+    tuner_class_t classes[TUNER_NB_CLASSES];   /**< one per class of files                */
+} tuner_t;
+
+
+/**
+ * Creates a new tuner where no class has changed its block size yet.
+ * @returns a newly allocated tuner_t structure that may be freed with
+ *          free_tuner_t() when no longer needed.
+ */
+extern tuner_t *new_tuner_t(void);
+
+
+/**
+ * Frees the tuner
+ * @param tuner is the tuner_t structure to be freed.
+ */
+extern void free_tuner_t(tuner_t *tuner);
+
+
+/**
+ * @param size is the size of a file.
+ * @returns the class of the file (from 0 to TUNER_NB_CLASSES - 1).
+ */
+extern guint tuner_get_class(gint64 size);
+
+
+/**
+ * Gives the block size to use for a file.
+ * @param tuner is the tuner (may be NULL).
+ * @param size is the size of the file.
+ * @param blocksize is the block size the file would have without
+ *        auto-tuning.
+ * @returns blocksize with the power of two of the class of the file
+ *          applied (blocksize when tuner is NULL).
+ */
+extern gint64 tuner_get_blocksize(tuner_t *tuner, gint64 size, gint64 blocksize);
+
+
+/**
+ * Records how a file has been deduplicated. The block size of its class
+ * may change when enough files have been measured.
+ * @param tuner is the tuner (may be NULL).
+ * @param size is the size of the file.
+ * @param blocks is the number of blocks of the file.
+ * @param sent is the number of these blocks whose data had to be sent
+ *        to the server.
+ */
+extern void tuner_record_file(tuner_t *tuner, gint64 size, guint64 blocks, guint64 sent);
+
+#endif /* #ifndef _CLIENT_TUNER_H_ */
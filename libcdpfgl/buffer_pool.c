@@ -0,0 +1,207 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    buffer_pool.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file buffer_pool.c
+ *
+ * This file contains the functions of the pool of reusable buffers.
+ * Every buffer has a hidden pool_header_t in front of it that records
+ * its size, so that it can go back to the right free list. Free lists
+ * are chained through these headers: releasing and reusing a buffer
+ * does not allocate anything.
+ */
+
+#include "libcdpfgl.h"
+
+static void free_pool_list(gpointer data);
+
+
+/**
+ * Frees a free list and every buffer in it (GDestroyNotify for the
+ * free_lists hash table).
+ * @param data is a pool_list_t * structure.
+ */
+static void free_pool_list(gpointer data)
+{
+    pool_list_t *list = (pool_list_t *) data;
+    pool_header_t *header = NULL;
+
+    if (list != NULL)
+        {
+            while (list->first != NULL)
+                {
+                    header = list->first;
+                    list->first = header->next;
+                    free_variable(header);
+                }
+
+            free_variable(list);
+        }
+}
+
+
+/**
+ * Creates a new empty pool of buffers.
+ * @param max_free_bytes is the maximum number of bytes that the pool
+ *        keeps in its free lists.
+ * @returns a newly allocated buffer_pool_t * structure that may be
+ *          freed with free_buffer_pool_t() when no longer needed.
+ */
+buffer_pool_t *new_buffer_pool_t(guint64 max_free_bytes)
+{
+    buffer_pool_t *pool = NULL;
+
+    pool = (buffer_pool_t *) g_malloc0(sizeof(buffer_pool_t));
+    g_assert_nonnull(pool);
+
+    g_mutex_init(&pool->mutex);
+    pool->free_lists = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_pool_list);
+    pool->free_bytes = 0;
+    pool->max_free_bytes = max_free_bytes;
+    pool->allocations = 0;
+
+    return pool;
+}
+
+
+/**
+ * Frees the pool and every free buffer in it. Buffers still in use must
+ * not be released to the pool afterwards.
+ * @param pool is the buffer_pool_t * structure to be freed.
+ */
+void free_buffer_pool_t(buffer_pool_t *pool)
+{
+    if (pool != NULL)
+        {
+            g_hash_table_destroy(pool->free_lists);
+            g_mutex_clear(&pool->mutex);
+            free_variable(pool);
+        }
+}
+
+
+/**
+ * Gets a buffer of size bytes from the pool. A released buffer of that
+ * size is reused if any.
+ * @param pool is the pool of buffers (must not be NULL).
+ * @param size is the size of the requested buffer.
+ * @returns a buffer of size bytes that must be given back with
+ *          buffer_pool_release() (never with g_free()).
+ */
+gpointer buffer_pool_alloc(buffer_pool_t *pool, gsize size)
+{
+    pool_list_t *list = NULL;
+    pool_header_t *header = NULL;
+
+    g_assert_nonnull(pool);
+
+    g_mutex_lock(&pool->mutex);
+
+    list = g_hash_table_lookup(pool->free_lists, GSIZE_TO_POINTER(size));
+
+    if (list != NULL && list->first != NULL)
+        {
+            header = list->first;
+            list->first = header->next;
+            list->count = list->count - 1;
+            pool->free_bytes = pool->free_bytes - size;
+        }
+    else
+        {
+            pool->allocations = pool->allocations + 1;
+        }
+
+    g_mutex_unlock(&pool->mutex);
+
+    if (header == NULL)
+        {
+            header = (pool_header_t *) g_malloc(sizeof(pool_header_t) + size);
+            g_assert_nonnull(header);
+            header->size = size;
+        }
+
+    header->next = NULL;
+
+    return (gpointer) (header + 1);
+}
+
+
+/**
+ * Gives back a buffer to the pool.
+ * @param pool is the pool the buffer comes from.
+ * @param buffer is a buffer obtained with buffer_pool_alloc() (may be
+ *        NULL).
+ */
+void buffer_pool_release(buffer_pool_t *pool, gpointer buffer)
+{
+    pool_list_t *list = NULL;
+    pool_header_t *header = NULL;
+
+    if (pool != NULL && buffer != NULL)
+        {
+            header = ((pool_header_t *) buffer) - 1;
+
+            g_mutex_lock(&pool->mutex);
+
+            if (pool->free_bytes + header->size <= pool->max_free_bytes)
+                {
+                    list = g_hash_table_lookup(pool->free_lists, GSIZE_TO_POINTER(header->size));
+
+                    if (list == NULL)
+                        {
+                            list = (pool_list_t *) g_malloc0(sizeof(pool_list_t));
+                            g_assert_nonnull(list);
+                            g_hash_table_insert(pool->free_lists, GSIZE_TO_POINTER(header->size), list);
+                        }
+
+                    header->next = list->first;
+                    list->first = header;
+                    list->count = list->count + 1;
+                    pool->free_bytes = pool->free_bytes + header->size;
+                    header = NULL;
+                }
+
+            g_mutex_unlock(&pool->mutex);
+
+            /* The pool is full enough: really frees the buffer */
+            free_variable(header);
+        }
+}
+
+
+/**
+ * @param pool is the pool of buffers.
+ * @returns the number of buffers that were really allocated by the
+ *          pool since its creation.
+ */
+guint64 buffer_pool_allocations(buffer_pool_t *pool)
+{
+    guint64 allocations = 0;
+
+    if (pool != NULL)
+        {
+            g_mutex_lock(&pool->mutex);
+            allocations = pool->allocations;
+            g_mutex_unlock(&pool->mutex);
+        }
+
+    return allocations;
+}
@@ -0,0 +1,115 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    buffer_pool.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file buffer_pool.h
+ *
+ * This file contains all the definitions of a pool of reusable buffers.
+ * Released buffers are kept, sorted by size, to be handed out again
+ * instead of being freed and allocated for every block.
+ */
+#ifndef _BUFFER_POOL_H_
+#define _BUFFER_POOL_H_
+
+
+/**
+ * @struct pool_header_t
+ * @brief Header hidden in front of every buffer of the pool. The next
+ *        field is only used while the buffer is in a free list.
+ */
+typedef struct pool_header_t
+{
+    gsize size;                 /**< size of the buffer (header excluded)     */
+    struct pool_header_t *next; /**< next free buffer of the same size        */
+} pool_header_t;
+
+
+/**
+ * @struct pool_list_t
+ * @brief List of free buffers of one size.
+ */
+typedef struct
+{
+    pool_header_t *first;       /**< first free buffer (NULL if none)         */
+    guint count;                /**< number of buffers in this list           */
+} pool_list_t;
+
+
+/**
+ * @struct buffer_pool_t
+ * @brief A pool of buffers that may be shared between threads.
+ */
+typedef struct
+{
+    GMutex mutex;               /**< protects everything in this structure              */
+    GHashTable *free_lists;     /**< size (gsize) -> pool_list_t * of free buffers       */
+    guint64 free_bytes;         /**< bytes kept in the free lists                        */
+    guint64 max_free_bytes;     /**< above this buffers are freed instead of being kept  */
+    guint64 allocations;        /**< number of buffers really allocated with g_malloc    */
+} buffer_pool_t;
+
+
+/**
+ * Creates a new empty pool of buffers.
+ * @param max_free_bytes is the maximum number of bytes that the pool
+ *        keeps in its free lists.
+ * @returns a newly allocated buffer_pool_t * structure that may be
+ *          freed with free_buffer_pool_t() when no longer needed.
+ */
+extern buffer_pool_t *new_buffer_pool_t(guint64 max_free_bytes);
+
+
+/**
+ * Frees the pool and every free buffer in it. Buffers still in use must
+ * not be released to the pool afterwards.
+ * @param pool is the buffer_pool_t * structure to be freed.
+ */
+extern void free_buffer_pool_t(buffer_pool_t *pool);
+
+
+/**
+ * Gets a buffer of size bytes from the pool. A released buffer of that
+ * size is reused if any.
+ * @param pool is the pool of buffers (must not be NULL).
+ * @param size is the size of the requested buffer.
+ * @returns a buffer of size bytes that must be given back with
+ *          buffer_pool_release() (never with g_free()).
+ */
+extern gpointer buffer_pool_alloc(buffer_pool_t *pool, gsize size);
+
+
+/**
+ * Gives back a buffer to the pool.
+ * @param pool is the pool the buffer comes from.
+ * @param buffer is a buffer obtained with buffer_pool_alloc() (may be
+ *        NULL).
+ */
+extern void buffer_pool_release(buffer_pool_t *pool, gpointer buffer);
+
+
+/**
+ * @param pool is the pool of buffers.
+ * @returns the number of buffers that were really allocated by the
+ *          pool since its creation.
+ */
+extern guint64 buffer_pool_allocations(buffer_pool_t *pool);
+
+#endif /* #ifndef _BUFFER_POOL_H_ */
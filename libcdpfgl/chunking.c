@@ -0,0 +1,627 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    chunking.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file chunking.c
+ *
+ * This file contains all the functions of the content defined chunking.
+ * The gear hash is fp = (fp << 1) + gear[byte]: each byte depends on the
+ * previous one so the kernel can not be vectorized. Instead it skips the
+ * first min bytes of each block and rolls two bytes per step with a
+ * table and masks shifted by one bit (FastCDC 2020), which keeps it
+ * way cheaper than the SHA256 of the same block.
+ */
+
+/* SEEK_DATA and SEEK_HOLE are GNU extensions */
+#define _GNU_SOURCE
+
+#include "libcdpfgl.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+static guint64 splitmix64(guint64 *state);
+static void init_gear_tables(void);
+static guint64 make_mask(guint bits);
+static gssize read_fixed_block(block_reader_t *reader, buffer_pool_t *pool, guchar **buffer, GError **error);
+static gboolean fill_window(block_reader_t *reader, GError **error);
+static gint open_if_sparse(gchar *filename, guint64 *file_size);
+static guint64 find_hole(block_reader_t *reader);
+static gssize skip_hole(block_reader_t *reader, guint64 length, GError **error);
+static void release_blocks_ahead(block_reader_t *reader);
+static void read_blocks_ahead(block_reader_t *reader, buffer_pool_t *pool);
+
+/**
+ * Tables of the gear hash. They are generated from a fixed seed: they
+ * MUST never change or blocks would not be the same from one version
+ * to another (and deduplication would be lost).
+ */
+static guint64 gear[256];
+static guint64 gear_ls[256];
+
+
+/**
+ * splitmix64 pseudo random generator used to fill the gear tables.
+ * @param[in,out] state is the state of the generator.
+ * @returns the next pseudo random 64 bits number.
+ */
+static guint64 splitmix64(guint64 *state)
+{
+    guint64 z = 0;
+
+    *state = *state + G_GUINT64_CONSTANT(0x9e3779b97f4a7c15);
+    z = *state;
+    z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT(0x94d049bb133111eb);
+
+    return z ^ (z >> 31);
+}
+
+
+/**
+ * Fills gear and gear_ls tables once.
+ */
+static void init_gear_tables(void)
+{
+    static gsize initialized = 0;
+    guint64 state = G_GUINT64_CONSTANT(0x63647066676c2121); /* "cdpfgl!!" */
+    guint i = 0;
+
+    if (g_once_init_enter(&initialized))
+        {
+            for (i = 0; i < 256; i++)
+                {
+                    gear[i] = splitmix64(&state);
+                    gear_ls[i] = gear[i] << 1;
+                }
+
+            g_once_init_leave(&initialized, 1);
+        }
+}
+
+
+/**
+ * Makes a mask of bits consecutive ones placed just below the highest
+ * bit: high bits of the gear hash depend on the 64 last bytes and the
+ * highest one is left free for the shifted masks.
+ * @param bits is the number of bits of the mask (1 to 62).
+ * @returns the mask.
+ */
+static guint64 make_mask(guint bits)
+{
+    bits = CLAMP(bits, 1, 62);
+
+    return ((G_GUINT64_CONSTANT(1) << bits) - 1) << (63 - bits);
+}
+
+
+/**
+ * Creates a new chunker. Sizes are adjusted to be coherent: avg is
+ * rounded down to a power of two, min is less than avg and max greater.
+ * @param min is the minimum size of a block.
+ * @param avg is the expected average size of a block.
+ * @param max is the maximum size of a block.
+ * @returns a newly allocated chunker_t structure that may be freed with
+ *          free_chunker_t() when no longer needed.
+ */
+chunker_t *new_chunker_t(gsize min, gsize avg, gsize max)
+{
+    chunker_t *chunker = NULL;
+    guint bits = 0;
+
+    init_gear_tables();
+
+    chunker = (chunker_t *) g_malloc0(sizeof(chunker_t));
+    g_assert_nonnull(chunker);
+
+    if (avg < 256)
+        {
+            avg = 256;
+        }
+
+    bits = g_bit_storage(avg) - 1;
+    avg = (gsize) 1 << bits;
+
+    if (min == 0 || min >= avg)
+        {
+            min = avg / 4;
+        }
+
+    if (max <= avg)
+        {
+            max = avg * 4;
+        }
+
+    chunker->min = min;
+    chunker->avg = avg;
+    chunker->max = max;
+    chunker->mask_s = make_mask(bits + CHUNKER_NORMALIZATION);
+    chunker->mask_s_ls = chunker->mask_s << 1;
+    chunker->mask_l = make_mask(bits - CHUNKER_NORMALIZATION);
+    chunker->mask_l_ls = chunker->mask_l << 1;
+
+    return chunker;
+}
+
+
+/**
+ * Frees a chunker
+ * @param chunker is the chunker_t structure to be freed.
+ */
+void free_chunker_t(chunker_t *chunker)
+{
+    free_variable(chunker);
+}
+
+
+/**
+ * Finds the first block boundary in buffer.
+ * @param chunker is the chunker to use.
+ * @param buffer is the data where to look for a boundary. It must
+ *        contain at least chunker->max bytes unless it is the end of
+ *        the file.
+ * @param length is the number of bytes in buffer.
+ * @returns the size of the first block of buffer (between 1 and
+ *          chunker->max bytes when length is not 0).
+ */
+gsize chunker_find_boundary(chunker_t *chunker, const guchar *buffer, gsize length)
+{
+    guint64 fp = 0;
+    gsize i = 0;
+    gsize normal = 0;
+    gsize max = 0;
+
+    if (chunker == NULL || buffer == NULL || length <= chunker->min)
+        {
+            return length;
+        }
+
+    max = MIN(length, chunker->max);
+    normal = MIN(chunker->avg, max);
+    i = chunker->min;
+
+    /**
+     * Two bytes per step: (fp << 2) + gear_ls[a] is the hash after byte
+     * a shifted by one, so it is tested with the shifted mask.
+     */
+    while (i + 1 < normal)
+        {
+            fp = (fp << 2) + gear_ls[buffer[i]];
+            if ((fp & chunker->mask_s_ls) == 0)
+                {
+                    return i + 1;
+                }
+
+            fp = fp + gear[buffer[i + 1]];
+            if ((fp & chunker->mask_s) == 0)
+                {
+                    return i + 2;
+                }
+
+            i = i + 2;
+        }
+
+    while (i + 1 < max)
+        {
+            fp = (fp << 2) + gear_ls[buffer[i]];
+            if ((fp & chunker->mask_l_ls) == 0)
+                {
+                    return i + 1;
+                }
+
+            fp = fp + gear[buffer[i + 1]];
+            if ((fp & chunker->mask_l) == 0)
+                {
+                    return i + 2;
+                }
+
+            i = i + 2;
+        }
+
+    return max;
+}
+
+
+/**
+ * Opens a file to look for its holes if it has less blocks allocated
+ * than its size (ie it may be sparse).
+ * @param filename is the name of the file.
+ * @param[out] file_size is the size of the file.
+ * @returns a file descriptor opened read only or -1 if the file is not
+ *          sparse (or if holes can not be looked for).
+ */
+static gint open_if_sparse(gchar *filename, guint64 *file_size)
+{
+    gint fd = -1;
+#ifdef SEEK_DATA
+    GStatBuf st;
+
+    if (filename != NULL && g_stat(filename, &st) == 0 && S_ISREG(st.st_mode) && (guint64) st.st_blocks * 512 < (guint64) st.st_size)
+        {
+            fd = g_open(filename, O_RDONLY, 0);
+            *file_size = (guint64) st.st_size;
+        }
+#endif
+
+    return fd;
+}
+
+
+/**
+ * Looks for a hole at the current position when the data region found
+ * before has been read entirely.
+ * @param reader is the block reader.
+ * @returns the length of the hole at reader->pos (0 if there is data).
+ */
+static guint64 find_hole(block_reader_t *reader)
+{
+    guint64 length = 0;
+#ifdef SEEK_DATA
+    off_t data = 0;
+    off_t hole = 0;
+
+    if (reader->fd >= 0 && reader->pos >= reader->data_end)
+        {
+            data = lseek(reader->fd, (off_t) reader->pos, SEEK_DATA);
+
+            if (data < 0 && errno == ENXIO)
+                {
+                    /* No more data: the end of the file is a hole */
+                    data = (off_t) MAX(reader->file_size, reader->pos);
+                }
+
+            if (data < 0 || (guint64) data < reader->pos)
+                {
+                    /* The filesystem does not tell: holes are read as zeros */
+                    reader->data_end = G_MAXUINT64;
+                }
+            else
+                {
+                    hole = lseek(reader->fd, data, SEEK_HOLE);
+                    reader->data_end = (hole < 0) ? G_MAXUINT64 : (guint64) hole;
+                    length = (guint64) data - reader->pos;
+                }
+        }
+#endif
+
+    return length;
+}
+
+
+/**
+ * Skips a hole of the stream without reading it.
+ * @param reader is the block reader.
+ * @param length is the length of the hole.
+ * @param[out] error is set when the stream could not be seeked.
+ * @returns length or -1 on error.
+ */
+static gssize skip_hole(block_reader_t *reader, guint64 length, GError **error)
+{
+    /* io_uring reads at reader->pos: the stream is not used */
+    if (reader->rfd < 0 && g_seekable_seek(G_SEEKABLE(reader->stream), (goffset) length, G_SEEK_CUR, NULL, error) == FALSE)
+        {
+            return -1;
+        }
+
+    reader->pos = reader->pos + length;
+
+    return (gssize) length;
+}
+
+
+/**
+ * Creates a new block reader
+ * @param stream is the stream to read from. It is not owned by the reader.
+ * @param chunker is the chunker to use for content defined blocks or
+ *        NULL to read fixed size blocks.
+ * @param blocksize is the size of fixed blocks.
+ * @param filename is the name of the file read by stream. When it is
+ *        not NULL and the file is sparse its holes are skipped.
+ * @returns a newly allocated block_reader_t structure that may be freed
+ *          with free_block_reader_t() when no longer needed.
+ */
+block_reader_t *new_block_reader_t(GInputStream *stream, chunker_t *chunker, gint64 blocksize, gchar *filename)
+{
+    block_reader_t *reader = NULL;
+
+    reader = (block_reader_t *) g_malloc0(sizeof(block_reader_t));
+    g_assert_nonnull(reader);
+
+    reader->stream = stream;
+    reader->chunker = chunker;
+    reader->blocksize = blocksize;
+    reader->window = NULL;
+    reader->size = 0;
+    reader->start = 0;
+    reader->end = 0;
+    reader->eof = FALSE;
+    reader->pos = 0;
+    reader->data_end = 0;
+    reader->file_size = 0;
+    reader->fd = open_if_sparse(filename, &reader->file_size);
+    reader->engine = NULL;
+    reader->rfd = -1;
+    reader->pool = NULL;
+    reader->nb_ahead = 0;
+    reader->next_ahead = 0;
+
+    if (chunker == NULL && filename != NULL && blocksize > 0)
+        {
+            reader->engine = get_io_engine();
+
+            if (reader->engine != NULL)
+                {
+                    reader->rfd = g_open(filename, O_RDONLY, 0);
+                }
+
+            if (reader->rfd < 0)
+                {
+                    reader->engine = NULL;
+                }
+        }
+
+    if (chunker != NULL)
+        {
+            reader->size = 2 * chunker->max;
+            reader->window = (guchar *) g_malloc(reader->size);
+        }
+
+    return reader;
+}
+
+
+/**
+ * Frees a block reader
+ * @param reader is the block_reader_t structure to be freed.
+ */
+void free_block_reader_t(block_reader_t *reader)
+{
+    if (reader != NULL)
+        {
+            release_blocks_ahead(reader);
+
+            if (reader->fd >= 0)
+                {
+                    close(reader->fd);
+                }
+
+            if (reader->rfd >= 0)
+                {
+                    close(reader->rfd);
+                }
+
+            free_variable(reader->window);
+            free_variable(reader);
+        }
+}
+
+
+/**
+ * Gives back to the pool the blocks read ahead that have not been
+ * returned.
+ * @param reader is the block reader.
+ */
+static void release_blocks_ahead(block_reader_t *reader)
+{
+    while (reader->next_ahead < reader->nb_ahead)
+        {
+            buffer_pool_release(reader->pool, reader->ahead[reader->next_ahead]);
+            reader->next_ahead++;
+        }
+
+    reader->nb_ahead = 0;
+    reader->next_ahead = 0;
+}
+
+
+/**
+ * Reads ahead with one io_uring submission the blocks that follow
+ * reader->pos. At most IO_ENGINE_READ_AHEAD bytes are read and reading
+ * stops where a hole begins so that whole blocks of the hole can be
+ * skipped.
+ * @param reader is the block reader (no block must be left ahead).
+ * @param pool is the pool where the buffers of the blocks come from.
+ */
+static void read_blocks_ahead(block_reader_t *reader, buffer_pool_t *pool)
+{
+    guint64 blocks = IO_ENGINE_READ_AHEAD / reader->blocksize;
+    guint i = 0;
+
+    if (reader->fd >= 0 && reader->data_end != G_MAXUINT64 && reader->data_end > reader->pos)
+        {
+            blocks = MIN(blocks, (reader->data_end - reader->pos + reader->blocksize - 1) / reader->blocksize);
+        }
+
+    reader->pool = pool;
+    reader->nb_ahead = (guint) CLAMP(blocks, 1, MIN(IO_ENGINE_DEPTH, reader->engine->depth));
+    reader->next_ahead = 0;
+
+    for (i = 0; i < reader->nb_ahead; i++)
+        {
+            reader->ahead[i] = (guchar *) buffer_pool_alloc(pool, reader->blocksize);
+        }
+
+    io_engine_read_blocks(reader->engine, reader->rfd, reader->pos, reader->ahead, reader->blocksize, reader->nb_ahead, reader->lengths);
+}
+
+
+/**
+ * Reads a fixed size block exactly as it has always been done.
+ * @param reader is the block reader.
+ * @param pool is the pool where the buffer of the block comes from.
+ * @param[out] buffer is the buffer of the block or NULL.
+ * @param[out] error is set when an error occured while reading.
+ * @returns the size of the block, 0 at the end of the stream or -1 on
+ *          error.
+ */
+static gssize read_fixed_block(block_reader_t *reader, buffer_pool_t *pool, guchar **buffer, GError **error)
+{
+    gssize size_read = 0;
+    guint64 end = 0;
+
+    end = reader->pos + find_hole(reader);
+
+    /* Only whole blocks of a hole are skipped (unless it ends the file) */
+    if (end < reader->file_size)
+        {
+            end = end - end % reader->blocksize;
+        }
+
+    if (end > reader->pos)
+        {
+            return skip_hole(reader, end - reader->pos, error);
+        }
+
+    if (reader->engine != NULL)
+        {
+            if (reader->next_ahead >= reader->nb_ahead)
+                {
+                    read_blocks_ahead(reader, pool);
+                }
+
+            *buffer = reader->ahead[reader->next_ahead];
+            size_read = reader->lengths[reader->next_ahead];
+            reader->next_ahead++;
+
+            if (size_read < 0)
+                {
+                    g_set_error(error, G_IO_ERROR, g_io_error_from_errno((gint) -size_read), "%s", g_strerror((gint) -size_read));
+                    size_read = -1;
+                }
+
+            if (size_read < reader->blocksize)
+                {
+                    /* End of file or error: the blocks after this one are worthless */
+                    release_blocks_ahead(reader);
+                }
+        }
+    else
+        {
+            *buffer = (guchar *) buffer_pool_alloc(pool, reader->blocksize);
+            size_read = g_input_stream_read(reader->stream, *buffer, reader->blocksize, NULL, error);
+        }
+
+    if (size_read <= 0)
+        {
+            buffer_pool_release(pool, *buffer);
+            *buffer = NULL;
+        }
+    else
+        {
+            reader->pos = reader->pos + size_read;
+        }
+
+    return size_read;
+}
+
+
+/**
+ * Fills the window so it contains at least chunker->max bytes unless
+ * the end of the stream is reached. Reading stops where a hole begins:
+ * the data before it is cut as if it were the end of the file.
+ * @param reader is the block reader.
+ * @param[out] error is set when an error occured while reading.
+ * @returns FALSE if an error occured, TRUE otherwise.
+ */
+static gboolean fill_window(block_reader_t *reader, GError **error)
+{
+    gsize bytes_read = 0;
+    gsize wanted = 0;
+    gboolean ok = TRUE;
+
+    if (reader->eof == FALSE && reader->end - reader->start < reader->chunker->max)
+        {
+            memmove(reader->window, reader->window + reader->start, reader->end - reader->start);
+            reader->end = reader->end - reader->start;
+            reader->start = 0;
+            wanted = reader->size - reader->end;
+
+            if (reader->fd >= 0 && reader->data_end != G_MAXUINT64)
+                {
+                    wanted = MIN(wanted, reader->data_end > reader->pos ? reader->data_end - reader->pos : 0);
+                }
+
+            ok = g_input_stream_read_all(reader->stream, reader->window + reader->end, wanted, &bytes_read, NULL, error);
+            reader->end = reader->end + bytes_read;
+            reader->pos = reader->pos + bytes_read;
+
+            if (ok == FALSE || bytes_read < wanted)
+                {
+                    reader->eof = TRUE;
+                }
+        }
+
+    return ok;
+}
+
+
+/**
+ * Reads the next block of the stream.
+ * @param reader is the block reader.
+ * @param pool is the pool where the buffer of the block comes from.
+ * @param[out] buffer is the buffer of the block (allocated from pool and
+ *             owned by the caller) or NULL when nothing has been read.
+ *             A positive size with a NULL buffer is a hole of that many
+ *             zeros that has not been read.
+ * @param[out] error is set when an error occured while reading.
+ * @returns the size of the block, 0 at the end of the stream or -1 on
+ *          error.
+ */
+gssize block_reader_read(block_reader_t *reader, buffer_pool_t *pool, guchar **buffer, GError **error)
+{
+    gsize cut = 0;
+    guint64 hole = 0;
+
+    *buffer = NULL;
+
+    if (reader == NULL || reader->stream == NULL)
+        {
+            return 0;
+        }
+    else if (reader->chunker == NULL)
+        {
+            return read_fixed_block(reader, pool, buffer, error);
+        }
+    else if (reader->start == reader->end && (hole = find_hole(reader)) > 0)
+        {
+            /* A hole is a block of its own: content defined blocks start again after it */
+            return skip_hole(reader, hole, error);
+        }
+    else if (fill_window(reader, error) == FALSE)
+        {
+            return -1;
+        }
+    else if (reader->start == reader->end)
+        {
+            return 0;
+        }
+    else
+        {
+            cut = chunker_find_boundary(reader->chunker, reader->window + reader->start, reader->end - reader->start);
+
+            /* Every buffer has the max size so they are all reused by the pool */
+            *buffer = (guchar *) buffer_pool_alloc(pool, reader->chunker->max);
+            memcpy(*buffer, reader->window + reader->start, cut);
+            reader->start = reader->start + cut;
+
+            return (gssize) cut;
+        }
+}
@@ -0,0 +1,165 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    chunking.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file chunking.h
+ *
+ * This file contains all the definitions of the content defined chunking
+ * used to cut files into blocks. Boundaries are found with a gear rolling
+ * hash (FastCDC) so an insertion in a file only changes the blocks around
+ * it. block_reader_t reads a file block after block either with fixed
+ * size blocks or with content defined ones. Holes of sparse files are
+ * not read: they are returned as blocks without data. When io_uring is
+ * available fixed size blocks are read ahead several at a time.
+ */
+#ifndef _CHUNKING_H_
+#define _CHUNKING_H_
+
+
+/**
+ * @def CHUNKER_NORMALIZATION
+ * Normalization level: bits added to the mask before the average size
+ * and removed after it. It makes block sizes concentrate around the
+ * average size.
+ */
+#define CHUNKER_NORMALIZATION (2)
+
+
+/**
+ * @struct chunker_t
+ * @brief Parameters of the content defined chunking. This structure is
+ *        never modified once created and may be shared between threads.
+ */
+typedef struct
+{
+    gsize min;           /**< minimum size of a block (no boundary is looked for before)  */
+    gsize avg;           /**< average size of a block (a power of two)                    */
+    gsize max;           /**< maximum size of a block                                     */
+    guint64 mask_s;      /**< mask used before avg bytes (harder to match)                */
+    guint64 mask_s_ls;   /**< mask_s shifted left by one (two bytes per step kernel)      */
+    guint64 mask_l;      /**< mask used after avg bytes (easier to match)                 */
+    guint64 mask_l_ls;   /**< mask_l shifted left by one (two bytes per step kernel)      */
+} chunker_t;
+
+
+/**
+ * @struct block_reader_t
+ * @brief Reads a stream block after block. With a chunker blocks are
+ *        content defined and data is read into a window of 2 * max
+ *        bytes, otherwise blocks are blocksize bytes long. When the
+ *        file is sparse its holes are found with SEEK_DATA / SEEK_HOLE
+ *        and skipped (with fixed size blocks only the whole blocks of
+ *        a hole are skipped so that blocks stay aligned). Fixed size
+ *        blocks are read ahead with io_uring when it is available:
+ *        the stream is then not read at all.
+ */
+typedef struct
+{
+    GInputStream *stream;  /**< stream to read from (not owned)                        */
+    chunker_t *chunker;    /**< chunker to use or NULL for fixed size blocks           */
+    gint64 blocksize;      /**< size of fixed blocks                                   */
+    guchar *window;        /**< data read and not yet cut into blocks (chunker only)   */
+    gsize size;            /**< allocated size of window                               */
+    gsize start;           /**< first byte of window not yet in a block                */
+    gsize end;             /**< end of the data in window                              */
+    gboolean eof;          /**< TRUE when the end of stream has been reached           */
+    gint fd;               /**< descriptor used to find holes (-1 if file is not sparse) */
+    guint64 pos;           /**< offset in the file of the next byte read from stream   */
+    guint64 data_end;      /**< offset where the data at pos ends (a hole begins)      */
+    guint64 file_size;     /**< size of the file when opened                           */
+    io_engine_t *engine;   /**< ring used to read ahead (NULL when GIO is used)        */
+    gint rfd;              /**< descriptor read by engine (-1 when GIO is used)         */
+    buffer_pool_t *pool;   /**< pool where buffers read ahead come from                */
+    guchar *ahead[IO_ENGINE_DEPTH];   /**< blocks read ahead                           */
+    gssize lengths[IO_ENGINE_DEPTH];  /**< bytes read (or -errno) of each block ahead  */
+    guint nb_ahead;        /**< number of blocks in ahead                              */
+    guint next_ahead;      /**< next block of ahead to be returned                     */
+} block_reader_t;
+
+
+/**
+ * Creates a new chunker. Sizes are adjusted to be coherent: avg is
+ * rounded down to a power of two, min is less than avg and max greater.
+ * @param min is the minimum size of a block.
+ * @param avg is the expected average size of a block.
+ * @param max is the maximum size of a block.
+ * @returns a newly allocated chunker_t structure that may be freed with
+ *          free_chunker_t() when no longer needed.
+ */
+extern chunker_t *new_chunker_t(gsize min, gsize avg, gsize max);
+
+
+/**
+ * Frees a chunker
+ * @param chunker is the chunker_t structure to be freed.
+ */
+extern void free_chunker_t(chunker_t *chunker);
+
+
+/**
+ * Finds the first block boundary in buffer.
+ * @param chunker is the chunker to use.
+ * @param buffer is the data where to look for a boundary. It must
+ *        contain at least chunker->max bytes unless it is the end of
+ *        the file.
+ * @param length is the number of bytes in buffer.
+ * @returns the size of the first block of buffer (between 1 and
+ *          chunker->max bytes when length is not 0).
+ */
+extern gsize chunker_find_boundary(chunker_t *chunker, const guchar *buffer, gsize length);
+
+
+/**
+ * Creates a new block reader
+ * @param stream is the stream to read from. It is not owned by the reader.
+ * @param chunker is the chunker to use for content defined blocks or
+ *        NULL to read fixed size blocks.
+ * @param blocksize is the size of fixed blocks.
+ * @param filename is the name of the file read by stream. When it is
+ *        not NULL and the file is sparse its holes are skipped.
+ * @returns a newly allocated block_reader_t structure that may be freed
+ *          with free_block_reader_t() when no longer needed.
+ */
+extern block_reader_t *new_block_reader_t(GInputStream *stream, chunker_t *chunker, gint64 blocksize, gchar *filename);
+
+
+/**
+ * Frees a block reader
+ * @param reader is the block_reader_t structure to be freed.
+ */
+extern void free_block_reader_t(block_reader_t *reader);
+
+
+/**
+ * Reads the next block of the stream.
+ * @param reader is the block reader.
+ * @param pool is the pool where the buffer of the block comes from.
+ * @param[out] buffer is the buffer of the block (allocated from pool and
+ *             owned by the caller) or NULL when nothing has been read.
+ *             A positive size with a NULL buffer is a hole of that many
+ *             zeros that has not been read.
+ * @param[out] error is set when an error occured while reading.
+ * @returns the size of the block, 0 at the end of the stream or -1 on
+ *          error.
+ */
+extern gssize block_reader_read(block_reader_t *reader, buffer_pool_t *pool, guchar **buffer, GError **error);
+
+#endif /* #ifndef _CHUNKING_H_ */
@@ -33,8 +33,21 @@
 
 static size_t write_data(void *buffer, size_t size, size_t nmemb, void *userp);
 static size_t read_data(char *buffer, size_t size, size_t nitems, void *userp);
+static size_t stream_data(void *buffer, size_t size, size_t nmemb, void *userp);
 static gboolean does_url_end_with_json(gchar *url);
 static struct curl_slist *append_content_type_to_header(struct curl_slist *chunk, gchar *url);
+static gint post_buffer(comm_t *comm, gchar *url, size_t length);
+static struct curl_slist *prepare_get_request(comm_t *comm, gchar *url, gchar *real_url, gchar *header, gchar *error_buf);
+static struct curl_slist *prepare_post_request(comm_t *comm, gchar *url, gchar *real_url, size_t length, gchar *error_buf);
+static gint perform_request(comm_t *comm);
+static void measure_request(comm_t *comm, CURL *curl_handle, size_t length);
+static void finish_async_request(comm_t *comm, comm_request_t *request, gint success);
+static gint run_multi(comm_t *comm, CURL *wait_for);
+static void set_connection_options(CURL *curl_handle);
+static comm_request_t *get_idle_request(comm_t *comm);
+static comm_request_t *wait_for_idle_request(comm_t *comm, gchar *url, comm_callback_t callback, gpointer user_data);
+static gint add_async_request(comm_t *comm, comm_request_t *request);
+static void free_comm_request_t(comm_request_t *request);
 
 /**
  * Gets the version for the communication library
@@ -270,7 +283,8 @@ static gboolean does_url_end_with_json(gchar *url)
  * @param chunk is the list of chunk headers as defined by libcurl
  * @param url is the url to be checked must not be NULL
  * @returns the appended list containing a 'Content-Type' header that
- *          is application/json if the URL ends with .json and
+ *          is application/json if the URL ends with .json,
+ *          application/octet-stream if it ends with .bin and
  *          is text/plain otherwise
  */
 static struct curl_slist *append_content_type_to_header(struct curl_slist *chunk, gchar *url)
@@ -282,6 +296,11 @@ static struct curl_slist *append_content_type_to_header(struct curl_slist *chunk
             content_type = g_strconcat("Content-Type: ", CT_JSON, NULL);
             chunk = curl_slist_append(chunk, content_type);
         }
+    else if (g_str_has_suffix(url, ".bin"))
+        {
+            content_type = g_strconcat("Content-Type: ", CT_BINARY, NULL);
+            chunk = curl_slist_append(chunk, content_type);
+        }
     else
         {
             content_type = g_strconcat("Content-Type: ", CT_PLAIN, NULL);
@@ -319,26 +338,12 @@ gint get_url(comm_t *comm, gchar *url, gchar *header)
     if (comm != NULL && url != NULL && comm->curl_handle != NULL && comm->conn != NULL)
         {
             error_buf = (gchar *) g_malloc(CURL_ERROR_SIZE + 1);
-            comm->seq = 0;
-            comm->length = 0;
-            comm->pos = 0;
             real_url = g_strdup_printf("%s%s", comm->conn, url);
 
-            curl_easy_setopt(comm->curl_handle, CURLOPT_URL, real_url);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEFUNCTION, write_data);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEDATA, comm);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_ERRORBUFFER, error_buf);
-
-            /* Setting header options */
-            chunk = append_content_type_to_header(chunk, url);
-            if (header != NULL)
-                {
-                    chunk = curl_slist_append(chunk, header);
-                }
-            curl_easy_setopt(comm->curl_handle, CURLOPT_HTTPHEADER, chunk);
+            chunk = prepare_get_request(comm, url, real_url, header, error_buf);
 
             /* Performing the HTTP GET request */
-            success = curl_easy_perform(comm->curl_handle);
+            success = perform_request(comm);
             curl_slist_free_all(chunk);
 
             if (success == CURLE_OK && comm->buffer != NULL)
@@ -359,6 +364,126 @@ gint get_url(comm_t *comm, gchar *url, gchar *header)
 }
 
 
+/**
+ * Used by libcurl to give the received bytes of a get_url_stream()
+ * request to its callback.
+ * @param buffer is the buffer where received data are written by libcurl
+ * @param size is the size of an element in buffer
+ * @param nmemb is the number of elements in buffer
+ * @param[in,out] userp is a user pointer and MUST be a pointer to a
+ *                comm_stream_t structure
+ * @returns the size of the data taken into account or 0 to abort the
+ *          request when the callback asks for it.
+ */
+static size_t stream_data(void *buffer, size_t size, size_t nmemb, void *userp)
+{
+    comm_stream_t *comm_stream = (comm_stream_t *) userp;
+
+    if (comm_stream != NULL && comm_stream->callback(buffer, size * nmemb, comm_stream->user_data) == TRUE)
+        {
+            return (size * nmemb);
+        }
+    else
+        {
+            return 0;
+        }
+}
+
+
+/**
+ * Uses curl to send a GET command to the http url and gives the answer
+ * to callback as it is received instead of keeping it into comm->buffer.
+ * It is meant for answers that may be far bigger than memory.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL)
+ * @param url a gchar * url where to send the command to (without the
+ *        http://ip:port string).
+ * @param header may be a gchar * string containing an HTTP header that
+ *        we want to pass into the HTTP GET request (may be NULL).
+ * @param callback is called with each part of the answer.
+ * @param user_data is passed to callback.
+ * @returns a CURLcode: CURLE_OK upon success, CURLE_WRITE_ERROR if
+ *          callback aborted the request, any other error code in any
+ *          other situation.
+ */
+gint get_url_stream(comm_t *comm, gchar *url, gchar *header, comm_stream_callback_t callback, gpointer user_data)
+{
+    gint success = CURLE_FAILED_INIT;
+    gchar *real_url = NULL;
+    gchar *error_buf = NULL;
+    struct curl_slist *chunk = NULL;
+    comm_stream_t comm_stream;
+
+    if (comm != NULL && url != NULL && callback != NULL && comm->curl_handle != NULL && comm->conn != NULL)
+        {
+            error_buf = (gchar *) g_malloc(CURL_ERROR_SIZE + 1);
+            real_url = g_strdup_printf("%s%s", comm->conn, url);
+
+            comm_stream.callback = callback;
+            comm_stream.user_data = user_data;
+
+            chunk = prepare_get_request(comm, url, real_url, header, error_buf);
+            curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEFUNCTION, stream_data);
+            curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEDATA, &comm_stream);
+
+            success = perform_request(comm);
+            curl_slist_free_all(chunk);
+
+            if (success != CURLE_OK)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while sending GET command and receiving data: %s\n"), error_buf);
+                }
+
+            free_variable(real_url);
+            free_variable(error_buf);
+        }
+
+    return success;
+}
+
+
+/**
+ * Prepares the curl handle of comm to send a GET request.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle.
+ * @param url is the url as given by the caller (used to guess the
+ *        content type).
+ * @param real_url is the complete url (with the connexion string).
+ * @param header is an optional HTTP header to add to the request (may
+ *        be NULL).
+ * @param error_buf is a buffer of at least CURL_ERROR_SIZE bytes where
+ *        curl will put an error message if any.
+ * @returns the list of headers that must be freed with
+ *          curl_slist_free_all() once the request is completed.
+ */
+static struct curl_slist *prepare_get_request(comm_t *comm, gchar *url, gchar *real_url, gchar *header, gchar *error_buf)
+{
+    struct curl_slist *chunk = NULL;
+
+    comm->seq = 0;
+    comm->length = 0;
+    comm->pos = 0;
+
+    /* The handle is not reset between requests to keep its connection */
+    curl_easy_setopt(comm->curl_handle, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_FAILONERROR, 0L);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_URL, real_url);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEFUNCTION, write_data);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEDATA, comm);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_ERRORBUFFER, error_buf);
+
+    /* Setting header options */
+    chunk = append_content_type_to_header(chunk, url);
+    if (header != NULL)
+        {
+            chunk = curl_slist_append(chunk, header);
+        }
+    curl_easy_setopt(comm->curl_handle, CURLOPT_HTTPHEADER, chunk);
+
+    return chunk;
+}
+
+
 /**
  * Uses curl to send a POST command to the http server url
  * @param comm a comm_t * structure that must contain an initialized
@@ -374,66 +499,634 @@ gint get_url(comm_t *comm, gchar *url, gchar *header)
  * @todo manage errors codes
  */
 gint post_url(comm_t *comm, gchar *url)
+{
+    gint success = CURLE_FAILED_INIT;
+
+    if (comm != NULL && comm->readbuffer != NULL)
+        {
+            /* readbuffer here should be plain base64 encoded text */
+            success = post_buffer(comm, url, strlen(comm->readbuffer));
+        }
+
+    return success;
+}
+
+
+/**
+ * Uses curl to send a POST command with binary data to the http server
+ * url
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL). readbuffer field of this
+ *        structure is sent as data in the POST command.
+ * @param url a gchar * url where to send the command to (same as
+ *        post_url()).
+ * @param length is the number of bytes of readbuffer to be sent.
+ * @returns a CURLcode (http://curl.haxx.se/libcurl/c/libcurl-errors.html)
+ *          CURLE_OK upon success, any other error code in any other
+ *          situation. When CURLE_OK is returned, the data that the server
+ *          sent is in the comm->buffer gchar * string.
+ */
+gint post_binary_url(comm_t *comm, gchar *url, size_t length)
+{
+    return post_buffer(comm, url, length);
+}
+
+
+/**
+ * Sends readbuffer (length bytes) to the server with a POST command.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param url a gchar * url where to send the command to.
+ * @param length is the number of bytes of readbuffer to be sent.
+ * @returns a CURLcode
+ */
+static gint post_buffer(comm_t *comm, gchar *url, size_t length)
 {
     gint success = CURLE_FAILED_INIT;
     gchar *real_url = NULL;
     gchar *error_buf = NULL;
-    gchar *len = NULL;
     struct curl_slist *chunk = NULL;
 
     if (comm != NULL && url != NULL && comm->curl_handle != NULL && comm->conn != NULL && comm->readbuffer != NULL)
         {
-
             error_buf = (gchar *) g_malloc(CURL_ERROR_SIZE + 1);
-            comm->seq = 0;
-            comm->pos = 0;
             real_url = g_strdup_printf("%s%s", comm->conn, url);
 
-            /* readbuffer here should be plain base64 encoded text */
-            comm->uncomp_len = strlen(comm->readbuffer);
-            comm->length = strlen(comm->readbuffer);
+            chunk = prepare_post_request(comm, url, real_url, length, error_buf);
+            success = perform_request(comm);
+
+            if (success != CURLE_OK)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while sending POST command (to \"%s\"): %s\n"), real_url, error_buf);
+                    comm->buffer = NULL;
+                }
+            else
+                {
+                    measure_request(comm, comm->curl_handle, length);
 
+                    if (comm->buffer != NULL)
+                        {
+                            print_debug(_("Answer is: \"%s\"\n"), comm->buffer); /** @todo  Not sure that we will need this debug information later */
+                        }
+                }
 
-            curl_easy_reset(comm->curl_handle);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_POST, 1);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_READFUNCTION, read_data);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_READDATA, comm);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_URL, real_url);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEFUNCTION, write_data);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEDATA, comm);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_ERRORBUFFER, error_buf);
-            /* curl_easy_setopt(comm->curl_handle, CURLOPT_VERBOSE, 1L); */
+            free_variable(real_url);
+            free_variable(error_buf);
+            curl_slist_free_all(chunk);
+        }
 
-            chunk = curl_slist_append(chunk, "Transfer-Encoding: chunked");
-            len = g_strdup_printf("Content-Length: %zd", comm->length);
-            chunk = curl_slist_append(chunk, len);
+    return success;
+}
 
-            chunk = append_content_type_to_header(chunk, url);
-            curl_easy_setopt(comm->curl_handle, CURLOPT_HTTPHEADER, chunk);
 
+/**
+ * Sets the options of curl_handle for a POST request of length bytes
+ * of comm->readbuffer. The handle is not reset in order to keep its
+ * connection alive.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param url a gchar * url where to send the command to (without
+ *        http://ip:port).
+ * @param real_url is the whole url (curl keeps its own copy).
+ * @param length is the number of bytes of readbuffer to be sent.
+ * @param error_buf is a CURL_ERROR_SIZE buffer where curl may write its
+ *        errors. It must live until the request completes.
+ * @returns the list of HTTP headers of the request that must be freed
+ *          with curl_slist_free_all() when the request completes.
+ */
+static struct curl_slist *prepare_post_request(comm_t *comm, gchar *url, gchar *real_url, size_t length, gchar *error_buf)
+{
+    struct curl_slist *chunk = NULL;
+
+    comm->seq = 0;
+    comm->pos = 0;
+    comm->uncomp_len = length;
+    comm->length = length;
+
+    curl_easy_setopt(comm->curl_handle, CURLOPT_POST, 1L);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) length);
+    /* A busy server answers 503: the request fails and may be sent again */
+    curl_easy_setopt(comm->curl_handle, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_READFUNCTION, read_data);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_READDATA, comm);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_URL, real_url);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEFUNCTION, write_data);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_WRITEDATA, comm);
+    curl_easy_setopt(comm->curl_handle, CURLOPT_ERRORBUFFER, error_buf);
+    /* curl_easy_setopt(comm->curl_handle, CURLOPT_VERBOSE, 1L); */
+
+    /**
+     * Content-Length is set by curl from CURLOPT_POSTFIELDSIZE_LARGE.
+     * An empty Expect: header avoids waiting for a '100 Continue' answer
+     * before sending each body.
+     */
+    chunk = curl_slist_append(chunk, "Expect:");
+    chunk = append_content_type_to_header(chunk, url);
+
+    if (comm->pending_list == TRUE)
+        {
+            chunk = curl_slist_append(chunk, X_PENDING_LIST ": 1");
+        }
+
+    curl_easy_setopt(comm->curl_handle, CURLOPT_HTTPHEADER, chunk);
+
+    return chunk;
+}
+
+
+/**
+ * Performs the request prepared in comm->curl_handle. When comm has a
+ * multi handle the request goes through it (reusing its connections) and
+ * asynchronous requests that complete meanwhile are finished.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @returns a CURLcode
+ */
+static gint perform_request(comm_t *comm)
+{
+    gint success = CURLE_FAILED_INIT;
+
+    if (comm->multi == NULL)
+        {
             success = curl_easy_perform(comm->curl_handle);
+        }
+    else if (curl_multi_add_handle(comm->multi, comm->curl_handle) == CURLM_OK)
+        {
+            success = run_multi(comm, comm->curl_handle);
+        }
 
-            if (success != CURLE_OK)
+    return success;
+}
+
+
+/**
+ * Measures a POST request that completed with success: small ones give
+ * the latency of the connection and big ones its bandwidth. Each
+ * measure is smoothed with the previous ones (7/8 of the old value).
+ * @param comm is the comm_t structure where measures are kept.
+ * @param curl_handle is the easy handle of the completed request.
+ * @param length is the number of bytes sent by the request.
+ */
+static void measure_request(comm_t *comm, CURL *curl_handle, size_t length)
+{
+    gdouble total = 0;
+    gdouble transfer = 0;
+    gdouble bandwidth = 0;
+
+    if (curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME, &total) == CURLE_OK && total > 0)
+        {
+            if (length < COMM_TUNE_SMALL_REQUEST)
                 {
-                    print_error(__FILE__, __LINE__, _("Error while sending POST command (to \"%s\"): %s\n"), real_url, error_buf);
+                    comm->latency = (comm->latency > 0) ? (7 * comm->latency + total) / 8 : total;
+                }
+            else
+                {
+                    /* The latency is not part of the transfer itself */
+                    transfer = total - comm->latency;
+
+                    if (transfer < total / 2)
+                        {
+                            transfer = total / 2;
+                        }
+
+                    bandwidth = (gdouble) length / transfer;
+                    comm->bandwidth = (comm->bandwidth > 0) ? (7 * comm->bandwidth + bandwidth) / 8 : bandwidth;
+                }
+        }
+}
+
+
+/**
+ * Finishes an asynchronous request: calls its callback, frees its
+ * buffers and puts it back into the idle queue.
+ * @param comm is the comm_t structure that owns the multi handle.
+ * @param request is the completed request.
+ * @param success is the CURLcode of the request.
+ */
+static void finish_async_request(comm_t *comm, comm_request_t *request, gint success)
+{
+    comm_t *rcomm = request->comm;
+    size_t length = 0;
+
+    curl_multi_remove_handle(comm->multi, rcomm->curl_handle);
+
+    if (success != CURLE_OK)
+        {
+            print_error(__FILE__, __LINE__, _("Error while sending asynchronous request (to \"%s\"): %s\n"), request->url, request->error_buf);
+            free_variable(rcomm->buffer);
+            rcomm->buffer = NULL;
+        }
+    else if (rcomm->readbuffer != NULL)
+        {
+            /* The connection of this request is one of comm's */
+            measure_request(comm, rcomm->curl_handle, rcomm->length);
+        }
+
+    if (request->callback != NULL)
+        {
+            if (rcomm->readbuffer != NULL)
+                {
+                    length = rcomm->length;
+                }
+            else if (rcomm->buffer != NULL)
+                {
+                    /* GET request: length is the answer's one */
+                    length = rcomm->pos;
+                }
+
+            request->callback(success, request->url, rcomm->readbuffer, length, rcomm->buffer, request->user_data);
+        }
+
+    free_variable(rcomm->readbuffer);
+    free_variable(rcomm->buffer);
+    free_variable(request->url);
+    curl_slist_free_all(request->chunk);
+    rcomm->readbuffer = NULL;
+    rcomm->buffer = NULL;
+    request->url = NULL;
+    request->chunk = NULL;
+    request->callback = NULL;
+    request->user_data = NULL;
+
+    comm->in_flight = comm->in_flight - 1;
+    g_queue_push_head(comm->idle, request);
+}
+
+
+/**
+ * Drives the multi handle of comm until wait_for completes or, when
+ * wait_for is NULL, until at least one asynchronous request completes
+ * (returns immediately if none is in flight).
+ * @param comm is the comm_t structure that owns the multi handle.
+ * @param wait_for is the easy handle of a synchronous request that has
+ *        been added to the multi handle or NULL.
+ * @returns the CURLcode of wait_for or CURLE_FAILED_INIT if wait_for is
+ *          NULL.
+ */
+static gint run_multi(comm_t *comm, CURL *wait_for)
+{
+    CURLMsg *msg = NULL;
+    comm_request_t *request = NULL;
+    gint success = CURLE_FAILED_INIT;
+    gint running = 0;
+    gint msgs_left = 0;
+    guint completed = 0;
+    gboolean done = FALSE;
+
+    if (wait_for == NULL && comm->in_flight == 0)
+        {
+            done = TRUE;
+        }
+
+    while (done == FALSE)
+        {
+            curl_multi_perform(comm->multi, &running);
+
+            while ((msg = curl_multi_info_read(comm->multi, &msgs_left)) != NULL)
+                {
+                    if (msg->msg == CURLMSG_DONE && msg->easy_handle == wait_for)
+                        {
+                            success = msg->data.result;
+                            curl_multi_remove_handle(comm->multi, wait_for);
+                            done = TRUE;
+                        }
+                    else if (msg->msg == CURLMSG_DONE)
+                        {
+                            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &request);
+                            finish_async_request(comm, request, msg->data.result);
+                            completed++;
+                        }
+                }
+
+            if (wait_for == NULL && completed > 0)
+                {
+                    done = TRUE;
+                }
+            else if (done == FALSE && running > 0)
+                {
+                    curl_multi_wait(comm->multi, NULL, 0, COMM_MULTI_WAIT_TIMEOUT, NULL);
+                }
+        }
+
+    return success;
+}
+
+
+/**
+ * Sets options that keep the connection of curl_handle alive and
+ * efficient between requests.
+ * @param curl_handle is an initialized curl easy handle.
+ */
+static void set_connection_options(CURL *curl_handle)
+{
+    if (curl_handle != NULL)
+        {
+            curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(curl_handle, CURLOPT_TCP_NODELAY, 1L);
+        }
+}
+
+
+/**
+ * Lets comm send requests through a curl multi handle: connections are
+ * kept alive and up to max_in_flight requests sent with
+ * post_url_async() may be in flight while synchronous get_url() and
+ * post_url() are performed. A comm_t in this mode must be used by only
+ * one thread.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param max_in_flight is the maximum number of asynchronous requests
+ *        in flight (at least 1).
+ */
+void comm_enable_multi(comm_t *comm, guint max_in_flight)
+{
+    if (comm != NULL && comm->multi == NULL)
+        {
+            if (max_in_flight < 1)
+                {
+                    max_in_flight = 1;
+                }
+
+            comm->multi = curl_multi_init();
+            comm->idle = g_queue_new();
+            comm->in_flight = 0;
+            comm->max_in_flight = max_in_flight;
+
+            /* One connection per request in flight and one for synchronous ones */
+            curl_multi_setopt(comm->multi, CURLMOPT_MAXCONNECTS, (long) max_in_flight + 1);
+            curl_multi_setopt(comm->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) max_in_flight + 1);
+        }
+}
+
+
+/**
+ * @param comm is the comm_t structure that owns the multi handle.
+ * @returns a comm_request_t from the idle queue or a newly allocated one.
+ */
+static comm_request_t *get_idle_request(comm_t *comm)
+{
+    comm_request_t *request = NULL;
+
+    request = (comm_request_t *) g_queue_pop_head(comm->idle);
+
+    if (request == NULL)
+        {
+            request = (comm_request_t *) g_malloc0(sizeof(comm_request_t));
+            g_assert_nonnull(request);
+
+            request->comm = init_comm_struct(comm->conn, comm->cmptype);
+            request->error_buf = (gchar *) g_malloc0(CURL_ERROR_SIZE + 1);
+            request->url = NULL;
+            request->chunk = NULL;
+            request->callback = NULL;
+            request->user_data = NULL;
+        }
+
+    return request;
+}
+
+
+/**
+ * Frees an idle comm_request_t
+ * @param request is the comm_request_t to be freed.
+ */
+static void free_comm_request_t(comm_request_t *request)
+{
+    if (request != NULL)
+        {
+            free_comm_t(request->comm);
+            free_variable(request->error_buf);
+            free_variable(request->url);
+            curl_slist_free_all(request->chunk);
+            free_variable(request);
+        }
+}
+
+
+/**
+ * Waits until a request may be sent without exceeding the maximum
+ * number of requests in flight and gets an idle request.
+ * @param comm is the comm_t structure that owns the multi handle.
+ * @param url is the url of the request (copied).
+ * @param callback is the function called when the request completes.
+ * @param user_data is passed to callback.
+ * @returns a comm_request_t ready to be prepared.
+ */
+static comm_request_t *wait_for_idle_request(comm_t *comm, gchar *url, comm_callback_t callback, gpointer user_data)
+{
+    comm_request_t *request = NULL;
+
+    while (comm->in_flight >= comm->max_in_flight)
+        {
+            run_multi(comm, NULL);
+        }
+
+    request = get_idle_request(comm);
+    request->url = g_strdup(url);
+    request->callback = callback;
+    request->user_data = user_data;
+
+    return request;
+}
+
+
+/**
+ * Adds a prepared request to the multi handle of comm.
+ * @param comm is the comm_t structure that owns the multi handle.
+ * @param request is the prepared request.
+ * @returns CURLE_OK if the request has been queued. Otherwise the
+ *          request is finished as a failed one (its callback is
+ *          called) and CURLE_FAILED_INIT is returned.
+ */
+static gint add_async_request(comm_t *comm, comm_request_t *request)
+{
+    gint success = CURLE_FAILED_INIT;
+
+    curl_easy_setopt(request->comm->curl_handle, CURLOPT_PRIVATE, request);
+    comm->in_flight = comm->in_flight + 1;
+
+    if (curl_multi_add_handle(comm->multi, request->comm->curl_handle) == CURLM_OK)
+        {
+            success = CURLE_OK;
+        }
+    else
+        {
+            finish_async_request(comm, request, CURLE_FAILED_INIT);
+        }
+
+    return success;
+}
+
+
+/**
+ * Sends a GET command asynchronously when comm has a multi handle and
+ * synchronously otherwise. callback is called when the request completes
+ * (from a later call to one of the functions of this file made with the
+ * same comm) with a NULL readbuffer and the answer of the server.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param url a gchar * url where to send the command to (same as
+ *        get_url()).
+ * @param header is an optional HTTP header to add to the request (may
+ *        be NULL). It is copied.
+ * @param callback is the function called when the request completes
+ *        (may be NULL).
+ * @param user_data is passed to callback.
+ * @returns CURLE_OK if the request has been queued (or sent
+ *          synchronously with success) or a CURLcode error.
+ */
+gint get_url_async(comm_t *comm, gchar *url, gchar *header, comm_callback_t callback, gpointer user_data)
+{
+    gint success = CURLE_FAILED_INIT;
+    comm_request_t *request = NULL;
+    gchar *real_url = NULL;
+
+    if (comm != NULL && url != NULL && comm->conn != NULL)
+        {
+            if (comm->multi == NULL)
+                {
+                    success = get_url(comm, url, header);
+
+                    if (callback != NULL)
+                        {
+                            callback(success, url, NULL, (comm->buffer != NULL) ? comm->pos : 0, comm->buffer, user_data);
+                        }
+
+                    free_variable(comm->buffer);
                     comm->buffer = NULL;
                 }
-            else if (comm->buffer != NULL)
+            else
                 {
-                    print_debug(_("Answer is: \"%s\"\n"), comm->buffer); /** @todo  Not sure that we will need this debug information later */
+                    request = wait_for_idle_request(comm, url, callback, user_data);
+
+                    real_url = g_strdup_printf("%s%s", comm->conn, url);
+                    request->chunk = prepare_get_request(request->comm, url, real_url, header, request->error_buf);
+                    free_variable(real_url);
+
+                    success = add_async_request(comm, request);
                 }
+        }
 
-            free_variable(real_url);
-            free_variable(error_buf);
-            free_variable(len);
-            curl_slist_free_all(chunk);
+    return success;
+}
+
+
+/**
+ * Sends a POST command asynchronously when comm has a multi handle and
+ * synchronously otherwise. callback is called when the request completes
+ * (from a later call to one of the functions of this file made with the
+ * same comm).
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param url a gchar * url where to send the command to (same as
+ *        post_url()).
+ * @param readbuffer is the buffer to be sent. Its ownership is
+ *        transfered: it is freed when the request completes.
+ * @param length is the number of bytes of readbuffer to be sent.
+ * @param callback is the function called when the request completes
+ *        (may be NULL).
+ * @param user_data is passed to callback.
+ * @returns CURLE_OK if the request has been queued (or sent
+ *          synchronously with success) or a CURLcode error.
+ */
+gint post_url_async(comm_t *comm, gchar *url, gchar *readbuffer, size_t length, comm_callback_t callback, gpointer user_data)
+{
+    gint success = CURLE_FAILED_INIT;
+    comm_request_t *request = NULL;
+    comm_t *rcomm = NULL;
+    gchar *real_url = NULL;
+
+    if (comm != NULL && url != NULL && readbuffer != NULL && comm->conn != NULL)
+        {
+            if (comm->multi == NULL)
+                {
+                    comm->readbuffer = readbuffer;
+                    success = post_buffer(comm, url, length);
+
+                    if (callback != NULL)
+                        {
+                            callback(success, url, readbuffer, length, comm->buffer, user_data);
+                        }
+
+                    free_variable(comm->buffer);
+                    comm->buffer = NULL;
+                    comm->readbuffer = NULL;
+                    free_variable(readbuffer);
+                }
+            else
+                {
+                    request = wait_for_idle_request(comm, url, callback, user_data);
+                    rcomm = request->comm;
+                    rcomm->readbuffer = readbuffer;
+
+                    /* curl keeps its own copy of the url string */
+                    real_url = g_strdup_printf("%s%s", comm->conn, url);
+                    request->chunk = prepare_post_request(rcomm, url, real_url, length, request->error_buf);
+                    free_variable(real_url);
 
+                    success = add_async_request(comm, request);
+                }
         }
 
     return success;
 }
 
 
+/**
+ * Gives the size of the requests that would keep the connection busy as
+ * measured by previous POST requests (sent through comm or its
+ * asynchronous requests): COMM_TUNE_LATENCY_FACTOR times the bandwidth
+ * delay product.
+ * @param comm is a comm_t * structure.
+ * @param min is the minimum size to be returned.
+ * @param max is the maximum size to be returned.
+ * @returns the size in bytes between min and max or 0 when the latency
+ *          or the bandwidth of the connection are not measured yet.
+ */
+size_t comm_get_tuned_size(comm_t *comm, size_t min, size_t max)
+{
+    gdouble size = 0;
+    size_t tuned = 0;
+
+    if (comm != NULL && comm->latency > 0 && comm->bandwidth > 0)
+        {
+            size = comm->bandwidth * comm->latency * COMM_TUNE_LATENCY_FACTOR;
+
+            if (size < (gdouble) min)
+                {
+                    tuned = min;
+                }
+            else if (size > (gdouble) max)
+                {
+                    tuned = max;
+                }
+            else
+                {
+                    tuned = (size_t) size;
+                }
+        }
+
+    return tuned;
+}
+
+
+/**
+ * Waits until every asynchronous request of comm has completed
+ * (callbacks are called).
+ * @param comm a comm_t * structure.
+ */
+void comm_wait_all_requests(comm_t *comm)
+{
+    if (comm != NULL && comm->multi != NULL)
+        {
+            while (comm->in_flight > 0)
+                {
+                    run_multi(comm, NULL);
+                }
+        }
+}
+
+
 /**
  * Checks wether the server is alive or not and checks its version
  * @param comm a comm_t * structure that must contain an initialized
@@ -450,11 +1143,19 @@ gboolean is_server_alive(comm_t *comm)
         {
             success = get_url(comm, "/Version.json", NULL);
             version = get_json_version(comm->buffer);
-
-            free_variable(comm->buffer);
+            comm->binary = get_json_protocol(comm->buffer, PROTOCOL_DATA_ARRAY_BIN);
+            comm->meta_array = get_json_protocol(comm->buffer, PROTOCOL_META_ARRAY_JSON);
+            comm->hash_array_bin = get_json_protocol(comm->buffer, PROTOCOL_HASH_ARRAY_BIN);
+            comm->file_archive = get_json_protocol(comm->buffer, PROTOCOL_FILE_ARCHIVE_BIN);
+            comm->lz4 = get_json_protocol(comm->buffer, PROTOCOL_LZ4);
+            comm->zstd = get_json_protocol(comm->buffer, PROTOCOL_ZSTD);
 
             if (success == CURLE_OK && version !=  NULL)
                 {
+                    free_variable(comm->epoch);
+                    comm->epoch = get_json_epoch(comm->buffer);
+                    free_variable(comm->buffer);
+
                     if (comm->conn != NULL)
                         {
                             print_debug(_("Server (version %s) is alive at %s.\n"), version, comm->conn);
@@ -469,6 +1170,8 @@ gboolean is_server_alive(comm_t *comm)
                 }
             else
                 {
+                    free_variable(comm->buffer);
+
                     if (comm->conn != NULL)
                         {
                             print_debug(_("Server is not alive (%s).\n"), comm->conn);
@@ -503,6 +1206,7 @@ comm_t *init_comm_struct(gchar *conn, gshort cmptype)
     g_assert_nonnull(comm);
 
     comm->curl_handle = curl_easy_init();
+    set_connection_options(comm->curl_handle);
     comm->buffer = NULL;
     comm->conn = g_strdup(conn);
     comm->readbuffer = NULL;
@@ -511,6 +1215,20 @@ comm_t *init_comm_struct(gchar *conn, gshort cmptype)
     comm->length = 0;
     comm->uncomp_len = 0;
     comm->cmptype = cmptype;
+    comm->binary = FALSE;
+    comm->meta_array = FALSE;
+    comm->hash_array_bin = FALSE;
+    comm->file_archive = FALSE;
+    comm->lz4 = FALSE;
+    comm->zstd = FALSE;
+    comm->pending_list = FALSE;
+    comm->epoch = NULL;
+    comm->multi = NULL;
+    comm->idle = NULL;
+    comm->in_flight = 0;
+    comm->max_in_flight = 0;
+    comm->latency = 0;
+    comm->bandwidth = 0;
 
     return comm;
 }
@@ -524,10 +1242,18 @@ void free_comm_t(comm_t *comm)
 {
     if (comm != NULL)
         {
+            if (comm->multi != NULL)
+                {
+                    comm_wait_all_requests(comm);
+                    g_queue_free_full(comm->idle, (GDestroyNotify) free_comm_request_t);
+                    curl_multi_cleanup(comm->multi);
+                }
+
             curl_easy_cleanup(comm->curl_handle);
             free_variable(comm->buffer);
             free_variable(comm->readbuffer);
             free_variable(comm->conn);
+            free_variable(comm->epoch);
             free_variable(comm);
         }
 }
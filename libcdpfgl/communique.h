@@ -47,6 +47,15 @@
 #define X_UNCOMPRESSED_CONTENT_LENGTH ("X-Uncompressed-Content-Length")
 
 
+/**
+ * @def X_PENDING_LIST
+ * Defines header name string that a client inserts into its post
+ * requests when it asks again about the hashs that the server answers
+ * in a "pending_list" (hashs promised by another client).
+ */
+#define X_PENDING_LIST ("X-Pending-List")
+
+
 /**
  * @def CT_JSON
  * Defines the Content-Type HTTP header for JSON requests / answers
@@ -58,6 +67,67 @@
 #define CT_PLAIN ("text/plain; charset=utf-8")
 
 
+/**
+ * @def CT_BINARY
+ * Defines the Content-Type HTTP header for binary requests (urls ending
+ * with .bin)
+ */
+#define CT_BINARY ("application/octet-stream")
+
+
+/**
+ * @def COMM_MULTI_WAIT_TIMEOUT
+ * Defines the maximum time (in milliseconds) to wait for some activity
+ * on the connections of a curl multi handle before calling it again.
+ */
+#define COMM_MULTI_WAIT_TIMEOUT (1000)
+
+
+/**
+ * @def COMM_TUNE_SMALL_REQUEST
+ * Defines the size (in bytes) under which a POST request measures the
+ * latency of the connection. Bigger ones measure its bandwidth.
+ */
+#define COMM_TUNE_SMALL_REQUEST (16384)
+
+
+/**
+ * @def COMM_TUNE_LATENCY_FACTOR
+ * Defines how many latencies the transfer of a tuned request should
+ * last: the fixed cost of each request is then at most one ninth of it.
+ */
+#define COMM_TUNE_LATENCY_FACTOR (8)
+
+
+/**
+ * Function template definition of the callback called when an
+ * asynchronous request sent with post_url_async() or get_url_async()
+ * completes.
+ * @param success is the CURLcode of the request (CURLE_OK upon success).
+ * @param url is the url where the request was sent.
+ * @param readbuffer is the buffer that was sent (it is freed after the
+ *        callback returns). It is NULL for GET requests.
+ * @param length is the number of bytes of readbuffer or, for GET
+ *        requests, the number of bytes of answer (that may be binary).
+ * @param answer is what the server answered (may be NULL). It is freed
+ *        after the callback returns.
+ * @param user_data is the pointer given to post_url_async() or
+ *        get_url_async().
+ */
+typedef void (* comm_callback_t) (gint success, gchar *url, gchar *readbuffer, size_t length, gchar *answer, gpointer user_data);
+
+
+/**
+ * Function template definition of the callback called by get_url_stream()
+ * each time some bytes of the answer are received.
+ * @param buffer is the received bytes (owned by libcurl).
+ * @param length is the number of bytes in buffer.
+ * @param user_data is the pointer given to get_url_stream().
+ * @returns TRUE to go on receiving, FALSE to abort the request.
+ */
+typedef gboolean (* comm_stream_callback_t) (const guchar *buffer, size_t length, gpointer user_data);
+
+
 /**
  * @struct comm_t
  * @brief Structure that will contain everything needed to the
@@ -78,9 +148,51 @@ typedef struct
     size_t length;     /**< length of buffer                                 */
     size_t uncomp_len; /**< length of uncompressed buffer                    */
     gshort cmptype;    /**< Compression type (COMPRESS_NONE_TYPE by default) */
+    gboolean binary;   /**< TRUE when the server understands /Data_Array.bin */
+    gboolean meta_array; /**< TRUE when the server understands /Meta_Array.json */
+    gboolean hash_array_bin; /**< TRUE when the server understands /Data/Hash_Array.bin */
+    gboolean file_archive; /**< TRUE when the server understands /File/Archive.bin        */
+    gboolean lz4;      /**< TRUE when the server uncompresses COMPRESS_LZ4_TYPE blocks  */
+    gboolean zstd;     /**< TRUE when the server uncompresses COMPRESS_ZSTD_TYPE blocks */
+    gboolean pending_list; /**< TRUE when POST requests say that "pending_list" is understood  */
+    gchar *epoch;      /**< epoch of the store of the server as told by /Version.json (may be NULL)    */
+    CURLM *multi;      /**< Curl multi handle when requests may be sent asynchronously (NULL otherwise) */
+    GQueue *idle;      /**< comm_request_t * that may be reused by asynchronous requests                */
+    guint in_flight;   /**< number of asynchronous requests not yet completed                           */
+    guint max_in_flight; /**< maximum number of asynchronous requests in flight                         */
+    gdouble latency;   /**< smoothed duration (in seconds) of small POST requests (0 until measured)    */
+    gdouble bandwidth; /**< smoothed bytes per second sent by big POST requests (0 until measured)      */
 } comm_t;
 
 
+/**
+ * @struct comm_request_t
+ * @brief An asynchronous request sent through the multi handle of a
+ *        comm_t. It has its own comm_t (and thus easy handle and
+ *        buffers) that is kept to be reused by next requests.
+ */
+typedef struct
+{
+    comm_t *comm;              /**< easy handle and buffers of this request       */
+    gchar *url;                /**< url (without http://ip:port) of the request   */
+    struct curl_slist *chunk;  /**< HTTP headers of the request                   */
+    gchar *error_buf;          /**< CURL_ERROR_SIZE buffer for curl errors        */
+    comm_callback_t callback;  /**< called when the request completes (may be NULL) */
+    gpointer user_data;        /**< passed to callback                            */
+} comm_request_t;
+
+
+/**
+ * @struct comm_stream_t
+ * @brief Callback (and its user_data) of a get_url_stream() request.
+ */
+typedef struct
+{
+    comm_stream_callback_t callback; /**< called with each part of the answer */
+    gpointer user_data;              /**< passed to callback                  */
+} comm_stream_t;
+
+
 /**
  * gets the version for the communication library (ZMQ for now)
  * @returns a newly allocated string that contains the version and that
@@ -130,6 +242,25 @@ extern comm_t *init_comm_struct(gchar *conn, gshort cmptype);
 extern gint get_url(comm_t *comm, gchar *url, gchar *header);
 
 
+/**
+ * Uses curl to send a GET command to the http url and gives the answer
+ * to callback as it is received instead of keeping it into comm->buffer.
+ * It is meant for answers that may be far bigger than memory.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL)
+ * @param url a gchar * url where to send the command to (without the
+ *        http://ip:port string).
+ * @param header may be a gchar * string containing an HTTP header that
+ *        we want to pass into the HTTP GET request (may be NULL).
+ * @param callback is called with each part of the answer.
+ * @param user_data is passed to callback.
+ * @returns a CURLcode: CURLE_OK upon success, CURLE_WRITE_ERROR if
+ *          callback aborted the request, any other error code in any
+ *          other situation.
+ */
+extern gint get_url_stream(comm_t *comm, gchar *url, gchar *header, comm_stream_callback_t callback, gpointer user_data);
+
+
 /**
  * Uses curl to send a POST command to the http server url
  * @param comm a comm_t * structure that must contain an initialized
@@ -146,6 +277,100 @@ extern gint get_url(comm_t *comm, gchar *url, gchar *header);
 extern gint post_url(comm_t *comm, gchar *url);
 
 
+/**
+ * Uses curl to send a POST command with binary data to the http server
+ * url
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL). readbuffer field of this
+ *        structure is sent as data in the POST command.
+ * @param url a gchar * url where to send the command to (same as
+ *        post_url()).
+ * @param length is the number of bytes of readbuffer to be sent.
+ * @returns a CURLcode (http://curl.haxx.se/libcurl/c/libcurl-errors.html)
+ *          CURLE_OK upon success, any other error code in any other
+ *          situation. When CURLE_OK is returned, the data that the server
+ *          sent is in the comm->buffer gchar * string.
+ */
+extern gint post_binary_url(comm_t *comm, gchar *url, size_t length);
+
+
+/**
+ * Lets comm send requests through a curl multi handle: connections are
+ * kept alive and up to max_in_flight requests sent with
+ * post_url_async() may be in flight while synchronous get_url() and
+ * post_url() are performed. A comm_t in this mode must be used by only
+ * one thread.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param max_in_flight is the maximum number of asynchronous requests
+ *        in flight (at least 1).
+ */
+extern void comm_enable_multi(comm_t *comm, guint max_in_flight);
+
+
+/**
+ * Sends a POST command asynchronously when comm has a multi handle and
+ * synchronously otherwise. callback is called when the request completes
+ * (from a later call to one of the functions of this file made with the
+ * same comm).
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param url a gchar * url where to send the command to (same as
+ *        post_url()).
+ * @param readbuffer is the buffer to be sent. Its ownership is
+ *        transfered: it is freed when the request completes.
+ * @param length is the number of bytes of readbuffer to be sent.
+ * @param callback is the function called when the request completes
+ *        (may be NULL).
+ * @param user_data is passed to callback.
+ * @returns CURLE_OK if the request has been queued (or sent
+ *          synchronously with success) or a CURLcode error.
+ */
+extern gint post_url_async(comm_t *comm, gchar *url, gchar *readbuffer, size_t length, comm_callback_t callback, gpointer user_data);
+
+
+/**
+ * Sends a GET command asynchronously when comm has a multi handle and
+ * synchronously otherwise. callback is called when the request completes
+ * (from a later call to one of the functions of this file made with the
+ * same comm) with a NULL readbuffer and the answer of the server.
+ * @param comm a comm_t * structure that must contain an initialized
+ *        curl_handle (must not be NULL).
+ * @param url a gchar * url where to send the command to (same as
+ *        get_url()).
+ * @param header is an optional HTTP header to add to the request (may
+ *        be NULL). It is copied.
+ * @param callback is the function called when the request completes
+ *        (may be NULL).
+ * @param user_data is passed to callback.
+ * @returns CURLE_OK if the request has been queued (or sent
+ *          synchronously with success) or a CURLcode error.
+ */
+extern gint get_url_async(comm_t *comm, gchar *url, gchar *header, comm_callback_t callback, gpointer user_data);
+
+
+/**
+ * Gives the size of the requests that would keep the connection busy as
+ * measured by previous POST requests (sent through comm or its
+ * asynchronous requests): COMM_TUNE_LATENCY_FACTOR times the bandwidth
+ * delay product.
+ * @param comm is a comm_t * structure.
+ * @param min is the minimum size to be returned.
+ * @param max is the maximum size to be returned.
+ * @returns the size in bytes between min and max or 0 when the latency
+ *          or the bandwidth of the connection are not measured yet.
+ */
+extern size_t comm_get_tuned_size(comm_t *comm, size_t min, size_t max);
+
+
+/**
+ * Waits until every asynchronous request of comm has completed
+ * (callbacks are called).
+ * @param comm a comm_t * structure.
+ */
+extern void comm_wait_all_requests(comm_t *comm);
+
+
 /**
  * Checks wether the server is alive or not and checks its version
  * @param comm a comm_t * structure that must contain an initialized
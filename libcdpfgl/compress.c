@@ -22,7 +22,8 @@
 
 /**
  * @file compress.c
- * This file is here to manage compression libraries (at least zlib)
+ * This file is here to manage compression libraries (at least zlib and
+ * lz4 or zstd when they are available)
  */
 
 #include "libcdpfgl.h"
@@ -31,6 +32,36 @@
 static void zlib_print_error(char *filename, int lineno, int ret);
 static compress_t *zlib_compress_buffer(compress_t *comp, guchar *buffer, guint size);
 static compress_t *zlib_uncompress_buffer(compress_t *comp, guint64 len);
+static void free_zlib_stream(gpointer data);
+static z_stream *get_zlib_stream(void);
+static gboolean zlib_compress_buffer_into(guchar *buffer, guint size, guchar *dest, gsize *destlen);
+static gboolean is_worth_compressing(guchar *buffer, guint size);
+static gboolean codec_compress_buffer_into(guchar *buffer, guint size, gint type, guchar *dest, gsize *destlen);
+#ifdef HAVE_LZ4
+static gboolean lz4_compress_buffer_into(guchar *buffer, guint size, guchar *dest, gsize *destlen);
+static compress_t *lz4_uncompress_buffer(compress_t *comp, guint64 len);
+#endif
+#ifdef HAVE_ZSTD
+static void free_zstd_cctx(gpointer data);
+static ZSTD_CCtx *get_zstd_cctx(void);
+static gboolean zstd_compress_buffer_into(guchar *buffer, guint size, guchar *dest, gsize *destlen);
+static compress_t *zstd_uncompress_buffer(compress_t *comp, guint64 len);
+#endif
+
+
+/**
+ * Each thread keeps its own deflate stream: initializing a stream
+ * allocates about 256 KB that we do not want to allocate for each block.
+ */
+static GPrivate zlib_stream = G_PRIVATE_INIT(free_zlib_stream);
+
+#ifdef HAVE_ZSTD
+/**
+ * Each thread keeps its own zstd compression context for the same
+ * reason.
+ */
+static GPrivate zstd_cctx = G_PRIVATE_INIT(free_zstd_cctx);
+#endif
 
 
 /**
@@ -75,13 +106,16 @@ void free_compress_t(compress_t *comp)
  * Compress buffer and returns a compressed text
  * @param buffer is the plain buffer text to be compressed
  *        this buffer must be \0 terminated.
- * @param type is the compression type to use (COMPRESS_ZLIB_TYPE).
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_LZ4_TYPE or COMPRESS_ZSTD_TYPE).
  * @returns a compress_t structure containing a compressed text
  *          buffer.
  */
 compress_t *compress_buffer(guchar *buffer, guint size, gint type)
 {
     compress_t *comp = NULL;
+    guchar *dest = NULL;
+    gsize destlen = 0;
 
     comp = init_compress_t();
 
@@ -89,6 +123,22 @@ compress_t *compress_buffer(guchar *buffer, guint size, gint type)
         {
             comp = zlib_compress_buffer(comp, buffer, size);
         }
+    else if ((type == COMPRESS_LZ4_TYPE || type == COMPRESS_ZSTD_TYPE) && comp != NULL)
+        {
+            destlen = compress_bound(size, type);
+            dest = (guchar *) g_malloc(destlen);
+
+            if (codec_compress_buffer_into(buffer, size, type, dest, &destlen) == TRUE)
+                {
+                    comp->text = dest;
+                    comp->len = destlen;
+                    comp->comp = TRUE;
+                }
+            else
+                {
+                    free_variable(dest);
+                }
+        }
 
     return comp;
 }
@@ -182,12 +232,440 @@ static compress_t *zlib_compress_buffer(compress_t *comp, guchar *buffer, guint
 }
 
 
+/**
+ * Frees a deflate stream when its thread exits.
+ * @param data is the z_stream * to be freed.
+ */
+static void free_zlib_stream(gpointer data)
+{
+    z_stream *stream = (z_stream *) data;
+
+    if (stream != NULL)
+        {
+            deflateEnd(stream);
+            free_variable(stream);
+        }
+}
+
+
+/**
+ * @returns the deflate stream of the calling thread (creates it the
+ *          first time) or NULL if it could not be initialized.
+ */
+static z_stream *get_zlib_stream(void)
+{
+    z_stream *stream = NULL;
+    int ret = Z_OK;
+
+    stream = g_private_get(&zlib_stream);
+
+    if (stream == NULL)
+        {
+            stream = (z_stream *) g_malloc0(sizeof(z_stream));
+            g_assert_nonnull(stream);
+
+            /* Same compression level as zlib_compress_buffer() */
+            ret = deflateInit(stream, 9);
+
+            if (ret != Z_OK)
+                {
+                    zlib_print_error(__FILE__, __LINE__, ret);
+                    free_variable(stream);
+                    stream = NULL;
+                }
+            else
+                {
+                    g_private_set(&zlib_stream, stream);
+                }
+        }
+
+    return stream;
+}
+
+
+/**
+ * Compress buffer using zlib into an already allocated buffer.
+ * @param buffer is the plain text buffer to be compressed
+ * @param size is the number of bytes to compress in buffer.
+ * @param dest is the buffer where to write compressed data.
+ * @param[in,out] destlen is the size of dest and then the size of the
+ *                compressed data.
+ * @returns TRUE if buffer has been compressed and FALSE otherwise.
+ */
+static gboolean zlib_compress_buffer_into(guchar *buffer, guint size, guchar *dest, gsize *destlen)
+{
+    z_stream *stream = NULL;
+    int ret = Z_OK;
+    gboolean success = FALSE;
+
+    stream = get_zlib_stream();
+
+    if (stream != NULL)
+        {
+            deflateReset(stream);
+
+            stream->next_in = (Bytef *) buffer;
+            stream->avail_in = (uInt) size;
+            stream->next_out = (Bytef *) dest;
+            stream->avail_out = (uInt) *destlen;
+
+            ret = deflate(stream, Z_FINISH);
+
+            if (ret == Z_STREAM_END)
+                {
+                    *destlen = stream->total_out;
+                    success = TRUE;
+                }
+            else
+                {
+                    zlib_print_error(__FILE__, __LINE__, ret);
+                }
+        }
+
+    return success;
+}
+
+
+#ifdef HAVE_LZ4
+/**
+ * Compress buffer using lz4 into an already allocated buffer.
+ * @param buffer is the plain text buffer to be compressed
+ * @param size is the number of bytes to compress in buffer.
+ * @param dest is the buffer where to write compressed data.
+ * @param[in,out] destlen is the size of dest and then the size of the
+ *                compressed data.
+ * @returns TRUE if buffer has been compressed and FALSE otherwise.
+ */
+static gboolean lz4_compress_buffer_into(guchar *buffer, guint size, guchar *dest, gsize *destlen)
+{
+    int ret = 0;
+
+    ret = LZ4_compress_default((const char *) buffer, (char *) dest, (int) size, (int) *destlen);
+
+    if (ret > 0)
+        {
+            *destlen = (gsize) ret;
+            return TRUE;
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error while compressing a buffer with lz4.\n"));
+            return FALSE;
+        }
+}
+
+
+/**
+ * Uncompress buffer using lz4
+ * @param comp is the compress_t structure that contains the compressed
+ *        data and that will contain the uncompressed data.
+ * @param len is the len of the uncompressed data
+ * @returns a compress_t structure with uncompressed data in it
+ *          or NULL in case that something went wrong.
+ */
+static compress_t *lz4_uncompress_buffer(compress_t *comp, guint64 len)
+{
+    guchar *destbuffer = NULL;
+    int ret = 0;
+
+    destbuffer = (guchar *) g_malloc0(len + 1);
+    ret = LZ4_decompress_safe((const char *) comp->text, (char *) destbuffer, (int) comp->len, (int) len);
+
+    if (ret < 0 || (guint64) ret != len)
+        {
+            print_error(__FILE__, __LINE__, _("Error: invalid or incomplete lz4 data.\n"));
+            free_variable(destbuffer);
+            comp->text = NULL;
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->text[len] = '\0';
+            comp->len = len;
+            comp->comp = FALSE;
+        }
+
+    return comp;
+}
+#endif
+
+
+#ifdef HAVE_ZSTD
+/**
+ * Frees a zstd compression context when its thread exits.
+ * @param data is the ZSTD_CCtx * to be freed.
+ */
+static void free_zstd_cctx(gpointer data)
+{
+    if (data != NULL)
+        {
+            ZSTD_freeCCtx((ZSTD_CCtx *) data);
+        }
+}
+
+
+/**
+ * @returns the zstd compression context of the calling thread (creates
+ *          it the first time) or NULL if it could not be created.
+ */
+static ZSTD_CCtx *get_zstd_cctx(void)
+{
+    ZSTD_CCtx *cctx = NULL;
+
+    cctx = g_private_get(&zstd_cctx);
+
+    if (cctx == NULL)
+        {
+            cctx = ZSTD_createCCtx();
+
+            if (cctx != NULL)
+                {
+                    g_private_set(&zstd_cctx, cctx);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: out of memory.\n"));
+                }
+        }
+
+    return cctx;
+}
+
+
+/**
+ * Compress buffer using zstd into an already allocated buffer.
+ * @param buffer is the plain text buffer to be compressed
+ * @param size is the number of bytes to compress in buffer.
+ * @param dest is the buffer where to write compressed data.
+ * @param[in,out] destlen is the size of dest and then the size of the
+ *                compressed data.
+ * @returns TRUE if buffer has been compressed and FALSE otherwise.
+ */
+static gboolean zstd_compress_buffer_into(guchar *buffer, guint size, guchar *dest, gsize *destlen)
+{
+    ZSTD_CCtx *cctx = NULL;
+    size_t ret = 0;
+    gboolean success = FALSE;
+
+    cctx = get_zstd_cctx();
+
+    if (cctx != NULL)
+        {
+            ret = ZSTD_compressCCtx(cctx, dest, *destlen, buffer, size, COMPRESS_ZSTD_LEVEL);
+
+            if (ZSTD_isError(ret))
+                {
+                    print_error(__FILE__, __LINE__, _("Error while compressing a buffer with zstd: %s\n"), ZSTD_getErrorName(ret));
+                }
+            else
+                {
+                    *destlen = ret;
+                    success = TRUE;
+                }
+        }
+
+    return success;
+}
+
+
+/**
+ * Uncompress buffer using zstd
+ * @param comp is the compress_t structure that contains the compressed
+ *        data and that will contain the uncompressed data.
+ * @param len is the len of the uncompressed data
+ * @returns a compress_t structure with uncompressed data in it
+ *          or NULL in case that something went wrong.
+ */
+static compress_t *zstd_uncompress_buffer(compress_t *comp, guint64 len)
+{
+    guchar *destbuffer = NULL;
+    size_t ret = 0;
+
+    destbuffer = (guchar *) g_malloc0(len + 1);
+    ret = ZSTD_decompress(destbuffer, len, comp->text, comp->len);
+
+    if (ZSTD_isError(ret) || ret != len)
+        {
+            print_error(__FILE__, __LINE__, _("Error: invalid or incomplete zstd data.\n"));
+            free_variable(destbuffer);
+            comp->text = NULL;
+            free_compress_t(comp);
+            comp = NULL;
+        }
+    else
+        {
+            comp->text = destbuffer;
+            comp->text[len] = '\0';
+            comp->len = len;
+            comp->comp = FALSE;
+        }
+
+    return comp;
+}
+#endif
+
+
+/**
+ * Guesses, from a sample, whether buffer is worth compressing. Already
+ * compressed or encrypted data has a nearly uniform byte distribution:
+ * we sum the squares of the byte counts of the sample (collision
+ * entropy) and compare it to what a uniform distribution gives. This is
+ * far cheaper than compressing the whole buffer for nothing.
+ * @param buffer is the plain buffer.
+ * @param size is the number of bytes in buffer.
+ * @returns TRUE if buffer may be compressed, FALSE if it looks random.
+ */
+static gboolean is_worth_compressing(guchar *buffer, guint size)
+{
+    guint64 counts[256];
+    guint64 sum = 0;
+    guint64 n = COMPRESS_SAMPLE_SIZE;
+    guint step = 0;
+    guint chunk = COMPRESS_SAMPLE_SIZE / COMPRESS_SAMPLE_STEPS;
+    guint i = 0;
+    guint j = 0;
+
+    if (size < COMPRESS_SAMPLE_SIZE * 2)
+        {
+            return TRUE;
+        }
+
+    memset(counts, 0, sizeof(counts));
+    step = size / COMPRESS_SAMPLE_STEPS;
+
+    for (i = 0; i < COMPRESS_SAMPLE_STEPS; i++)
+        {
+            for (j = 0; j < chunk; j++)
+                {
+                    counts[buffer[i * step + j]]++;
+                }
+        }
+
+    for (i = 0; i < 256; i++)
+        {
+            sum = sum + counts[i] * counts[i];
+        }
+
+    /* Uniform bytes give sum ~ n * n / 256 (+ n): we require 12.5% more,
+     * that is a collision entropy under ~7.8 bits per byte.
+     */
+    return (sum * 256 * 8 > n * n * 9);
+}
+
+
+/**
+ * Compress buffer with the selected codec into dest, without any
+ * heuristic.
+ * @param buffer is the plain buffer to be compressed.
+ * @param size is the number of bytes to compress in buffer.
+ * @param type is the compression type to use.
+ * @param dest is the buffer where to write compressed data.
+ * @param[in,out] destlen is the size of dest and then the size of the
+ *                compressed data.
+ * @returns TRUE if buffer has been compressed and FALSE otherwise.
+ */
+static gboolean codec_compress_buffer_into(guchar *buffer, guint size, gint type, guchar *dest, gsize *destlen)
+{
+    gboolean success = FALSE;
+
+    if (type == COMPRESS_ZLIB_TYPE)
+        {
+            success = zlib_compress_buffer_into(buffer, size, dest, destlen);
+        }
+#ifdef HAVE_LZ4
+    else if (type == COMPRESS_LZ4_TYPE)
+        {
+            success = lz4_compress_buffer_into(buffer, size, dest, destlen);
+        }
+#endif
+#ifdef HAVE_ZSTD
+    else if (type == COMPRESS_ZSTD_TYPE)
+        {
+            success = zstd_compress_buffer_into(buffer, size, dest, destlen);
+        }
+#endif
+
+    return success;
+}
+
+
+/**
+ * Gives the size of a buffer always big enough to receive compressed
+ * data.
+ * @param size is the size of the plain data to be compressed.
+ * @param type is the compression type to use.
+ * @returns the size of the buffer to give to compress_buffer_into().
+ */
+gsize compress_bound(guint size, gint type)
+{
+    if (type == COMPRESS_ZLIB_TYPE)
+        {
+            return compressBound((uLong) size) + 2;
+        }
+#ifdef HAVE_LZ4
+    else if (type == COMPRESS_LZ4_TYPE)
+        {
+            return (gsize) LZ4_compressBound((int) size);
+        }
+#endif
+#ifdef HAVE_ZSTD
+    else if (type == COMPRESS_ZSTD_TYPE)
+        {
+            return ZSTD_compressBound(size);
+        }
+#endif
+    else
+        {
+            return size;
+        }
+}
+
+
+/**
+ * Compress buffer into dest buffer that has been allocated by the
+ * caller (from a buffer pool for instance).
+ * Buffers that look incompressible (already compressed or encrypted
+ * data) are not compressed at all and compressed data that does not
+ * save at least 1/COMPRESS_MIN_GAIN of size is discarded.
+ * @param buffer is the plain buffer to be compressed.
+ * @param size is the number of bytes to compress in buffer.
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_LZ4_TYPE or COMPRESS_ZSTD_TYPE).
+ * @param dest is the buffer where to write compressed data. It should be
+ *        at least compress_bound(size, type) bytes long.
+ * @param[in,out] destlen is the size of dest and then the size of the
+ *                compressed data.
+ * @returns TRUE if buffer has been compressed and FALSE otherwise (the
+ *          caller should then keep buffer as is, uncompressed).
+ */
+gboolean compress_buffer_into(guchar *buffer, guint size, gint type, guchar *dest, gsize *destlen)
+{
+    gboolean success = FALSE;
+
+    if (type != COMPRESS_NONE_TYPE && buffer != NULL && dest != NULL && destlen != NULL && is_worth_compressing(buffer, size) == TRUE)
+        {
+            success = codec_compress_buffer_into(buffer, size, type, dest, destlen);
+
+            if (success == TRUE && *destlen > size - size / COMPRESS_MIN_GAIN)
+                {
+                    /* Not worth it: uncompressing would cost more than sending it */
+                    success = FALSE;
+                }
+        }
+
+    return success;
+}
+
+
 /**
  * Uncompress buffer and returns an uncompressed text
  * @param buffer is the compressed buffer to be uncompressed
  * @param cmplen is the len of the above compressed buffer
  * @param textlen is the len of the uncompressed data
- * @param type is the compression type to use (COMPRESS_ZLIB_TYPE).
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_LZ4_TYPE or COMPRESS_ZSTD_TYPE).
  * @returns a compress_t structure containing a compressed text
  *          buffer.
  */
@@ -206,6 +684,24 @@ compress_t *uncompress_buffer(guchar *buffer, guint64 cmplen, guint64 textlen, g
             comp->comp = TRUE;
             comp = zlib_uncompress_buffer(comp, textlen);
         }
+#ifdef HAVE_LZ4
+    else if (type == COMPRESS_LZ4_TYPE)
+        {
+            comp->text = buffer;
+            comp->len = cmplen;
+            comp->comp = TRUE;
+            comp = lz4_uncompress_buffer(comp, textlen);
+        }
+#endif
+#ifdef HAVE_ZSTD
+    else if (type == COMPRESS_ZSTD_TYPE)
+        {
+            comp->text = buffer;
+            comp->len = cmplen;
+            comp->comp = TRUE;
+            comp = zstd_uncompress_buffer(comp, textlen);
+        }
+#endif
 
     return comp;
 }
@@ -271,7 +767,9 @@ static compress_t *zlib_uncompress_buffer(compress_t *comp, guint64 len)
 /**
  * Verify if a compress type is allowed
  * @param cmptype is a gshort that should represents the compression type
- * @returns a boolean: True if we know the compression type, False otherwise.
+ * @returns a boolean: True if we know the compression type (and if the
+ *          library that implements it has been compiled in), False
+ *          otherwise.
  */
 gboolean is_compress_type_allowed(gshort cmptype)
 {
@@ -279,6 +777,18 @@ gboolean is_compress_type_allowed(gshort cmptype)
         {
             return TRUE;
         }
+#ifdef HAVE_LZ4
+    else if (cmptype == COMPRESS_LZ4_TYPE)
+        {
+            return TRUE;
+        }
+#endif
+#ifdef HAVE_ZSTD
+    else if (cmptype == COMPRESS_ZSTD_TYPE)
+        {
+            return TRUE;
+        }
+#endif
     else
         {
             return FALSE;
@@ -292,10 +802,18 @@ gboolean is_compress_type_allowed(gshort cmptype)
  */
 gchar *get_compress_type_string(void)
 {
+    GString *types = NULL;
 
-    return g_strdup_printf("%d, %d", COMPRESS_NONE_TYPE, COMPRESS_ZLIB_TYPE);
-
-}
+    types = g_string_new("");
+    g_string_append_printf(types, "%d, %d", COMPRESS_NONE_TYPE, COMPRESS_ZLIB_TYPE);
 
+#ifdef HAVE_LZ4
+    g_string_append_printf(types, ", %d", COMPRESS_LZ4_TYPE);
+#endif
 
+#ifdef HAVE_ZSTD
+    g_string_append_printf(types, ", %d", COMPRESS_ZSTD_TYPE);
+#endif
 
+    return g_string_free(types, FALSE);
+}
@@ -23,7 +23,8 @@
 /**
  * @file compress.h
  * This file contains all headers and public functions to manage
- * compression libraries such as zlib.
+ * compression libraries such as zlib, lz4 or zstd. lz4 and zstd are
+ * optional and only available when found at configure time.
  */
 
 #ifndef _COMPRESS_H_
@@ -41,6 +42,50 @@
  */
 #define COMPRESS_ZLIB_TYPE (1)
 
+/**
+ * @def COMPRESS_LZ4_TYPE
+ * Defines that LZ4 is to be used to compress data (very fast, lower
+ * compression ratio).
+ */
+#define COMPRESS_LZ4_TYPE (2)
+
+/**
+ * @def COMPRESS_ZSTD_TYPE
+ * Defines that Zstandard is to be used to compress data
+ */
+#define COMPRESS_ZSTD_TYPE (3)
+
+
+/**
+ * @def COMPRESS_ZSTD_LEVEL
+ * Zstandard compression level. Low levels compress faster than the
+ * network sends data and still compress better than zlib.
+ */
+#define COMPRESS_ZSTD_LEVEL (3)
+
+
+/**
+ * @def COMPRESS_SAMPLE_SIZE
+ * Number of bytes sampled in a buffer to guess whether it is worth
+ * compressing it. Buffers smaller than this are always compressed.
+ */
+#define COMPRESS_SAMPLE_SIZE (4096)
+
+
+/**
+ * @def COMPRESS_SAMPLE_STEPS
+ * Number of evenly spaced chunks of the buffer that make the sample.
+ */
+#define COMPRESS_SAMPLE_STEPS (16)
+
+
+/**
+ * @def COMPRESS_MIN_GAIN
+ * Compressed data is kept only if it saves at least 1/COMPRESS_MIN_GAIN
+ * of the plain size. Otherwise the block is sent uncompressed.
+ */
+#define COMPRESS_MIN_GAIN (16)
+
 
 /**
  * @struct compress_t
@@ -79,12 +124,43 @@ extern void free_compress_t(compress_t *comp);
 extern compress_t *compress_buffer(guchar *buffer, guint size, gint type);
 
 
+/**
+ * Gives the size of a buffer always big enough to receive compressed
+ * data.
+ * @param size is the size of the plain data to be compressed.
+ * @param type is the compression type to use.
+ * @returns the size of the buffer to give to compress_buffer_into().
+ */
+extern gsize compress_bound(guint size, gint type);
+
+
+/**
+ * Compress buffer into dest buffer that has been allocated by the
+ * caller (from a buffer pool for instance).
+ * @param buffer is the plain buffer to be compressed.
+ * @param size is the number of bytes to compress in buffer.
+ * Buffers that look incompressible (already compressed or encrypted
+ * data) are not compressed at all and compressed data that does not
+ * save at least 1/COMPRESS_MIN_GAIN of size is discarded.
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_LZ4_TYPE or COMPRESS_ZSTD_TYPE).
+ * @param dest is the buffer where to write compressed data. It should be
+ *        at least compress_bound(size, type) bytes long.
+ * @param[in,out] destlen is the size of dest and then the size of the
+ *                compressed data.
+ * @returns TRUE if buffer has been compressed and FALSE otherwise (the
+ *          caller should then keep buffer as is, uncompressed).
+ */
+extern gboolean compress_buffer_into(guchar *buffer, guint size, gint type, guchar *dest, gsize *destlen);
+
+
 /**
  * Uncompress buffer and returns an uncompressed text
  * @param buffer is the compressed buffer to be uncompressed
  * @param cmplen is the len of the above compressed buffer
  * @param textlen is the len of the uncompressed data
- * @param type is the compression type to use (COMPRESS_ZLIB_TYPE).
+ * @param type is the compression type to use (COMPRESS_ZLIB_TYPE,
+ *        COMPRESS_LZ4_TYPE or COMPRESS_ZSTD_TYPE).
  * @returns a compress_t structure containing a compressed text
  *          buffer.
  */
@@ -94,7 +170,9 @@ extern compress_t *uncompress_buffer(guchar *buffer, guint64 cmplen, guint64 tex
 /**
  * Verify if a compress type is allowed
  * @param cmptype is a gshort that should represents the compression type
- * @returns a boolean: True if we know the compression type, False otherwise.
+ * @returns a boolean: True if we know the compression type (and if the
+ *          library that implements it has been compiled in), False
+ *          otherwise.
  */
 extern gboolean is_compress_type_allowed(gshort cmptype);
 
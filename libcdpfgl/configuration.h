@@ -55,6 +55,15 @@
   * Defines the group name for all preferences related to server's
   * backend named file_backend that stores everything into flat files.
   *
+  * @def GN_PACK_BACKEND
+  * Defines the group name for all preferences related to server's
+  * backend named pack_backend that appends blocks into big pack files.
+  *
+  * @def GN_TIER_BACKEND
+  * Defines the group name for all preferences related to server's
+  * backend named tier_backend that appends blocks into pack files on a
+  * local fast tier and moves them to a cold tier.
+  *
   * @def GN_VERSION
   * Defines the group name that will keep version information for
   * the database in the client's cache directory (for now).
@@ -63,6 +72,8 @@
 #define GN_SERVER ("Server")
 #define GN_ALL ("All")
 #define GN_FILE_BACKEND ("File_Backend")
+#define GN_PACK_BACKEND ("Pack_Backend")
+#define GN_TIER_BACKEND ("Tier_Backend")
 #define GN_VERSION ("Version")
 
 
@@ -100,6 +111,28 @@
 # define KN_NOSCAN ("no-scan")
 
 
+/**
+ * @def KN_CDC
+ * Defines the key name for the cdc option that makes the client cut
+ * files into content defined blocks (instead of fixed size ones) if set
+ * to TRUE (FALSE is the default).
+ *
+ * @def KN_CDC_MIN_SIZE
+ * Defines the key name for the minimum size of a content defined block.
+ *
+ * @def KN_CDC_AVG_SIZE
+ * Defines the key name for the average size of a content defined block
+ * (rounded down to a power of two).
+ *
+ * @def KN_CDC_MAX_SIZE
+ * Defines the key name for the maximum size of a content defined block.
+ */
+#define KN_CDC ("cdc")
+#define KN_CDC_MIN_SIZE ("cdc-min-size")
+#define KN_CDC_AVG_SIZE ("cdc-avg-size")
+#define KN_CDC_MAX_SIZE ("cdc-max-size")
+
+
 /**
  * @def KN_BUFFER_SIZE
  * Defines the key name for the buffersize option that allow one to
@@ -109,6 +142,80 @@
 #define KN_BUFFER_SIZE ("buffersize")
 
 
+/**
+ * @def KN_THREADS
+ * Defines the key name for the number of threads the client uses to
+ * save files and to hash and compress their blocks.
+ */
+#define KN_THREADS ("threads")
+
+
+/**
+ * @def KN_CARVERS
+ * Defines the key name for the number of threads the client uses to
+ * enumerate directories while carving.
+ */
+#define KN_CARVERS ("carvers")
+
+
+/**
+ * @def KN_QUIET_PERIOD
+ * Defines the key name for the time (in milliseconds) without any event
+ * on a file before the client saves it.
+ */
+#define KN_QUIET_PERIOD ("quiet-period")
+
+
+/**
+ * @def KN_MAX_DELAY
+ * Defines the key name for the maximum time (in milliseconds) a file
+ * modified continuously may wait before the client saves it.
+ */
+#define KN_MAX_DELAY ("max-delay")
+
+
+/**
+ * @def KN_MEMORY_LIMIT
+ * Defines the key name for the maximum number of bytes of file data
+ * that one thread of the client keeps in memory.
+ */
+#define KN_MEMORY_LIMIT ("memory-limit")
+
+
+/**
+ * @def KN_LIVE_BUDGET
+ * Defines the key name for the number of MB per second that files
+ * changed while the client runs may read (0 means no limit).
+ */
+#define KN_LIVE_BUDGET ("live-budget")
+
+
+/**
+ * @def KN_CARVE_BUDGET
+ * Defines the key name for the number of MB per second that files
+ * found while carving directories may read (0 means no limit).
+ */
+#define KN_CARVE_BUDGET ("carve-budget")
+
+
+/**
+ * @def KN_LOW_MEMORY
+ * Defines the key name for the low-memory option that makes the client
+ * fit into small memory systems if set to TRUE (FALSE is the default).
+ */
+#define KN_LOW_MEMORY ("low-memory")
+
+
+/**
+ * @def KN_AUTO_TUNE
+ * Defines the key name for the auto-tune option that makes the client
+ * tune the size of the batches sent to the server and the block size of
+ * each class of files from what it measures if set to TRUE (FALSE is
+ * the default).
+ */
+#define KN_AUTO_TUNE ("auto-tune")
+
+
 /**
  * @def KN_DIR_LIST
  * Defines a list of directories that we want to watch.
@@ -165,6 +272,67 @@
 #define KN_SERVER_PORT ("server-port")
 
 
+/**
+ * @def KN_BACKEND
+ * Defines the backend that server program will use to store data and
+ * meta data. Known values are "file" (the default), "pack" and "tier".
+ */
+#define KN_BACKEND ("backend")
+
+
+/**
+ * @def KN_DATA_WORKERS
+ * Defines the number of threads the server uses to store data.
+ */
+#define KN_DATA_WORKERS ("data-workers")
+
+
+/**
+ * @def KN_QUEUE_SIZE
+ * Defines the maximum size (in MB) of the data waiting to be stored by
+ * the server.
+ */
+#define KN_QUEUE_SIZE ("queue-size")
+
+
+/**
+ * @def KN_SERVER_MODE
+ * Defines how the server serves connections: "threads" (the default,
+ * one thread per connection) or "pool" (a pool of threads using epoll).
+ */
+#define KN_SERVER_MODE ("server-mode")
+
+
+/**
+ * @def KN_POOL_THREADS
+ * Defines the number of threads of the pool when server-mode is "pool".
+ */
+#define KN_POOL_THREADS ("pool-threads")
+
+
+/**
+ * @def KN_BLOCK_CACHE
+ * Defines the size (in MB) of the cache of blocks read by the server.
+ */
+#define KN_BLOCK_CACHE ("block-cache")
+
+
+/**
+ * @def KN_INFLIGHT_TIMEOUT
+ * Defines the time (in seconds) a client has to send a block it has been
+ * asked for before the server asks it to another client.
+ */
+#define KN_INFLIGHT_TIMEOUT ("inflight-timeout")
+
+
+/**
+ * @def KN_META_SYNC
+ * Defines the fsync() policy of meta data catalogs: "none", "flush" (the
+ * default) or "always".
+ */
+#define KN_META_SYNC ("meta-sync")
+
+
 /** Below you'll find some definitions for the server's backends */
 /**
  * @def KN_FILE_DIRECTORY
@@ -182,6 +350,63 @@
 #define KN_DIR_LEVEL ("dir-level")
 
 
+/**
+ * @def KN_GC_INTERVAL
+ * Defines the time in seconds between two garbage collections of the
+ * blocks that file_backend stores and that no meta data references
+ * anymore (0 disables the garbage collector).
+ */
+#define KN_GC_INTERVAL ("gc-interval")
+
+
+/**
+ * @def KN_GC_RATE
+ * Defines the maximum number of filesystem operations per second done
+ * by the garbage collector of file_backend while it sweeps.
+ */
+#define KN_GC_RATE ("gc-rate")
+
+
+/**
+ * @def KN_GC_MIN_AGE
+ * Defines the age in seconds under which an unreferenced block is not
+ * deleted by the garbage collector of file_backend.
+ */
+#define KN_GC_MIN_AGE ("gc-min-age")
+
+
+/**
+ * @def KN_GC_MEMORY
+ * Defines the size in MB of the Bloom filter where the garbage collector
+ * of file_backend marks referenced hashs.
+ */
+#define KN_GC_MEMORY ("gc-memory")
+
+
+/**
+ * @def KN_PACK_SIZE
+ * Defines the size in bytes above which pack_backend closes the pack
+ * file it appends blocks to and opens a new one.
+ */
+#define KN_PACK_SIZE ("pack-size")
+
+
+/**
+ * @def KN_COLD_DIRECTORY
+ * Defines the directory of the cold tier of tier_backend (an object
+ * store mounted there for instance) where sealed pack files are moved.
+ */
+#define KN_COLD_DIRECTORY ("cold-directory")
+
+
+/**
+ * @def KN_MIGRATE_INTERVAL
+ * Defines the time in seconds between two looks of tier_backend for
+ * sealed pack files to be moved to the cold tier.
+ */
+#define KN_MIGRATE_INTERVAL ("migrate-interval")
+
+
 /** Below you'll find some definitions for the version cache file */
 /**
  * @def KN_CLIENT_DATABASE
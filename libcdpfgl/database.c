@@ -42,7 +42,18 @@ static void check_and_create_object(db_t *database, gchar *name, gint type, gcha
 static void check_and_create_table(db_t *database, gchar *tablename, gchar *sql_creation_cmd, gchar *err_msg);
 static void check_and_create_index(db_t *database, gchar *indexname, gchar *sql_creation_cmd, gchar *err_msg);
 static void verify_if_tables_exists(db_t *database);
+static void set_pragmas(db_t *database);
+static void commit_pending_batch(db_t *database);
+static void begin_batch_if_needed(db_t *database);
+static void end_batch_if_due(db_t *database);
+static sqlite3_stmt *create_get_file_blocks_stmt(sqlite3 *db);
+static sqlite3_stmt *create_save_file_blocks_stmt(sqlite3 *db);
 static file_row_t *get_file_id(db_t *database, meta_data_t *meta);
+static guint64 hash_file_name(gchar *name);
+static file_key_t *new_file_key_t(meta_data_t *meta);
+static guint file_key_hash(gconstpointer key);
+static gboolean file_key_equal(gconstpointer a, gconstpointer b);
+static void load_files_map(db_t *database);
 static file_row_t *new_file_row_t(void);
 static void free_file_row_t(file_row_t *row);
 static int transmit_callback(void *userp, int nb_col, char **data, char **name_col);
@@ -52,6 +63,7 @@ static int delete_transmited_buffers(db_t *database);
 static void bind_guint64_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, guint64 value);
 static void bind_guint_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, guint value);
 static void bind_text_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, gchar *value);
+static void bind_blob_value(sqlite3 *db, sqlite3_stmt *stmt, const gchar *name, gchar *blob_value, gsize length);
 static void bind_values_to_save_meta_data(sqlite3 *db, sqlite3_stmt *stmt, meta_data_t *meta, gboolean only_meta, guint64 cache_time);
 static void bind_values_to_save_buffer(sqlite3 *db, sqlite3_stmt *stmt, gchar *url, gchar *buffer);
 static void bind_values_to_get_file_id(sqlite3 *db, sqlite3_stmt *stmt, meta_data_t *meta);
@@ -164,6 +176,74 @@ static void sql_begin(db_t *database)
 }
 
 
+/**
+ * Commits the transaction opened by db_save_meta_data() if any. This
+ * must be done before any other transaction is opened on the database.
+ * database's mutex must be held.
+ * @param database : the db_t * structure that contains the database connexion
+ */
+static void commit_pending_batch(db_t *database)
+{
+    if (database != NULL && database->batched > 0)
+        {
+            sql_commit(database);
+            database->batched = 0;
+        }
+}
+
+
+/**
+ * Opens the batch transaction if none is pending. database's mutex must
+ * be held.
+ * @param database : the db_t * structure that contains the database connexion
+ */
+static void begin_batch_if_needed(db_t *database)
+{
+    if (database->batched == 0)
+        {
+            sql_begin(database);
+            database->batch_begin = g_get_monotonic_time();
+        }
+}
+
+
+/**
+ * Counts one more write in the batch transaction and commits it when
+ * it is full or too old. database's mutex must be held.
+ * @param database : the db_t * structure that contains the database connexion
+ */
+static void end_batch_if_due(db_t *database)
+{
+    database->batched = database->batched + 1;
+
+    if (database->batched >= DATABASE_BATCH_SIZE || g_get_monotonic_time() - database->batch_begin >= DATABASE_BATCH_INTERVAL)
+        {
+            commit_pending_batch(database);
+        }
+}
+
+
+/**
+ * Sets the pragmas of the cache database: WAL journal with synchronous
+ * NORMAL means that a commit does not wait for an fsync (the WAL is
+ * synced at checkpoints) and mmap avoids copies when reading. Losing the
+ * last commits in a crash only makes the client send those files again.
+ * @param database : the db_t * structure that contains the database connexion
+ */
+static void set_pragmas(db_t *database)
+{
+    gchar *sql_command = NULL;
+
+    exec_sql_cmd(database, "PRAGMA journal_mode=WAL;", _("(%d - %d) Error while setting journal mode: %s\n"));
+    exec_sql_cmd(database, "PRAGMA synchronous=NORMAL;", _("(%d - %d) Error while setting synchronous mode: %s\n"));
+    exec_sql_cmd(database, "PRAGMA temp_store=MEMORY;", _("(%d - %d) Error while setting temp store: %s\n"));
+
+    sql_command = g_strdup_printf("PRAGMA mmap_size=%d;", DATABASE_MMAP_SIZE);
+    exec_sql_cmd(database, sql_command, _("(%d - %d) Error while setting mmap size: %s\n"));
+    free_variable(sql_command);
+}
+
+
 /**
  * Makes a list of first column elements returned by a query
  * @param userp is a pointer to a list_t structure that must not be NULL
@@ -444,6 +524,166 @@ static void verify_if_tables_exists(db_t *database)
 
     print_debug(_("\tindex files_inodes\n"));
     check_and_create_index(database, "files_inodes", "CREATE INDEX main.files_inodes ON files (inode ASC)", _("(%d - %d) Error while creating index 'files_inodes': %s\n"));
+
+    print_debug(_("\tindex files_inodes_mtime_size\n"));
+    check_and_create_index(database, "files_inodes_mtime_size", "CREATE INDEX main.files_inodes_mtime_size ON files (inode ASC, mtime ASC, size ASC)", _("(%d - %d) Error while creating index 'files_inodes_mtime_size': %s\n"));
+
+    /* Creation of file_blocks table that contains the blocks of the last saved version of big files */
+    print_debug(_("\ttable file_blocks\n"));
+    check_and_create_table(database, "file_blocks", "CREATE TABLE file_blocks (name TEXT PRIMARY KEY, blocks BLOB);", _("(%d - %d) Error while creating database table 'file_blocks': %s\n"));
+}
+
+
+/**
+ * Hashes a filename with 64 bits FNV-1a. Collisions would need the same
+ * inode, times, size, mode and owners to be harmful.
+ * @param name is the filename to be hashed (may be NULL).
+ * @returns a 64 bits hash of name.
+ */
+static guint64 hash_file_name(gchar *name)
+{
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    guchar *p = (guchar *) name;
+
+    if (p != NULL)
+        {
+            while (*p != '\0')
+                {
+                    hash = hash ^ *p;
+                    hash = hash * G_GUINT64_CONSTANT(1099511628211);
+                    p++;
+                }
+        }
+
+    return hash;
+}
+
+
+/**
+ * Creates the key of a file from its meta data.
+ * @param meta is the file's metadata.
+ * @returns a newly allocated file_key_t * that may be freed with
+ *          free_variable() when no longer needed.
+ */
+static file_key_t *new_file_key_t(meta_data_t *meta)
+{
+    file_key_t *key = NULL;
+
+    key = (file_key_t *) g_malloc0(sizeof(file_key_t));
+    g_assert_nonnull(key);
+
+    key->inode = meta->inode;
+    key->ctime = meta->ctime;
+    key->mtime = meta->mtime;
+    key->size = meta->size;
+    key->name_hash = hash_file_name(meta->name);
+    key->mode = meta->mode;
+    key->uid = meta->uid;
+    key->gid = meta->gid;
+    key->file_type = meta->file_type;
+
+    return key;
+}
+
+
+/**
+ * @param key is a file_key_t *.
+ * @returns a hash value for key.
+ */
+static guint file_key_hash(gconstpointer key)
+{
+    const file_key_t *fkey = (const file_key_t *) key;
+    guint64 hash = 0;
+
+    hash = fkey->name_hash ^ (fkey->inode * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)) ^ fkey->mtime ^ (fkey->size << 21);
+
+    return (guint) (hash ^ (hash >> 32));
+}
+
+
+/**
+ * @param a is a file_key_t *.
+ * @param b is a file_key_t *.
+ * @returns TRUE if a and b are the keys of the same file.
+ */
+static gboolean file_key_equal(gconstpointer a, gconstpointer b)
+{
+    const file_key_t *ka = (const file_key_t *) a;
+    const file_key_t *kb = (const file_key_t *) b;
+
+    return (ka->inode == kb->inode && ka->name_hash == kb->name_hash &&
+            ka->mtime == kb->mtime && ka->ctime == kb->ctime &&
+            ka->size == kb->size && ka->mode == kb->mode &&
+            ka->uid == kb->uid && ka->gid == kb->gid &&
+            ka->file_type == kb->file_type);
+}
+
+
+/**
+ * Loads the key of every file of the files table into database->files
+ * with one single SELECT. is_file_in_cache() then answers without
+ * asking SQLite. If anything goes wrong database->files stays NULL and
+ * is_file_in_cache() falls back to get_file_id().
+ * @param database is the structure that contains everything that is
+ *        related to the database (it's connexion for instance).
+ */
+static void load_files_map(db_t *database)
+{
+    sqlite3_stmt *stmt = NULL;
+    file_key_t *key = NULL;
+    GHashTable *files = NULL;
+    gint result = 0;
+    gint64 begin = 0;
+
+    if (database != NULL && database->db != NULL)
+        {
+            begin = trace_begin();
+            result = sqlite3_prepare_v2(database->db, "SELECT inode, name, type, uid, gid, ctime, mtime, mode, size FROM files;", -1, &stmt, NULL);
+            print_on_db_error(database->db, result, "load_files_map");
+
+            if (result == SQLITE_OK)
+                {
+                    files = g_hash_table_new_full(file_key_hash, file_key_equal, free_variable, NULL);
+                    result = sqlite3_step(stmt);
+
+                    while (result == SQLITE_ROW)
+                        {
+                            /* A NULL name never matches get_file_id's statement */
+                            if (sqlite3_column_type(stmt, 1) != SQLITE_NULL)
+                                {
+                                    key = (file_key_t *) g_malloc0(sizeof(file_key_t));
+                                    g_assert_nonnull(key);
+
+                                    key->inode = (guint64) sqlite3_column_int64(stmt, 0);
+                                    key->name_hash = hash_file_name((gchar *) sqlite3_column_text(stmt, 1));
+                                    key->file_type = (guint8) sqlite3_column_int(stmt, 2);
+                                    key->uid = (guint32) sqlite3_column_int64(stmt, 3);
+                                    key->gid = (guint32) sqlite3_column_int64(stmt, 4);
+                                    key->ctime = (guint64) sqlite3_column_int64(stmt, 5);
+                                    key->mtime = (guint64) sqlite3_column_int64(stmt, 6);
+                                    key->mode = (guint32) sqlite3_column_int64(stmt, 7);
+                                    key->size = (guint64) sqlite3_column_int64(stmt, 8);
+
+                                    g_hash_table_add(files, key);
+                                }
+                            result = sqlite3_step(stmt);
+                        }
+
+                    if (result == SQLITE_DONE)
+                        {
+                            database->files = files;
+                            print_debug(_("\t%u files loaded from the cache.\n"), g_hash_table_size(files));
+                        }
+                    else
+                        {
+                            print_on_db_error(database->db, result, "load_files_map");
+                            g_hash_table_destroy(files);
+                        }
+                }
+
+            sqlite3_finalize(stmt);
+            trace_end(begin, "load_files_map");
+        }
 }
 
 
@@ -459,34 +699,43 @@ static void verify_if_tables_exists(db_t *database)
 gboolean is_file_in_cache(db_t *database, meta_data_t *meta)
 {
     file_row_t *row = NULL;
+    file_key_t key;
+    gboolean in_cache = FALSE;
 
-    if (meta != NULL && database != NULL)
+    if (meta != NULL && database != NULL && database->files != NULL)
         {
-
+            if (meta->name != NULL)
+                {
+                    key.inode = meta->inode;
+                    key.ctime = meta->ctime;
+                    key.mtime = meta->mtime;
+                    key.size = meta->size;
+                    key.name_hash = hash_file_name(meta->name);
+                    key.mode = meta->mode;
+                    key.uid = meta->uid;
+                    key.gid = meta->gid;
+                    key.file_type = meta->file_type;
+
+                    g_mutex_lock(&database->mutex);
+                    in_cache = g_hash_table_contains(database->files, &key);
+                    g_mutex_unlock(&database->mutex);
+                }
+        }
+    else if (meta != NULL && database != NULL)
+        {
+            g_mutex_lock(&database->mutex);
             row = get_file_id(database, meta);
+            g_mutex_unlock(&database->mutex);
 
             if (row != NULL)
                 {
-                    if (row->nb_row == 0) /* No row has been returned. It means that the file isn't in the cache */
-                        {
-                            free_file_row_t(row);
-                            return FALSE;
-                        }
-                    else
-                        { /* At least one row has been returned */
-                            free_file_row_t(row);
-                            return TRUE;
-                        }
-                }
-            else
-                {
-                    return FALSE;
+                    /* No row returned means that the file isn't in the cache */
+                    in_cache = (row->nb_row != 0);
+                    free_file_row_t(row);
                 }
         }
-    else
-        {
-            return FALSE;
-        }
+
+    return in_cache;
 }
 
 
@@ -559,7 +808,9 @@ static void free_file_row_t(file_row_t *row)
 
 /**
  * Insert file into cache. One should have verified that the file
- * does not already exists in the database.
+ * does not already exists in the database. Inserts are grouped into
+ * one transaction that is committed every DATABASE_BATCH_SIZE files or
+ * when it is older than DATABASE_BATCH_INTERVAL.
  * @todo Use statements to avoid bugs when dealing with strings from user
  *       space and thus avoid sql injection a bit. See
  *       https://sqlite.org/c3ref/prepare.html
@@ -581,8 +832,10 @@ void db_save_meta_data(db_t *database, meta_data_t *meta, gboolean only_meta)
         {
             cache_time = g_get_real_time();
 
-            /* beginning a transaction */
-            sql_begin(database);
+            g_mutex_lock(&database->mutex);
+
+            /* beginning a transaction if none is pending */
+            begin_batch_if_needed(database);
 
             /* Inserting the file into the files table */
             stmt = database->stmts->save_meta_stmt;
@@ -593,9 +846,107 @@ void db_save_meta_data(db_t *database, meta_data_t *meta, gboolean only_meta)
                     print_on_db_error(database->db, result, "sqlite3_step");
                 }
 
-            /* ending the transaction here */
-            sql_commit(database);
+            /* Keeps the in memory map of the files table up to date */
+            if (database->files != NULL && meta->name != NULL)
+                {
+                    g_hash_table_add(database->files, new_file_key_t(meta));
+                }
+
             sqlite3_reset(stmt);
+
+            /* ending the transaction when the batch is full or too old */
+            end_batch_if_due(database);
+
+            g_mutex_unlock(&database->mutex);
+        }
+}
+
+
+/**
+ * Gets the block records of the last saved version of a file.
+ * @param database is the structure that contains everything that is
+ *        related to the database (it's connexion for instance).
+ * @param name is the filename.
+ * @param[out] length is the number of bytes of the returned buffer.
+ * @returns a newly allocated buffer with the records of the file as
+ *          saved by db_save_file_blocks() or NULL if there is none.
+ */
+guint8 *db_get_file_blocks(db_t *database, gchar *name, gsize *length)
+{
+    sqlite3_stmt *stmt = NULL;
+    guint8 *blocks = NULL;
+    gint result = 0;
+    gint bytes = 0;
+
+    *length = 0;
+
+    if (database != NULL && database->stmts != NULL && name != NULL)
+        {
+            g_mutex_lock(&database->mutex);
+
+            stmt = database->stmts->get_file_blocks_stmt;
+            if (stmt != NULL)
+                {
+                    bind_text_value(database->db, stmt, ":name", name);
+                    result = sqlite3_step(stmt);
+
+                    if (result == SQLITE_ROW)
+                        {
+                            bytes = sqlite3_column_bytes(stmt, 0);
+
+                            if (bytes > 0)
+                                {
+                                    blocks = (guint8 *) g_memdup(sqlite3_column_blob(stmt, 0), bytes);
+                                    *length = bytes;
+                                }
+                        }
+                    else
+                        {
+                            print_on_db_error(database->db, result, "db_get_file_blocks");
+                        }
+
+                    sqlite3_reset(stmt);
+                }
+
+            g_mutex_unlock(&database->mutex);
+        }
+
+    return blocks;
+}
+
+
+/**
+ * Saves (or replaces) the block records of a file. Like
+ * db_save_meta_data() this is done in the pending batch transaction.
+ * @param database is the structure that contains everything that is
+ *        related to the database (it's connexion for instance).
+ * @param name is the filename.
+ * @param blocks is a buffer of records (its format is known by the
+ *        client only).
+ * @param length is the number of bytes in blocks.
+ */
+void db_save_file_blocks(db_t *database, gchar *name, guint8 *blocks, gsize length)
+{
+    sqlite3_stmt *stmt = NULL;
+    gint result = 0;
+
+    if (database != NULL && database->stmts != NULL && name != NULL && blocks != NULL)
+        {
+            g_mutex_lock(&database->mutex);
+            begin_batch_if_needed(database);
+
+            stmt = database->stmts->save_file_blocks_stmt;
+            if (stmt != NULL)
+                {
+                    bind_text_value(database->db, stmt, ":name", name);
+                    bind_blob_value(database->db, stmt, ":blocks", (gchar *) blocks, length);
+                    result = sqlite3_step(stmt);
+                    print_on_db_error(database->db, result, "db_save_file_blocks");
+                    sqlite3_reset(stmt);
+                }
+
+            end_batch_if_due(database);
+            g_mutex_unlock(&database->mutex);
         }
 }
 
@@ -615,6 +966,8 @@ void db_save_buffer(db_t *database, gchar *url, gchar *buffer)
 
     if (database != NULL && url != NULL && buffer != NULL && database->stmts != NULL)
         {
+            g_mutex_lock(&database->mutex);
+            commit_pending_batch(database);
             sql_begin(database);
 
             stmt = database->stmts->save_buffer_stmt;
@@ -626,6 +979,7 @@ void db_save_buffer(db_t *database, gchar *url, gchar *buffer)
                 }
             sql_commit(database);
             sqlite3_reset(stmt);
+            g_mutex_unlock(&database->mutex);
         }
 }
 
@@ -648,7 +1002,9 @@ gboolean db_is_there_buffers_to_transmit(db_t *database)
             i = (int *) g_malloc0(sizeof(int));
             *i = 0;
 
+            g_mutex_lock(&database->mutex);
             result = sqlite3_exec(database->db, "SELECT * FROM buffers WHERE buffers.buffer_id NOT IN (SELECT transmited.buffer_id FROM transmited INNER JOIN buffers ON transmited.buffer_id = buffers.buffer_id);", count_lines_callback, i, &error_message);
+            g_mutex_unlock(&database->mutex);
 
             if (result == SQLITE_OK && *i == 0)
                 {
@@ -793,6 +1149,12 @@ gboolean db_transmit_buffers(db_t *database, comm_t *comm)
         {
             trans = new_transmited_t(database, comm);
 
+            /* Buffers are rare and transmitting them is done by one thread only:
+             * holding the lock while posting keeps things simple.
+             */
+            g_mutex_lock(&database->mutex);
+            commit_pending_batch(database);
+
             /* This should select only the rows in buffers that are not in transmited based on the primary key buffer_id */
             result = sqlite3_exec(database->db, "SELECT * FROM buffers WHERE buffers.buffer_id NOT IN (SELECT transmited.buffer_id FROM transmited INNER JOIN buffers ON transmited.buffer_id = buffers.buffer_id);", transmit_callback, trans, &error_message);
 
@@ -801,6 +1163,8 @@ gboolean db_transmit_buffers(db_t *database, comm_t *comm)
             delete_transmited_buffers(database);
             /** @todo Catch the return value of this function and do something with it */
 
+            g_mutex_unlock(&database->mutex);
+
         }
 
     if (result == SQLITE_OK)
@@ -1060,6 +1424,46 @@ static sqlite3_stmt *create_get_file_id_stmt(sqlite3 *db)
 }
 
 
+/**
+ * Creates the statement that retrieves the block records of a file.
+ * @param db is an sqlite * pointer to an opened database.
+ * @returns the newly created statement.
+ */
+static sqlite3_stmt *create_get_file_blocks_stmt(sqlite3 *db)
+{
+    sqlite3_stmt *stmt = NULL;
+    int result = 0;
+
+    if (db != NULL)
+        {
+            result = sqlite3_prepare_v2(db, "SELECT blocks FROM file_blocks WHERE name=:name;", -1, &stmt, NULL);
+            print_on_db_error(db, result, "create_get_file_blocks_stmt");
+        }
+
+    return stmt;
+}
+
+
+/**
+ * Creates the statement that saves the block records of a file.
+ * @param db is an sqlite * pointer to an opened database.
+ * @returns the newly created statement.
+ */
+static sqlite3_stmt *create_save_file_blocks_stmt(sqlite3 *db)
+{
+    sqlite3_stmt *stmt = NULL;
+    int result = 0;
+
+    if (db != NULL)
+        {
+            result = sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO file_blocks (name, blocks) VALUES (:name, :blocks);", -1, &stmt, NULL);
+            print_on_db_error(db, result, "create_save_file_blocks_stmt");
+        }
+
+    return stmt;
+}
+
+
 /**
  * Creates a new stmt_t * strcuture
  * @param db is an sqlite * pointer to an opened database.
@@ -1077,6 +1481,8 @@ static stmt_t *new_stmts(sqlite3 *db)
     stmts->save_meta_stmt = create_save_meta_stmt(db);
     stmts->save_buffer_stmt = create_save_buffer_stmt(db);
     stmts->get_file_id_stmt = create_get_file_id_stmt(db);
+    stmts->get_file_blocks_stmt = create_get_file_blocks_stmt(db);
+    stmts->save_file_blocks_stmt = create_save_file_blocks_stmt(db);
 
     return stmts;
 }
@@ -1093,6 +1499,8 @@ static void free_stmts(stmt_t *stmts)
             sqlite3_finalize(stmts->save_meta_stmt);
             sqlite3_finalize(stmts->save_buffer_stmt);
             sqlite3_finalize(stmts->get_file_id_stmt);
+            sqlite3_finalize(stmts->get_file_blocks_stmt);
+            sqlite3_finalize(stmts->save_file_blocks_stmt);
             g_free(stmts);
         }
 }
@@ -1139,11 +1547,25 @@ void close_database(db_t *database)
     if (database != NULL)
         {
             print_debug(_("\tClosing database.\n"));
+
+            /* Other threads may still be using the database */
+            g_mutex_lock(&database->mutex);
+
+            commit_pending_batch(database);
             free_stmts(database->stmts);
+            database->stmts = NULL;
+            if (database->files != NULL)
+                {
+                    g_hash_table_destroy(database->files);
+                    database->files = NULL;
+                }
             if (database->db != NULL)
                 {
                     sqlite3_close(database->db);
+                    database->db = NULL;
                 }
+
+            g_mutex_unlock(&database->mutex);
         }
 }
 
@@ -1185,12 +1607,15 @@ db_t *open_database(gchar *dirname, gchar *filename)
 
                     database->version_filename = g_strdup_printf("%s.version", database_name);
                     database->db = db;
+                    g_mutex_init(&database->mutex);
                     sqlite3_extended_result_codes(db, 1);
+                    set_pragmas(database);
 
                     verify_if_tables_exists(database);
                     database->stmts = new_stmts(db);
                     database->version = get_database_version(database->version_filename, KN_CLIENT_DATABASE);
                     migrate_schema_if_needed(database);
+                    load_files_map(database);
 
                     free_variable(database_name);
 
@@ -58,6 +58,30 @@
 #define DATABASE_SCHEMA_VERSION (1)
 
 
+/**
+ * @def DATABASE_BATCH_SIZE
+ * Number of files saved by db_save_meta_data() in one transaction
+ * before it is committed.
+ */
+#define DATABASE_BATCH_SIZE (1024)
+
+
+/**
+ * @def DATABASE_BATCH_INTERVAL
+ * Maximum time (in microseconds) a transaction opened by
+ * db_save_meta_data() is kept before being committed. Default is 2 s.
+ */
+#define DATABASE_BATCH_INTERVAL (2000000)
+
+
+/**
+ * @def DATABASE_MMAP_SIZE
+ * Size (in bytes) of the database that sqlite may access through mmap.
+ * Default is 256 MB.
+ */
+#define DATABASE_MMAP_SIZE (268435456)
+
+
 /**
  * @struct stmt_t
  * @brief structure to hold all statements needed for the programs.
@@ -67,9 +91,31 @@
     sqlite3_stmt *save_meta_stmt;
     sqlite3_stmt *save_buffer_stmt;
     sqlite3_stmt *get_file_id_stmt;
+    sqlite3_stmt *get_file_blocks_stmt;
+    sqlite3_stmt *save_file_blocks_stmt;
  } stmt_t;
 
 
+/**
+ * @struct file_key_t
+ * @brief Compact in memory key of a file saved in the files table. It
+ *        holds the columns tested by get_file_id's statement and a 64
+ *        bits hash of the filename instead of the filename itself.
+ */
+typedef struct
+{
+    guint64 inode;     /**< file's inode                      */
+    guint64 ctime;     /**< changed time                      */
+    guint64 mtime;     /**< modified time                     */
+    guint64 size;      /**< size of the file                  */
+    guint64 name_hash; /**< FNV-1a 64 bits hash of the name   */
+    guint32 mode;      /**< UNIX mode of the file             */
+    guint32 uid;       /**< uid (owner)                       */
+    guint32 gid;       /**< gid (group owner)                 */
+    guint8 file_type;  /**< type of the file                  */
+} file_key_t;
+
+
 /**
  * @struct db_t
  * @brief Structure to store everything that is needed for the database.
@@ -77,7 +123,11 @@
 typedef struct
 {
     sqlite3 *db;  /**< database connexion  */
+    GMutex mutex; /**< serializes accesses to the connexion and its statements between client's threads */
     stmt_t *stmts;
+    GHashTable *files; /**< set of file_key_t * of every file in the files table (NULL when it could not be loaded) */
+    guint batched;       /**< number of files saved in the pending transaction (0 if none is opened)          */
+    gint64 batch_begin;  /**< time (g_get_monotonic_time) at which the pending transaction has been opened     */
     gint64 version;
     gchar *version_filename;
 } db_t;
@@ -165,6 +215,31 @@ extern gboolean is_file_in_cache(db_t *database, meta_data_t *meta);
 extern void db_save_meta_data(db_t *database, meta_data_t *meta, gboolean only_meta);
 
 
+/**
+ * Gets the block records of the last saved version of a file.
+ * @param database is the structure that contains everything that is
+ *        related to the database (it's connexion for instance).
+ * @param name is the filename.
+ * @param[out] length is the number of bytes of the returned buffer.
+ * @returns a newly allocated buffer with the records of the file as
+ *          saved by db_save_file_blocks() or NULL if there is none.
+ */
+extern guint8 *db_get_file_blocks(db_t *database, gchar *name, gsize *length);
+
+
+/**
+ * Saves (or replaces) the block records of a file. Like
+ * db_save_meta_data() this is done in the pending batch transaction.
+ * @param database is the structure that contains everything that is
+ *        related to the database (it's connexion for instance).
+ * @param name is the filename.
+ * @param blocks is a buffer of records (its format is known by the
+ *        client only).
+ * @param length is the number of bytes in blocks.
+ */
+extern void db_save_file_blocks(db_t *database, gchar *name, guint8 *blocks, gsize length);
+
+
 /**
  * This function says if the table 'buffers' is empty or not, that is
  * to say whether we have to transmit unsaved data or not.
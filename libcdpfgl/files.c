@@ -54,7 +54,8 @@ meta_data_t *new_meta_data_t(void)
     meta->gid = 65534;  /* nfsnobody on my system ie unpriviledged user */
     meta->name = NULL;
     meta->link = NULL;
-    meta->hash_data_list = NULL;
+    meta->hashs = NULL;
+    meta->nb_hashs = 0;
     meta->in_cache = FALSE; /* a newly meta data is not in the local cache ! */
     meta->blocksize = 16384; /* Default blocksize */
 
@@ -100,7 +101,7 @@ void free_meta_data_t(meta_data_t *meta, gboolean free_link)
                     free_variable(meta->link);
                 }
 
-            g_list_free_full(meta->hash_data_list, free_hdt_struct);
+            free_variable(meta->hashs);
             free_variable(meta);
         }
 }
@@ -491,6 +492,34 @@ GDateTime *convert_gchar_date_to_gdatetime(gchar *date)
 }
 
 
+/**
+ * Transforms a YYYY-MM-DD HH:MM:SS date into unix time once for all.
+ * @param date is the date as given in a query.
+ * @param[out] unix_time is the unix time of that date.
+ * @returns TRUE if date is a valid date, FALSE otherwise.
+ */
+gboolean get_unix_time_from_gchar_date(gchar *date, gint64 *unix_time)
+{
+    GDateTime *datetime = NULL;
+    gboolean valid = FALSE;
+
+    datetime = convert_gchar_date_to_gdatetime(date);
+
+    if (datetime != NULL)
+        {
+            *unix_time = g_date_time_to_unix(datetime);
+            g_date_time_unref(datetime);
+            valid = TRUE;
+        }
+    else
+        {
+            print_debug(_("Invalid date %s ignored\n"), date);
+        }
+
+    return valid;
+}
+
+
 /**
  * Get unix mode of a file
  * @param fileinfo : a GFileInfo pointer obtained from an opened file
@@ -34,7 +34,8 @@
  *
  * Structure to store all meta data associated with a file or a directory
  * command line. We want to limit memory consumption and thus we use the
- * guint instead of gchar *.
+ * guint instead of gchar *. Hashs are kept in one contiguous array (and
+ * not in a list of hash_data_t structures) as they are in catalog records.
  */
 typedef struct
 {
@@ -51,7 +52,8 @@ typedef struct
     guint32 gid;           /**< gid (group owner)                                                                */
     gchar *name;           /**< name for the file or the directory                                               */
     gchar *link;           /**< link name where points the LINK if file_type is a link                           */
-    GList *hash_data_list; /**< List of hash_data_t structures of the file (hash and data are in a binary form)  */
+    guint8 *hashs;         /**< nb_hashs * HASH_LEN bytes: binary hashs of the file's blocks in order            */
+    guint64 nb_hashs;      /**< number of hashs in hashs                                                          */
     gboolean in_cache;     /**< in_cache is a boolean that may be TRUE if the file is in the local cache (client)*/
     gint64 blocksize;      /**< blocksize is the blocksize to be applied on the file                             */
 } meta_data_t;
@@ -165,6 +167,15 @@ extern gboolean compare_after_before_date(guint64 mtime, gchar *date, gboolean a
 extern GDateTime *convert_gchar_date_to_gdatetime(gchar *date);
 
 
+/**
+ * Transforms a YYYY-MM-DD HH:MM:SS date into unix time once for all.
+ * @param date is the date as given in a query.
+ * @param[out] unix_time is the unix time of that date.
+ * @returns TRUE if date is a valid date, FALSE otherwise.
+ */
+extern gboolean get_unix_time_from_gchar_date(gchar *date, gint64 *unix_time);
+
+
 /**
  * Get unix mode of a file
  * @param fileinfo : a GFileInfo pointer obtained from an opened file
@@ -28,6 +28,35 @@
 
 #include "libcdpfgl.h"
 
+static void free_thread_checksum(gpointer data);
+static gpointer select_hash_implementation(gpointer data);
+
+
+/**
+ * Threads that hash without dedicated instructions keep their own
+ * GChecksum to avoid creating one for each block.
+ */
+static GPrivate thread_checksum = G_PRIVATE_INIT(free_thread_checksum);
+
+
+/**
+ * Accelerated SHA256 compression function selected at the first call
+ * of calculate_hash_into() (NULL when GChecksum is used).
+ */
+static sha256_compress_func hash_compress = NULL;
+
+
+/**
+ * Name of the SHA256 implementation in use.
+ */
+static const gchar *hash_implementation = "glib";
+
+
+/**
+ * Ensures that the SHA256 implementation is selected only once.
+ */
+static GOnce hash_once = G_ONCE_INIT;
+
 /**
  * Comparison function used to compare two hashs (binary form) mainly
  * used to sort hashs properly.
@@ -216,7 +245,13 @@ guint8 *string_to_hash(gchar *str_hash)
  */
 void free_hash_data_t(hash_data_t *hash_data)
 {
-    if (hash_data != NULL)
+    if (hash_data != NULL && hash_data->pool != NULL)
+        {
+            buffer_pool_release(hash_data->pool, hash_data->data);
+            buffer_pool_release(hash_data->pool, hash_data->hash);
+            buffer_pool_release(hash_data->pool, hash_data);
+        }
+    else if (hash_data != NULL)
         {
             free_variable(hash_data->data);
             free_variable(hash_data->hash);
@@ -265,6 +300,60 @@ hash_data_t *new_hash_data_t(guchar *data, gssize size_read, guint8 *hash, gshor
 
     hash_data->hash = hash;
     hash_data->cmptype = cmptype;
+    hash_data->pool = NULL;
+
+    return hash_data;
+}
+
+
+/**
+ * Inits and returns a newly hash_data_t structure taken from pool (and
+ * compresses data into a buffer of the pool if cmptype is a compression
+ * type such as COMPRESS_ZLIB_TYPE). free_hash_data_t() gives everything
+ * back to the pool.
+ * @param pool is the pool of buffers where data and hash come from.
+ * @param data is the buffer read (allocated from pool). It belongs to the
+ *        returned structure or it is released if compressed.
+ * @param size_read is the number of bytes in data.
+ * @param hash is the hash of data (allocated from pool).
+ * @param cmptype is the compression type to use.
+ * @returns a newly created hash_data_t structure.
+ */
+hash_data_t *new_hash_data_t_from_pool(buffer_pool_t *pool, guchar *data, gssize size_read, guint8 *hash, gshort cmptype)
+{
+    hash_data_t *hash_data = NULL;
+    guchar *dest = NULL;
+    gsize destlen = 0;
+
+    g_assert_nonnull(pool);
+
+    hash_data = (hash_data_t *) buffer_pool_alloc(pool, sizeof(hash_data_t));
+
+    hash_data->data = data;
+    hash_data->read = size_read;
+    hash_data->uncmplen = size_read;
+    hash_data->hash = hash;
+    hash_data->cmptype = COMPRESS_NONE_TYPE;
+    hash_data->pool = pool;
+
+    if (cmptype != COMPRESS_NONE_TYPE && data != NULL)
+        {
+            destlen = compress_bound(size_read, cmptype);
+            dest = (guchar *) buffer_pool_alloc(pool, destlen);
+
+            if (compress_buffer_into(data, size_read, cmptype, dest, &destlen) == TRUE)
+                {
+                    buffer_pool_release(pool, data);
+                    hash_data->data = dest;
+                    hash_data->read = destlen;
+                    hash_data->cmptype = cmptype;
+                }
+            else
+                {
+                    /* data is sent uncompressed: cmptype tells it to the server */
+                    buffer_pool_release(pool, dest);
+                }
+        }
 
     return hash_data;
 }
@@ -287,6 +376,7 @@ hash_data_t *new_hash_data_t_as_is(guchar * data, gssize read, guint8 *hash, gsh
     hash_data->uncmplen = uncmplen;
     hash_data->hash = hash;
     hash_data->cmptype = cmptype;
+    hash_data->pool = NULL;
 
     return hash_data;
 }
@@ -425,29 +515,30 @@ gchar *convert_max_hashs_from_hash_list_to_gchar(hash_extract_t *hash_extract, g
  */
 gchar *make_path_from_hash(gchar *path, guint8 *hash, guint level)
 {
-    gchar *octet = NULL;
-    gchar *old_path = NULL;
+    static const gchar hex[] = "0123456789abcdef";
+    gchar dirs[HASH_LEN * 3];  /* "xx/" for each level */
     gchar *new_path = NULL;
+    guint pos = 0;
     guint i = 0;
 
     if (path != NULL && hash != NULL && level < HASH_LEN)
         {
-
-            old_path = g_strdup(path);
-
-            for(i = 0; i < level; i++)
+            for (i = 0; i < level; i++)
                 {
-                    octet = g_strdup_printf("%02x", hash[i]);
-                    new_path = g_build_filename(old_path, octet, NULL);
-
-                    free_variable(old_path);
-                    free_variable(octet);
+                    if (i > 0)
+                        {
+                            dirs[pos++] = G_DIR_SEPARATOR;
+                        }
 
-                    old_path = new_path;
+                    dirs[pos++] = hex[hash[i] >> 4];
+                    dirs[pos++] = hex[hash[i] & 0x0f];
                 }
+
+            dirs[pos] = '\0';
+            new_path = g_build_filename(path, dirs, NULL);
         }
 
-    return old_path;
+    return new_path;
 }
 
 
@@ -565,16 +656,431 @@ gpointer copy_only_hash(gconstpointer src, gpointer user_data)
  */
 guint8 *calculate_hash_for_string(guchar *buffer, guint size)
 {
-    GChecksum *digest = NULL;
     guint8 *a_hash = NULL;
-    gsize digest_len = HASH_LEN;
 
     /* Calculates cheksum for final_buffer */
-    a_hash = (guint8 *) g_malloc(digest_len);
-    digest = g_checksum_new(G_CHECKSUM_SHA256);
-    g_checksum_update(digest, (const guchar *) buffer, size);
-    g_checksum_get_digest(digest, a_hash, &digest_len);
-    g_checksum_free(digest);
+    a_hash = (guint8 *) g_malloc(HASH_LEN);
+    calculate_hash_into(buffer, size, a_hash);
 
     return a_hash;
 }
+
+
+/**
+ * Frees the GChecksum of a thread when it exits.
+ * @param data is the GChecksum * to be freed.
+ */
+static void free_thread_checksum(gpointer data)
+{
+    if (data != NULL)
+        {
+            g_checksum_free((GChecksum *) data);
+        }
+}
+
+
+/**
+ * Selects the accelerated SHA256 implementation if the processor has
+ * one. It is checked against GChecksum on a few buffers before being
+ * used: a wrong hash would silently corrupt the backups.
+ * @param data is not used.
+ * @returns NULL.
+ */
+static gpointer select_hash_implementation(gpointer data)
+{
+    sha256_compress_func compress = NULL;
+    const gchar *name = NULL;
+    GChecksum *checksum = NULL;
+    guchar buffer[1000];
+    guint8 expected[HASH_LEN];
+    guint8 got[HASH_LEN];
+    gsize digest_len = HASH_LEN;
+    gsize sizes[] = {0, 55, 56, 64, 119, 1000};
+    gboolean ok = TRUE;
+    guint i = 0;
+
+    compress = sha256_get_accelerated_compress(&name);
+
+    if (compress != NULL)
+        {
+            for (i = 0; i < sizeof(buffer); i++)
+                {
+                    buffer[i] = (guchar) (i * 7 + 3);
+                }
+
+            checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+            for (i = 0; i < G_N_ELEMENTS(sizes) && ok == TRUE; i++)
+                {
+                    digest_len = HASH_LEN;
+                    g_checksum_reset(checksum);
+                    g_checksum_update(checksum, buffer, sizes[i]);
+                    g_checksum_get_digest(checksum, expected, &digest_len);
+                    sha256_digest(compress, buffer, sizes[i], got);
+                    ok = (memcmp(expected, got, HASH_LEN) == 0);
+                }
+
+            g_checksum_free(checksum);
+
+            if (ok == TRUE)
+                {
+                    hash_compress = compress;
+                    hash_implementation = name;
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("SHA256 with %s gives wrong hashs: using glib's one.\n"), name);
+                }
+        }
+
+    print_debug(_("SHA256 implementation: %s\n"), hash_implementation);
+
+    return NULL;
+}
+
+
+/**
+ * Calculates the SHA256 hash of buffer into a_hash. The processor's
+ * SHA256 instructions are used when it has some, GChecksum otherwise.
+ * This function is thread safe.
+ * @param buffer is a buffer that may contain \0 bytes.
+ * @param size is the number of bytes of buffer to hash.
+ * @param[out] a_hash is where the HASH_LEN bytes of the hash are
+ *             written.
+ */
+void calculate_hash_into(guchar *buffer, gsize size, guint8 *a_hash)
+{
+    GChecksum *checksum = NULL;
+    gsize digest_len = HASH_LEN;
+
+    g_once(&hash_once, select_hash_implementation, NULL);
+
+    if (hash_compress != NULL)
+        {
+            sha256_digest(hash_compress, buffer, size, a_hash);
+        }
+    else
+        {
+            checksum = g_private_get(&thread_checksum);
+
+            if (checksum == NULL)
+                {
+                    checksum = g_checksum_new(G_CHECKSUM_SHA256);
+                    g_private_set(&thread_checksum, checksum);
+                }
+
+            g_checksum_update(checksum, buffer, size);
+            g_checksum_get_digest(checksum, a_hash, &digest_len);
+            g_checksum_reset(checksum);
+        }
+}
+
+
+/**
+ * @returns the name of the SHA256 implementation in use (this string
+ *          must not be freed).
+ */
+const gchar *get_hash_implementation(void)
+{
+    g_once(&hash_once, select_hash_implementation, NULL);
+
+    return hash_implementation;
+}
+
+
+/**
+ * Hash function to be used with GHashTable when keys are binary hashs
+ * (guint8 * of HASH_LEN bytes). Hashs are SHA256 ones and are thus
+ * uniformly distributed: the first bytes are enough.
+ * @param key is a guint8 * binary hash of HASH_LEN bytes.
+ * @returns a guint hash value for the key.
+ */
+guint hash_key_hash(gconstpointer key)
+{
+    guint value = 0;
+
+    memcpy(&value, key, sizeof(guint));
+
+    return value;
+}
+
+
+/**
+ * Equal function to be used with GHashTable when keys are binary hashs
+ * @param a is a guint8 * binary hash of HASH_LEN bytes.
+ * @param b is a guint8 * binary hash of HASH_LEN bytes.
+ * @returns TRUE if a and b are the same hashs, FALSE otherwise
+ */
+gboolean hash_key_equal(gconstpointer a, gconstpointer b)
+{
+    return (memcmp(a, b, HASH_LEN) == 0);
+}
+
+
+/**
+ * Creates an empty hash index: a GHashTable whose keys are binary hashs
+ * that are NOT owned by the table (they usually point to the hash field
+ * of a hash_data_t structure).
+ * @returns a newly allocated GHashTable that may be freed with
+ *          g_hash_table_destroy() when no longer needed.
+ */
+GHashTable *new_hash_index(void)
+{
+    return g_hash_table_new(hash_key_hash, hash_key_equal);
+}
+
+
+/**
+ * Builds a hash index over a GList of hash_data_t structures: each hash
+ * maps to the GList element that contains it. When a hash appears
+ * more than once the first element is kept (as a linear search would).
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @returns a newly allocated GHashTable that may be freed with
+ *          g_hash_table_destroy() when no longer needed. Keys point to
+ *          the hashs of hash_data_list: an entry must be removed before
+ *          its hash_data_t structure is freed.
+ */
+GHashTable *new_hash_index_from_list(GList *hash_data_list)
+{
+    GHashTable *index = NULL;
+    hash_data_t *hash_data = NULL;
+
+    index = new_hash_index();
+
+    while (hash_data_list != NULL)
+        {
+            hash_data = hash_data_list->data;
+
+            if (hash_data != NULL && hash_data->hash != NULL && g_hash_table_contains(index, hash_data->hash) == FALSE)
+                {
+                    g_hash_table_insert(index, hash_data->hash, hash_data_list);
+                }
+
+            hash_data_list = g_list_next(hash_data_list);
+        }
+
+    return index;
+}
+
+
+/**
+ * Writes the zero hash of a block of length zeros (see
+ * ZERO_HASH_PREFIX_LEN).
+ * @param length is the length of the block (must not be 0).
+ * @param[out] a_hash is where the HASH_LEN bytes of the hash are
+ *             written.
+ */
+void make_zero_hash(guint64 length, guint8 *a_hash)
+{
+    if (a_hash != NULL)
+        {
+            memset(a_hash, 0, ZERO_HASH_PREFIX_LEN);
+            put_guint64_into_buffer(a_hash + ZERO_HASH_PREFIX_LEN, length);
+        }
+}
+
+
+/**
+ * Tells whether a hash is a zero hash.
+ * @param a_hash is a binary hash of HASH_LEN bytes.
+ * @param[out] length is the length of the block of zeros if a_hash is
+ *             a zero hash (may be NULL).
+ * @returns TRUE if a_hash is a zero hash, FALSE otherwise.
+ */
+gboolean is_zero_hash(guint8 *a_hash, guint64 *length)
+{
+    guint64 zero_len = 0;
+
+    if (a_hash == NULL || a_hash[0] != 0 || memcmp(a_hash, a_hash + 1, ZERO_HASH_PREFIX_LEN - 1) != 0)
+        {
+            return FALSE;
+        }
+
+    zero_len = get_guint64_from_buffer(a_hash + ZERO_HASH_PREFIX_LEN);
+
+    if (length != NULL)
+        {
+            *length = zero_len;
+        }
+
+    return (zero_len > 0);
+}
+
+
+/**
+ * Tells whether a buffer is made only of zeros. The first byte is
+ * compared to 0 and then the buffer to itself shifted by one byte which
+ * lets memcmp() use its vectorized implementation.
+ * @param buffer is the buffer to look at.
+ * @param size is the number of bytes of buffer.
+ * @returns TRUE if every byte of buffer is 0 (and size is not 0).
+ */
+gboolean is_zero_buffer(const guchar *buffer, gsize size)
+{
+    if (buffer == NULL || size == 0 || buffer[0] != 0)
+        {
+            return FALSE;
+        }
+
+    return (memcmp(buffer, buffer + 1, size - 1) == 0);
+}
+
+
+/**
+ * Removes zero hashs from a list (those blocks are never stored).
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @returns the list without those blocks (that are freed).
+ */
+GList *remove_zero_hashs(GList *hash_data_list)
+{
+    GList *iter = hash_data_list;
+    GList *next = NULL;
+    hash_data_t *hash_data = NULL;
+
+    while (iter != NULL)
+        {
+            next = g_list_next(iter);
+            hash_data = (hash_data_t *) iter->data;
+
+            if (hash_data != NULL && is_zero_hash(hash_data->hash, NULL) == TRUE)
+                {
+                    free_hash_data_t(hash_data);
+                    hash_data_list = g_list_delete_link(hash_data_list, iter);
+                }
+
+            iter = next;
+        }
+
+    return hash_data_list;
+}
+
+
+/**
+ * Makes the contiguous array of hashs of a meta_data_t structure from a
+ * list of hash_data_t * structures. Data (if any) is not copied.
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @param[out] nb_hashs is the number of hashs in the returned array.
+ * @returns a newly allocated array of *nb_hashs * HASH_LEN bytes (NULL if
+ *          the list has no hash) that may be freed when no longer
+ *          needed.
+ */
+guint8 *make_hash_array_from_hash_data_list(GList *hash_data_list, guint64 *nb_hashs)
+{
+    GList *iter = NULL;
+    hash_data_t *hash_data = NULL;
+    guint8 *hashs = NULL;
+    guint64 nb = 0;
+
+    for (iter = hash_data_list; iter != NULL; iter = g_list_next(iter))
+        {
+            hash_data = (hash_data_t *) iter->data;
+
+            if (hash_data != NULL && hash_data->hash != NULL)
+                {
+                    nb++;
+                }
+        }
+
+    if (nb > 0)
+        {
+            hashs = (guint8 *) g_malloc(nb * HASH_LEN);
+            nb = 0;
+
+            for (iter = hash_data_list; iter != NULL; iter = g_list_next(iter))
+                {
+                    hash_data = (hash_data_t *) iter->data;
+
+                    if (hash_data != NULL && hash_data->hash != NULL)
+                        {
+                            memcpy(hashs + nb * HASH_LEN, hash_data->hash, HASH_LEN);
+                            nb++;
+                        }
+                }
+        }
+
+    *nb_hashs = nb;
+
+    return hashs;
+}
+
+
+/**
+ * Makes a list of hash_data_t * structures (with hashs only) from a
+ * contiguous array of hashs. This is only needed where a list is
+ * expected: backends' needed lists and retrieving data.
+ * @param hashs is an array of nb_hashs * HASH_LEN bytes.
+ * @param nb_hashs is the number of hashs in hashs.
+ * @returns a GList of hash_data_t * in the same order than the array.
+ */
+GList *make_hash_data_list_from_hash_array(guint8 *hashs, guint64 nb_hashs)
+{
+    GList *hash_data_list = NULL;
+    hash_data_t *hash_data = NULL;
+    guint64 i = nb_hashs;
+
+    if (hashs != NULL)
+        {
+            /* prepending from the end gives the list in the right order */
+            while (i > 0)
+                {
+                    i--;
+                    hash_data = new_hash_data_t_as_is(NULL, 0, (guint8 *) g_memdup(hashs + i * HASH_LEN, HASH_LEN), COMPRESS_NONE_TYPE, 0);
+                    hash_data_list = g_list_prepend(hash_data_list, hash_data);
+                }
+        }
+
+    return hash_data_list;
+}
+
+
+/**
+ * Makes a contiguous array of hashs from a string containning base64
+ * encoded hashs separated by commas (as make_hash_data_list_from_string()
+ * does for a list).
+ * @param hash_string the string containing base64 encoded hashs.
+ * @param[out] nb_hashs is the number of hashs in the returned array.
+ * @returns a newly allocated array of *nb_hashs * HASH_LEN bytes (NULL if
+ *          there is no hash) that may be freed when no longer needed.
+ */
+guint8 *make_hash_array_from_string(gchar *hash_string, guint64 *nb_hashs)
+{
+    gchar **strings = NULL;
+    gchar *a_hash = NULL;
+    guchar *decoded = NULL;
+    guint8 *hashs = NULL;
+    gsize len = 0;
+    guint64 nb = 0;
+    guint i = 0;
+
+    if (hash_string != NULL)
+        {
+            strings = g_strsplit(hash_string, ",", -1);
+            hashs = (guint8 *) g_malloc(g_strv_length(strings) * HASH_LEN + 1);
+
+            for (i = 0; strings[i] != NULL; i++)
+                {
+                    a_hash = g_strndup(g_strchug(strings[i] + 1), strlen(g_strchug(strings[i])) - 2);
+                    decoded = g_base64_decode(a_hash, &len);
+
+                    if (decoded != NULL && len == HASH_LEN)
+                        {
+                            memcpy(hashs + nb * HASH_LEN, decoded, HASH_LEN);
+                            nb++;
+                        }
+
+                    free_variable(decoded);
+                    free_variable(a_hash);
+                }
+
+            g_strfreev(strings);
+
+            if (nb == 0)
+                {
+                    free_variable(hashs);
+                }
+        }
+
+    *nb_hashs = nb;
+
+    return hashs;
+}
@@ -34,6 +34,17 @@
  */
 #define HASH_LEN (32)
 
+
+/**
+ * @def ZERO_HASH_PREFIX_LEN
+ * A zero hash is the well-known hash of a block made only of zeros (a
+ * hole of a sparse file for instance). It is not a SHA256 hash: its
+ * first ZERO_HASH_PREFIX_LEN bytes are zeros and its last 8 bytes are
+ * the length of the block. Such blocks are neither hashed, sent nor
+ * stored: they are recreated as holes when restored.
+ */
+#define ZERO_HASH_PREFIX_LEN (HASH_LEN - 8)
+
 /**
  * @struct hash_data_t
  * @brief Structure to store a hash and the corresponding data
@@ -45,6 +56,7 @@ typedef struct
     gssize read;     /* Always the lenght of *data buffer (compressed or not) */
     gshort cmptype;  /* tells wether the data here has been compressed or not and what type of compression it is */
     gssize uncmplen; /* The length of the uncompressed buffer if it has been compressed */
+    buffer_pool_t *pool; /* pool where hash, data and this structure come from (NULL if they were allocated with g_malloc) */
 } hash_data_t;
 
 
@@ -111,6 +123,22 @@ extern void free_hdt_struct(gpointer data);
  */
 extern hash_data_t *new_hash_data_t(guchar * data, gssize read, guint8 *hash, gshort cmptype);
 
+
+/**
+ * Inits and returns a newly hash_data_t structure taken from pool (and
+ * compresses data into a buffer of the pool if cmptype is a compression
+ * type such as COMPRESS_ZLIB_TYPE). free_hash_data_t() gives everything
+ * back to the pool.
+ * @param pool is the pool of buffers where data and hash come from.
+ * @param data is the buffer read (allocated from pool). It belongs to the
+ *        returned structure or it is released if compressed.
+ * @param read is the number of bytes in data.
+ * @param hash is the hash of data (allocated from pool).
+ * @param cmptype is the compression type to use.
+ * @returns a newly created hash_data_t structure.
+ */
+extern hash_data_t *new_hash_data_t_from_pool(buffer_pool_t *pool, guchar *data, gssize read, guint8 *hash, gshort cmptype);
+
 /**
  * Inits and returns a newly hash_data_t structure filed with the value as stated and
  * does nothing with the data
@@ -211,4 +239,135 @@ extern gchar *convert_max_hashs_from_hash_list_to_gchar(hash_extract_t *hash_ext
  */
 extern guint8 *calculate_hash_for_string(guchar *buffer, guint size);
 
+
+/**
+ * Calculates the SHA256 hash of buffer into a_hash. The processor's
+ * SHA256 instructions are used when it has some, GChecksum otherwise.
+ * This function is thread safe.
+ * @param buffer is a buffer that may contain \0 bytes.
+ * @param size is the number of bytes of buffer to hash.
+ * @param[out] a_hash is where the HASH_LEN bytes of the hash are
+ *             written.
+ */
+extern void calculate_hash_into(guchar *buffer, gsize size, guint8 *a_hash);
+
+
+/**
+ * @returns the name of the SHA256 implementation in use (this string
+ *          must not be freed).
+ */
+extern const gchar *get_hash_implementation(void);
+
+
+/**
+ * Hash function to be used with GHashTable when keys are binary hashs
+ * (guint8 * of HASH_LEN bytes). Hashs are SHA256 ones and are thus
+ * uniformly distributed: the first bytes are enough.
+ * @param key is a guint8 * binary hash of HASH_LEN bytes.
+ * @returns a guint hash value for the key.
+ */
+extern guint hash_key_hash(gconstpointer key);
+
+
+/**
+ * Equal function to be used with GHashTable when keys are binary hashs
+ * @param a is a guint8 * binary hash of HASH_LEN bytes.
+ * @param b is a guint8 * binary hash of HASH_LEN bytes.
+ * @returns TRUE if a and b are the same hashs, FALSE otherwise
+ */
+extern gboolean hash_key_equal(gconstpointer a, gconstpointer b);
+
+
+/**
+ * Creates an empty hash index: a GHashTable whose keys are binary hashs
+ * that are NOT owned by the table (they usually point to the hash field
+ * of a hash_data_t structure).
+ * @returns a newly allocated GHashTable that may be freed with
+ *          g_hash_table_destroy() when no longer needed.
+ */
+extern GHashTable *new_hash_index(void);
+
+
+/**
+ * Builds a hash index over a GList of hash_data_t structures: each hash
+ * maps to the GList element that contains it. When a hash appears
+ * more than once the first element is kept (as a linear search would).
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @returns a newly allocated GHashTable that may be freed with
+ *          g_hash_table_destroy() when no longer needed. Keys point to
+ *          the hashs of hash_data_list: an entry must be removed before
+ *          its hash_data_t structure is freed.
+ */
+extern GHashTable *new_hash_index_from_list(GList *hash_data_list);
+
+
+/**
+ * Writes the zero hash of a block of length zeros (see
+ * ZERO_HASH_PREFIX_LEN).
+ * @param length is the length of the block (must not be 0).
+ * @param[out] a_hash is where the HASH_LEN bytes of the hash are
+ *             written.
+ */
+extern void make_zero_hash(guint64 length, guint8 *a_hash);
+
+
+/**
+ * Tells whether a hash is a zero hash.
+ * @param a_hash is a binary hash of HASH_LEN bytes.
+ * @param[out] length is the length of the block of zeros if a_hash is
+ *             a zero hash (may be NULL).
+ * @returns TRUE if a_hash is a zero hash, FALSE otherwise.
+ */
+extern gboolean is_zero_hash(guint8 *a_hash, guint64 *length);
+
+
+/**
+ * Tells whether a buffer is made only of zeros.
+ * @param buffer is the buffer to look at.
+ * @param size is the number of bytes of buffer.
+ * @returns TRUE if every byte of buffer is 0 (and size is not 0).
+ */
+extern gboolean is_zero_buffer(const guchar *buffer, gsize size);
+
+
+/**
+ * Removes zero hashs from a list (those blocks are never stored).
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @returns the list without those blocks (that are freed).
+ */
+extern GList *remove_zero_hashs(GList *hash_data_list);
+
+
+/**
+ * Makes the contiguous array of hashs of a meta_data_t structure from a
+ * list of hash_data_t * structures. Data (if any) is not copied.
+ * @param hash_data_list is a GList of hash_data_t * structures.
+ * @param[out] nb_hashs is the number of hashs in the returned array.
+ * @returns a newly allocated array of *nb_hashs * HASH_LEN bytes (NULL if
+ *          the list has no hash) that may be freed when no longer
+ *          needed.
+ */
+extern guint8 *make_hash_array_from_hash_data_list(GList *hash_data_list, guint64 *nb_hashs);
+
+
+/**
+ * Makes a list of hash_data_t * structures (with hashs only) from a
+ * contiguous array of hashs.
+ * @param hashs is an array of nb_hashs * HASH_LEN bytes.
+ * @param nb_hashs is the number of hashs in hashs.
+ * @returns a GList of hash_data_t * in the same order than the array.
+ */
+extern GList *make_hash_data_list_from_hash_array(guint8 *hashs, guint64 nb_hashs);
+
+
+/**
+ * Makes a contiguous array of hashs from a string containning base64
+ * encoded hashs separated by commas.
+ * @param hash_string the string containing base64 encoded hashs.
+ * @param[out] nb_hashs is the number of hashs in the returned array.
+ * @returns a newly allocated array of *nb_hashs * HASH_LEN bytes (NULL if
+ *          there is no hash) that may be freed when no longer needed.
+ */
+extern guint8 *make_hash_array_from_string(gchar *hash_string, guint64 *nb_hashs);
+
 #endif /* #ifndef _HASHS_H_ */
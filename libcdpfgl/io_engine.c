@@ -0,0 +1,577 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    io_engine.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file io_engine.c
+ *
+ * This file contains the functions of the asynchronous I/O engine. Each
+ * thread gets its own io_uring ring (a ring is not meant to be shared).
+ * If the kernel refuses to create a ring (too old, or forbidden as in
+ * some containers) no other ring is tried and GIO is used everywhere.
+ */
+
+#include "libcdpfgl.h"
+
+#ifdef HAVE_LIBURING
+static void free_thread_engine(gpointer data);
+static void reset_ring(io_engine_t *engine);
+static gboolean reap_one(io_engine_t *engine, guint64 *key, gint *result);
+static guint submit_and_reap(io_engine_t *engine, guint count, guint64 *keys, gint *results);
+
+
+/**
+ * The ring of each thread (created by get_io_engine()).
+ */
+static GPrivate thread_engine = G_PRIVATE_INIT(free_thread_engine);
+
+
+/**
+ * TRUE once the kernel refused to create a ring.
+ */
+static gint uring_refused = FALSE;
+
+
+/**
+ * @def IO_ENGINE_OP_BITS
+ * Number of low bits of the user data of a request that tell which
+ * request of a file it is (the other bits are the index of the file).
+ */
+#define IO_ENGINE_OP_BITS (2)
+
+/**
+ * @def IO_ENGINE_OP_WRITE
+ * The request writes the data of the file.
+ */
+#define IO_ENGINE_OP_WRITE (0)
+
+/**
+ * @def IO_ENGINE_OP_FSYNC
+ * The request fsync()s the file.
+ */
+#define IO_ENGINE_OP_FSYNC (1)
+
+/**
+ * @def IO_ENGINE_OP_CLOSE
+ * The request closes the file.
+ */
+#define IO_ENGINE_OP_CLOSE (2)
+
+
+/**
+ * Frees the ring of a thread when it exits.
+ * @param data is the io_engine_t * to be freed.
+ */
+static void free_thread_engine(gpointer data)
+{
+    io_engine_t *engine = (io_engine_t *) data;
+
+    if (engine != NULL)
+        {
+            if (engine->depth > 0)
+                {
+                    io_uring_queue_exit(&engine->ring);
+                }
+
+            free_variable(engine);
+        }
+}
+
+
+/**
+ * Drops the requests left in the submission queue by creating the ring
+ * again. If it can not be created the engine is broken (its depth is 0)
+ * and GIO is used by this thread from now on.
+ * @param engine is the ring of the calling thread.
+ */
+static void reset_ring(io_engine_t *engine)
+{
+    gint ret = 0;
+
+    io_uring_queue_exit(&engine->ring);
+    ret = io_uring_queue_init(IO_ENGINE_DEPTH, &engine->ring, 0);
+
+    if (ret < 0)
+        {
+            print_error(__FILE__, __LINE__, _("Error while creating io_uring ring again: %s\n"), g_strerror(-ret));
+            engine->depth = 0;
+        }
+}
+
+
+/**
+ * Waits for one completion.
+ * @param engine is the ring of the calling thread.
+ * @param[out] key is the user data of the completed request.
+ * @param[out] result is the result of the completed request.
+ * @returns FALSE if waiting failed, TRUE otherwise.
+ */
+static gboolean reap_one(io_engine_t *engine, guint64 *key, gint *result)
+{
+    struct io_uring_cqe *cqe = NULL;
+    gint ret = 0;
+
+    do
+        {
+            ret = io_uring_wait_cqe(&engine->ring, &cqe);
+        }
+    while (ret == -EINTR);
+
+    if (ret == 0)
+        {
+            *key = (guint64) GPOINTER_TO_SIZE(io_uring_cqe_get_data(cqe));
+            *result = cqe->res;
+            io_uring_cqe_seen(&engine->ring, cqe);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error while waiting for io_uring completions: %s\n"), g_strerror(-ret));
+        }
+
+    return (ret == 0);
+}
+
+
+/**
+ * Submits the requests prepared in the submission queue and waits for
+ * all of them to complete. When the kernel takes only a part of them
+ * the rest is submitted again once some requests completed. Requests
+ * that can not be submitted at all are dropped with the ring (see
+ * reset_ring()) so that no later submission runs them: they never ran
+ * and only the reaped ones have to be taken care of (closing their
+ * file descriptors for instance).
+ * @param engine is the ring of the calling thread.
+ * @param count is the number of requests prepared.
+ * @param[out] keys is an array of count user data of the completed
+ *             requests (in completion order).
+ * @param[out] results is an array of count results of the completed
+ *             requests (in the same order as keys).
+ * @returns the number of completed requests in keys and results (count
+ *          when everything went well).
+ */
+static guint submit_and_reap(io_engine_t *engine, guint count, guint64 *keys, gint *results)
+{
+    gint ret = 0;
+    guint submitted = 0;
+    guint done = 0;
+    gboolean ok = TRUE;
+
+    while (submitted < count && ok == TRUE)
+        {
+            ret = io_uring_submit(&engine->ring);
+
+            if (ret > 0)
+                {
+                    submitted = submitted + (guint) ret;
+                }
+            else if (ret == -EINTR)
+                {
+                    /* Tries again */
+                }
+            else if ((ret == 0 || ret == -EAGAIN || ret == -EBUSY) && done < submitted)
+                {
+                    /* The kernel is short of resources: a completion frees some */
+                    ok = reap_one(engine, &keys[done], &results[done]);
+
+                    if (ok == TRUE)
+                        {
+                            done++;
+                        }
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error while submitting %u io_uring requests: %s\n"), count - submitted, g_strerror(ret < 0 ? -ret : EAGAIN));
+                    ok = FALSE;
+                }
+        }
+
+    while (done < submitted && reap_one(engine, &keys[done], &results[done]) == TRUE)
+        {
+            done++;
+        }
+
+    if (done < count)
+        {
+            reset_ring(engine);
+        }
+
+    return done;
+}
+#endif
+
+
+/**
+ * Gets the ring of the calling thread. It is created at the first call
+ * and freed when the thread exits.
+ * @returns the io_engine_t * of the calling thread or NULL if io_uring
+ *          is not available (not compiled in or refused by the kernel):
+ *          GIO has then to be used.
+ */
+io_engine_t *get_io_engine(void)
+{
+    io_engine_t *engine = NULL;
+#ifdef HAVE_LIBURING
+    gint ret = 0;
+
+    engine = (io_engine_t *) g_private_get(&thread_engine);
+
+    if (engine == NULL && g_atomic_int_get(&uring_refused) == FALSE)
+        {
+            engine = (io_engine_t *) g_malloc0(sizeof(io_engine_t));
+            g_assert_nonnull(engine);
+
+            ret = io_uring_queue_init(IO_ENGINE_DEPTH, &engine->ring, 0);
+
+            if (ret < 0)
+                {
+                    print_debug(_("io_uring is not available (%s): using GIO\n"), g_strerror(-ret));
+                    g_atomic_int_set(&uring_refused, TRUE);
+                    free_variable(engine);
+                    engine = NULL;
+                }
+            else
+                {
+                    engine->depth = IO_ENGINE_DEPTH;
+                    g_private_set(&thread_engine, engine);
+                }
+        }
+
+    if (engine != NULL && engine->depth == 0)
+        {
+            /* The ring of this thread is broken */
+            engine = NULL;
+        }
+#endif
+
+    return engine;
+}
+
+
+/**
+ * Reads count blocks of size bytes that follow each other in a file
+ * from offset with one submission.
+ * @param engine is the ring of the calling thread.
+ * @param fd is the file descriptor of the file to read from.
+ * @param offset is the offset in the file of the first block.
+ * @param buffers is an array of count buffers of at least size bytes.
+ * @param size is the size of each block.
+ * @param count is the number of blocks to read (at most engine->depth).
+ * @param[out] lengths is an array of count results: the number of bytes
+ *             read into each buffer (0 at the end of the file) or
+ *             -errno.
+ * @returns FALSE if some requests could not be completed (their
+ *          lengths are then -errno), TRUE otherwise.
+ */
+gboolean io_engine_read_blocks(io_engine_t *engine, gint fd, guint64 offset, guchar **buffers, gsize size, guint count, gssize *lengths)
+{
+    gboolean ok = FALSE;
+    guint i = 0;
+#ifdef HAVE_LIBURING
+    struct io_uring_sqe *sqe = NULL;
+    guint64 keys[IO_ENGINE_DEPTH];
+    gint results[IO_ENGINE_DEPTH];
+    guint done = 0;
+#endif
+
+    for (i = 0; i < count; i++)
+        {
+            lengths[i] = -ENOSYS;
+        }
+
+#ifdef HAVE_LIBURING
+    if (engine != NULL && count > 0 && count <= engine->depth)
+        {
+            for (i = 0; i < count; i++)
+                {
+                    sqe = io_uring_get_sqe(&engine->ring);
+                    io_uring_prep_read(sqe, fd, buffers[i], size, offset + i * size);
+                    io_uring_sqe_set_data(sqe, GSIZE_TO_POINTER((gsize) i));
+                    lengths[i] = -EIO;
+                }
+
+            done = submit_and_reap(engine, count, keys, results);
+            ok = (done == count);
+
+            for (i = 0; i < done; i++)
+                {
+                    lengths[keys[i]] = results[i];
+                }
+        }
+#endif
+
+    return ok;
+}
+
+
+/**
+ * Writes whole files under temporary names (filename followed by a
+ * random suffix): files are created with one submission and then
+ * written, fsync()'ed if asked and closed with another one. A file
+ * never has its final name before io_engine_rename_files() is called:
+ * a crash of the process can not leave a truncated file under its name.
+ * Only with sync does this also hold when the system crashes.
+ * @param engine is the ring of the calling thread.
+ * @param writes is an array of count io_write_t structures. temp and
+ *        result of each of them are set.
+ * @param count is the number of files to write.
+ * @param sync is TRUE when each file has to be fsync()'ed before being
+ *        closed.
+ */
+void io_engine_write_files(io_engine_t *engine, io_write_t *writes, guint count, gboolean sync)
+{
+    guint i = 0;
+#ifdef HAVE_LIBURING
+    struct io_uring_sqe *sqe = NULL;
+    guint64 keys[IO_ENGINE_DEPTH];
+    gint results[IO_ENGINE_DEPTH];
+    gint *fds = NULL;
+    guint first = 0;
+    guint nb = 0;
+    guint done = 0;
+    guint per_file = sync == TRUE ? 3 : 2;
+    guint64 file = 0;
+    guint op = 0;
+    guint round = 0;
+#endif
+
+    for (i = 0; i < count; i++)
+        {
+            writes[i].temp = NULL;
+            writes[i].result = -ENOSYS;
+        }
+
+#ifdef HAVE_LIBURING
+    if (engine != NULL && engine->depth > 0 && count > 0)
+        {
+            fds = (gint *) g_malloc(count * sizeof(gint));
+
+            for (i = 0; i < count; i++)
+                {
+                    fds[i] = -EIO;
+                }
+
+            /* 1. Creates the temporary files (until the ring breaks if it does) */
+            for (first = 0; first < count && engine->depth > 0; first = first + nb)
+                {
+                    nb = MIN(engine->depth, count - first);
+
+                    for (i = first; i < first + nb; i++)
+                        {
+                            writes[i].temp = g_strdup_printf("%s.%08x.tmp", writes[i].filename, g_random_int());
+                            sqe = io_uring_get_sqe(&engine->ring);
+                            io_uring_prep_openat(sqe, AT_FDCWD, writes[i].temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+                            io_uring_sqe_set_data(sqe, GSIZE_TO_POINTER((gsize) i));
+                        }
+
+                    /* Files whose open did not complete never ran: they have no descriptor */
+                    done = submit_and_reap(engine, nb, keys, results);
+
+                    for (i = 0; i < done; i++)
+                        {
+                            fds[keys[i]] = results[i];
+                        }
+                }
+
+            /* 2. Writes, fsync()s and closes them: hard links run the close even if the write fails */
+            first = 0;
+
+            while (first < count)
+                {
+                    nb = 0;
+                    round = first;
+
+                    while (first < count && (engine->depth == 0 || nb + per_file <= engine->depth))
+                        {
+                            if (fds[first] >= 0 && engine->depth > 0)
+                                {
+                                    writes[first].result = 0;
+
+                                    sqe = io_uring_get_sqe(&engine->ring);
+                                    io_uring_prep_write(sqe, fds[first], writes[first].data, writes[first].length, 0);
+                                    io_uring_sqe_set_data(sqe, GSIZE_TO_POINTER(((gsize) first << IO_ENGINE_OP_BITS) | IO_ENGINE_OP_WRITE));
+                                    sqe->flags |= IOSQE_IO_HARDLINK;
+
+                                    if (sync == TRUE)
+                                        {
+                                            sqe = io_uring_get_sqe(&engine->ring);
+                                            io_uring_prep_fsync(sqe, fds[first], 0);
+                                            io_uring_sqe_set_data(sqe, GSIZE_TO_POINTER(((gsize) first << IO_ENGINE_OP_BITS) | IO_ENGINE_OP_FSYNC));
+                                            sqe->flags |= IOSQE_IO_HARDLINK;
+                                        }
+
+                                    sqe = io_uring_get_sqe(&engine->ring);
+                                    io_uring_prep_close(sqe, fds[first]);
+                                    io_uring_sqe_set_data(sqe, GSIZE_TO_POINTER(((gsize) first << IO_ENGINE_OP_BITS) | IO_ENGINE_OP_CLOSE));
+
+                                    nb = nb + per_file;
+                                }
+                            else if (fds[first] >= 0)
+                                {
+                                    /* The ring broke: this file is left unwritten */
+                                    close(fds[first]);
+                                    fds[first] = -EIO;
+                                    writes[first].result = -EIO;
+                                }
+                            else
+                                {
+                                    writes[first].result = fds[first];
+                                }
+
+                            first++;
+                        }
+
+                    done = 0;
+
+                    if (nb > 0)
+                        {
+                            done = submit_and_reap(engine, nb, keys, results);
+                        }
+
+                    for (i = 0; i < done; i++)
+                        {
+                            file = keys[i] >> IO_ENGINE_OP_BITS;
+                            op = (guint) (keys[i] & ((1 << IO_ENGINE_OP_BITS) - 1));
+
+                            if (op == IO_ENGINE_OP_CLOSE)
+                                {
+                                    /* Even a failed close releases the descriptor */
+                                    fds[file] = -EBADF;
+                                }
+
+                            if (results[i] < 0 && writes[file].result == 0)
+                                {
+                                    writes[file].result = results[i];
+                                }
+                            else if (op == IO_ENGINE_OP_WRITE && results[i] >= 0 && (gsize) results[i] != writes[file].length && writes[file].result == 0)
+                                {
+                                    /* Regular files are not written partially unless the disk is full */
+                                    writes[file].result = -ENOSPC;
+                                }
+                        }
+
+                    for (i = round; i < first; i++)
+                        {
+                            if (fds[i] >= 0)
+                                {
+                                    /* The close of this file did not complete: we can not tell whether it has been written */
+                                    close(fds[i]);
+                                    fds[i] = -EIO;
+
+                                    if (writes[i].result == 0)
+                                        {
+                                            writes[i].result = -EIO;
+                                        }
+                                }
+                        }
+                }
+
+            free_variable(fds);
+        }
+#endif
+}
+
+
+/**
+ * Renames files written by io_engine_write_files() whose result is 0
+ * to their final name. Temporary files of the other ones (failed writes
+ * or results set to an error by the caller) are removed. temp of every
+ * write is then freed.
+ * @param engine is the ring of the calling thread (may be NULL: files
+ *        are then renamed one by one).
+ * @param writes is an array of count io_write_t structures. result of
+ *        each renamed one is set.
+ * @param count is the number of files.
+ */
+void io_engine_rename_files(io_engine_t *engine, io_write_t *writes, guint count)
+{
+    guint i = 0;
+#ifdef HAVE_LIBURING
+    struct io_uring_sqe *sqe = NULL;
+    guint64 keys[IO_ENGINE_DEPTH];
+    gint results[IO_ENGINE_DEPTH];
+    guint first = 0;
+    guint nb = 0;
+    guint done = 0;
+    guint last = 0;
+
+    while (engine != NULL && engine->depth > 0 && first < count)
+        {
+            nb = 0;
+            last = first;
+
+            while (last < count && nb < engine->depth)
+                {
+                    if (writes[last].result == 0 && writes[last].temp != NULL)
+                        {
+                            sqe = io_uring_get_sqe(&engine->ring);
+                            io_uring_prep_renameat(sqe, AT_FDCWD, writes[last].temp, AT_FDCWD, writes[last].filename, 0);
+                            io_uring_sqe_set_data(sqe, GSIZE_TO_POINTER((gsize) last));
+                            /* Until the rename completes */
+                            writes[last].result = -EINPROGRESS;
+                            nb++;
+                        }
+
+                    last++;
+                }
+
+            if (nb > 0)
+                {
+                    done = submit_and_reap(engine, nb, keys, results);
+
+                    for (i = 0; i < done; i++)
+                        {
+                            writes[keys[i]].result = results[i];
+                        }
+                }
+
+            for (i = first; i < last; i++)
+                {
+                    if (writes[i].result == -EINPROGRESS)
+                        {
+                            /* This rename never ran (the ring broke): it is done below */
+                            writes[i].result = 0;
+                        }
+                    else if (writes[i].result == 0)
+                        {
+                            free_variable(writes[i].temp);
+                            writes[i].temp = NULL;
+                        }
+                }
+
+            first = last;
+        }
+#endif
+
+    for (i = 0; i < count; i++)
+        {
+            if (writes[i].result == 0 && writes[i].temp != NULL && g_rename(writes[i].temp, writes[i].filename) != 0)
+                {
+                    writes[i].result = -errno;
+                }
+
+            if (writes[i].result != 0 && writes[i].temp != NULL)
+                {
+                    g_unlink(writes[i].temp);
+                }
+
+            free_variable(writes[i].temp);
+            writes[i].temp = NULL;
+        }
+}
@@ -0,0 +1,137 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    io_engine.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file io_engine.h
+ *
+ * This file contains all the definitions of the asynchronous I/O engine.
+ * When liburing is available and the kernel accepts it, blocks are read
+ * and written with io_uring: many requests are submitted at once instead
+ * of one system call chain per block. Everything else (and everything
+ * when io_uring can not be used) goes through GIO as before.
+ */
+#ifndef _IO_ENGINE_H_
+#define _IO_ENGINE_H_
+
+
+/**
+ * @def IO_ENGINE_DEPTH
+ * Defines the number of entries of the submission queue of each ring.
+ * It is the maximum number of blocks read at once.
+ */
+#define IO_ENGINE_DEPTH (32)
+
+
+/**
+ * @def IO_ENGINE_READ_AHEAD
+ * Defines the maximum number of bytes read ahead at once by a block
+ * reader (at least one block is read).
+ */
+#define IO_ENGINE_READ_AHEAD (1048576)
+
+
+/**
+ * @struct io_engine_t
+ * @brief An io_uring ring. A ring must only be used by the thread that
+ *        owns it: get_io_engine() gives each thread its own ring.
+ */
+typedef struct
+{
+#ifdef HAVE_LIBURING
+    struct io_uring ring;  /**< the ring used to submit requests                        */
+#endif
+    guint depth;           /**< number of entries of the submission queue (0 if broken) */
+} io_engine_t;
+
+
+/**
+ * @struct io_write_t
+ * @brief A whole file to be written by io_engine_write_files().
+ */
+typedef struct
+{
+    gchar *filename;  /**< name of the file once io_engine_rename_files() is done       */
+    gchar *temp;      /**< temporary name the file is written under (owned by the engine) */
+    guchar *data;     /**< data to be written into the file                             */
+    gsize length;     /**< number of bytes of data                                      */
+    gint result;      /**< 0 when the file has been written (or renamed) or -errno      */
+} io_write_t;
+
+
+/**
+ * Gets the ring of the calling thread. It is created at the first call
+ * and freed when the thread exits.
+ * @returns the io_engine_t * of the calling thread or NULL if io_uring
+ *          is not available (not compiled in or refused by the kernel):
+ *          GIO has then to be used.
+ */
+extern io_engine_t *get_io_engine(void);
+
+
+/**
+ * Reads count blocks of size bytes that follow each other in a file
+ * from offset with one submission.
+ * @param engine is the ring of the calling thread.
+ * @param fd is the file descriptor of the file to read from.
+ * @param offset is the offset in the file of the first block.
+ * @param buffers is an array of count buffers of at least size bytes.
+ * @param size is the size of each block.
+ * @param count is the number of blocks to read (at most engine->depth).
+ * @param[out] lengths is an array of count results: the number of bytes
+ *             read into each buffer (0 at the end of the file) or
+ *             -errno.
+ * @returns FALSE if some requests could not be completed (their
+ *          lengths are then -errno), TRUE otherwise.
+ */
+extern gboolean io_engine_read_blocks(io_engine_t *engine, gint fd, guint64 offset, guchar **buffers, gsize size, guint count, gssize *lengths);
+
+
+/**
+ * Writes whole files under temporary names (filename followed by a
+ * random suffix): files are created with one submission and then
+ * written, fsync()'ed if asked and closed with another one. A file
+ * never has its final name before io_engine_rename_files() is called:
+ * a crash of the process can not leave a truncated file under its name.
+ * Only with sync does this also hold when the system crashes.
+ * @param engine is the ring of the calling thread.
+ * @param writes is an array of count io_write_t structures. temp and
+ *        result of each of them are set.
+ * @param count is the number of files to write.
+ * @param sync is TRUE when each file has to be fsync()'ed before being
+ *        closed.
+ */
+extern void io_engine_write_files(io_engine_t *engine, io_write_t *writes, guint count, gboolean sync);
+
+
+/**
+ * Renames files written by io_engine_write_files() whose result is 0
+ * to their final name. Temporary files of the other ones (failed writes
+ * or results set to an error by the caller) are removed. temp of every
+ * write is then freed.
+ * @param engine is the ring of the calling thread (may be NULL: files
+ *        are then renamed one by one).
+ * @param writes is an array of count io_write_t structures. result of
+ *        each renamed one is set.
+ * @param count is the number of files.
+ */
+extern void io_engine_rename_files(io_engine_t *engine, io_write_t *writes, guint count);
+
+#endif /* #ifndef _IO_ENGINE_H_ */
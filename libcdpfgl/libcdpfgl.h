@@ -46,20 +46,35 @@
 #include <glib.h>
 #include <gio/gio.h>
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 #include <sqlite3.h>
 #include <jansson.h>
 #include <curl/curl.h>
 #include <ctype.h>
 #include <zlib.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LIBURING
+#include <fcntl.h>
+#include <liburing.h>
+#endif
 
 #include "configuration.h"
 #include "files.h"
+#include "buffer_pool.h"
+#include "io_engine.h"
+#include "chunking.h"
 #include "hashs.h"
+#include "sha256.h"
 #include "communique.h"
 #include "database.h"
 #include "packing.h"
 #include "query.h"
-#include "clock.h"
+#include "trace.h"
 #include "compress.h"
 #include "options.h"
 
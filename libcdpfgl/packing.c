@@ -34,6 +34,7 @@ static void insert_guint64_into_json_root(json_t *root, gchar *keyname, guint64
 static void insert_gshort_into_json_root(json_t *root, gchar *keyname, gshort number);
 static json_t *create_json_code(guint32 http_code, gchar *message);
 static json_t *create_json_answer(gchar *type, guint32 http_code, gchar *message);
+static gchar *encode_to_base64_in_pool(buffer_pool_t *pool, const guchar *data, gsize len);
 
 
 /**
@@ -244,6 +245,31 @@ json_t *convert_hash_list_to_json(GList *hash_list)
 }
 
 
+/**
+ * Converts a contiguous array of hashs to a json_t * array
+ * @param hashs is an array of nb_hashs * HASH_LEN bytes.
+ * @param nb_hashs is the number of hashs in hashs.
+ * @returns a json_t * array with the base64 encoded hashs in it (if any).
+ */
+json_t *convert_hash_array_to_json(guint8 *hashs, guint64 nb_hashs)
+{
+    json_t *array = NULL;
+    gchar *encoded_hash = NULL;
+    guint64 i = 0;
+
+    array = json_array();
+
+    for (i = 0; hashs != NULL && i < nb_hashs; i++)
+        {
+            encoded_hash = g_base64_encode(hashs + i * HASH_LEN, HASH_LEN);
+            append_string_to_array(array, encoded_hash);
+            free_variable(encoded_hash);
+        }
+
+    return array;
+}
+
+
 /**
  * Converts the file list (a list of gchar *) to a json_t * array
  * @param file_list : the GSList * list of hashs
@@ -296,10 +322,38 @@ gchar *convert_file_list_to_json_string(GSList *file_list)
 }
 
 
+/**
+ * Base64 encodes data into a buffer of the pool.
+ * @param pool is the pool of buffers where to take the buffer from.
+ * @param data is the data to be encoded.
+ * @param len is the number of bytes of data.
+ * @returns a \0 terminated base64 string that must be released to pool.
+ */
+static gchar *encode_to_base64_in_pool(buffer_pool_t *pool, const guchar *data, gsize len)
+{
+    gchar *encoded = NULL;
+    gsize size = 0;
+    gint state = 0;
+    gint save = 0;
+
+    /* g_base64_encode_step() and g_base64_encode_close() need at most
+     * (len / 3 + 1) * 4 + 4 bytes plus one for the final \0
+     */
+    encoded = (gchar *) buffer_pool_alloc(pool, (len / 3 + 1) * 4 + 5);
+
+    size = g_base64_encode_step(data, len, FALSE, encoded, &state, &save);
+    size = size + g_base64_encode_close(FALSE, encoded + size, &state, &save);
+    encoded[size] = '\0';
+
+    return encoded;
+}
+
+
 /**
  * Converts hash_data_t structure to a json_t * structure
  * @param hash_data the hash_data_t structure that contains the data to
- *        be converted.
+ *        be converted. When it comes from a pool, base64 strings are
+ *        encoded in buffers of that pool.
  * @returns a json_t * structure with informations of hash_data in it
  */
 json_t *convert_hash_data_t_to_json(hash_data_t *hash_data)
@@ -310,8 +364,16 @@ json_t *convert_hash_data_t_to_json(hash_data_t *hash_data)
 
     if (hash_data != NULL && hash_data->data != NULL && hash_data->hash != NULL && hash_data->read >= 0)
         {
-            encoded_data = g_base64_encode((guchar*) hash_data->data, hash_data->read);
-            encoded_hash = g_base64_encode((guchar*) hash_data->hash, HASH_LEN);
+            if (hash_data->pool != NULL)
+                {
+                    encoded_data = encode_to_base64_in_pool(hash_data->pool, hash_data->data, hash_data->read);
+                    encoded_hash = encode_to_base64_in_pool(hash_data->pool, hash_data->hash, HASH_LEN);
+                }
+            else
+                {
+                    encoded_data = g_base64_encode((guchar*) hash_data->data, hash_data->read);
+                    encoded_hash = g_base64_encode((guchar*) hash_data->hash, HASH_LEN);
+                }
 
             root = json_object();
             insert_string_into_json_root(root, "hash", encoded_hash);
@@ -319,8 +381,17 @@ json_t *convert_hash_data_t_to_json(hash_data_t *hash_data)
             insert_guint64_into_json_root(root, "size", hash_data->read);
             insert_gshort_into_json_root(root, "cmptype", hash_data->cmptype);
             insert_guint64_into_json_root(root, "uncmpsize", hash_data->uncmplen);
-            free_variable(encoded_data);
-            free_variable(encoded_hash);
+
+            if (hash_data->pool != NULL)
+                {
+                    buffer_pool_release(hash_data->pool, encoded_data);
+                    buffer_pool_release(hash_data->pool, encoded_hash);
+                }
+            else
+                {
+                    free_variable(encoded_data);
+                    free_variable(encoded_hash);
+                }
         }
 
     return root;
@@ -392,7 +463,7 @@ json_t *convert_meta_data_to_json(meta_data_t *meta, const gchar *hostname, gboo
             insert_string_into_json_root(root, "hostname", (gchar *) hostname);
             insert_boolean_into_json_root(root, "data_sent", data_sent);
 
-            array = convert_hash_list_to_json(meta->hash_data_list);
+            array = convert_hash_array_to_json(meta->hashs, meta->nb_hashs);
 
             insert_json_value_into_json_root(root, "hash_list", array);
         }
@@ -464,15 +535,18 @@ json_t *convert_meta_data_list_to_json_array(GList *list, gchar *hostname, gbool
  * @param version : version of the program.
  * @param authors : authors that contributed to this program
  * @param license : license in use for this program and its sources
+ * @param epoch : epoch of the store of the server (changes when blocks
+ *        may have been deleted) or NULL if the backend has none.
  * @returns a newlly allocated gchar * string in json format that can be
  *          freed when no longer needed.
  */
-gchar *convert_version_to_json(gchar *name, gchar *date, gchar *version, gchar *authors, gchar *license)
+gchar *convert_version_to_json(gchar *name, gchar *date, gchar *version, gchar *authors, gchar *license, gchar *epoch)
 {
     json_t *root = NULL;    /** json_t *root is the root that will contain all data in json format     */
     json_t *libs = NULL;    /** json_t *libs is the array that will contain all libraries and versions */
     json_t *auths = NULL;   /** json_t *auths is the array containing all authors                      */
     json_t *objs = NULL;    /** json_t *objs will store version of libraries                           */
+    json_t *protos = NULL;  /** json_t *protos is the array of protocols understood                    */
     gchar *buffer = NULL;
     gchar *json_str = NULL; /** gchar *json_str is the string to be returned at the end                */
 
@@ -485,6 +559,11 @@ gchar *convert_version_to_json(gchar *name, gchar *date, gchar *version, gchar *
     insert_string_into_json_root(root, "revision", REVISION);
     insert_string_into_json_root(root, "licence", license);
 
+    if (epoch != NULL)
+        {
+            insert_string_into_json_root(root, "epoch", epoch);
+        }
+
     /**
      * @todo use g_strsplit to split authors string if more than one author
      * is in the string.
@@ -532,8 +611,41 @@ gchar *convert_version_to_json(gchar *name, gchar *date, gchar *version, gchar *
     json_array_append_new(libs, objs);
     free_variable(buffer);
 
+#ifdef HAVE_LZ4
+    /* lz4 */
+    buffer = g_strdup_printf("%s", LZ4_versionString());
+    objs = json_object();
+    json_object_set_new(objs, "lz4", json_string(buffer));
+    json_array_append_new(libs, objs);
+    free_variable(buffer);
+#endif
+
+#ifdef HAVE_ZSTD
+    /* zstd */
+    buffer = g_strdup_printf("%s", ZSTD_versionString());
+    objs = json_object();
+    json_object_set_new(objs, "zstd", json_string(buffer));
+    json_array_append_new(libs, objs);
+    free_variable(buffer);
+#endif
+
     insert_json_value_into_json_root(root, "librairies", libs);
 
+    /* protocols that clients may use with this server */
+    protos = json_array();
+    json_array_append_new(protos, json_string("Data_Array.json"));
+    json_array_append_new(protos, json_string(PROTOCOL_DATA_ARRAY_BIN));
+    json_array_append_new(protos, json_string(PROTOCOL_META_ARRAY_JSON));
+    json_array_append_new(protos, json_string(PROTOCOL_HASH_ARRAY_BIN));
+    json_array_append_new(protos, json_string(PROTOCOL_FILE_ARCHIVE_BIN));
+#ifdef HAVE_LZ4
+    json_array_append_new(protos, json_string(PROTOCOL_LZ4));
+#endif
+#ifdef HAVE_ZSTD
+    json_array_append_new(protos, json_string(PROTOCOL_ZSTD));
+#endif
+    insert_json_value_into_json_root(root, "protocols", protos);
+
     json_str = json_dumps(root, 0);
 
     json_decref(root);
@@ -670,3 +782,67 @@ json_t *make_json_from_stats(gchar *title, guint64 nb_request)
 
     return stats;
 }
+
+
+/**
+ * Puts a guint16 value into buffer in little endian order
+ * @param[out] buffer is the buffer where to put the value (2 bytes long
+ *             at least)
+ * @param value the value to put into buffer
+ */
+void put_guint16_into_buffer(guint8 *buffer, guint16 value)
+{
+    value = GUINT16_TO_LE(value);
+    memcpy(buffer, &value, sizeof(guint16));
+}
+
+
+/**
+ * Puts a guint32 value into buffer in little endian order
+ * @param[out] buffer is the buffer where to put the value (4 bytes long
+ *             at least)
+ * @param value the value to put into buffer
+ */
+void put_guint32_into_buffer(guint8 *buffer, guint32 value)
+{
+    value = GUINT32_TO_LE(value);
+    memcpy(buffer, &value, sizeof(guint32));
+}
+
+
+/**
+ * Puts a guint64 value into buffer in little endian order
+ * @param[out] buffer is the buffer where to put the value (8 bytes long
+ *             at least)
+ * @param value the value to put into buffer
+ */
+void put_guint64_into_buffer(guint8 *buffer, guint64 value)
+{
+    value = GUINT64_TO_LE(value);
+    memcpy(buffer, &value, sizeof(guint64));
+}
+
+
+/**
+ * Appends one hash_data_t structure to a binary data array (the body
+ * of a /Data_Array.bin request): a BIN_DATA_ARRAY_HEADER_SIZE header
+ * followed by the raw data.
+ * @param array is the GByteArray to append to.
+ * @param hash_data is the hash_data_t structure to append (not freed).
+ */
+void append_hash_data_t_to_binary_array(GByteArray *array, hash_data_t *hash_data)
+{
+    guint8 header[BIN_DATA_ARRAY_HEADER_SIZE];
+
+    if (array != NULL && hash_data != NULL && hash_data->data != NULL && hash_data->hash != NULL && hash_data->read >= 0)
+        {
+            memset(header, 0, BIN_DATA_ARRAY_HEADER_SIZE);
+            memcpy(header, hash_data->hash, HASH_LEN);
+            put_guint16_into_buffer(header + HASH_LEN, (guint16) hash_data->cmptype);
+            put_guint64_into_buffer(header + HASH_LEN + 4, (guint64) hash_data->uncmplen);
+            put_guint64_into_buffer(header + HASH_LEN + 12, (guint64) hash_data->read);
+
+            g_byte_array_append(array, header, BIN_DATA_ARRAY_HEADER_SIZE);
+            g_byte_array_append(array, hash_data->data, hash_data->read);
+        }
+}
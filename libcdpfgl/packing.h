@@ -66,6 +66,115 @@
 #define ENC_END (127)
 
 
+/**
+ * @def BIN_DATA_ARRAY_HEADER_SIZE
+ * Size of the header of one block in a /Data_Array.bin request. Numbers
+ * are little endian: hash (HASH_LEN), cmptype (2), padding (2),
+ * uncmplen (8) and length (8). The header is followed by length bytes
+ * of raw data.
+ */
+#define BIN_DATA_ARRAY_HEADER_SIZE (HASH_LEN + 2 + 2 + 8 + 8)
+
+
+/**
+ * @def PROTOCOL_DATA_ARRAY_BIN
+ * Name of the binary data array protocol as advertised by the server in
+ * the "protocols" array of its version answer.
+ */
+#define PROTOCOL_DATA_ARRAY_BIN ("Data_Array.bin")
+
+
+/**
+ * @def PROTOCOL_META_ARRAY_JSON
+ * Name of the protocol that lets clients send meta data of many files
+ * in one /Meta_Array.json request.
+ */
+#define PROTOCOL_META_ARRAY_JSON ("Meta_Array.json")
+
+
+/**
+ * @def PROTOCOL_HASH_ARRAY_BIN
+ * Name of the protocol that lets clients get the data of many hashs in
+ * one /Data/Hash_Array.bin request. The answer is a binary data array
+ * (the same format as /Data_Array.bin) of uncompressed blocks that
+ * the server streams.
+ */
+#define PROTOCOL_HASH_ARRAY_BIN ("Hash_Array.bin")
+
+
+/**
+ * @def PROTOCOL_FILE_ARCHIVE_BIN
+ * Name of the protocol that lets clients get in one /File/Archive.bin
+ * request the meta data and the blocks of every file that a query
+ * finds. The answer is a binary data array where meta data records
+ * (ARCHIVE_META_TYPE) are followed by the uncompressed blocks of the
+ * file. It ends with an ARCHIVE_END_TYPE record.
+ */
+#define PROTOCOL_FILE_ARCHIVE_BIN ("File_Archive.bin")
+
+
+/**
+ * @def ARCHIVE_META_TYPE
+ * cmptype of an archive record whose data is the JSON meta data of the
+ * file whose blocks follow (its hash is made of zeros).
+ *
+ * @def ARCHIVE_MISSING_TYPE
+ * cmptype of an (empty) archive record telling that the server does not
+ * have the block of this hash.
+ *
+ * @def ARCHIVE_END_TYPE
+ * cmptype of the (empty) last record of an archive. An archive that
+ * does not end with it has been truncated.
+ */
+#define ARCHIVE_META_TYPE (256)
+#define ARCHIVE_MISSING_TYPE (257)
+#define ARCHIVE_END_TYPE (258)
+
+
+/**
+ * @def PROTOCOL_LZ4
+ * Advertised by servers that are able to uncompress COMPRESS_LZ4_TYPE
+ * blocks.
+ */
+#define PROTOCOL_LZ4 ("lz4")
+
+
+/**
+ * @def PROTOCOL_ZSTD
+ * Advertised by servers that are able to uncompress COMPRESS_ZSTD_TYPE
+ * blocks.
+ */
+#define PROTOCOL_ZSTD ("zstd")
+
+
+/**
+ * @def BIN_DATA_ARRAY_MAX_BLOCK_SIZE
+ * Maximum length of one block accepted in a binary data array. Anything
+ * bigger is considered as a malformed request.
+ */
+#define BIN_DATA_ARRAY_MAX_BLOCK_SIZE (67108864)
+
+
+/**
+ * @struct binary_array_decoder_t
+ * @brief Incremental decoder of a binary data array.
+ *
+ * Data is fed as it arrives (for instance from libmicrohttpd's upload
+ * callback) and complete blocks are given back as soon as their last
+ * byte is received. Memory used is bounded by the size of one block.
+ */
+typedef struct
+{
+    guint8 header[BIN_DATA_ARRAY_HEADER_SIZE]; /**< header of the block being decoded          */
+    guint64 header_pos;                        /**< number of header bytes already received    */
+    guchar *data;                              /**< data of the block being decoded (or NULL)  */
+    guint64 data_len;                          /**< length of data as told by the header       */
+    guint64 data_pos;                          /**< number of data bytes already received      */
+    guint64 nb_blocks;                         /**< number of blocks decoded so far            */
+    gboolean error;                            /**< TRUE when a malformed header was found     */
+} binary_array_decoder_t;
+
+
 /**
  * This function loads a JSON string into a json_t struture
  * @param json_str is the json string
@@ -152,6 +261,15 @@ extern gchar *get_string_from_json_root(json_t *root, gchar *keyname);
 extern json_t *convert_hash_list_to_json(GList *hash_list);
 
 
+/**
+ * Converts a contiguous array of hashs to a json_t * array
+ * @param hashs is an array of nb_hashs * HASH_LEN bytes.
+ * @param nb_hashs is the number of hashs in hashs.
+ * @returns a json_t * array with the base64 encoded hashs in it (if any).
+ */
+extern json_t *convert_hash_array_to_json(guint8 *hashs, guint64 nb_hashs);
+
+
 /**
  * Converts the file list to a json_t * array
  * @param file_list : the GSList * list of hashs
@@ -194,6 +312,18 @@ extern json_t *convert_meta_data_list_to_json_array(GList *list, gchar *hostname
 GList *extract_glist_from_array(json_t *root, gchar *name, gboolean only_hash);
 
 
+/**
+ * This function returns a contiguous array of hashs from a json array
+ * of base64 encoded hashs.
+ * @param root is the root json string that may contain an array named "name"
+ * @param name is the name of the array to look for into
+ * @param[out] nb_hashs is the number of hashs in the returned array.
+ * @returns a newly allocated array of *nb_hashs * HASH_LEN bytes (NULL if
+ *          there is no hash) that may be freed when no longer needed.
+ */
+guint8 *extract_hash_array_from_json(json_t *root, gchar *name, guint64 *nb_hashs);
+
+
 /**
  * This function returns a list from an json array.
  * @param root is the root json string that must contain an array named
@@ -322,10 +452,12 @@ extern gchar *get_json_version(gchar *json_str);
  * @param version : version of the program.
  * @param authors : authors that contributed to this program
  * @param license : license in use for this program and its sources
+ * @param epoch : epoch of the store of the server (changes when blocks
+ *        may have been deleted) or NULL if the backend has none.
  * @returns a newlly allocated gchar * string in json format that can be
  *          freed when no longer needed.
  */
-extern gchar *convert_version_to_json(gchar *name, gchar *date, gchar *version, gchar *authors, gchar *license);
+extern gchar *convert_version_to_json(gchar *name, gchar *date, gchar *version, gchar *authors, gchar *license, gchar *epoch);
 
 
 /**
@@ -370,4 +502,131 @@ extern gchar *answer_json_success_string(guint32 error_code, gchar *message);
  */
 extern json_t *make_json_from_stats(gchar *title, guint64 nb_request);
 
+
+/**
+ * Puts a guint16 value into buffer in little endian order
+ * @param[out] buffer is the buffer where to put the value (2 bytes long
+ *             at least)
+ * @param value the value to put into buffer
+ */
+extern void put_guint16_into_buffer(guint8 *buffer, guint16 value);
+
+
+/**
+ * Puts a guint32 value into buffer in little endian order
+ * @param[out] buffer is the buffer where to put the value (4 bytes long
+ *             at least)
+ * @param value the value to put into buffer
+ */
+extern void put_guint32_into_buffer(guint8 *buffer, guint32 value);
+
+
+/**
+ * Puts a guint64 value into buffer in little endian order
+ * @param[out] buffer is the buffer where to put the value (8 bytes long
+ *             at least)
+ * @param value the value to put into buffer
+ */
+extern void put_guint64_into_buffer(guint8 *buffer, guint64 value);
+
+
+/**
+ * @param buffer is the buffer where to read the value from.
+ * @returns the guint16 little endian value read from buffer
+ */
+extern guint16 get_guint16_from_buffer(guint8 *buffer);
+
+
+/**
+ * @param buffer is the buffer where to read the value from.
+ * @returns the guint32 little endian value read from buffer
+ */
+extern guint32 get_guint32_from_buffer(guint8 *buffer);
+
+
+/**
+ * @param buffer is the buffer where to read the value from.
+ * @returns the guint64 little endian value read from buffer
+ */
+extern guint64 get_guint64_from_buffer(guint8 *buffer);
+
+
+/**
+ * Appends one hash_data_t structure to a binary data array (the body
+ * of a /Data_Array.bin request): a BIN_DATA_ARRAY_HEADER_SIZE header
+ * followed by the raw data.
+ * @param array is the GByteArray to append to.
+ * @param hash_data is the hash_data_t structure to append (not freed).
+ */
+extern void append_hash_data_t_to_binary_array(GByteArray *array, hash_data_t *hash_data);
+
+
+/**
+ * Extracts a list of hash_data_t structures from a binary data array
+ * (the body of a /Data_Array.bin request).
+ * @param buffer is the binary data array.
+ * @param length is the length in bytes of buffer.
+ * @param[out] valid is set to FALSE if buffer is truncated or malformed
+ *             and to TRUE otherwise.
+ * @returns a GList of newly allocated hash_data_t structures that were
+ *          successfully extracted (may be NULL).
+ */
+extern GList *extract_glist_from_binary_array(guchar *buffer, guint64 length, gboolean *valid);
+
+
+/**
+ * Creates a new incremental binary data array decoder
+ * @returns a newly allocated binary_array_decoder_t structure that may
+ *          be freed with free_binary_array_decoder_t() when no longer
+ *          needed.
+ */
+extern binary_array_decoder_t *new_binary_array_decoder_t(void);
+
+
+/**
+ * Frees a binary_array_decoder_t structure (and an incomplete block
+ * if any)
+ * @param decoder is the decoder to be freed.
+ */
+extern void free_binary_array_decoder_t(binary_array_decoder_t *decoder);
+
+
+/**
+ * Feeds the decoder with some bytes of a binary data array.
+ * @param decoder is the decoder to feed.
+ * @param buffer is the received bytes.
+ * @param length is the number of bytes in buffer.
+ * @returns a GList of newly allocated hash_data_t structures: the blocks
+ *          that are complete with those bytes (may be NULL).
+ */
+extern GList *feed_binary_array_decoder(binary_array_decoder_t *decoder, const guchar *buffer, gsize length);
+
+
+/**
+ * @param decoder is the decoder.
+ * @returns TRUE if everything fed to the decoder was made of complete
+ *          and valid blocks, FALSE otherwise.
+ */
+extern gboolean is_binary_array_decoder_complete(binary_array_decoder_t *decoder);
+
+
+/**
+ * Tells whether a version json string (as returned by the server)
+ * advertises a protocol in its "protocols" array.
+ * @param json_str : a gchar * containing the JSON formated string.
+ * @param protocol is the name of the protocol to look for.
+ * @returns TRUE if protocol is advertised, FALSE otherwise.
+ */
+extern gboolean get_json_protocol(gchar *json_str, gchar *protocol);
+
+
+/**
+ * Gets the epoch of the store of the server from a version json string
+ * as returned by the server.
+ * @param json_str : a gchar * containing the JSON formated string.
+ * @returns a newly allocated epoch string or NULL (older servers and
+ *          backends without any epoch).
+ */
+extern gchar *get_json_epoch(gchar *json_str);
+
 #endif /* #ifndef _PACKING_H_ */
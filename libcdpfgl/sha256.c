@@ -0,0 +1,318 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    sha256.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file sha256.c
+ *
+ * SHA256 compression functions that use the processor's SHA256
+ * instructions. The code is compiled with a target attribute so that
+ * the whole program does not require these instructions: they are only
+ * used after the processor has been asked whether it has them.
+ */
+
+#include "libcdpfgl.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256_X86 (1)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#define SHA256_ARM (1)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_neon.h>
+#endif
+
+#if defined(SHA256_X86)
+static gboolean x86_has_sha(void);
+static void sha256_x86_compress(guint32 *state, const guint8 *data, gsize blocks);
+#endif
+#if defined(SHA256_ARM)
+static void sha256_arm_compress(guint32 *state, const guint8 *data, gsize blocks);
+#endif
+
+
+/**
+ * SHA256 round constants (FIPS 180-4).
+ */
+static const guint32 sha256_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/**
+ * SHA256 initial state (FIPS 180-4).
+ */
+static const guint32 sha256_init[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+
+#if defined(SHA256_X86)
+/**
+ * @returns TRUE if the processor has the SHA extensions (and SSSE3 and
+ *          SSE4.1 that the implementation also uses).
+ */
+static gboolean x86_has_sha(void)
+{
+    guint eax = 0;
+    guint ebx = 0;
+    guint ecx = 0;
+    guint edx = 0;
+    gboolean sse = FALSE;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0)
+        {
+            /* SSSE3 is bit 9 and SSE4.1 bit 19 of ecx */
+            sse = ((ecx & (1 << 9)) != 0) && ((ecx & (1 << 19)) != 0);
+        }
+
+    if (sse == TRUE && __get_cpuid_max(0, NULL) >= 7)
+        {
+            /* SHA is bit 29 of ebx of leaf 7 */
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            return ((ebx & (1 << 29)) != 0);
+        }
+
+    return FALSE;
+}
+
+
+/**
+ * SHA256 compression function with x86 SHA extensions. The state is
+ * kept in the ABEF / CDGH layout that sha256rnds2 expects.
+ * @param state is the SHA256 state (8 words: a, b, c, d, e, f, g, h).
+ * @param data is the data to process (blocks * SHA256_BLOCK_LEN bytes).
+ * @param blocks is the number of blocks to process.
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_x86_compress(guint32 *state, const guint8 *data, gsize blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0;
+    __m128i state1;
+    __m128i abef;
+    __m128i cdgh;
+    __m128i tmp;
+    __m128i msg[4];
+    guint g = 0;
+
+    tmp = _mm_loadu_si128((const __m128i *) &state[0]);
+    state1 = _mm_loadu_si128((const __m128i *) &state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);               /* CDAB */
+    state1 = _mm_shuffle_epi32(state1, 0x1B);         /* EFGH */
+    state0 = _mm_alignr_epi8(tmp, state1, 8);         /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);      /* CDGH */
+
+    while (blocks > 0)
+        {
+            abef = state0;
+            cdgh = state1;
+
+            for (g = 0; g < 16; g++)
+                {
+                    if (g < 4)
+                        {
+                            msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16 * g)), mask);
+                        }
+                    else
+                        {
+                            /* W[t] = s1(W[t-2]) + W[t-7] + s0(W[t-15]) + W[t-16] four words at a time */
+                            tmp = _mm_sha256msg1_epu32(msg[g & 3], msg[(g - 3) & 3]);
+                            tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(msg[(g - 1) & 3], msg[(g - 2) & 3], 4));
+                            msg[g & 3] = _mm_sha256msg2_epu32(tmp, msg[(g - 1) & 3]);
+                        }
+
+                    tmp = _mm_add_epi32(msg[g & 3], _mm_loadu_si128((const __m128i *) &sha256_k[4 * g]));
+                    state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+                    tmp = _mm_shuffle_epi32(tmp, 0x0E);
+                    state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);
+                }
+
+            state0 = _mm_add_epi32(state0, abef);
+            state1 = _mm_add_epi32(state1, cdgh);
+
+            data = data + SHA256_BLOCK_LEN;
+            blocks--;
+        }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);            /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);         /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);      /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);         /* HGFE */
+
+    _mm_storeu_si128((__m128i *) &state[0], state0);
+    _mm_storeu_si128((__m128i *) &state[4], state1);
+}
+#endif
+
+
+#if defined(SHA256_ARM)
+/**
+ * SHA256 compression function with ARMv8 cryptographic extensions.
+ * @param state is the SHA256 state (8 words: a, b, c, d, e, f, g, h).
+ * @param data is the data to process (blocks * SHA256_BLOCK_LEN bytes).
+ * @param blocks is the number of blocks to process.
+ */
+__attribute__((target("+crypto")))
+static void sha256_arm_compress(guint32 *state, const guint8 *data, gsize blocks)
+{
+    uint32x4_t state0;
+    uint32x4_t state1;
+    uint32x4_t abcd;
+    uint32x4_t efgh;
+    uint32x4_t tmp;
+    uint32x4_t save;
+    uint32x4_t msg[4];
+    guint g = 0;
+
+    state0 = vld1q_u32(&state[0]);
+    state1 = vld1q_u32(&state[4]);
+
+    while (blocks > 0)
+        {
+            abcd = state0;
+            efgh = state1;
+
+            for (g = 0; g < 16; g++)
+                {
+                    if (g < 4)
+                        {
+                            msg[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * g)));
+                        }
+                    else
+                        {
+                            msg[g & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[g & 3], msg[(g - 3) & 3]), msg[(g - 2) & 3], msg[(g - 1) & 3]);
+                        }
+
+                    tmp = vaddq_u32(msg[g & 3], vld1q_u32(&sha256_k[4 * g]));
+                    save = state0;
+                    state0 = vsha256hq_u32(state0, state1, tmp);
+                    state1 = vsha256h2q_u32(state1, save, tmp);
+                }
+
+            state0 = vaddq_u32(state0, abcd);
+            state1 = vaddq_u32(state1, efgh);
+
+            data = data + SHA256_BLOCK_LEN;
+            blocks--;
+        }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+#endif
+
+
+/**
+ * Looks for an accelerated SHA256 compression function usable on this
+ * processor.
+ * @param[out] name is the name of the implementation found if any.
+ * @returns the compression function or NULL if the processor has no
+ *          instruction dedicated to SHA256 (or if the program has been
+ *          compiled for a processor where we do not know them).
+ */
+sha256_compress_func sha256_get_accelerated_compress(const gchar **name)
+{
+#if defined(SHA256_X86)
+    if (x86_has_sha() == TRUE)
+        {
+            *name = "x86 SHA extensions";
+            return sha256_x86_compress;
+        }
+#endif
+
+#if defined(SHA256_ARM)
+    if ((getauxval(AT_HWCAP) & HWCAP_SHA2) != 0)
+        {
+            *name = "ARMv8 cryptographic extensions";
+            return sha256_arm_compress;
+        }
+#endif
+
+    *name = NULL;
+
+    return NULL;
+}
+
+
+/**
+ * Calculates the SHA256 digest of a buffer with a compression function.
+ * Whole blocks are processed directly from buffer, only the last one
+ * (with the padding) is copied.
+ * @param compress is the compression function to use.
+ * @param buffer is the buffer to hash.
+ * @param size is the number of bytes of buffer.
+ * @param[out] digest is where the HASH_LEN bytes digest is written.
+ */
+void sha256_digest(sha256_compress_func compress, const guchar *buffer, gsize size, guint8 *digest)
+{
+    guint32 state[8];
+    guint8 last[2 * SHA256_BLOCK_LEN];
+    gsize blocks = size / SHA256_BLOCK_LEN;
+    gsize rest = size % SHA256_BLOCK_LEN;
+    gsize padded = SHA256_BLOCK_LEN;
+    guint64 bits = (guint64) size * 8;
+    guint i = 0;
+
+    memcpy(state, sha256_init, sizeof(state));
+
+    if (blocks > 0)
+        {
+            compress(state, buffer, blocks);
+        }
+
+    /* padding: 0x80, zeros and the length in bits (big endian) */
+    memset(last, 0, sizeof(last));
+    memcpy(last, buffer + blocks * SHA256_BLOCK_LEN, rest);
+    last[rest] = 0x80;
+
+    if (rest >= SHA256_BLOCK_LEN - 8)
+        {
+            padded = 2 * SHA256_BLOCK_LEN;
+        }
+
+    for (i = 0; i < 8; i++)
+        {
+            last[padded - 1 - i] = (guint8) (bits >> (8 * i));
+        }
+
+    compress(state, last, padded / SHA256_BLOCK_LEN);
+
+    for (i = 0; i < 8; i++)
+        {
+            digest[4 * i] = (guint8) (state[i] >> 24);
+            digest[4 * i + 1] = (guint8) (state[i] >> 16);
+            digest[4 * i + 2] = (guint8) (state[i] >> 8);
+            digest[4 * i + 3] = (guint8) state[i];
+        }
+}
@@ -0,0 +1,73 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    sha256.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file sha256.h
+ *
+ * This file contains the definitions of the SHA256 implementations that
+ * use the instructions dedicated to SHA256 of the processor (SHA
+ * extensions on x86, cryptographic extensions on ARMv8). They are only
+ * used (by calculate_hash_into() in hashs.c) when the processor has such
+ * instructions.
+ */
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+
+/**
+ * @def SHA256_BLOCK_LEN
+ * Size of the blocks that the SHA256 compression function processes.
+ */
+#define SHA256_BLOCK_LEN (64)
+
+
+/**
+ * A SHA256 compression function: processes blocks (64 bytes each) of
+ * data and updates state.
+ * @param state is the SHA256 state (8 words: a, b, c, d, e, f, g, h).
+ * @param data is the data to process (blocks * SHA256_BLOCK_LEN bytes).
+ * @param blocks is the number of blocks to process.
+ */
+typedef void (* sha256_compress_func) (guint32 *state, const guint8 *data, gsize blocks);
+
+
+/**
+ * Looks for an accelerated SHA256 compression function usable on this
+ * processor.
+ * @param[out] name is the name of the implementation found if any.
+ * @returns the compression function or NULL if the processor has no
+ *          instruction dedicated to SHA256 (or if the program has been
+ *          compiled for a processor where we do not know them).
+ */
+extern sha256_compress_func sha256_get_accelerated_compress(const gchar **name);
+
+
+/**
+ * Calculates the SHA256 digest of a buffer with a compression function.
+ * @param compress is the compression function to use.
+ * @param buffer is the buffer to hash.
+ * @param size is the number of bytes of buffer.
+ * @param[out] digest is where the HASH_LEN bytes digest is written.
+ */
+extern void sha256_digest(sha256_compress_func compress, const guchar *buffer, gsize size, guint8 *digest);
+
+
+#endif /* #ifndef _SHA256_H_ */
@@ -0,0 +1,325 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    trace.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file trace.c
+ *
+ * Low overhead tracing of the main steps of the programs. Each thread
+ * records its spans into its own ring buffer (created the first time it
+ * records one). Spans are only gathered when they are dumped.
+ */
+
+#include "libcdpfgl.h"
+
+static gboolean tracing = FALSE;      /** TRUE when tracing is enabled                   */
+static gchar *trace_filename = NULL;  /** File where the Chrome trace is written         */
+static gint64 trace_origin = 0;       /** Monotonic time when tracing was enabled        */
+static GMutex rings_mutex;            /** Protects rings and next_tid                    */
+static GSList *rings = NULL;          /** All the trace_ring_t * ever created            */
+static guint next_tid = 0;            /** Number to be given to the next thread          */
+static GPrivate thread_ring = G_PRIVATE_INIT(NULL);
+
+static trace_ring_t *get_thread_ring(void);
+static void record_span(gint64 start, gint64 duration, const gchar *name);
+static void write_json_string(FILE *file, const gchar *string);
+static gint compare_durations(gconstpointer a, gconstpointer b);
+static void print_span_summary(gpointer key, gpointer value, gpointer user_data);
+
+
+/**
+ * Enables tracing. Spans will be written into filename by trace_dump().
+ * @param filename is the name of the file where to write the Chrome
+ *        trace. NULL does not change anything.
+ */
+void init_tracing(gchar *filename)
+{
+    if (filename != NULL)
+        {
+            free_variable(trace_filename);
+            trace_filename = g_strdup(filename);
+            trace_origin = g_get_monotonic_time();
+            tracing = TRUE;
+        }
+}
+
+
+/**
+ * @returns TRUE if tracing is enabled and FALSE otherwise.
+ */
+gboolean is_tracing_enabled(void)
+{
+    return tracing;
+}
+
+
+/**
+ * Gets the ring buffer of the calling thread (creates it if needed).
+ * @returns the trace_ring_t * of the calling thread.
+ */
+static trace_ring_t *get_thread_ring(void)
+{
+    trace_ring_t *ring = g_private_get(&thread_ring);
+
+    if (ring == NULL)
+        {
+            ring = (trace_ring_t *) g_malloc0(sizeof(trace_ring_t));
+            g_assert_nonnull(ring);
+
+            g_mutex_init(&ring->mutex);
+            ring->size = TRACE_RING_FIRST_SIZE;
+            ring->written = 0;
+            ring->spans = (trace_span_t *) g_malloc0(sizeof(trace_span_t) * ring->size);
+
+            /* Rings are kept when their thread ends: they are dumped at exit */
+            g_mutex_lock(&rings_mutex);
+            ring->tid = next_tid;
+            next_tid = next_tid + 1;
+            rings = g_slist_prepend(rings, ring);
+            g_mutex_unlock(&rings_mutex);
+
+            g_private_set(&thread_ring, ring);
+        }
+
+    return ring;
+}
+
+
+/**
+ * Records a span into the ring buffer of the calling thread.
+ * @param start is the time (microseconds) when the span began.
+ * @param duration is the duration of the span in microseconds.
+ * @param name is the name of the span.
+ */
+static void record_span(gint64 start, gint64 duration, const gchar *name)
+{
+    trace_ring_t *ring = get_thread_ring();
+    trace_span_t *span = NULL;
+
+    g_mutex_lock(&ring->mutex);
+
+    if (ring->written == ring->size && ring->size < TRACE_RING_SIZE)
+        {
+            /* The ring has never wrapped: growing it keeps spans in order */
+            ring->size = ring->size * 2;
+            ring->spans = (trace_span_t *) g_realloc(ring->spans, sizeof(trace_span_t) * ring->size);
+        }
+
+    span = &ring->spans[ring->written % ring->size];
+    span->start = start;
+    span->duration = duration;
+    g_strlcpy(span->name, name != NULL ? name : "", TRACE_NAME_LEN);
+    ring->written = ring->written + 1;
+
+    g_mutex_unlock(&ring->mutex);
+}
+
+
+/**
+ * Begins a span. This costs one read of the monotonic clock when tracing
+ * is enabled and nothing otherwise.
+ * @returns the time when the span began or 0 if the span does not have
+ *          to be measured.
+ */
+gint64 trace_begin(void)
+{
+    gint64 start = 0;
+
+    if (tracing == TRUE)
+        {
+            start = g_get_monotonic_time();
+        }
+
+    return start;
+}
+
+
+/**
+ * Ends a span: records it into the ring buffer of the calling thread.
+ * @param start is the value returned by trace_begin().
+ * @param name is the name of the span (it is copied).
+ */
+void trace_end(gint64 start, const gchar *name)
+{
+    if (start != 0 && tracing == TRUE)
+        {
+            record_span(start, g_get_monotonic_time() - start, name);
+        }
+}
+
+
+/**
+ * Writes a string as a JSON string (with its quotes) into a file.
+ * @param file is the file where to write.
+ * @param string is the string to be written.
+ */
+static void write_json_string(FILE *file, const gchar *string)
+{
+    const gchar *p = string;
+
+    fputc('"', file);
+
+    while (p != NULL && *p != '\0')
+        {
+            if (*p == '"' || *p == '\\')
+                {
+                    fputc('\\', file);
+                    fputc(*p, file);
+                }
+            else if ((guchar) *p < 0x20)
+                {
+                    fprintf(file, "\\u%04x", (guchar) *p);
+                }
+            else
+                {
+                    fputc(*p, file);
+                }
+
+            p++;
+        }
+
+    fputc('"', file);
+}
+
+
+/**
+ * Compares two durations (for sorting them).
+ * @param a is a gint64 * duration.
+ * @param b is a gint64 * duration.
+ * @returns a negative value if a < b, 0 if a == b and a positive value
+ *          otherwise.
+ */
+static gint compare_durations(gconstpointer a, gconstpointer b)
+{
+    gint64 da = *(const gint64 *) a;
+    gint64 db = *(const gint64 *) b;
+
+    return (da > db) - (da < db);
+}
+
+
+/**
+ * Prints the summary of the durations of one kind of span.
+ * @param key is the name of the spans.
+ * @param value is a GArray of gint64 durations of these spans.
+ * @param user_data is not used.
+ */
+static void print_span_summary(gpointer key, gpointer value, gpointer user_data)
+{
+    GArray *durations = (GArray *) value;
+    gint64 total = 0;
+    guint i = 0;
+    guint n = durations->len;
+
+    g_array_sort(durations, compare_durations);
+
+    for (i = 0; i < n; i++)
+        {
+            total = total + g_array_index(durations, gint64, i);
+        }
+
+    fprintf(stdout, _("%-48s %8u spans, mean %10" G_GINT64_FORMAT " µs, p50 %10" G_GINT64_FORMAT " µs, p99 %10" G_GINT64_FORMAT " µs, max %10" G_GINT64_FORMAT " µs\n"),
+            (gchar *) key, n, total / n,
+            g_array_index(durations, gint64, (n - 1) / 2),
+            g_array_index(durations, gint64, ((guint64) n * 99 + 99) / 100 - 1),
+            g_array_index(durations, gint64, n - 1));
+}
+
+
+/**
+ * Writes all recorded spans as a Chrome trace (JSON) into the file given
+ * to init_tracing() and prints a summary of the durations of each kind
+ * of span. Does nothing if tracing is not enabled.
+ */
+void trace_dump(void)
+{
+    FILE *file = NULL;
+    GSList *iter = NULL;
+    trace_ring_t *ring = NULL;
+    trace_span_t *span = NULL;
+    GHashTable *summary = NULL;
+    GArray *durations = NULL;
+    guint64 first = 0;
+    guint64 i = 0;
+    gboolean comma = FALSE;
+    pid_t pid = getpid();
+
+    if (tracing == TRUE && trace_filename != NULL)
+        {
+            file = fopen(trace_filename, "w");
+
+            if (file == NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to open trace file %s: %s\n"), trace_filename, g_strerror(errno));
+                }
+            else
+                {
+                    summary = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
+
+                    fprintf(file, "{\"traceEvents\":[\n");
+
+                    g_mutex_lock(&rings_mutex);
+
+                    for (iter = rings; iter != NULL; iter = g_slist_next(iter))
+                        {
+                            ring = (trace_ring_t *) iter->data;
+                            g_mutex_lock(&ring->mutex);
+
+                            first = (ring->written > ring->size) ? ring->written - ring->size : 0;
+
+                            for (i = first; i < ring->written; i++)
+                                {
+                                    span = &ring->spans[i % ring->size];
+
+                                    if (comma == TRUE)
+                                        {
+                                            fprintf(file, ",\n");
+                                        }
+
+                                    fprintf(file, "{\"name\":");
+                                    write_json_string(file, span->name);
+                                    fprintf(file, ",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%u}", span->start - trace_origin, span->duration, (gint) pid, ring->tid);
+                                    comma = TRUE;
+
+                                    durations = g_hash_table_lookup(summary, span->name);
+
+                                    if (durations == NULL)
+                                        {
+                                            durations = g_array_new(FALSE, FALSE, sizeof(gint64));
+                                            g_hash_table_insert(summary, g_strdup(span->name), durations);
+                                        }
+
+                                    g_array_append_val(durations, span->duration);
+                                }
+
+                            g_mutex_unlock(&ring->mutex);
+                        }
+
+                    g_mutex_unlock(&rings_mutex);
+
+                    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+                    fclose(file);
+
+                    fprintf(stdout, _("Trace written to %s. Summary of spans:\n"), trace_filename);
+                    g_hash_table_foreach(summary, print_span_summary, NULL);
+                    g_hash_table_destroy(summary);
+                }
+        }
+}
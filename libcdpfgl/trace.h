@@ -0,0 +1,127 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    trace.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file trace.h
+ *
+ * This file contains the definitions needed to trace the time spent in
+ * the main steps of the programs. Spans are measured with the monotonic
+ * clock and recorded into a ring buffer owned by each thread. Tracing is
+ * enabled at runtime (--trace option) and the spans are written as a
+ * Chrome trace (JSON) when the program ends.
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+
+/**
+ * @def TRACE_NAME_LEN
+ * Maximum length (final \0 included) of the name of a span. Longer names
+ * are truncated.
+ */
+#define TRACE_NAME_LEN (48)
+
+
+/**
+ * @def TRACE_RING_FIRST_SIZE
+ * Number of spans that a ring buffer can contain when it is created. It
+ * doubles when it is full until it reaches TRACE_RING_SIZE.
+ */
+#define TRACE_RING_FIRST_SIZE (256)
+
+
+/**
+ * @def TRACE_RING_SIZE
+ * Maximum number of spans kept for each thread. Older spans are
+ * overwritten by newer ones.
+ */
+#define TRACE_RING_SIZE (16384)
+
+
+/**
+ * @struct trace_span_t
+ * @brief One recorded span.
+ */
+typedef struct
+{
+    gint64 start;                /**< monotonic time (microseconds) when the span began */
+    gint64 duration;             /**< duration of the span in microseconds              */
+    gchar name[TRACE_NAME_LEN];  /**< name of the span                                  */
+} trace_span_t;
+
+
+/**
+ * @struct trace_ring_t
+ * @brief Ring buffer of the spans of one thread.
+ *
+ * Only its thread writes into it. The mutex is never contended except
+ * when the spans are dumped.
+ */
+typedef struct
+{
+    GMutex mutex;          /**< protects spans against a concurrent dump */
+    guint tid;             /**< number given to the thread               */
+    guint size;            /**< number of spans allocated                */
+    guint64 written;       /**< number of spans ever written             */
+    trace_span_t *spans;   /**< the spans                                */
+} trace_ring_t;
+
+
+/**
+ * Enables tracing. Spans will be written into filename by trace_dump().
+ * @param filename is the name of the file where to write the Chrome
+ *        trace. NULL does not change anything.
+ */
+extern void init_tracing(gchar *filename);
+
+
+/**
+ * @returns TRUE if tracing is enabled and FALSE otherwise.
+ */
+extern gboolean is_tracing_enabled(void);
+
+
+/**
+ * Begins a span. This costs one read of the monotonic clock when tracing
+ * is enabled and nothing otherwise.
+ * @returns the time when the span began or 0 if the span does not have
+ *          to be measured.
+ */
+extern gint64 trace_begin(void);
+
+
+/**
+ * Ends a span: records it into the ring buffer of the calling thread.
+ * @param start is the value returned by trace_begin().
+ * @param name is the name of the span (it is copied).
+ */
+extern void trace_end(gint64 start, const gchar *name);
+
+
+/**
+ * Writes all recorded spans as a Chrome trace (JSON) into the file given
+ * to init_tracing() and prints a summary of the durations of each kind
+ * of span. Does nothing if tracing is not enabled.
+ */
+extern void trace_dump(void);
+
+
+#endif /* #ifndef _TRACE_H_ */
@@ -343,6 +343,60 @@ GList *extract_glist_from_array(json_t *root, gchar *name, gboolean only_hash)
 }
 
 
+/**
+ * This function returns a contiguous array of hashs from a json array
+ * of base64 encoded hashs. Hashs that do not decode to HASH_LEN bytes
+ * are ignored.
+ * @param root is the root json string that may contain an array named "name"
+ * @param name is the name of the array to look for into
+ * @param[out] nb_hashs is the number of hashs in the returned array.
+ * @returns a newly allocated array of *nb_hashs * HASH_LEN bytes (NULL if
+ *          there is no hash) that may be freed when no longer needed.
+ */
+guint8 *extract_hash_array_from_json(json_t *root, gchar *name, guint64 *nb_hashs)
+{
+    json_t *array =  NULL;
+    size_t index = 0;
+    json_t *value = NULL;
+    guchar *a_hash = NULL;
+    gsize hash_len = 0;
+    guint8 *hashs = NULL;
+    guint64 nb = 0;
+
+    if (root != NULL && name != NULL)
+        {
+            array = get_json_value_from_json_root(root, name);
+
+            if (json_array_size(array) > 0)
+                {
+                    hashs = (guint8 *) g_malloc(json_array_size(array) * HASH_LEN);
+
+                    json_array_foreach(array, index, value)
+                        {
+                            a_hash = g_base64_decode(json_string_value(value), &hash_len);
+
+                            if (a_hash != NULL && hash_len == HASH_LEN)
+                                {
+                                    memcpy(hashs + nb * HASH_LEN, a_hash, HASH_LEN);
+                                    nb++;
+                                }
+
+                            free_variable(a_hash);
+                        }
+
+                    if (nb == 0)
+                        {
+                            free_variable(hashs);
+                        }
+                }
+        }
+
+    *nb_hashs = nb;
+
+    return hashs;
+}
+
+
 /**
  * Fills a server_meta_data_t from data that are in json_t *root
  * @param root is the JSON string that should contain all data needed
@@ -378,7 +432,7 @@ static server_meta_data_t *fills_server_meta_data_t_from_json_t(json_t *root)
             meta->name = get_string_from_json_root(root, "name");
             meta->link = get_string_from_json_root(root, "link");
 
-            meta->hash_data_list = extract_glist_from_array(root, "hash_list", TRUE);
+            meta->hashs = extract_hash_array_from_json(root, "hash_list", &meta->nb_hashs);
 
             smeta->meta = meta;
             smeta->hostname = get_string_from_json_root(root, "hostname");
@@ -550,3 +604,308 @@ server_meta_data_t *convert_json_to_smeta_data(gchar *json_str)
 
     return smeta;
 }
+
+
+/**
+ * @param buffer is the buffer where to read the value from.
+ * @returns the guint16 little endian value read from buffer
+ */
+guint16 get_guint16_from_buffer(guint8 *buffer)
+{
+    guint16 value = 0;
+
+    memcpy(&value, buffer, sizeof(guint16));
+
+    return GUINT16_FROM_LE(value);
+}
+
+
+/**
+ * @param buffer is the buffer where to read the value from.
+ * @returns the guint32 little endian value read from buffer
+ */
+guint32 get_guint32_from_buffer(guint8 *buffer)
+{
+    guint32 value = 0;
+
+    memcpy(&value, buffer, sizeof(guint32));
+
+    return GUINT32_FROM_LE(value);
+}
+
+
+/**
+ * @param buffer is the buffer where to read the value from.
+ * @returns the guint64 little endian value read from buffer
+ */
+guint64 get_guint64_from_buffer(guint8 *buffer)
+{
+    guint64 value = 0;
+
+    memcpy(&value, buffer, sizeof(guint64));
+
+    return GUINT64_FROM_LE(value);
+}
+
+
+/**
+ * Extracts a list of hash_data_t structures from a binary data array
+ * (the body of a /Data_Array.bin request).
+ * @param buffer is the binary data array.
+ * @param length is the length in bytes of buffer.
+ * @param[out] valid is set to FALSE if buffer is truncated or malformed
+ *             and to TRUE otherwise.
+ * @returns a GList of newly allocated hash_data_t structures that were
+ *          successfully extracted (may be NULL).
+ */
+GList *extract_glist_from_binary_array(guchar *buffer, guint64 length, gboolean *valid)
+{
+    GList *head = NULL;
+    guint64 pos = 0;
+    guint64 data_len = 0;
+    guint8 *hash = NULL;
+    guchar *data = NULL;
+    gshort cmptype = COMPRESS_NONE_TYPE;
+    gssize uncmplen = 0;
+    gboolean ok = TRUE;
+
+    if (buffer != NULL)
+        {
+            while (pos < length && ok == TRUE)
+                {
+                    if (length - pos >= BIN_DATA_ARRAY_HEADER_SIZE)
+                        {
+                            cmptype = (gshort) get_guint16_from_buffer(buffer + pos + HASH_LEN);
+                            uncmplen = (gssize) get_guint64_from_buffer(buffer + pos + HASH_LEN + 4);
+                            data_len = get_guint64_from_buffer(buffer + pos + HASH_LEN + 12);
+
+                            if (data_len <= length - pos - BIN_DATA_ARRAY_HEADER_SIZE)
+                                {
+                                    hash = (guint8 *) g_memdup(buffer + pos, HASH_LEN);
+                                    data = (guchar *) g_memdup(buffer + pos + BIN_DATA_ARRAY_HEADER_SIZE, data_len);
+                                    head = g_list_prepend(head, new_hash_data_t_as_is(data, data_len, hash, cmptype, uncmplen));
+                                    pos = pos + BIN_DATA_ARRAY_HEADER_SIZE + data_len;
+                                }
+                            else
+                                {
+                                    ok = FALSE;
+                                }
+                        }
+                    else
+                        {
+                            ok = FALSE;
+                        }
+                }
+
+            head = g_list_reverse(head);
+        }
+    else
+        {
+            ok = FALSE;
+        }
+
+    if (valid != NULL)
+        {
+            *valid = ok;
+        }
+
+    return head;
+}
+
+
+/**
+ * Creates a new incremental binary data array decoder
+ * @returns a newly allocated binary_array_decoder_t structure that may
+ *          be freed with free_binary_array_decoder_t() when no longer
+ *          needed.
+ */
+binary_array_decoder_t *new_binary_array_decoder_t(void)
+{
+    binary_array_decoder_t *decoder = NULL;
+
+    decoder = (binary_array_decoder_t *) g_malloc0(sizeof(binary_array_decoder_t));
+    g_assert_nonnull(decoder);
+
+    decoder->header_pos = 0;
+    decoder->data = NULL;
+    decoder->data_len = 0;
+    decoder->data_pos = 0;
+    decoder->nb_blocks = 0;
+    decoder->error = FALSE;
+
+    return decoder;
+}
+
+
+/**
+ * Frees a binary_array_decoder_t structure (and an incomplete block
+ * if any)
+ * @param decoder is the decoder to be freed.
+ */
+void free_binary_array_decoder_t(binary_array_decoder_t *decoder)
+{
+    if (decoder != NULL)
+        {
+            free_variable(decoder->data);
+            free_variable(decoder);
+        }
+}
+
+
+/**
+ * Feeds the decoder with some bytes of a binary data array.
+ * @param decoder is the decoder to feed.
+ * @param buffer is the received bytes.
+ * @param length is the number of bytes in buffer.
+ * @returns a GList of newly allocated hash_data_t structures: the blocks
+ *          that are complete with those bytes (may be NULL).
+ */
+GList *feed_binary_array_decoder(binary_array_decoder_t *decoder, const guchar *buffer, gsize length)
+{
+    GList *head = NULL;
+    gsize pos = 0;
+    guint64 needed = 0;
+    guint8 *hash = NULL;
+    gshort cmptype = COMPRESS_NONE_TYPE;
+    gssize uncmplen = 0;
+
+    if (decoder != NULL && buffer != NULL)
+        {
+            while (pos < length && decoder->error == FALSE)
+                {
+                    if (decoder->header_pos < BIN_DATA_ARRAY_HEADER_SIZE)
+                        {
+                            /* Filling the header */
+                            needed = MIN(BIN_DATA_ARRAY_HEADER_SIZE - decoder->header_pos, length - pos);
+                            memcpy(decoder->header + decoder->header_pos, buffer + pos, needed);
+                            decoder->header_pos = decoder->header_pos + needed;
+                            pos = pos + needed;
+
+                            if (decoder->header_pos == BIN_DATA_ARRAY_HEADER_SIZE)
+                                {
+                                    decoder->data_len = get_guint64_from_buffer(decoder->header + HASH_LEN + 12);
+                                    decoder->data_pos = 0;
+
+                                    if (decoder->data_len <= BIN_DATA_ARRAY_MAX_BLOCK_SIZE)
+                                        {
+                                            decoder->data = (guchar *) g_malloc(decoder->data_len + 1);
+                                        }
+                                    else
+                                        {
+                                            decoder->error = TRUE;
+                                        }
+                                }
+                        }
+                    else
+                        {
+                            /* Filling the data */
+                            needed = MIN(decoder->data_len - decoder->data_pos, length - pos);
+                            memcpy(decoder->data + decoder->data_pos, buffer + pos, needed);
+                            decoder->data_pos = decoder->data_pos + needed;
+                            pos = pos + needed;
+                        }
+
+                    if (decoder->header_pos == BIN_DATA_ARRAY_HEADER_SIZE && decoder->error == FALSE && decoder->data_pos == decoder->data_len)
+                        {
+                            /* This block is complete */
+                            hash = (guint8 *) g_memdup(decoder->header, HASH_LEN);
+                            cmptype = (gshort) get_guint16_from_buffer(decoder->header + HASH_LEN);
+                            uncmplen = (gssize) get_guint64_from_buffer(decoder->header + HASH_LEN + 4);
+                            head = g_list_prepend(head, new_hash_data_t_as_is(decoder->data, decoder->data_len, hash, cmptype, uncmplen));
+
+                            decoder->data = NULL;
+                            decoder->header_pos = 0;
+                            decoder->data_len = 0;
+                            decoder->data_pos = 0;
+                            decoder->nb_blocks = decoder->nb_blocks + 1;
+                        }
+                }
+
+            head = g_list_reverse(head);
+        }
+
+    return head;
+}
+
+
+/**
+ * @param decoder is the decoder.
+ * @returns TRUE if everything fed to the decoder was made of complete
+ *          and valid blocks, FALSE otherwise.
+ */
+gboolean is_binary_array_decoder_complete(binary_array_decoder_t *decoder)
+{
+    return (decoder != NULL && decoder->error == FALSE && decoder->header_pos == 0);
+}
+
+
+/**
+ * Tells whether a version json string (as returned by the server)
+ * advertises a protocol in its "protocols" array.
+ * @param json_str : a gchar * containing the JSON formated string.
+ * @param protocol is the name of the protocol to look for.
+ * @returns TRUE if protocol is advertised, FALSE otherwise.
+ */
+gboolean get_json_protocol(gchar *json_str, gchar *protocol)
+{
+    json_t *root = NULL;
+    json_t *array = NULL;
+    json_t *value = NULL;
+    size_t index = 0;
+    gboolean found = FALSE;
+
+    if (json_str != NULL && protocol != NULL)
+        {
+            root = load_json(json_str);
+
+            if (root != NULL)
+                {
+                    /* older servers do not have any "protocols" array */
+                    array = json_object_get(root, "protocols");
+
+                    json_array_foreach(array, index, value)
+                        {
+                            if (g_strcmp0(json_string_value(value), protocol) == 0)
+                                {
+                                    found = TRUE;
+                                }
+                        }
+
+                    json_decref(root);
+                }
+        }
+
+    return found;
+}
+
+
+/**
+ * Gets the epoch of the store of the server from a version json string
+ * as returned by the server.
+ * @param json_str : a gchar * containing the JSON formated string.
+ * @returns a newly allocated epoch string or NULL (older servers and
+ *          backends without any epoch).
+ */
+gchar *get_json_epoch(gchar *json_str)
+{
+    json_t *root = NULL;
+    gchar *epoch = NULL;
+
+    if (json_str != NULL)
+        {
+            root = load_json(json_str);
+
+            if (root != NULL)
+                {
+                    /* older servers do not send any "epoch" */
+                    if (json_object_get(root, "epoch") != NULL)
+                        {
+                            epoch = get_string_from_json_root(root, "epoch");
+                        }
+
+                    json_decref(root);
+                }
+        }
+
+    return epoch;
+}
@@ -0,0 +1,295 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    archive.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file archive.c
+ *
+ * This file contains the functions used by 'cdpfglrestore' to restore
+ * files from a /File/Archive.bin answer while it streams. The archive
+ * is a binary data array where the JSON meta data of each file
+ * (ARCHIVE_META_TYPE record) is followed by its uncompressed blocks in
+ * order. Blocks of zeros are not sent: they become holes.
+ */
+
+#include "restore.h"
+
+static void make_holes_of_zero_hashs(plan_file_t *pfile);
+static void close_archive_file(archive_reader_t *reader);
+static void open_archive_file(archive_reader_t *reader, hash_data_t *record);
+static void write_archive_block(archive_reader_t *reader, hash_data_t *record);
+static void skip_missing_block(archive_reader_t *reader, hash_data_t *record);
+static void process_archive_record(archive_reader_t *reader, hash_data_t *record);
+static gboolean archive_data_received(const guchar *buffer, size_t length, gpointer user_data);
+
+
+/**
+ * Seeks over the blocks of zeros that are next in the file (they are
+ * not in the archive).
+ * @param pfile is the file being written.
+ */
+static void make_holes_of_zero_hashs(plan_file_t *pfile)
+{
+    GError *error = NULL;
+    guint64 length = 0;
+
+    while (pfile->cursor < pfile->meta->nb_hashs && pfile->failed == FALSE && is_zero_hash(pfile->meta->hashs + pfile->cursor * HASH_LEN, &length) == TRUE)
+        {
+            if (seek_over_hole(pfile->stream, length, &error) == TRUE)
+                {
+                    pfile->written = pfile->written + length;
+                    pfile->holes = TRUE;
+                    pfile->cursor = pfile->cursor + 1;
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error while making a hole in restored file: %s\n"), error->message);
+                    free_error(error);
+                    error = NULL;
+                    pfile->failed = TRUE;
+                }
+        }
+}
+
+
+/**
+ * Closes the current file (if any) once every of its records has been
+ * received.
+ * @param reader is the archive_reader_t state of the archive.
+ */
+static void close_archive_file(archive_reader_t *reader)
+{
+    if (reader->pfile != NULL)
+        {
+            make_holes_of_zero_hashs(reader->pfile);
+
+            if (reader->pfile->cursor < reader->pfile->meta->nb_hashs && reader->pfile->failed == FALSE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: %s has not been completely restored.\n"), reader->pfile->filename);
+                }
+
+            close_plan_file(reader->pfile);
+            reader->pfile = NULL;
+        }
+
+    free_smeta_data_t(reader->smeta);
+    reader->smeta = NULL;
+}
+
+
+/**
+ * Opens the file whose meta data is in record.
+ * @param reader is the archive_reader_t state of the archive.
+ * @param record is an ARCHIVE_META_TYPE record.
+ */
+static void open_archive_file(archive_reader_t *reader, hash_data_t *record)
+{
+    gchar *json_str = NULL;
+
+    close_archive_file(reader);
+
+    json_str = g_strndup((gchar *) record->data, record->read);
+    reader->smeta = convert_json_to_smeta_data(json_str);
+    free_variable(json_str);
+
+    if (reader->smeta != NULL && reader->smeta->meta != NULL)
+        {
+            reader->nb_files = reader->nb_files + 1;
+            print_debug(_("File to be restored from archive: %s\n"), reader->smeta->meta->name);
+            reader->pfile = open_plan_file(reader->res_struct, reader->smeta->meta);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: malformed meta data in archive.\n"));
+        }
+}
+
+
+/**
+ * Writes a block received for the current file. It has to be the next
+ * block of the file.
+ * @param reader is the archive_reader_t state of the archive.
+ * @param record is a block of the archive (COMPRESS_NONE_TYPE record).
+ */
+static void write_archive_block(archive_reader_t *reader, hash_data_t *record)
+{
+    plan_file_t *pfile = reader->pfile;
+    GError *error = NULL;
+
+    if (pfile != NULL && pfile->failed == FALSE)
+        {
+            make_holes_of_zero_hashs(pfile);
+
+            if (pfile->cursor >= pfile->meta->nb_hashs || memcmp(pfile->meta->hashs + pfile->cursor * HASH_LEN, record->hash, HASH_LEN) != 0)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unexpected block in archive for file %s\n"), pfile->filename);
+                    pfile->failed = TRUE;
+                }
+            else if (g_output_stream_write_all((GOutputStream *) pfile->stream, record->data, record->read, NULL, NULL, &error) == TRUE)
+                {
+                    pfile->written = pfile->written + record->read;
+                    pfile->cursor = pfile->cursor + 1;
+                    reader->nb_blocks = reader->nb_blocks + 1;
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error while writing restored data: %s\n"), error->message);
+                    free_error(error);
+                    pfile->failed = TRUE;
+                }
+        }
+}
+
+
+/**
+ * Skips a block that the server does not have (as the planner does).
+ * @param reader is the archive_reader_t state of the archive.
+ * @param record is an ARCHIVE_MISSING_TYPE record.
+ */
+static void skip_missing_block(archive_reader_t *reader, hash_data_t *record)
+{
+    plan_file_t *pfile = reader->pfile;
+    gchar *hash = NULL;
+
+    if (pfile != NULL && pfile->failed == FALSE)
+        {
+            make_holes_of_zero_hashs(pfile);
+
+            hash = hash_to_string(record->hash);
+            print_error(__FILE__, __LINE__, _("Error: server does not have block %s of file %s\n"), hash, pfile->filename);
+            free_variable(hash);
+
+            pfile->cursor = pfile->cursor + 1;
+        }
+}
+
+
+/**
+ * Processes one record of the archive.
+ * @param reader is the archive_reader_t state of the archive.
+ * @param record is the record to be processed.
+ */
+static void process_archive_record(archive_reader_t *reader, hash_data_t *record)
+{
+    switch (record->cmptype)
+        {
+            case ARCHIVE_META_TYPE:
+                open_archive_file(reader, record);
+            break;
+
+            case ARCHIVE_MISSING_TYPE:
+                skip_missing_block(reader, record);
+            break;
+
+            case ARCHIVE_END_TYPE:
+                close_archive_file(reader);
+                reader->ended = TRUE;
+            break;
+
+            case COMPRESS_NONE_TYPE:
+                write_archive_block(reader, record);
+            break;
+
+            default:
+                print_error(__FILE__, __LINE__, _("Error: unknown record type %d in archive.\n"), record->cmptype);
+            break;
+        }
+}
+
+
+/**
+ * Callback called by get_url_stream() with each part of the archive.
+ * Records that are complete are processed and freed at once.
+ * @param buffer is the received bytes.
+ * @param length is the number of bytes in buffer.
+ * @param user_data is the archive_reader_t state of the archive.
+ * @returns FALSE to abort the request when the archive is malformed,
+ *          TRUE otherwise.
+ */
+static gboolean archive_data_received(const guchar *buffer, size_t length, gpointer user_data)
+{
+    archive_reader_t *reader = (archive_reader_t *) user_data;
+    GList *records = NULL;
+    GList *iter = NULL;
+
+    records = feed_binary_array_decoder(reader->decoder, buffer, length);
+
+    for (iter = records; iter != NULL; iter = g_list_next(iter))
+        {
+            process_archive_record(reader, iter->data);
+        }
+
+    g_list_free_full(records, (GDestroyNotify) free_hash_data_t);
+
+    return (reader->decoder->error == FALSE);
+}
+
+
+/**
+ * Restores every file that query finds with one /File/Archive.bin
+ * request. Files are written as their records are received. The server
+ * must understand /File/Archive.bin.
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param query is the structure that contains everything needed to
+ *        query the server (and filter a bit). It must not be NULL.
+ * @returns TRUE if the whole archive has been received, FALSE if it
+ *          has been truncated or is malformed.
+ */
+gboolean restore_files_from_archive(res_struct_t *res_struct, query_t *query)
+{
+    archive_reader_t reader;
+    gchar *request = NULL;
+    gint64 span = 0;
+
+    if (res_struct != NULL && res_struct->comm != NULL && query != NULL)
+        {
+            span = trace_begin();
+
+            reader.res_struct = res_struct;
+            reader.decoder = new_binary_array_decoder_t();
+            reader.smeta = NULL;
+            reader.pfile = NULL;
+            reader.nb_files = 0;
+            reader.nb_blocks = 0;
+            reader.ended = FALSE;
+
+            request = make_query_request("/File/Archive.bin", query);
+            print_debug(_("Query is: %s\n"), request);
+
+            get_url_stream(res_struct->comm, request, NULL, archive_data_received, &reader);
+
+            if (reader.ended == FALSE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: archive has been truncated or is malformed.\n"));
+                    close_archive_file(&reader);
+                }
+
+            print_debug(_("%" G_GUINT64_FORMAT " files restored from archive with %" G_GUINT64_FORMAT " blocks\n"), reader.nb_files, reader.nb_blocks);
+
+            free_binary_array_decoder_t(reader.decoder);
+            free_variable(request);
+
+            trace_end(span, "Files restored from archive in");
+
+            return reader.ended;
+        }
+
+    return FALSE;
+}
@@ -0,0 +1,66 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    archive.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file archive.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * used to restore files from a streamed archive (/File/Archive.bin) as
+ * it is received: one request brings the meta data and the blocks of
+ * every file that a query finds.
+ */
+#ifndef _RESTORE_ARCHIVE_H_
+#define _RESTORE_ARCHIVE_H_
+
+
+/**
+ * @struct archive_reader_t
+ * @brief State of an archive being received and unpacked.
+ *
+ * Only the file being written and the record being received are kept
+ * in memory.
+ */
+typedef struct
+{
+    res_struct_t *res_struct;          /**< main structure of cdpfglrestore                  */
+    binary_array_decoder_t *decoder;   /**< decodes records of the archive                   */
+    server_meta_data_t *smeta;         /**< meta data of the current file (NULL if none)     */
+    plan_file_t *pfile;                /**< current file being written (NULL if none)        */
+    guint64 nb_files;                  /**< number of files found in the archive             */
+    guint64 nb_blocks;                 /**< number of blocks written into files              */
+    gboolean ended;                    /**< TRUE when the end record has been received       */
+} archive_reader_t;
+
+
+/**
+ * Restores every file that query finds with one /File/Archive.bin
+ * request. Files are written as their records are received. The server
+ * must understand /File/Archive.bin.
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param query is the structure that contains everything needed to
+ *        query the server (and filter a bit). It must not be NULL.
+ * @returns TRUE if the whole archive has been received, FALSE if it
+ *          has been truncated or is malformed.
+ */
+extern gboolean restore_files_from_archive(res_struct_t *res_struct, query_t *query);
+
+
+#endif /* #ifndef _RESTORE_ARCHIVE_H_ */
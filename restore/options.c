@@ -48,6 +48,7 @@ static void print_selected_options(options_t *opt)
                     print_string_option(_("Server's IP address: %s\n"), opt->srv_conf->ip);
                     fprintf(stdout, _("Server's port number: %d\n"), opt->srv_conf->port);
                 }
+            fprintf(stdout, _("Parallel requests: %d\n"), opt->parallel);
         }
 }
 
@@ -113,6 +114,7 @@ static options_t *manage_command_line_options(int argc, char **argv)
     gboolean version = FALSE;      /** True if -v was selected on the command line                                       */
     gint debug = -4;               /** 0 == FALSE and other values == TRUE                                               */
     gchar *configfile = NULL;      /** filename for the configuration file if any                                        */
+    gchar *trace = NULL;           /** filename where to write the trace if any                                          */
     gchar *ip =  NULL;             /** IP address where is located server's program                                      */
     gint port = 0;                 /** Port number on which to send things to the server                                 */
     gchar *list = NULL;            /** Should contain a filename or a directory to filter out                            */
@@ -126,6 +128,7 @@ static options_t *manage_command_line_options(int argc, char **argv)
     gboolean all_files = FALSE;    /** all_files: True if we want to restore all files found by REGEX (-r or -l options) */
     gboolean latest = FALSE;       /** latest: True if we only want to get the latest version of a file                  */
     gboolean parents = FALSE;      /** parents: True if restore has to create / restore files with the whole path        */
+    gint parallel = 0;             /** parallel: number of data requests kept in flight while restoring a file           */
     srv_conf_t *srv_conf = NULL;
     GOptionEntry entries[] =
     {
@@ -143,8 +146,10 @@ static options_t *manage_command_line_options(int argc, char **argv)
         { "latest", 'g', 0, G_OPTION_ARG_NONE, &latest, N_("Selects only latest version of each file."), NULL},
         { "parents", 'P', 0, G_OPTION_ARG_NONE, &parents, N_("Creates directories if needed: ie restore with the whole path"), NULL},
         { "where", 'w', 0, G_OPTION_ARG_STRING, &where, N_("Specify a DIRECTORY where to restore a file."), N_("DIRECTORY")},
+        { "parallel", 'j', 0, G_OPTION_ARG_INT, &parallel, N_("NUMBER of data requests kept in flight while restoring a file."), N_("NUMBER")},
         { "ip", 'i', 0, G_OPTION_ARG_STRING, &ip, N_("IP address where server program is."), "IP"},
         { "port", 'p', 0, G_OPTION_ARG_INT, &port, N_("Port NUMBER on which server program is listening."), N_("NUMBER")},
+        { "trace", 'T', 0, G_OPTION_ARG_FILENAME, &trace, N_("Records the duration of the main steps and writes them as a Chrome trace (JSON) into FILENAME when the program ends."), N_("FILENAME")},
         { NULL }
     };
 
@@ -163,6 +168,7 @@ static options_t *manage_command_line_options(int argc, char **argv)
     opt->where = NULL;
     opt->r_hostname = NULL;
     opt->srv_conf = NULL;
+    opt->parallel = RESTORE_MAX_IN_FLIGHT;
 
     srv_conf = new_srv_conf_t();
     srv_conf->ip = g_strdup("localhost");
@@ -199,12 +205,19 @@ static options_t *manage_command_line_options(int argc, char **argv)
     /* 3) retrieving other options from the command line.
      */
     set_debug_mode_upon_cmdl(debug);
+    init_tracing(trace);
+    free_variable(trace);
     opt->version = version;           /* only TRUE if -v or --version was invoked      */
     opt->all_versions = all_versions; /* only TRUE if -e or --all-versions was invoked */
     opt->all_files = all_files;       /* only TRUE if -f or --all-files was invoked    */
     opt->latest = latest;             /* only TRUE if -r or --latest was invoked       */
     opt->parents = parents;           /* only TRUE if -p or --parents was invoked      */
 
+    if (parallel > 0)
+        {
+            opt->parallel = parallel;
+        }
+
     opt->date = set_option_str(date, opt->date);
     opt->afterdate = set_option_str(afterdate, opt->afterdate);
     opt->beforedate = set_option_str(beforedate, opt->beforedate);
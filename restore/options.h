@@ -56,6 +56,7 @@ typedef struct
     gboolean all_files;     /**< all_files is true if we want to restore all files found by REGEX with -r or -l options       */
     gboolean latest;        /**< latest is true if we want ot get only the latest version of a file. Defaults is false        */
     gboolean parents;       /**< when parents is true restore will create (if needed) and restore files with their whole path */
+    guint parallel;         /**< number of data requests kept in flight while restoring a file                                */
 } options_t;
 
 
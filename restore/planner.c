@@ -0,0 +1,622 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    planner.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file planner.c
+ *
+ * This file contains the restore planner used by 'cdpfglrestore' when
+ * it restores many files at once. Files that share blocks (a copied
+ * directory for instance) are written at the same time and a block is
+ * fetched from the server once and then taken from a bounded LRU cache
+ * of decoded blocks. Requests are sent asynchronously to
+ * /Data/Hash_Array.bin whose answers carry the hash of each block.
+ */
+
+#include "restore.h"
+
+static block_cache_t *new_block_cache_t(guint64 max_size);
+static void free_cache_entry_t(cache_entry_t *entry);
+static void free_block_cache_t(block_cache_t *cache);
+static void block_cache_insert(block_cache_t *cache, hash_data_t *hash_data);
+static hash_data_t *block_cache_lookup(block_cache_t *cache, guint8 *hash);
+static void open_next_files(restore_plan_t *plan);
+static void write_plan_file(restore_plan_t *plan, plan_file_t *pfile);
+static void write_all_plan_files(restore_plan_t *plan);
+static void close_finished_files(restore_plan_t *plan);
+static void plan_batch_received(gint success, gchar *url, gchar *readbuffer, size_t length, gchar *answer, gpointer user_data);
+static void send_plan_batch(restore_plan_t *plan, GList *hash_list, guint max);
+static void request_needed_blocks(restore_plan_t *plan);
+
+
+/**
+ * Creates a new empty block cache
+ * @param max_size is the maximum number of bytes of data in the cache.
+ * @returns a newly allocated block_cache_t structure that may be freed
+ *          with free_block_cache_t() when no longer needed.
+ */
+static block_cache_t *new_block_cache_t(guint64 max_size)
+{
+    block_cache_t *cache = NULL;
+
+    cache = (block_cache_t *) g_malloc0(sizeof(block_cache_t));
+    g_assert_nonnull(cache);
+
+    cache->entries = new_hash_index();
+    cache->lru = g_queue_new();
+    cache->size = 0;
+    cache->max_size = max_size;
+
+    return cache;
+}
+
+
+/**
+ * Frees a cache entry and its block
+ * @param entry is the cache_entry_t structure to be freed.
+ */
+static void free_cache_entry_t(cache_entry_t *entry)
+{
+    if (entry != NULL)
+        {
+            free_hash_data_t(entry->hash_data);
+            free_variable(entry);
+        }
+}
+
+
+/**
+ * Frees a block cache and every block in it
+ * @param cache is the block_cache_t structure to be freed.
+ */
+static void free_block_cache_t(block_cache_t *cache)
+{
+    if (cache != NULL)
+        {
+            g_hash_table_destroy(cache->entries);
+            g_queue_free_full(cache->lru, (GDestroyNotify) free_cache_entry_t);
+            free_variable(cache);
+        }
+}
+
+
+/**
+ * Inserts a block into the cache evicting least recently used blocks
+ * if the cache becomes too big (the block just inserted is always kept).
+ * @param cache is the block cache.
+ * @param hash_data is the block to insert. It is owned by the cache
+ *        (and freed here if the cache already has this block).
+ */
+static void block_cache_insert(block_cache_t *cache, hash_data_t *hash_data)
+{
+    cache_entry_t *entry = NULL;
+
+    if (g_hash_table_contains(cache->entries, hash_data->hash) == TRUE)
+        {
+            free_hash_data_t(hash_data);
+        }
+    else
+        {
+            entry = (cache_entry_t *) g_malloc0(sizeof(cache_entry_t));
+            g_assert_nonnull(entry);
+
+            entry->hash_data = hash_data;
+            g_queue_push_head(cache->lru, entry);
+            entry->link = cache->lru->head;
+            g_hash_table_insert(cache->entries, hash_data->hash, entry);
+            cache->size = cache->size + hash_data->read;
+
+            while (cache->size > cache->max_size && g_queue_get_length(cache->lru) > 1)
+                {
+                    entry = (cache_entry_t *) g_queue_pop_tail(cache->lru);
+                    g_hash_table_remove(cache->entries, entry->hash_data->hash);
+                    cache->size = cache->size - entry->hash_data->read;
+                    free_cache_entry_t(entry);
+                }
+        }
+}
+
+
+/**
+ * Looks a block up in the cache and marks it as the most recently used
+ * @param cache is the block cache.
+ * @param hash is the binary hash of the block.
+ * @returns the block (owned by the cache) or NULL if it is not in the
+ *          cache.
+ */
+static hash_data_t *block_cache_lookup(block_cache_t *cache, guint8 *hash)
+{
+    cache_entry_t *entry = NULL;
+
+    entry = (cache_entry_t *) g_hash_table_lookup(cache->entries, hash);
+
+    if (entry != NULL)
+        {
+            g_queue_unlink(cache->lru, entry->link);
+            g_queue_push_head_link(cache->lru, entry->link);
+
+            return entry->hash_data;
+        }
+    else
+        {
+            return NULL;
+        }
+}
+
+
+/**
+ * Creates the file to be restored. Symbolic links are made here as
+ * they do not have any data.
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param meta is the whole meta_data file describing the file to be
+ *        restored.
+ * @returns a newly allocated plan_file_t structure that may be freed
+ *          with close_plan_file() or NULL if there is no data to write.
+ */
+plan_file_t *open_plan_file(res_struct_t *res_struct, meta_data_t *meta)
+{
+    plan_file_t *pfile = NULL;
+    gchar *filename = NULL;
+    GFile *file = NULL;
+    GFileOutputStream *stream = NULL;
+    GError *error = NULL;
+
+    filename = get_filename_to_restore(res_struct, meta);
+
+    if (filename != NULL)
+        {
+            file = g_file_new_for_path(filename);
+
+            if (g_strcmp0("", meta->link) == 0)
+                {
+                    if (res_struct->opt->parents == TRUE)
+                        {
+                            create_directory(g_path_get_dirname(filename));
+                        }
+
+                    stream = g_file_replace(file, NULL, TRUE, G_FILE_CREATE_NONE, NULL, &error);
+
+                    if (stream != NULL)
+                        {
+                            pfile = (plan_file_t *) g_malloc0(sizeof(plan_file_t));
+                            g_assert_nonnull(pfile);
+
+                            pfile->meta = meta;
+                            pfile->file = file;
+                            pfile->filename = filename;
+                            pfile->stream = stream;
+                            pfile->cursor = 0;
+                            pfile->written = 0;
+                            pfile->failed = FALSE;
+                            pfile->holes = FALSE;
+                        }
+                    else if (error != NULL)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to open file %s to write data in it (%s).\n"), filename, error->message);
+                            free_error(error);
+                        }
+                }
+            else
+                {
+                    make_symbolic_link(file, meta->link);
+                }
+
+            if (pfile == NULL)
+                {
+                    free_object(file);
+                    free_variable(filename);
+                }
+        }
+
+    return pfile;
+}
+
+
+/**
+ * Closes a restored file and sets its attributes
+ * @param pfile is the plan_file_t structure of the file. It is freed.
+ */
+void close_plan_file(plan_file_t *pfile)
+{
+    GError *error = NULL;
+
+    if (pfile != NULL)
+        {
+            if (pfile->holes == TRUE && pfile->failed == FALSE)
+                {
+                    end_restored_stream(pfile->stream, pfile->written);
+                }
+
+            g_output_stream_close((GOutputStream *) pfile->stream, NULL, &error);
+
+            if (error != NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while closing file %s: %s\n"), pfile->filename, error->message);
+                    free_error(error);
+                }
+
+            free_object(pfile->stream);
+
+            /* Setting before closing the file does not alter access and modification time */
+            set_file_attributes(pfile->file, pfile->meta);
+
+            if (pfile->failed == TRUE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: file %s has not been completely restored.\n"), pfile->filename);
+                }
+
+            print_debug(_("%" G_GUINT64_FORMAT " bytes restored into %s\n"), pfile->written, pfile->filename);
+
+            free_object(pfile->file);
+            free_variable(pfile->filename);
+            free_variable(pfile);
+        }
+}
+
+
+/**
+ * Opens files of the list until RESTORE_PLAN_MAX_FILES files are being
+ * written or until there is no more file to open.
+ * @param plan is the restore plan.
+ */
+static void open_next_files(restore_plan_t *plan)
+{
+    meta_data_t *meta = NULL;
+    plan_file_t *pfile = NULL;
+
+    while (plan->nb_active < RESTORE_PLAN_MAX_FILES && plan->next_smeta != NULL)
+        {
+            meta = get_meta_data_from_smeta_list(plan->next_smeta);
+            plan->next_smeta = g_slist_next(plan->next_smeta);
+
+            if (meta != NULL)
+                {
+                    pfile = open_plan_file(plan->res_struct, meta);
+
+                    if (pfile != NULL)
+                        {
+                            plan->active = g_list_append(plan->active, pfile);
+                            plan->nb_active = plan->nb_active + 1;
+                        }
+                }
+        }
+}
+
+
+/**
+ * Writes into a file every following block that is in the cache. Blocks
+ * of zeros become holes. A block that the server does not know fails the
+ * file: its size is unknown and following blocks can not be placed.
+ * @param plan is the restore plan.
+ * @param pfile is the file to write to.
+ */
+static void write_plan_file(restore_plan_t *plan, plan_file_t *pfile)
+{
+    guint8 *hash = NULL;
+    hash_data_t *block = NULL;
+    GError *error = NULL;
+    gboolean go_on = TRUE;
+    guint64 length = 0;
+
+    while (pfile->cursor < pfile->meta->nb_hashs && pfile->failed == FALSE && go_on == TRUE)
+        {
+            hash = pfile->meta->hashs + pfile->cursor * HASH_LEN;
+
+            if (g_hash_table_contains(plan->missing, hash) == TRUE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: block %" G_GUINT64_FORMAT " of file %s is unknown to the server\n"), pfile->cursor, pfile->filename);
+                    pfile->failed = TRUE;
+                }
+            else if (is_zero_hash(hash, &length) == TRUE)
+                {
+                    if (seek_over_hole(pfile->stream, length, &error) == TRUE)
+                        {
+                            pfile->written = pfile->written + length;
+                            pfile->holes = TRUE;
+                            pfile->cursor = pfile->cursor + 1;
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while making a hole in restored file: %s\n"), error->message);
+                            free_error(error);
+                            error = NULL;
+                            pfile->failed = TRUE;
+                        }
+                }
+            else
+                {
+                    block = block_cache_lookup(plan->cache, hash);
+
+                    if (block == NULL)
+                        {
+                            go_on = FALSE;
+                        }
+                    else if (g_output_stream_write_all((GOutputStream *) pfile->stream, block->data, block->read, NULL, NULL, &error) == TRUE)
+                        {
+                            pfile->written = pfile->written + block->read;
+                            plan->needed = plan->needed + 1;
+                            pfile->cursor = pfile->cursor + 1;
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while writing restored data: %s\n"), error->message);
+                            free_error(error);
+                            error = NULL;
+                            pfile->failed = TRUE;
+                        }
+                }
+        }
+}
+
+
+/**
+ * Writes into every file being restored what can be written.
+ * @param plan is the restore plan.
+ */
+static void write_all_plan_files(restore_plan_t *plan)
+{
+    GList *iter = plan->active;
+
+    while (iter != NULL)
+        {
+            write_plan_file(plan, iter->data);
+            iter = g_list_next(iter);
+        }
+}
+
+
+/**
+ * Closes files that have been completely written (or that failed).
+ * @param plan is the restore plan.
+ */
+static void close_finished_files(restore_plan_t *plan)
+{
+    GList *iter = plan->active;
+    GList *next = NULL;
+    plan_file_t *pfile = NULL;
+
+    while (iter != NULL)
+        {
+            next = g_list_next(iter);
+            pfile = iter->data;
+
+            if (pfile->cursor >= pfile->meta->nb_hashs || pfile->failed == TRUE)
+                {
+                    close_plan_file(pfile);
+                    plan->active = g_list_delete_link(plan->active, iter);
+                    plan->nb_active = plan->nb_active - 1;
+                }
+
+            iter = next;
+        }
+}
+
+
+/**
+ * Callback called when a batch of blocks has been retrieved from the
+ * server. Each block is put into the cache and files are written as
+ * soon as possible in order to use blocks before they may be evicted.
+ * Requested hashs that are not in the answer are marked as missing.
+ * @param success is the CURLcode of the request.
+ * @param url is the url of the request.
+ * @param readbuffer is NULL for GET requests.
+ * @param length is the length of answer.
+ * @param answer is the answer of the server (freed by the caller).
+ * @param user_data is the plan_batch_t * of the request. It is freed
+ *        here.
+ */
+static void plan_batch_received(gint success, gchar *url, gchar *readbuffer, size_t length, gchar *answer, gpointer user_data)
+{
+    plan_batch_t *batch = (plan_batch_t *) user_data;
+    restore_plan_t *plan = batch->plan;
+    GList *head = NULL;
+    GList *iter = NULL;
+    hash_data_t *hash_data = NULL;
+    gboolean valid = FALSE;
+    gchar *hash = NULL;
+
+    if (success == CURLE_OK && answer != NULL)
+        {
+            head = extract_glist_from_binary_array((guchar *) answer, length, &valid);
+
+            if (valid == FALSE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: malformed answer from %s\n"), url);
+                }
+        }
+
+    iter = head;
+    while (iter != NULL)
+        {
+            hash_data = iter->data;
+            g_hash_table_remove(plan->in_flight, hash_data->hash);
+            block_cache_insert(plan->cache, hash_data);
+            plan->fetched = plan->fetched + 1;
+            write_all_plan_files(plan);
+            iter = g_list_next(iter);
+        }
+    g_list_free(head);
+
+    iter = batch->hash_list;
+    while (iter != NULL)
+        {
+            hash_data = iter->data;
+
+            if (g_hash_table_remove(plan->in_flight, hash_data->hash) == TRUE)
+                {
+                    hash = hash_to_string(hash_data->hash);
+                    print_error(__FILE__, __LINE__, _("Error while trying to restore block %s\n"), hash);
+                    free_variable(hash);
+                    g_hash_table_add(plan->missing, hash_data->hash);
+                }
+
+            iter = g_list_next(iter);
+        }
+
+    write_all_plan_files(plan);
+
+    /* hashs of the list belong to meta data of the files */
+    g_list_free_full(batch->hash_list, g_free);
+    free_variable(batch);
+}
+
+
+/**
+ * Sends one /Data/Hash_Array.bin request
+ * @param plan is the restore plan.
+ * @param hash_list is a GList of at most max hash_data_t * whose blocks
+ *        are requested. It is owned by the request but the hashs of its
+ *        elements point into meta data of the files.
+ * @param max is the maximum number of hashs of a request.
+ */
+static void send_plan_batch(restore_plan_t *plan, GList *hash_list, guint max)
+{
+    plan_batch_t *batch = NULL;
+    hash_extract_t *hash_extract = NULL;
+    gchar *header = NULL;
+
+    batch = (plan_batch_t *) g_malloc0(sizeof(plan_batch_t));
+    g_assert_nonnull(batch);
+
+    batch->plan = plan;
+    batch->hash_list = hash_list;
+
+    hash_extract = new_hash_extract_t();
+    hash_extract->hash_list = hash_list;
+    header = create_x_get_hash_array_http_header(hash_extract, max);
+    free_variable(hash_extract);
+
+    get_url_async(plan->res_struct->comm, "/Data/Hash_Array.bin", header, plan_batch_received, batch);
+
+    free_variable(header);
+}
+
+
+/**
+ * Requests the blocks that files will need soon: for each file being
+ * written the blocks of the next hashs that are neither in the cache
+ * nor already requested. Enough hashs are looked at to keep every
+ * possible request in flight.
+ * @param plan is the restore plan.
+ */
+static void request_needed_blocks(restore_plan_t *plan)
+{
+    GList *iter = NULL;
+    GList *hash_list = NULL;
+    plan_file_t *pfile = NULL;
+    guint8 *hash = NULL;
+    guint64 cursor = 0;
+    guint max = 0;
+    guint window = 0;
+    guint nb_hashs = 0;
+    guint i = 0;
+
+    iter = plan->active;
+    while (iter != NULL)
+        {
+            pfile = iter->data;
+            max = calculate_max_number_of_hashs(pfile->meta->size);
+            window = max * MAX(plan->res_struct->comm->max_in_flight, 1);
+            cursor = pfile->cursor;
+            hash_list = NULL;
+            nb_hashs = 0;
+            i = 0;
+
+            while (cursor < pfile->meta->nb_hashs && i < window)
+                {
+                    hash = pfile->meta->hashs + cursor * HASH_LEN;
+
+                    if (is_zero_hash(hash, NULL) == FALSE && g_hash_table_contains(plan->missing, hash) == FALSE && g_hash_table_contains(plan->in_flight, hash) == FALSE && g_hash_table_contains(plan->cache->entries, hash) == FALSE)
+                        {
+                            g_hash_table_add(plan->in_flight, hash);
+                            hash_list = g_list_prepend(hash_list, new_hash_data_t_as_is(NULL, 0, hash, COMPRESS_NONE_TYPE, 0));
+                            nb_hashs = nb_hashs + 1;
+
+                            if (nb_hashs == max)
+                                {
+                                    send_plan_batch(plan, g_list_reverse(hash_list), max);
+                                    hash_list = NULL;
+                                    nb_hashs = 0;
+                                }
+                        }
+
+                    i = i + 1;
+                    cursor = cursor + 1;
+                }
+
+            if (hash_list != NULL)
+                {
+                    send_plan_batch(plan, g_list_reverse(hash_list), max);
+                }
+
+            iter = g_list_next(iter);
+        }
+}
+
+
+/**
+ * Restores each file of the list with the planner: each distinct block
+ * is fetched once (unless evicted from the cache before being used
+ * again) and up to RESTORE_PLAN_MAX_FILES files are written at the same
+ * time. The server must understand /Data/Hash_Array.bin.
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param list is a GSList of smeta structures representing files to be
+ *        restored.
+ */
+void restore_planned_files(res_struct_t *res_struct, GSList *list)
+{
+    restore_plan_t plan;
+    gint64 span = 0;
+
+    if (res_struct != NULL && res_struct->comm != NULL)
+        {
+            span = trace_begin();
+
+            plan.res_struct = res_struct;
+            plan.next_smeta = list;
+            plan.active = NULL;
+            plan.nb_active = 0;
+            plan.cache = new_block_cache_t(RESTORE_CACHE_SIZE);
+            plan.in_flight = new_hash_index();
+            plan.missing = new_hash_index();
+            plan.fetched = 0;
+            plan.needed = 0;
+
+            open_next_files(&plan);
+
+            while (plan.active != NULL)
+                {
+                    request_needed_blocks(&plan);
+                    comm_wait_all_requests(res_struct->comm);
+
+                    write_all_plan_files(&plan);
+                    close_finished_files(&plan);
+                    open_next_files(&plan);
+                }
+
+            print_debug(_("%" G_GUINT64_FORMAT " blocks restored with %" G_GUINT64_FORMAT " blocks fetched\n"), plan.needed, plan.fetched);
+
+            g_hash_table_destroy(plan.in_flight);
+            g_hash_table_destroy(plan.missing);
+            free_block_cache_t(plan.cache);
+
+            trace_end(span, "Files restored in");
+        }
+}
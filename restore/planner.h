@@ -0,0 +1,151 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    planner.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file planner.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the restore planner. When many files are restored at once the
+ * planner fetches each distinct block only once, keeps decoded blocks
+ * in a bounded LRU cache and writes several files at the same time.
+ */
+#ifndef _RESTORE_PLANNER_H_
+#define _RESTORE_PLANNER_H_
+
+
+/**
+ * @def RESTORE_CACHE_SIZE
+ * Defines the maximum number of bytes of decoded blocks kept in the
+ * block cache (64 MB). Blocks that are evicted before being written
+ * again are simply fetched again.
+ */
+#define RESTORE_CACHE_SIZE (67108864)
+
+
+/**
+ * @def RESTORE_PLAN_MAX_FILES
+ * Defines the number of files that are written at the same time.
+ */
+#define RESTORE_PLAN_MAX_FILES (8)
+
+
+/**
+ * @struct cache_entry_t
+ * @brief One decoded block of the block cache.
+ */
+typedef struct
+{
+    hash_data_t *hash_data; /**< the block (its hash is the key of the entry)  */
+    GList *link;            /**< element of the lru queue of this entry        */
+} cache_entry_t;
+
+
+/**
+ * @struct block_cache_t
+ * @brief Bounded LRU cache of decoded blocks.
+ */
+typedef struct
+{
+    GHashTable *entries;  /**< hash (guint8 *) -> cache_entry_t *                      */
+    GQueue *lru;          /**< cache_entry_t * with most recently used at head         */
+    guint64 size;         /**< number of bytes of data in the cache                    */
+    guint64 max_size;     /**< maximum number of bytes of data in the cache            */
+} block_cache_t;
+
+
+/**
+ * @struct plan_file_t
+ * @brief A file being written by the planner.
+ */
+typedef struct
+{
+    meta_data_t *meta;          /**< meta data of the file (not owned)              */
+    GFile *file;                /**< the file being restored                        */
+    gchar *filename;            /**< its name                                       */
+    GFileOutputStream *stream;  /**< stream where data is written                   */
+    guint64 cursor;             /**< index in meta->hashs of the next block to write */
+    guint64 written;            /**< number of bytes written                        */
+    gboolean failed;            /**< TRUE on a write error or a missing block        */
+    gboolean holes;             /**< TRUE when holes have been seeked over          */
+} plan_file_t;
+
+
+/**
+ * @struct restore_plan_t
+ * @brief Everything the planner needs to restore a list of files.
+ */
+typedef struct
+{
+    res_struct_t *res_struct;   /**< main structure of cdpfglrestore                     */
+    GSList *next_smeta;         /**< next server_meta_data_t * to be opened              */
+    GList *active;              /**< plan_file_t * being written                         */
+    guint nb_active;            /**< number of elements in active                        */
+    block_cache_t *cache;       /**< decoded blocks                                      */
+    GHashTable *in_flight;      /**< hashs requested and not received yet                */
+    GHashTable *missing;        /**< hashs the server does not know                      */
+    guint64 fetched;            /**< number of blocks fetched from the server            */
+    guint64 needed;             /**< number of blocks written into files                 */
+} restore_plan_t;
+
+
+/**
+ * @struct plan_batch_t
+ * @brief user_data of one /Data/Hash_Array.bin request of the planner.
+ */
+typedef struct
+{
+    restore_plan_t *plan;  /**< the plan this batch belongs to              */
+    GList *hash_list;      /**< hash_data_t * requested (hashs not owned)   */
+} plan_batch_t;
+
+
+/**
+ * Creates the file to be restored. Symbolic links are made here as
+ * they do not have any data.
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param meta is the whole meta_data file describing the file to be
+ *        restored.
+ * @returns a newly allocated plan_file_t structure that may be freed
+ *          with close_plan_file() or NULL if there is no data to write.
+ */
+extern plan_file_t *open_plan_file(res_struct_t *res_struct, meta_data_t *meta);
+
+
+/**
+ * Closes a restored file and sets its attributes
+ * @param pfile is the plan_file_t structure of the file. It is freed.
+ */
+extern void close_plan_file(plan_file_t *pfile);
+
+
+/**
+ * Restores each file of the list with the planner: each distinct block
+ * is fetched once (unless evicted from the cache before being used
+ * again) and up to RESTORE_PLAN_MAX_FILES files are written at the same
+ * time. The server must understand /Data/Hash_Array.bin.
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param list is a GSList of smeta structures representing files to be
+ *        restored.
+ */
+extern void restore_planned_files(res_struct_t *res_struct, GSList *list);
+
+
+#endif /* #ifndef _RESTORE_PLANNER_H_ */
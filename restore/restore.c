@@ -35,12 +35,16 @@ static query_t *get_user_infos(gchar *hostname, gchar *filename, options_t *opt)
 static query_t *new_query_from_filename(gchar *hostname, gchar *filename);
 static gchar *add_on_field_to_request(gchar *request, gchar *field, gchar *value);
 static gchar *add_on_boolean_field_to_request(gchar *request, gchar *field, gboolean value);
-static gchar *make_base_request(query_t *query);
+static gchar *make_base_request(gchar *url, query_t *query);
 static GSList *get_files_from_server(res_struct_t *res_struct, query_t *query);
 static void print_list_of_smeta(GSList *list);
 static void print_all_files(res_struct_t *res_struct, query_t *query);
 static void print_all_versions(res_struct_t *res_struct, query_t *query);
-static void restore_data_to_stream(res_struct_t *res_struct, GFileOutputStream *stream, GList *hash_list, gint max);
+static void write_pending_batches(restore_stream_t *restore_stream);
+static gint count_hashs_before_hole(GList *hash_list, gint max);
+static hash_data_t *convert_binary_answer_to_hash_data(guchar *answer, guint64 length);
+static void restore_batch_received(gint success, gchar *url, gchar *readbuffer, size_t length, gchar *answer, gpointer user_data);
+static gboolean restore_data_to_stream(res_struct_t *res_struct, GFileOutputStream *stream, GList *hash_list, gint max);
 static void create_file(res_struct_t *res_struct, meta_data_t *meta);
 static void print_debug_file_info(meta_data_t *meta);
 static void restore_one_file(res_struct_t *res_struct, GSList *elem);
@@ -101,6 +105,10 @@ static res_struct_t *init_res_struct(int argc, char **argv)
             conn = make_connexion_string(res_struct->opt->srv_conf);
             res_struct->comm = init_comm_struct(conn, COMPRESS_NONE_TYPE);
 
+            /* Tells us which protocols the server understands */
+            is_server_alive(res_struct->comm);
+            comm_enable_multi(res_struct->comm, res_struct->opt->parallel);
+
             set_res_struct_hostname(res_struct, res_struct->opt->r_hostname);
         }
     else
@@ -286,23 +294,52 @@ static gchar *add_on_boolean_field_to_request(gchar *request, gchar *field, gboo
 
 /**
  * Makes the base URL for all requests
+ * @param url is the url of the request (/File/List.json or
+ *        /File/Archive.bin).
  * @param query is the structure that contains everything needed to
  *        query the server (and filter a bit). It must not be NULL.
  * @returns always returns a newly allocated gchar * that represents
  *          the base of the right part of the URL for all requests.
  */
-static gchar *make_base_request(query_t *query)
+static gchar *make_base_request(gchar *url, query_t *query)
 {
     gchar *request = NULL;
 
     if (query != NULL)
         {
             /* This is the base request */
-            request = g_strdup_printf("/File/List.json?hostname=%s&uid=%s&gid=%s&owner=%s&group=%s&filename=%s", query->hostname, query->uid, query->gid, query->owner, query->group, query->filename);
+            request = g_strdup_printf("%s?hostname=%s&uid=%s&gid=%s&owner=%s&group=%s&filename=%s", url, query->hostname, query->uid, query->gid, query->owner, query->group, query->filename);
         }
     else
         {
-             request = g_strdup_printf("/File/List.json?");
+             request = g_strdup_printf("%s?", url);
+        }
+
+    return request;
+}
+
+
+/**
+ * Makes the whole request (with the date filters) of a query.
+ * @param url is the url of the request (/File/List.json or
+ *        /File/Archive.bin).
+ * @param query is the structure that contains everything needed to
+ *        query the server (and filter a bit). It must not be NULL.
+ * @returns a newly allocated gchar * request that may be freed with
+ *          free_variable() when no longer needed.
+ */
+gchar *make_query_request(gchar *url, query_t *query)
+{
+    gchar *request = NULL;
+
+    request = make_base_request(url, query);
+
+    if (query != NULL)
+        {
+            request = add_on_field_to_request(request, "date", query->date);
+            request = add_on_field_to_request(request, "afterdate", query->afterdate);
+            request = add_on_field_to_request(request, "beforedate", query->beforedate);
+            request = add_on_boolean_field_to_request(request, "latest",  query->latest);
         }
 
     return request;
@@ -325,11 +362,7 @@ static GSList *get_files_from_server(res_struct_t *res_struct, query_t *query)
 
     if (res_struct != NULL && query != NULL)
         {
-            request = make_base_request(query);
-            request = add_on_field_to_request(request, "date", query->date);
-            request = add_on_field_to_request(request, "afterdate", query->afterdate);
-            request = add_on_field_to_request(request, "beforedate", query->beforedate);
-            request = add_on_boolean_field_to_request(request, "latest",  query->latest);
+            request = make_query_request("/File/List.json", query);
 
             print_debug(_("Query is: %s\n"), request);
             res = get_url(res_struct->comm, request, NULL);
@@ -402,7 +435,7 @@ static void print_all_files(res_struct_t *res_struct, query_t *query)
  * @returns the meta_data_t * structure pointer from that list element
  *          ie : list->data->meta if it exists or NULL otherwise.
  */
-static meta_data_t *get_meta_data_from_smeta_list(GSList *list)
+meta_data_t *get_meta_data_from_smeta_list(GSList *list)
 {
     server_meta_data_t *smeta = NULL;
     meta_data_t *meta = NULL;
@@ -462,88 +495,332 @@ static void print_all_versions(res_struct_t *res_struct, query_t *query)
 }
 
 
+/**
+ * Makes a hole of length bytes in the file being restored: the stream
+ * is seeked over it instead of writing zeros. The file has to be
+ * truncated to its size by end_restored_stream() if it ends with a hole.
+ * @param stream is the stream of the file being restored.
+ * @param length is the length of the hole.
+ * @param[out] error is set if the stream could not be seeked.
+ * @returns TRUE on success, FALSE otherwise.
+ */
+gboolean seek_over_hole(GFileOutputStream *stream, guint64 length, GError **error)
+{
+    return g_seekable_seek(G_SEEKABLE(stream), (goffset) length, G_SEEK_CUR, NULL, error);
+}
+
+
+/**
+ * Sets the size of a restored file in which holes have been made (a
+ * hole at the end of the file is not written by seeking).
+ * @param stream is the stream of the file being restored.
+ * @param size is the size of the restored file.
+ */
+void end_restored_stream(GFileOutputStream *stream, guint64 size)
+{
+    GError *error = NULL;
+
+    if (g_seekable_truncate(G_SEEKABLE(stream), (goffset) size, NULL, &error) == FALSE && error != NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error while setting the size of restored file: %s\n"), error->message);
+            free_error(error);
+        }
+}
+
+
+/**
+ * Writes, in order, every pending batch that may be written (ie whose
+ * previous batches have all been written). A batch without data is a
+ * hole. A failed batch (NULL hash_data) fails the whole file: its length
+ * is unknown so the following batches can not be written where they
+ * belong.
+ * @param restore_stream is the restore_stream_t of the file being
+ *        restored.
+ */
+static void write_pending_batches(restore_stream_t *restore_stream)
+{
+    hash_data_t *hash_data = NULL;
+    GError *error = NULL;
+    gpointer key = GUINT_TO_POINTER(restore_stream->next);
+
+    while (g_hash_table_contains(restore_stream->pending, key) == TRUE)
+        {
+            hash_data = g_hash_table_lookup(restore_stream->pending, key);
+
+            if (hash_data == NULL)
+                {
+                    restore_stream->failed = TRUE;
+                }
+            else if (hash_data->data == NULL && restore_stream->failed == FALSE)
+                {
+                    if (seek_over_hole(restore_stream->stream, hash_data->read, &error) == TRUE)
+                        {
+                            restore_stream->written = restore_stream->written + hash_data->read;
+                            restore_stream->holes = TRUE;
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while making a hole in restored file: %s\n"), error->message);
+                            free_error(error);
+                            error = NULL;
+                            restore_stream->failed = TRUE;
+                        }
+                }
+            else if (restore_stream->failed == FALSE)
+                {
+                    if (g_output_stream_write_all((GOutputStream *) restore_stream->stream, hash_data->data, hash_data->read, NULL, NULL, &error) == TRUE)
+                        {
+                            restore_stream->written = restore_stream->written + hash_data->read;
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error while writing restored data: %s\n"), error->message);
+                            free_error(error);
+                            error = NULL;
+                            restore_stream->failed = TRUE;
+                        }
+                }
+
+            g_hash_table_remove(restore_stream->pending, key);
+            restore_stream->next = restore_stream->next + 1;
+            key = GUINT_TO_POINTER(restore_stream->next);
+        }
+}
+
+
+/**
+ * @param hash_list is a GList of hash_data_t * whose first hash is not
+ *        a zero hash.
+ * @param max is the maximum number of hashs to count.
+ * @returns the number of hashs at the beginning of hash_list that come
+ *          before the first zero hash (at most max).
+ */
+static gint count_hashs_before_hole(GList *hash_list, gint max)
+{
+    hash_data_t *hash_data = NULL;
+    gint count = 0;
+
+    while (hash_list != NULL && count < max)
+        {
+            hash_data = hash_list->data;
+
+            if (is_zero_hash(hash_data->hash, NULL) == TRUE)
+                {
+                    hash_list = NULL;
+                }
+            else
+                {
+                    count = count + 1;
+                    hash_list = g_list_next(hash_list);
+                }
+        }
+
+    return count;
+}
+
+
+/**
+ * Gathers the data of the blocks of a /Data/Hash_Array.bin answer (a
+ * binary data array of uncompressed blocks). Blocks are moved in place
+ * to the beginning of answer and copied once.
+ * @param answer is the answer of the server. It is modified.
+ * @param length is the length in bytes of answer.
+ * @returns a newly allocated hash_data_t structure whose data is the
+ *          concatenation of the blocks or NULL if answer is malformed.
+ */
+static hash_data_t *convert_binary_answer_to_hash_data(guchar *answer, guint64 length)
+{
+    guint64 pos = 0;
+    guint64 size = 0;
+    guint64 data_len = 0;
+    gboolean ok = TRUE;
+    hash_data_t *hash_data = NULL;
+
+    while (pos < length && ok == TRUE)
+        {
+            if (length - pos >= BIN_DATA_ARRAY_HEADER_SIZE && get_guint16_from_buffer(answer + pos + HASH_LEN) == COMPRESS_NONE_TYPE)
+                {
+                    data_len = get_guint64_from_buffer(answer + pos + HASH_LEN + 12);
+
+                    if (data_len <= length - pos - BIN_DATA_ARRAY_HEADER_SIZE)
+                        {
+                            memmove(answer + size, answer + pos + BIN_DATA_ARRAY_HEADER_SIZE, data_len);
+                            size = size + data_len;
+                            pos = pos + BIN_DATA_ARRAY_HEADER_SIZE + data_len;
+                        }
+                    else
+                        {
+                            ok = FALSE;
+                        }
+                }
+            else
+                {
+                    ok = FALSE;
+                }
+        }
+
+    if (ok == TRUE)
+        {
+            hash_data = new_hash_data_t_as_is((guchar *) g_memdup(answer, size), size, NULL, COMPRESS_NONE_TYPE, size);
+        }
+
+    return hash_data;
+}
+
+
+/**
+ * Callback called when a batch of hashs has been retrieved from the
+ * server. It decodes the batch and writes it (and every following batch
+ * that was waiting for it) if it is the next one to be written.
+ * @param success is the CURLcode of the request.
+ * @param url is the url of the request.
+ * @param readbuffer is NULL for GET requests.
+ * @param length is the length of answer.
+ * @param answer is the answer of the server (freed by the caller).
+ * @param user_data is the restore_batch_t * of the request. It is freed
+ *        here.
+ */
+static void restore_batch_received(gint success, gchar *url, gchar *readbuffer, size_t length, gchar *answer, gpointer user_data)
+{
+    restore_batch_t *batch = (restore_batch_t *) user_data;
+    restore_stream_t *restore_stream = batch->restore_stream;
+    hash_data_t *hash_data = NULL;
+
+    if (success == CURLE_OK && answer != NULL)
+        {
+            if (g_str_has_prefix(url, "/Data/Hash_Array.bin"))
+                {
+                    hash_data = convert_binary_answer_to_hash_data((guchar *) answer, length);
+                }
+            else
+                {
+                    hash_data = convert_string_to_hash_data(answer);
+                }
+        }
+
+    if (hash_data == NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error while trying to restore batch %d of hashs\n"), batch->number);
+        }
+
+    g_hash_table_insert(restore_stream->pending, GUINT_TO_POINTER(batch->number), hash_data);
+    write_pending_batches(restore_stream);
+
+    free_variable(batch);
+}
+
+
 /**
  * Writes data obtained from the server with the hash_list hashs
- * to the stream.
+ * to the stream. Up to res_struct->opt->parallel batches of max hashs
+ * are requested at the same time. Blocks of zeros (zero hashs) are not
+ * requested: they are batches of their own that become holes.
+ * @param res_struct is the main structure for cdpfglrestore program.
  * @param stream is the stream where we are writing data (MUST be opened
  *        and not NULL)
  * @param hash_list list of hashs of the file to be restored
  * @param max is the maximum number of hashs to include into the header
- * @todo error management.
+ * @returns TRUE if every batch has been retrieved and written and FALSE
+ *          otherwise (the file is then not restored).
  */
-static void restore_data_to_stream(res_struct_t *res_struct, GFileOutputStream *stream, GList *hash_list, gint max)
+static gboolean restore_data_to_stream(res_struct_t *res_struct, GFileOutputStream *stream, GList *hash_list, gint max)
 {
-    gchar *hash = NULL;
-    hash_data_t *hash_data = NULL;
     hash_extract_t *hash_extract = NULL;
-    GError *error = NULL;
-    gchar *request = NULL;
+    restore_stream_t restore_stream;
+    restore_batch_t *batch = NULL;
+    hash_data_t *hash_data = NULL;
     gchar *header = NULL;
-    gint res = CURLE_FAILED_INIT;
+    gchar *url = NULL;
+    guint number = 0;
+    guint64 length = 0;
+    gboolean restored = FALSE;
 
     if (stream != NULL)
         {
+            if (res_struct->comm->hash_array_bin == TRUE)
+                {
+                    url = "/Data/Hash_Array.bin";
+                }
+            else
+                {
+                    url = "/Data/Hash_Array.json";
+                }
+
+            restore_stream.stream = stream;
+            restore_stream.pending = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) free_hash_data_t);
+            restore_stream.next = 0;
+            restore_stream.written = 0;
+            restore_stream.failed = FALSE;
+            restore_stream.holes = FALSE;
+
             hash_extract = new_hash_extract_t();
             hash_extract->hash_list = hash_list;
 
-            while (hash_extract->hash_list != NULL)
+            while (hash_extract->hash_list != NULL && restore_stream.failed == FALSE)
                 {
+                    hash_data = hash_extract->hash_list->data;
 
-                    header = create_x_get_hash_array_http_header(hash_extract, max);
-                    request = g_strdup_printf("/Data/Hash_Array.json");
-                    print_debug(_("Query is: %s with header %s\n"), request, header);
-                    res = get_url(res_struct->comm, request, header);
-
-                    if (res == CURLE_OK)
+                    if (is_zero_hash(hash_data->hash, &length) == TRUE)
                         {
-                            /** We need to save the retrieved buffer */
-                            if (res_struct->comm->buffer != NULL)
-                                {
-                                    hash_data = convert_string_to_hash_data(res_struct->comm->buffer);
-                                    free_variable(res_struct->comm->buffer);
-                                    res_struct->comm->buffer = NULL; /* This is a way to know that this variable has been freed */
-
-                                    if (hash_data != NULL)
-                                        {
-                                            g_output_stream_write((GOutputStream *) stream, hash_data->data, hash_data->read, NULL, &error);
-                                            free_hash_data_t(hash_data);
-                                        }
-                                    else
-                                        {
-                                            print_error(__FILE__, __LINE__, _("Error while trying to restore %s hash\n"), hash);
-                                        }
-                                }
+                            g_hash_table_insert(restore_stream.pending, GUINT_TO_POINTER(number), new_hash_data_t_as_is(NULL, length, NULL, COMPRESS_NONE_TYPE, length));
+                            number = number + 1;
+                            hash_extract->hash_list = g_list_next(hash_extract->hash_list);
+                            write_pending_batches(&restore_stream);
                         }
                     else
                         {
-                            print_error(__FILE__, __LINE__, _("Error while getting hash %s"), hash);
+                            header = create_x_get_hash_array_http_header(hash_extract, count_hashs_before_hole(hash_extract->hash_list, max));
+                            print_debug(_("Query is: %s with header %s\n"), url, header);
+
+                            batch = (restore_batch_t *) g_malloc0(sizeof(restore_batch_t));
+                            batch->restore_stream = &restore_stream;
+                            batch->number = number;
+                            number = number + 1;
+
+                            get_url_async(res_struct->comm, url, header, restore_batch_received, batch);
+
+                            free_variable(header);
                         }
+                }
+
+            comm_wait_all_requests(res_struct->comm);
 
-                    free_variable(request);
-                    free_variable(header);
+            if (restore_stream.holes == TRUE && restore_stream.failed == FALSE)
+                {
+                    end_restored_stream(stream, restore_stream.written);
+                }
+
+            print_debug(_("%" G_GUINT64_FORMAT " bytes restored in %d batches\n"), restore_stream.written, number);
+
+            if (restore_stream.failed == FALSE)
+                {
+                    restored = TRUE;
                 }
+
+            g_hash_table_destroy(restore_stream.pending);
+            free_variable(hash_extract);
         }
+
+    return restored;
 }
 
 
 /**
- * Creates the file to be restored.
- * @param res_struct is the main structure for cdpfglrestore program (used here
- *        to communicate with cdpfglserver's server).
+ * Computes the name of the file to be restored from command line's
+ * options (where, parents, all versions).
+ * @param res_struct is the main structure for cdpfglrestore program.
  * @param meta is the whole meta_data file describing the file to be
  *        restored
+ * @returns a newly allocated filename that may be freed with
+ *          free_variable() when no longer needed or NULL.
  */
-static void create_file(res_struct_t *res_struct, meta_data_t *meta)
+gchar *get_filename_to_restore(res_struct_t *res_struct, meta_data_t *meta)
 {
-    GFile *file = NULL;
     gchar *basename = NULL;    /** basename for the file to be restored       */
     gchar *newname = NULL;     /** Effective name that the file will have     */
     gchar *where = NULL;       /** directory where to restore the file        */
     gchar *filename = NULL;    /** filename of the restored file              */
-    GFileOutputStream *stream =  NULL;
-    GError *error = NULL;
     options_t *opt = NULL;
-    gint max = 0;
     gchar *the_date = NULL;    /** String containing file's last modified date */
 
     if (res_struct != NULL && meta != NULL && res_struct->opt != NULL)
@@ -586,11 +863,42 @@ static void create_file(res_struct_t *res_struct, meta_data_t *meta)
             filename = get_unique_filename(opt->all_versions, basename, where, newname, the_date);
 
             print_debug(_("filename to restore: %s\n"), filename);
+
+            free_variable(where);
+            free_variable(basename);
+            free_variable(newname);
+            free_variable(the_date);
+        }
+
+    return filename;
+}
+
+
+/**
+ * Creates the file to be restored.
+ * @param res_struct is the main structure for cdpfglrestore program (used here
+ *        to communicate with cdpfglserver's server).
+ * @param meta is the whole meta_data file describing the file to be
+ *        restored
+ */
+static void create_file(res_struct_t *res_struct, meta_data_t *meta)
+{
+    GFile *file = NULL;
+    gchar *filename = NULL;    /** filename of the restored file              */
+    GFileOutputStream *stream =  NULL;
+    GError *error = NULL;
+    GList *hash_list = NULL;   /** hashs of the file for the requests' headers */
+    gint max = 0;
+
+    filename = get_filename_to_restore(res_struct, meta);
+
+    if (filename != NULL)
+        {
             file = g_file_new_for_path(filename);
 
             if (g_strcmp0("", meta->link) == 0)
                 {
-                    if (opt->parents == TRUE)
+                    if (res_struct->opt->parents == TRUE)
                         {
                             create_directory(g_path_get_dirname(filename));
                         }
@@ -599,7 +907,12 @@ static void create_file(res_struct_t *res_struct, meta_data_t *meta)
                     if (stream != NULL)
                         {
                             max = calculate_max_number_of_hashs(meta->size);
-                            restore_data_to_stream(res_struct, stream, meta->hash_data_list, max);
+                            hash_list = make_hash_data_list_from_hash_array(meta->hashs, meta->nb_hashs);
+                            if (restore_data_to_stream(res_struct, stream, hash_list, max) == FALSE)
+                                {
+                                    print_error(__FILE__, __LINE__, _("Error: file %s has not been restored.\n"), filename);
+                                }
+                            g_list_free_full(hash_list, free_hdt_struct);
                             g_output_stream_close((GOutputStream *) stream, NULL, &error);
                             free_object(stream);
                         }
@@ -618,11 +931,7 @@ static void create_file(res_struct_t *res_struct, meta_data_t *meta)
                 }
 
             free_object(file);
-            free_variable(where);
-            free_variable(basename);
             free_variable(filename);
-            free_variable(newname);
-            free_variable(the_date);
         }
 }
 
@@ -705,7 +1014,9 @@ static void restore_last_file(res_struct_t *res_struct, query_t *query)
 
 
 /**
- * Retores each file of the list
+ * Retores each file of the list. When the server understands
+ * /Data/Hash_Array.bin the planner is used to fetch blocks shared by
+ * files only once and to write several files at the same time.
  * @param res_struct is the main structure for cdpfglrestore program. It
  *         is needed by create_file function called here in order to know
  *         what to do upon command line's options
@@ -714,10 +1025,17 @@ static void restore_last_file(res_struct_t *res_struct, query_t *query)
  */
 static void restore_list_of_smeta(res_struct_t *res_struct, GSList *list)
 {
-    while (list != NULL)
+    if (res_struct != NULL && res_struct->comm != NULL && res_struct->comm->hash_array_bin == TRUE)
         {
-            restore_one_file(res_struct, list);
-            list = g_slist_next(list);
+            restore_planned_files(res_struct, list);
+        }
+    else
+        {
+            while (list != NULL)
+                {
+                    restore_one_file(res_struct, list);
+                    list = g_slist_next(list);
+                }
         }
 }
 
@@ -778,7 +1096,9 @@ static void free_res_struct_t(res_struct_t *res_struct)
 
 
 /**
- * Restores all files that the fetched list contains.
+ * Restores all files that the fetched list contains. When the server
+ * knows /File/Archive.bin they are all restored from one streamed
+ * archive.
  * @param res_struct is the main structure for cdpfglrestore program.
  * @param query is the structure that contains everything needed to
  *        query the server (and filter a bit). It must not be NULL.
@@ -787,7 +1107,11 @@ static void restore_all_files(res_struct_t *res_struct, query_t *query)
 {
     GSList *list = NULL;      /** List of server_meta_data_t *        */
 
-    if (res_struct != NULL && query != NULL)
+    if (res_struct != NULL && query != NULL && res_struct->comm->file_archive == TRUE)
+        {
+            restore_files_from_archive(res_struct, query);
+        }
+    else if (res_struct != NULL && query != NULL)
         {
             list = get_files_from_server(res_struct, query);
 
@@ -880,6 +1204,7 @@ int main(int argc, char **argv)
                     restore_files(res_struct);
                 }
 
+            trace_dump();
             free_res_struct_t(res_struct);
 
             return EXIT_SUCCESS;
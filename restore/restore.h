@@ -46,6 +46,44 @@
 
 #include "options.h"
 
+/**
+ * @def RESTORE_MAX_IN_FLIGHT
+ * Default number of X-Get-Hash-Array requests kept in flight while
+ * restoring a file.
+ */
+#define RESTORE_MAX_IN_FLIGHT (4)
+
+
+/**
+ * @struct restore_stream_t
+ * @brief Keeps track of the batches of a file being restored.
+ *
+ * Batches may complete in any order but the size of a batch is only
+ * known when it has been received: a batch is written once every batch
+ * before it has been written. Others wait in pending.
+ */
+typedef struct
+{
+    GFileOutputStream *stream; /**< stream of the file being restored                          */
+    GHashTable *pending;       /**< batch number -> hash_data_t * received but not written yet  */
+    guint next;                /**< number of the next batch to be written                     */
+    guint64 written;           /**< number of bytes written so far (holes included)            */
+    gboolean failed;           /**< TRUE if a batch could not be retrieved or written          */
+    gboolean holes;            /**< TRUE if holes have been seeked over                        */
+} restore_stream_t;
+
+
+/**
+ * @struct restore_batch_t
+ * @brief user_data of one batch request.
+ */
+typedef struct
+{
+    restore_stream_t *restore_stream; /**< the file this batch belongs to */
+    guint number;                     /**< number of the batch            */
+} restore_batch_t;
+
+
 /**
  * @struct res_struct_t
  * @brief This structure is used to keep all parameters for cdpfglrestore's
@@ -83,5 +121,64 @@ typedef struct
 #define PROGRAM_NAME ("cdpfglrestore")
 
 
+#include "planner.h"
+#include "archive.h"
+
+
+/**
+ * Computes the name of the file to be restored from command line's
+ * options (where, parents, all versions).
+ * @param res_struct is the main structure for cdpfglrestore program.
+ * @param meta is the whole meta_data file describing the file to be
+ *        restored
+ * @returns a newly allocated filename that may be freed with
+ *          free_variable() when no longer needed or NULL.
+ */
+extern gchar *get_filename_to_restore(res_struct_t *res_struct, meta_data_t *meta);
+
+
+/**
+ * Makes the whole request (with the date filters) of a query.
+ * @param url is the url of the request (/File/List.json or
+ *        /File/Archive.bin).
+ * @param query is the structure that contains everything needed to
+ *        query the server (and filter a bit). It must not be NULL.
+ * @returns a newly allocated gchar * request that may be freed with
+ *          free_variable() when no longer needed.
+ */
+extern gchar *make_query_request(gchar *url, query_t *query);
+
+
+/**
+ * Gets the meta_data_t * pointer associated to the smeta_data_t *
+ * structure that is stored into the list
+ * @param list is an element of a list of smeta_data_t * structures.
+ * @returns the meta_data_t * structure pointer from that list element
+ *          ie : list->data->meta if it exists or NULL otherwise.
+ */
+extern meta_data_t *get_meta_data_from_smeta_list(GSList *list);
+
+
+/**
+ * Makes a hole of length bytes in the file being restored: the stream
+ * is seeked over it instead of writing zeros. The file has to be
+ * truncated to its size by end_restored_stream() if it ends with a hole.
+ * @param stream is the stream of the file being restored.
+ * @param length is the length of the hole.
+ * @param[out] error is set if the stream could not be seeked.
+ * @returns TRUE on success, FALSE otherwise.
+ */
+extern gboolean seek_over_hole(GFileOutputStream *stream, guint64 length, GError **error);
+
+
+/**
+ * Sets the size of a restored file in which holes have been made (a
+ * hole at the end of the file is not written by seeking).
+ * @param stream is the stream of the file being restored.
+ * @param size is the size of the restored file.
+ */
+extern void end_restored_stream(GFileOutputStream *stream, guint64 size);
+
+
 
 #endif /* #ifndef _RESTORE_OPTIONS_H_ */
@@ -34,13 +34,18 @@
  * @todo write some backends !
  * @param store_smeta a function to store server_meta_data_t structure
  * @param store_data a function to store data
+ * @param store_data_list a function to store a list of data at once
+ *        (may be NULL: store_data is then called for each of them).
  * @param init_backend a function to init the backend
  * @param build_needed_hash_list a function that must build a GSList * needed hash list
  * @param get_list_of_files gets the list of saved files
  * @param retrieve_data retrieves data from a specified hash.
+ * @param terminate_backend writes what the backend keeps in memory when
+ *        the server ends (may be NULL).
+ * @param get_epoch returns the epoch of the store (may be NULL).
  * @returns a newly created backend_t structure initialized to nothing !
  */
-backend_t *init_backend_structure(void *store_smeta, void *store_data, void *init_backend, void *build_needed_hash_list, void *get_list_of_files, void * retrieve_data)
+backend_t *init_backend_structure(void *store_smeta, void *store_data, void *store_data_list, void *init_backend, void *build_needed_hash_list, void *get_list_of_files, void * retrieve_data, void *terminate_backend, void *get_epoch)
 {
     backend_t *backend = NULL;
 
@@ -49,10 +54,13 @@ backend_t *init_backend_structure(void *store_smeta, void *store_data, void *ini
     backend->user_data = NULL;
     backend->store_smeta = store_smeta;
     backend->store_data = store_data;
+    backend->store_data_list = store_data_list;
     backend->init_backend = init_backend;
     backend->build_needed_hash_list = build_needed_hash_list;
     backend->get_list_of_files = get_list_of_files;
     backend->retrieve_data = retrieve_data;
+    backend->terminate_backend = terminate_backend;
+    backend->get_epoch = get_epoch;
 
     return backend;
 }
@@ -41,11 +41,14 @@
  */
 typedef void (* store_smeta_func) (void *, server_meta_data_t *);   /**< Stores a server_meta_data_t structure according to the backend                            */
 typedef void (* store_data_func) (void *, hash_data_t *);            /**< Stores a hash_data_t structure according to the backend                                    */
+typedef void (* store_data_list_func) (void *, GList *);             /**< Stores a list of hash_data_t structures at once (may be NULL)                              */
 typedef GList * (* build_needed_hash_list_func) (void *, GList *);   /**< A function that will check if a hash is already known and build a list
                                                                       *   of needed hashs that the client may send                                                   */
 typedef void (* init_backend_func) (void *);                         /**< A function that will initialize the backend if needed                                      */
 typedef gchar * (* get_list_of_files_func) (void *, query_t *);      /**< A function that returns a JSON formatted string of saved files corresponding to the query  */
 typedef hash_data_t * (* retrieve_data_func) (void *, gchar *);      /**< A function that returns the buffer associated to a specific hash                           */
+typedef void (* terminate_backend_func) (void *);                    /**< A function that writes what the backend keeps in memory when the server ends               */
+typedef gchar * (* get_epoch_func) (void *);                         /**< A function that returns the epoch of the store (changes when blocks may have been deleted) */
 
 
 /**
@@ -56,10 +59,13 @@ typedef struct
 {
     store_smeta_func store_smeta;
     store_data_func store_data;
+    store_data_list_func store_data_list;
     build_needed_hash_list_func build_needed_hash_list;
     init_backend_func init_backend;
     get_list_of_files_func get_list_of_files;
     retrieve_data_func retrieve_data;
+    terminate_backend_func terminate_backend;
+    get_epoch_func get_epoch;
     void *user_data;                                     /**< user_data should be used by backends to store their own internal structure */
 } backend_t;
 
@@ -69,13 +75,18 @@ typedef struct
  * Inits the backend with the correct functions
  * @param store_smeta a function to store server_meta_data_t structure
  * @param store_data a function to store data
+ * @param store_data_list a function to store a list of data at once
+ *        (may be NULL: store_data is then called for each of them).
  * @param init_backend a function to init the backend
  * @param build_needed_hash_list a function that must build a GSList * needed hash list
  * @param get_list_of_files gets the list of saved files
  * @param retrieve_data retrieves data from a specified hash.
+ * @param terminate_backend writes what the backend keeps in memory when
+ *        the server ends (may be NULL).
+ * @param get_epoch returns the epoch of the store (may be NULL).
  * @returns a newly created backend_t structure initialized to nothing !
  */
-extern backend_t *init_backend_structure(void *store_smeta, void *store_data, void *init_backend, void *build_needed_hash_list, void *get_list_of_files, void * retrieve_data);
+extern backend_t *init_backend_structure(void *store_smeta, void *store_data, void *store_data_list, void *init_backend, void *build_needed_hash_list, void *get_list_of_files, void * retrieve_data, void *terminate_backend, void *get_epoch);
 
 
 
@@ -0,0 +1,481 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    bench.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file bench.c
+ *
+ * Micro-benchmarks of the hot paths of libcdpfgl and of the file backend
+ * ('make bench' builds and runs it). Each benchmark prints the number of
+ * operations per second and, when it makes sense, the throughput in MB/s.
+ * Data is generated with a fixed seed so that runs may be compared.
+ */
+
+#include "server.h"
+
+/**
+ * @def BENCH_SEED
+ * Seed of the random generator used to generate the data.
+ */
+#define BENCH_SEED (0x5a5a5a5a)
+
+/**
+ * @def BENCH_BLOCK_SIZE
+ * Size of the blocks used by the benchmarks (the client's default).
+ */
+#define BENCH_BLOCK_SIZE (16384)
+
+/**
+ * @def BENCH_NB_HASHS
+ * Number of hashs in the lists used by the benchmarks.
+ */
+#define BENCH_NB_HASHS (4096)
+
+/**
+ * @def BENCH_NB_LINES
+ * Number of lines of the flat meta data file read by the benchmark.
+ */
+#define BENCH_NB_LINES (20000)
+
+
+static void print_result(const gchar *name, guint64 ops, guint64 bytes, gint64 microseconds);
+static guchar *make_text_buffer(GRand *rand, gsize size);
+static guint8 *make_random_hash(GRand *rand);
+static GList *make_random_hash_list(GRand *rand, guint nb);
+static void bench_hash(GRand *rand);
+static void bench_compress(GRand *rand);
+static void bench_hash_data_json(GRand *rand);
+static void bench_hash_data_list_from_string(GRand *rand);
+static void free_meta_data_list_element(gpointer data);
+static void bench_extract_from_line(GRand *rand, gchar *tmpdir);
+static void bench_build_needed_hash_list(GRand *rand, gchar *tmpdir);
+
+
+/**
+ * Prints the result of one benchmark.
+ * @param name is the name of the benchmark.
+ * @param ops is the number of operations done.
+ * @param bytes is the number of bytes processed (0 if it does not make
+ *        sense for this benchmark).
+ * @param microseconds is the time spent doing the operations.
+ */
+static void print_result(const gchar *name, guint64 ops, guint64 bytes, gint64 microseconds)
+{
+    gdouble seconds = (gdouble) MAX(microseconds, 1) / G_USEC_PER_SEC;
+
+    if (bytes > 0)
+        {
+            fprintf(stdout, "%-44s %12.0f ops/s %10.1f MB/s\n", name, ops / seconds, bytes / seconds / 1048576.0);
+        }
+    else
+        {
+            fprintf(stdout, "%-44s %12.0f ops/s\n", name, ops / seconds);
+        }
+}
+
+
+/**
+ * Makes a compressible buffer made of words picked in a small dictionary.
+ * @param rand is the random generator to use.
+ * @param size is the size of the buffer to make.
+ * @returns a newly allocated buffer of size bytes (plus a final \0).
+ */
+static guchar *make_text_buffer(GRand *rand, gsize size)
+{
+    const gchar *words[] = {"sauvegarde ", "block ", "hash ", "server ", "client ", "data ", "meta ", "0x3f2a ", "\n", "restore ", "file ", "cdpfgl "};
+    guchar *buffer = (guchar *) g_malloc(size + 1);
+    const gchar *word = NULL;
+    gsize pos = 0;
+    gsize len = 0;
+
+    while (pos < size)
+        {
+            word = words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))];
+            len = MIN(strlen(word), size - pos);
+            memcpy(buffer + pos, word, len);
+            pos = pos + len;
+        }
+
+    buffer[size] = '\0';
+
+    return buffer;
+}
+
+
+/**
+ * @param rand is the random generator to use.
+ * @returns a newly allocated random binary hash of HASH_LEN bytes.
+ */
+static guint8 *make_random_hash(GRand *rand)
+{
+    guint8 *hash = (guint8 *) g_malloc(HASH_LEN);
+    guint i = 0;
+
+    for (i = 0; i < HASH_LEN; i++)
+        {
+            hash[i] = (guint8) g_rand_int_range(rand, 0, 256);
+        }
+
+    return hash;
+}
+
+
+/**
+ * @param rand is the random generator to use.
+ * @param nb is the number of hashs to generate.
+ * @returns a GList of nb hash_data_t * with random hashs and no data.
+ */
+static GList *make_random_hash_list(GRand *rand, guint nb)
+{
+    GList *list = NULL;
+    guint i = 0;
+
+    for (i = 0; i < nb; i++)
+        {
+            list = g_list_prepend(list, new_hash_data_t_as_is(NULL, 0, make_random_hash(rand), COMPRESS_NONE_TYPE, 0));
+        }
+
+    return list;
+}
+
+
+/**
+ * Benchmarks calculate_hash_into() on blocks.
+ * @param rand is the random generator to use.
+ */
+static void bench_hash(GRand *rand)
+{
+    guchar *buffer = make_text_buffer(rand, BENCH_BLOCK_SIZE);
+    guint8 a_hash[HASH_LEN];
+    gint64 start = 0;
+    guint i = 0;
+    guint nb = 8192;
+    gchar *name = NULL;
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < nb; i++)
+        {
+            calculate_hash_into(buffer, BENCH_BLOCK_SIZE, a_hash);
+        }
+
+    name = g_strdup_printf("calculate_hash_into (%s)", get_hash_implementation());
+    print_result(name, nb, (guint64) nb * BENCH_BLOCK_SIZE, g_get_monotonic_time() - start);
+
+    free_variable(name);
+    free_variable(buffer);
+}
+
+
+/**
+ * Benchmarks compress_buffer() and uncompress_buffer() with every
+ * compression type compiled in.
+ * @param rand is the random generator to use.
+ */
+static void bench_compress(GRand *rand)
+{
+    guchar *buffer = make_text_buffer(rand, BENCH_BLOCK_SIZE);
+    compress_t *comp = NULL;
+    compress_t *uncomp = NULL;
+    gint64 start = 0;
+    guint64 cmplen = 0;
+    guint i = 0;
+    guint nb = 2048;
+    gshort type = 0;
+    gchar *name = NULL;
+
+    for (type = COMPRESS_ZLIB_TYPE; type <= COMPRESS_ZSTD_TYPE; type++)
+        {
+            if (is_compress_type_allowed(type) == TRUE)
+                {
+                    start = g_get_monotonic_time();
+                    for (i = 0; i < nb; i++)
+                        {
+                            comp = compress_buffer(buffer, BENCH_BLOCK_SIZE, type);
+                            cmplen = comp->len;
+                            free_compress_t(comp);
+                        }
+
+                    name = g_strdup_printf("compress_buffer (type %d, ratio %.2f)", type, (gdouble) BENCH_BLOCK_SIZE / MAX(cmplen, 1));
+                    print_result(name, nb, (guint64) nb * BENCH_BLOCK_SIZE, g_get_monotonic_time() - start);
+                    free_variable(name);
+
+                    comp = compress_buffer(buffer, BENCH_BLOCK_SIZE, type);
+
+                    start = g_get_monotonic_time();
+                    for (i = 0; i < nb; i++)
+                        {
+                            uncomp = uncompress_buffer(comp->text, comp->len, BENCH_BLOCK_SIZE, type);
+                            free_compress_t(uncomp);
+                        }
+
+                    name = g_strdup_printf("uncompress_buffer (type %d)", type);
+                    print_result(name, nb, (guint64) nb * BENCH_BLOCK_SIZE, g_get_monotonic_time() - start);
+                    free_variable(name);
+
+                    free_compress_t(comp);
+                }
+        }
+
+    free_variable(buffer);
+}
+
+
+/**
+ * Benchmarks convert_hash_data_t_to_json() and convert_json_t_to_hash_data()
+ * with blocks of BENCH_BLOCK_SIZE bytes.
+ * @param rand is the random generator to use.
+ */
+static void bench_hash_data_json(GRand *rand)
+{
+    guchar *buffer = make_text_buffer(rand, BENCH_BLOCK_SIZE);
+    hash_data_t *hash_data = NULL;
+    hash_data_t *decoded = NULL;
+    json_t *root = NULL;
+    gint64 start = 0;
+    guint i = 0;
+    guint nb = 4096;
+
+    hash_data = new_hash_data_t_as_is(buffer, BENCH_BLOCK_SIZE, make_random_hash(rand), COMPRESS_NONE_TYPE, BENCH_BLOCK_SIZE);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < nb; i++)
+        {
+            root = convert_hash_data_t_to_json(hash_data);
+            json_decref(root);
+        }
+    print_result("convert_hash_data_t_to_json", nb, (guint64) nb * BENCH_BLOCK_SIZE, g_get_monotonic_time() - start);
+
+    root = convert_hash_data_t_to_json(hash_data);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < nb; i++)
+        {
+            decoded = convert_json_t_to_hash_data(root);
+            free_hash_data_t(decoded);
+        }
+    print_result("convert_json_t_to_hash_data", nb, (guint64) nb * BENCH_BLOCK_SIZE, g_get_monotonic_time() - start);
+
+    json_decref(root);
+    free_hash_data_t(hash_data);
+}
+
+
+/**
+ * Benchmarks make_hash_data_list_from_string() with a string of
+ * BENCH_NB_HASHS base64 encoded hashs.
+ * @param rand is the random generator to use.
+ */
+static void bench_hash_data_list_from_string(GRand *rand)
+{
+    GString *string = g_string_new("");
+    GList *list = NULL;
+    guint8 *hash = NULL;
+    gchar *encoded = NULL;
+    gint64 start = 0;
+    guint i = 0;
+    guint nb = 64;
+
+    for (i = 0; i < BENCH_NB_HASHS; i++)
+        {
+            hash = make_random_hash(rand);
+            encoded = g_base64_encode(hash, HASH_LEN);
+            g_string_append_printf(string, "%s\"%s\"", i == 0 ? "" : ", ", encoded);
+            free_variable(encoded);
+            free_variable(hash);
+        }
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < nb; i++)
+        {
+            list = make_hash_data_list_from_string(string->str);
+            g_list_free_full(list, free_hdt_struct);
+        }
+    print_result("make_hash_data_list_from_string (hashs)", (guint64) nb * BENCH_NB_HASHS, 0, g_get_monotonic_time() - start);
+
+    g_string_free(string, TRUE);
+}
+
+
+/**
+ * Frees a meta_data_t * element of a list
+ * @param data is the meta_data_t * to be freed.
+ */
+static void free_meta_data_list_element(gpointer data)
+{
+    free_meta_data_t((meta_data_t *) data, TRUE);
+}
+
+
+/**
+ * Benchmarks extract_from_line() through file_get_meta_list_from_flat_file()
+ * that reads a generated flat meta data file line by line.
+ * @param rand is the random generator to use.
+ * @param tmpdir is the temporary directory where to write the file.
+ */
+static void bench_extract_from_line(GRand *rand, gchar *tmpdir)
+{
+    gchar *filename = g_build_filename(tmpdir, "flat.meta", NULL);
+    FILE *file = NULL;
+    GList *list = NULL;
+    guint8 *hash = NULL;
+    gchar *encoded = NULL;
+    gint64 start = 0;
+    guint i = 0;
+    guint j = 0;
+
+    file = fopen(filename, "w");
+
+    if (file != NULL)
+        {
+            for (i = 0; i < BENCH_NB_LINES; i++)
+                {
+                    fprintf(file, "1, %u, 33188, 1432131763, 1432129404, 1425592185, 65536, \"user\", \"group\", 1000, 1000, \"/bench/dir%u/file%u\", \"\"", i, i / 100, i);
+
+                    for (j = 0; j < 4; j++)
+                        {
+                            hash = make_random_hash(rand);
+                            encoded = g_base64_encode(hash, HASH_LEN);
+                            fprintf(file, ", \"%s\"", encoded);
+                            free_variable(encoded);
+                            free_variable(hash);
+                        }
+
+                    fprintf(file, "\n");
+                }
+
+            fclose(file);
+
+            start = g_get_monotonic_time();
+            list = file_get_meta_list_from_flat_file(filename);
+            print_result("extract_from_line (lines)", g_list_length(list), 0, g_get_monotonic_time() - start);
+
+            g_list_free_full(list, free_meta_data_list_element);
+            g_unlink(filename);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to create %s: %s\n"), filename, g_strerror(errno));
+        }
+
+    free_variable(filename);
+}
+
+
+/**
+ * Benchmarks file_build_needed_hash_list() with a list of BENCH_NB_HASHS
+ * hashs where half of them are stored: once when the presence index is
+ * not ready (unknown hashs are looked for in the filesystem) and once
+ * when it is ready.
+ * @param rand is the random generator to use.
+ * @param tmpdir is the temporary directory used as the backend's prefix.
+ */
+static void bench_build_needed_hash_list(GRand *rand, gchar *tmpdir)
+{
+    server_struct_t *server_struct = NULL;
+    file_backend_t *file_backend = NULL;
+    GList *hash_data_list = NULL;
+    GList *iter = NULL;
+    GList *needed = NULL;
+    gint64 start = 0;
+    guint i = 0;
+    guint nb = 16;
+    gboolean stored = FALSE;
+
+    server_struct = (server_struct_t *) g_malloc0(sizeof(server_struct_t));
+    server_struct->backend = init_backend_structure(file_store_smeta, file_store_data, file_store_data_list, file_init_backend, file_build_needed_hash_list, file_get_list_of_files, file_retrieve_data, NULL, NULL);
+
+    file_backend = (file_backend_t *) g_malloc0(sizeof(file_backend_t));
+    file_backend->prefix = g_strdup(tmpdir);
+    file_backend->level = FILE_BACKEND_LEVEL;
+    file_backend->presence = new_presence_t();
+    server_struct->backend->user_data = file_backend;
+
+    hash_data_list = make_random_hash_list(rand, BENCH_NB_HASHS);
+
+    for (iter = hash_data_list; iter != NULL; iter = g_list_next(iter))
+        {
+            if (stored == TRUE)
+                {
+                    presence_insert(file_backend->presence, ((hash_data_t *) iter->data)->hash);
+                }
+            stored = !stored;
+        }
+
+    start = g_get_monotonic_time();
+    needed = file_build_needed_hash_list(server_struct, hash_data_list);
+    print_result("file_build_needed_hash_list (not ready)", BENCH_NB_HASHS, 0, g_get_monotonic_time() - start);
+    g_list_free_full(needed, free_hdt_struct);
+
+    presence_set_ready(file_backend->presence);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < nb; i++)
+        {
+            needed = file_build_needed_hash_list(server_struct, hash_data_list);
+            g_list_free_full(needed, free_hdt_struct);
+        }
+    print_result("file_build_needed_hash_list (ready)", (guint64) nb * BENCH_NB_HASHS, 0, g_get_monotonic_time() - start);
+
+    g_list_free_full(hash_data_list, free_hdt_struct);
+    free_presence_t(file_backend->presence);
+    free_variable(file_backend->prefix);
+    free_variable(file_backend);
+    free_variable(server_struct->backend);
+    free_variable(server_struct);
+}
+
+
+/**
+ * Main function
+ * @param argc : number of arguments given on the command line.
+ * @param argv : an array of strings that contains command line arguments.
+ * @returns EXIT_SUCCESS or EXIT_FAILURE if the temporary directory
+ *          could not be created.
+ */
+int main(int argc, char **argv)
+{
+    GRand *rand = NULL;
+    gchar *tmpdir = NULL;
+
+    init_international_languages();
+
+    tmpdir = g_dir_make_tmp("cdpfglbench-XXXXXX", NULL);
+
+    if (tmpdir == NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to create a temporary directory\n"));
+            return EXIT_FAILURE;
+        }
+
+    rand = g_rand_new_with_seed(BENCH_SEED);
+
+    bench_hash(rand);
+    bench_compress(rand);
+    bench_hash_data_json(rand);
+    bench_hash_data_list_from_string(rand);
+    bench_extract_from_line(rand, tmpdir);
+    bench_build_needed_hash_list(rand, tmpdir);
+
+    g_rand_free(rand);
+    g_rmdir(tmpdir);
+    free_variable(tmpdir);
+
+    return EXIT_SUCCESS;
+}
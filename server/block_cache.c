@@ -0,0 +1,249 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    block_cache.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file block_cache.c
+ *
+ * This file contains all the functions of the cache of blocks read from
+ * the backend by 'cdpfglserver'. Blocks are immutable (they are named
+ * by their hash) so the cache never has to be invalidated. Hashs are
+ * SHA256 ones and are uniformly distributed: their last byte selects
+ * the shard.
+ */
+
+#include "server.h"
+
+static block_cache_shard_t *get_shard(block_cache_t *cache, guint8 *hash);
+static void free_cached_block_t(gpointer data);
+static void evict_blocks(block_cache_shard_t *shard, guint64 needed);
+
+
+/**
+ * @param cache is the block cache.
+ * @param hash is a binary hash of HASH_LEN bytes.
+ * @returns the shard where the block of this hash is.
+ */
+static block_cache_shard_t *get_shard(block_cache_t *cache, guint8 *hash)
+{
+    return &cache->shards[hash[HASH_LEN - 1] & (BLOCK_CACHE_SHARDS - 1)];
+}
+
+
+/**
+ * Frees a cached block
+ * @param data is the cached_block_t * to be freed.
+ */
+static void free_cached_block_t(gpointer data)
+{
+    cached_block_t *block = (cached_block_t *) data;
+
+    if (block != NULL)
+        {
+            free_variable(block->data);
+            free_variable(block);
+        }
+}
+
+
+/**
+ * Removes least recently used blocks of a shard until needed bytes can
+ * be added to it.
+ * @param shard is the shard (its mutex must be held).
+ * @param needed is the number of bytes that we want to add.
+ */
+static void evict_blocks(block_cache_shard_t *shard, guint64 needed)
+{
+    cached_block_t *block = NULL;
+
+    while (shard->size + needed > shard->capacity && g_queue_is_empty(&shard->lru) == FALSE)
+        {
+            block = g_queue_pop_tail(&shard->lru);
+            shard->size = shard->size - block->read;
+            /* the table frees the block */
+            g_hash_table_remove(shard->table, block->hash);
+        }
+}
+
+
+/**
+ * Creates a new empty block cache.
+ * @param size is the maximum size in bytes of the data in the cache.
+ * @returns a newly allocated block_cache_t structure that may be freed
+ *          with free_block_cache_t() when no longer needed or NULL if
+ *          size is 0 (no cache at all).
+ */
+block_cache_t *new_block_cache_t(guint64 size)
+{
+    block_cache_t *cache = NULL;
+    block_cache_shard_t *shard = NULL;
+    guint i = 0;
+
+    if (size > 0)
+        {
+            cache = (block_cache_t *) g_malloc0(sizeof(block_cache_t));
+            g_assert_nonnull(cache);
+
+            for (i = 0; i < BLOCK_CACHE_SHARDS; i++)
+                {
+                    shard = &cache->shards[i];
+                    g_mutex_init(&shard->mutex);
+                    shard->table = g_hash_table_new_full(hash_key_hash, hash_key_equal, NULL, free_cached_block_t);
+                    g_queue_init(&shard->lru);
+                    shard->size = 0;
+                    shard->capacity = size / BLOCK_CACHE_SHARDS;
+                }
+        }
+
+    return cache;
+}
+
+
+/**
+ * Frees a block cache and every block in it.
+ * @param cache is the block_cache_t structure to be freed.
+ */
+void free_block_cache_t(block_cache_t *cache)
+{
+    block_cache_shard_t *shard = NULL;
+    guint i = 0;
+
+    if (cache != NULL)
+        {
+            for (i = 0; i < BLOCK_CACHE_SHARDS; i++)
+                {
+                    shard = &cache->shards[i];
+                    g_queue_clear(&shard->lru);
+                    g_hash_table_destroy(shard->table);
+                    g_mutex_clear(&shard->mutex);
+                }
+
+            free_variable(cache);
+        }
+}
+
+
+/**
+ * Looks a block up in the cache.
+ * @param cache is the block cache (may be NULL).
+ * @param hash is the binary hash (HASH_LEN bytes) of the block.
+ * @returns a newly allocated hash_data_t structure with a copy of the
+ *          block's data or NULL if the block is not in the cache.
+ */
+hash_data_t *block_cache_get(block_cache_t *cache, guint8 *hash)
+{
+    block_cache_shard_t *shard = NULL;
+    cached_block_t *block = NULL;
+    hash_data_t *hash_data = NULL;
+
+    if (cache != NULL && hash != NULL)
+        {
+            shard = get_shard(cache, hash);
+
+            g_mutex_lock(&shard->mutex);
+
+            block = g_hash_table_lookup(shard->table, hash);
+
+            if (block != NULL)
+                {
+                    /* Moves the block at the head of the LRU list */
+                    g_queue_unlink(&shard->lru, block->link);
+                    g_queue_push_head_link(&shard->lru, block->link);
+
+                    hash_data = new_hash_data_t_as_is((guchar *) g_memdup(block->data, block->read), block->read, (guint8 *) g_memdup(block->hash, HASH_LEN), block->cmptype, block->uncmplen);
+                }
+
+            g_mutex_unlock(&shard->mutex);
+        }
+
+    return hash_data;
+}
+
+
+/**
+ * Puts a copy of a block into the cache. Least recently used blocks are
+ * removed to make room for it. Blocks bigger than a shard are not kept.
+ * @param cache is the block cache (may be NULL).
+ * @param hash_data is the block as retrieved from the backend. It is
+ *        not modified.
+ */
+void block_cache_put(block_cache_t *cache, hash_data_t *hash_data)
+{
+    block_cache_shard_t *shard = NULL;
+    cached_block_t *block = NULL;
+
+    if (cache != NULL && hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL && hash_data->read > 0)
+        {
+            shard = get_shard(cache, hash_data->hash);
+
+            g_mutex_lock(&shard->mutex);
+
+            if ((guint64) hash_data->read <= shard->capacity && g_hash_table_contains(shard->table, hash_data->hash) == FALSE)
+                {
+                    evict_blocks(shard, hash_data->read);
+
+                    block = (cached_block_t *) g_malloc0(sizeof(cached_block_t));
+                    g_assert_nonnull(block);
+
+                    memcpy(block->hash, hash_data->hash, HASH_LEN);
+                    block->data = (guchar *) g_memdup(hash_data->data, hash_data->read);
+                    block->read = hash_data->read;
+                    block->cmptype = hash_data->cmptype;
+                    block->uncmplen = hash_data->uncmplen;
+
+                    g_queue_push_head(&shard->lru, block);
+                    block->link = g_queue_peek_head_link(&shard->lru);
+                    g_hash_table_insert(shard->table, block->hash, block);
+                    shard->size = shard->size + block->read;
+                }
+
+            g_mutex_unlock(&shard->mutex);
+        }
+}
+
+
+/**
+ * Gets the occupation of the cache (hits and misses are counted in
+ * stats_t by the caller).
+ * @param cache is the block cache (may be NULL).
+ * @param[out] size is the number of bytes of data in the cache.
+ * @param[out] blocks is the number of blocks in the cache.
+ */
+void block_cache_get_usage(block_cache_t *cache, guint64 *size, guint64 *blocks)
+{
+    block_cache_shard_t *shard = NULL;
+    guint i = 0;
+
+    *size = 0;
+    *blocks = 0;
+
+    if (cache != NULL)
+        {
+            for (i = 0; i < BLOCK_CACHE_SHARDS; i++)
+                {
+                    shard = &cache->shards[i];
+
+                    g_mutex_lock(&shard->mutex);
+                    *size = *size + shard->size;
+                    *blocks = *blocks + g_hash_table_size(shard->table);
+                    g_mutex_unlock(&shard->mutex);
+                }
+        }
+}
@@ -0,0 +1,135 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    block_cache.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file block_cache.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the cache of blocks read from the backend. When many hosts restore
+ * the same files the same blocks are requested again and again: they
+ * are kept in memory (as stored, with their compression parameters) in
+ * a sharded LRU cache bounded in size.
+ */
+#ifndef _SERVER_BLOCK_CACHE_H_
+#define _SERVER_BLOCK_CACHE_H_
+
+
+/**
+ * @def BLOCK_CACHE_SIZE
+ * Defines the default size (in MB) of the block cache. 0 disables it.
+ */
+#define BLOCK_CACHE_SIZE (256)
+
+
+/**
+ * @def BLOCK_CACHE_SHARDS
+ * Number of independent parts (each with its own mutex and LRU list) of
+ * the cache. Must be a power of two.
+ */
+#define BLOCK_CACHE_SHARDS (16)
+
+
+/**
+ * @struct cached_block_t
+ * @brief A block kept in the cache.
+ */
+typedef struct
+{
+    guint8 hash[HASH_LEN];  /**< hash of the block (key of the table)         */
+    guchar *data;           /**< data of the block as stored (maybe compressed) */
+    gssize read;            /**< length of data                               */
+    gshort cmptype;         /**< compression type of data                     */
+    gssize uncmplen;        /**< uncompressed length of data                  */
+    GList *link;            /**< link of this block in the LRU list           */
+} cached_block_t;
+
+
+/**
+ * @struct block_cache_shard_t
+ * @brief One part of the cache: blocks whose hash falls into it.
+ */
+typedef struct
+{
+    GMutex mutex;        /**< Protects everything in this shard               */
+    GHashTable *table;   /**< hash (guint8 *) -> cached_block_t *             */
+    GQueue lru;          /**< cached_block_t *: most recently used first      */
+    guint64 size;        /**< number of bytes of data in this shard           */
+    guint64 capacity;    /**< maximum number of bytes of data in this shard   */
+} block_cache_shard_t;
+
+
+/**
+ * @struct block_cache_t
+ * @brief Cache of the blocks read from the backend.
+ */
+typedef struct
+{
+    block_cache_shard_t shards[BLOCK_CACHE_SHARDS]; /**< parts of the cache */
+} block_cache_t;
+
+
+/**
+ * Creates a new empty block cache.
+ * @param size is the maximum size in bytes of the data in the cache.
+ * @returns a newly allocated block_cache_t structure that may be freed
+ *          with free_block_cache_t() when no longer needed or NULL if
+ *          size is 0 (no cache at all).
+ */
+extern block_cache_t *new_block_cache_t(guint64 size);
+
+
+/**
+ * Frees a block cache and every block in it.
+ * @param cache is the block_cache_t structure to be freed.
+ */
+extern void free_block_cache_t(block_cache_t *cache);
+
+
+/**
+ * Looks a block up in the cache.
+ * @param cache is the block cache (may be NULL).
+ * @param hash is the binary hash (HASH_LEN bytes) of the block.
+ * @returns a newly allocated hash_data_t structure with a copy of the
+ *          block's data or NULL if the block is not in the cache.
+ */
+extern hash_data_t *block_cache_get(block_cache_t *cache, guint8 *hash);
+
+
+/**
+ * Puts a copy of a block into the cache. Least recently used blocks are
+ * removed to make room for it. Blocks bigger than a shard are not kept.
+ * @param cache is the block cache (may be NULL).
+ * @param hash_data is the block as retrieved from the backend. It is
+ *        not modified.
+ */
+extern void block_cache_put(block_cache_t *cache, hash_data_t *hash_data);
+
+
+/**
+ * Gets the occupation of the cache (hits and misses are counted in
+ * stats_t by the caller).
+ * @param cache is the block cache (may be NULL).
+ * @param[out] size is the number of bytes of data in the cache.
+ * @param[out] blocks is the number of blocks in the cache.
+ */
+extern void block_cache_get_usage(block_cache_t *cache, guint64 *size, guint64 *blocks);
+
+#endif /* #ifndef _SERVER_BLOCK_CACHE_H_ */
@@ -0,0 +1,1509 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    catalog.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file catalog.c
+ *
+ * This file contains all the functions of the per host meta data catalog
+ * used by the backends of 'cdpfglserver'. A catalog file is a sequence
+ * of binary records (see CATALOG_RECORD_FIXED_SIZE). Its index is built
+ * by scanning the file the first time the host is needed and is kept up
+ * to date when records are appended. Flat meta data files of previous
+ * versions (prefix/meta/hostname) are imported once into the catalog and
+ * are no longer written to.
+ */
+
+#include "server.h"
+
+static catalog_node_t *new_catalog_node_t(gchar *name);
+static void free_catalog_node_t(gpointer data);
+static catalog_node_t *get_child_node(catalog_node_t *node, gchar *name);
+static void insert_version_in_node(catalog_node_t *node, guint64 mtime, guint64 offset);
+static void index_record(catalog_host_t *host, gchar *name, guint64 mtime, guint64 offset);
+static GByteArray *encode_record(meta_data_t *meta);
+static meta_data_t *decode_record(guint8 *body, guint32 length, gboolean reduced);
+static gboolean flush_host(catalog_host_t *host);
+static gboolean append_meta_to_host(catalog_host_t *host, meta_data_t *meta);
+static void load_host_catalog(catalog_host_t *host);
+static void import_flat_file(catalog_host_t *host, gchar *flat_filename);
+static void free_catalog_host_t(gpointer data);
+static catalog_host_t *get_host_catalog(catalog_t *catalog, gchar *hostname, gboolean create);
+static void flush_all_hosts(catalog_t *catalog, gboolean all);
+static gpointer flush_catalog_thread(gpointer user_data);
+static gchar *get_literal_prefix_from_regex(gchar *regex);
+static guint get_first_version_after(GArray *versions, gint64 after);
+static void add_node_versions_to_search(catalog_node_t *node, gchar *path, catalog_search_t *search);
+static void collect_all_versions(catalog_node_t *node, GString *path, gboolean is_root, catalog_search_t *search);
+static void walk_literal_prefix(catalog_node_t *node, GString *path, gboolean is_root, gchar **components, guint depth, catalog_search_t *search);
+static gint compare_offsets(gconstpointer a, gconstpointer b);
+static GList *read_records_from_offsets(gchar *filename, GArray *offsets, gboolean reduced);
+static void open_all_hosts(catalog_t *catalog);
+static gboolean read_hashs_from_file(gchar *filename, guint64 size, catalog_hash_func func, gpointer user_data, guint64 *nb_records);
+
+
+/**
+ * Creates a new node of the trie
+ * @param name is the path component of this node (copied).
+ * @returns a newly allocated catalog_node_t without children nor
+ *          versions.
+ */
+static catalog_node_t *new_catalog_node_t(gchar *name)
+{
+    catalog_node_t *node = NULL;
+
+    node = (catalog_node_t *) g_malloc0(sizeof(catalog_node_t));
+    g_assert_nonnull(node);
+
+    node->name = g_strdup(name);
+
+    /* Filenames are not always valid UTF-8 strings */
+    if (g_utf8_validate(name, -1, NULL) == TRUE)
+        {
+            node->folded = g_utf8_casefold(name, -1);
+        }
+    else
+        {
+            node->folded = g_ascii_strdown(name, -1);
+        }
+
+    node->children = NULL;
+    node->versions = NULL;
+
+    return node;
+}
+
+
+/**
+ * Frees a node of the trie and all its children
+ * @param data is the catalog_node_t * node to be freed.
+ */
+static void free_catalog_node_t(gpointer data)
+{
+    catalog_node_t *node = (catalog_node_t *) data;
+
+    if (node != NULL)
+        {
+            if (node->children != NULL)
+                {
+                    g_hash_table_destroy(node->children);
+                }
+
+            if (node->versions != NULL)
+                {
+                    g_array_free(node->versions, TRUE);
+                }
+
+            free_variable(node->name);
+            free_variable(node->folded);
+            free_variable(node);
+        }
+}
+
+
+/**
+ * Gets the child of a node, creating it if it does not exist.
+ * @param node is the parent node.
+ * @param name is the name of the child.
+ * @returns the child node named name.
+ */
+static catalog_node_t *get_child_node(catalog_node_t *node, gchar *name)
+{
+    catalog_node_t *child = NULL;
+
+    if (node->children == NULL)
+        {
+            /* keys are the names owned by the nodes themselves */
+            node->children = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_catalog_node_t);
+        }
+
+    child = g_hash_table_lookup(node->children, name);
+
+    if (child == NULL)
+        {
+            child = new_catalog_node_t(name);
+            g_hash_table_insert(node->children, child->name, child);
+        }
+
+    return child;
+}
+
+
+/**
+ * Inserts a version into the versions of a node keeping them sorted by
+ * mtime. Versions with the same mtime are kept in the order of the
+ * catalog file.
+ * @param node is the node of the path.
+ * @param mtime is the mtime of this version.
+ * @param offset is the offset of the record in the catalog file.
+ */
+static void insert_version_in_node(catalog_node_t *node, guint64 mtime, guint64 offset)
+{
+    catalog_version_t version;
+    guint i = 0;
+
+    if (node->versions == NULL)
+        {
+            node->versions = g_array_new(FALSE, FALSE, sizeof(catalog_version_t));
+        }
+
+    version.mtime = mtime;
+    version.offset = offset;
+
+    /* Versions mostly come in mtime order: looking from the end */
+    i = node->versions->len;
+    while (i > 0 && g_array_index(node->versions, catalog_version_t, i - 1).mtime > mtime)
+        {
+            i--;
+        }
+
+    g_array_insert_val(node->versions, i, version);
+}
+
+
+/**
+ * Indexes one record of a host catalog
+ * @param host is the host catalog.
+ * @param name is the filename of the record.
+ * @param mtime is the mtime of the record.
+ * @param offset is the offset of the record in the catalog file.
+ */
+static void index_record(catalog_host_t *host, gchar *name, guint64 mtime, guint64 offset)
+{
+    gchar **components = NULL;
+    catalog_node_t *node = host->root;
+    guint i = 0;
+
+    if (name != NULL)
+        {
+            /* joining components with '/' gives back exactly name */
+            components = g_strsplit(name, "/", -1);
+
+            for (i = 0; components[i] != NULL; i++)
+                {
+                    node = get_child_node(node, components[i]);
+                }
+
+            g_strfreev(components);
+        }
+
+    insert_version_in_node(node, mtime, offset);
+}
+
+
+/**
+ * Encodes meta data into a catalog record
+ * @param meta is the meta data to encode.
+ * @returns a newly allocated GByteArray containing the record header
+ *          and its body.
+ */
+static GByteArray *encode_record(meta_data_t *meta)
+{
+    GByteArray *record = NULL;
+    guint8 *body = NULL;
+    gchar *owner = meta->owner != NULL ? meta->owner : "";
+    gchar *group = meta->group != NULL ? meta->group : "";
+    gchar *name = meta->name != NULL ? meta->name : "";
+    gchar *link = meta->link != NULL ? meta->link : "";
+    guint16 owner_len = (guint16) MIN(strlen(owner), G_MAXUINT16);
+    guint16 group_len = (guint16) MIN(strlen(group), G_MAXUINT16);
+    guint32 name_len = strlen(name);
+    guint32 link_len = strlen(link);
+    guint32 nb_hashs = meta->hashs != NULL ? (guint32) meta->nb_hashs : 0;
+    guint32 length = 0;
+    guint32 pos = 0;
+
+    length = CATALOG_RECORD_FIXED_SIZE + owner_len + group_len + name_len + link_len + nb_hashs * HASH_LEN;
+
+    record = g_byte_array_sized_new(CATALOG_RECORD_HEADER_SIZE + length);
+    g_byte_array_set_size(record, CATALOG_RECORD_HEADER_SIZE + length);
+    memset(record->data, 0, record->len);
+
+    put_guint32_into_buffer(record->data, CATALOG_MAGIC);
+    put_guint32_into_buffer(record->data + 4, length);
+
+    body = record->data + CATALOG_RECORD_HEADER_SIZE;
+    body[0] = meta->file_type;
+    put_guint32_into_buffer(body + 4, meta->mode);
+    put_guint32_into_buffer(body + 8, meta->uid);
+    put_guint32_into_buffer(body + 12, meta->gid);
+    put_guint64_into_buffer(body + 16, meta->inode);
+    put_guint64_into_buffer(body + 24, meta->atime);
+    put_guint64_into_buffer(body + 32, meta->ctime);
+    put_guint64_into_buffer(body + 40, meta->mtime);
+    put_guint64_into_buffer(body + 48, meta->size);
+    put_guint16_into_buffer(body + 56, owner_len);
+    put_guint16_into_buffer(body + 58, group_len);
+    put_guint32_into_buffer(body + 60, name_len);
+    put_guint32_into_buffer(body + 64, link_len);
+    put_guint32_into_buffer(body + 68, nb_hashs);
+
+    pos = CATALOG_RECORD_FIXED_SIZE;
+    memcpy(body + pos, owner, owner_len);
+    pos = pos + owner_len;
+    memcpy(body + pos, group, group_len);
+    pos = pos + group_len;
+    memcpy(body + pos, name, name_len);
+    pos = pos + name_len;
+    memcpy(body + pos, link, link_len);
+    pos = pos + link_len;
+
+    /* hashs are stored in the record exactly as they are in memory */
+    if (nb_hashs > 0)
+        {
+            memcpy(body + pos, meta->hashs, (gsize) nb_hashs * HASH_LEN);
+        }
+
+    return record;
+}
+
+
+/**
+ * Decodes the body of a catalog record
+ * @param body is the body of the record (header excluded).
+ * @param length is the length of the body.
+ * @param reduced is TRUE when only name, file_type, mtime and size are
+ *        wanted (as for reduced queries).
+ * @returns a newly allocated meta_data_t structure or NULL if the record
+ *          is not valid.
+ */
+static meta_data_t *decode_record(guint8 *body, guint32 length, gboolean reduced)
+{
+    meta_data_t *meta = NULL;
+    guint16 owner_len = 0;
+    guint16 group_len = 0;
+    guint32 name_len = 0;
+    guint32 link_len = 0;
+    guint32 nb_hashs = 0;
+    guint32 pos = CATALOG_RECORD_FIXED_SIZE;
+
+    if (length >= CATALOG_RECORD_FIXED_SIZE)
+        {
+            owner_len = get_guint16_from_buffer(body + 56);
+            group_len = get_guint16_from_buffer(body + 58);
+            name_len = get_guint32_from_buffer(body + 60);
+            link_len = get_guint32_from_buffer(body + 64);
+            nb_hashs = get_guint32_from_buffer(body + 68);
+
+            if ((guint64) CATALOG_RECORD_FIXED_SIZE + owner_len + group_len + name_len + link_len + (guint64) nb_hashs * HASH_LEN == length)
+                {
+                    meta = new_meta_data_t();
+
+                    meta->file_type = body[0];
+                    meta->mtime = get_guint64_from_buffer(body + 40);
+                    meta->size = get_guint64_from_buffer(body + 48);
+                    meta->name = g_strndup((gchar *) body + pos + owner_len + group_len, name_len);
+
+                    if (reduced == FALSE)
+                        {
+                            meta->mode = get_guint32_from_buffer(body + 4);
+                            meta->uid = get_guint32_from_buffer(body + 8);
+                            meta->gid = get_guint32_from_buffer(body + 12);
+                            meta->inode = get_guint64_from_buffer(body + 16);
+                            meta->atime = get_guint64_from_buffer(body + 24);
+                            meta->ctime = get_guint64_from_buffer(body + 32);
+
+                            meta->owner = g_strndup((gchar *) body + pos, owner_len);
+                            pos = pos + owner_len;
+                            meta->group = g_strndup((gchar *) body + pos, group_len);
+                            pos = pos + group_len + name_len;
+                            meta->link = g_strndup((gchar *) body + pos, link_len);
+                            pos = pos + link_len;
+
+                            if (nb_hashs > 0)
+                                {
+                                    meta->hashs = (guint8 *) g_memdup(body + pos, nb_hashs * HASH_LEN);
+                                    meta->nb_hashs = nb_hashs;
+                                }
+                        }
+                }
+        }
+
+    return meta;
+}
+
+
+/**
+ * Writes pending records of a host catalog into its file (and
+ * fsync()'s it unless the policy is CATALOG_SYNC_NONE). Records that
+ * could not be written are kept and will be written by the next flush.
+ * Caller must hold the catalog mutex.
+ * @param host is the host catalog.
+ * @returns TRUE if every pending record has been written, FALSE otherwise.
+ */
+static gboolean flush_host(catalog_host_t *host)
+{
+    gssize written = 0;
+    guint done = 0;
+    gboolean ok = TRUE;
+
+    if (host->fd >= 0 && host->pending->len > 0)
+        {
+            while (done < host->pending->len && ok == TRUE)
+                {
+                    written = write(host->fd, host->pending->data + done, host->pending->len - done);
+
+                    if (written >= 0)
+                        {
+                            done = done + written;
+                        }
+                    else if (errno != EINTR)
+                        {
+                            ok = FALSE;
+                        }
+                }
+
+            if (ok == TRUE && host->sync != CATALOG_SYNC_NONE && fsync(host->fd) != 0)
+                {
+                    ok = FALSE;
+                }
+
+            if (ok == TRUE)
+                {
+                    host->flushed = host->flushed + host->pending->len;
+                    g_byte_array_set_size(host->pending, 0);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to append meta data to catalog %s: %s\n"), host->filename, g_strerror(errno));
+
+                    /* Records appended after a partial one would be unreachable */
+                    if (done > 0 && truncate(host->filename, host->flushed) != 0)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to truncate catalog %s: %s\n"), host->filename, g_strerror(errno));
+                        }
+                }
+        }
+
+    return ok;
+}
+
+
+/**
+ * Appends meta data to pending records of a host catalog and indexes it.
+ * Pending records are written when there is enough of them (or at once
+ * with CATALOG_SYNC_ALWAYS policy). Caller must hold the catalog mutex.
+ * @param host is the host catalog.
+ * @param meta is the meta data to append.
+ * @returns TRUE if the record has been appended, FALSE otherwise.
+ */
+static gboolean append_meta_to_host(catalog_host_t *host, meta_data_t *meta)
+{
+    GByteArray *record = NULL;
+    gboolean ok = FALSE;
+
+    if (host->fd >= 0)
+        {
+            record = encode_record(meta);
+
+            if (host->pending->len == 0)
+                {
+                    host->pending_since = g_get_monotonic_time();
+                }
+
+            g_byte_array_append(host->pending, record->data, record->len);
+
+            /* The record is at host->size once pending records are written */
+            index_record(host, meta->name, meta->mtime, host->size);
+            host->size = host->size + record->len;
+            host->nb_records = host->nb_records + 1;
+            ok = TRUE;
+
+            if (host->sync == CATALOG_SYNC_ALWAYS || host->pending->len >= CATALOG_FLUSH_SIZE)
+                {
+                    flush_host(host);
+                }
+
+            g_byte_array_free(record, TRUE);
+        }
+
+    return ok;
+}
+
+
+/**
+ * Scans a catalog file and indexes every valid record in it. If the
+ * server stopped while writing a record the incomplete record is removed.
+ * @param host is the host catalog whose filename is set.
+ */
+static void load_host_catalog(catalog_host_t *host)
+{
+    GFile *the_file = NULL;
+    GFileInputStream *stream = NULL;
+    GInputStream *buffered = NULL;
+    GError *error = NULL;
+    guint8 header[CATALOG_RECORD_HEADER_SIZE];
+    guint8 *body = NULL;
+    guint32 body_size = 0;
+    guint32 length = 0;
+    gsize size_read = 0;
+    gchar *name = NULL;
+    guint64 name_start = 0;
+    guint64 file_size = 0;
+    gboolean ok = TRUE;
+
+    the_file = g_file_new_for_path(host->filename);
+    stream = g_file_read(the_file, NULL, &error);
+
+    if (stream != NULL)
+        {
+            file_size = get_file_size(the_file);
+            buffered = g_buffered_input_stream_new_sized((GInputStream *) stream, CATALOG_BUFFER_SIZE);
+
+            do
+                {
+                    ok = g_input_stream_read_all(buffered, header, CATALOG_RECORD_HEADER_SIZE, &size_read, NULL, &error);
+                    ok = ok && size_read == CATALOG_RECORD_HEADER_SIZE && get_guint32_from_buffer(header) == CATALOG_MAGIC;
+
+                    if (ok == TRUE)
+                        {
+                            length = get_guint32_from_buffer(header + 4);
+                            ok = length >= CATALOG_RECORD_FIXED_SIZE && host->size + CATALOG_RECORD_HEADER_SIZE + length <= file_size;
+                        }
+
+                    if (ok == TRUE)
+                        {
+                            if (length > body_size)
+                                {
+                                    body = (guint8 *) g_realloc(body, length);
+                                    body_size = length;
+                                }
+
+                            ok = g_input_stream_read_all(buffered, body, length, &size_read, NULL, &error) && size_read == length;
+                        }
+
+                    if (ok == TRUE)
+                        {
+                            name_start = CATALOG_RECORD_FIXED_SIZE + get_guint16_from_buffer(body + 56) + get_guint16_from_buffer(body + 58);
+                            ok = name_start + get_guint32_from_buffer(body + 60) <= length;
+                        }
+
+                    if (ok == TRUE)
+                        {
+                            name = g_strndup((gchar *) body + name_start, get_guint32_from_buffer(body + 60));
+                            index_record(host, name, get_guint64_from_buffer(body + 40), host->size);
+                            free_variable(name);
+
+                            host->size = host->size + CATALOG_RECORD_HEADER_SIZE + length;
+                            host->nb_records = host->nb_records + 1;
+                        }
+                }
+            while (ok == TRUE);
+
+            if (error != NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while reading catalog %s: %s\n"), host->filename, error->message);
+                    free_error(error);
+                }
+
+            g_input_stream_close(buffered, NULL, NULL);
+            free_object(buffered);
+            free_object(stream);
+            free_variable(body);
+
+            print_debug(_("catalog: %" G_GUINT64_FORMAT " records loaded from %s\n"), host->nb_records, host->filename);
+
+            if (host->size < file_size)
+                {
+                    /* Appending after some garbage is not a good idea */
+                    print_error(__FILE__, __LINE__, _("catalog: %s ends with an incomplete record. Truncating it.\n"), host->filename);
+
+                    if (truncate(host->filename, host->size) != 0)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to truncate catalog %s: %s\n"), host->filename, g_strerror(errno));
+                        }
+                }
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to open catalog %s: %s\n"), host->filename, error->message);
+            free_error(error);
+        }
+
+    free_object(the_file);
+}
+
+
+/**
+ * Imports a flat meta data file into a host catalog
+ * @param host is the host catalog (opened to append records).
+ * @param flat_filename is the flat meta data file of the same host.
+ */
+static void import_flat_file(catalog_host_t *host, gchar *flat_filename)
+{
+    GList *file_list = NULL;
+    GList *head = NULL;
+
+    fprintf(stdout, _("Please wait while importing %s into %s\n"), flat_filename, host->filename);
+
+    file_list = file_get_meta_list_from_flat_file(flat_filename);
+
+    for (head = file_list; head != NULL; head = g_list_next(head))
+        {
+            append_meta_to_host(host, head->data);
+        }
+
+    g_list_free_full(file_list, free_glist_meta_data_t);
+    flush_host(host);
+
+    fprintf(stdout, _("Finished !\n"));
+}
+
+
+/**
+ * Frees a host catalog and closes its file.
+ * @param data is the catalog_host_t * structure to be freed.
+ */
+static void free_catalog_host_t(gpointer data)
+{
+    catalog_host_t *host = (catalog_host_t *) data;
+
+    if (host != NULL)
+        {
+            if (host->fd >= 0)
+                {
+                    flush_host(host);
+                    close(host->fd);
+                }
+
+            g_byte_array_free(host->pending, TRUE);
+            free_catalog_node_t(host->root);
+            free_variable(host->filename);
+            free_variable(host);
+        }
+}
+
+
+/**
+ * Gets the catalog of a host, opening (and importing the flat meta data
+ * file if any) when it is the first time this host is seen. Caller must
+ * hold the catalog mutex.
+ * @param catalog is the catalog of the backend.
+ * @param hostname is the name of the host.
+ * @param create is TRUE if the catalog file has to be created when it
+ *        does not exist already.
+ * @returns the catalog_host_t of this host or NULL if there is no
+ *          catalog for that host and create is FALSE.
+ */
+static catalog_host_t *get_host_catalog(catalog_t *catalog, gchar *hostname, gboolean create)
+{
+    catalog_host_t *host = NULL;
+    gchar *basename = NULL;
+    gchar *filename = NULL;
+    gchar *flat_filename = NULL;
+    gboolean exists = FALSE;
+    gboolean flat_exists = FALSE;
+
+    host = g_hash_table_lookup(catalog->hosts, hostname);
+
+    if (host == NULL)
+        {
+            basename = g_strconcat(hostname, CATALOG_SUFFIX, NULL);
+            filename = g_build_filename(catalog->directory, basename, NULL);
+            flat_filename = g_build_filename(catalog->directory, hostname, NULL);
+
+            exists = file_exists(filename);
+            flat_exists = file_exists(flat_filename);
+
+            if (exists == TRUE || flat_exists == TRUE || create == TRUE)
+                {
+                    host = (catalog_host_t *) g_malloc0(sizeof(catalog_host_t));
+                    g_assert_nonnull(host);
+
+                    host->filename = filename;
+                    host->sync = catalog->sync;
+                    host->pending = g_byte_array_sized_new(CATALOG_FLUSH_SIZE);
+                    host->size = 0;
+                    host->nb_records = 0;
+                    host->root = new_catalog_node_t("");
+
+                    if (exists == TRUE)
+                        {
+                            load_host_catalog(host);
+                        }
+
+                    host->flushed = host->size;
+                    host->fd = g_open(filename, O_WRONLY | O_APPEND | O_CREAT, 0644);
+
+                    if (host->fd < 0)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to open catalog %s to append meta-data in it: %s\n"), filename, g_strerror(errno));
+                        }
+                    else if (exists == FALSE && flat_exists == TRUE)
+                        {
+                            import_flat_file(host, flat_filename);
+                        }
+
+                    g_hash_table_insert(catalog->hosts, g_strdup(hostname), host);
+                }
+            else
+                {
+                    free_variable(filename);
+                }
+
+            free_variable(flat_filename);
+            free_variable(basename);
+        }
+
+    return host;
+}
+
+
+/**
+ * Writes pending records of host catalogs. Caller must hold the catalog
+ * mutex.
+ * @param catalog is the catalog.
+ * @param all is TRUE to write every pending record and FALSE to write
+ *        only those of hosts whose oldest pending record is older than
+ *        CATALOG_FLUSH_INTERVAL.
+ */
+static void flush_all_hosts(catalog_t *catalog, gboolean all)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+    catalog_host_t *host = NULL;
+    gint64 now = g_get_monotonic_time();
+
+    g_hash_table_iter_init(&iter, catalog->hosts);
+
+    while (g_hash_table_iter_next(&iter, &key, &value) == TRUE)
+        {
+            host = (catalog_host_t *) value;
+
+            if (host->pending->len > 0 && (all == TRUE || now - host->pending_since >= CATALOG_FLUSH_INTERVAL))
+                {
+                    flush_host(host);
+                }
+        }
+}
+
+
+/**
+ * Thread that writes records that are pending for too long (when
+ * clients send few meta data CATALOG_FLUSH_SIZE is never reached).
+ * @param user_data is the catalog_t structure.
+ * @returns NULL
+ */
+static gpointer flush_catalog_thread(gpointer user_data)
+{
+    catalog_t *catalog = (catalog_t *) user_data;
+    gint64 end_time = 0;
+
+    g_mutex_lock(&catalog->mutex);
+
+    while (catalog->stop == FALSE)
+        {
+            end_time = g_get_monotonic_time() + CATALOG_FLUSH_INTERVAL / 2;
+
+            if (g_cond_wait_until(&catalog->cond, &catalog->mutex, end_time) == FALSE)
+                {
+                    flush_all_hosts(catalog, FALSE);
+                }
+        }
+
+    g_mutex_unlock(&catalog->mutex);
+
+    return NULL;
+}
+
+
+/**
+ * Creates a new catalog for backends that store their meta data in
+ * prefix/meta. Host catalogs are opened when first needed.
+ * @param prefix is the directory where the backend stores everything
+ *        (a "meta" subdirectory must exist in it).
+ * @param sync is the fsync() policy: "none", "flush" or "always" (NULL
+ *        means "flush").
+ * @returns a newly allocated catalog_t structure that may be freed with
+ *          free_catalog_t() when no longer needed.
+ */
+catalog_t *new_catalog_t(gchar *prefix, gchar *sync)
+{
+    catalog_t *catalog = NULL;
+
+    catalog = (catalog_t *) g_malloc0(sizeof(catalog_t));
+    g_assert_nonnull(catalog);
+
+    catalog->directory = g_build_filename(prefix, "meta", NULL);
+    g_mutex_init(&catalog->mutex);
+    g_cond_init(&catalog->cond);
+    catalog->hosts = g_hash_table_new_full(g_str_hash, g_str_equal, free_variable, free_catalog_host_t);
+    catalog->stop = FALSE;
+
+    if (g_strcmp0(sync, "none") == 0)
+        {
+            catalog->sync = CATALOG_SYNC_NONE;
+        }
+    else if (g_strcmp0(sync, "always") == 0)
+        {
+            catalog->sync = CATALOG_SYNC_ALWAYS;
+        }
+    else
+        {
+            catalog->sync = CATALOG_SYNC_FLUSH;
+        }
+
+    if (catalog->sync != CATALOG_SYNC_ALWAYS)
+        {
+            catalog->flush_thread = g_thread_new("catalog-flush", flush_catalog_thread, catalog);
+        }
+
+    return catalog;
+}
+
+
+/**
+ * Frees a catalog, writes pending records and closes every opened
+ * catalog file.
+ * @param catalog is the catalog_t structure to be freed.
+ */
+void free_catalog_t(catalog_t *catalog)
+{
+    if (catalog != NULL)
+        {
+            if (catalog->flush_thread != NULL)
+                {
+                    g_mutex_lock(&catalog->mutex);
+                    catalog->stop = TRUE;
+                    g_cond_signal(&catalog->cond);
+                    g_mutex_unlock(&catalog->mutex);
+                    g_thread_join(catalog->flush_thread);
+                }
+
+            /* free_catalog_host_t() writes pending records */
+            g_hash_table_destroy(catalog->hosts);
+            g_cond_clear(&catalog->cond);
+            g_mutex_clear(&catalog->mutex);
+            free_variable(catalog->directory);
+            free_variable(catalog);
+        }
+}
+
+
+/**
+ * Appends meta data to the catalog of the host that sent it.
+ * @param catalog is the catalog where to store meta data.
+ * @param smeta the server's structure for file meta data. It contains the
+ *        hostname that sent it. It is not freed.
+ */
+void catalog_store_smeta(catalog_t *catalog, server_meta_data_t *smeta)
+{
+    catalog_host_t *host = NULL;
+    guint64 i = 0;
+
+    if (catalog != NULL && smeta != NULL && smeta->hostname != NULL && smeta->meta != NULL)
+        {
+            g_mutex_lock(&catalog->mutex);
+
+            host = get_host_catalog(catalog, smeta->hostname, TRUE);
+
+            if (append_meta_to_host(host, smeta->meta) == TRUE && catalog->mark != NULL)
+                {
+                    for (i = 0; smeta->meta->hashs != NULL && i < smeta->meta->nb_hashs; i++)
+                        {
+                            catalog->mark(smeta->meta->hashs + i * HASH_LEN, catalog->mark_data);
+                        }
+                }
+
+            g_mutex_unlock(&catalog->mutex);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: no server_meta_data_t structure or missing hostname or missing meta_data_t * structure.\n"));
+        }
+}
+
+
+/**
+ * Gets the literal prefix that every filename matching regex must begin
+ * with. Only simple cases are taken into account: regex must be anchored
+ * with '^' and must not contain any alternation. The prefix stops at the
+ * first special or non ASCII character.
+ * @param regex is the regular expression as given in the query (may be
+ *        NULL).
+ * @returns a newly allocated lower case string that may be empty when
+ *          no prefix can be found. It may be freed when no longer needed.
+ */
+static gchar *get_literal_prefix_from_regex(gchar *regex)
+{
+    GString *literal = NULL;
+    gchar *p = NULL;
+    gsize previous_len = 0;
+    gboolean stop = FALSE;
+
+    literal = g_string_new("");
+
+    if (regex != NULL && regex[0] == '^' && strchr(regex, '|') == NULL)
+        {
+            p = regex + 1;
+
+            while (*p != '\0' && stop == FALSE)
+                {
+                    if (*p == '\\' && g_ascii_ispunct(p[1]))
+                        {
+                            /* An escaped character is a literal one */
+                            previous_len = literal->len;
+                            g_string_append_c(literal, p[1]);
+                            p = p + 2;
+                        }
+                    else if ((guchar) *p >= 0x80 || strchr(".[]()*+?{}|\\$^", *p) != NULL)
+                        {
+                            stop = TRUE;
+                        }
+                    else
+                        {
+                            previous_len = literal->len;
+                            g_string_append_c(literal, g_ascii_tolower(*p));
+                            p++;
+                        }
+                }
+
+            if (*p == '*' || *p == '?' || *p == '{')
+                {
+                    /* The last literal character may be absent */
+                    g_string_truncate(literal, previous_len);
+                }
+        }
+
+    return g_string_free(literal, FALSE);
+}
+
+
+/**
+ * @param versions is an array of catalog_version_t sorted by mtime.
+ * @param after is the mtime to look for.
+ * @returns the index of the first version whose mtime is >= after.
+ */
+static guint get_first_version_after(GArray *versions, gint64 after)
+{
+    guint low = 0;
+    guint high = versions->len;
+    guint middle = 0;
+
+    while (low < high)
+        {
+            middle = low + (high - low) / 2;
+
+            if ((gint64) g_array_index(versions, catalog_version_t, middle).mtime < after)
+                {
+                    low = middle + 1;
+                }
+            else
+                {
+                    high = middle;
+                }
+        }
+
+    return low;
+}
+
+
+/**
+ * Adds the offsets of the versions of a node that match the query
+ * @param node is the node whose versions are to be looked at.
+ * @param path is the full path of that node.
+ * @param search is the search context.
+ */
+static void add_node_versions_to_search(catalog_node_t *node, gchar *path, catalog_search_t *search)
+{
+    catalog_version_t *version = NULL;
+    guint i = 0;
+
+    if (node->versions != NULL && (search->regex == NULL || g_regex_match(search->regex, path, 0, NULL) == TRUE))
+        {
+            if (search->has_after == TRUE)
+                {
+                    i = get_first_version_after(node->versions, search->after);
+                }
+
+            for (; i < node->versions->len; i++)
+                {
+                    version = &g_array_index(node->versions, catalog_version_t, i);
+
+                    if (search->has_before == TRUE && (gint64) version->mtime >= search->before)
+                        {
+                            break;
+                        }
+
+                    if (compare_mtime_to_date(version->mtime, search->query->date) == TRUE)
+                        {
+                            g_array_append_val(search->offsets, version->offset);
+                        }
+                }
+        }
+}
+
+
+/**
+ * Adds versions of a node and of all its descendants.
+ * @param node is the node where to begin.
+ * @param path is the full path of node. It is used as a buffer while
+ *        walking the trie and is given back unchanged.
+ * @param is_root is TRUE if node is the root of the trie.
+ * @param search is the search context.
+ */
+static void collect_all_versions(catalog_node_t *node, GString *path, gboolean is_root, catalog_search_t *search)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+    gsize len = path->len;
+
+    add_node_versions_to_search(node, path->str, search);
+
+    if (node->children != NULL)
+        {
+            g_hash_table_iter_init(&iter, node->children);
+
+            while (g_hash_table_iter_next(&iter, &key, &value))
+                {
+                    if (is_root == FALSE)
+                        {
+                            g_string_append_c(path, '/');
+                        }
+
+                    g_string_append(path, ((catalog_node_t *) value)->name);
+                    collect_all_versions((catalog_node_t *) value, path, FALSE, search);
+                    g_string_truncate(path, len);
+                }
+        }
+}
+
+
+/**
+ * Walks down the trie following the components of the literal prefix
+ * of the regular expression. All components but the last one must be
+ * equal (case insensitively) to the node's names and the last one must
+ * be a prefix of them.
+ * @param node is the node reached so far.
+ * @param path is the full path of node (used as a buffer).
+ * @param is_root is TRUE if node is the root of the trie.
+ * @param components are the lower case components of the literal prefix.
+ * @param depth is the index of the component to look for in the
+ *        children of node.
+ * @param search is the search context.
+ */
+static void walk_literal_prefix(catalog_node_t *node, GString *path, gboolean is_root, gchar **components, guint depth, catalog_search_t *search)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+    catalog_node_t *child = NULL;
+    gsize len = path->len;
+    gboolean last = (components[depth + 1] == NULL);
+
+    if (node->children != NULL)
+        {
+            g_hash_table_iter_init(&iter, node->children);
+
+            while (g_hash_table_iter_next(&iter, &key, &value))
+                {
+                    child = (catalog_node_t *) value;
+
+                    if ((last == TRUE && g_str_has_prefix(child->folded, components[depth]) == TRUE) || (last == FALSE && strcmp(child->folded, components[depth]) == 0))
+                        {
+                            if (is_root == FALSE)
+                                {
+                                    g_string_append_c(path, '/');
+                                }
+
+                            g_string_append(path, child->name);
+
+                            if (last == TRUE)
+                                {
+                                    collect_all_versions(child, path, FALSE, search);
+                                }
+                            else
+                                {
+                                    walk_literal_prefix(child, path, FALSE, components, depth + 1, search);
+                                }
+
+                            g_string_truncate(path, len);
+                        }
+                }
+        }
+}
+
+
+/**
+ * Compares two guint64 offsets
+ * @param a is a pointer to the first offset.
+ * @param b is a pointer to the second offset.
+ * @returns -1, 0 or 1 if a is lower than, equal to or greater than b.
+ */
+static gint compare_offsets(gconstpointer a, gconstpointer b)
+{
+    guint64 offset_a = *((guint64 *) a);
+    guint64 offset_b = *((guint64 *) b);
+
+    if (offset_a < offset_b)
+        {
+            return -1;
+        }
+    else if (offset_a > offset_b)
+        {
+            return 1;
+        }
+    else
+        {
+            return 0;
+        }
+}
+
+
+/**
+ * Reads the records at the given offsets of a catalog file.
+ * @param filename is the name of the catalog file.
+ * @param offsets are the guint64 offsets of the records (sorted to read
+ *        the file forward).
+ * @param reduced is TRUE if only reduced meta data are wanted.
+ * @returns a list of meta_data_t * structures.
+ */
+static GList *read_records_from_offsets(gchar *filename, GArray *offsets, gboolean reduced)
+{
+    GFile *the_file = NULL;
+    GFileInputStream *stream = NULL;
+    GError *error = NULL;
+    GList *file_list = NULL;
+    meta_data_t *meta = NULL;
+    guint8 header[CATALOG_RECORD_HEADER_SIZE];
+    guint8 *body = NULL;
+    guint32 body_size = 0;
+    guint32 length = 0;
+    gsize size_read = 0;
+    guint64 offset = 0;
+    guint i = 0;
+
+    the_file = g_file_new_for_path(filename);
+    stream = g_file_read(the_file, NULL, &error);
+
+    if (stream != NULL)
+        {
+            for (i = 0; i < offsets->len && error == NULL; i++)
+                {
+                    offset = g_array_index(offsets, guint64, i);
+                    meta = NULL;
+
+                    if (g_seekable_seek(G_SEEKABLE(stream), offset, G_SEEK_SET, NULL, &error) == TRUE &&
+                        g_input_stream_read_all((GInputStream *) stream, header, CATALOG_RECORD_HEADER_SIZE, &size_read, NULL, &error) == TRUE &&
+                        size_read == CATALOG_RECORD_HEADER_SIZE && get_guint32_from_buffer(header) == CATALOG_MAGIC)
+                        {
+                            length = get_guint32_from_buffer(header + 4);
+
+                            if (length > body_size)
+                                {
+                                    body = (guint8 *) g_realloc(body, length);
+                                    body_size = length;
+                                }
+
+                            if (g_input_stream_read_all((GInputStream *) stream, body, length, &size_read, NULL, &error) == TRUE && size_read == length)
+                                {
+                                    meta = decode_record(body, length, reduced);
+                                }
+                        }
+
+                    if (meta != NULL)
+                        {
+                            file_list = g_list_prepend(file_list, meta);
+                        }
+                    else if (error == NULL)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: invalid record at offset %" G_GUINT64_FORMAT " in catalog %s\n"), offset, filename);
+                        }
+                }
+
+            if (error != NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while reading catalog %s: %s\n"), filename, error->message);
+                    free_error(error);
+                }
+
+            g_input_stream_close((GInputStream *) stream, NULL, NULL);
+            free_object(stream);
+            free_variable(body);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to open catalog %s: %s\n"), filename, error->message);
+            free_error(error);
+        }
+
+    free_object(the_file);
+
+    return file_list;
+}
+
+
+/**
+ * Gets the list of saved files that match the query. Only records of
+ * the matching paths and versions are read from the catalog file.
+ * @param catalog is the catalog to search into.
+ * @param query is the structure that contains everything about the
+ *        requested query.
+ * @returns a JSON string containing all filenames requested
+ */
+gchar *catalog_get_list_of_files(catalog_t *catalog, query_t *query)
+{
+    catalog_host_t *host = NULL;
+    catalog_search_t search;
+    GError *error = NULL;
+    GString *path = NULL;
+    GList *file_list = NULL;
+    gchar *literal = NULL;
+    gchar **components = NULL;
+    gchar *filename = NULL;
+    json_t *array = NULL;
+    json_t *root = NULL;
+    gchar *json_string = NULL;
+
+    if (catalog != NULL && query != NULL && query->hostname != NULL)
+        {
+            print_debug(_("catalog: filter is: %s && %s && %s && %s\n"), query->filename, query->date, query->afterdate, query->beforedate);
+
+            memset(&search, 0, sizeof(catalog_search_t));
+            search.query = query;
+            search.offsets = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+            if (query->filename != NULL)
+                {
+                    search.regex = g_regex_new(query->filename, G_REGEX_CASELESS, 0, &error);
+
+                    if (search.regex == NULL)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: invalid regular expression %s: %s\n"), query->filename, error->message);
+                            free_error(error);
+                        }
+                }
+
+            if (query->afterdate != NULL)
+                {
+                    search.has_after = get_unix_time_from_gchar_date(query->afterdate, &search.after);
+                }
+
+            if (query->beforedate != NULL)
+                {
+                    search.has_before = get_unix_time_from_gchar_date(query->beforedate, &search.before);
+                }
+
+            g_mutex_lock(&catalog->mutex);
+
+            host = get_host_catalog(catalog, query->hostname, FALSE);
+
+            if (host != NULL)
+                {
+                    /* Records are read from the file: pending ones have to be written */
+                    flush_host(host);
+                    filename = g_strdup(host->filename);
+
+                    /* An invalid regular expression matches nothing */
+                    if (query->filename == NULL || search.regex != NULL)
+                        {
+                            literal = get_literal_prefix_from_regex(query->filename);
+                            path = g_string_new("");
+
+                            if (literal[0] == '\0')
+                                {
+                                    collect_all_versions(host->root, path, TRUE, &search);
+                                }
+                            else
+                                {
+                                    components = g_strsplit(literal, "/", -1);
+                                    walk_literal_prefix(host->root, path, TRUE, components, 0, &search);
+                                    g_strfreev(components);
+                                }
+
+                            g_string_free(path, TRUE);
+                            free_variable(literal);
+                        }
+                }
+
+            g_mutex_unlock(&catalog->mutex);
+
+            if (filename != NULL)
+                {
+                    print_debug(_("catalog: reading %u records in %s\n"), search.offsets->len, filename);
+
+                    g_array_sort(search.offsets, compare_offsets);
+                    file_list = read_records_from_offsets(filename, search.offsets, query->reduced);
+
+                    /* Sorting the list. As explained in Glib doc, it may be
+                     * quicker to add elements to the list by prepending them
+                     * and then sorting the list once. */
+                    file_list = g_list_sort(file_list, compare_meta_data_t);
+
+                    /* Filtering  */
+                    if (query->latest == TRUE)
+                        {
+                            file_list = keep_latests_meta_data_t_in_list(file_list);
+                        }
+
+                    /* Converting list into JSON array */
+                    array = convert_meta_data_list_to_json_array(file_list, query->hostname, FALSE);
+
+                    /* Freeing memory */
+                    g_list_free_full(file_list, free_glist_meta_data_t);
+                    free_variable(filename);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: no meta data for host %s.\n"), query->hostname);
+                }
+
+            if (search.regex != NULL)
+                {
+                    g_regex_unref(search.regex);
+                }
+
+            g_array_free(search.offsets, TRUE);
+        }
+    else
+        {
+            print_debug(_("catalog: Something is wrong with backend initialization!\n"));
+        }
+
+    root = json_object();
+    insert_json_value_into_json_root(root, "file_list", array);
+    json_string = json_dumps(root, 0);
+
+    json_decref(array);
+    json_decref(root);
+
+    return json_string;
+}
+
+
+/**
+ * Sets the function called with every hash of the meta data stored from
+ * now on (the garbage collector marks them this way while it runs).
+ * @param catalog is the catalog.
+ * @param mark is the function to call (NULL to stop calling one).
+ * @param user_data is given to mark.
+ */
+void catalog_set_mark_func(catalog_t *catalog, catalog_hash_func mark, gpointer user_data)
+{
+    if (catalog != NULL)
+        {
+            g_mutex_lock(&catalog->mutex);
+            catalog->mark = mark;
+            catalog->mark_data = user_data;
+            g_mutex_unlock(&catalog->mutex);
+        }
+}
+
+
+/**
+ * Opens the catalog of every host that has a catalog file or a flat
+ * meta data file in the meta directory. Caller must hold the catalog
+ * mutex.
+ * @param catalog is the catalog.
+ */
+static void open_all_hosts(catalog_t *catalog)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    gchar *hostname = NULL;
+
+    dir = g_dir_open(catalog->directory, 0, NULL);
+
+    if (dir != NULL)
+        {
+            while ((name = g_dir_read_name(dir)) != NULL)
+                {
+                    if (g_str_has_suffix(name, CATALOG_SUFFIX) == TRUE)
+                        {
+                            hostname = g_strndup(name, strlen(name) - strlen(CATALOG_SUFFIX));
+                        }
+                    else
+                        {
+                            hostname = g_strdup(name);
+                        }
+
+                    get_host_catalog(catalog, hostname, FALSE);
+                    free_variable(hostname);
+                }
+
+            g_dir_close(dir);
+        }
+}
+
+
+/**
+ * Reads the size first bytes of a catalog file and calls func with
+ * every hash of every record.
+ * @param filename is the catalog file.
+ * @param size is the number of bytes of valid records in it.
+ * @param func is the function to call for each hash.
+ * @param user_data is given to func.
+ * @param[in,out] nb_records is incremented for each record read.
+ * @returns TRUE if the size bytes have been read, FALSE otherwise.
+ */
+static gboolean read_hashs_from_file(gchar *filename, guint64 size, catalog_hash_func func, gpointer user_data, guint64 *nb_records)
+{
+    GFile *the_file = NULL;
+    GFileInputStream *stream = NULL;
+    GInputStream *buffered = NULL;
+    GError *error = NULL;
+    guint8 header[CATALOG_RECORD_HEADER_SIZE];
+    guint8 *body = NULL;
+    guint32 body_size = 0;
+    guint32 length = 0;
+    guint32 nb_hashs = 0;
+    guint32 i = 0;
+    guint64 hashs_start = 0;
+    guint64 pos = 0;
+    gsize size_read = 0;
+    gboolean ok = TRUE;
+
+    the_file = g_file_new_for_path(filename);
+    stream = g_file_read(the_file, NULL, &error);
+
+    if (stream != NULL)
+        {
+            buffered = g_buffered_input_stream_new_sized((GInputStream *) stream, CATALOG_BUFFER_SIZE);
+
+            while (ok == TRUE && pos < size)
+                {
+                    ok = g_input_stream_read_all(buffered, header, CATALOG_RECORD_HEADER_SIZE, &size_read, NULL, &error);
+                    ok = ok && size_read == CATALOG_RECORD_HEADER_SIZE && get_guint32_from_buffer(header) == CATALOG_MAGIC;
+
+                    if (ok == TRUE)
+                        {
+                            length = get_guint32_from_buffer(header + 4);
+                            ok = length >= CATALOG_RECORD_FIXED_SIZE && pos + CATALOG_RECORD_HEADER_SIZE + length <= size;
+                        }
+
+                    if (ok == TRUE)
+                        {
+                            if (length > body_size)
+                                {
+                                    body = (guint8 *) g_realloc(body, length);
+                                    body_size = length;
+                                }
+
+                            ok = g_input_stream_read_all(buffered, body, length, &size_read, NULL, &error) && size_read == length;
+                        }
+
+                    if (ok == TRUE)
+                        {
+                            /* Hashs end the record */
+                            nb_hashs = get_guint32_from_buffer(body + 68);
+                            hashs_start = (guint64) length - (guint64) nb_hashs * HASH_LEN;
+                            ok = (guint64) nb_hashs * HASH_LEN <= length - CATALOG_RECORD_FIXED_SIZE;
+
+                            for (i = 0; ok == TRUE && i < nb_hashs; i++)
+                                {
+                                    func(body + hashs_start + i * HASH_LEN, user_data);
+                                }
+
+                            pos = pos + CATALOG_RECORD_HEADER_SIZE + length;
+                            *nb_records = *nb_records + 1;
+                        }
+                }
+
+            if (error != NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while reading catalog %s: %s\n"), filename, error->message);
+                    free_error(error);
+                }
+
+            g_input_stream_close(buffered, NULL, NULL);
+            free_object(buffered);
+            free_object(stream);
+            free_variable(body);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to open catalog %s: %s\n"), filename, error->message);
+            free_error(error);
+            ok = FALSE;
+        }
+
+    free_object(the_file);
+
+    return ok;
+}
+
+
+/**
+ * Calls func with every hash referenced by every record of every host
+ * catalog in the meta directory (hosts not opened yet are opened).
+ * Catalog files are read sequentially and records are not kept in
+ * memory. Records stored while this function runs are not seen.
+ * @param catalog is the catalog.
+ * @param func is the function to call for each hash.
+ * @param user_data is given to func.
+ * @param[out] nb_records is the number of records read.
+ * @returns TRUE if every catalog has been entirely read, FALSE otherwise.
+ */
+gboolean catalog_foreach_hash(catalog_t *catalog, catalog_hash_func func, gpointer user_data, guint64 *nb_records)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+    catalog_host_t *host = NULL;
+    GPtrArray *filenames = NULL;
+    GArray *sizes = NULL;
+    guint i = 0;
+    gboolean ok = TRUE;
+
+    *nb_records = 0;
+
+    if (catalog == NULL || func == NULL)
+        {
+            return FALSE;
+        }
+
+    filenames = g_ptr_array_new_with_free_func(free_variable);
+    sizes = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+    /* Only what has been written when the mutex is held is read: records
+     * are appended and never modified so the files are read without it.
+     */
+    g_mutex_lock(&catalog->mutex);
+
+    open_all_hosts(catalog);
+    g_hash_table_iter_init(&iter, catalog->hosts);
+
+    while (g_hash_table_iter_next(&iter, &key, &value) == TRUE)
+        {
+            host = (catalog_host_t *) value;
+
+            if (flush_host(host) == FALSE)
+                {
+                    ok = FALSE;
+                }
+
+            g_ptr_array_add(filenames, g_strdup(host->filename));
+            g_array_append_val(sizes, host->flushed);
+        }
+
+    g_mutex_unlock(&catalog->mutex);
+
+    for (i = 0; i < filenames->len && ok == TRUE; i++)
+        {
+            ok = read_hashs_from_file(g_ptr_array_index(filenames, i), g_array_index(sizes, guint64, i), func, user_data, nb_records);
+        }
+
+    g_ptr_array_free(filenames, TRUE);
+    g_array_free(sizes, TRUE);
+
+    return ok;
+}
@@ -0,0 +1,272 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    catalog.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file catalog.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the per host meta data catalog. Meta data are appended in a binary
+ * form to prefix/meta/hostname.cat and an in memory index (a trie of
+ * path components where each path has its versions sorted by mtime)
+ * allows queries to read only the records they need.
+ */
+#ifndef _SERVER_CATALOG_H_
+#define _SERVER_CATALOG_H_
+
+
+/**
+ * @def CATALOG_SUFFIX
+ * Suffix of catalog files in the meta directory.
+ */
+#define CATALOG_SUFFIX (".cat")
+
+
+/**
+ * @def CATALOG_BUFFER_SIZE
+ * Size of the buffer used when scanning a whole catalog file.
+ */
+#define CATALOG_BUFFER_SIZE (1048576)
+
+
+/**
+ * @def CATALOG_FLUSH_SIZE
+ * Records are kept in memory and written to the catalog file once that
+ * many bytes are pending.
+ */
+#define CATALOG_FLUSH_SIZE (1048576)
+
+
+/**
+ * @def CATALOG_FLUSH_INTERVAL
+ * Maximum time (in microseconds) a record is kept in memory before being
+ * written to the catalog file.
+ */
+#define CATALOG_FLUSH_INTERVAL (1000000)
+
+
+/**
+ * @def CATALOG_SYNC_NONE
+ * Pending records are written but the system decides when they reach
+ * the disk ("none" policy).
+ */
+#define CATALOG_SYNC_NONE (0)
+
+/**
+ * @def CATALOG_SYNC_FLUSH
+ * Every write of pending records is followed by an fsync() ("flush"
+ * policy, the default).
+ */
+#define CATALOG_SYNC_FLUSH (1)
+
+/**
+ * @def CATALOG_SYNC_ALWAYS
+ * Records are not kept in memory: each one is written and fsync()'ed
+ * ("always" policy).
+ */
+#define CATALOG_SYNC_ALWAYS (2)
+
+
+/**
+ * @def CATALOG_MAGIC
+ * Magic number that begins every record in a catalog file ("CDCT").
+ */
+#define CATALOG_MAGIC (0x54434443)
+
+
+/**
+ * @def CATALOG_RECORD_HEADER_SIZE
+ * Size of the header of each record: magic (4) and length (4) of the
+ * body that follows it.
+ */
+#define CATALOG_RECORD_HEADER_SIZE (4 + 4)
+
+
+/**
+ * @def CATALOG_RECORD_FIXED_SIZE
+ * Size of the fixed part of a record body (all little endian):
+ * file_type (1), padding (3), mode (4), uid (4), gid (4), inode (8),
+ * atime (8), ctime (8), mtime (8), size (8), owner length (2), group
+ * length (2), name length (4), link length (4) and number of hashs (4).
+ * It is followed by owner, group, name and link strings (without their
+ * trailing \0) and by the binary hashs (HASH_LEN bytes each).
+ */
+#define CATALOG_RECORD_FIXED_SIZE (72)
+
+
+/**
+ * Function called for each hash referenced by a catalog record.
+ * @param hash is the binary hash (HASH_LEN bytes, not owned).
+ * @param user_data is the pointer given with the function.
+ */
+typedef void (* catalog_hash_func) (guint8 *hash, gpointer user_data);
+
+
+/**
+ * @struct catalog_version_t
+ * @brief One version of a path: where its record is in the catalog
+ *        file and its mtime to filter on dates without reading it.
+ */
+typedef struct
+{
+    guint64 mtime;   /**< mtime of the file in this version        */
+    guint64 offset;  /**< offset of the record in the catalog file */
+} catalog_version_t;
+
+
+/**
+ * @struct catalog_node_t
+ * @brief A node of the trie of path components. The path of a node is
+ *        made by joining the names from the root with '/'.
+ */
+typedef struct
+{
+    gchar *name;          /**< path component                                          */
+    gchar *folded;        /**< case folded name used for case insensitive lookups      */
+    GHashTable *children; /**< name -> catalog_node_t * (NULL when there is no child)   */
+    GArray *versions;     /**< catalog_version_t sorted by mtime (NULL if none)         */
+} catalog_node_t;
+
+
+/**
+ * @struct catalog_host_t
+ * @brief Catalog of one host.
+ */
+typedef struct
+{
+    gchar *filename;            /**< prefix/meta/hostname.cat                         */
+    gint fd;                    /**< file descriptor where records are appended        */
+    gint sync;                  /**< CATALOG_SYNC_* policy of the catalog             */
+    GByteArray *pending;        /**< records not written yet to the catalog file      */
+    gint64 pending_since;       /**< monotonic time of the oldest pending record      */
+    guint64 flushed;            /**< size of the records written to the catalog file  */
+    guint64 size;               /**< size of valid records (pending ones included)    */
+    guint64 nb_records;         /**< number of records in the catalog file            */
+    catalog_node_t *root;       /**< root of the trie of path components              */
+} catalog_host_t;
+
+
+/**
+ * @struct catalog_t
+ * @brief Catalogs of every host known by a backend.
+ *
+ * Records are appended by the meta data thread and the index is walked
+ * by libmicrohttpd's threads: everything is protected by mutex.
+ * Records are first appended to a per host buffer that is written (group
+ * commit) when it is big enough, when it is too old (flush_thread takes
+ * care of that) or before a query reads the catalog file. Records
+ * themselves are read without the mutex because a query only reads
+ * records that have been written.
+ */
+typedef struct
+{
+    gchar *directory;     /**< directory where catalog files are (prefix/meta) */
+    GMutex mutex;         /**< Protects hosts and everything in them          */
+    GHashTable *hosts;    /**< hostname -> catalog_host_t *                    */
+    gint sync;            /**< CATALOG_SYNC_* policy                           */
+    GCond cond;           /**< Wakes flush_thread up when it has to stop       */
+    gboolean stop;        /**< TRUE when flush_thread has to stop              */
+    GThread *flush_thread; /**< writes records pending for too long            */
+    catalog_hash_func mark; /**< called with every hash stored (may be NULL)   */
+    gpointer mark_data;   /**< user_data given to mark                         */
+} catalog_t;
+
+
+/**
+ * @struct catalog_search_t
+ * @brief Everything needed while walking the trie for one query.
+ */
+typedef struct
+{
+    GRegex *regex;       /**< regular expression on the filename (may be NULL) */
+    query_t *query;      /**< the query itself                                  */
+    gboolean has_after;  /**< TRUE if after is a bound                          */
+    gint64 after;        /**< versions must have mtime >= after                 */
+    gboolean has_before; /**< TRUE if before is a bound                         */
+    gint64 before;       /**< versions must have mtime < before                 */
+    GArray *offsets;     /**< guint64 offsets of the matching records           */
+} catalog_search_t;
+
+
+/**
+ * Creates a new catalog for backends that store their meta data in
+ * prefix/meta. Host catalogs are opened when first needed.
+ * @param prefix is the directory where the backend stores everything
+ *        (a "meta" subdirectory must exist in it).
+ * @param sync is the fsync() policy: "none", "flush" or "always" (NULL
+ *        means "flush").
+ * @returns a newly allocated catalog_t structure that may be freed with
+ *          free_catalog_t() when no longer needed.
+ */
+extern catalog_t *new_catalog_t(gchar *prefix, gchar *sync);
+
+
+/**
+ * Frees a catalog, writes pending records and closes every opened
+ * catalog file.
+ * @param catalog is the catalog_t structure to be freed.
+ */
+extern void free_catalog_t(catalog_t *catalog);
+
+
+/**
+ * Appends meta data to the catalog of the host that sent it.
+ * @param catalog is the catalog where to store meta data.
+ * @param smeta the server's structure for file meta data. It contains the
+ *        hostname that sent it. It is not freed.
+ */
+extern void catalog_store_smeta(catalog_t *catalog, server_meta_data_t *smeta);
+
+
+/**
+ * Gets the list of saved files that match the query. Only records of
+ * the matching paths and versions are read from the catalog file.
+ * @param catalog is the catalog to search into.
+ * @param query is the structure that contains everything about the
+ *        requested query.
+ * @returns a JSON string containing all filenames requested
+ */
+extern gchar *catalog_get_list_of_files(catalog_t *catalog, query_t *query);
+
+
+/**
+ * Sets the function called with every hash of the meta data stored from
+ * now on (the garbage collector marks them this way while it runs).
+ * @param catalog is the catalog.
+ * @param mark is the function to call (NULL to stop calling one).
+ * @param user_data is given to mark.
+ */
+extern void catalog_set_mark_func(catalog_t *catalog, catalog_hash_func mark, gpointer user_data);
+
+
+/**
+ * Calls func with every hash referenced by every record of every host
+ * catalog in the meta directory (hosts not opened yet are opened).
+ * Catalog files are read sequentially and records are not kept in
+ * memory. Records stored while this function runs are not seen.
+ * @param catalog is the catalog.
+ * @param func is the function to call for each hash.
+ * @param user_data is given to func.
+ * @param[out] nb_records is the number of records read.
+ * @returns TRUE if every catalog has been entirely read, FALSE otherwise.
+ */
+extern gboolean catalog_foreach_hash(catalog_t *catalog, catalog_hash_func func, gpointer user_data, guint64 *nb_records);
+
+#endif /* #ifndef _SERVER_CATALOG_H_ */
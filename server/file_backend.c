@@ -32,142 +32,151 @@
 #include "server.h"
 
 
-static gchar *build_filename_from_hash(gchar *path, gchar *hex_has, guint level);
-static void make_all_subdirectories(file_backend_t *file_backend);
-static buffer_t *init_buffer_structure(GFileInputStream *stream);
-static void free_buffer_t(buffer_t *a_buffer);
-static void read_one_buffer(buffer_t *a_buffer);
-static gchar *extract_one_line_from_buffer(buffer_t *a_buffer);
-static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *query);
-static GList *get_file_list_from_regex_and_query(GFileInputStream *stream, GRegex *a_regex, query_t *query);
+static gboolean build_filename_from_hash(file_backend_t *file_backend, guint8 *hash, gchar *filename, gsize *dirlen);
+static gboolean make_directory_of_hash(file_backend_t *file_backend, gchar *filename, gsize dirlen);
+static gchar *find_end_of_line(gchar *start, gchar *end);
+static gboolean is_mtime_in_query(guint64 mtime, flat_parse_t *parse);
+static meta_data_t *extract_from_line(gchar *line, flat_parse_t *parse);
+static gpointer parse_flat_chunk_thread(gpointer user_data);
+static GList *get_file_list_from_regex_and_query(gchar *contents, gsize size, GRegex *a_regex, query_t *query);
 static gshort get_cmptype_from_file_meta(gchar *filename);
 static gssize get_uncmplen_from_file_meta(gchar *filename);
+static gchar *make_file_meta_contents(gssize uncmplen, gshort cmptype, gsize *length);
 static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort cmptype);
+static void add_directory_to_presence(presence_t *presence, gchar *dirname, gchar *hex_prefix, guint depth, guint level);
+static gpointer rebuild_presence_thread(gpointer user_data);
 
 /**
- * Stores meta data into a flat file. A file is created for each host that
- * sends meta data. This code is not thread safe (it means that this is
- * not safe to call it from different threads unless some mechanism
- * garantees that a write will never occur in the same file at the same
- * time.
+ * Stores meta data into the catalog of the host that sent it (in
+ * prefix/meta/hostname.cat).
  * @param server_struct is the server main structure where all
  *        informations needed by the program are stored.
  * @param smeta the server's structure for file meta data. It contains the
- *        hostname that sent it. This structure IS FREED by this
- *        function.
- * @todo prefix should be set as a configuration's option.
+ *        hostname that sent it. It is freed by the meta data thread.
  */
 void file_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta)
 {
-    GFile *meta_file = NULL;
-    gchar *filename = NULL;
-    GFileOutputStream *stream = NULL;
-    GError *error = NULL;
-    gsize count = 0;
-    gssize written = 0;
-    gchar *string_written = NULL;
-    gchar *buffer = NULL;
-    gchar *hash_list = NULL;
-    meta_data_t *meta = NULL;
-    gchar *prefix = NULL;
     file_backend_t *file_backend = NULL;
-    gchar *name64 = NULL;
-    gchar *link64 = NULL;
-
 
     if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL && smeta != NULL)
         {
-            meta = smeta->meta;
             file_backend = server_struct->backend->user_data;
-            prefix = g_build_filename((gchar *) file_backend->prefix, "meta", NULL);
-
-            if (smeta->hostname != NULL && meta != NULL)
-                {
-                    filename = g_build_filename(prefix, smeta->hostname, NULL);
-
-                    meta_file = g_file_new_for_path(filename);
+            catalog_store_smeta(file_backend->catalog, smeta);
+        }
+}
 
-                    stream = g_file_append_to(meta_file, G_FILE_CREATE_NONE, NULL, &error);
 
-                    if (stream != NULL)
-                        {
-                            hash_list = convert_hash_data_list_to_gchar(meta->hash_data_list);
-
-                            name64 = encode_to_base64(meta->name);
-                            link64 = encode_to_base64(meta->link);
+/**
+ * Builds the filename of a block represented by a hash into a buffer:
+ * prefix/data/xx/yy/<rest of the hash in hexadecimal> with level
+ * directories.
+ * @param file_backend is the structure that contains the prefix and the
+ *        level of directories.
+ * @param hash is the binary hash of the block.
+ * @param[out] filename is a buffer of FILE_BACKEND_PATH_LEN bytes where
+ *             the filename is built.
+ * @param[out] dirlen is the length of the directory part of filename
+ *             (filename[*dirlen] is the last '/'). May be NULL.
+ * @returns TRUE if the filename has been built, FALSE if it would not
+ *          fit in the buffer.
+ */
+static gboolean build_filename_from_hash(file_backend_t *file_backend, guint8 *hash, gchar *filename, gsize *dirlen)
+{
+    static const gchar hex[] = "0123456789abcdef";
+    gsize pos = 0;
+    guint i = 0;
 
-                            if (name64 == NULL)
-                                {
-                                    name64 = g_strdup("");
-                                }
+    if (file_backend == NULL || hash == NULL || file_backend->level >= HASH_LEN)
+        {
+            return FALSE;
+        }
 
-                            if (link64 == NULL)
-                                {
-                                    link64 = g_strdup("");
-                                }
+    pos = g_snprintf(filename, FILE_BACKEND_PATH_LEN, "%s%sdata", file_backend->prefix, G_DIR_SEPARATOR_S);
 
-                            if (hash_list != NULL)
-                                {
-                                    buffer = g_strdup_printf("%d, %" G_GUINT64_FORMAT ", %d, %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", \"%s\", \"%s\", %d, %d, \"%s\", \"%s\", %s\n", meta->file_type, meta->inode, meta->mode, meta->atime, meta->ctime, meta->mtime, meta->size, meta->owner, meta->group, meta->uid, meta->gid, name64, link64, hash_list);
-                                    free_variable(hash_list);
-                                }
-                            else
-                                {
-                                    buffer = g_strdup_printf("%d, %" G_GUINT64_FORMAT ", %d, %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", \"%s\", \"%s\", %d, %d, \"%s\", \"%s\"\n", meta->file_type, meta->inode, meta->mode, meta->atime, meta->ctime, meta->mtime, meta->size, meta->owner, meta->group, meta->uid, meta->gid, name64, link64);
-                                }
+    if (pos + file_backend->level * 3 + 1 + (HASH_LEN - file_backend->level) * 2 >= FILE_BACKEND_PATH_LEN)
+        {
+            print_error(__FILE__, __LINE__, _("Error: path %s is too long.\n"), file_backend->prefix);
+            return FALSE;
+        }
 
-                            free_variable(name64);
-                            free_variable(link64);
+    for (i = 0; i < file_backend->level; i++)
+        {
+            filename[pos++] = G_DIR_SEPARATOR;
+            filename[pos++] = hex[hash[i] >> 4];
+            filename[pos++] = hex[hash[i] & 0x0f];
+        }
 
-                            count = strlen(buffer);
-                            written = g_output_stream_write((GOutputStream *) stream, buffer, count, NULL, &error);
+    if (dirlen != NULL)
+        {
+            *dirlen = pos;
+        }
 
-                            if (error != NULL)
-                                {
-                                    string_written = g_strdup_printf("%"G_GSSIZE_FORMAT, written);
-                                    print_error(__FILE__, __LINE__, _("Error: unable to write to file %s (%s bytes written).\n"), filename, string_written);
-                                }
+    filename[pos++] = G_DIR_SEPARATOR;
 
-                            g_output_stream_close((GOutputStream *) stream, NULL, &error);
-                            free_variable(buffer);
-                        }
-                    else
-                        {
-                            print_error(__FILE__, __LINE__, _("Error: unable to open file %s to append meta-data in it.\n"), filename);
-                        }
+    for (i = file_backend->level; i < HASH_LEN; i++)
+        {
+            filename[pos++] = hex[hash[i] >> 4];
+            filename[pos++] = hex[hash[i] & 0x0f];
+        }
 
-                    free_object(meta_file);
-                    free_variable(filename);
-                }
-            else
-                {
-                    print_error(__FILE__, __LINE__, _("Error: no server_meta_data_t structure or missing hostname or missing meta_data_t * structure.\n"));
-                }
+    filename[pos] = '\0';
 
-            free_variable(prefix);
-        }
+    return TRUE;
 }
 
 
 /**
- * Builds the filename of a block represented by a hash
- * @param path is the whole path.
- * @param hex_hash the hash to be stored / retrieved.
- * @param cmptype is the compression type (COMPRESS_NONE_TYPE, COMPRESS_ZLIB_TYPE).
- * @param level is the level chosen to store hashs.
+ * Makes the directory where a block is stored (and its parents) unless
+ * it is already known to exist.
+ * @param file_backend is the structure that contains the cache of the
+ *        directories known to exist.
+ * @param filename is the filename of the block as built by
+ *        build_filename_from_hash(). It is modified while this function
+ *        runs.
+ * @param dirlen is the length of the directory part of filename.
+ * @returns TRUE if the directory exists, FALSE otherwise.
  */
-static gchar *build_filename_from_hash(gchar *path, gchar *hex_hash, guint level)
+static gboolean make_directory_of_hash(file_backend_t *file_backend, gchar *filename, gsize dirlen)
 {
-    gchar *hash_cmp_filename = NULL;
-    gchar *filename = NULL;
+    gchar *dir = NULL;
+    gboolean exists = FALSE;
+    gsize datalen = 0;
+
+    /* dirs keys are relative to prefix/data ("xx/yy") */
+    datalen = dirlen - file_backend->level * 3 + 1;
+    filename[dirlen] = '\0';
+    dir = filename + datalen;
+
+    g_mutex_lock(&file_backend->dirs_mutex);
 
-    /* Stores compression type in the hash filename's separated by a , */
-    hash_cmp_filename = g_strdup_printf("%s", hex_hash + level*2);
-    filename = g_build_filename(path, hash_cmp_filename, NULL);
+    if (file_backend->dirs != NULL && g_hash_table_contains(file_backend->dirs, dir) == TRUE)
+        {
+            exists = TRUE;
+        }
+    else if (g_mkdir_with_parents(filename, 0755) == 0)
+        {
+            exists = TRUE;
 
-    free_variable(hash_cmp_filename);
+            if (file_backend->dirs != NULL)
+                {
+                    if (g_hash_table_size(file_backend->dirs) >= FILE_BACKEND_DIR_CACHE_SIZE)
+                        {
+                            g_hash_table_remove_all(file_backend->dirs);
+                        }
 
-    return filename;
+                    g_hash_table_add(file_backend->dirs, g_strdup(dir));
+                }
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to create directory %s: %s\n"), filename, g_strerror(errno));
+        }
+
+    g_mutex_unlock(&file_backend->dirs_mutex);
+
+    filename[dirlen] = G_DIR_SEPARATOR;
+
+    return exists;
 }
 
 
@@ -230,19 +239,18 @@ static gssize get_uncmplen_from_file_meta(gchar *filename)
 }
 
 /**
- * Sets cmptype and uncmplen in meta hash file.
- * @param filename is the filename of the hash. The meta file has the
- *        same name but ends with .meta
+ * Makes the contents of a meta hash file.
  * @param uncmplen the len of the uncompressed hash file.
  * @param cmptype the compression type used to store this hash file.
+ * @param[out] length is the length of the contents.
+ * @returns a newly allocated string that may be freed with
+ *          free_variable() when no longer needed.
  */
-static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort cmptype)
+static gchar *make_file_meta_contents(gssize uncmplen, gshort cmptype, gsize *length)
 {
-    gchar *filename_meta = NULL;
     GKeyFile *keyfile = NULL;
-    GError *error = NULL;
+    gchar *contents = NULL;
 
-    filename_meta = g_strdup_printf("%s.meta", filename);
     keyfile = g_key_file_new();
 
     if (is_compress_type_allowed(cmptype) == FALSE)
@@ -253,9 +261,34 @@ static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort c
     g_key_file_set_int64(keyfile, GN_META, KN_UNCMPLEN, uncmplen);
     g_key_file_set_integer(keyfile, GN_META, KN_CMPTYPE, cmptype);
 
-    g_key_file_save_to_file(keyfile, filename_meta, &error);
+    contents = g_key_file_to_data(keyfile, length, NULL);
 
     g_key_file_free(keyfile);
+
+    return contents;
+}
+
+
+/**
+ * Sets cmptype and uncmplen in meta hash file.
+ * @param filename is the filename of the hash. The meta file has the
+ *        same name but ends with .meta
+ * @param uncmplen the len of the uncompressed hash file.
+ * @param cmptype the compression type used to store this hash file.
+ */
+static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort cmptype)
+{
+    gchar *filename_meta = NULL;
+    gchar *contents = NULL;
+    gsize length = 0;
+    GError *error = NULL;
+
+    filename_meta = g_strdup_printf("%s.meta", filename);
+    contents = make_file_meta_contents(uncmplen, cmptype, &length);
+
+    g_file_set_contents(filename_meta, contents, length, &error);
+
+    free_variable(contents);
     free_variable(filename_meta);
 }
 
@@ -263,7 +296,7 @@ static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort c
 /**
  * Stores data into a flat file. The file is named by its hash in hex
  * representation (one should easily check that the sha256sum of such a
- * file gives its name !).
+ * file gives its name !). Its directory is created if needed.
  * @param server_struct is the server's main structure where all
  *        informations needed by the program are stored.
  * @param hash_data is a hash_data_t * structure that contains the hash and
@@ -274,27 +307,21 @@ static void set_metadata_to_file_meta(gchar *filename, gssize uncmplen, gshort c
 void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
 {
     GFile *data_file = NULL;
-    gchar *filename = NULL;
+    gchar filename[FILE_BACKEND_PATH_LEN];
+    gsize dirlen = 0;
     GFileOutputStream *stream = NULL;
     GError *error = NULL;
     gssize written = 0;
     gchar *string_written = NULL;
-    gchar *hex_hash = NULL;
-    gchar *path = NULL;
-    gchar *prefix = NULL;
     file_backend_t *file_backend = NULL;
 
     if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
         {
             file_backend = server_struct->backend->user_data;
-            prefix = g_build_filename((gchar *) file_backend->prefix, "data", NULL);
 
-            if (hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL)
+            if (hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL && build_filename_from_hash(file_backend, hash_data->hash, filename, &dirlen) == TRUE)
                 {
-                    path = make_path_from_hash(prefix, hash_data->hash, file_backend->level);
-                    hex_hash = hash_to_string(hash_data->hash);
-
-                    filename = build_filename_from_hash(path, hex_hash, file_backend->level);
+                    make_directory_of_hash(file_backend, filename, dirlen);
                     set_metadata_to_file_meta(filename, hash_data->uncmplen, hash_data->cmptype);
 
                     data_file = g_file_new_for_path(filename);
@@ -310,6 +337,10 @@ void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
                                     print_error(__FILE__, __LINE__, _("Error: unable to write to file %s (%s bytes written).\n"), filename, string_written);
                                     free_variable(string_written);
                                 }
+                            else
+                                {
+                                    presence_insert(file_backend->presence, hash_data->hash);
+                                }
 
                             g_output_stream_close((GOutputStream *) stream, NULL, &error);
 
@@ -324,22 +355,165 @@ void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
                         }
 
                     free_object(data_file);
-                    free_variable(filename);
-                    free_variable(hex_hash);
-                    free_variable(path);
                 }
             else
                 {
                     print_error(__FILE__, __LINE__, _("Error: no hash_data_t structure or hash in it or missing data in it.\n"));
                 }
+        }
+}
+
+
+/**
+ * Stores a list of blocks at once. With io_uring every data file and
+ * its .meta file are written under temporary names with a few
+ * submissions (see io_engine_write_files()). .meta files are renamed
+ * first and a data file only gets its name once its .meta file has its
+ * own: a block without its .meta file would be served uncompressed. A
+ * block whose data or .meta file could not be written is not stored
+ * and is thus asked again to clients. Like file_store_data() files are
+ * not fsync()'ed: renames only protect blocks against crashes of the
+ * process, not against crashes of the system (a block may then be left
+ * truncated or empty under its name). Otherwise each block is stored by
+ * file_store_data().
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data_list is a GList of hash_data_t * structures as
+ *        received by file_store_data(). The list and its elements are
+ *        freed by this function.
+ */
+void file_store_data_list(server_struct_t *server_struct, GList *hash_data_list)
+{
+    io_engine_t *engine = NULL;
+    file_backend_t *file_backend = NULL;
+    GList *iter = NULL;
+    hash_data_t *hash_data = NULL;
+    hash_data_t **blocks = NULL;
+    io_write_t *writes = NULL;
+    gchar filename[FILE_BACKEND_PATH_LEN];
+    gsize dirlen = 0;
+    guint len = 0;
+    guint nb = 0;
+    guint i = 0;
 
-            free_variable(prefix);
+    engine = get_io_engine();
+
+    if (engine == NULL || server_struct == NULL || server_struct->backend == NULL || server_struct->backend->user_data == NULL)
+        {
+            for (iter = hash_data_list; iter != NULL; iter = g_list_next(iter))
+                {
+                    file_store_data(server_struct, (hash_data_t *) iter->data);
+                }
         }
+    else
+        {
+            file_backend = server_struct->backend->user_data;
+            len = g_list_length(hash_data_list);
+            blocks = (hash_data_t **) g_malloc0(len * sizeof(hash_data_t *));
+            /* data files are writes[0 .. nb - 1] and their .meta files writes[nb .. 2 * nb - 1] */
+            writes = (io_write_t *) g_malloc0(2 * len * sizeof(io_write_t));
+
+            for (iter = hash_data_list; iter != NULL; iter = g_list_next(iter))
+                {
+                    hash_data = (hash_data_t *) iter->data;
+
+                    if (hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL && build_filename_from_hash(file_backend, hash_data->hash, filename, &dirlen) == TRUE)
+                        {
+                            make_directory_of_hash(file_backend, filename, dirlen);
+
+                            /* The data file and its .meta file (moved next to the data files below) */
+                            writes[nb].filename = g_strdup(filename);
+                            writes[nb].data = hash_data->data;
+                            writes[nb].length = hash_data->read;
+                            writes[len + nb].filename = g_strdup_printf("%s.meta", filename);
+                            writes[len + nb].data = (guchar *) make_file_meta_contents(hash_data->uncmplen, hash_data->cmptype, &writes[len + nb].length);
+                            blocks[nb] = hash_data;
+                            nb++;
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: no hash_data_t structure or hash in it or missing data in it.\n"));
+                        }
+                }
+
+            if (nb < len)
+                {
+                    memmove(writes + nb, writes + len, nb * sizeof(io_write_t));
+                }
+
+            /* No fsync(): see the comment of this function */
+            io_engine_write_files(engine, writes, 2 * nb, FALSE);
+
+            for (i = 0; i < 2 * nb; i++)
+                {
+                    if (writes[i].result < 0)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to write to file %s: %s\n"), writes[i].filename, g_strerror(-writes[i].result));
+                        }
+                }
+
+            for (i = 0; i < nb; i++)
+                {
+                    /* A block is only stored with both of its files */
+                    if (writes[i].result < 0 && writes[nb + i].result == 0)
+                        {
+                            writes[nb + i].result = writes[i].result;
+                        }
+                    else if (writes[nb + i].result < 0 && writes[i].result == 0)
+                        {
+                            writes[i].result = writes[nb + i].result;
+                        }
+                }
+
+            /* .meta files first */
+            io_engine_rename_files(engine, writes + nb, nb);
+
+            for (i = 0; i < nb; i++)
+                {
+                    if (writes[nb + i].result < 0 && writes[i].result == 0)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to write to file %s: %s\n"), writes[nb + i].filename, g_strerror(-writes[nb + i].result));
+                            writes[i].result = writes[nb + i].result;
+                        }
+                }
+
+            io_engine_rename_files(engine, writes, nb);
+
+            for (i = 0; i < nb; i++)
+                {
+                    if (writes[i].result == 0)
+                        {
+                            presence_insert(file_backend->presence, blocks[i]->hash);
+                        }
+                    else if (writes[nb + i].result == 0)
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to write to file %s: %s\n"), writes[i].filename, g_strerror(-writes[i].result));
+
+                            if (g_file_test(writes[i].filename, G_FILE_TEST_EXISTS) == FALSE)
+                                {
+                                    /* The data file did not get its name: its .meta file is useless */
+                                    g_unlink(writes[nb + i].filename);
+                                }
+                        }
+
+                    free_variable(writes[i].filename);
+                    free_variable(writes[nb + i].filename);
+                    free_variable(writes[nb + i].data);
+                    free_hash_data_t(blocks[i]);
+                }
+
+            free_variable(writes);
+            free_variable(blocks);
+        }
+
+    g_list_free(hash_data_list);
 }
 
 
 /**
- * Builds a list of hashs that cdpfglerver's server needs.
+ * Builds a list of hashs that cdpfglerver's server needs. The presence
+ * index is asked first and the filesystem is only asked when the index
+ * can not tell (while it is not ready).
  * @param server_struct is the server's main structure where all
  *        informations needed by the program are stored.
  * @param hash_list is the list of hashs that we have to check for.
@@ -351,51 +525,63 @@ GList *file_build_needed_hash_list(server_struct_t *server_struct, GList *hash_d
     GFile *data_file = NULL;
     GList *head = hash_data_list;
     GList *needed = NULL;
-    gchar *hex_hash = NULL;
-    gchar *filename = NULL;
-    gchar *path = NULL;
-    gchar *prefix = NULL;
+    gchar filename[FILE_BACKEND_PATH_LEN];
     file_backend_t *file_backend = NULL;
     hash_data_t *hash_data = NULL;
     hash_data_t *needed_hash_data = NULL;
+    gint presence = PRESENCE_UNKNOWN;
+    GHashTable *needed_index = NULL;
 
 
     if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
         {
             file_backend = server_struct->backend->user_data;
-
-            prefix = g_build_filename((gchar *) file_backend->prefix, "data", NULL);
+            needed_index = new_hash_index();
 
             while (head != NULL)
                 {
                     hash_data = head->data;
-                    path = make_path_from_hash(prefix, hash_data->hash, file_backend->level);
-                    hex_hash = hash_to_string(hash_data->hash);
-                    filename = build_filename_from_hash(path, hex_hash, file_backend->level);
-                    data_file = g_file_new_for_path(filename);
+
+                    /* Marked before the lookup: the collector can not delete it once told it is here */
+                    gc_mark_hash(hash_data->hash, file_backend->gc);
+                    presence = presence_lookup(file_backend->presence, hash_data->hash);
+
+                    if (presence == PRESENCE_UNKNOWN && build_filename_from_hash(file_backend, hash_data->hash, filename, NULL) == TRUE)
+                        {
+                            data_file = g_file_new_for_path(filename);
+
+                            if (g_file_query_exists(data_file, NULL) == TRUE)
+                                {
+                                    presence = PRESENCE_PRESENT;
+                                }
+
+                            free_object(data_file);
+                        }
+
+                    if (presence == PRESENCE_PRESENT && file_backend->gc_interval > 0 && build_filename_from_hash(file_backend, hash_data->hash, filename, NULL) == TRUE)
+                        {
+                            /* Its meta data may come later than the collection's marks */
+                            gc_touch_block(file_backend->gc, filename);
+                        }
 
                     /* @todo : do we need to request compressed hash if we have an uncompressed version ?
                      * Also : how can the program thy to answer this without knowing that the hash will be compressed or not ? */
 
-                    if (g_file_query_exists(data_file, NULL) == FALSE && hash_data_is_in_list(hash_data, needed) == FALSE)
+                    if (presence != PRESENCE_PRESENT && g_hash_table_contains(needed_index, hash_data->hash) == FALSE)
                         {
                             /* file does not exists and is not in the needed list so we need it!
                              * thus putting it it the needed list
                              */
                             needed_hash_data = copy_only_hash(hash_data, NULL);
                             needed = g_list_prepend(needed, needed_hash_data);
+                            g_hash_table_add(needed_index, needed_hash_data->hash);
                         }
 
-                    free_object(data_file);
-                    free_variable(filename);
-                    free_variable(hex_hash);
-                    free_variable(path);
-
                     head = g_list_next(head);
                 }
 
+            g_hash_table_destroy(needed_index);
             needed = g_list_reverse(needed);
-            free_variable(prefix);
         }
 
     return needed;
@@ -403,72 +589,82 @@ GList *file_build_needed_hash_list(server_struct_t *server_struct, GList *hash_d
 
 
 /**
- * Makes all subdirectories into the "data" directory.
- * @note creating subdirectories for a level of 2 will take some time and
- *       the empty directories will consume at least 256 Mb of space (ext4
- *       filesystem). A level of 3 will take a long time and will consume
- *       at least like 64 Gb of space (ext4 filesystem). Expect 16 Tb with
- *       level 4 and a very very long time to complete.
- * @param file_backend the structure that contains the prefix path and the
- *        level in which we want to create the subdirectories.
+ * Adds every hash stored in a directory of "data" (and its
+ * subdirectories) to the presence index. Data files are stored in
+ * prefix/data/xx/yy/<rest of the hash> with level directories.
+ * @param presence is the presence index to fill.
+ * @param dirname is the directory to scan.
+ * @param hex_prefix is the beginning of the hexadecimal hash made of
+ *        the names of the directories above dirname.
+ * @param depth is the depth of dirname (0 is prefix/data).
+ * @param level is the level of directories of file_backend.
  */
-static void make_all_subdirectories(file_backend_t *file_backend)
+static void add_directory_to_presence(presence_t *presence, gchar *dirname, gchar *hex_prefix, guint depth, guint level)
 {
-    gchar *path = NULL;
-    gchar *path2 = NULL;
-    gchar *octet = NULL;
-    guint number = 0;
-    double i = 0;
-    double p = 0;
-    double total = 0;
-
-    if (file_backend != NULL && file_backend->level < 5 && file_backend->level > 1)
-        {
-            total = pow(256, file_backend->level);
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    gchar *subdir = NULL;
+    gchar *hex_hash = NULL;
+    guint8 *hash = NULL;
 
-            for (i = 0; i < total; i++)
-                {
-                    path = g_strdup("");
+    dir = g_dir_open(dirname, 0, NULL);
 
-                    for (p = file_backend->level-1; p >= 0; p--)
+    if (dir != NULL)
+        {
+            while ((name = g_dir_read_name(dir)) != NULL)
+                {
+                    if (depth < level && strlen(name) == 2 && g_ascii_isxdigit(name[0]) && g_ascii_isxdigit(name[1]))
                         {
-                            number = i / (pow(256, p));
-
-
-                            if (number > 255)
-                                {
-                                    number = fmod(number, 256);
-                                }
+                            subdir = g_build_filename(dirname, name, NULL);
+                            hex_hash = g_strconcat(hex_prefix, name, NULL);
+                            add_directory_to_presence(presence, subdir, hex_hash, depth + 1, level);
+                            free_variable(hex_hash);
+                            free_variable(subdir);
+                        }
+                    else if (depth == level && strlen(name) == (HASH_LEN - level) * 2)
+                        {
+                            /* .meta files have a longer name and are not considered */
+                            hex_hash = g_strconcat(hex_prefix, name, NULL);
+                            hash = string_to_hash(hex_hash);
+                            presence_insert(presence, hash);
+                            free_variable(hash);
+                            free_variable(hex_hash);
+                        }
+                }
 
+            g_dir_close(dir);
+        }
+}
 
-                            octet = g_strdup_printf("%02x", number);
-                            path2 = g_strconcat(path, octet, "/", NULL);
-                            free_variable(path);
-                            path = path2;
-                            free_variable(octet);
-                        }
 
-                    path[strlen(path)-1] = '\0';
-                    path2 = g_build_filename(file_backend->prefix, "data", path, NULL);
+/**
+ * Thread that fills the presence index with every hash already stored
+ * by file_backend. Until it ends the filesystem is asked for hashs
+ * that are not in the index.
+ * @param user_data is the file_backend_t structure of the backend.
+ * @returns NULL
+ */
+static gpointer rebuild_presence_thread(gpointer user_data)
+{
+    file_backend_t *file_backend = (file_backend_t *) user_data;
+    gchar *dirname = NULL;
+    gint64 elapsed = 0;
 
-                    create_directory(path2);
+    if (file_backend != NULL)
+        {
+            elapsed = trace_begin();
+            dirname = g_build_filename(file_backend->prefix, "data", NULL);
 
-                    free_variable(path);
-                    free_variable(path2);
+            add_directory_to_presence(file_backend->presence, dirname, "", 0, file_backend->level);
+            presence_set_ready(file_backend->presence);
 
-                }
+            trace_end(elapsed, "rebuild_presence_thread");
+            print_debug(_("file_backend: presence index ready with %" G_GUINT64_FORMAT " hashs\n"), presence_count(file_backend->presence));
 
-            /* Creates a directory named .done in prefix/data in order
-             * to tell that we already have created all direcrories an subdirectories
-             */
-            path =  g_build_filename(file_backend->prefix, "data", ".done", NULL);
-            create_directory(path);
-            free_variable(path);
-        }
-    else if (file_backend != NULL)
-        {
-            print_error(__FILE__, __LINE__, _("dir-level (%d) should be > 1 and < 5\n"), file_backend->level);
+            free_variable(dirname);
         }
+
+    return NULL;
 }
 
 
@@ -485,6 +681,7 @@ static void read_from_group_file_backend(file_backend_t *file_backend, gchar *fi
     GError *error = NULL;          /** Glib error handling       */
     gchar *prefix = NULL;
     guint level = 0;
+    gint gc_value = 0;
 
     keyfile = g_key_file_new();
 
@@ -494,6 +691,18 @@ static void read_from_group_file_backend(file_backend_t *file_backend, gchar *fi
                 {
                     prefix = read_string_from_file(keyfile, filename, GN_FILE_BACKEND, KN_FILE_DIRECTORY, _("Could not load [file_backend] file-directory from file."));
                     level = read_int_from_file(keyfile, filename, GN_FILE_BACKEND, KN_DIR_LEVEL, _("Could not load [file_backend] dir-level from file."), FILE_BACKEND_LEVEL);
+
+                    gc_value = read_int_from_file(keyfile, filename, GN_FILE_BACKEND, KN_GC_INTERVAL, _("Could not load [file_backend] gc-interval from file."), GC_DEFAULT_INTERVAL);
+                    file_backend->gc_interval = gc_value >= 0 ? gc_value : GC_DEFAULT_INTERVAL;
+
+                    gc_value = read_int_from_file(keyfile, filename, GN_FILE_BACKEND, KN_GC_RATE, _("Could not load [file_backend] gc-rate from file."), GC_DEFAULT_RATE);
+                    file_backend->gc_rate = gc_value > 0 ? gc_value : GC_DEFAULT_RATE;
+
+                    gc_value = read_int_from_file(keyfile, filename, GN_FILE_BACKEND, KN_GC_MIN_AGE, _("Could not load [file_backend] gc-min-age from file."), GC_DEFAULT_MIN_AGE);
+                    file_backend->gc_min_age = gc_value >= 0 ? gc_value : GC_DEFAULT_MIN_AGE;
+
+                    gc_value = read_int_from_file(keyfile, filename, GN_FILE_BACKEND, KN_GC_MEMORY, _("Could not load [file_backend] gc-memory from file."), GC_DEFAULT_MEMORY);
+                    file_backend->gc_memory = gc_value > 0 ? gc_value : GC_DEFAULT_MEMORY;
                 }
         }
     else if (error != NULL)
@@ -533,7 +742,6 @@ static void read_from_group_file_backend(file_backend_t *file_backend, gchar *fi
 void file_init_backend(server_struct_t *server_struct)
 {
     file_backend_t *file_backend = NULL;
-    gchar *path = NULL;
 
     if (server_struct != NULL && server_struct->backend != NULL)
         {
@@ -542,6 +750,10 @@ void file_init_backend(server_struct_t *server_struct)
             /* default values */
             file_backend->prefix = g_strdup("/var/tmp/cdpfgl/server");
             file_backend->level = FILE_BACKEND_LEVEL;
+            file_backend->gc_interval = GC_DEFAULT_INTERVAL;
+            file_backend->gc_rate = GC_DEFAULT_RATE;
+            file_backend->gc_min_age = GC_DEFAULT_MIN_AGE;
+            file_backend->gc_memory = GC_DEFAULT_MEMORY;
 
             if (server_struct->opt != NULL && server_struct->opt->configfile != NULL)
                 {
@@ -554,15 +766,19 @@ void file_init_backend(server_struct_t *server_struct)
             file_create_directory(file_backend->prefix, "meta");
             file_create_directory(file_backend->prefix, "data");
 
-            path =  g_build_filename(file_backend->prefix, "data", ".done", NULL);
-            if (file_exists(path) == FALSE)
-                {
-                    fprintf(stdout, _("Please wait while creating directories\n"));
-                    make_all_subdirectories(file_backend);
-                    fprintf(stdout, _("Finished !\n"));
-                }
-            free_variable(path);
+            file_backend->catalog = new_catalog_t(file_backend->prefix, server_struct->opt != NULL ? server_struct->opt->meta_sync : NULL);
+
+            /* Subdirectories of "data" are created when needed by file_store_data() */
+            g_mutex_init(&file_backend->dirs_mutex);
+            file_backend->dirs = g_hash_table_new_full(g_str_hash, g_str_equal, free_variable, NULL);
 
+            /* Filling the presence index while the server starts */
+            file_backend->presence = new_presence_t();
+            file_backend->presence_thread = g_thread_new("presence", rebuild_presence_thread, file_backend);
+
+            /* Unreferenced blocks are deleted only if gc-interval is set */
+            file_backend->gc = new_gc_t(file_backend->prefix, file_backend->level, file_backend->presence, file_backend->catalog,
+                                        file_backend->gc_interval, file_backend->gc_rate, file_backend->gc_min_age, file_backend->gc_memory);
         }
     else
         {
@@ -572,172 +788,85 @@ void file_init_backend(server_struct_t *server_struct)
 
 
 /**
- * Allocates a newly buffer_t structure and fills it with the corresponding
- * values.
- * @param stream is the GFileInputStream stream from which we want to read things
- * @returns a newly allocated buffer_t structure with buf, size and pos
- *          filled accordingly. It may be freed when no longer needed.
+ * Finds the end of the line that begins at start (assuming unix style
+ * '\n' end of lines). A '\n' between double quotes does not end a line.
+ * memchr() is used to look for delimiters as it is vectorized by the C
+ * library.
+ * @param start is the beginning of the line.
+ * @param end is the byte right after the end of the chunk.
+ * @returns a pointer to the '\n' that ends the line or end if the line
+ *          is the last one of the chunk and has no '\n'.
  */
-static buffer_t *init_buffer_structure(GFileInputStream *stream)
+static gchar *find_end_of_line(gchar *start, gchar *end)
 {
-    buffer_t *a_buffer = NULL;
-    gchar *buf = NULL;
+    gchar *eol = NULL;
+    gchar *quote = NULL;
+    gchar *pos = start;
+    gboolean in_string = FALSE; /* True when beetween " " and False otherwise */
 
-    a_buffer = (buffer_t *) g_malloc0(sizeof(buffer_t));
-    buf = (gchar *) g_malloc0(FILE_BACKEND_BUFFER_SIZE + 1); /* to store the \0 at the end ! */
+    do
+        {
+            eol = memchr(pos, '\n', end - pos);
 
-    a_buffer->buf = buf;
-    a_buffer->size = 0;
-    a_buffer->pos = 0;
-    a_buffer->stream = stream;
+            if (eol == NULL)
+                {
+                    eol = end;
+                }
 
-    return a_buffer;
-}
+            while ((quote = memchr(pos, '"', eol - pos)) != NULL)
+                {
+                    in_string = !in_string;
+                    pos = quote + 1;
+                }
 
+            pos = eol + 1;
+        }
+    while (in_string == TRUE && eol < end);
 
-/**
- * Frees the buffer structure
- * @param a_buffer is the buffer structure to be freed
- */
-static void free_buffer_t(buffer_t *a_buffer)
-{
-    free_variable(a_buffer->buf);
-    free_variable(a_buffer);
+    return eol;
 }
 
 
 /**
- * Reads one entire buffer
- * @param[in,out] a_buffer is a buffer_t * structure containing all that is
- *                needed to read a buffer and to know where we are in it
- *                when parsing it. It fills the structure with the bytes
- *                read, the number of bytes read and puts pos at 0.
+ * @param mtime is the modification time of a file.
+ * @param parse is what is looked for.
+ * @returns TRUE if mtime matches the dates of the query.
  */
-static void read_one_buffer(buffer_t *a_buffer)
+static gboolean is_mtime_in_query(guint64 mtime, flat_parse_t *parse)
 {
-    GError *error = NULL;
+    gboolean res = FALSE;
 
-    if (a_buffer != NULL && a_buffer->stream != NULL)
-        {
-            a_buffer->size = g_input_stream_read((GInputStream *) a_buffer->stream, a_buffer->buf, FILE_BACKEND_BUFFER_SIZE, NULL, &error);
-            a_buffer->pos = 0;
+    res = compare_mtime_to_date(mtime, parse->query->date);
 
-            if (error != NULL)
-                {
-                    print_error(__FILE__, __LINE__, _("Error while reading the file: %s\n"), error->message);
-                    free_error(error);
-                }
+    if (parse->has_after == TRUE)
+        {
+            res = res && ((gint64) mtime >= parse->after);
         }
-}
 
-
-/**
- * This function extracts one line from the buffer by searching the end of
- * line (assuming unix style '\n' end of lines).
- * @param[in,out] a_buffer contains the buffer the total number of bytes read
- *                and the actual position
- * @returns a gchar * representing a whole line that may be freed when no
- *          longer needed.
- * @warning this function does not work properly (it will not handle ", \n
- *          and , charaters in file names or link names: @todo rewrite
- *          something new that may handle this correctly.
- */
-static gchar *extract_one_line_from_buffer(buffer_t *a_buffer)
-{
-    gchar *line = NULL;
-    gchar *a_line = NULL;
-    gchar *whole_line = NULL;
-    gssize i = 0;
-    gint comma = 0;             /* Counts the fields */
-    gboolean end = FALSE;       /* end of line detected */
-    gboolean in_string = FALSE; /* True when beetween " " and False otherwise */
-
-    if (a_buffer != NULL && a_buffer->buf != NULL)
+    if (parse->has_before == TRUE)
         {
-            i = a_buffer->pos;
-
-            while (end != TRUE && a_buffer->size != 0)
-                {
-                    if (i < a_buffer->size)
-                        {
-                            if (a_buffer->buf[i] == '"')
-                                {
-                                    in_string = !in_string;
-                                }
-                            else if (a_buffer->buf[i] == ',' && in_string == FALSE)
-                                {
-                                    comma++;
-                                }
-
-                            if (a_buffer->buf[i] == '\n' && in_string == FALSE && comma >= 12)
-                                {
-                                    end = TRUE;
-                                }
-                            else
-                                {
-                                    i++;
-                                }
-                        }
-                    else
-                        {
-                            /* The line is stored in more than one buffer */
-                            line = g_strndup(a_buffer->buf + a_buffer->pos, i - a_buffer->pos);
-
-                            if (whole_line != NULL)
-                                {
-                                    /* the line is stored in more than 2 buffers */
-                                    a_line = g_strconcat(whole_line, line, NULL);
-                                    free_variable(whole_line);
-                                    free_variable(line);
-                                    whole_line = a_line;
-                                }
-                            else
-                                {
-                                    /* second buffer */
-                                    whole_line = line;
-                                }
-
-                            read_one_buffer(a_buffer);
-                            i = 0;
-                        }
-                }
-
-            line = g_strndup(a_buffer->buf + a_buffer->pos, i - a_buffer->pos);
-            a_buffer->pos = i + 1; /* the new position is right next '\n' ! */
-
-            if (whole_line != NULL)
-                {
-                    a_line = g_strconcat(whole_line, line, NULL);
-                    free_variable(whole_line);
-                    free_variable(line);
-                    whole_line = a_line;
-                }
-            else
-                {
-                    whole_line = line;
-                }
+            res = res && ((gint64) mtime < parse->before);
         }
 
-    return whole_line;
+    return res;
 }
 
 
 /**
  * Extracts all meta data from one line.
  * @param line is the line that has been read.
- * @param a_regex is the regular expression to filter upon the filename
- * @param query is the structure that contains everything about the
- *        requested filename.
- * @returns a newly allocated gchar * string containing the filename that
- *          may be freed when no longer needed
+ * @param parse is what is looked for (regular expression to filter upon
+ *        the filename and the query).
+ * @returns a newly allocated meta_data_t * structure filled with the
+ *          meta data of the file if it matches the query or NULL
  */
-static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *query)
+static meta_data_t *extract_from_line(gchar *line, flat_parse_t *parse)
 {
     gchar **params = NULL;
     gchar *filename = NULL;
     meta_data_t *meta = NULL;
-    guint32 q_uid = 0;
-    guint32 q_gid = 0;
+    query_t *query = parse->query;
+    GRegex *a_regex = parse->regex;
     gboolean res = FALSE;
 
     if (line != NULL && strlen(line) > 16)
@@ -749,6 +878,13 @@ static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *que
 
             params = g_strsplit(line, ",", 14);
 
+            if (g_strv_length(params) < 13)
+                {
+                    /* Not a meta data line */
+                    g_strfreev(params);
+                    return NULL;
+                }
+
             filename = get_substring_from_string(params[11], TRUE);
 
             if (g_regex_match(a_regex, filename, 0, NULL) && (query->reduced != TRUE))
@@ -766,20 +902,7 @@ static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *que
                     meta->ctime = get_guint64_from_string(params[4]);
                     meta->mtime = get_guint64_from_string(params[5]);
 
-                    res = compare_mtime_to_date(meta->mtime, query->date);
-
-                    /** @todo gain speed in comparison by transforming query->afterdate and query->beforedate only once
-                     *        in the calling function
-                     */
-                    if (query->afterdate != NULL)
-                        {
-                            res = res && compare_after_before_date(meta->mtime, query->afterdate, TRUE);
-                        }
-
-                    if (query->beforedate != NULL)
-                        {
-                            res = res && compare_after_before_date(meta->mtime, query->beforedate, FALSE);
-                        }
+                    res = is_mtime_in_query(meta->mtime, parse);
 
                     if (res == TRUE)
                         {
@@ -791,12 +914,8 @@ static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *que
 
                             meta->uid = get_uint_from_string(params[9]);
                             meta->gid = get_uint_from_string(params[10]);
-                            //q_uid = get_uint_from_string(query->uid);
-                            //q_gid = get_uint_from_string(query->gid);
-
-                            //if (strcmp(meta->owner, query->owner) == 0 && strcmp(meta->group, query->group) == 0 && (meta->uid == q_uid) && (meta->gid == q_gid))
 
-                            meta->hash_data_list = make_hash_data_list_from_string(params[13]);
+                            meta->hashs = make_hash_array_from_string(params[13], &meta->nb_hashs);
 
                             /* This debug message has no text to be translated */
                             print_debug("file_backend: --> type %d, inode: %"G_GUINT64_FORMAT", mode: %d, atime: %"G_GUINT64_FORMAT", ctime: %"G_GUINT64_FORMAT", mtime: %"G_GUINT64_FORMAT", size: %"G_GUINT64_FORMAT", filename: %s, owner: %s, group: %s, uid: %d, gid: %d, link: %s\n", meta->file_type, meta->inode, meta->mode, meta->atime, meta->ctime, meta->mtime, meta->size, meta->name, meta->owner, meta->group, meta->uid, meta->gid, meta->link);
@@ -816,20 +935,7 @@ static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *que
                                     meta->file_type = get_uint_from_string(params[0]);
                                     meta->mtime = get_guint64_from_string(params[5]);
 
-                                    res = compare_mtime_to_date(meta->mtime, query->date);
-
-                                    /** @todo gain speed in comparison by transforming query->afterdate and query->beforedate only once
-                                     *        in the calling function
-                                     */
-                                    if (query->afterdate != NULL)
-                                        {
-                                            res = res && compare_after_before_date(meta->mtime, query->afterdate, TRUE);
-                                        }
-
-                                    if (query->beforedate != NULL)
-                                        {
-                                            res = res && compare_after_before_date(meta->mtime, query->beforedate, FALSE);
-                                        }
+                                    res = is_mtime_in_query(meta->mtime, parse);
 
                                     if (res == TRUE)
                                         {
@@ -857,41 +963,121 @@ static meta_data_t *extract_from_line(gchar *line, GRegex *a_regex, query_t *que
 
 
 /**
- * @param stream is an opened file stream of a plain meta data flat file.
+ * Thread that parses the lines of one chunk of a flat meta data file.
+ * @param user_data is the flat_chunk_t structure of the chunk. Its
+ *        file_list is filled with the meta data found in the chunk.
+ * @returns NULL
+ */
+static gpointer parse_flat_chunk_thread(gpointer user_data)
+{
+    flat_chunk_t *chunk = (flat_chunk_t *) user_data;
+    gchar *pos = chunk->start;
+    gchar *eol = NULL;
+    gchar *line = NULL;
+    meta_data_t *meta = NULL;
+
+    while (pos < chunk->end)
+        {
+            eol = find_end_of_line(pos, chunk->end);
+            line = g_strndup(pos, eol - pos);
+
+            meta = extract_from_line(line, chunk->parse);
+
+            if (meta != NULL)
+                {
+                    chunk->file_list = g_list_prepend(chunk->file_list, meta);
+                }
+
+            free_variable(line);
+            pos = eol + 1; /* the new position is right next '\n' ! */
+        }
+
+    chunk->file_list = g_list_reverse(chunk->file_list);
+
+    return NULL;
+}
+
+
+/**
+ * Splits the contents of a flat meta data file in chunks at end of
+ * lines and parses them in parallel.
+ * @param contents is the whole contents of a plain meta data flat file.
+ * @param size is the size of contents.
  * @param a_regex is a GRegex * regular expression.
  * @param query is the structure that contains everything about the user
  *        requested query.
- * @returns the list of files from the flat file containing all meta data.
+ * @returns the list of files from the flat file containing all meta data
+ *          in the order they were written.
  */
-static GList *get_file_list_from_regex_and_query(GFileInputStream *stream, GRegex *a_regex, query_t *query)
+static GList *get_file_list_from_regex_and_query(gchar *contents, gsize size, GRegex *a_regex, query_t *query)
 {
-    buffer_t *a_buffer = NULL;
-    gchar *line = NULL;
-    meta_data_t *meta = NULL;
+    flat_parse_t parse;
+    flat_chunk_t *chunks = NULL;
     GList *file_list = NULL;
+    gchar *end = contents + size;
+    gchar *pos = contents;
+    gchar *eol = NULL;
+    guint nb_chunks = 0;
+    guint i = 0;
+
+    parse.regex = a_regex;
+    parse.query = query;
+    parse.has_after = FALSE;
+    parse.has_before = FALSE;
+
+    if (query->afterdate != NULL)
+        {
+            parse.has_after = get_unix_time_from_gchar_date(query->afterdate, &parse.after);
+        }
+
+    if (query->beforedate != NULL)
+        {
+            parse.has_before = get_unix_time_from_gchar_date(query->beforedate, &parse.before);
+        }
 
-    a_buffer = init_buffer_structure(stream);
-    read_one_buffer(a_buffer);
+    nb_chunks = MIN(g_get_num_processors(), size / FILE_BACKEND_CHUNK_MIN_SIZE + 1);
+    chunks = (flat_chunk_t *) g_malloc0(nb_chunks * sizeof(flat_chunk_t));
 
-    do
+    for (i = 0; i < nb_chunks; i++)
         {
-            line = extract_one_line_from_buffer(a_buffer);
+            chunks[i].start = pos;
+            chunks[i].parse = &parse;
 
-            if (a_buffer->size != 0)
+            if (i == nb_chunks - 1)
                 {
-                    meta = extract_from_line(line, a_regex, query);
-
-                    if (meta != NULL)
-                        {
-                            file_list = g_list_prepend(file_list, meta);
-                        }
+                    pos = end;
+                }
+            else if (pos < contents + (size / nb_chunks) * (i + 1))
+                {
+                    /* chunks end right after a '\n': file and link names are
+                     * base64 encoded and never contain one.
+                     */
+                    eol = memchr(contents + (size / nb_chunks) * (i + 1), '\n', end - (contents + (size / nb_chunks) * (i + 1)));
+                    pos = (eol == NULL) ? end : eol + 1;
                 }
 
-            free_variable(line);
+            chunks[i].end = pos;
         }
-    while (a_buffer->size != 0);
 
-    free_buffer_t(a_buffer);
+    /* The first chunk is parsed by this thread */
+    for (i = 1; i < nb_chunks; i++)
+        {
+            chunks[i].thread = g_thread_new("flat-meta", parse_flat_chunk_thread, &chunks[i]);
+        }
+
+    parse_flat_chunk_thread(&chunks[0]);
+
+    for (i = 1; i < nb_chunks; i++)
+        {
+            g_thread_join(chunks[i].thread);
+        }
+
+    for (i = nb_chunks; i > 0; i--)
+        {
+            file_list = g_list_concat(chunks[i - 1].file_list, file_list);
+        }
+
+    free_variable(chunks);
 
     return file_list;
 }
@@ -904,83 +1090,68 @@ static GList *get_file_list_from_regex_and_query(GFileInputStream *stream, GRege
  * @param query is the structure that contains everything about the
  *        requested query.
  * @returns a JSON string containing all filenames requested
- * @note g_str_match_string is only available since glib 2.40 and
- *       travis-ci.org has an older version of it!
  */
 gchar *file_get_list_of_files(server_struct_t *server_struct, query_t *query)
 {
-    gchar *filename = NULL;
     file_backend_t *file_backend = NULL;
-    GFile *the_file = NULL;
-    GFileInputStream *stream = NULL;
+    catalog_t *catalog = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL &&  server_struct->backend->user_data != NULL)
+        {
+            file_backend = server_struct->backend->user_data;
+            catalog = file_backend->catalog;
+        }
+
+    return catalog_get_list_of_files(catalog, query);
+}
+
+
+/**
+ * Reads every entry of a flat meta data file (prefix/meta/hostname) as
+ * written by previous versions. It is used to import such files into
+ * the catalog. The file is mapped in memory and parsed in parallel.
+ * @param filename is the name of the flat meta data file.
+ * @returns the list of all meta_data_t * structures of that file in the
+ *          order they were written.
+ */
+GList *file_get_meta_list_from_flat_file(gchar *filename)
+{
+    GMappedFile *mapped = NULL;
     GError *error = NULL;
-    json_t *array = NULL;
-    json_t *root = NULL;
-    gchar *json_string = NULL;
     GRegex *a_regex = NULL;
     GList *file_list = NULL;
+    query_t *query = NULL;
 
-
-    if (server_struct != NULL && server_struct->backend != NULL &&  server_struct->backend->user_data != NULL && query != NULL)
+    if (filename != NULL)
         {
-            print_debug(_("file_backend: filter is: %s && %s && %s && %s\n"), query->filename, query->date, query->afterdate, query->beforedate);
-
-            a_regex = g_regex_new(query->filename, G_REGEX_CASELESS, 0, &error);
-
-            file_backend = server_struct->backend->user_data;
-            filename =  g_build_filename(file_backend->prefix, "meta", query->hostname, NULL);
-            the_file = g_file_new_for_path(filename);
+            /* A query that matches everything */
+            query = init_query_t(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, FALSE, FALSE);
+            a_regex = g_regex_new("", 0, 0, NULL);
 
             print_debug(_("file_backend: Reading in %s\n"), filename);
 
-            stream = g_file_read(the_file, NULL, &error);
+            mapped = g_mapped_file_new(filename, FALSE, &error);
 
-            if (stream != NULL)
+            if (mapped != NULL)
                 {
-                    /* Requesting a list of files corresponding to a_regex and query */
-                    file_list = get_file_list_from_regex_and_query(stream, a_regex, query);
-
-                    /* Closing file input stream */
-                    g_input_stream_close((GInputStream *) stream, NULL, &error);
-
-                    /* Sorting the list. As explained in Glib doc, it may be
-                     * quicker to add elements to the list by prepending them
-                     * and then sorting the list once. */
-                    file_list = g_list_sort(file_list, compare_meta_data_t);
-
-                    /* Filtering  */
-                    if (query->latest == TRUE)
+                    if (g_mapped_file_get_length(mapped) > 0)
                         {
-                            file_list = keep_latests_meta_data_t_in_list(file_list);
+                            file_list = get_file_list_from_regex_and_query(g_mapped_file_get_contents(mapped), g_mapped_file_get_length(mapped), a_regex, query);
                         }
 
-                    /* Converting list into JSON array */
-                    array = convert_meta_data_list_to_json_array(file_list, query->hostname, FALSE);
-
-                    /* Freeing memory */
-                    g_list_free_full(file_list, free_glist_meta_data_t);
+                    g_mapped_file_unref(mapped);
                 }
             else
                 {
                      print_error(__FILE__, __LINE__, _("Error: unable to open file %s to read data from it.\n"), filename);
+                     free_error(error);
                 }
 
-            free_variable(filename);
             g_regex_unref(a_regex);
-        }
-    else
-        {
-            print_debug(_("file_backend: Something is wrong with backend initialization!\n"));
+            free_query_t(query);
         }
 
-    root = json_object();
-    insert_json_value_into_json_root(root, "file_list", array);
-    json_string = json_dumps(root, 0);
-
-    json_decref(array);
-    json_decref(root);
-
-    return json_string;
+    return file_list;
 }
 
 
@@ -996,13 +1167,11 @@ gchar *file_get_list_of_files(server_struct_t *server_struct, query_t *query)
 hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
 {
     GFile *data_file = NULL;
-    gchar *filename = NULL;
+    gchar filename[FILE_BACKEND_PATH_LEN];
     GFileInputStream *stream = NULL;
     GError *error = NULL;
     gssize size_read = 0;
     gchar *string_read = NULL;
-    gchar *path = NULL;
-    gchar *prefix = NULL;
     file_backend_t *file_backend = NULL;
     hash_data_t *hash_data = NULL;
     guchar *data = NULL;
@@ -1015,52 +1184,93 @@ hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
     if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
         {
             file_backend = server_struct->backend->user_data;
-            prefix = g_build_filename((gchar *) file_backend->prefix, "data", NULL);
             hash = string_to_hash(hex_hash);
-            path = make_path_from_hash(prefix, hash, file_backend->level);
-            filename = build_filename_from_hash(path, hex_hash, file_backend->level);
-            cmptype = get_cmptype_from_file_meta(filename);
-            data_file = g_file_new_for_path(filename);
-            stream = g_file_read(data_file, NULL, &error);
 
-            if (stream != NULL)
+            if (build_filename_from_hash(file_backend, hash, filename, NULL) == TRUE)
                 {
-                    filesize = get_file_size(data_file);
-                    /* we can do this because files here are blocks and
-                     * may not be too big: as large as the biggest CLIENT_BUFFER_SIZE. */
-                    data = (guchar *) g_malloc(filesize + 1);   /* No need to do g_malloc0  because data is binary data */
-
-                    size_read = g_input_stream_read((GInputStream *) stream, data, filesize, NULL, &error);
+                    cmptype = get_cmptype_from_file_meta(filename);
+                    data_file = g_file_new_for_path(filename);
+                    stream = g_file_read(data_file, NULL, &error);
 
-                    if (error != NULL)
+                    if (stream != NULL)
                         {
-                            string_read = g_strdup_printf("%"G_GSSIZE_FORMAT, size_read);
-                            print_error(__FILE__, __LINE__, _("Error: unable to read from file %s (%s bytes read): %s.\n"), filename, string_read, error->message);
-                            free_variable(string_read);
-                            free_error(error);
+                            filesize = get_file_size(data_file);
+                            /* we can do this because files here are blocks and
+                             * may not be too big: as large as the biggest CLIENT_BUFFER_SIZE. */
+                            data = (guchar *) g_malloc(filesize + 1);   /* No need to do g_malloc0  because data is binary data */
+
+                            size_read = g_input_stream_read((GInputStream *) stream, data, filesize, NULL, &error);
+
+                            if (error != NULL)
+                                {
+                                    string_read = g_strdup_printf("%"G_GSSIZE_FORMAT, size_read);
+                                    print_error(__FILE__, __LINE__, _("Error: unable to read from file %s (%s bytes read): %s.\n"), filename, string_read, error->message);
+                                    free_variable(string_read);
+                                    free_error(error);
+                                }
+                            else
+                                {
+                                    /* We need to know the compression type directly from the stored filename */
+                                    uncmplen = get_uncmplen_from_file_meta(filename);
+
+                                    /* see retreive_data() in server.c */
+                                    hash_data = new_hash_data_t_as_is(data, size_read, hash, cmptype, uncmplen);
+                                }
+
+                            g_input_stream_close((GInputStream *) stream, NULL, &error);
+                            g_object_unref(stream);
                         }
                     else
                         {
-                            /* We need to know the compression type directly from the stored filename */
-                            uncmplen = get_uncmplen_from_file_meta(filename);
-
-                            /* see retreive_data() in server.c */
-                            hash_data = new_hash_data_t_as_is(data, size_read, hash, cmptype, uncmplen);
+                             print_error(__FILE__, __LINE__, _("Error: unable to open file %s to read data from it.\n"), filename);
                         }
 
-                    g_input_stream_close((GInputStream *) stream, NULL, &error);
-                    g_object_unref(stream);
-                }
-            else
-                {
-                     print_error(__FILE__, __LINE__, _("Error: unable to open file %s to read data from it.\n"), filename);
+                    free_object(data_file);
                 }
-
-            free_object(data_file);
-            free_variable(filename);
-            free_variable(path);
-            free_variable(prefix);
         }
 
     return hash_data;
 }
+
+
+/**
+ * Writes meta data still in memory and closes the catalog when the
+ * server ends.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+void file_terminate_backend(server_struct_t *server_struct)
+{
+    file_backend_t *file_backend = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
+        {
+            file_backend = server_struct->backend->user_data;
+            free_gc_t(file_backend->gc);
+            file_backend->gc = NULL;
+            free_catalog_t(file_backend->catalog);
+            file_backend->catalog = NULL;
+        }
+}
+
+
+/**
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @returns a newly allocated string with the epoch of the store (it
+ *          changes each time the garbage collector deletes blocks) or
+ *          NULL.
+ */
+gchar *file_get_epoch(server_struct_t *server_struct)
+{
+    file_backend_t *file_backend = NULL;
+    gchar *epoch = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
+        {
+            file_backend = server_struct->backend->user_data;
+            epoch = gc_get_epoch(file_backend->gc);
+        }
+
+    return epoch;
+}
@@ -31,11 +31,12 @@
 
 
 /**
- * @def FILE_BACKEND_BUFFER_SIZE
- * Defines the buffer size used to read files in the file_backend backend.
- * Should be at least as big as CLIENT_BLOCK_SIZE
+ * @def FILE_BACKEND_CHUNK_MIN_SIZE
+ * Defines the minimum size of the chunks of a flat meta data file that
+ * are parsed in parallel (one thread per chunk, at most one per
+ * processor).
  */
-#define FILE_BACKEND_BUFFER_SIZE (65536)
+#define FILE_BACKEND_CHUNK_MIN_SIZE (1048576)
 
 
 /**
@@ -44,6 +45,21 @@
  */
 #define FILE_BACKEND_LEVEL (2)
 
+
+/**
+ * @def FILE_BACKEND_PATH_LEN
+ * Size of the buffers where the filenames of the blocks are built.
+ */
+#define FILE_BACKEND_PATH_LEN (4096)
+
+
+/**
+ * @def FILE_BACKEND_DIR_CACHE_SIZE
+ * Maximum number of directories known to exist that are remembered by
+ * file_store_data() (the cache is emptied when it is full).
+ */
+#define FILE_BACKEND_DIR_CACHE_SIZE (65536)
+
 /**
  * To store meta data of the hash file.
  */
@@ -62,41 +78,66 @@
  * to store up to 512 Gbytes of deduplicated data. A level of 3 should be
  * ok up to 256 tera bytes of deduplicated data. A level of 4 should be ok
  * for up to 65536 tera bytes !
+ * Directories are created when the first block that belongs to them is
+ * stored and dirs remembers the ones that are known to exist.
  */
 typedef struct
 {
-    gchar *prefix; /**< Prefix for the path where data are located */
-    guint level;   /**< level of directories defaults to 3 */
+    gchar *prefix;             /**< Prefix for the path where data are located        */
+    guint level;               /**< level of directories defaults to 3                */
+    presence_t *presence;      /**< in memory index of hashs already stored            */
+    GThread *presence_thread;  /**< thread that fills presence index at startup        */
+    catalog_t *catalog;        /**< per host meta data catalogs                        */
+    GMutex dirs_mutex;         /**< Protects dirs                                      */
+    GHashTable *dirs;          /**< directories (relative to data) known to exist      */
+    guint gc_interval;         /**< seconds between two garbage collections (0: none)  */
+    guint gc_rate;             /**< filesystem operations per second of the sweep      */
+    guint gc_min_age;          /**< unreferenced blocks younger than this are kept     */
+    guint gc_memory;           /**< size (in MB) of the Bloom filter of the collector  */
+    gc_t *gc;                  /**< garbage collector of unreferenced blocks           */
 } file_backend_t;
 
 
 
 /**
- * @struct buffer_t
- * @brief used to know where we are in the buffer when extracting lines of
- *        it.
+ * @struct flat_parse_t
+ * @brief What is looked for in a flat meta data file. Dates of the query
+ *        are transformed into unix time once for all.
  */
 typedef struct
 {
-    GFileInputStream *stream;   /**< Stream from which we want to read things */
-    gssize pos;                 /**< Position into the buffer                 */
-    gssize size;                /**< number of bytes read into the buffer     */
-    gchar *buf;                 /**< buffer read                              */
-} buffer_t;
+    GRegex *regex;          /**< regular expression to filter upon the filename */
+    query_t *query;         /**< the query itself                               */
+    gboolean has_after;     /**< TRUE when after is a valid date                */
+    gint64 after;           /**< files must have been modified after that time  */
+    gboolean has_before;    /**< TRUE when before is a valid date               */
+    gint64 before;          /**< files must have been modified before that time */
+} flat_parse_t;
+
+
+/**
+ * @struct flat_chunk_t
+ * @brief A chunk of a flat meta data file made of whole lines and parsed
+ *        by its own thread.
+ */
+typedef struct
+{
+    gchar *start;           /**< first byte of the chunk                         */
+    gchar *end;             /**< byte right after the last one of the chunk      */
+    flat_parse_t *parse;    /**< what is looked for (shared by all chunks)       */
+    GList *file_list;       /**< meta_data_t * found in the chunk (file's order) */
+    GThread *thread;        /**< thread that parses the chunk                    */
+} flat_chunk_t;
 
 
 
 /**
- * Stores meta data into a flat file. A file is created for each host that
- * sends meta data. This code is not thread safe (it means that this is
- * not safe to call it from different threads unless some mechanism
- * garantees that a write will never occur in the same file at the same
- * time.
- * @param server_struct is the server's main structure where all
+ * Stores meta data into the catalog of the host that sent it (in
+ * prefix/meta/hostname.cat).
+ * @param server_struct is the server main structure where all
  *        informations needed by the program are stored.
  * @param smeta the server's structure for file meta data. It contains the
- *        hostname that sent it. This structure MUST be freed by this
- *        function.
+ *        hostname that sent it. It is freed by the meta data thread.
  */
 extern void file_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta);
 
@@ -124,6 +165,20 @@ extern void file_init_backend(server_struct_t *server_struct);
 extern void file_store_data(server_struct_t *server_struct, hash_data_t *hash_data);
 
 
+/**
+ * Stores a list of blocks at once. With io_uring every data file and
+ * its .meta file are written with a few submissions (see
+ * io_engine_write_files()). Otherwise each block is stored by
+ * file_store_data().
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data_list is a GList of hash_data_t * structures as
+ *        received by file_store_data(). The list and its elements are
+ *        freed by this function.
+ */
+extern void file_store_data_list(server_struct_t *server_struct, GList *hash_data_list);
+
+
 /**
  * Builds a list of hashs that server's server needs.
  * @param server_struct is the server's main structure where all
@@ -144,6 +199,17 @@ extern GList *file_build_needed_hash_list(server_struct_t *server_struct, GList
 extern gchar *file_get_list_of_files(server_struct_t *server_struct, query_t *query);
 
 
+/**
+ * Reads every entry of a flat meta data file (prefix/meta/hostname) as
+ * written by previous versions. It is used to import such files into
+ * the catalog.
+ * @param filename is the name of the flat meta data file.
+ * @returns the list of all meta_data_t * structures of that file in the
+ *          order they were written.
+ */
+extern GList *file_get_meta_list_from_flat_file(gchar *filename);
+
+
 /**
  * Retrieves data from a flat file. The file is named by its hash in hex
  * representation (one should easily check that the sha256sum of such a
@@ -155,4 +221,23 @@ extern gchar *file_get_list_of_files(server_struct_t *server_struct, query_t *qu
  */
 extern hash_data_t *file_retrieve_data(server_struct_t *server_struct, gchar *hex_hash);
 
+
+/**
+ * Writes meta data still in memory and closes the catalog when the
+ * server ends.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+extern void file_terminate_backend(server_struct_t *server_struct);
+
+
+/**
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @returns a newly allocated string with the epoch of the store (it
+ *          changes each time the garbage collector deletes blocks) or
+ *          NULL.
+ */
+extern gchar *file_get_epoch(server_struct_t *server_struct);
+
 #endif /* #ifndef _SERVER_FILE_BACKEND_H_ */
@@ -0,0 +1,591 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    gc.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file gc.c
+ *
+ * This file contains the garbage collector of file_backend. A collection
+ * marks every hash referenced by the catalogs in a Bloom filter (memory
+ * is bounded whatever the number of hashs is: a false positive only
+ * keeps an unreferenced block) and then sweeps the data directories,
+ * deleting unmarked blocks that are old enough. A block is as old as the
+ * last time it was stored or told present to a client: meta data that
+ * reference it may arrive long after the collection began. Temporary
+ * files left by an interrupted store are deleted when they are old
+ * enough too. Filesystem operations of the sweep are rate limited not to
+ * slow the storage of new data.
+ */
+
+#include "server.h"
+
+static guint64 get_guint64_from_hash(guint8 *hash, guint offset);
+static void bloom_add(guint8 *bloom, guint64 bloom_bits, guint8 *hash);
+static gboolean bloom_may_contain(guint8 *bloom, guint64 bloom_bits, guint8 *hash);
+static gboolean gc_wait(gc_t *gc, gint64 end_time);
+static gboolean gc_throttle(gc_t *gc);
+static void sweep_block(gc_t *gc, gchar *filename, guint8 *hash, gint64 older_than);
+static void sweep_temp_file(gc_t *gc, gchar *filename, gint64 older_than);
+static gboolean sweep_directory(gc_t *gc, gchar *dirname, gchar *hex_prefix, guint depth, gint64 older_than);
+static void collect(gc_t *gc);
+static void save_epoch(gc_t *gc);
+static void load_epoch(gc_t *gc);
+static gpointer gc_thread(gpointer user_data);
+
+
+/**
+ * @param hash is a binary hash of HASH_LEN bytes.
+ * @param offset is the offset in the hash where to read 8 bytes.
+ * @returns the guint64 made of the 8 bytes at offset in hash.
+ */
+static guint64 get_guint64_from_hash(guint8 *hash, guint offset)
+{
+    guint64 value = 0;
+
+    memcpy(&value, hash + offset, sizeof(guint64));
+
+    return value;
+}
+
+
+/**
+ * Sets the GC_BLOOM_PROBES bits of hash in the Bloom filter (double
+ * hashing with two 64 bits words of the hash).
+ * @param bloom is the Bloom filter.
+ * @param bloom_bits is the number of bits in the filter (power of two).
+ * @param hash is the binary hash to add.
+ */
+static void bloom_add(guint8 *bloom, guint64 bloom_bits, guint8 *hash)
+{
+    guint64 h1 = get_guint64_from_hash(hash, 0);
+    guint64 h2 = get_guint64_from_hash(hash, 24);
+    guint64 bit = 0;
+    guint i = 0;
+
+    for (i = 0; i < GC_BLOOM_PROBES; i++)
+        {
+            bit = (h1 + i * h2) & (bloom_bits - 1);
+            bloom[bit >> 3] |= (1 << (bit & 7));
+        }
+}
+
+
+/**
+ * Tests the GC_BLOOM_PROBES bits of hash in the Bloom filter
+ * @param bloom is the Bloom filter.
+ * @param bloom_bits is the number of bits in the filter (power of two).
+ * @param hash is the binary hash to look for.
+ * @returns FALSE if hash has never been added, TRUE if it may have been.
+ */
+static gboolean bloom_may_contain(guint8 *bloom, guint64 bloom_bits, guint8 *hash)
+{
+    guint64 h1 = get_guint64_from_hash(hash, 0);
+    guint64 h2 = get_guint64_from_hash(hash, 24);
+    guint64 bit = 0;
+    guint i = 0;
+    gboolean maybe = TRUE;
+
+    for (i = 0; i < GC_BLOOM_PROBES && maybe == TRUE; i++)
+        {
+            bit = (h1 + i * h2) & (bloom_bits - 1);
+            maybe = ((bloom[bit >> 3] & (1 << (bit & 7))) != 0);
+        }
+
+    return maybe;
+}
+
+
+/**
+ * Waits until end_time unless the garbage collector is stopped.
+ * @param gc is the garbage collector.
+ * @param end_time is the monotonic time until when to wait.
+ * @returns FALSE if the garbage collector has to stop, TRUE otherwise.
+ */
+static gboolean gc_wait(gc_t *gc, gint64 end_time)
+{
+    gboolean go_on = TRUE;
+
+    g_mutex_lock(&gc->mutex);
+
+    while (gc->stop == FALSE && g_cond_wait_until(&gc->cond, &gc->mutex, end_time) == TRUE)
+        {
+            /* spurious wake up or signal: gc->stop is tested again */
+        }
+
+    go_on = (gc->stop == FALSE);
+
+    g_mutex_unlock(&gc->mutex);
+
+    return go_on;
+}
+
+
+/**
+ * Accounts for one filesystem operation and sleeps until the next second
+ * when rate operations have already been done in the current one.
+ * @param gc is the garbage collector.
+ * @returns FALSE if the garbage collector has to stop, TRUE otherwise.
+ */
+static gboolean gc_throttle(gc_t *gc)
+{
+    gint64 now = g_get_monotonic_time();
+    gboolean go_on = TRUE;
+
+    if (now - gc->window >= G_USEC_PER_SEC)
+        {
+            gc->window = now;
+            gc->ops = 0;
+        }
+    else if (gc->ops >= gc->rate)
+        {
+            go_on = gc_wait(gc, gc->window + G_USEC_PER_SEC);
+            gc->window = g_get_monotonic_time();
+            gc->ops = 0;
+        }
+
+    gc->ops++;
+
+    return go_on;
+}
+
+
+/**
+ * Deletes a block (and its .meta file) if it is not marked and is older
+ * than older_than. The mutex is held from the test of the Bloom filter
+ * to the removal of the hash from the presence index: a hash marked
+ * meanwhile is not deleted.
+ * @param gc is the garbage collector.
+ * @param filename is the filename of the block.
+ * @param hash is the binary hash of the block.
+ * @param older_than is the unix time before which the block must have
+ *        been modified to be deleted.
+ */
+static void sweep_block(gc_t *gc, gchar *filename, guint8 *hash, gint64 older_than)
+{
+    GStatBuf buf;
+    gchar *filename_meta = NULL;
+
+    g_mutex_lock(&gc->mutex);
+
+    if (bloom_may_contain(gc->bloom, gc->bloom_bits, hash) == FALSE && g_stat(filename, &buf) == 0 && buf.st_mtime < older_than)
+        {
+            if (g_unlink(filename) == 0)
+                {
+                    filename_meta = g_strdup_printf("%s.meta", filename);
+                    g_unlink(filename_meta);
+                    free_variable(filename_meta);
+
+                    presence_remove(gc->presence, hash);
+                    gc->removed++;
+                    gc->freed = gc->freed + buf.st_size;
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to remove %s: %s\n"), filename, g_strerror(errno));
+                }
+        }
+
+    g_mutex_unlock(&gc->mutex);
+}
+
+
+/**
+ * Deletes a temporary file (left by a store that has been interrupted)
+ * if it is older than older_than.
+ * @param gc is the garbage collector.
+ * @param filename is the filename of the temporary file.
+ * @param older_than is the unix time before which the file must have
+ *        been modified to be deleted.
+ */
+static void sweep_temp_file(gc_t *gc, gchar *filename, gint64 older_than)
+{
+    GStatBuf buf;
+
+    if (g_stat(filename, &buf) == 0 && buf.st_mtime < older_than)
+        {
+            if (g_unlink(filename) == 0)
+                {
+                    gc->freed = gc->freed + buf.st_size;
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to remove %s: %s\n"), filename, g_strerror(errno));
+                }
+        }
+}
+
+
+/**
+ * Sweeps a directory of "data" (and its subdirectories) the same way
+ * add_directory_to_presence() in file_backend.c walks it.
+ * @param gc is the garbage collector.
+ * @param dirname is the directory to sweep.
+ * @param hex_prefix is the beginning of the hexadecimal hash made of
+ *        the names of the directories above dirname.
+ * @param depth is the depth of dirname (0 is prefix/data).
+ * @param older_than is the unix time before which an unreferenced block
+ *        must have been modified to be deleted.
+ * @returns FALSE if the garbage collector has to stop, TRUE otherwise.
+ */
+static gboolean sweep_directory(gc_t *gc, gchar *dirname, gchar *hex_prefix, guint depth, gint64 older_than)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    gchar *path = NULL;
+    gchar *hex_hash = NULL;
+    guint8 *hash = NULL;
+    gboolean go_on = gc_throttle(gc);
+
+    dir = g_dir_open(dirname, 0, NULL);
+
+    if (dir != NULL)
+        {
+            while (go_on == TRUE && (name = g_dir_read_name(dir)) != NULL)
+                {
+                    if (depth < gc->level && strlen(name) == 2 && g_ascii_isxdigit(name[0]) && g_ascii_isxdigit(name[1]))
+                        {
+                            path = g_build_filename(dirname, name, NULL);
+                            hex_hash = g_strconcat(hex_prefix, name, NULL);
+                            go_on = sweep_directory(gc, path, hex_hash, depth + 1, older_than);
+                            free_variable(hex_hash);
+                            free_variable(path);
+                        }
+                    else if (depth == gc->level && strlen(name) == (HASH_LEN - gc->level) * 2)
+                        {
+                            /* Nothing is read from the disk for marked blocks */
+                            hex_hash = g_strconcat(hex_prefix, name, NULL);
+                            hash = string_to_hash(hex_hash);
+
+                            if (bloom_may_contain(gc->bloom, gc->bloom_bits, hash) == FALSE)
+                                {
+                                    path = g_build_filename(dirname, name, NULL);
+                                    go_on = gc_throttle(gc);
+                                    sweep_block(gc, path, hash, older_than);
+                                    free_variable(path);
+                                }
+
+                            free_variable(hash);
+                            free_variable(hex_hash);
+                        }
+                    else if (depth == gc->level && g_str_has_suffix(name, ".tmp") == TRUE)
+                        {
+                            path = g_build_filename(dirname, name, NULL);
+                            go_on = gc_throttle(gc);
+                            sweep_temp_file(gc, path, older_than);
+                            free_variable(path);
+                        }
+                }
+
+            g_dir_close(dir);
+        }
+
+    return go_on;
+}
+
+
+/**
+ * Makes a new random epoch and saves it into prefix/GC_EPOCH_FILENAME.
+ * Caller must hold the mutex (or be the only user of gc).
+ * @param gc is the garbage collector.
+ */
+static void save_epoch(gc_t *gc)
+{
+    gchar *filename = NULL;
+    GError *error = NULL;
+
+    free_variable(gc->epoch);
+    gc->epoch = g_strdup_printf("%08x%08x%08x%08x", g_random_int(), g_random_int(), g_random_int(), g_random_int());
+
+    filename = g_build_filename(gc->prefix, GC_EPOCH_FILENAME, NULL);
+
+    if (g_file_set_contents(filename, gc->epoch, -1, &error) == FALSE)
+        {
+            print_error(__FILE__, __LINE__, _("Error while saving %s: %s\n"), filename, error->message);
+            free_error(error);
+        }
+
+    free_variable(filename);
+}
+
+
+/**
+ * Loads the epoch of the store from prefix/GC_EPOCH_FILENAME or makes a
+ * new one if there is none (a new store).
+ * @param gc is the garbage collector.
+ */
+static void load_epoch(gc_t *gc)
+{
+    gchar *filename = NULL;
+    gchar *contents = NULL;
+
+    filename = g_build_filename(gc->prefix, GC_EPOCH_FILENAME, NULL);
+
+    if (g_file_get_contents(filename, &contents, NULL, NULL) == TRUE && contents[0] != '\0')
+        {
+            gc->epoch = g_strstrip(contents);
+        }
+    else
+        {
+            free_variable(contents);
+            save_epoch(gc);
+        }
+
+    free_variable(filename);
+}
+
+
+/**
+ * Runs one collection: marks every hash referenced by the catalogs and
+ * sweeps the data directories. Nothing is deleted if a catalog could not
+ * be entirely read.
+ * @param gc is the garbage collector.
+ */
+static void collect(gc_t *gc)
+{
+    gint64 elapsed = 0;
+    gint64 older_than = 0;
+    guint64 nb_records = 0;
+    gchar *dirname = NULL;
+    gboolean ok = TRUE;
+
+    elapsed = trace_begin();
+    older_than = g_get_real_time() / G_USEC_PER_SEC - gc->min_age;
+
+    /* From now on every hash stored or asked for is marked */
+    g_mutex_lock(&gc->mutex);
+    gc->bloom = (guint8 *) g_malloc0(gc->bloom_bits / 8);
+    gc->active = TRUE;
+    gc->removed = 0;
+    gc->freed = 0;
+    g_mutex_unlock(&gc->mutex);
+
+    catalog_set_mark_func(gc->catalog, gc_mark_hash, gc);
+
+    ok = gc_wait(gc, g_get_monotonic_time() + (gint64) GC_GRACE_TIME * G_USEC_PER_SEC);
+
+    if (ok == TRUE)
+        {
+            ok = catalog_foreach_hash(gc->catalog, gc_mark_hash, gc, &nb_records);
+
+            if (ok == FALSE)
+                {
+                    print_error(__FILE__, __LINE__, _("gc: catalogs could not be read, no block is removed.\n"));
+                }
+        }
+
+    if (ok == TRUE)
+        {
+            dirname = g_build_filename(gc->prefix, "data", NULL);
+            gc->window = g_get_monotonic_time();
+            gc->ops = 0;
+            sweep_directory(gc, dirname, "", 0, older_than);
+            free_variable(dirname);
+        }
+
+    catalog_set_mark_func(gc->catalog, NULL, NULL);
+
+    g_mutex_lock(&gc->mutex);
+    gc->active = FALSE;
+    free_variable(gc->bloom);
+
+    if (gc->removed > 0)
+        {
+            /* Clients may think that the server has some of the removed blocks */
+            save_epoch(gc);
+        }
+
+    g_mutex_unlock(&gc->mutex);
+
+    trace_end(elapsed, "gc_collect");
+    print_debug(_("gc: %" G_GUINT64_FORMAT " records marked, %" G_GUINT64_FORMAT " blocks removed (%" G_GUINT64_FORMAT " bytes)\n"), nb_records, gc->removed, gc->freed);
+}
+
+
+/**
+ * Thread that runs a collection every interval seconds. Collections only
+ * begin once the presence index is ready because deleted hashs must not
+ * be inserted again into it by the thread that fills it.
+ * @param user_data is the gc_t structure.
+ * @returns NULL
+ */
+static gpointer gc_thread(gpointer user_data)
+{
+    gc_t *gc = (gc_t *) user_data;
+
+    while (gc_wait(gc, g_get_monotonic_time() + (gint64) gc->interval * G_USEC_PER_SEC) == TRUE)
+        {
+            if (presence_is_ready(gc->presence) == TRUE)
+                {
+                    collect(gc);
+                }
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Creates the garbage collector of file_backend and starts its thread
+ * unless interval is 0.
+ * @param prefix is the prefix of file_backend.
+ * @param level is the level of directories of file_backend.
+ * @param presence is the presence index of file_backend.
+ * @param catalog is the catalog of file_backend.
+ * @param interval is the number of seconds between two collections.
+ * @param rate is the maximum number of filesystem operations per second.
+ * @param min_age is the age (in seconds) under which a block is kept.
+ * @param memory is the size (in MB) of the Bloom filter.
+ * @returns a newly allocated gc_t structure that may be freed with
+ *          free_gc_t() when no longer needed.
+ */
+gc_t *new_gc_t(gchar *prefix, guint level, presence_t *presence, catalog_t *catalog, guint interval, guint rate, guint min_age, guint memory)
+{
+    gc_t *gc = NULL;
+    guint64 bits = (guint64) MAX(memory, 1) * 8 * 1048576;
+
+    gc = (gc_t *) g_malloc0(sizeof(gc_t));
+    g_assert_nonnull(gc);
+
+    gc->prefix = g_strdup(prefix);
+    gc->level = level;
+    gc->presence = presence;
+    gc->catalog = catalog;
+    gc->interval = interval;
+    gc->rate = MAX(rate, 1);
+    gc->min_age = min_age;
+    gc->stop = FALSE;
+    gc->active = FALSE;
+    gc->bloom = NULL;
+
+    /* The Bloom filter needs a power of two number of bits */
+    gc->bloom_bits = 8 * 1048576;
+
+    while (gc->bloom_bits * 2 <= bits)
+        {
+            gc->bloom_bits = gc->bloom_bits * 2;
+        }
+
+    g_mutex_init(&gc->mutex);
+    g_cond_init(&gc->cond);
+
+    load_epoch(gc);
+
+    if (interval > 0)
+        {
+            gc->thread = g_thread_new("gc", gc_thread, gc);
+        }
+
+    return gc;
+}
+
+
+/**
+ * Stops the garbage collector (a collection in progress is interrupted)
+ * and frees it.
+ * @param gc is the gc_t structure to be freed.
+ */
+void free_gc_t(gc_t *gc)
+{
+    if (gc != NULL)
+        {
+            if (gc->thread != NULL)
+                {
+                    g_mutex_lock(&gc->mutex);
+                    gc->stop = TRUE;
+                    g_cond_signal(&gc->cond);
+                    g_mutex_unlock(&gc->mutex);
+                    g_thread_join(gc->thread);
+                }
+
+            g_cond_clear(&gc->cond);
+            g_mutex_clear(&gc->mutex);
+            free_variable(gc->epoch);
+            free_variable(gc->prefix);
+            free_variable(gc);
+        }
+}
+
+
+/**
+ * Marks a hash as referenced when a collection is running (does nothing
+ * otherwise).
+ * @param hash is the binary hash (HASH_LEN bytes).
+ * @param user_data is the gc_t structure (may be NULL).
+ */
+void gc_mark_hash(guint8 *hash, gpointer user_data)
+{
+    gc_t *gc = (gc_t *) user_data;
+
+    if (gc != NULL && hash != NULL)
+        {
+            g_mutex_lock(&gc->mutex);
+
+            if (gc->active == TRUE)
+                {
+                    bloom_add(gc->bloom, gc->bloom_bits, hash);
+                }
+
+            g_mutex_unlock(&gc->mutex);
+        }
+}
+
+
+/**
+ * Resets the age of a block that a client is told the server has (its
+ * meta data may come much later) when the garbage collector is enabled
+ * and the block has not been touched for GC_TOUCH_INTERVAL seconds.
+ * @param gc is the garbage collector (may be NULL).
+ * @param filename is the filename of the block.
+ */
+void gc_touch_block(gc_t *gc, gchar *filename)
+{
+    GStatBuf buf;
+    gint64 now = 0;
+
+    if (gc != NULL && gc->interval > 0 && filename != NULL)
+        {
+            now = g_get_real_time() / G_USEC_PER_SEC;
+
+            if (g_stat(filename, &buf) == 0 && buf.st_mtime < now - GC_TOUCH_INTERVAL && g_utime(filename, NULL) != 0)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to touch %s: %s\n"), filename, g_strerror(errno));
+                }
+        }
+}
+
+
+/**
+ * @param gc is the garbage collector (may be NULL).
+ * @returns a newly allocated copy of the epoch of the store (NULL if gc
+ *          is NULL) that may be freed with free_variable().
+ */
+gchar *gc_get_epoch(gc_t *gc)
+{
+    gchar *epoch = NULL;
+
+    if (gc != NULL)
+        {
+            g_mutex_lock(&gc->mutex);
+            epoch = g_strdup(gc->epoch);
+            g_mutex_unlock(&gc->mutex);
+        }
+
+    return epoch;
+}
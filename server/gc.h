@@ -0,0 +1,192 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    gc.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file gc.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the garbage collector of file_backend. It finds the blocks that no
+ * meta data record references anymore and deletes them while the server
+ * runs: referenced hashs are marked in a Bloom filter of bounded size
+ * while catalogs are read and data directories are then swept at a
+ * limited rate.
+ */
+#ifndef _SERVER_GC_H_
+#define _SERVER_GC_H_
+
+
+/**
+ * @def GC_DEFAULT_INTERVAL
+ * Defines the default time (in seconds) between two garbage collections.
+ * 0 disables the garbage collector (which is the default).
+ */
+#define GC_DEFAULT_INTERVAL (0)
+
+
+/**
+ * @def GC_DEFAULT_RATE
+ * Defines the default maximum number of filesystem operations (directory
+ * reads, stat() and unlink() calls) that the sweep does each second.
+ */
+#define GC_DEFAULT_RATE (1000)
+
+
+/**
+ * @def GC_DEFAULT_MIN_AGE
+ * Defines the default age (in seconds) under which an unreferenced block
+ * is kept: its meta data may not have been received yet (clients replay
+ * their spool in parallel). The age of a block is reset each time a
+ * client is told that the server has it (see gc_touch_block()). Default
+ * is one day.
+ */
+#define GC_DEFAULT_MIN_AGE (86400)
+
+
+/**
+ * @def GC_TOUCH_INTERVAL
+ * Time (in seconds) under which the modification time of a block that a
+ * client is told present is not updated again: a block is thus kept at
+ * least min_age - GC_TOUCH_INTERVAL seconds after it was last answered.
+ */
+#define GC_TOUCH_INTERVAL (3600)
+
+
+/**
+ * @def GC_DEFAULT_MEMORY
+ * Defines the default size (in MB) of the Bloom filter of referenced
+ * hashs. 64 MB keep false positives (unreferenced blocks that are kept)
+ * under 0.3% up to 32 millions of distinct hashs.
+ */
+#define GC_DEFAULT_MEMORY (64)
+
+
+/**
+ * @def GC_BLOOM_PROBES
+ * Number of bits set in the Bloom filter for each hash.
+ */
+#define GC_BLOOM_PROBES (4)
+
+
+/**
+ * @def GC_GRACE_TIME
+ * Time (in seconds) waited between the moment new meta data begin to be
+ * marked and the moment catalogs are read: meta data that were already
+ * in the meta data queue are stored meanwhile. Meta data that arrive
+ * later are protected by the age of their blocks (GC_DEFAULT_MIN_AGE).
+ */
+#define GC_GRACE_TIME (60)
+
+
+/**
+ * @def GC_EPOCH_FILENAME
+ * Name of the file (in the prefix of file_backend) where the epoch of the
+ * store is saved.
+ */
+#define GC_EPOCH_FILENAME ("epoch")
+
+
+/**
+ * @struct gc_t
+ * @brief Garbage collector of file_backend.
+ *
+ * The collection runs in its own thread. While it runs, hashs of the
+ * meta data stored and hashs asked by clients are marked too: the mutex
+ * protects the Bloom filter against the sweep that deletes a block only
+ * if it is still unmarked once the mutex is held. The epoch of the store
+ * identifies it and changes whenever blocks are deleted: clients then
+ * forget the hashs that they think the server has.
+ */
+typedef struct
+{
+    gchar *prefix;            /**< prefix of file_backend (blocks are in prefix/data) */
+    guint level;              /**< level of directories of file_backend               */
+    presence_t *presence;     /**< presence index of file_backend                     */
+    catalog_t *catalog;       /**< catalogs of file_backend                           */
+    guint interval;           /**< seconds between two collections (0: disabled)      */
+    guint rate;               /**< maximum filesystem operations per second           */
+    guint min_age;            /**< unreferenced blocks younger than this are kept     */
+    guint64 bloom_bits;       /**< number of bits of the Bloom filter (power of two)  */
+    GMutex mutex;             /**< protects everything below                          */
+    GCond cond;               /**< wakes the thread up when it has to stop            */
+    gboolean stop;            /**< TRUE when the thread has to stop                   */
+    gboolean active;          /**< TRUE while hashs are being marked                  */
+    guint8 *bloom;            /**< Bloom filter of referenced hashs (NULL if inactive) */
+    guint64 removed;          /**< number of blocks removed by the last collection    */
+    guint64 freed;            /**< bytes freed by the last collection                 */
+    gchar *epoch;             /**< epoch of the store (see GC_EPOCH_FILENAME)         */
+    gint64 window;            /**< monotonic time when the current second began (thread only) */
+    guint ops;                /**< operations done in the current second (thread only)        */
+    GThread *thread;          /**< thread that runs collections                       */
+} gc_t;
+
+
+/**
+ * Creates the garbage collector of file_backend and starts its thread
+ * unless interval is 0.
+ * @param prefix is the prefix of file_backend.
+ * @param level is the level of directories of file_backend.
+ * @param presence is the presence index of file_backend.
+ * @param catalog is the catalog of file_backend.
+ * @param interval is the number of seconds between two collections.
+ * @param rate is the maximum number of filesystem operations per second.
+ * @param min_age is the age (in seconds) under which a block is kept.
+ * @param memory is the size (in MB) of the Bloom filter.
+ * @returns a newly allocated gc_t structure that may be freed with
+ *          free_gc_t() when no longer needed.
+ */
+extern gc_t *new_gc_t(gchar *prefix, guint level, presence_t *presence, catalog_t *catalog, guint interval, guint rate, guint min_age, guint memory);
+
+
+/**
+ * Stops the garbage collector (a collection in progress is interrupted)
+ * and frees it.
+ * @param gc is the gc_t structure to be freed.
+ */
+extern void free_gc_t(gc_t *gc);
+
+
+/**
+ * Marks a hash as referenced when a collection is running (does nothing
+ * otherwise).
+ * @param hash is the binary hash (HASH_LEN bytes).
+ * @param user_data is the gc_t structure (may be NULL).
+ */
+extern void gc_mark_hash(guint8 *hash, gpointer user_data);
+
+
+/**
+ * Resets the age of a block that a client is told the server has (its
+ * meta data may come much later) when the garbage collector is enabled
+ * and the block has not been touched for GC_TOUCH_INTERVAL seconds.
+ * @param gc is the garbage collector (may be NULL).
+ * @param filename is the filename of the block.
+ */
+extern void gc_touch_block(gc_t *gc, gchar *filename);
+
+
+/**
+ * @param gc is the garbage collector (may be NULL).
+ * @returns a newly allocated copy of the epoch of the store (NULL if gc
+ *          is NULL) that may be freed with free_variable().
+ */
+extern gchar *gc_get_epoch(gc_t *gc);
+
+#endif /* #ifndef _SERVER_GC_H_ */
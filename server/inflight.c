@@ -0,0 +1,276 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    inflight.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file inflight.c
+ *
+ * This file contains all the functions of the set of blocks in flight
+ * used by 'cdpfglserver' not to ask the same block to every client that
+ * saves it at the same time. Promises that are not kept are removed
+ * when they are looked up again and, at most once per timeout, by a
+ * sweep of the whole table.
+ */
+
+#include "server.h"
+
+static inflight_entry_t *get_entry(inflight_t *inflight, guint8 *hash);
+static gboolean is_promise_expired(gpointer key, gpointer value, gpointer user_data);
+static void sweep_expired_promises(inflight_t *inflight, gint64 now);
+
+
+/**
+ * Gets the entry of a hash creating it if it does not exist.
+ * @param inflight is the set of blocks in flight (its mutex must be
+ *        held).
+ * @param hash is the binary hash (HASH_LEN bytes) of the block.
+ * @returns the inflight_entry_t * of hash (owned by the table).
+ */
+static inflight_entry_t *get_entry(inflight_t *inflight, guint8 *hash)
+{
+    inflight_entry_t *entry = NULL;
+
+    entry = (inflight_entry_t *) g_hash_table_lookup(inflight->table, hash);
+
+    if (entry == NULL)
+        {
+            entry = (inflight_entry_t *) g_malloc0(sizeof(inflight_entry_t));
+            g_assert_nonnull(entry);
+
+            memcpy(entry->hash, hash, HASH_LEN);
+            entry->expires = 0;
+            entry->queued = 0;
+            g_hash_table_insert(inflight->table, entry->hash, entry);
+        }
+
+    return entry;
+}
+
+
+/**
+ * GHRFunc that tells whether an entry is an expired promise.
+ * @param key is the hash of the entry (unused).
+ * @param value is the inflight_entry_t * entry.
+ * @param user_data is a gint64 * to the current monotonic time.
+ * @returns TRUE if the entry has to be removed.
+ */
+static gboolean is_promise_expired(gpointer key, gpointer value, gpointer user_data)
+{
+    inflight_entry_t *entry = (inflight_entry_t *) value;
+    gint64 *now = (gint64 *) user_data;
+
+    return (entry->queued == 0 && entry->expires <= *now);
+}
+
+
+/**
+ * Removes promises that have not been kept (the clients may have
+ * disappeared) so that the table does not grow forever.
+ * @param inflight is the set of blocks in flight (its mutex must be
+ *        held).
+ * @param now is the current monotonic time.
+ */
+static void sweep_expired_promises(inflight_t *inflight, gint64 now)
+{
+    guint removed = 0;
+
+    if (now >= inflight->next_sweep)
+        {
+            removed = g_hash_table_foreach_remove(inflight->table, is_promise_expired, &now);
+            inflight->next_sweep = now + inflight->timeout;
+
+            if (removed > 0)
+                {
+                    print_debug(_("inflight: %u promised blocks were not sent in time\n"), removed);
+                }
+        }
+}
+
+
+/**
+ * Creates a new empty set of blocks in flight.
+ * @param timeout is the time in seconds a client has to send a block it
+ *        has been asked for.
+ * @returns a newly allocated inflight_t structure that may be freed with
+ *          free_inflight_t() when no longer needed or NULL if timeout is
+ *          0 (no set at all).
+ */
+inflight_t *new_inflight_t(guint timeout)
+{
+    inflight_t *inflight = NULL;
+
+    if (timeout > 0)
+        {
+            inflight = (inflight_t *) g_malloc0(sizeof(inflight_t));
+            g_assert_nonnull(inflight);
+
+            g_mutex_init(&inflight->mutex);
+            inflight->table = g_hash_table_new_full(hash_key_hash, hash_key_equal, NULL, free_variable);
+            inflight->timeout = (gint64) timeout * G_USEC_PER_SEC;
+            inflight->next_sweep = g_get_monotonic_time() + inflight->timeout;
+        }
+
+    return inflight;
+}
+
+
+/**
+ * Frees a set of blocks in flight.
+ * @param inflight is the inflight_t structure to be freed.
+ */
+void free_inflight_t(inflight_t *inflight)
+{
+    if (inflight != NULL)
+        {
+            g_hash_table_destroy(inflight->table);
+            g_mutex_clear(&inflight->mutex);
+            free_variable(inflight);
+        }
+}
+
+
+/**
+ * Removes from a list of needed hashs the ones that are promised by
+ * another client or queued and records the others as promised by the
+ * client that is going to be answered. Queued blocks have been received
+ * and are dropped from the list. Blocks only promised by another client
+ * are moved to pending: that client may never send them so the client
+ * that is answered must not consider them as stored and has to ask for
+ * them again. Clients that do not ask again (pending is NULL) are asked
+ * for them as well.
+ * @param inflight is the set of blocks in flight (may be NULL).
+ * @param needed is a GList of hash_data_t * structures of needed hashs
+ *        as answered by the backend.
+ * @param[out] pending is where hashs promised by another client are
+ *             prepended (hash_data_t * elements). It may be NULL.
+ * @returns the list of hashs the client has to send. Dropped elements
+ *          are freed.
+ */
+GList *inflight_reserve_needed(inflight_t *inflight, GList *needed, GList **pending)
+{
+    GList *iter = needed;
+    GList *next = NULL;
+    hash_data_t *hash_data = NULL;
+    inflight_entry_t *entry = NULL;
+    gint64 now = 0;
+    guint skipped = 0;
+    guint promised = 0;
+
+    if (inflight != NULL)
+        {
+            now = g_get_monotonic_time();
+
+            g_mutex_lock(&inflight->mutex);
+
+            sweep_expired_promises(inflight, now);
+
+            while (iter != NULL)
+                {
+                    next = g_list_next(iter);
+                    hash_data = (hash_data_t *) iter->data;
+
+                    if (hash_data != NULL && hash_data->hash != NULL)
+                        {
+                            entry = get_entry(inflight, hash_data->hash);
+
+                            if (entry->queued > 0)
+                                {
+                                    /* It is already received */
+                                    needed = g_list_delete_link(needed, iter);
+                                    free_hdt_struct(hash_data);
+                                    skipped++;
+                                }
+                            else if (entry->expires > now && pending != NULL)
+                                {
+                                    /* Another client is to send it */
+                                    needed = g_list_remove_link(needed, iter);
+                                    *pending = g_list_concat(iter, *pending);
+                                    promised++;
+                                }
+                            else if (entry->expires <= now)
+                                {
+                                    entry->expires = now + inflight->timeout;
+                                }
+                        }
+
+                    iter = next;
+                }
+
+            g_mutex_unlock(&inflight->mutex);
+
+            if (skipped > 0 || promised > 0)
+                {
+                    print_debug(_("inflight: %u needed blocks are already received and %u are promised by another client\n"), skipped, promised);
+                }
+        }
+
+    return needed;
+}
+
+
+/**
+ * Records that a block has been received and waits to be stored.
+ * @param inflight is the set of blocks in flight (may be NULL).
+ * @param hash is the binary hash (HASH_LEN bytes) of the block.
+ */
+void inflight_queued(inflight_t *inflight, guint8 *hash)
+{
+    inflight_entry_t *entry = NULL;
+
+    if (inflight != NULL && hash != NULL)
+        {
+            g_mutex_lock(&inflight->mutex);
+            entry = get_entry(inflight, hash);
+            entry->queued++;
+            g_mutex_unlock(&inflight->mutex);
+        }
+}
+
+
+/**
+ * Records that a queued block has been handled by the backend: the
+ * backend now answers for it.
+ * @param inflight is the set of blocks in flight (may be NULL).
+ * @param hash is the binary hash (HASH_LEN bytes) of the block.
+ */
+void inflight_stored(inflight_t *inflight, guint8 *hash)
+{
+    inflight_entry_t *entry = NULL;
+
+    if (inflight != NULL && hash != NULL)
+        {
+            g_mutex_lock(&inflight->mutex);
+
+            entry = (inflight_entry_t *) g_hash_table_lookup(inflight->table, hash);
+
+            if (entry != NULL && entry->queued > 0)
+                {
+                    entry->queued--;
+
+                    if (entry->queued == 0)
+                        {
+                            /* the table frees the entry */
+                            g_hash_table_remove(inflight->table, hash);
+                        }
+                }
+
+            g_mutex_unlock(&inflight->mutex);
+        }
+}
@@ -0,0 +1,128 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    inflight.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file inflight.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the set of blocks in flight. When many clients save the same data
+ * at the same time every one of them is told that a block is needed
+ * until it is stored. A block that a client has been asked for (it is
+ * promised) or that waits in the data workers' queues (it is queued) is
+ * not asked again to other clients. A promise that is not kept within
+ * a timeout is forgotten and the block is asked again.
+ */
+#ifndef _SERVER_INFLIGHT_H_
+#define _SERVER_INFLIGHT_H_
+
+
+/**
+ * @def INFLIGHT_TIMEOUT
+ * Defines the default time (in seconds) a client has to send a block it
+ * has been asked for. 0 disables the set of blocks in flight.
+ */
+#define INFLIGHT_TIMEOUT (300)
+
+
+/**
+ * @struct inflight_entry_t
+ * @brief A block promised by a client or queued to be stored.
+ */
+typedef struct
+{
+    guint8 hash[HASH_LEN];  /**< hash of the block (key of the table)                 */
+    gint64 expires;         /**< monotonic time (µs) when the promise is forgotten     */
+    guint queued;           /**< number of copies of the block in the data queues      */
+} inflight_entry_t;
+
+
+/**
+ * @struct inflight_t
+ * @brief Set of the blocks in flight.
+ *
+ * This structure is shared by libmicrohttpd's threads (that answer which
+ * blocks are needed and queue received blocks) and the data workers
+ * (that store them). Every access is protected by mutex.
+ */
+typedef struct
+{
+    GMutex mutex;        /**< Protects everything in this structure                  */
+    GHashTable *table;   /**< hash (guint8 *) -> inflight_entry_t *                  */
+    gint64 timeout;      /**< time (µs) a client has to send a promised block         */
+    gint64 next_sweep;   /**< monotonic time (µs) of the next removal of old promises */
+} inflight_t;
+
+
+/**
+ * Creates a new empty set of blocks in flight.
+ * @param timeout is the time in seconds a client has to send a block it
+ *        has been asked for.
+ * @returns a newly allocated inflight_t structure that may be freed with
+ *          free_inflight_t() when no longer needed or NULL if timeout is
+ *          0 (no set at all).
+ */
+extern inflight_t *new_inflight_t(guint timeout);
+
+
+/**
+ * Frees a set of blocks in flight.
+ * @param inflight is the inflight_t structure to be freed.
+ */
+extern void free_inflight_t(inflight_t *inflight);
+
+
+/**
+ * Removes from a list of needed hashs the ones that are promised by
+ * another client or queued and records the others as promised by the
+ * client that is going to be answered. Queued blocks have been received
+ * and are dropped from the list. Blocks only promised by another client
+ * are moved to pending: that client may never send them so the client
+ * that is answered must not consider them as stored and has to ask for
+ * them again. Clients that do not ask again (pending is NULL) are asked
+ * for them as well.
+ * @param inflight is the set of blocks in flight (may be NULL).
+ * @param needed is a GList of hash_data_t * structures of needed hashs
+ *        as answered by the backend.
+ * @param[out] pending is where hashs promised by another client are
+ *             prepended (hash_data_t * elements). It may be NULL.
+ * @returns the list of hashs the client has to send. Dropped elements
+ *          are freed.
+ */
+extern GList *inflight_reserve_needed(inflight_t *inflight, GList *needed, GList **pending);
+
+
+/**
+ * Records that a block has been received and waits to be stored.
+ * @param inflight is the set of blocks in flight (may be NULL).
+ * @param hash is the binary hash (HASH_LEN bytes) of the block.
+ */
+extern void inflight_queued(inflight_t *inflight, guint8 *hash);
+
+
+/**
+ * Records that a queued block has been handled by the backend: the
+ * backend now answers for it.
+ * @param inflight is the set of blocks in flight (may be NULL).
+ * @param hash is the binary hash (HASH_LEN bytes) of the block.
+ */
+extern void inflight_stored(inflight_t *inflight, guint8 *hash);
+
+#endif /* #ifndef _SERVER_INFLIGHT_H_ */
@@ -40,6 +40,9 @@ void free_options_t(options_t *opt)
 
     if (opt != NULL)
         {
+            free_variable(opt->backend);
+            free_variable(opt->mode);
+            free_variable(opt->meta_sync);
             free_variable(opt);
         }
 
@@ -63,6 +66,15 @@ static void print_selected_options(options_t *opt)
                 {
                     fprintf(stdout, _("Port number: %d\n"), opt->port);
                 }
+
+            print_string_option(_("Backend: %s\n"), opt->backend);
+            fprintf(stdout, _("Data workers: %d\n"), opt->data_workers);
+            fprintf(stdout, _("Queue size: %d MB\n"), opt->queue_size);
+            print_string_option(_("Server mode: %s\n"), opt->mode);
+            fprintf(stdout, _("Pool threads: %d\n"), opt->pool_threads);
+            fprintf(stdout, _("Block cache: %d MB\n"), opt->block_cache);
+            fprintf(stdout, _("In flight timeout: %d s\n"), opt->inflight_timeout);
+            print_string_option(_("Meta data sync: %s\n"), opt->meta_sync);
         }
 }
 
@@ -95,6 +107,35 @@ gchar *buffer_selected_option(options_t *opt)
                     free_variable(buffer);
                     buffer = buf1;
                 }
+
+            if (opt->backend != NULL)
+                {
+                    buf1 = g_strdup_printf(_("%sBackend: %s\n"), buffer, opt->backend);
+                    free_variable(buffer);
+                    buffer = buf1;
+                }
+
+            buf1 = g_strdup_printf(_("%sData workers: %d\nQueue size: %d MB\n"), buffer, opt->data_workers, opt->queue_size);
+            free_variable(buffer);
+            buffer = buf1;
+
+            if (opt->mode != NULL)
+                {
+                    buf1 = g_strdup_printf(_("%sServer mode: %s\nPool threads: %d\n"), buffer, opt->mode, opt->pool_threads);
+                    free_variable(buffer);
+                    buffer = buf1;
+                }
+
+            buf1 = g_strdup_printf(_("%sBlock cache: %d MB\nIn flight timeout: %d s\n"), buffer, opt->block_cache, opt->inflight_timeout);
+            free_variable(buffer);
+            buffer = buf1;
+
+            if (opt->meta_sync != NULL)
+                {
+                    buf1 = g_strdup_printf(_("%sMeta data sync: %s\n"), buffer, opt->meta_sync);
+                    free_variable(buffer);
+                    buffer = buf1;
+                }
         }
 
     return buffer;
@@ -112,6 +153,9 @@ static void read_from_configuration_file(options_t *opt, gchar *filename)
     GKeyFile *keyfile = NULL;      /** Configuration file parser */
     GError *error = NULL;          /** Glib error handling       */
     srv_conf_t *srv_conf = NULL;
+    gchar *backend = NULL;
+    gchar *mode = NULL;
+    gchar *meta_sync = NULL;
 
     if (filename != NULL)
         {
@@ -130,6 +174,26 @@ static void read_from_configuration_file(options_t *opt, gchar *filename)
                 {
                     srv_conf = read_from_group_server(keyfile, filename);
                     opt->port = srv_conf ->port;
+                    free_srv_conf_t(srv_conf);
+
+                    backend = read_string_from_file(keyfile, filename, GN_SERVER, KN_BACKEND, _("Could not load backend name from file"));
+                    opt->backend = set_option_str(backend, opt->backend);
+                    free_variable(backend);
+
+                    opt->data_workers = read_int_from_file(keyfile, filename, GN_SERVER, KN_DATA_WORKERS, _("Could not load number of data workers from file"), opt->data_workers);
+                    opt->queue_size = read_int_from_file(keyfile, filename, GN_SERVER, KN_QUEUE_SIZE, _("Could not load queue size from file"), opt->queue_size);
+
+                    mode = read_string_from_file(keyfile, filename, GN_SERVER, KN_SERVER_MODE, _("Could not load server mode from file"));
+                    opt->mode = set_option_str(mode, opt->mode);
+                    free_variable(mode);
+                    opt->pool_threads = read_int_from_file(keyfile, filename, GN_SERVER, KN_POOL_THREADS, _("Could not load number of pool threads from file"), opt->pool_threads);
+                    opt->block_cache = read_int_from_file(keyfile, filename, GN_SERVER, KN_BLOCK_CACHE, _("Could not load block cache size from file"), opt->block_cache);
+                    opt->inflight_timeout = read_int_from_file(keyfile, filename, GN_SERVER, KN_INFLIGHT_TIMEOUT, _("Could not load in flight timeout from file"), opt->inflight_timeout);
+
+                    meta_sync = read_string_from_file(keyfile, filename, GN_SERVER, KN_META_SYNC, _("Could not load meta data sync policy from file"));
+                    opt->meta_sync = set_option_str(meta_sync, opt->meta_sync);
+                    free_variable(meta_sync);
+
                     read_debug_mode_from_file(keyfile, filename);
                 }
             else if (error != NULL)
@@ -162,7 +226,16 @@ options_t *manage_command_line_options(int argc, char **argv)
     gboolean version = FALSE;       /** True if -v was selected on the command line                                        */
     gint cmdl_debug = -4;           /** debug mode as specified on the command line                                        */
     gchar *configfile = NULL;       /** Filename for the configuration file if any                                         */
+    gchar *trace = NULL;            /** Filename where to write the trace if any                                           */
     gint port = 0;                  /** Port number on which to listen                                                     */
+    gchar *backend = NULL;          /** Name of the backend to be used                                                     */
+    gint data_workers = 0;          /** Number of threads that store data                                                  */
+    gint queue_size = 0;            /** Maximum size (in MB) of the data waiting to be stored                              */
+    gchar *mode = NULL;             /** How connections are served ("threads" or "pool")                                   */
+    gint pool_threads = 0;          /** Number of threads of the pool in "pool" mode                                       */
+    gint block_cache = -1;          /** Size (in MB) of the cache of blocks read from the backend                          */
+    gint inflight_timeout = -1;     /** Seconds a client has to send a block it has been asked for                         */
+    gchar *meta_sync = NULL;        /** fsync() policy of meta data catalogs ("none", "flush" or "always")                */
 
     GOptionEntry entries[] =
     {
@@ -170,6 +243,15 @@ options_t *manage_command_line_options(int argc, char **argv)
         { "debug", 'd', 0,  G_OPTION_ARG_INT, &cmdl_debug, N_("Activates (1) or deactivates (0) debug mode."), N_("BOOLEAN")},
         { "configuration", 'c', 0, G_OPTION_ARG_STRING, &configfile, N_("Specify an alternative configuration file."), N_("FILENAME")},
         { "port", 'p', 0, G_OPTION_ARG_INT, &port, N_("Port NUMBER on which to listen."), N_("NUMBER")},
+        { "backend", 'b', 0, G_OPTION_ARG_STRING, &backend, N_("Backend NAME to use to store data: file, pack or tier."), N_("NAME")},
+        { "data-workers", 'w', 0, G_OPTION_ARG_INT, &data_workers, N_("NUMBER of threads used to store data (default is 4)."), N_("NUMBER")},
+        { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode, N_("MODE used to serve connections: threads (one per connection) or pool."), N_("MODE")},
+        { "pool-threads", 't', 0, G_OPTION_ARG_INT, &pool_threads, N_("NUMBER of threads of the pool in pool mode (default is one per processor)."), N_("NUMBER")},
+        { "queue-size", 'q', 0, G_OPTION_ARG_INT, &queue_size, N_("SIZE in MB of the data waiting to be stored before clients are slowed down (default is 256)."), N_("SIZE")},
+        { "block-cache", 'k', 0, G_OPTION_ARG_INT, &block_cache, N_("SIZE in MB of the cache of blocks read for restores, 0 disables it (default is 256)."), N_("SIZE")},
+        { "inflight-timeout", 'i', 0, G_OPTION_ARG_INT, &inflight_timeout, N_("SECONDS a client has to send a block before it is asked to another client, 0 asks every client (default is 300)."), N_("SECONDS")},
+        { "meta-sync", 's', 0, G_OPTION_ARG_STRING, &meta_sync, N_("POLICY used to fsync() meta data: none, flush (each time buffered meta data are written, the default) or always (each file)."), N_("POLICY")},
+        { "trace", 'T', 0, G_OPTION_ARG_FILENAME, &trace, N_("Records the duration of the main steps and writes them as a Chrome trace (JSON) into FILENAME when the program ends."), N_("FILENAME")},
         { NULL }
     };
 
@@ -200,6 +282,14 @@ options_t *manage_command_line_options(int argc, char **argv)
 
     opt->configfile = NULL;
     opt->port = SERVER_PORT;
+    opt->backend = g_strdup(SERVER_DEFAULT_BACKEND);
+    opt->data_workers = SERVER_DATA_WORKERS;
+    opt->queue_size = SERVER_QUEUE_SIZE;
+    opt->mode = g_strdup(SERVER_DEFAULT_MODE);
+    opt->pool_threads = -1;
+    opt->block_cache = BLOCK_CACHE_SIZE;
+    opt->inflight_timeout = INFLIGHT_TIMEOUT;
+    opt->meta_sync = g_strdup(SERVER_DEFAULT_META_SYNC);
 
 
     /* 1) Reading options from default configuration file */
@@ -222,13 +312,83 @@ options_t *manage_command_line_options(int argc, char **argv)
      */
 
     set_debug_mode_upon_cmdl(cmdl_debug);
+    init_tracing(trace);
+    free_variable(trace);
 
     if (port > 1024 && port < 65535)
         {
             opt->port = port;
         }
 
+    opt->backend = set_option_str(backend, opt->backend);
+
+    if (data_workers > 0)
+        {
+            opt->data_workers = data_workers;
+        }
+    else if (opt->data_workers <= 0)
+        {
+            opt->data_workers = SERVER_DATA_WORKERS;
+        }
+
+    if (queue_size > 0)
+        {
+            opt->queue_size = queue_size;
+        }
+    else if (opt->queue_size <= 0)
+        {
+            opt->queue_size = SERVER_QUEUE_SIZE;
+        }
+
+    opt->mode = set_option_str(mode, opt->mode);
+
+    if (g_strcmp0(opt->mode, "threads") != 0 && g_strcmp0(opt->mode, "pool") != 0)
+        {
+            print_error(__FILE__, __LINE__, _("Unknown server mode %s, using %s\n"), opt->mode, SERVER_DEFAULT_MODE);
+            free_variable(opt->mode);
+            opt->mode = g_strdup(SERVER_DEFAULT_MODE);
+        }
+
+    if (pool_threads > 0)
+        {
+            opt->pool_threads = pool_threads;
+        }
+    else if (opt->pool_threads <= 0)
+        {
+            opt->pool_threads = g_get_num_processors();
+        }
+
+    if (block_cache >= 0)
+        {
+            opt->block_cache = block_cache;
+        }
+    else if (opt->block_cache < 0)
+        {
+            opt->block_cache = BLOCK_CACHE_SIZE;
+        }
+
+    if (inflight_timeout >= 0)
+        {
+            opt->inflight_timeout = inflight_timeout;
+        }
+    else if (opt->inflight_timeout < 0)
+        {
+            opt->inflight_timeout = INFLIGHT_TIMEOUT;
+        }
+
+    opt->meta_sync = set_option_str(meta_sync, opt->meta_sync);
+
+    if (g_strcmp0(opt->meta_sync, "none") != 0 && g_strcmp0(opt->meta_sync, "flush") != 0 && g_strcmp0(opt->meta_sync, "always") != 0)
+        {
+            print_error(__FILE__, __LINE__, _("Unknown meta data sync policy %s, using %s\n"), opt->meta_sync, SERVER_DEFAULT_META_SYNC);
+            free_variable(opt->meta_sync);
+            opt->meta_sync = g_strdup(SERVER_DEFAULT_META_SYNC);
+        }
+
     g_option_context_free(context);
+    free_variable(mode);
+    free_variable(meta_sync);
+    free_variable(backend);
     free_variable(bugreport);
     free_variable(summary);
 
@@ -42,6 +42,14 @@ typedef struct
     gboolean version;   /**< TRUE if we have to display program's version                             */
     gchar *configfile;  /**< filename for the configuration file specified on the command line        */
     gint port;          /**< port number on which the cdpfglserver program will listen for connexions */
+    gchar *backend;     /**< name of the backend to be used to store data ("file" or "pack")         */
+    gint data_workers;  /**< number of threads that store data                                        */
+    gint queue_size;    /**< maximum size (in MB) of the data waiting to be stored                    */
+    gchar *mode;        /**< how connections are served: "threads" or "pool"                          */
+    gint pool_threads;  /**< number of threads of the pool in "pool" mode                             */
+    gint block_cache;   /**< size (in MB) of the cache of blocks read from the backend (0 disables it) */
+    gint inflight_timeout; /**< seconds a client has to send a block it was asked for (0 disables it) */
+    gchar *meta_sync;   /**< fsync() policy of meta data catalogs: "none", "flush" or "always"        */
 } options_t;
 
 
@@ -0,0 +1,953 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    pack_backend.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/pack_backend.c
+ *
+ * This file contains all the functions for the pack backend that appends
+ * every data block into big pack files (prefix/pack/XXXXXXXX.pack) and
+ * keeps an index (prefix/pack/index) of where each block is. Meta data
+ * are stored in flat files exactly as file_backend does.
+ *
+ * Record in a pack file (all numbers are little endian):
+ *   magic (4) | hash (32) | cmptype (2) | padding (2) | uncmplen (8) | length (8) | data (length)
+ *
+ * Record in the index file:
+ *   hash (32) | pack (4) | cmptype (2) | padding (2) | offset (8) | length (8) | uncmplen (8)
+ *
+ * @note to translators: pack_backend is the name of the backend please
+ * do not translate this. Thanks.
+ */
+
+#include "server.h"
+
+static pack_entry_t *new_pack_entry_t(guint32 pack, guint64 offset, guint64 length, gshort cmptype, gssize uncmplen);
+static gchar *get_pack_filename_in(gchar *directory, guint32 pack);
+static gchar *get_pack_filename(pack_backend_t *pack_backend, guint32 pack);
+static void insert_entry_in_index(pack_backend_t *pack_backend, guint8 *hash, pack_entry_t *entry);
+static void write_index_record(pack_backend_t *pack_backend, guint8 *hash, pack_entry_t *entry);
+static gboolean load_index(pack_backend_t *pack_backend, guint32 *last_pack, guint64 *last_end);
+static guint64 scan_pack_file(pack_backend_t *pack_backend, guint32 pack, guint64 from);
+static guint32 find_last_pack_number_in(gchar *dirname, GHashTable *found, guint32 last);
+static guint32 find_last_pack_number(pack_backend_t *pack_backend);
+static void open_pack_to_append(pack_backend_t *pack_backend);
+static void read_from_group_pack_backend(pack_backend_t *pack_backend, gchar *filename, const gchar *group);
+
+
+/**
+ * Creates a new pack_entry_t structure
+ * @param pack is the pack number where the block is stored.
+ * @param offset is the offset of the data in the pack file.
+ * @param length is the length of the stored data.
+ * @param cmptype is the compression type of the stored data.
+ * @param uncmplen is the length of the uncompressed data.
+ * @returns a newly allocated pack_entry_t structure that may be freed
+ *          with free_variable() when no longer needed.
+ */
+static pack_entry_t *new_pack_entry_t(guint32 pack, guint64 offset, guint64 length, gshort cmptype, gssize uncmplen)
+{
+    pack_entry_t *entry = NULL;
+
+    entry = (pack_entry_t *) g_malloc(sizeof(pack_entry_t));
+    g_assert_nonnull(entry);
+
+    entry->pack = pack;
+    entry->offset = offset;
+    entry->length = length;
+    entry->cmptype = cmptype;
+    entry->uncmplen = uncmplen;
+
+    return entry;
+}
+
+
+/**
+ * Builds the filename of a pack file in a directory
+ * @param directory is the directory where pack files are.
+ * @param pack is the number of the pack file.
+ * @returns a newly allocated gchar * filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+static gchar *get_pack_filename_in(gchar *directory, guint32 pack)
+{
+    gchar *basename = NULL;
+    gchar *filename = NULL;
+
+    basename = g_strdup_printf("%08x.pack", pack);
+    filename = g_build_filename(directory, basename, NULL);
+    free_variable(basename);
+
+    return filename;
+}
+
+
+/**
+ * Builds the filename of a pack file: pack files that have been
+ * migrated are in the cold tier directory. Caller must hold
+ * pack_backend->mutex if the migrator may be running.
+ * @param pack_backend is the pack backend structure.
+ * @param pack is the number of the pack file.
+ * @returns a newly allocated gchar * filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+static gchar *get_pack_filename(pack_backend_t *pack_backend, guint32 pack)
+{
+    gchar *dirname = NULL;
+    gchar *filename = NULL;
+
+    if (pack_backend->cold != NULL && g_hash_table_contains(pack_backend->migrated, GUINT_TO_POINTER(pack + 1)) == TRUE)
+        {
+            filename = get_pack_filename_in(pack_backend->cold, pack);
+        }
+    else
+        {
+            dirname = g_build_filename(pack_backend->prefix, "pack", NULL);
+            filename = get_pack_filename_in(dirname, pack);
+            free_variable(dirname);
+        }
+
+    return filename;
+}
+
+
+/**
+ * Builds the filename of a pack file in the hot tier (the local pack
+ * directory) wherever the pack file is.
+ * @param pack_backend is the pack backend structure.
+ * @param pack is the number of the pack file.
+ * @returns a newly allocated gchar * filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+gchar *pack_get_hot_filename(pack_backend_t *pack_backend, guint32 pack)
+{
+    gchar *dirname = NULL;
+    gchar *filename = NULL;
+
+    dirname = g_build_filename(pack_backend->prefix, "pack", NULL);
+    filename = get_pack_filename_in(dirname, pack);
+    free_variable(dirname);
+
+    return filename;
+}
+
+
+/**
+ * Inserts an entry into the in memory index. The hash is copied.
+ * Caller must hold pack_backend->mutex if other threads may access
+ * the index.
+ * @param pack_backend is the pack backend structure.
+ * @param hash is the binary hash of the block.
+ * @param entry is the location of the block (owned by the index after
+ *        this call).
+ */
+static void insert_entry_in_index(pack_backend_t *pack_backend, guint8 *hash, pack_entry_t *entry)
+{
+    guint8 *key = NULL;
+
+    key = (guint8 *) g_memdup(hash, HASH_LEN);
+    g_hash_table_replace(pack_backend->index, key, entry);
+}
+
+
+/**
+ * Appends one record to the index file.
+ * @param pack_backend is the pack backend structure.
+ * @param hash is the binary hash of the block.
+ * @param entry is the location of the block.
+ */
+static void write_index_record(pack_backend_t *pack_backend, guint8 *hash, pack_entry_t *entry)
+{
+    guint8 record[PACK_INDEX_RECORD_SIZE];
+    GError *error = NULL;
+
+    if (pack_backend->istream != NULL)
+        {
+            memset(record, 0, PACK_INDEX_RECORD_SIZE);
+            memcpy(record, hash, HASH_LEN);
+            put_guint32_into_buffer(record + HASH_LEN, entry->pack);
+            put_guint16_into_buffer(record + HASH_LEN + 4, (guint16) entry->cmptype);
+            put_guint64_into_buffer(record + HASH_LEN + 8, entry->offset);
+            put_guint64_into_buffer(record + HASH_LEN + 16, entry->length);
+            put_guint64_into_buffer(record + HASH_LEN + 24, (guint64) entry->uncmplen);
+
+            if (g_output_stream_write_all((GOutputStream *) pack_backend->istream, record, PACK_INDEX_RECORD_SIZE, NULL, NULL, &error) == FALSE)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to write to pack index: %s\n"), error->message);
+                    free_error(error);
+                }
+        }
+}
+
+
+/**
+ * Loads the index file into memory.
+ * @param pack_backend is the pack backend structure.
+ * @param[out] last_pack will contain the highest pack number referenced
+ *             by the index.
+ * @param[out] last_end will contain the end of the last record written
+ *             in that pack file.
+ * @returns TRUE if the index file exists and has been read, FALSE
+ *          otherwise.
+ */
+static gboolean load_index(pack_backend_t *pack_backend, guint32 *last_pack, guint64 *last_end)
+{
+    gchar *filename = NULL;
+    GFile *index_file = NULL;
+    GFileInputStream *stream = NULL;
+    GError *error = NULL;
+    guint8 *buffer = NULL;
+    gsize size_read = 0;
+    gsize i = 0;
+    guint32 pack = 0;
+    guint64 end = 0;
+    guint64 nb_records = 0;
+    pack_entry_t *entry = NULL;
+    gboolean loaded = FALSE;
+
+    filename = g_build_filename(pack_backend->prefix, "pack", PACK_INDEX_FILENAME, NULL);
+    index_file = g_file_new_for_path(filename);
+    stream = g_file_read(index_file, NULL, &error);
+
+    if (stream != NULL)
+        {
+            /* Reading 1024 records at a time */
+            buffer = (guint8 *) g_malloc(PACK_INDEX_RECORD_SIZE * 1024);
+
+            do
+                {
+                    g_input_stream_read_all((GInputStream *) stream, buffer, PACK_INDEX_RECORD_SIZE * 1024, &size_read, NULL, &error);
+
+                    for (i = 0; i + PACK_INDEX_RECORD_SIZE <= size_read; i = i + PACK_INDEX_RECORD_SIZE)
+                        {
+                            entry = new_pack_entry_t(get_guint32_from_buffer(buffer + i + HASH_LEN),
+                                                     get_guint64_from_buffer(buffer + i + HASH_LEN + 8),
+                                                     get_guint64_from_buffer(buffer + i + HASH_LEN + 16),
+                                                     (gshort) get_guint16_from_buffer(buffer + i + HASH_LEN + 4),
+                                                     (gssize) get_guint64_from_buffer(buffer + i + HASH_LEN + 24));
+
+                            if (entry->pack > pack)
+                                {
+                                    pack = entry->pack;
+                                    end = 0;
+                                }
+
+                            if (entry->pack == pack && entry->offset + entry->length > end)
+                                {
+                                    end = entry->offset + entry->length;
+                                }
+
+                            insert_entry_in_index(pack_backend, buffer + i, entry);
+                            nb_records++;
+                        }
+                }
+            while (size_read == PACK_INDEX_RECORD_SIZE * 1024 && error == NULL);
+
+            if (error != NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error while reading pack index %s: %s\n"), filename, error->message);
+                    free_error(error);
+                }
+
+            print_debug(_("pack_backend: %" G_GUINT64_FORMAT " records loaded from index\n"), nb_records);
+
+            g_input_stream_close((GInputStream *) stream, NULL, NULL);
+            free_object(stream);
+            free_variable(buffer);
+            loaded = TRUE;
+        }
+    else
+        {
+            free_error(error);
+        }
+
+    *last_pack = pack;
+    *last_end = end;
+
+    free_object(index_file);
+    free_variable(filename);
+
+    return loaded;
+}
+
+
+/**
+ * Scans a pack file from a position and adds every record found into
+ * the index (in memory and on disk). Used to rebuild the index when it
+ * is missing or when the server stopped between the write of a block
+ * and the write of its index record.
+ * @param pack_backend is the pack backend structure.
+ * @param pack is the pack number to scan.
+ * @param from is the position where to start the scan (must be the
+ *        beginning of a record).
+ * @returns the position of the end of the last valid record found.
+ */
+static guint64 scan_pack_file(pack_backend_t *pack_backend, guint32 pack, guint64 from)
+{
+    gchar *filename = NULL;
+    GFile *pack_file = NULL;
+    GFileInputStream *stream = NULL;
+    GError *error = NULL;
+    guint8 header[PACK_RECORD_HEADER_SIZE];
+    gsize size_read = 0;
+    guint64 pos = from;
+    guint64 length = 0;
+    guint64 size = 0;
+    gboolean end = FALSE;
+    pack_entry_t *entry = NULL;
+
+    filename = get_pack_filename(pack_backend, pack);
+    pack_file = g_file_new_for_path(filename);
+    stream = g_file_read(pack_file, NULL, &error);
+
+    if (stream != NULL)
+        {
+            size = get_file_size(pack_file);
+        }
+
+    if (stream != NULL && g_seekable_seek((GSeekable *) stream, from, G_SEEK_SET, NULL, &error) == TRUE)
+        {
+            while (end == FALSE)
+                {
+                    if (g_input_stream_read_all((GInputStream *) stream, header, PACK_RECORD_HEADER_SIZE, &size_read, NULL, &error) == TRUE && size_read == PACK_RECORD_HEADER_SIZE && get_guint32_from_buffer(header) == PACK_MAGIC)
+                        {
+                            length = get_guint64_from_buffer(header + 4 + HASH_LEN + 12);
+
+                            if (g_seekable_seek((GSeekable *) stream, length, G_SEEK_CUR, NULL, &error) == TRUE && pos + PACK_RECORD_HEADER_SIZE + length <= size)
+                                {
+                                    entry = new_pack_entry_t(pack, pos + PACK_RECORD_HEADER_SIZE, length, (gshort) get_guint16_from_buffer(header + 4 + HASH_LEN), (gssize) get_guint64_from_buffer(header + 4 + HASH_LEN + 4));
+                                    write_index_record(pack_backend, header + 4, entry);
+                                    insert_entry_in_index(pack_backend, header + 4, entry);
+                                    pos = pos + PACK_RECORD_HEADER_SIZE + length;
+                                }
+                            else
+                                {
+                                    end = TRUE;
+                                }
+                        }
+                    else
+                        {
+                            end = TRUE;
+                        }
+                }
+
+            g_input_stream_close((GInputStream *) stream, NULL, NULL);
+        }
+
+    free_error(error);
+    free_object(stream);
+    free_object(pack_file);
+    free_variable(filename);
+
+    return pos;
+}
+
+
+/**
+ * Finds the highest pack number in a directory.
+ * @param dirname is the directory where to look for pack files.
+ * @param found if not NULL receives the number (+1) of each pack file
+ *        found.
+ * @param last is the highest pack number already known.
+ * @returns the highest pack number between last and the ones found.
+ */
+static guint32 find_last_pack_number_in(gchar *dirname, GHashTable *found, guint32 last)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+    guint32 pack = 0;
+
+    dir = g_dir_open(dirname, 0, NULL);
+
+    if (dir != NULL)
+        {
+            while ((name = g_dir_read_name(dir)) != NULL)
+                {
+                    if (g_str_has_suffix(name, ".pack") && sscanf(name, "%08x.pack", &pack) == 1)
+                        {
+                            if (found != NULL)
+                                {
+                                    g_hash_table_add(found, GUINT_TO_POINTER(pack + 1));
+                                }
+
+                            if (pack > last)
+                                {
+                                    last = pack;
+                                }
+                        }
+                }
+
+            g_dir_close(dir);
+        }
+
+    return last;
+}
+
+
+/**
+ * Finds the highest pack number in the pack directory and in the cold
+ * tier directory (if any). Pack files found in the cold tier are
+ * recorded as migrated.
+ * @param pack_backend is the pack backend structure.
+ * @returns the highest pack number found or 0.
+ */
+static guint32 find_last_pack_number(pack_backend_t *pack_backend)
+{
+    gchar *dirname = NULL;
+    guint32 last = 0;
+
+    dirname = g_build_filename(pack_backend->prefix, "pack", NULL);
+    last = find_last_pack_number_in(dirname, NULL, 0);
+    free_variable(dirname);
+
+    if (pack_backend->cold != NULL)
+        {
+            last = find_last_pack_number_in(pack_backend->cold, pack_backend->migrated, last);
+        }
+
+    return last;
+}
+
+
+/**
+ * Opens pack_backend->pack pack file in order to append blocks to it
+ * and sets pack_backend->pack_pos to its actual size.
+ * @param pack_backend is the pack backend structure.
+ */
+static void open_pack_to_append(pack_backend_t *pack_backend)
+{
+    gchar *filename = NULL;
+    GFile *pack_file = NULL;
+    GError *error = NULL;
+
+    if (pack_backend->stream != NULL)
+        {
+            g_output_stream_close((GOutputStream *) pack_backend->stream, NULL, NULL);
+            free_object(pack_backend->stream);
+        }
+
+    filename = get_pack_filename(pack_backend, pack_backend->pack);
+    pack_file = g_file_new_for_path(filename);
+
+    pack_backend->stream = g_file_append_to(pack_file, G_FILE_CREATE_NONE, NULL, &error);
+    pack_backend->pack_pos = get_file_size(pack_file);
+
+    if (pack_backend->stream == NULL)
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to open pack file %s to append data in it: %s\n"), filename, error->message);
+            free_error(error);
+        }
+    else
+        {
+            print_debug(_("pack_backend: appending to %s\n"), filename);
+        }
+
+    free_object(pack_file);
+    free_variable(filename);
+}
+
+
+/**
+ * Reads keys in keyfile if group (GN_PACK_BACKEND or GN_TIER_BACKEND)
+ * is in that keyfile and fills pack_backend structure accordingly. The
+ * cold tier keys are only read from GN_TIER_BACKEND group.
+ * @param[in,out] pack_backend: pack_backend_t * structure to store
+ *                options read from the configuration file "filename".
+ * @param filename : the filename of the configuration file to read from
+ * @param group is the group where to read the keys (GN_PACK_BACKEND or
+ *        GN_TIER_BACKEND).
+ */
+static void read_from_group_pack_backend(pack_backend_t *pack_backend, gchar *filename, const gchar *group)
+{
+    GKeyFile *keyfile = NULL;      /** Configuration file parser */
+    GError *error = NULL;          /** Glib error handling       */
+    gchar *prefix = NULL;
+    gchar *cold = NULL;
+    gint64 pack_size = 0;
+    gint64 interval = 0;
+
+    keyfile = g_key_file_new();
+
+    if (g_key_file_load_from_file(keyfile, filename, G_KEY_FILE_KEEP_COMMENTS, &error))
+        {
+            if (g_strcmp0(group, GN_TIER_BACKEND) == 0 && g_key_file_has_group(keyfile, GN_TIER_BACKEND) == TRUE)
+                {
+                    prefix = read_string_from_file(keyfile, filename, GN_TIER_BACKEND, KN_FILE_DIRECTORY, _("Could not load [tier_backend] file-directory from file."));
+                    pack_size = read_int64_from_file(keyfile, filename, GN_TIER_BACKEND, KN_PACK_SIZE, _("Could not load [tier_backend] pack-size from file."), PACK_BACKEND_PACK_SIZE);
+                    cold = read_string_from_file(keyfile, filename, GN_TIER_BACKEND, KN_COLD_DIRECTORY, _("Could not load [tier_backend] cold-directory from file."));
+                    interval = read_int64_from_file(keyfile, filename, GN_TIER_BACKEND, KN_MIGRATE_INTERVAL, _("Could not load [tier_backend] migrate-interval from file."), TIER_BACKEND_MIGRATE_INTERVAL);
+                }
+            else if (g_strcmp0(group, GN_PACK_BACKEND) == 0 && g_key_file_has_group(keyfile, GN_PACK_BACKEND) == TRUE)
+                {
+                    prefix = read_string_from_file(keyfile, filename, GN_PACK_BACKEND, KN_FILE_DIRECTORY, _("Could not load [pack_backend] file-directory from file."));
+                    pack_size = read_int64_from_file(keyfile, filename, GN_PACK_BACKEND, KN_PACK_SIZE, _("Could not load [pack_backend] pack-size from file."), PACK_BACKEND_PACK_SIZE);
+                }
+        }
+    else if (error != NULL)
+        {
+            print_error(__FILE__, __LINE__,  _("Failed to open %s configuration file: %s\n"), filename, error->message);
+            free_error(error);
+        }
+
+    if (prefix != NULL)
+        {
+            free_variable(pack_backend->prefix);
+            pack_backend->prefix = normalize_directory(prefix);
+        }
+
+    free_variable(prefix);
+
+    if (cold != NULL)
+        {
+            free_variable(pack_backend->cold);
+            pack_backend->cold = normalize_directory(cold);
+        }
+
+    free_variable(cold);
+
+    if (pack_size >= 1048576)
+        {
+            pack_backend->pack_size = pack_size;
+        }
+
+    if (interval > 0)
+        {
+            pack_backend->migrate_interval = interval;
+        }
+
+    g_key_file_free(keyfile);
+}
+
+
+/**
+ * Inits the backend: creates directories, loads the index (or rebuilds
+ * it from the pack files) and opens the pack file to append to.
+ * user_data of the backend structure is a pack_backend_t structure.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+void pack_init_backend(server_struct_t *server_struct)
+{
+    pack_init_backend_from_group(server_struct, GN_PACK_BACKEND);
+}
+
+
+/**
+ * Inits the backend reading its configuration from group. When group is
+ * GN_TIER_BACKEND the pack files that are in the cold tier directory are
+ * known as migrated before the index is checked against pack files.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param group is the configuration group of the backend
+ *        (GN_PACK_BACKEND or GN_TIER_BACKEND).
+ */
+void pack_init_backend_from_group(server_struct_t *server_struct, const gchar *group)
+{
+    pack_backend_t *pack_backend = NULL;
+    gchar *filename = NULL;
+    GFile *index_file = NULL;
+    GFile *pack_file = NULL;
+    GError *error = NULL;
+    guint64 last_end = 0;
+    guint64 end = 0;
+    guint32 last_pack = 0;
+    guint32 index_pack = 0;
+    guint32 i = 0;
+    gboolean loaded = FALSE;
+
+    if (server_struct != NULL && server_struct->backend != NULL)
+        {
+            pack_backend = (pack_backend_t *) g_malloc0(sizeof(pack_backend_t));
+
+            /* default values */
+            pack_backend->prefix = g_strdup("/var/tmp/cdpfgl/server");
+            pack_backend->pack_size = PACK_BACKEND_PACK_SIZE;
+            pack_backend->index = g_hash_table_new_full(hash_key_hash, hash_key_equal, free_variable, free_variable);
+            pack_backend->stream = NULL;
+            pack_backend->istream = NULL;
+            pack_backend->cold = NULL;
+            pack_backend->migrated = g_hash_table_new(g_direct_hash, g_direct_equal);
+            pack_backend->migrate_interval = TIER_BACKEND_MIGRATE_INTERVAL;
+            pack_backend->migrator = NULL;
+            pack_backend->stop = FALSE;
+            g_mutex_init(&pack_backend->mutex);
+            g_cond_init(&pack_backend->migrate_cond);
+
+            if (server_struct->opt != NULL && server_struct->opt->configfile != NULL)
+                {
+                    /* Values from the config file */
+                    read_from_group_pack_backend(pack_backend, server_struct->opt->configfile, group);
+                }
+
+            server_struct->backend->user_data = pack_backend;
+
+            create_directory(pack_backend->prefix);
+            file_create_directory(pack_backend->prefix, "meta");
+            file_create_directory(pack_backend->prefix, "pack");
+
+            if (pack_backend->cold != NULL)
+                {
+                    create_directory(pack_backend->cold);
+                }
+
+            pack_backend->catalog = new_catalog_t(pack_backend->prefix, server_struct->opt != NULL ? server_struct->opt->meta_sync : NULL);
+
+            last_pack = find_last_pack_number(pack_backend);
+            loaded = load_index(pack_backend, &index_pack, &last_end);
+
+            /* Index records are appended after every block written */
+            filename = g_build_filename(pack_backend->prefix, "pack", PACK_INDEX_FILENAME, NULL);
+            index_file = g_file_new_for_path(filename);
+            pack_backend->istream = g_file_append_to(index_file, G_FILE_CREATE_NONE, NULL, &error);
+
+            if (pack_backend->istream == NULL)
+                {
+                    print_error(__FILE__, __LINE__, _("Error: unable to open pack index %s: %s\n"), filename, error->message);
+                    free_error(error);
+                }
+
+            if (loaded == FALSE)
+                {
+                    /* No index: rebuilding it from all pack files */
+                    fprintf(stdout, _("Please wait while rebuilding pack index\n"));
+                    for (i = 0; i <= last_pack; i++)
+                        {
+                            end = scan_pack_file(pack_backend, i, 0);
+                        }
+                    fprintf(stdout, _("Finished !\n"));
+                }
+            else
+                {
+                    /* Records that may have been written without their index record */
+                    end = scan_pack_file(pack_backend, index_pack, last_end);
+                    for (i = index_pack + 1; i <= last_pack; i++)
+                        {
+                            end = scan_pack_file(pack_backend, i, 0);
+                        }
+                }
+
+            pack_backend->pack = last_pack;
+
+            free_variable(filename);
+            filename = get_pack_filename(pack_backend, last_pack);
+            pack_file = g_file_new_for_path(filename);
+
+            if (g_hash_table_contains(pack_backend->migrated, GUINT_TO_POINTER(last_pack + 1)) == TRUE)
+                {
+                    /* Pack files in the cold tier are never appended to */
+                    pack_backend->pack = last_pack + 1;
+                }
+            else if (g_file_query_exists(pack_file, NULL) == TRUE && end < get_file_size(pack_file))
+                {
+                    /* Appending after some garbage is not a good idea */
+                    print_error(__FILE__, __LINE__, _("pack_backend: %s ends with an incomplete record. Starting a new pack file.\n"), filename);
+                    pack_backend->pack = last_pack + 1;
+                }
+
+            open_pack_to_append(pack_backend);
+
+            free_object(pack_file);
+            free_object(index_file);
+            free_variable(filename);
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: no server structure or no backend structure.\n"));
+        }
+}
+
+
+/**
+ * Stores meta data into the catalog exactly as file_backend does.
+ * @param server_struct is the server main structure where all
+ *        informations needed by the program are stored.
+ * @param smeta the server's structure for file meta data.
+ */
+void pack_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta)
+{
+    pack_backend_t *pack_backend = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL && smeta != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+            catalog_store_smeta(pack_backend->catalog, smeta);
+        }
+}
+
+
+/**
+ * Appends data to the current pack file and records its location
+ * into the index. Already stored hashs are not written again.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data is a hash_data_t * structure that contains the hash and
+ *        the corresponding data in a binary form and a 'read' field that
+ *        contains the number of bytes in 'data' field. This structure is
+ *        freed by this function.
+ */
+void pack_store_data(server_struct_t *server_struct, hash_data_t *hash_data)
+{
+    pack_backend_t *pack_backend = NULL;
+    guint8 header[PACK_RECORD_HEADER_SIZE];
+    GError *error = NULL;
+    pack_entry_t *entry = NULL;
+    gchar *string_written = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+
+            if (hash_data != NULL && hash_data->hash != NULL && hash_data->data != NULL)
+                {
+                    g_mutex_lock(&pack_backend->mutex);
+
+                    if (g_hash_table_contains(pack_backend->index, hash_data->hash) == FALSE)
+                        {
+                            if (pack_backend->pack_pos >= pack_backend->pack_size)
+                                {
+                                    pack_backend->pack = pack_backend->pack + 1;
+                                    open_pack_to_append(pack_backend);
+                                    /* The previous pack file is sealed: it may be migrated */
+                                    g_cond_signal(&pack_backend->migrate_cond);
+                                }
+
+                            memset(header, 0, PACK_RECORD_HEADER_SIZE);
+                            put_guint32_into_buffer(header, PACK_MAGIC);
+                            memcpy(header + 4, hash_data->hash, HASH_LEN);
+                            put_guint16_into_buffer(header + 4 + HASH_LEN, (guint16) hash_data->cmptype);
+                            put_guint64_into_buffer(header + 4 + HASH_LEN + 4, (guint64) hash_data->uncmplen);
+                            put_guint64_into_buffer(header + 4 + HASH_LEN + 12, (guint64) hash_data->read);
+
+                            if (pack_backend->stream != NULL &&
+                                g_output_stream_write_all((GOutputStream *) pack_backend->stream, header, PACK_RECORD_HEADER_SIZE, NULL, NULL, &error) == TRUE &&
+                                g_output_stream_write_all((GOutputStream *) pack_backend->stream, hash_data->data, hash_data->read, NULL, NULL, &error) == TRUE)
+                                {
+                                    entry = new_pack_entry_t(pack_backend->pack, pack_backend->pack_pos + PACK_RECORD_HEADER_SIZE, hash_data->read, hash_data->cmptype, hash_data->uncmplen);
+                                    write_index_record(pack_backend, hash_data->hash, entry);
+                                    insert_entry_in_index(pack_backend, hash_data->hash, entry);
+                                    pack_backend->pack_pos = pack_backend->pack_pos + PACK_RECORD_HEADER_SIZE + hash_data->read;
+                                }
+                            else
+                                {
+                                    string_written = g_strdup_printf("%"G_GSSIZE_FORMAT, hash_data->read);
+                                    print_error(__FILE__, __LINE__, _("Error: unable to append %s bytes to pack file %08x: %s\n"), string_written, pack_backend->pack, error != NULL ? error->message : "");
+                                    free_variable(string_written);
+                                    free_error(error);
+
+                                    /* The pack file may now end with an incomplete record */
+                                    pack_backend->pack = pack_backend->pack + 1;
+                                    open_pack_to_append(pack_backend);
+                                }
+                        }
+
+                    g_mutex_unlock(&pack_backend->mutex);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: no hash_data_t structure or hash in it or missing data in it.\n"));
+                }
+        }
+
+    free_hash_data_t(hash_data);
+}
+
+
+/**
+ * Builds a list of hashs that server's server needs. Only the in memory
+ * index is looked at: the mutex is taken once for the whole list.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data_list is the list of hashs that we have to check for.
+ * @returns to the client a list of hashs in no specific order for which
+ *          the server needs the data.
+ */
+GList *pack_build_needed_hash_list(server_struct_t *server_struct, GList *hash_data_list)
+{
+    GList *head = hash_data_list;
+    GList *needed = NULL;
+    pack_backend_t *pack_backend = NULL;
+    hash_data_t *hash_data = NULL;
+    hash_data_t *needed_hash_data = NULL;
+    GHashTable *needed_index = NULL;
+    gboolean known = FALSE;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+            needed_index = new_hash_index();
+
+            g_mutex_lock(&pack_backend->mutex);
+
+            while (head != NULL)
+                {
+                    hash_data = head->data;
+                    known = g_hash_table_contains(pack_backend->index, hash_data->hash);
+
+                    if (known == FALSE && g_hash_table_contains(needed_index, hash_data->hash) == FALSE)
+                        {
+                            needed_hash_data = copy_only_hash(hash_data, NULL);
+                            needed = g_list_prepend(needed, needed_hash_data);
+                            g_hash_table_add(needed_index, needed_hash_data->hash);
+                        }
+
+                    head = g_list_next(head);
+                }
+
+            g_mutex_unlock(&pack_backend->mutex);
+
+            g_hash_table_destroy(needed_index);
+            needed = g_list_reverse(needed);
+        }
+
+    return needed;
+}
+
+
+/**
+ * Gets the list of all saved files
+ * @param server_struct is the structure that contains all data for the
+ *        server.
+ * @param query is the structure that contains everything about the
+ *        requested query.
+ * @returns a JSON string containing all filenames requested
+ */
+gchar *pack_get_list_of_files(server_struct_t *server_struct, query_t *query)
+{
+    pack_backend_t *pack_backend = NULL;
+    catalog_t *catalog = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL &&  server_struct->backend->user_data != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+            catalog = pack_backend->catalog;
+        }
+
+    return catalog_get_list_of_files(catalog, query);
+}
+
+
+/**
+ * Retrieves data of a block from the pack file where it is stored.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hex_hash is a gchar * hash in hexadecimal format as retrieved
+ *        from the url.
+ * @returns a newly allocated hash_data_t structure or NULL if the hash is
+ *          unknown.
+ */
+hash_data_t *pack_retrieve_data(server_struct_t *server_struct, gchar *hex_hash)
+{
+    pack_backend_t *pack_backend = NULL;
+    pack_entry_t *entry = NULL;
+    pack_entry_t location;
+    gchar *filename = NULL;
+    GFile *pack_file = NULL;
+    GFileInputStream *stream = NULL;
+    GError *error = NULL;
+    gsize size_read = 0;
+    guint8 *hash = NULL;
+    guchar *data = NULL;
+    hash_data_t *hash_data = NULL;
+    gboolean found = FALSE;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL && hex_hash != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+            hash = string_to_hash(hex_hash);
+
+            g_mutex_lock(&pack_backend->mutex);
+            entry = g_hash_table_lookup(pack_backend->index, hash);
+            if (entry != NULL)
+                {
+                    location = *entry;
+                    found = TRUE;
+                    filename = get_pack_filename(pack_backend, location.pack);
+                }
+            g_mutex_unlock(&pack_backend->mutex);
+
+            if (found == TRUE)
+                {
+                    pack_file = g_file_new_for_path(filename);
+                    stream = g_file_read(pack_file, NULL, &error);
+
+                    if (stream == NULL && pack_backend->cold != NULL)
+                        {
+                            /* The pack file may have been migrated since the lookup */
+                            free_error(error);
+                            error = NULL;
+                            free_object(pack_file);
+                            free_variable(filename);
+                            filename = get_pack_filename_in(pack_backend->cold, location.pack);
+                            pack_file = g_file_new_for_path(filename);
+                            stream = g_file_read(pack_file, NULL, &error);
+                        }
+
+                    if (stream != NULL && g_seekable_seek((GSeekable *) stream, location.offset, G_SEEK_SET, NULL, &error) == TRUE)
+                        {
+                            data = (guchar *) g_malloc(location.length + 1);
+
+                            if (g_input_stream_read_all((GInputStream *) stream, data, location.length, &size_read, NULL, &error) == TRUE && size_read == location.length)
+                                {
+                                    hash_data = new_hash_data_t_as_is(data, size_read, hash, location.cmptype, location.uncmplen);
+                                    hash = NULL;
+                                }
+                            else
+                                {
+                                    print_error(__FILE__, __LINE__, _("Error: unable to read block %s from pack file %s.\n"), hex_hash, filename);
+                                    free_variable(data);
+                                }
+
+                            g_input_stream_close((GInputStream *) stream, NULL, NULL);
+                        }
+                    else
+                        {
+                            print_error(__FILE__, __LINE__, _("Error: unable to open file %s to read data from it.\n"), filename);
+                        }
+
+                    free_error(error);
+                    free_object(stream);
+                    free_object(pack_file);
+                    free_variable(filename);
+                }
+
+            free_variable(hash);
+        }
+
+    return hash_data;
+}
+
+
+/**
+ * Writes meta data still in memory and closes the catalog when the
+ * server ends.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+void pack_terminate_backend(server_struct_t *server_struct)
+{
+    pack_backend_t *pack_backend = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+            free_catalog_t(pack_backend->catalog);
+            pack_backend->catalog = NULL;
+        }
+}
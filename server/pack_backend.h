@@ -0,0 +1,215 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    pack_backend.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/pack_backend.h
+ *
+ * This file contains all definitions for the functions of the pack
+ * backend. This backend appends data blocks into big pack files instead
+ * of creating one file (and one .meta file) per block. An index file
+ * keeps, for each hash, the pack file number, the offset and the length
+ * of the block and its compression parameters.
+ */
+
+#ifndef _SERVER_PACK_BACKEND_H_
+#define _SERVER_PACK_BACKEND_H_
+
+
+/**
+ * @def PACK_BACKEND_PACK_SIZE
+ * Defines the default size (in bytes) above which a new pack file is
+ * created. Default is 1 GB.
+ */
+#define PACK_BACKEND_PACK_SIZE (1073741824)
+
+
+/**
+ * @def PACK_MAGIC
+ * Magic number that begins every record in a pack file ("CDPK"). It
+ * allows one to rebuild the index by scanning pack files.
+ */
+#define PACK_MAGIC (0x4b504443)
+
+
+/**
+ * @def PACK_RECORD_HEADER_SIZE
+ * Size of the header written before each block in a pack file:
+ * magic (4), hash (HASH_LEN), cmptype (2), padding (2), uncmplen (8)
+ * and length (8).
+ */
+#define PACK_RECORD_HEADER_SIZE (4 + HASH_LEN + 2 + 2 + 8 + 8)
+
+
+/**
+ * @def PACK_INDEX_RECORD_SIZE
+ * Size of one record in the index file: hash (HASH_LEN), pack number (4),
+ * cmptype (2), padding (2), offset (8), length (8) and uncmplen (8).
+ */
+#define PACK_INDEX_RECORD_SIZE (HASH_LEN + 4 + 2 + 2 + 8 + 8 + 8)
+
+
+/**
+ * @def PACK_INDEX_FILENAME
+ * Name of the index file in the pack directory.
+ */
+#define PACK_INDEX_FILENAME ("index")
+
+
+/**
+ * @struct pack_entry_t
+ * @brief Location of one block into the pack files.
+ */
+typedef struct
+{
+    guint32 pack;      /**< number of the pack file where the block is      */
+    guint64 offset;    /**< offset of the data (header excluded) in it      */
+    guint64 length;    /**< length of the data as stored (maybe compressed) */
+    gshort cmptype;    /**< compression type of the stored data             */
+    gssize uncmplen;   /**< uncompressed length of the data                 */
+} pack_entry_t;
+
+
+/**
+ * @struct pack_backend_t
+ * @brief Structure that contains everything needed by pack backend.
+ *
+ * Blocks are appended to prefix/pack/XXXXXXXX.pack files. The in memory
+ * index is protected by a mutex because blocks are stored by the data
+ * thread and retrieved by libmicrohttpd's threads. When used by the tier
+ * backend sealed pack files are moved to the cold directory by the
+ * migrator thread: the index (that stays local) is unchanged because
+ * only the directory of a pack file changes.
+ */
+typedef struct
+{
+    gchar *prefix;              /**< Prefix for the path where data are located               */
+    guint64 pack_size;          /**< Size above which a new pack file is opened               */
+    GMutex mutex;               /**< Protects the index and the current pack file             */
+    GHashTable *index;          /**< hash (guint8 *) -> pack_entry_t * index                  */
+    guint32 pack;               /**< number of the pack file we are appending to              */
+    guint64 pack_pos;           /**< actual size of the pack file we are appending to         */
+    GFileOutputStream *stream;  /**< stream of the pack file we are appending to              */
+    GFileOutputStream *istream; /**< stream of the index file                                 */
+    catalog_t *catalog;         /**< per host meta data catalogs                              */
+    gchar *cold;                /**< directory of the cold tier (NULL when not tiered)        */
+    GHashTable *migrated;       /**< numbers (+1) of pack files that are in the cold tier     */
+    gint64 migrate_interval;    /**< seconds between two looks for sealed pack files          */
+    GThread *migrator;          /**< thread moving sealed pack files to the cold tier         */
+    GCond migrate_cond;         /**< signaled when a pack file is sealed or when stopping     */
+    gboolean stop;              /**< TRUE when the migrator has to end                        */
+} pack_backend_t;
+
+
+/**
+ * Stores meta data into the catalog exactly as file_backend does.
+ * @param server_struct is the server main structure where all
+ *        informations needed by the program are stored.
+ * @param smeta the server's structure for file meta data.
+ */
+extern void pack_store_smeta(server_struct_t *server_struct, server_meta_data_t *smeta);
+
+
+/**
+ * Inits the backend: creates directories, loads the index (or rebuilds
+ * it from the pack files) and opens the pack file to append to.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+extern void pack_init_backend(server_struct_t *server_struct);
+
+
+/**
+ * Inits the backend reading its configuration from group. When group is
+ * GN_TIER_BACKEND the pack files that are in the cold tier directory are
+ * known as migrated before the index is checked against pack files.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param group is the configuration group of the backend
+ *        (GN_PACK_BACKEND or GN_TIER_BACKEND).
+ */
+extern void pack_init_backend_from_group(server_struct_t *server_struct, const gchar *group);
+
+
+/**
+ * Builds the filename of a pack file in the hot tier (the local pack
+ * directory) wherever the pack file is.
+ * @param pack_backend is the pack backend structure.
+ * @param pack is the number of the pack file.
+ * @returns a newly allocated gchar * filename that may be freed with
+ *          free_variable() when no longer needed.
+ */
+extern gchar *pack_get_hot_filename(pack_backend_t *pack_backend, guint32 pack);
+
+
+/**
+ * Appends data to the current pack file and records its location
+ * into the index. Already stored hashs are not written again.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data is a hash_data_t * structure that contains the hash and
+ *        the corresponding data. This structure is freed by this function.
+ */
+extern void pack_store_data(server_struct_t *server_struct, hash_data_t *hash_data);
+
+
+/**
+ * Builds a list of hashs that server's server needs.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hash_data_list is the list of hashs that we have to check for.
+ * @returns to the client a list of hashs for which the server needs the
+ *          data.
+ */
+extern GList *pack_build_needed_hash_list(server_struct_t *server_struct, GList *hash_data_list);
+
+
+/**
+ * Gets the list of all saved files
+ * @param server_struct is the structure that contains all data for the
+ *        server.
+ * @param query is the structure that contains everything about the
+ *        requested query.
+ * @returns a JSON string containing all filenames requested
+ */
+extern gchar *pack_get_list_of_files(server_struct_t *server_struct, query_t *query);
+
+
+/**
+ * Retrieves data of a block from the pack file where it is stored.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ * @param hex_hash is a gchar * hash in hexadecimal format as retrieved
+ *        from the url.
+ * @returns a newly allocated hash_data_t structure or NULL if the hash is
+ *          unknown.
+ */
+extern hash_data_t *pack_retrieve_data(server_struct_t *server_struct, gchar *hex_hash);
+
+
+/**
+ * Writes meta data still in memory and closes the catalog when the
+ * server ends.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+extern void pack_terminate_backend(server_struct_t *server_struct);
+
+#endif /* #ifndef _SERVER_PACK_BACKEND_H_ */
@@ -0,0 +1,395 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    presence.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file presence.c
+ *
+ * This file contains all the functions of the in memory presence index
+ * used by 'cdpfglserver' to know whether a hash is already stored
+ * without stat()'ing the filesystem. Hashs are SHA256 ones and are thus
+ * uniformly distributed: their bytes are used directly as hash values
+ * for the table and for the Bloom filter.
+ */
+
+#include "server.h"
+
+static guint64 get_guint64_from_hash(guint8 *hash, guint offset);
+static void bloom_add(guint8 *bloom, guint64 bloom_bits, guint8 *hash);
+static gboolean bloom_may_contain(guint8 *bloom, guint64 bloom_bits, guint8 *hash);
+static gboolean table_find_slot(guint8 *slots, guint8 *used, guint64 capacity, guint8 *hash, guint64 *slot);
+static void allocate_table(presence_t *presence, guint64 capacity);
+static void grow_table(presence_t *presence);
+
+
+/**
+ * @param hash is a binary hash of HASH_LEN bytes.
+ * @param offset is the offset in the hash where to read 8 bytes.
+ * @returns the guint64 made of the 8 bytes at offset in hash.
+ */
+static guint64 get_guint64_from_hash(guint8 *hash, guint offset)
+{
+    guint64 value = 0;
+
+    memcpy(&value, hash + offset, sizeof(guint64));
+
+    return value;
+}
+
+
+/**
+ * Sets the PRESENCE_BLOOM_PROBES bits of hash in the Bloom filter
+ * (double hashing with two 64 bits words of the hash).
+ * @param bloom is the Bloom filter.
+ * @param bloom_bits is the number of bits in the filter (power of two).
+ * @param hash is the binary hash to add.
+ */
+static void bloom_add(guint8 *bloom, guint64 bloom_bits, guint8 *hash)
+{
+    guint64 h1 = get_guint64_from_hash(hash, 8);
+    guint64 h2 = get_guint64_from_hash(hash, 16);
+    guint64 bit = 0;
+    guint i = 0;
+
+    for (i = 0; i < PRESENCE_BLOOM_PROBES; i++)
+        {
+            bit = (h1 + i * h2) & (bloom_bits - 1);
+            bloom[bit >> 3] |= (1 << (bit & 7));
+        }
+}
+
+
+/**
+ * Tests the PRESENCE_BLOOM_PROBES bits of hash in the Bloom filter
+ * @param bloom is the Bloom filter.
+ * @param bloom_bits is the number of bits in the filter (power of two).
+ * @param hash is the binary hash to look for.
+ * @returns FALSE if hash has never been added, TRUE if it may have been.
+ */
+static gboolean bloom_may_contain(guint8 *bloom, guint64 bloom_bits, guint8 *hash)
+{
+    guint64 h1 = get_guint64_from_hash(hash, 8);
+    guint64 h2 = get_guint64_from_hash(hash, 16);
+    guint64 bit = 0;
+    guint i = 0;
+    gboolean maybe = TRUE;
+
+    for (i = 0; i < PRESENCE_BLOOM_PROBES && maybe == TRUE; i++)
+        {
+            bit = (h1 + i * h2) & (bloom_bits - 1);
+            maybe = ((bloom[bit >> 3] & (1 << (bit & 7))) != 0);
+        }
+
+    return maybe;
+}
+
+
+/**
+ * Finds the slot of a hash in the table with linear probing.
+ * @param slots is the array of hashs of the table.
+ * @param used tells for each slot if it is used or not.
+ * @param capacity is the number of slots (power of two).
+ * @param hash is the binary hash to look for.
+ * @param[out] slot is the slot where hash is or the first free slot
+ *             where it should be inserted.
+ * @returns TRUE if hash is in the table, FALSE otherwise.
+ */
+static gboolean table_find_slot(guint8 *slots, guint8 *used, guint64 capacity, guint8 *hash, guint64 *slot)
+{
+    guint64 i = get_guint64_from_hash(hash, 0) & (capacity - 1);
+    gboolean found = FALSE;
+
+    while (used[i] != 0 && found == FALSE)
+        {
+            if (memcmp(slots + i * HASH_LEN, hash, HASH_LEN) == 0)
+                {
+                    found = TRUE;
+                }
+            else
+                {
+                    i = (i + 1) & (capacity - 1);
+                }
+        }
+
+    *slot = i;
+
+    return found;
+}
+
+
+/**
+ * Allocates an empty table and its Bloom filter
+ * @param presence is the presence index.
+ * @param capacity is the number of slots (power of two).
+ */
+static void allocate_table(presence_t *presence, guint64 capacity)
+{
+    presence->capacity = capacity;
+    presence->count = 0;
+    presence->slots = (guint8 *) g_malloc0(capacity * HASH_LEN);
+    presence->used = (guint8 *) g_malloc0(capacity);
+    presence->bloom_bits = capacity * PRESENCE_BLOOM_BITS_PER_SLOT;
+    presence->bloom = (guint8 *) g_malloc0(presence->bloom_bits / 8);
+}
+
+
+/**
+ * Doubles the size of the table and rebuilds the Bloom filter (a Bloom
+ * filter can not be resized but we know every hash that is in it).
+ * @param presence is the presence index (mutex must be held).
+ */
+static void grow_table(presence_t *presence)
+{
+    guint8 *old_slots = presence->slots;
+    guint8 *old_used = presence->used;
+    guint64 old_capacity = presence->capacity;
+    guint64 i = 0;
+    guint64 slot = 0;
+
+    free_variable(presence->bloom);
+    allocate_table(presence, old_capacity * 2);
+
+    for (i = 0; i < old_capacity; i++)
+        {
+            if (old_used[i] != 0)
+                {
+                    table_find_slot(presence->slots, presence->used, presence->capacity, old_slots + i * HASH_LEN, &slot);
+                    memcpy(presence->slots + slot * HASH_LEN, old_slots + i * HASH_LEN, HASH_LEN);
+                    presence->used[slot] = 1;
+                    presence->count++;
+                    bloom_add(presence->bloom, presence->bloom_bits, old_slots + i * HASH_LEN);
+                }
+        }
+
+    free_variable(old_slots);
+    free_variable(old_used);
+}
+
+
+/**
+ * Creates a new empty presence index. It is not ready until
+ * presence_set_ready() is called.
+ * @returns a newly allocated presence_t structure that may be freed
+ *          with free_presence_t() when no longer needed.
+ */
+presence_t *new_presence_t(void)
+{
+    presence_t *presence = NULL;
+
+    presence = (presence_t *) g_malloc0(sizeof(presence_t));
+    g_assert_nonnull(presence);
+
+    g_mutex_init(&presence->mutex);
+    allocate_table(presence, PRESENCE_DEFAULT_CAPACITY);
+    presence->ready = FALSE;
+
+    return presence;
+}
+
+
+/**
+ * Frees a presence index
+ * @param presence is the presence_t structure to be freed.
+ */
+void free_presence_t(presence_t *presence)
+{
+    if (presence != NULL)
+        {
+            g_mutex_clear(&presence->mutex);
+            free_variable(presence->slots);
+            free_variable(presence->used);
+            free_variable(presence->bloom);
+            free_variable(presence);
+        }
+}
+
+
+/**
+ * Inserts a hash into the presence index. Inserting twice the same hash
+ * is harmless.
+ * @param presence is the presence index.
+ * @param hash is the binary hash (HASH_LEN bytes) to insert.
+ */
+void presence_insert(presence_t *presence, guint8 *hash)
+{
+    guint64 slot = 0;
+
+    if (presence != NULL && hash != NULL)
+        {
+            g_mutex_lock(&presence->mutex);
+
+            if (table_find_slot(presence->slots, presence->used, presence->capacity, hash, &slot) == FALSE)
+                {
+                    memcpy(presence->slots + slot * HASH_LEN, hash, HASH_LEN);
+                    presence->used[slot] = 1;
+                    presence->count++;
+                    bloom_add(presence->bloom, presence->bloom_bits, hash);
+
+                    if (presence->count * 4 > presence->capacity * 3)
+                        {
+                            grow_table(presence);
+                        }
+                }
+
+            g_mutex_unlock(&presence->mutex);
+        }
+}
+
+
+/**
+ * Removes a hash from the presence index (when its block has been
+ * deleted). The Bloom filter is left as is: a lookup of the hash then
+ * checks the table before answering PRESENCE_ABSENT. Hashs that
+ * follow the removed one are shifted back so that linear probing still
+ * finds them.
+ * @param presence is the presence index.
+ * @param hash is the binary hash (HASH_LEN bytes) to remove.
+ */
+void presence_remove(presence_t *presence, guint8 *hash)
+{
+    guint64 mask = 0;
+    guint64 hole = 0;
+    guint64 next = 0;
+    guint64 home = 0;
+
+    if (presence != NULL && hash != NULL)
+        {
+            g_mutex_lock(&presence->mutex);
+
+            mask = presence->capacity - 1;
+
+            if (table_find_slot(presence->slots, presence->used, presence->capacity, hash, &hole) == TRUE)
+                {
+                    presence->used[hole] = 0;
+                    presence->count--;
+                    next = (hole + 1) & mask;
+
+                    while (presence->used[next] != 0)
+                        {
+                            home = get_guint64_from_hash(presence->slots + next * HASH_LEN, 0) & mask;
+
+                            /* Moves the hash into the hole unless its home slot is between the hole and it */
+                            if (((next - home) & mask) >= ((next - hole) & mask))
+                                {
+                                    memcpy(presence->slots + hole * HASH_LEN, presence->slots + next * HASH_LEN, HASH_LEN);
+                                    presence->used[hole] = 1;
+                                    presence->used[next] = 0;
+                                    hole = next;
+                                }
+
+                            next = (next + 1) & mask;
+                        }
+                }
+
+            g_mutex_unlock(&presence->mutex);
+        }
+}
+
+
+/**
+ * Looks a hash up in the presence index. The Bloom filter avoids most
+ * lookups in the table. Once the index is ready the table has every
+ * stored hash: a hash that is not in it is absent.
+ * @param presence is the presence index.
+ * @param hash is the binary hash (HASH_LEN bytes) to look for.
+ * @returns PRESENCE_ABSENT, PRESENCE_PRESENT or PRESENCE_UNKNOWN.
+ */
+gint presence_lookup(presence_t *presence, guint8 *hash)
+{
+    guint64 slot = 0;
+    gint result = PRESENCE_UNKNOWN;
+
+    if (presence != NULL && hash != NULL)
+        {
+            g_mutex_lock(&presence->mutex);
+
+            if (presence->ready == TRUE && bloom_may_contain(presence->bloom, presence->bloom_bits, hash) == FALSE)
+                {
+                    result = PRESENCE_ABSENT;
+                }
+            else if (table_find_slot(presence->slots, presence->used, presence->capacity, hash, &slot) == TRUE)
+                {
+                    /* Even when not ready a hash in the table is stored */
+                    result = PRESENCE_PRESENT;
+                }
+            else if (presence->ready == TRUE)
+                {
+                    /* A false positive of the Bloom filter: the table has every stored hash */
+                    result = PRESENCE_ABSENT;
+                }
+
+            g_mutex_unlock(&presence->mutex);
+        }
+
+    return result;
+}
+
+
+/**
+ * Tells that the presence index now reflects the whole storage.
+ * @param presence is the presence index.
+ */
+void presence_set_ready(presence_t *presence)
+{
+    if (presence != NULL)
+        {
+            g_mutex_lock(&presence->mutex);
+            presence->ready = TRUE;
+            g_mutex_unlock(&presence->mutex);
+        }
+}
+
+
+/**
+ * @param presence is the presence index.
+ * @returns TRUE if the presence index reflects the whole storage.
+ */
+gboolean presence_is_ready(presence_t *presence)
+{
+    gboolean ready = FALSE;
+
+    if (presence != NULL)
+        {
+            g_mutex_lock(&presence->mutex);
+            ready = presence->ready;
+            g_mutex_unlock(&presence->mutex);
+        }
+
+    return ready;
+}
+
+
+/**
+ * @param presence is the presence index.
+ * @returns the number of hashs in the presence index.
+ */
+guint64 presence_count(presence_t *presence)
+{
+    guint64 count = 0;
+
+    if (presence != NULL)
+        {
+            g_mutex_lock(&presence->mutex);
+            count = presence->count;
+            g_mutex_unlock(&presence->mutex);
+        }
+
+    return count;
+}
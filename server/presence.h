@@ -0,0 +1,166 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    presence.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file presence.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the in memory presence index. This index tells whether a hash is
+ * already stored by the server without asking the filesystem. It is made
+ * of a Bloom filter in front of an open addressing table of hashs.
+ */
+#ifndef _SERVER_PRESENCE_H_
+#define _SERVER_PRESENCE_H_
+
+
+/**
+ * @def PRESENCE_DEFAULT_CAPACITY
+ * Defines the initial number of slots in the table (must be a power of
+ * two). The table doubles its size when it is filled above 3/4.
+ */
+#define PRESENCE_DEFAULT_CAPACITY (65536)
+
+
+/**
+ * @def PRESENCE_BLOOM_BITS_PER_SLOT
+ * Number of bits of the Bloom filter for each slot of the table. With 4
+ * probes and 16 bits per slot the false positive rate stays under 0.3%
+ * even when the table is full.
+ */
+#define PRESENCE_BLOOM_BITS_PER_SLOT (16)
+
+
+/**
+ * @def PRESENCE_BLOOM_PROBES
+ * Number of bits set in the Bloom filter for each hash.
+ */
+#define PRESENCE_BLOOM_PROBES (4)
+
+
+/**
+ * @def PRESENCE_ABSENT
+ * The hash is not stored (the index is ready and neither the Bloom
+ * filter nor the table has it).
+ */
+#define PRESENCE_ABSENT (0)
+
+/**
+ * @def PRESENCE_PRESENT
+ * The hash is in the table.
+ */
+#define PRESENCE_PRESENT (1)
+
+/**
+ * @def PRESENCE_UNKNOWN
+ * The index is not ready yet and the hash is not in the table: the
+ * caller has to ask the real storage.
+ */
+#define PRESENCE_UNKNOWN (2)
+
+
+/**
+ * @struct presence_t
+ * @brief In memory presence index of hashs.
+ *
+ * This structure is shared between the data thread (that inserts hashs),
+ * libmicrohttpd's threads (that look hashs up) and the thread that
+ * rebuilds the index at startup. Every access is protected by mutex.
+ */
+typedef struct
+{
+    GMutex mutex;       /**< Protects everything in this structure                */
+    guint8 *slots;      /**< capacity * HASH_LEN bytes of hashs                   */
+    guint8 *used;       /**< capacity bytes: 1 if the slot is used, 0 otherwise   */
+    guint64 capacity;   /**< number of slots in the table (power of two)          */
+    guint64 count;      /**< number of hashs in the table                         */
+    guint8 *bloom;      /**< Bloom filter bits                                    */
+    guint64 bloom_bits; /**< number of bits in the Bloom filter (power of two)    */
+    gboolean ready;     /**< TRUE when the index reflects the whole storage       */
+} presence_t;
+
+
+/**
+ * Creates a new empty presence index. It is not ready until
+ * presence_set_ready() is called.
+ * @returns a newly allocated presence_t structure that may be freed
+ *          with free_presence_t() when no longer needed.
+ */
+extern presence_t *new_presence_t(void);
+
+
+/**
+ * Frees a presence index
+ * @param presence is the presence_t structure to be freed.
+ */
+extern void free_presence_t(presence_t *presence);
+
+
+/**
+ * Inserts a hash into the presence index. Inserting twice the same hash
+ * is harmless.
+ * @param presence is the presence index.
+ * @param hash is the binary hash (HASH_LEN bytes) to insert.
+ */
+extern void presence_insert(presence_t *presence, guint8 *hash);
+
+
+/**
+ * Removes a hash from the presence index (when its block has been
+ * deleted). The Bloom filter is left as is: a lookup of the hash then
+ * checks the table before answering PRESENCE_ABSENT.
+ * @param presence is the presence index.
+ * @param hash is the binary hash (HASH_LEN bytes) to remove.
+ */
+extern void presence_remove(presence_t *presence, guint8 *hash);
+
+
+/**
+ * Looks a hash up in the presence index. The Bloom filter avoids most
+ * lookups in the table. Once the index is ready the table has every
+ * stored hash: a hash that is not in it is absent.
+ * @param presence is the presence index.
+ * @param hash is the binary hash (HASH_LEN bytes) to look for.
+ * @returns PRESENCE_ABSENT, PRESENCE_PRESENT or PRESENCE_UNKNOWN.
+ */
+extern gint presence_lookup(presence_t *presence, guint8 *hash);
+
+
+/**
+ * Tells that the presence index now reflects the whole storage.
+ * @param presence is the presence index.
+ */
+extern void presence_set_ready(presence_t *presence);
+
+
+/**
+ * @param presence is the presence index.
+ * @returns TRUE if the presence index reflects the whole storage.
+ */
+extern gboolean presence_is_ready(presence_t *presence);
+
+
+/**
+ * @param presence is the presence index.
+ * @returns the number of hashs in the presence index.
+ */
+extern guint64 presence_count(presence_t *presence);
+
+#endif /* #ifndef _SERVER_PRESENCE_H_ */
@@ -35,27 +35,52 @@ static server_struct_t *init_server_main_structure(int argc, char **argv);
 static gchar *get_data_from_a_specific_hash(server_struct_t *server_struct, gchar *hash);
 static gchar *get_argument_value_from_key(struct MHD_Connection *connection, gchar *key, gboolean encoded);
 static gboolean get_boolean_argument_value_from_key(struct MHD_Connection *connection, gchar *key);
+static query_t *get_query_from_connection(struct MHD_Connection *connection);
 static gchar *get_a_list_of_files(server_struct_t *server_struct, struct MHD_Connection *connection);
+static hash_array_stream_t *new_hash_array_stream_t(server_struct_t *server_struct, struct MHD_Connection *connection);
+static void release_hash_array_block(hash_array_stream_t *stream);
+static void free_hash_array_stream_t(void *cls);
+static void set_hash_array_record(hash_array_stream_t *stream, guint8 *hash, gshort cmptype, guchar *data, guint64 length);
+static gboolean load_hash_array_block(hash_array_stream_t *stream, guint8 *hash);
+static gboolean load_next_hash_array_block(hash_array_stream_t *stream);
+static gboolean load_next_archive_record(hash_array_stream_t *stream);
+static gboolean load_next_record(hash_array_stream_t *stream);
+static ssize_t read_hash_array_stream(void *cls, uint64_t pos, char *buf, size_t max);
+static int queue_hash_array_stream(struct MHD_Connection *connection, hash_array_stream_t *stream);
+static int answer_hash_array_bin_get_request(server_struct_t *server_struct, struct MHD_Connection *connection);
+static int answer_file_archive_bin_get_request(server_struct_t *server_struct, struct MHD_Connection *connection);
 static gchar *get_data_from_a_list_of_hashs(server_struct_t *server_struct, struct MHD_Connection *connection);
-static json_t *fills_json_with_get_stats(json_t *get, req_get_t *get_stats);
-static json_t *fills_json_with_post_stats(json_t *post, req_post_t *post_stats);
+static hash_data_t *retrieve_data_with_cache(server_struct_t *server_struct, gchar *hex_hash);
+static json_t *fills_json_with_get_stats(json_t *get, stats_t *stats);
+static json_t *fills_json_with_post_stats(json_t *post, stats_t *stats);
+static json_t *make_json_from_latencies(stats_t *stats);
 static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url);
 static gchar *get_unformatted_answer(server_struct_t *server_struct, const char *url);
 static int create_MHD_response(struct MHD_Connection *connection, gchar *answer, gchar *content_type);
+static int create_MHD_retry_later_response(struct MHD_Connection *connection);
+static gboolean is_data_post_url(const char *url);
+static gint get_latency_of_get_url(const char *url);
 static int process_get_request(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, void **con_cls);
-static json_t *find_needed_hashs(server_struct_t *server_struct, GList *hash_data_list);
+static gboolean accepts_pending_list(struct MHD_Connection *connection);
+static json_t *find_needed_hashs(server_struct_t *server_struct, GList *hash_data_list, json_t **pending);
 static int answer_meta_json_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, guchar *received_data, guint64 length);
 static int answer_hash_array_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, guchar *received_data);
 static void print_received_data_for_hash(guint8 *hash, gssize read);
+static void push_hash_data_list_to_data_queue(server_struct_t *server_struct, GList *hash_data_list);
+static int answer_data_array_bin_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, binary_array_decoder_t *decoder, guint64 length);
+static int process_received_binary_data(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, upload_t *pp);
+static void free_upload_t(upload_t *pp);
 static int process_received_data(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, guchar *received_data, guint64 length);
+static gint get_latency_of_post_url(const char *url);
 static guint64 get_header_content_length(struct MHD_Connection *connection, gchar *header, guint64 default_value);
+static gboolean must_refuse_data(server_struct_t *server_struct, const char *url);
 static int process_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, void **con_cls, const char *upload_data, size_t *upload_data_size);
 static int print_out_key(void *cls, enum MHD_ValueKind kind, const char *key, const char *value);
 static void print_headers(struct MHD_Connection *connection);
 static int ahc(void *cls, struct MHD_Connection *connection, const char *url, const char *method, const char *version, const char *upload_data, size_t *upload_data_size, void **con_cls);
 static gpointer meta_data_thread(gpointer user_data);
-static gpointer data_thread(gpointer user_data);
 static void install_server_signal_traps(server_struct_t *server_struct);
+static struct MHD_Daemon *start_mhd_daemon(server_struct_t *server_struct);
 
 
 /**
@@ -69,12 +94,29 @@ void free_server_struct_t(server_struct_t *server_struct)
         {
             MHD_stop_daemon(server_struct->d);
             print_debug(_("\tMHD daemon stopped.\n"));
-            free_variable(server_struct->backend); /** we need a backend function to be called to free the backend structure */
+            free_data_workers_t(server_struct->workers);
+            print_debug(_("\tdata workers stopped.\n"));
+
+            if (server_struct->meta_thread != NULL)
+                {
+                    /* server_struct is the stop request: meta data already queued are stored before it */
+                    g_async_queue_push(server_struct->meta_queue, server_struct);
+                    g_thread_join(server_struct->meta_thread);
+                    server_struct->meta_thread = NULL;
+                    print_debug(_("\tmeta thread stopped.\n"));
+                }
+
+            if (server_struct->backend != NULL && server_struct->backend->terminate_backend != NULL)
+                {
+                    server_struct->backend->terminate_backend(server_struct);
+                    print_debug(_("\tbackend terminated.\n"));
+                }
+            free_variable(server_struct->backend);
             print_debug(_("\tbackend variable freed.\n"));
-            g_thread_unref(server_struct->data_thread);
-            print_debug(_("\tdata thread unreferenced.\n"));
-            g_thread_unref(server_struct->meta_thread);
-            print_debug(_("\tmeta thread unreferenced.\n"));
+            free_block_cache_t(server_struct->block_cache);
+            print_debug(_("\tblock cache freed.\n"));
+            free_inflight_t(server_struct->inflight);
+            print_debug(_("\tset of blocks in flight freed.\n"));
             free_options_t(server_struct->opt);
             print_debug(_("\toption structure freed.\n"));
             free_variable(server_struct);
@@ -98,6 +140,7 @@ static gboolean int_signal_handler(gpointer user_data)
             print_debug(_("\nEnding the program:\n"));
             g_main_loop_quit(server_struct->loop);
             print_debug(_("\tMain loop exited.\n"));
+            trace_dump();
             free_server_struct_t(server_struct);
         }
 
@@ -121,24 +164,76 @@ static server_struct_t *init_server_main_structure(int argc, char **argv)
     g_assert_nonnull(server_struct);
 
 
-    server_struct->data_thread = NULL;
+    server_struct->workers = NULL;
     server_struct->meta_thread = NULL;
     server_struct->opt = do_what_is_needed_from_command_line_options(argc, argv);
     server_struct->d = NULL;            /* libmicrohttpd daemon pointer */
     server_struct->meta_queue = g_async_queue_new();
-    server_struct->data_queue = g_async_queue_new();
     server_struct->loop = NULL;
 
     /* server statistics */
     server_struct->stats = new_stats_t();
 
-    /* default backend (file_backend) */
-    server_struct->backend = init_backend_structure(file_store_smeta, file_store_data, file_init_backend, file_build_needed_hash_list, file_get_list_of_files, file_retrieve_data);
+    if (server_struct->opt != NULL)
+        {
+            server_struct->block_cache = new_block_cache_t((guint64) server_struct->opt->block_cache * 1048576);
+            server_struct->inflight = new_inflight_t((guint) server_struct->opt->inflight_timeout);
+        }
+
+    if (server_struct->opt != NULL && g_strcmp0(server_struct->opt->backend, "pack") == 0)
+        {
+            server_struct->backend = init_backend_structure(pack_store_smeta, pack_store_data, NULL, pack_init_backend, pack_build_needed_hash_list, pack_get_list_of_files, pack_retrieve_data, pack_terminate_backend, NULL);
+        }
+    else if (server_struct->opt != NULL && g_strcmp0(server_struct->opt->backend, "tier") == 0)
+        {
+            /* pack_backend whose sealed pack files are moved to a cold tier */
+            server_struct->backend = init_backend_structure(pack_store_smeta, pack_store_data, NULL, tier_init_backend, pack_build_needed_hash_list, pack_get_list_of_files, pack_retrieve_data, tier_terminate_backend, NULL);
+        }
+    else
+        {
+            /* default backend (file_backend) */
+            server_struct->backend = init_backend_structure(file_store_smeta, file_store_data, file_store_data_list, file_init_backend, file_build_needed_hash_list, file_get_list_of_files, file_retrieve_data, file_terminate_backend, file_get_epoch);
+        }
 
     return server_struct;
 }
 
 
+/**
+ * Retrieves the data of a hash from the block cache or from the backend
+ * (the block is then put into the cache).
+ * @param server_struct is the main structure for the server.
+ * @param hex_hash is the hash (in hex format) of which we want the data.
+ * @returns a newly allocated hash_data_t structure or NULL if the hash is
+ *          unknown.
+ */
+static hash_data_t *retrieve_data_with_cache(server_struct_t *server_struct, gchar *hex_hash)
+{
+    hash_data_t *hash_data = NULL;
+    guint8 *a_hash = NULL;
+    gint64 start = 0;
+
+    if (server_struct->block_cache != NULL)
+        {
+            a_hash = string_to_hash(hex_hash);
+            hash_data = block_cache_get(server_struct->block_cache, a_hash);
+            add_one_block_cache_lookup(server_struct->stats, hash_data != NULL);
+        }
+
+    if (hash_data == NULL)
+        {
+            start = g_get_monotonic_time();
+            hash_data = server_struct->backend->retrieve_data(server_struct, hex_hash);
+            add_latency(server_struct->stats, STATS_LATENCY_RETRIEVE_DATA, g_get_monotonic_time() - start);
+            block_cache_put(server_struct->block_cache, hash_data);
+        }
+
+    free_variable(a_hash);
+
+    return hash_data;
+}
+
+
 /**
  * Function that gets the data of a specific hash
  * @param server_struct is the main structure for the server.
@@ -159,7 +254,7 @@ static gchar *get_data_from_a_specific_hash(server_struct_t *server_struct, gcha
 
     if (backend->retrieve_data != NULL)
         {
-            hash_data = backend->retrieve_data(server_struct, hash);
+            hash_data = retrieve_data_with_cache(server_struct, hash);
             answer = convert_hash_data_t_to_string(hash_data);
             free_hash_data_t(hash_data);
 
@@ -243,6 +338,39 @@ static gboolean get_boolean_argument_value_from_key(struct MHD_Connection *conne
 }
 
 
+/**
+ * Makes a query from the arguments of the url (from connection). Used
+ * by /File/List.json and /File/Archive.bin requests.
+ * @param connection is the connection in MHD
+ * @returns a newly allocated query_t structure that may be freed with
+ *          free_query_t() when no longer needed.
+ */
+static query_t *get_query_from_connection(struct MHD_Connection *connection)
+{
+    query_t *query = NULL;
+
+    query = init_query_t(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, FALSE, FALSE);
+
+    query->hostname = get_argument_value_from_key(connection, "hostname", FALSE);
+    query->uid = get_argument_value_from_key(connection, "uid", FALSE);
+    query->gid = get_argument_value_from_key(connection, "gid", FALSE);
+    query->owner = get_argument_value_from_key(connection, "owner", FALSE);
+    query->group = get_argument_value_from_key(connection, "group", FALSE);
+    query->filename = get_argument_value_from_key(connection, "filename", TRUE);
+    query->date = get_argument_value_from_key(connection, "date", TRUE);
+    query->afterdate = get_argument_value_from_key(connection, "afterdate", TRUE);
+    query->beforedate = get_argument_value_from_key(connection, "beforedate", TRUE);
+    query->latest = get_boolean_argument_value_from_key(connection, "latest");
+    query->reduced = get_boolean_argument_value_from_key(connection, "reduced");
+
+    print_debug(_("hostname: %s, uid: %s, gid: %s, owner: %s, group: %s, filter: %s && %s && %s && %s && %d\n"), \
+                   query->hostname, query->uid, query->gid, query->owner, query->group,                     \
+                   query->filename, query->date, query->afterdate, query->beforedate, query->latest);
+
+    return query;
+}
+
+
 /**
  * Function to get a list of saved files.
  * @param server_struct is the main structure for the server.
@@ -265,23 +393,7 @@ static gchar *get_a_list_of_files(server_struct_t *server_struct, struct MHD_Con
 
     if (backend->get_list_of_files != NULL)
         {
-            query = init_query_t(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, FALSE, FALSE);
-
-            query->hostname = get_argument_value_from_key(connection, "hostname", FALSE);
-            query->uid = get_argument_value_from_key(connection, "uid", FALSE);
-            query->gid = get_argument_value_from_key(connection, "gid", FALSE);
-            query->owner = get_argument_value_from_key(connection, "owner", FALSE);
-            query->group = get_argument_value_from_key(connection, "group", FALSE);
-            query->filename = get_argument_value_from_key(connection, "filename", TRUE);
-            query->date = get_argument_value_from_key(connection, "date", TRUE);
-            query->afterdate = get_argument_value_from_key(connection, "afterdate", TRUE);
-            query->beforedate = get_argument_value_from_key(connection, "beforedate", TRUE);
-            query->latest = get_boolean_argument_value_from_key(connection, "latest");
-            query->reduced = get_boolean_argument_value_from_key(connection, "reduced");
-
-            print_debug(_("hostname: %s, uid: %s, gid: %s, owner: %s, group: %s, filter: %s && %s && %s && %s && %d\n"), \
-                           query->hostname, query->uid, query->gid, query->owner, query->group,                     \
-                           query->filename, query->date, query->afterdate, query->beforedate, query->latest);
+            query = get_query_from_connection(connection);
 
             if (query->hostname != NULL)
                 {
@@ -310,91 +422,480 @@ static gchar *get_a_list_of_files(server_struct_t *server_struct, struct MHD_Con
 
 
 /**
- * Gets all data from a list of hash obtained from X-Get-Hash-Array HTTP
- * header.
+ * Creates the state needed to read, one after the other, the blocks of
+ * the hashs listed in the X-Get-Hash-Array HTTP header.
  * @param server_struct is the main structure for the server.
- * @param connection is the connection in MHD
- * @returns a newlly allocated gchar * string that contains the anwser to be
- *          sent back to the client (hopefully a json string containing
- *          a hash (that is a fake one here), data and size of the data.
+ * @param connection is the connection in MHD (NULL when answering
+ *        /File/Archive.bin).
+ * @returns a newly allocated hash_array_stream_t structure that may be
+ *          freed with free_hash_array_stream_t() when no longer needed.
  */
-static gchar *get_data_from_a_list_of_hashs(server_struct_t *server_struct, struct MHD_Connection *connection)
+static hash_array_stream_t *new_hash_array_stream_t(server_struct_t *server_struct, struct MHD_Connection *connection)
 {
     const char *header = NULL;
-    gchar *answer = NULL;
-    gchar *hash = NULL;
-    GList *head = NULL;
-    GList *header_hdl = NULL;
-    hash_data_t *header_hd = NULL;
-    hash_data_t *hash_data = NULL;
-    backend_t *backend = server_struct->backend;
-    guint size = 0;
-    guint buffer_len = 0;
-    guchar *concat = NULL;
-    guchar *final_buffer = NULL;
-    a_clock_t *a_clock = NULL;
-    compress_t *compress = NULL;
-    guint8 *a_hash = NULL;
+    hash_array_stream_t *stream = NULL;
+    gint64 span = 0;
+
+    stream = (hash_array_stream_t *) g_malloc0(sizeof(hash_array_stream_t));
+    g_assert_nonnull(stream);
+
+    stream->server_struct = server_struct;
+    stream->head = NULL;
+    stream->hash_data = NULL;
+    stream->compress = NULL;
+    stream->data = NULL;
+    stream->length = 0;
+    stream->pos = 0;
+    stream->loaded = FALSE;
+    stream->archive = FALSE;
+    stream->files = NULL;
+    stream->next_file = NULL;
+    stream->meta = NULL;
+    stream->index = 0;
+    stream->json = NULL;
+    stream->ended = FALSE;
+
+    if (connection != NULL)
+        {
+            span = trace_begin();
+            header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, X_GET_HASH_ARRAY);
+            stream->head = make_hash_data_list_from_string((gchar *) header);
+            trace_end(span, "X-Get-Hash-Array retrieved in");
+        }
+
+    stream->next = stream->head;
 
+    return stream;
+}
 
-    a_clock = new_clock_t();
-    header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, X_GET_HASH_ARRAY);
-    header_hdl = make_hash_data_list_from_string((gchar *)header);
-    end_clock(a_clock, "X-Get-Hash-Array retrieved in");
 
-    a_clock = new_clock_t();
-    head = header_hdl;
-    while (header_hdl != NULL)
+/**
+ * Releases the block being sent (if any)
+ * @param stream is the hash_array_stream_t state of the answer.
+ */
+static void release_hash_array_block(hash_array_stream_t *stream)
+{
+    free_hash_data_t(stream->hash_data);
+    free_compress_t(stream->compress);
+    free_variable(stream->json);
+    stream->hash_data = NULL;
+    stream->compress = NULL;
+    stream->json = NULL;
+    stream->data = NULL;
+    stream->length = 0;
+    stream->pos = 0;
+    stream->loaded = FALSE;
+}
+
+
+/**
+ * Frees a hash_array_stream_t structure. Used by libmicrohttpd as the
+ * free callback of streamed answers.
+ * @param cls is the hash_array_stream_t * structure to be freed.
+ */
+static void free_hash_array_stream_t(void *cls)
+{
+    hash_array_stream_t *stream = (hash_array_stream_t *) cls;
+
+    if (stream != NULL)
         {
-            header_hd = header_hdl->data;
-            hash = hash_to_string(header_hd->hash);
-            hash_data = backend->retrieve_data(server_struct, hash);
-            free_variable(hash);
+            release_hash_array_block(stream);
+            g_list_free_full(stream->head, free_hdt_struct);
+            g_slist_free_full(stream->files, free_gslist_smeta);
+            free_variable(stream);
+        }
+}
+
+
+/**
+ * Makes the record to be sent next: its header is filled and data is
+ * sent after it.
+ * @param stream is the hash_array_stream_t state of the answer (its
+ *        current record must have been released).
+ * @param hash is the binary hash of the record (NULL for a hash made of
+ *        zeros).
+ * @param cmptype is the type of the record: COMPRESS_NONE_TYPE for an
+ *        uncompressed block or one of the ARCHIVE_*_TYPE.
+ * @param data is the data of the record (may be NULL if length is 0).
+ * @param length is the length of data.
+ */
+static void set_hash_array_record(hash_array_stream_t *stream, guint8 *hash, gshort cmptype, guchar *data, guint64 length)
+{
+    memset(stream->header, 0, BIN_DATA_ARRAY_HEADER_SIZE);
+
+    if (hash != NULL)
+        {
+            memcpy(stream->header, hash, HASH_LEN);
+        }
+
+    put_guint16_into_buffer(stream->header + HASH_LEN, (guint16) cmptype);
+    put_guint64_into_buffer(stream->header + HASH_LEN + 4, length);
+    put_guint64_into_buffer(stream->header + HASH_LEN + 12, length);
+
+    stream->data = data;
+    stream->length = length;
+    stream->pos = 0;
+    stream->loaded = TRUE;
+}
+
+
+/**
+ * Reads the block of a hash from the backend and uncompresses it if
+ * needed.
+ * @param stream is the hash_array_stream_t state of the answer (its
+ *        current record must have been released).
+ * @param hash is the binary hash of the block to read.
+ * @returns TRUE if the block has been loaded, FALSE if the backend does
+ *          not know this hash or if the block could not be uncompressed.
+ */
+static gboolean load_hash_array_block(hash_array_stream_t *stream, guint8 *hash)
+{
+    gchar *hex_hash = NULL;
 
-            if (hash_data != NULL)
+    hex_hash = hash_to_string(hash);
+    stream->hash_data = retrieve_data_with_cache(stream->server_struct, hex_hash);
+    free_variable(hex_hash);
+
+    if (stream->hash_data != NULL)
+        {
+            if (stream->hash_data->cmptype == COMPRESS_NONE_TYPE)
+                {
+                    set_hash_array_record(stream, hash, COMPRESS_NONE_TYPE, stream->hash_data->data, stream->hash_data->read);
+                }
+            else
                 {
+                    stream->compress = uncompress_buffer(stream->hash_data->data, stream->hash_data->read, stream->hash_data->uncmplen, stream->hash_data->cmptype);
 
-                    if (hash_data->cmptype == COMPRESS_NONE_TYPE)
+                    if (stream->compress != NULL)
                         {
-                            concat = concat_buffer(final_buffer, size, hash_data->data, hash_data->read);
-                            buffer_len = hash_data->read;
+                            set_hash_array_record(stream, hash, COMPRESS_NONE_TYPE, stream->compress->text, stream->compress->len);
                         }
                     else
                         {
-                            compress = uncompress_buffer(hash_data->data, hash_data->read, hash_data->uncmplen, hash_data->cmptype);
+                            print_error(__FILE__, __LINE__, _("Error while uncompressing one block.\n"));
+                            release_hash_array_block(stream);
+                        }
+                }
+        }
 
-                            if (compress != NULL)
-                                {
-                                    concat = concat_buffer(final_buffer, size, compress->text, compress->len);
-                                    buffer_len = compress->len;
-                                    free_compress_t(compress);
-                                }
-                            else
-                                {
-                                    print_error(__FILE__, __LINE__, _("Error while uncompressing one block.\n"));
-                                }
+    return stream->loaded;
+}
+
+
+/**
+ * Reads the next block that the backend knows of and uncompresses it if
+ * needed. Unknown hashs are skipped.
+ * @param stream is the hash_array_stream_t state of the answer (its
+ *        current block must have been released).
+ * @returns TRUE if a block has been loaded, FALSE when there is no more
+ *          block to send.
+ */
+static gboolean load_next_hash_array_block(hash_array_stream_t *stream)
+{
+    hash_data_t *header_hd = NULL;
+
+    while (stream->next != NULL && stream->loaded == FALSE)
+        {
+            header_hd = stream->next->data;
+            load_hash_array_block(stream, header_hd->hash);
+            stream->next = g_list_next(stream->next);
+        }
+
+    return stream->loaded;
+}
+
+
+/**
+ * Makes the next record of a /File/Archive.bin answer: the meta data
+ * of a file, then each of its blocks (zero hashs are skipped as they
+ * are restored as holes) and finally the end record once every file
+ * has been sent. Blocks that can not be read are sent as
+ * ARCHIVE_MISSING_TYPE records to let the client know.
+ * @param stream is the hash_array_stream_t state of the answer (its
+ *        current record must have been released).
+ * @returns TRUE if a record has been loaded, FALSE when the end record
+ *          has already been sent.
+ */
+static gboolean load_next_archive_record(hash_array_stream_t *stream)
+{
+    server_meta_data_t *smeta = NULL;
+    guint8 *hash = NULL;
+
+    while (stream->loaded == FALSE && stream->ended == FALSE)
+        {
+            if (stream->meta != NULL && stream->index < stream->meta->nb_hashs)
+                {
+                    hash = stream->meta->hashs + stream->index * HASH_LEN;
+                    stream->index = stream->index + 1;
+
+                    if (is_zero_hash(hash, NULL) == FALSE && load_hash_array_block(stream, hash) == FALSE)
+                        {
+                            set_hash_array_record(stream, hash, ARCHIVE_MISSING_TYPE, NULL, 0);
                         }
+                }
+            else if (stream->next_file != NULL)
+                {
+                    smeta = stream->next_file->data;
+                    stream->next_file = g_slist_next(stream->next_file);
 
-                    size = size + buffer_len;
+                    if (smeta != NULL && smeta->meta != NULL)
+                        {
+                            stream->meta = smeta->meta;
+                            stream->index = 0;
+                            stream->json = convert_meta_data_to_json_string(smeta->meta, smeta->hostname, smeta->data_sent);
+                            set_hash_array_record(stream, NULL, ARCHIVE_META_TYPE, (guchar *) stream->json, strlen(stream->json));
+                        }
+                }
+            else
+                {
+                    set_hash_array_record(stream, NULL, ARCHIVE_END_TYPE, NULL, 0);
+                    stream->ended = TRUE;
+                }
+        }
 
-                    free_variable(final_buffer);
-                    final_buffer = concat;
-                    free_hash_data_t(hash_data);
+    return stream->loaded;
+}
+
+
+/**
+ * Makes the next record of the answer whatever it is.
+ * @param stream is the hash_array_stream_t state of the answer (its
+ *        current record must have been released).
+ * @returns TRUE if a record has been loaded, FALSE when there is
+ *          nothing more to send.
+ */
+static gboolean load_next_record(hash_array_stream_t *stream)
+{
+    if (stream->archive == TRUE)
+        {
+            return load_next_archive_record(stream);
+        }
+    else
+        {
+            return load_next_hash_array_block(stream);
+        }
+}
+
+
+/**
+ * Fills buf with the next bytes of a /Data/Hash_Array.bin or of a
+ * /File/Archive.bin answer. Used by libmicrohttpd as the content reader
+ * callback of streamed answers: blocks are read from the backend only
+ * when they are about to be sent and released as soon as they have
+ * been.
+ * @param cls is the hash_array_stream_t * state of the answer.
+ * @param pos is the position in the answer (unused as we are always
+ *        called sequentially).
+ * @param buf is the buffer to be filled.
+ * @param max is the size of buf.
+ * @returns the number of bytes written in buf or
+ *          MHD_CONTENT_READER_END_OF_STREAM when everything has been
+ *          sent.
+ */
+static ssize_t read_hash_array_stream(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    hash_array_stream_t *stream = (hash_array_stream_t *) cls;
+    size_t written = 0;
+    guint64 to_copy = 0;
+
+    while (written < max && (stream->loaded == TRUE || load_next_record(stream) == TRUE))
+        {
+            if (stream->pos < BIN_DATA_ARRAY_HEADER_SIZE)
+                {
+                    to_copy = MIN(BIN_DATA_ARRAY_HEADER_SIZE - stream->pos, max - written);
+                    memcpy(buf + written, stream->header + stream->pos, to_copy);
+                }
+            else
+                {
+                    to_copy = MIN(stream->length - (stream->pos - BIN_DATA_ARRAY_HEADER_SIZE), max - written);
+                    memcpy(buf + written, stream->data + (stream->pos - BIN_DATA_ARRAY_HEADER_SIZE), to_copy);
                 }
 
-            header_hdl = g_list_next(header_hdl);
+            stream->pos = stream->pos + to_copy;
+            written = written + to_copy;
+
+            if (stream->pos == BIN_DATA_ARRAY_HEADER_SIZE + stream->length)
+                {
+                    release_hash_array_block(stream);
+                }
         }
-    g_list_free_full(head, free_hdt_struct);
-    end_clock(a_clock, "Read all files");
 
-    a_clock = new_clock_t();
+    if (written == 0)
+        {
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+    else
+        {
+            return (ssize_t) written;
+        }
+}
+
 
-    a_hash = calculate_hash_for_string(final_buffer, size);
-    hash_data = new_hash_data_t_as_is((guchar *) final_buffer, size, a_hash, COMPRESS_NONE_TYPE, size);
+/**
+ * Queues a streamed binary answer. stream is freed by libmicrohttpd
+ * once the answer has been sent (or here if it can not be queued).
+ * @param connection is the connection in MHD
+ * @param stream is the hash_array_stream_t state of the answer.
+ * @returns an int that is either MHD_NO or MHD_YES upon failure or not.
+ */
+static int queue_hash_array_stream(struct MHD_Connection *connection, hash_array_stream_t *stream)
+{
+    struct MHD_Response *response = NULL;
+    int success = MHD_NO;
+
+    response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, HASH_ARRAY_STREAM_BLOCK_SIZE, read_hash_array_stream, stream, free_hash_array_stream_t);
+
+    if (response != NULL)
+        {
+            MHD_add_response_header(response, "Content-Type", CT_BINARY);
+            success = MHD_queue_response(connection, MHD_HTTP_OK, response);
+            MHD_destroy_response(response);
+        }
+    else
+        {
+            free_hash_array_stream_t(stream);
+        }
+
+    return success;
+}
+
+
+/**
+ * Answers /Data/Hash_Array.bin GET request with a streamed binary data
+ * array of the uncompressed blocks of the hashs listed in the
+ * X-Get-Hash-Array HTTP header. At most one block is kept in memory.
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @returns an int that is either MHD_NO or MHD_YES upon failure or not.
+ */
+static int answer_hash_array_bin_get_request(server_struct_t *server_struct, struct MHD_Connection *connection)
+{
+    hash_array_stream_t *stream = NULL;
+    gchar *message = NULL;
+    gchar *answer = NULL;
+    int success = MHD_NO;
+
+    if (server_struct->backend->retrieve_data != NULL)
+        {
+            stream = new_hash_array_stream_t(server_struct, connection);
+            success = queue_hash_array_stream(connection, stream);
+        }
+    else
+        {
+            message = g_strdup(_("This backend's missing a retrieve_data function!"));
+            answer = answer_json_error_string(MHD_HTTP_NOT_IMPLEMENTED, message);
+            free_variable(message);
+            success = create_MHD_response(connection, answer, CT_JSON);
+        }
+
+    return success;
+}
+
+
+/**
+ * Answers /File/Archive.bin GET request with a streamed archive of
+ * every file that the query (same arguments as /File/List.json) finds:
+ * for each file its meta data and then its uncompressed blocks. This
+ * lets a whole directory be restored with one request. Only the list
+ * of files and one block are kept in memory.
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @returns an int that is either MHD_NO or MHD_YES upon failure or not.
+ */
+static int answer_file_archive_bin_get_request(server_struct_t *server_struct, struct MHD_Connection *connection)
+{
+    hash_array_stream_t *stream = NULL;
+    backend_t *backend = server_struct->backend;
+    query_t *query = NULL;
+    gchar *message = NULL;
+    gchar *answer = NULL;
+    gchar *list = NULL;
+    json_t *root = NULL;
+    int success = MHD_NO;
+
+    if (backend->retrieve_data != NULL && backend->get_list_of_files != NULL)
+        {
+            query = get_query_from_connection(connection);
+
+            if (query->hostname != NULL)
+                {
+                    list = backend->get_list_of_files(server_struct, query);
+                    root = load_json(list);
+
+                    stream = new_hash_array_stream_t(server_struct, NULL);
+                    stream->archive = TRUE;
+                    stream->files = g_slist_reverse(extract_smeta_gslist_from_json_array(root));
+                    stream->next_file = stream->files;
+
+                    json_decref(root);
+                    free_variable(list);
+
+                    success = queue_hash_array_stream(connection, stream);
+                }
+            else
+                {
+                    message = g_strdup_printf(_("Malformed request: hostname: %s, uid: %s, gid: %s, owner: %s, group: %s"), \
+                                                query->hostname, query->uid, query->gid, query->owner, query->group);
+                    answer = answer_json_error_string(MHD_HTTP_BAD_REQUEST, message);
+                    free_variable(message);
+                    success = create_MHD_response(connection, answer, CT_JSON);
+                }
+
+            free_query_t(query);
+        }
+    else
+        {
+            message = g_strdup(_("This backend's missing a retrieve_data or a get_list_of_files function!"));
+            answer = answer_json_error_string(MHD_HTTP_NOT_IMPLEMENTED, message);
+            free_variable(message);
+            success = create_MHD_response(connection, answer, CT_JSON);
+        }
+
+    return success;
+}
+
+
+/**
+ * Gets all data from a list of hash obtained from X-Get-Hash-Array HTTP
+ * header. Kept for clients that do not know /Data/Hash_Array.bin.
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @returns a newlly allocated gchar * string that contains the anwser to be
+ *          sent back to the client (hopefully a json string containing
+ *          a hash (that is a fake one here), data and size of the data.
+ */
+static gchar *get_data_from_a_list_of_hashs(server_struct_t *server_struct, struct MHD_Connection *connection)
+{
+    gchar *answer = NULL;
+    hash_array_stream_t *stream = NULL;
+    hash_data_t *hash_data = NULL;
+    GByteArray *array = NULL;
+    guint size = 0;
+    gint64 span = 0;
+    guint8 *a_hash = NULL;
+
+
+    stream = new_hash_array_stream_t(server_struct, connection);
+
+    span = trace_begin();
+    array = g_byte_array_new();
+    while (load_next_hash_array_block(stream) == TRUE)
+        {
+            g_byte_array_append(array, stream->data, stream->length);
+            release_hash_array_block(stream);
+        }
+    free_hash_array_stream_t(stream);
+    trace_end(span, "Read all files");
+
+    span = trace_begin();
+
+    size = array->len;
+    a_hash = calculate_hash_for_string(array->data, size);
+    hash_data = new_hash_data_t_as_is((guchar *) g_byte_array_free(array, FALSE), size, a_hash, COMPRESS_NONE_TYPE, size);
     answer = convert_hash_data_t_to_string(hash_data);
     free_hash_data_t(hash_data);
 
-    end_clock(a_clock, "Transformed into a JSON string");
+    trace_end(span, "Transformed into a JSON string");
 
     return answer;
 }
@@ -403,22 +904,23 @@ static gchar *get_data_from_a_list_of_hashs(server_struct_t *server_struct, stru
 /**
  * Fills a json structure from GET statistics
  * @param get is the json structure to be filled with get statistics.
- * @param get_stats is the structure (req_get_t *) that contains all statistics
- *                  for GET http requests
+ * @param stats is the stats_t structure that contains all statistics.
  * @returns a json_t * filled with GET statistics.
  */
-json_t *fills_json_with_get_stats(json_t *get, req_get_t *get_stats)
+json_t *fills_json_with_get_stats(json_t *get, stats_t *stats)
 {
-    if (get != NULL && get_stats != NULL)
+    if (get != NULL && stats != NULL)
         {
-            insert_integer_value_into_json_root(get, "/Stats.json", get_stats->stats);
-            insert_integer_value_into_json_root(get, "/Version.json", get_stats->version);
-            insert_integer_value_into_json_root(get, "/Version", get_stats->verstxt);
-            insert_integer_value_into_json_root(get, "/File/List.json", get_stats->file_list);
-            insert_integer_value_into_json_root(get, "/Data/0xxxx.json", get_stats->data_hash);
-            insert_integer_value_into_json_root(get, "/Data/Hash_Array.json", get_stats->data_hash_array);
-            insert_integer_value_into_json_root(get, "/unknown.json", get_stats->unk);
-            insert_integer_value_into_json_root(get, "/unknown", get_stats->unktxt);
+            insert_integer_value_into_json_root(get, "/Stats.json", get_stats_counter(stats, STATS_GET_STATS));
+            insert_integer_value_into_json_root(get, "/Version.json", get_stats_counter(stats, STATS_GET_VERSION));
+            insert_integer_value_into_json_root(get, "/Version", get_stats_counter(stats, STATS_GET_VERSTXT));
+            insert_integer_value_into_json_root(get, "/File/List.json", get_stats_counter(stats, STATS_GET_FILE_LIST));
+            insert_integer_value_into_json_root(get, "/Data/0xxxx.json", get_stats_counter(stats, STATS_GET_DATA_HASH));
+            insert_integer_value_into_json_root(get, "/Data/Hash_Array.json", get_stats_counter(stats, STATS_GET_DATA_HASH_ARRAY));
+            insert_integer_value_into_json_root(get, "/Data/Hash_Array.bin", get_stats_counter(stats, STATS_GET_DATA_HASH_ARRAY_BIN));
+            insert_integer_value_into_json_root(get, "/File/Archive.bin", get_stats_counter(stats, STATS_GET_FILE_ARCHIVE_BIN));
+            insert_integer_value_into_json_root(get, "/unknown.json", get_stats_counter(stats, STATS_GET_UNK));
+            insert_integer_value_into_json_root(get, "/unknown", get_stats_counter(stats, STATS_GET_UNKTXT));
         }
 
     return get;
@@ -428,62 +930,109 @@ json_t *fills_json_with_get_stats(json_t *get, req_get_t *get_stats)
 /**
  * Fills a json structure from  POST statistics
  * @param post is the json structure to be filled with post statistics.
- * @param post_stats is the structure (req_post_t *) that contains all statistics
- *                  for POST http requests
+ * @param stats is the stats_t structure that contains all statistics.
  * @returns a json_t * filled with POST statistics.
  */
-json_t *fills_json_with_post_stats(json_t *post, req_post_t *post_stats)
+json_t *fills_json_with_post_stats(json_t *post, stats_t *stats)
 {
-    if (post != NULL && post_stats != NULL)
+    if (post != NULL && stats != NULL)
         {
-            insert_integer_value_into_json_root(post, "/Meta.json", post_stats->meta);
-            insert_integer_value_into_json_root(post, "/Data.json", post_stats->data);
-            insert_integer_value_into_json_root(post, "/Data_Array.json", post_stats->data_array);
-            insert_integer_value_into_json_root(post, "/Hash_Array.json", post_stats->hash_array);
-            insert_integer_value_into_json_root(post, "/unknown.json", post_stats->unk);
+            insert_integer_value_into_json_root(post, "/Meta.json", get_stats_counter(stats, STATS_POST_META));
+            insert_integer_value_into_json_root(post, "/Meta_Array.json", get_stats_counter(stats, STATS_POST_META_ARRAY));
+            insert_integer_value_into_json_root(post, "/Data.json", get_stats_counter(stats, STATS_POST_DATA));
+            insert_integer_value_into_json_root(post, "/Data_Array.json", get_stats_counter(stats, STATS_POST_DATA_ARRAY));
+            insert_integer_value_into_json_root(post, "/Data_Array.bin", get_stats_counter(stats, STATS_POST_DATA_ARRAY_BIN));
+            insert_integer_value_into_json_root(post, "/Hash_Array.json", get_stats_counter(stats, STATS_POST_HASH_ARRAY));
+            insert_integer_value_into_json_root(post, "/unknown.json", get_stats_counter(stats, STATS_POST_UNK));
         }
 
     return post;
 }
 
 
+/**
+ * Makes a json structure with a summary of every latency histogram
+ * (values are in microseconds).
+ * @param stats is the stats_t structure that contains all statistics.
+ * @returns a json_t * object with one object per histogram.
+ */
+static json_t *make_json_from_latencies(stats_t *stats)
+{
+    json_t *latencies = NULL;
+    json_t *one = NULL;
+    latency_t summary;
+    gint i = 0;
+
+    latencies = json_object();
+
+    for (i = 0; i < STATS_NB_LATENCIES; i++)
+        {
+            get_latency_summary(stats, i, &summary);
+
+            one = make_json_from_stats("count", summary.count);
+            insert_integer_value_into_json_root(one, "mean", summary.mean);
+            insert_integer_value_into_json_root(one, "p50", summary.p50);
+            insert_integer_value_into_json_root(one, "p90", summary.p90);
+            insert_integer_value_into_json_root(one, "p99", summary.p99);
+            insert_integer_value_into_json_root(one, "p99.9", summary.p999);
+            insert_integer_value_into_json_root(one, "max", summary.max);
+            insert_json_value_into_json_root(latencies, (gchar *) get_latency_name(i), one);
+        }
+
+    return latencies;
+}
+
+
 /**
  * Answers a json string containing all stats about the usage
  * of this server.
  * @param stats is the stats_t structure containing all stats
  *        to be returned.
+ * @param block_cache is the cache of blocks (may be NULL).
  * @todo Needs a refactoring
  */
-static gchar *answer_global_stats(stats_t *stats)
+static gchar *answer_global_stats(stats_t *stats, block_cache_t *block_cache)
 {
     json_t *root = NULL;
     json_t *get = NULL;
     json_t *post = NULL;
     json_t *unk = NULL;
     json_t *req = NULL;
+    json_t *cache = NULL;
     gchar *answer = NULL;
+    guint64 size = 0;
+    guint64 blocks = 0;
 
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL && stats->requests->post != NULL && stats->requests->unknown != NULL)
+    if (stats != NULL)
         {
             root = json_object();
 
-            get = make_json_from_stats("Total requests", stats->requests->get->nb_request);
-            get = fills_json_with_get_stats(get, stats->requests->get);
+            get = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_GET_REQUESTS));
+            get = fills_json_with_get_stats(get, stats);
 
-            post = make_json_from_stats("Total requests", stats->requests->post->nb_request);
-            fills_json_with_post_stats(post, stats->requests->post);
+            post = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_POST_REQUESTS));
+            fills_json_with_post_stats(post, stats);
 
-            unk = make_json_from_stats("Total requests", stats->requests->unknown->nb_request);
-            req = make_json_from_stats("Total requests", stats->requests->nb_request);
+            unk = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_UNK_REQUESTS));
+            req = make_json_from_stats("Total requests", get_stats_counter(stats, STATS_REQUESTS));
             insert_json_value_into_json_root(req, "GET", get);
             insert_json_value_into_json_root(req, "POST", post);
             insert_json_value_into_json_root(req, "Unknown", unk);
             insert_json_value_into_json_root(root, "Requests", req);
 
-            insert_integer_value_into_json_root(root, "files", stats->nb_files);
-            insert_integer_value_into_json_root(root, "total size", stats->nb_total_bytes);
-            insert_integer_value_into_json_root(root, "dedup size", stats->nb_dedup_bytes);
-            insert_integer_value_into_json_root(root, "meta data size", stats->nb_meta_bytes);
+            insert_integer_value_into_json_root(root, "files", get_stats_counter(stats, STATS_FILES));
+            insert_integer_value_into_json_root(root, "total size", get_stats_counter(stats, STATS_TOTAL_BYTES));
+            insert_integer_value_into_json_root(root, "dedup size", get_stats_counter(stats, STATS_DEDUP_BYTES));
+            insert_integer_value_into_json_root(root, "meta data size", get_stats_counter(stats, STATS_META_BYTES));
+
+            block_cache_get_usage(block_cache, &size, &blocks);
+            cache = make_json_from_stats("hits", get_stats_counter(stats, STATS_CACHE_HITS));
+            insert_integer_value_into_json_root(cache, "misses", get_stats_counter(stats, STATS_CACHE_MISSES));
+            insert_integer_value_into_json_root(cache, "size", size);
+            insert_integer_value_into_json_root(cache, "blocks", blocks);
+            insert_json_value_into_json_root(root, "block cache", cache);
+
+            insert_json_value_into_json_root(root, "latencies (us)", make_json_from_latencies(stats));
 
             answer = json_dumps(root, 0);
         }
@@ -508,6 +1057,7 @@ static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connect
     gchar *answer = NULL;
     gchar *message = NULL;
     gchar *hash = NULL;
+    gchar *epoch = NULL;
     size_t hlen = 0;
 
     g_assert_nonnull(server_struct);
@@ -515,13 +1065,20 @@ static gchar *get_json_answer(server_struct_t *server_struct, struct MHD_Connect
     if (g_str_has_prefix(url, "/Version.json"))
         {
             add_one_to_get_url_version(server_struct->stats, FALSE);
-            answer = convert_version_to_json(PROGRAM_NAME, SERVER_DATE, SERVER_VERSION, SERVER_AUTHORS, SERVER_LICENSE);
+
+            if (server_struct->backend != NULL && server_struct->backend->get_epoch != NULL)
+                {
+                    epoch = server_struct->backend->get_epoch(server_struct);
+                }
+
+            answer = convert_version_to_json(PROGRAM_NAME, SERVER_DATE, SERVER_VERSION, SERVER_AUTHORS, SERVER_LICENSE, epoch);
+            free_variable(epoch);
         }
     else if (g_str_has_prefix(url, "/Stats.json"))
         {
             /* Answer a json string with stats on server's usage */
             add_one_to_get_url_stats(server_struct->stats);
-            answer = answer_global_stats(server_struct->stats);
+            answer = answer_global_stats(server_struct->stats, server_struct->block_cache);
         }
     else if (g_str_has_prefix(url, "/File/List.json"))
         {
@@ -637,6 +1194,83 @@ static int create_MHD_response(struct MHD_Connection *connection, gchar *answer,
 }
 
 
+/**
+ * Answers "503 Service Unavailable" with a Retry-After header: clients
+ * see an error and keep the request to send it again later.
+ * @param connection is the connection in MHD
+ * @returns MHD_YES if the response has been queued, MHD_NO otherwise.
+ */
+static int create_MHD_retry_later_response(struct MHD_Connection *connection)
+{
+    struct MHD_Response *response = NULL;
+    gchar *answer = NULL;
+    gchar *retry = NULL;
+    int success = MHD_NO;
+
+    answer = answer_json_error_string(MHD_HTTP_SERVICE_UNAVAILABLE, _("Server is busy, retry later\n"));
+    retry = g_strdup_printf("%d", SERVER_RETRY_AFTER);
+
+    response = MHD_create_response_from_buffer(strlen(answer), (void *) answer, MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header(response, "Content-Type", CT_PLAIN);
+    MHD_add_response_header(response, "Retry-After", retry);
+    success = MHD_queue_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, response);
+    MHD_destroy_response(response);
+
+    free_variable(retry);
+
+    return success;
+}
+
+
+/**
+ * @param url is the requested url of a GET request.
+ * @returns the latency histogram (STATS_LATENCY_GET_STATS...) where
+ *          the request for this url has to be counted.
+ */
+static gint get_latency_of_get_url(const char *url)
+{
+    gint latency = STATS_LATENCY_GET_UNK;
+
+    if (g_str_has_prefix(url, "/Data/Hash_Array.bin"))
+        {
+            latency = STATS_LATENCY_GET_DATA_HASH_ARRAY_BIN;
+        }
+    else if (g_str_has_prefix(url, "/File/Archive.bin"))
+        {
+            latency = STATS_LATENCY_GET_FILE_ARCHIVE_BIN;
+        }
+    else if (g_str_has_suffix(url, ".json") == FALSE)
+        {
+            if (g_strcmp0(url, "/Version") == 0)
+                {
+                    latency = STATS_LATENCY_GET_VERSION;
+                }
+        }
+    else if (g_str_has_prefix(url, "/Version.json"))
+        {
+            latency = STATS_LATENCY_GET_VERSION;
+        }
+    else if (g_str_has_prefix(url, "/Stats.json"))
+        {
+            latency = STATS_LATENCY_GET_STATS;
+        }
+    else if (g_str_has_prefix(url, "/File/List.json"))
+        {
+            latency = STATS_LATENCY_GET_FILE_LIST;
+        }
+    else if (g_str_has_prefix(url, "/Data/Hash_Array.json"))
+        {
+            latency = STATS_LATENCY_GET_DATA_HASH_ARRAY;
+        }
+    else if (g_str_has_prefix(url, "/Data/"))
+        {
+            latency = STATS_LATENCY_GET_DATA_HASH;
+        }
+
+    return latency;
+}
+
+
 /**
  * Function to process get requests received from clients.
  * @param server_struct is the main structure for the server.
@@ -652,6 +1286,7 @@ static int process_get_request(server_struct_t *server_struct, struct MHD_Connec
     gchar *answer = NULL;
     gchar *content_type = NULL;
     gchar * message = NULL;
+    gint64 start = 0;
 
     g_assert_nonnull(server_struct);
 
@@ -664,6 +1299,7 @@ static int process_get_request(server_struct_t *server_struct, struct MHD_Connec
         }
     else
         {
+            start = g_get_monotonic_time();
             add_one_get_request(server_struct->stats);
 
             if (get_debug_mode() == TRUE)
@@ -672,31 +1308,44 @@ static int process_get_request(server_struct_t *server_struct, struct MHD_Connec
                     print_headers(connection);
                 }
 
-            if (g_str_has_suffix(url, ".json"))
-                { /* A json format answer was requested */
-                    answer = get_json_answer(server_struct, connection, url);
-                    content_type = CT_JSON;
-                }
-            else
-                { /* An "unformatted" answer was requested */
-                    answer = get_unformatted_answer(server_struct, url);
-                    content_type = CT_PLAIN;
-                }
-
             /* reset when done */
             *con_cls = NULL;
 
-            if (answer == NULL)
-                {
-                    message = g_strdup_printf(_("Error: could not process GET request for url: %s\n"), url);
-                    answer = answer_json_error_string(MHD_HTTP_INTERNAL_SERVER_ERROR, message);
-                    free_variable(message);
+            if (g_str_has_prefix(url, "/Data/Hash_Array.bin"))
+                { /* A streamed binary answer was requested */
+                    add_one_to_get_url_data_hash_array_bin(server_struct->stats);
+                    success = answer_hash_array_bin_get_request(server_struct, connection);
+                }
+            else if (g_str_has_prefix(url, "/File/Archive.bin"))
+                { /* A streamed archive of files was requested */
+                    add_one_to_get_url_file_archive_bin(server_struct->stats);
+                    success = answer_file_archive_bin_get_request(server_struct, connection);
                 }
+            else
+                {
+                    if (g_str_has_suffix(url, ".json"))
+                        { /* A json format answer was requested */
+                            answer = get_json_answer(server_struct, connection, url);
+                            content_type = CT_JSON;
+                        }
+                    else
+                        { /* An "unformatted" answer was requested */
+                            answer = get_unformatted_answer(server_struct, url);
+                            content_type = CT_PLAIN;
+                        }
 
-            /* Do not free answer variable as MHD will do it for us ! */
-            success = create_MHD_response(connection, answer, content_type);
+                    if (answer == NULL)
+                        {
+                            message = g_strdup_printf(_("Error: could not process GET request for url: %s\n"), url);
+                            answer = answer_json_error_string(MHD_HTTP_INTERNAL_SERVER_ERROR, message);
+                            free_variable(message);
+                        }
 
+                    /* Do not free answer variable as MHD will do it for us ! */
+                    success = create_MHD_response(connection, answer, content_type);
+                }
 
+            add_latency(server_struct->stats, get_latency_of_get_url(url), g_get_monotonic_time() - start);
         }
 
     return success;
@@ -704,36 +1353,79 @@ static int process_get_request(server_struct_t *server_struct, struct MHD_Connec
 }
 
 
+/**
+ * @param connection is the connection in MHD
+ * @returns TRUE if the client tells (with the X-Pending-List header)
+ *          that it asks again about hashs of a "pending_list".
+ */
+static gboolean accepts_pending_list(struct MHD_Connection *connection)
+{
+    return (MHD_lookup_connection_value(connection, MHD_HEADER_KIND, X_PENDING_LIST) != NULL);
+}
+
+
 /**
  * Selects hashs that are needed by invoking the backend function if it
- * exists and returns a json array.
+ * exists and returns a json array. Hashs that are waiting to be stored
+ * are not asked again. Hashs that another client has been asked for are
+ * not asked either but are returned in pending: the client has to ask
+ * about them again later (that other client may never send them).
  * @param server_struct is the main structure for the server.
- * @param
+ * @param hash_data_list is the list of hashs that the client asks for.
+ * @param[in,out] pending is NULL when the client does not understand
+ *             "pending_list" (hashs promised by another client are then
+ *             asked to this one as well). Otherwise *pending is set to a
+ *             json_t * array of hashs promised by another client or to
+ *             NULL if there is none.
  * @returns a json_t * array of needed hashs that may be freed when no
  *          longer needed.
  */
-static json_t *find_needed_hashs(server_struct_t *server_struct, GList *hash_data_list)
+static json_t *find_needed_hashs(server_struct_t *server_struct, GList *hash_data_list, json_t **pending)
 {
     json_t *array = NULL;   /** json_t *array is the array that will receive base64 encoded needed hashs */
     GList *needed = NULL;   /** GList that contains needed hashs as answered by the backend if any       */
+    GList *promised = NULL; /** GList that contains needed hashs promised by another client              */
+    gint64 start = 0;
 
     /**
      * Creating a json_t * array with the hashs that are needed. If
      * the selected backend does not have a build_needed_hash_list
-     * function we are returning the whole hash_data_list !
+     * function we are returning the whole hash_data_list ! Blocks of
+     * zeros (zero hashs) are never needed: they are not stored.
      */
     g_assert_nonnull(server_struct);
     g_assert_nonnull(server_struct->backend);
 
     if (server_struct->backend->build_needed_hash_list != NULL)
         {
+            start = g_get_monotonic_time();
             needed = server_struct->backend->build_needed_hash_list(server_struct, hash_data_list);
-            array = convert_hash_list_to_json(needed);
-            g_list_free_full(needed, free_hdt_struct);
+            add_latency(server_struct->stats, STATS_LATENCY_BUILD_NEEDED_HASH_LIST, g_get_monotonic_time() - start);
+        }
+    else
+        {
+            needed = g_list_copy_deep(hash_data_list, copy_only_hash, NULL);
+        }
+
+    needed = remove_zero_hashs(needed);
+
+    if (pending != NULL)
+        {
+            needed = inflight_reserve_needed(server_struct->inflight, needed, &promised);
+            *pending = NULL;
         }
     else
         {
-            array = convert_hash_list_to_json(hash_data_list);
+            needed = inflight_reserve_needed(server_struct->inflight, needed, NULL);
+        }
+
+    array = convert_hash_list_to_json(needed);
+    g_list_free_full(needed, free_hdt_struct);
+
+    if (promised != NULL)
+        {
+            *pending = convert_hash_list_to_json(promised);
+            g_list_free_full(promised, free_hdt_struct);
         }
 
     return array;
@@ -755,6 +1447,8 @@ static int answer_meta_json_post_request(server_struct_t *server_struct, struct
     gchar *answer = NULL;             /** gchar *answer : Do not free answer variable as MHD will do it for us !       */
     json_t *root = NULL;              /** json_t *root is the root that will contain all meta data json formatted      */
     json_t *array = NULL;             /** json_t *array is the array that will receive base64 encoded hashs            */
+    json_t *pending = NULL;           /** json_t *pending is the array of needed hashs promised by another client     */
+    GList *hash_data_list = NULL;     /** GList *hash_data_list is made from the hashs of the file for the backend    */
 
     smeta = convert_json_to_smeta_data((gchar *)received_data);
 
@@ -767,7 +1461,9 @@ static int answer_meta_json_post_request(server_struct_t *server_struct, struct
 
             if (smeta->data_sent == FALSE)
                 {
-                    array = find_needed_hashs(server_struct, smeta->meta->hash_data_list);
+                    hash_data_list = make_hash_data_list_from_hash_array(smeta->meta->hashs, smeta->meta->nb_hashs);
+                    array = find_needed_hashs(server_struct, hash_data_list, accepts_pending_list(connection) ? &pending : NULL);
+                    g_list_free_full(hash_data_list, free_hdt_struct);
                 }
             else
                 {
@@ -776,6 +1472,8 @@ static int answer_meta_json_post_request(server_struct_t *server_struct, struct
 
             root = json_object();
             insert_json_value_into_json_root(root, "hash_list", array);
+            /* Only when some needed hashs are promised by another client */
+            insert_json_value_into_json_root(root, "pending_list", pending);
             answer = json_dumps(root, 0);
             json_decref(root);
 
@@ -796,6 +1494,92 @@ static int answer_meta_json_post_request(server_struct_t *server_struct, struct
 }
 
 
+/**
+ * Answers /Meta_Array.json POST request by storing the meta data of
+ * every file of the "file_list" array and answering to the client the
+ * union of the hashs needed for all those files.
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @param received_data is a guchar * string to the data that was received
+ *        by the POST request.
+ * @param length is the total length of POST request in bytes
+ */
+static int answer_meta_array_json_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, guchar *received_data, guint64 length)
+{
+    GSList *smeta_list = NULL;        /** GSList *smeta_list is the list of received server_meta_data_t *            */
+    GSList *iter = NULL;
+    GList *hash_data_list = NULL;     /** GList *hash_data_list is made from the hashs of all files                 */
+    server_meta_data_t *smeta = NULL;
+    gchar *answer = NULL;             /** gchar *answer : Do not free answer variable as MHD will do it for us !       */
+    json_t *root = NULL;
+    json_t *array = NULL;
+    json_t *pending = NULL;
+
+    root = load_json((gchar *) received_data);
+
+    if (root != NULL)
+        {
+            smeta_list = g_slist_reverse(extract_smeta_gslist_from_json_array(root));
+            json_decref(root);
+
+            print_debug(_("Received meta data (%zd bytes) for %u files\n"), length, g_slist_length(smeta_list));
+
+            for (iter = smeta_list; iter != NULL; iter = g_slist_next(iter))
+                {
+                    smeta = iter->data;
+
+                    if (smeta != NULL && smeta->meta != NULL)
+                        {
+                            add_one_saved_file(server_struct->stats);
+                            add_file_size_to_total_size(server_struct->stats, smeta->meta->size);
+
+                            if (smeta->data_sent == FALSE)
+                                {
+                                    hash_data_list = g_list_concat(hash_data_list, make_hash_data_list_from_hash_array(smeta->meta->hashs, smeta->meta->nb_hashs));
+                                }
+                        }
+                }
+
+            /* backends answer each needed hash only once */
+            array = find_needed_hashs(server_struct, hash_data_list, accepts_pending_list(connection) ? &pending : NULL);
+            g_list_free_full(hash_data_list, free_hdt_struct);
+
+            root = json_object();
+            insert_json_value_into_json_root(root, "hash_list", array);
+            /* Only when some needed hashs are promised by another client */
+            insert_json_value_into_json_root(root, "pending_list", pending);
+            answer = json_dumps(root, 0);
+            json_decref(root);
+
+            /**
+             * Sending every smeta into the queue. smeta are freed by the
+             * meta thread and should not be used after this point.
+             */
+            for (iter = smeta_list; iter != NULL; iter = g_slist_next(iter))
+                {
+                    smeta = iter->data;
+
+                    if (smeta != NULL && smeta->meta != NULL)
+                        {
+                            g_async_queue_push(server_struct->meta_queue, smeta);
+                        }
+                    else
+                        {
+                            free_smeta_data_t(smeta);
+                        }
+                }
+
+            g_slist_free(smeta_list);
+        }
+    else
+        {
+            answer = answer_json_error_string(MHD_HTTP_INTERNAL_SERVER_ERROR, _("Error: could not convert json to metadata\n"));
+        }
+
+    return create_MHD_response(connection, answer, CT_JSON);
+}
+
+
 /**
  * Answers /Hash_Array.json POST request by answering to the client needed
  * hashs
@@ -809,6 +1593,7 @@ static int answer_hash_array_post_request(server_struct_t *server_struct, struct
     gchar *answer = NULL;         /** gchar *answer : Do not free answer variable as MHD will do it for us !  */
     json_t *root = NULL;          /** json_t *root is the root that will contain all meta data json formatted */
     json_t *array = NULL;         /** json_t *array is the array that will receive base64 encoded hashs       */
+    json_t *pending = NULL;       /** json_t *pending is the array of needed hashs promised by another client */
     GList *hash_data_list = NULL;
     gchar *content_type = NULL;
 
@@ -824,10 +1609,12 @@ static int answer_hash_array_post_request(server_struct_t *server_struct, struct
             /* strlen here is possible because received_data is a text base64 encoded structure */
             print_debug(_("Received hash array of %zd bytes size\n"), strlen((const gchar *)received_data));
 
-            array = find_needed_hashs(server_struct, hash_data_list);
+            array = find_needed_hashs(server_struct, hash_data_list, accepts_pending_list(connection) ? &pending : NULL);
 
             root = json_object();
             insert_json_value_into_json_root(root, "hash_list", array);
+            /* Only when some needed hashs are promised by another client */
+            insert_json_value_into_json_root(root, "pending_list", pending);
             answer = json_dumps(root, 0);
             json_decref(root);
             g_list_free_full(hash_data_list, free_hdt_struct);
@@ -893,10 +1680,10 @@ static int answer_data_post_request(server_struct_t *server_struct, struct MHD_C
 
     /**
      * Sending received_data into the queue in order to be treated by
-     * the corresponding thread. hash_data is freed by data_thread
+     * the corresponding worker. hash_data is freed by the worker
      * and should not be used after this "call" here.
      */
-    g_async_queue_push(server_struct->data_queue, hash_data);
+    data_workers_push(server_struct->workers, hash_data);
 
     /**
      * creating an answer for the client to say that everything went Ok!
@@ -917,20 +1704,44 @@ static int answer_data_post_request(server_struct_t *server_struct, struct MHD_C
 static int answer_data_array_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, guchar *received_data)
 {
     gchar *answer = NULL;                   /** gchar *answer : Do not free answer variable as MHD will do it for us ! */
-    hash_data_t *hash_data = NULL;
     int success = MHD_NO;
-    a_clock_t *elapsed = NULL;
+    gint64 elapsed = 0;
     json_t *root = NULL;
     GList *hash_data_list = NULL;
-    GList *head = NULL;
-    gboolean debug = FALSE;
 
-    elapsed = new_clock_t();
+    elapsed = trace_begin();
     root = load_json((gchar *)received_data);
-    end_clock(elapsed, "load_json");
+    trace_end(elapsed, "load_json");
     hash_data_list = extract_glist_from_array(root, "data_array", FALSE);
-    head = hash_data_list;
     json_decref(root);
+
+    push_hash_data_list_to_data_queue(server_struct, hash_data_list);
+
+    /**
+     * creating an answer for the client to say that everything went Ok!
+     */
+
+    answer = answer_json_success_string(MHD_HTTP_OK, _("Ok!"));
+    success = create_MHD_response(connection, answer, CT_PLAIN);
+
+    return success;
+
+}
+
+
+/**
+ * Sends every hash_data_t structure of the list to the data workers in
+ * order to be stored. The list itself is freed but not its elements
+ * (data workers will free them).
+ * @param server_struct is the main structure for the server.
+ * @param hash_data_list is a GList of hash_data_t structures.
+ */
+static void push_hash_data_list_to_data_queue(server_struct_t *server_struct, GList *hash_data_list)
+{
+    GList *head = hash_data_list;
+    hash_data_t *hash_data = NULL;
+    gboolean debug = FALSE;
+
     debug = get_debug_mode();
 
     while (hash_data_list != NULL)
@@ -944,22 +1755,66 @@ static int answer_data_array_post_request(server_struct_t *server_struct, struct
                     print_received_data_for_hash(hash_data->hash, hash_data->read);
                 }
 
-            /** Sending hash_data into the queue. */
-            g_async_queue_push(server_struct->data_queue, hash_data);
+            /** Sending hash_data to its worker (waits if queues are full). */
+            data_workers_push(server_struct->workers, hash_data);
             hash_data_list = g_list_next(hash_data_list);
         }
 
     g_list_free(head);
+}
 
-    /**
-     * creating an answer for the client to say that everything went Ok!
-     */
 
-    answer = answer_json_success_string(MHD_HTTP_OK, _("Ok!"));
+/**
+ * Answers /Data_Array.bin POST request by answering to the client 'Ok'.
+ * Blocks have already been decoded and sent to the data queue while
+ * they were received.
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @param decoder is the decoder that decoded the request.
+ * @param length is the length in bytes of the request.
+ */
+static int answer_data_array_bin_post_request(server_struct_t *server_struct, struct MHD_Connection *connection, binary_array_decoder_t *decoder, guint64 length)
+{
+    gchar *answer = NULL;                   /** gchar *answer : Do not free answer variable as MHD will do it for us ! */
+    int success = MHD_NO;
+
+    if (is_binary_array_decoder_complete(decoder) == TRUE)
+        {
+            answer = answer_json_success_string(MHD_HTTP_OK, _("Ok!"));
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: malformed /Data_Array.bin request (%" G_GUINT64_FORMAT " bytes)\n"), length);
+            answer = answer_json_error_string(MHD_HTTP_BAD_REQUEST, _("Malformed binary data array!\n"));
+        }
+
     success = create_MHD_response(connection, answer, CT_PLAIN);
 
     return success;
+}
+
+
+/**
+ * Function that answers to a streamed POST request (ie one whose data
+ * has been decoded while it was received).
+ * @param server_struct is the main structure for the server.
+ * @param connection is the connection in MHD
+ * @param url is the requested url
+ * @param pp is the upload_t structure of this request.
+ */
+static int process_received_binary_data(server_struct_t *server_struct, struct MHD_Connection *connection, const char *url, upload_t *pp)
+{
+    int success = MHD_NO;
+
+    add_one_post_request(server_struct->stats);
+
+    if (g_str_has_prefix(url, "/Data_Array.bin"))
+        {
+            add_one_to_post_url_data_array_bin(server_struct->stats);
+            success = answer_data_array_bin_post_request(server_struct, connection, pp->decoder, pp->pos);
+        }
 
+    return success;
 }
 
 
@@ -988,6 +1843,11 @@ static int process_received_data(server_struct_t *server_struct, struct MHD_Conn
             add_length_and_one_to_post_url_meta(server_struct->stats, length);
             success = answer_meta_json_post_request(server_struct, connection, received_data, length);
         }
+    else if (g_str_has_prefix(url, "/Meta_Array.json") && received_data != NULL)
+        {
+            add_length_and_one_to_post_url_meta_array(server_struct->stats, length);
+            success = answer_meta_array_json_post_request(server_struct, connection, received_data, length);
+        }
     else if (g_str_has_prefix(url, "/Hash_Array.json") && received_data != NULL)
         {
             add_one_to_post_url_hash_array(server_struct->stats);
@@ -1017,6 +1877,54 @@ static int process_received_data(server_struct_t *server_struct, struct MHD_Conn
 }
 
 
+/**
+ * @param url is the requested url of a POST request.
+ * @returns the latency histogram (STATS_LATENCY_POST_META...) where the
+ *          request for this url has to be counted.
+ */
+static gint get_latency_of_post_url(const char *url)
+{
+    gint latency = STATS_LATENCY_POST_UNK;
+
+    if (g_str_has_prefix(url, "/Meta.json"))
+        {
+            latency = STATS_LATENCY_POST_META;
+        }
+    else if (g_str_has_prefix(url, "/Meta_Array.json"))
+        {
+            latency = STATS_LATENCY_POST_META_ARRAY;
+        }
+    else if (g_str_has_prefix(url, "/Hash_Array.json"))
+        {
+            latency = STATS_LATENCY_POST_HASH_ARRAY;
+        }
+    else if (g_str_has_prefix(url, "/Data.json"))
+        {
+            latency = STATS_LATENCY_POST_DATA;
+        }
+    else if (g_str_has_prefix(url, "/Data_Array.json"))
+        {
+            latency = STATS_LATENCY_POST_DATA_ARRAY;
+        }
+    else if (g_str_has_prefix(url, "/Data_Array.bin"))
+        {
+            latency = STATS_LATENCY_POST_DATA_ARRAY_BIN;
+        }
+
+    return latency;
+}
+
+
+/**
+ * @param url is the requested url of a POST request.
+ * @returns TRUE if the request carries data blocks for the data workers.
+ */
+static gboolean is_data_post_url(const char *url)
+{
+    return (g_str_has_prefix(url, "/Data.json") || g_str_has_prefix(url, "/Data_Array.json") || g_str_has_prefix(url, "/Data_Array.bin"));
+}
+
+
 /**
  * @param connection is the connection in MHD
  * @param header is the header to look for.
@@ -1050,7 +1958,45 @@ static guint64 get_header_content_length(struct MHD_Connection *connection, gcha
 
 
 /**
- * Function to process post requests.
+ * Frees an upload_t structure
+ * @param pp is the upload_t structure to be freed.
+ */
+static void free_upload_t(upload_t *pp)
+{
+    if (pp != NULL)
+        {
+            free_binary_array_decoder_t(pp->decoder);
+            free_variable(pp->buffer);
+            free_variable(pp);
+        }
+}
+
+
+/**
+ * In "pool" mode the threads of the pool must not wait for the data
+ * workers: requests carrying data are refused while the data queues are
+ * full.
+ * @param server_struct is the main structure for the server.
+ * @param url is the requested url
+ * @returns TRUE if url carries data that must be refused now.
+ */
+static gboolean must_refuse_data(server_struct_t *server_struct, const char *url)
+{
+    return (server_struct->workers != NULL && server_struct->workers->wait == FALSE && is_data_post_url(url) == TRUE && data_workers_are_full(server_struct->workers) == TRUE);
+}
+
+
+/**
+ * Function to process post requests. Binary requests (/Data_Array.bin)
+ * are decoded while they are received and each block is sent to the
+ * data queue as soon as it is complete: memory used by such requests
+ * is bounded by the size of one block. Other requests are buffered and
+ * processed once complete. In "pool" mode requests carrying data are
+ * refused (503) while the data queues are full (see must_refuse_data()).
+ * This is checked when a request begins, before each received part of
+ * a binary request (the rest of the request is then discarded) and
+ * before a buffered request is processed: the queues may only exceed
+ * their bound by one part of a request per connection.
  * @param server_struct is the main structure for the server.
  * @param connection is the connection in MHD
  * @param url is the requested url
@@ -1065,28 +2011,74 @@ static int process_post_request(server_struct_t *server_struct, struct MHD_Conne
     int success = MHD_NO;
     upload_t *pp = (upload_t *) *con_cls;
     guint64 len = 0;
+    GList *hash_data_list = NULL;
 
     /* print_debug("%ld, %s, %p\n", *upload_data_size, url, pp); */ /* This is for early debug only ! */
 
-    if (pp == NULL)
+    if (pp == NULL && must_refuse_data(server_struct, url) == TRUE)
+        {
+            print_debug(_("Data queues are full: refusing POST url %s\n"), url);
+            success = create_MHD_retry_later_response(connection);
+        }
+    else if (pp == NULL)
         {
             /* print_headers(connection); */ /* Used for debugging */
             /* Initializing the structure at first connection       */
-            len = get_header_content_length(connection, "Content-Length", DEFAULT_SERVER_BUFFER_SIZE);
             pp = (upload_t *) g_malloc(sizeof(upload_t));
             pp->pos = 0;
-            pp->buffer = g_malloc(sizeof(gchar) * (len + 1));  /* not using g_malloc0 here because it's 1000 times slower */
             pp->number = 0;
+            pp->start = g_get_monotonic_time();
+            pp->refused = FALSE;
+
+            if (g_str_has_prefix(url, "/Data_Array.bin"))
+                {
+                    pp->buffer = NULL;
+                    pp->size = 0;
+                    pp->decoder = new_binary_array_decoder_t();
+                }
+            else
+                {
+                    len = get_header_content_length(connection, "Content-Length", DEFAULT_SERVER_BUFFER_SIZE);
+                    pp->buffer = g_malloc(sizeof(gchar) * (len + 1));  /* not using g_malloc0 here because it's 1000 times slower */
+                    pp->size = len;
+                    pp->decoder = NULL;
+                }
+
             *con_cls = pp;
 
             success = MHD_YES;
         }
     else if (*upload_data_size != 0)
         {
-            /* Getting data whatever they are */
-            memcpy(pp->buffer + pp->pos, upload_data, *upload_data_size);
-            pp->pos = pp->pos + *upload_data_size;
+            if (pp->decoder != NULL)
+                {
+                    if (pp->refused == FALSE && must_refuse_data(server_struct, url) == TRUE)
+                        {
+                            print_debug(_("Data queues are full: discarding the rest of POST url %s\n"), url);
+                            pp->refused = TRUE;
+                        }
+
+                    if (pp->refused == FALSE)
+                        {
+                            /* Decoding data as it arrives */
+                            hash_data_list = feed_binary_array_decoder(pp->decoder, (const guchar *) upload_data, *upload_data_size);
+                            push_hash_data_list_to_data_queue(server_struct, hash_data_list);
+                        }
+                }
+            else
+                {
+                    if (pp->pos + *upload_data_size > pp->size)
+                        {
+                            /* Content-Length was wrong or missing */
+                            pp->size = MAX(pp->size * 2, pp->pos + *upload_data_size);
+                            pp->buffer = g_realloc(pp->buffer, pp->size + 1);
+                        }
+
+                    /* Getting data whatever they are */
+                    memcpy(pp->buffer + pp->pos, upload_data, *upload_data_size);
+                }
 
+            pp->pos = pp->pos + *upload_data_size;
             pp->number = pp->number + 1;
 
             *con_cls = pp;
@@ -1098,7 +2090,6 @@ static int process_post_request(server_struct_t *server_struct, struct MHD_Conne
         {
             /* reset when done */
             *con_cls = NULL;
-            pp->buffer[pp->pos] = '\0';
 
             if (get_debug_mode() == TRUE)
                 {
@@ -1106,12 +2097,26 @@ static int process_post_request(server_struct_t *server_struct, struct MHD_Conne
                     print_headers(connection);
                 }
 
+            if (pp->refused == TRUE || (pp->decoder == NULL && must_refuse_data(server_struct, url) == TRUE))
+                {
+                    /* The client keeps the whole request and sends it again later */
+                    print_debug(_("Data queues are full: refusing POST url %s\n"), url);
+                    success = create_MHD_retry_later_response(connection);
+                }
+            else if (pp->decoder != NULL)
+                {
+                    success = process_received_binary_data(server_struct, connection, url, pp);
+                }
+            else
+                {
+                    pp->buffer[pp->pos] = '\0';
 
-            /* Do something with received_data */
-            success = process_received_data(server_struct, connection, url, pp->buffer, pp->pos);
+                    /* Do something with received_data */
+                    success = process_received_data(server_struct, connection, url, pp->buffer, pp->pos);
+                }
 
-            free_variable(pp->buffer);
-            free_variable(pp);
+            add_latency(server_struct->stats, get_latency_of_post_url(url), g_get_monotonic_time() - pp->start);
+            free_upload_t(pp);
         }
 
     return success;
@@ -1179,6 +2184,8 @@ static int ahc(void *cls, struct MHD_Connection *connection, const char *url, co
 
 /**
  * Thread whose aim is to store meta-data according to the selected backend
+ * until it pops server_struct (the stop request sent by
+ * free_server_struct_t()).
  * @param data : server_struct_t * structure.
  * @returns NULL to fullfill the template needed to create a GThread
  */
@@ -1186,6 +2193,8 @@ static gpointer meta_data_thread(gpointer user_data)
 {
     server_struct_t *server_struct = user_data;
     server_meta_data_t *smeta = NULL;
+    gpointer item = NULL;
+    gboolean stop = FALSE;
 
     g_assert_nonnull(server_struct);
     g_assert_nonnull(server_struct->backend);
@@ -1195,11 +2204,16 @@ static gpointer meta_data_thread(gpointer user_data)
             if (server_struct->backend->store_smeta != NULL)
                 {
 
-                    while (TRUE)
+                    while (stop == FALSE)
                         {
-                            smeta = g_async_queue_pop(server_struct->meta_queue);
+                            item = g_async_queue_pop(server_struct->meta_queue);
+                            smeta = (server_meta_data_t *) item;
 
-                            if (smeta != NULL && smeta->meta != NULL)
+                            if (item == server_struct)
+                                {
+                                    stop = TRUE;
+                                }
+                            else if (smeta != NULL && smeta->meta != NULL)
                                 {
                                     print_debug(_("meta_data_thread: received from %s meta for file %s\n"), smeta->hostname, smeta->meta->name);
                                     server_struct->backend->store_smeta(server_struct, smeta);
@@ -1225,50 +2239,6 @@ static gpointer meta_data_thread(gpointer user_data)
 }
 
 
-/**
- * Thread whose aim is to store data according to the selected backend
- * @param data : server_struct_t * structure.
- * @returns NULL to fullfill the template needed to create a GThread
- */
-static gpointer data_thread(gpointer user_data)
-{
-    server_struct_t *dt_server_struct = user_data;
-    hash_data_t *hash_data = NULL;
-
-    g_assert_nonnull(dt_server_struct);
-    g_assert_nonnull(dt_server_struct->backend);
-
-    if (dt_server_struct->meta_queue != NULL)
-        {
-
-            if (dt_server_struct->backend->store_data != NULL)
-                {
-
-                    while (TRUE)
-                        {
-                            hash_data = g_async_queue_pop(dt_server_struct->data_queue);
-
-                            if (hash_data != NULL)
-                                {
-                                    dt_server_struct->backend->store_data(dt_server_struct, hash_data);
-                                }
-                        }
-                }
-            else
-                {
-                    print_error(__FILE__, __LINE__, _("Error: no data store backend defined, data's thread terminating...\n"));
-                }
-
-        }
-    else
-        {
-            print_error(__FILE__, __LINE__, _("Error while trying to launch data thread"));
-        }
-
-    return NULL;
-}
-
-
 /**
  * Installs signals traps in order to be able to close the program as
  * as cleanly as we can.
@@ -1294,6 +2264,36 @@ static void install_server_signal_traps(server_struct_t *server_struct)
 }
 
 
+/**
+ * Starts libmicrohttpd's daemon in the selected mode. In "pool" mode a
+ * fixed number of threads serve every connection: data blocks are
+ * handed to the data workers (requests are refused while their queues
+ * are full) and GET answers of many blocks are streamed one block at a
+ * time. The threads of the pool still read the backend themselves to
+ * answer GET requests of data (get_data_from_a_list_of_hashs()) and to
+ * tell which hashs are needed (build_needed_hash_list()): a slow
+ * backend slows these requests down and then every connection.
+ * @param server_struct is the main structure of the program.
+ * @returns the MHD_Daemon started or NULL on error.
+ */
+static struct MHD_Daemon *start_mhd_daemon(server_struct_t *server_struct)
+{
+    struct MHD_Daemon *d = NULL;
+    options_t *opt = server_struct->opt;
+
+    if (g_strcmp0(opt->mode, "pool") == 0)
+        {
+            print_debug(_("Using a pool of %d threads to serve connections\n"), opt->pool_threads);
+            d = MHD_start_daemon(SERVER_MHD_POOL_FLAGS | MHD_USE_DEBUG, opt->port, NULL, NULL, &ahc, server_struct, MHD_OPTION_THREAD_POOL_SIZE, (unsigned int) opt->pool_threads, MHD_OPTION_CONNECTION_MEMORY_LIMIT, (size_t) SERVER_CONNECTION_MEMORY_LIMIT, MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) SERVER_CONNECTION_TIMEOUT, MHD_OPTION_END);
+        }
+    else
+        {
+            d = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION | MHD_USE_DEBUG, opt->port, NULL, NULL, &ahc, server_struct, MHD_OPTION_CONNECTION_MEMORY_LIMIT, (size_t) SERVER_CONNECTION_MEMORY_LIMIT, MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) SERVER_CONNECTION_TIMEOUT, MHD_OPTION_END);
+        }
+
+    return d;
+}
+
 
 /**
  * Main function
@@ -1330,10 +2330,19 @@ int main(int argc, char **argv)
 
             /* Before starting anything else, start the threads */
             server_struct->meta_thread = g_thread_new("meta-data", meta_data_thread, server_struct);
-            server_struct->data_thread = g_thread_new("data", data_thread, server_struct);
+
+            if (server_struct->backend->store_data != NULL)
+                {
+                    /* Threads of the pool must never wait for the data workers */
+                    server_struct->workers = new_data_workers_t(server_struct, server_struct->backend, server_struct->opt->data_workers, (guint64) server_struct->opt->queue_size * 1048576, g_strcmp0(server_struct->opt->mode, "pool") != 0);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("Error: no data store backend defined, data will not be stored...\n"));
+                }
 
             /* Starting the libmicrohttpd daemon */
-            server_struct->d = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION | MHD_USE_DEBUG, server_struct->opt->port, NULL, NULL, &ahc, server_struct, MHD_OPTION_CONNECTION_MEMORY_LIMIT, (size_t) 131070 , MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) 120, MHD_OPTION_END);
+            server_struct->d = start_mhd_daemon(server_struct);
 
             if (server_struct->d == NULL)
                 {
@@ -45,9 +45,11 @@
 #include <glib.h>
 #include <gio/gio.h>
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 #include <glib-unix.h>
 #include <sys/inotify.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 
 #include "libcdpfgl.h"
@@ -79,6 +81,9 @@
 #include "options.h"
 #include "backend.h"
 #include "stats.h"
+#include "workers.h"
+#include "block_cache.h"
+#include "inflight.h"
 
 /**
  * @def DEFAULT_SERVER_BUFFER_SIZE
@@ -87,6 +92,67 @@
  */
 #define DEFAULT_SERVER_BUFFER_SIZE (8388608)
 
+/**
+ * @def SERVER_DEFAULT_BACKEND
+ * Defines the backend used by default to store data. "file" is the
+ * one file per block backend whereas "pack" appends blocks into big
+ * pack files and "tier" moves those pack files to a cold tier.
+ */
+#define SERVER_DEFAULT_BACKEND ("file")
+
+
+/**
+ * @def SERVER_DEFAULT_MODE
+ * Defines how libmicrohttpd serves connections by default: "threads"
+ * starts one thread per connection whereas "pool" uses a fixed pool of
+ * threads that wait for events on every connection with epoll.
+ */
+#define SERVER_DEFAULT_MODE ("threads")
+
+
+/**
+ * @def SERVER_DEFAULT_META_SYNC
+ * Defines when meta data catalogs are fsync()'ed by default: "flush"
+ * does it each time buffered records are written, "none" never does it
+ * and "always" writes and fsync()'s each record at once.
+ */
+#define SERVER_DEFAULT_META_SYNC ("flush")
+
+
+/**
+ * @def SERVER_CONNECTION_MEMORY_LIMIT
+ * Defines the memory limit of each connection in libmicrohttpd.
+ */
+#define SERVER_CONNECTION_MEMORY_LIMIT (131070)
+
+
+/**
+ * @def SERVER_CONNECTION_TIMEOUT
+ * Defines the time (in seconds) after which an inactive connection is
+ * closed.
+ */
+#define SERVER_CONNECTION_TIMEOUT (120)
+
+
+/**
+ * @def SERVER_RETRY_AFTER
+ * Defines the time (in seconds) given in the Retry-After header when a
+ * request is refused because the data queues are full.
+ */
+#define SERVER_RETRY_AFTER (5)
+
+
+/**
+ * @def SERVER_MHD_POOL_FLAGS
+ * libmicrohttpd flags used for the "pool" mode. The epoll flag has been
+ * renamed in libmicrohttpd 0.9.53.
+ */
+#if MHD_VERSION >= 0x00095300
+#define SERVER_MHD_POOL_FLAGS (MHD_USE_EPOLL_INTERNAL_THREAD)
+#else
+#define SERVER_MHD_POOL_FLAGS (MHD_USE_EPOLL_INTERNALLY)
+#endif
+
 /**
  * @struct server_struct_t
  * @brief Structure that contains everything needed by the program.
@@ -101,12 +167,15 @@ typedef struct
     backend_t *backend;
     GAsyncQueue *meta_queue;  /**< An asynchronous queue where smeta data will
                                *   be transmitted as it arrives                    */
-    GAsyncQueue *data_queue;  /**< An asynchronous queue where data will be
-                               *   transmitted as it arrives                       */
-    GThread *data_thread;     /**< Thread that will take care of storing data      */
+    data_workers_t *workers;  /**< Threads that will take care of storing data
+                               *   with their bounded queues                       */
     GThread *meta_thread;     /**< Thread that will take care of storing meta data */
     GMainLoop* loop;          /**< Main loop in glib                               */
     stats_t *stats;           /**< Keeps some stats about server usage             */
+    block_cache_t *block_cache; /**< Blocks recently read from the backend (NULL
+                                 *   when disabled)                                */
+    inflight_t *inflight;     /**< Blocks promised by clients or queued to be
+                               *   stored (NULL when disabled)                     */
 } server_struct_t;
 
 
@@ -119,11 +188,63 @@ typedef struct
 {
     guchar *buffer;  /**< buffer that will grab all upload_data from MHD_ahc callback       */
     guint64 pos;     /**< position in the buffer (at the end it is the size of that buffer) */
+    guint64 size;    /**< allocated size of the buffer                                      */
     guint64 number;  /**< number of upload_data buffers received                            */
+    binary_array_decoder_t *decoder; /**< decoder used instead of buffer for streamed
+                                      *   binary requests (/Data_Array.bin)               */
+    gint64 start;    /**< monotonic time (microseconds) when the request began          */
+    gboolean refused; /**< TRUE when the data queues became full while receiving the
+                       *   request: the rest is discarded and answered 503         */
 } upload_t;
 
 
+/**
+ * @def HASH_ARRAY_STREAM_BLOCK_SIZE
+ * Preferred size of the buffers that libmicrohttpd asks us to fill when
+ * streaming an answer to /Data/Hash_Array.bin.
+ */
+#define HASH_ARRAY_STREAM_BLOCK_SIZE (65536)
+
+
+/**
+ * @struct hash_array_stream_t
+ * @brief State of an answer to /Data/Hash_Array.bin or to
+ *        /File/Archive.bin that is streamed to the client.
+ *
+ * Blocks are read from the backend and uncompressed one at a time, only
+ * when libmicrohttpd needs more bytes to send. Each of them is sent
+ * with a BIN_DATA_ARRAY_HEADER_SIZE header as in /Data_Array.bin. An
+ * archive also has ARCHIVE_*_TYPE records (meta data of each file,
+ * missing blocks and end of the archive).
+ */
+typedef struct
+{
+    server_struct_t *server_struct; /**< server's main structure (for the backend)        */
+    GList *head;         /**< list of hash_data_t * requested by the client               */
+    GList *next;         /**< next hash of head to be read from the backend               */
+    hash_data_t *hash_data; /**< block being sent as returned by the backend              */
+    compress_t *compress;   /**< uncompressed block when hash_data is compressed          */
+    guchar *data;        /**< uncompressed data of the block being sent (NULL if none)    */
+    guint64 length;      /**< length of data                                              */
+    guint8 header[BIN_DATA_ARRAY_HEADER_SIZE]; /**< header of the block being sent        */
+    guint64 pos;         /**< position in the block being sent (header included)          */
+    gboolean loaded;     /**< TRUE when a record (header and data) is being sent          */
+    gboolean archive;    /**< TRUE when answering /File/Archive.bin                       */
+    GSList *files;       /**< server_meta_data_t * of the files of an archive             */
+    GSList *next_file;   /**< next file of files whose meta data has to be sent           */
+    meta_data_t *meta;   /**< file of files whose blocks are being sent                   */
+    guint64 index;       /**< index into meta->hashs of the next block to be sent         */
+    gchar *json;         /**< JSON meta data of meta being sent (NULL otherwise)          */
+    gboolean ended;      /**< TRUE when the end record of the archive has been made       */
+} hash_array_stream_t;
+
+
+#include "presence.h"
+#include "catalog.h"
+#include "gc.h"
 #include "file_backend.h"
+#include "pack_backend.h"
+#include "tier_backend.h"
 #include "stats.h"
 
 #endif /* #ifndef _SERVER_H_ */
@@ -24,161 +24,197 @@
  *
  * This file contains all functions and structures that are used by
  * 'cdpfglserver' Sauvegarde's server for its statistics.
+ *
+ * Every thread is given one shard of counters the first time it updates
+ * statistics. Updates are atomic (relaxed) additions into that shard and
+ * reading a counter sums it over all shards.
  */
 
 #include "server.h"
 
-static req_get_t *new_req_get_t(void);
-static void free_req_get_t(req_get_t *req_get);
-static req_post_t *new_req_post_t(void);
-static void free_req_post_t(req_post_t *req_post);
-static req_unk_t *new_req_unk_t(void);
-static void free_req_unk_t(req_unk_t *req_unk);
-static requests_t *new_requests_t(void);
-static void free_requests_t(requests_t *requests);
+static const gchar *latency_names[STATS_NB_LATENCIES] =
+{
+    "GET /Stats.json",
+    "GET /Version",
+    "GET /File/List.json",
+    "GET /Data/0xxxx.json",
+    "GET /Data/Hash_Array.json",
+    "GET /Data/Hash_Array.bin",
+    "GET /File/Archive.bin",
+    "GET unknown",
+    "POST /Meta.json",
+    "POST /Meta_Array.json",
+    "POST /Data.json",
+    "POST /Data_Array.json",
+    "POST /Data_Array.bin",
+    "POST /Hash_Array.json",
+    "POST unknown",
+    "store_data",
+    "build_needed_hash_list",
+    "retrieve_data",
+};
+
+static GPrivate thread_shard = G_PRIVATE_INIT(NULL);
+
+static void atomic_add_guint64(guint64 *value, guint64 add);
+static guint64 atomic_read_guint64(guint64 *value);
+static stats_shard_t *get_thread_shard(stats_t *stats);
+static void add_to_counter(stats_t *stats, gint counter, guint64 value);
+static guint get_histogram_bucket(guint64 microseconds);
+static guint64 get_histogram_bucket_upper_bound(guint bucket);
+static guint64 get_histogram_percentile(guint64 *buckets, guint64 count, guint permille);
 static void add_bytes_to_metadata_bytes(stats_t *stats, size_t nb_bytes);
 
+
 /**
- * Creates a new req_get_t structure initialized with zeros
- * @return a newly allocated req_get_t structure that can
- *         be freed with free_req_get_t() function when no
- *         longer needed.
+ * Atomically adds a number to a guint64 value
+ * @param value is the value to be modified.
+ * @param add is the number to add to value.
  */
-static req_get_t *new_req_get_t(void)
+static void atomic_add_guint64(guint64 *value, guint64 add)
 {
-    req_get_t *req_get = NULL;
-
-    req_get = (req_get_t *) g_malloc0(sizeof(req_get_t));
-
-    req_get->nb_request = 0;
-    req_get->stats = 0;
-    req_get->version = 0;
-    req_get->verstxt = 0;
-    req_get->file_list = 0;
-    req_get->data_hash = 0;
-    req_get->data_hash_array = 0;
-    req_get->unktxt = 0;
-    req_get->unk = 0;
-
-    return req_get;
+    __atomic_fetch_add(value, add, __ATOMIC_RELAXED);
 }
 
 
 /**
- * Frees an allocated req_get_t structure
- * @param req_get is an allocated req_get_t structure to be freed.
+ * Atomically reads a guint64 value
+ * @param value is the value to be read.
+ * @returns the value.
  */
-static void free_req_get_t(req_get_t *req_get)
+static guint64 atomic_read_guint64(guint64 *value)
 {
-    if (req_get != NULL)
-        {
-            g_free(req_get);
-        }
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
 }
 
 
 /**
- * Creates a new req_post_t structure initialized with zeros
- * @return a newly allocated req_post_t structure that can
- *         be freed with free_req_post_t() function when no
- *         longer needed.
+ * Gets the shard of the calling thread. A shard is given to a thread the
+ * first time it calls this function.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @returns the stats_shard_t * shard of the calling thread.
  */
-static req_post_t *new_req_post_t(void)
+static stats_shard_t *get_thread_shard(stats_t *stats)
 {
-    req_post_t *req_post = NULL;
+    guint index = GPOINTER_TO_UINT(g_private_get(&thread_shard));
 
-    req_post = (req_post_t *) g_malloc0(sizeof(req_post_t));
-
-    req_post->nb_request = 0;
-    req_post->meta = 0;
-    req_post->data = 0;
-    req_post->data_array = 0;
-    req_post->hash_array = 0;
-    req_post->unk = 0;
+    if (index == 0)
+        {
+            /* index is stored plus one as 0 means that there is no shard yet */
+            index = ((guint) g_atomic_int_add(&stats->next_shard, 1) % STATS_SHARDS) + 1;
+            g_private_set(&thread_shard, GUINT_TO_POINTER(index));
+        }
 
-    return req_post;
+    return stats->shards[index - 1];
 }
 
 
 /**
- * Frees an allocated req_post_t structure
- * @param req_post is an allocated req_post_t structure to be freed.
+ * Adds a value to a counter
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param counter is the counter to be increased (STATS_REQUESTS...).
+ * @param value is the value to be added to the counter.
  */
-static void free_req_post_t(req_post_t *req_post)
+static void add_to_counter(stats_t *stats, gint counter, guint64 value)
 {
-    if (req_post != NULL)
+    stats_shard_t *shard = NULL;
+
+    if (stats != NULL && counter >= 0 && counter < STATS_NB_COUNTERS)
         {
-            g_free(req_post);
+            shard = get_thread_shard(stats);
+            atomic_add_guint64(&shard->counters[counter], value);
         }
 }
 
 
 /**
- * Creates a new req_unk_t structure initialized with zeros
- * @return a newly allocated req_ink_t structure that can
- *         be freed with free_req_unk_t() function when no
- *         longer needed.
+ * Below 2^STATS_HISTOGRAM_SUB_BITS buckets are exact. Above, the bucket
+ * is made of the position of the highest bit set and of the
+ * STATS_HISTOGRAM_SUB_BITS bits that follow it.
+ * @param microseconds is a latency.
+ * @returns the bucket where this latency has to be counted.
  */
-static req_unk_t *new_req_unk_t(void)
+static guint get_histogram_bucket(guint64 microseconds)
 {
-    req_unk_t *req_unk = NULL;
+    guint64 sub_count = 1 << STATS_HISTOGRAM_SUB_BITS;
+    guint highest = 0;
+    guint bucket = 0;
 
-    req_unk = (req_unk_t *) g_malloc0(sizeof(req_unk_t));
+    if (microseconds < sub_count)
+        {
+            bucket = (guint) microseconds;
+        }
+    else
+        {
+            highest = g_bit_storage(microseconds) - 1;
 
-    req_unk->nb_request = 0;
+            if (highest >= STATS_HISTOGRAM_MAX_BITS)
+                {
+                    bucket = STATS_HISTOGRAM_BUCKETS - 1;
+                }
+            else
+                {
+                    bucket = ((highest - STATS_HISTOGRAM_SUB_BITS + 1) << STATS_HISTOGRAM_SUB_BITS);
+                    bucket = bucket + ((microseconds >> (highest - STATS_HISTOGRAM_SUB_BITS)) & (sub_count - 1));
+                }
+        }
 
-    return req_unk;
+    return bucket;
 }
 
 
 /**
- * Frees an allocated req_get_t structure
- * @param req_unk is an allocated req_unk_t structure to be freed.
+ * @param bucket is a bucket of a histogram.
+ * @returns the highest latency (in microseconds) counted in this bucket.
  */
-static void free_req_unk_t(req_unk_t *req_unk)
+static guint64 get_histogram_bucket_upper_bound(guint bucket)
 {
-    if (req_unk != NULL)
+    guint64 sub_count = 1 << STATS_HISTOGRAM_SUB_BITS;
+    guint highest = 0;
+    guint64 lower = 0;
+    guint64 width = 0;
+
+    if (bucket < sub_count)
+        {
+            return bucket;
+        }
+    else
         {
-            g_free(req_unk);
+            highest = (bucket >> STATS_HISTOGRAM_SUB_BITS) + STATS_HISTOGRAM_SUB_BITS - 1;
+            width = (guint64) 1 << (highest - STATS_HISTOGRAM_SUB_BITS);
+            lower = (sub_count + (bucket & (sub_count - 1))) * width;
+
+            return lower + width - 1;
         }
 }
 
 
 /**
- * Creates a new req_requests_t structure initialized with zeros
- * @return a newly allocated requests_t structure that can
- *         be freed with free_requests_t() function when no
- *         longer needed.
+ * @param buckets is the array of the STATS_HISTOGRAM_BUCKETS buckets of
+ *        a histogram.
+ * @param count is the number of latencies in the histogram (not 0).
+ * @param permille is the percentile wanted expressed in per mille (990
+ *        for the 99th percentile).
+ * @returns the upper bound of the bucket where the percentile is.
  */
-static requests_t *new_requests_t(void)
+static guint64 get_histogram_percentile(guint64 *buckets, guint64 count, guint permille)
 {
-    requests_t *requests = NULL;
-
-
-    requests = (requests_t *) g_malloc0(sizeof(requests_t));
-
-    requests->get = new_req_get_t();
-    requests->post = new_req_post_t();
-    requests->unknown = new_req_unk_t();
-    requests->nb_request = 0;
-
-    return requests;
-}
+    guint64 rank = (count * permille + 999) / 1000;
+    guint64 seen = 0;
+    guint i = 0;
 
+    if (rank == 0)
+        {
+            rank = 1;
+        }
 
-/**
- * Frees an allocated request_t structure
- * @param requests is an allocated requests_t structure to be freed.
- */
-static void free_requests_t(requests_t *requests)
-{
-    if (requests != NULL)
+    while (i < STATS_HISTOGRAM_BUCKETS - 1 && seen + buckets[i] < rank)
         {
-            free_req_get_t(requests->get);
-            free_req_post_t(requests->post);
-            free_req_unk_t(requests->unknown);
-            g_free(requests);
+            seen = seen + buckets[i];
+            i++;
         }
+
+    return get_histogram_bucket_upper_bound(i);
 }
 
 
@@ -191,14 +227,18 @@ static void free_requests_t(requests_t *requests)
 stats_t *new_stats_t(void)
 {
     stats_t *stats = NULL;
+    guint i = 0;
 
     stats = (stats_t *) g_malloc0(sizeof(stats_t));
+    g_assert_nonnull(stats);
+
+    for (i = 0; i < STATS_SHARDS; i++)
+        {
+            stats->shards[i] = (stats_shard_t *) g_malloc0(sizeof(stats_shard_t));
+            g_assert_nonnull(stats->shards[i]);
+        }
 
-    stats->requests = new_requests_t();
-    stats->nb_files = 0;
-    stats->nb_dedup_bytes = 0;
-    stats->nb_total_bytes = 0;
-    stats->nb_meta_bytes = 0;
+    stats->next_shard = 0;
 
     return stats;
 }
@@ -210,14 +250,149 @@ stats_t *new_stats_t(void)
  */
 void free_stats_t(stats_t *stats)
 {
+    guint i = 0;
+
     if (stats != NULL)
         {
-            free_requests_t(stats->requests);
+            for (i = 0; i < STATS_SHARDS; i++)
+                {
+                    free_variable(stats->shards[i]);
+                }
+
             g_free(stats);
         }
 }
 
 
+/**
+ * Gets the value of a counter (summed over all shards).
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param counter is the counter to read (STATS_REQUESTS...).
+ * @returns the value of the counter.
+ */
+guint64 get_stats_counter(stats_t *stats, gint counter)
+{
+    guint64 value = 0;
+    guint i = 0;
+
+    if (stats != NULL && counter >= 0 && counter < STATS_NB_COUNTERS)
+        {
+            for (i = 0; i < STATS_SHARDS; i++)
+                {
+                    value = value + atomic_read_guint64(&stats->shards[i]->counters[counter]);
+                }
+        }
+
+    return value;
+}
+
+
+/**
+ * Records a latency in a histogram.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the histogram to use (STATS_LATENCY_GET_STATS...).
+ * @param microseconds is the latency to record.
+ */
+void add_latency(stats_t *stats, gint latency, gint64 microseconds)
+{
+    stats_shard_t *shard = NULL;
+    histogram_t *histogram = NULL;
+
+    if (stats != NULL && latency >= 0 && latency < STATS_NB_LATENCIES)
+        {
+            if (microseconds < 0)
+                {
+                    microseconds = 0;
+                }
+
+            shard = get_thread_shard(stats);
+            histogram = &shard->latencies[latency];
+
+            atomic_add_guint64(&histogram->buckets[get_histogram_bucket((guint64) microseconds)], 1);
+            atomic_add_guint64(&histogram->count, 1);
+            atomic_add_guint64(&histogram->sum, (guint64) microseconds);
+        }
+}
+
+
+/**
+ * Summarizes a latency histogram (summed over all shards).
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the histogram to summarize (STATS_LATENCY_GET_STATS...).
+ * @param[out] summary is filled with the summary of the histogram.
+ */
+void get_latency_summary(stats_t *stats, gint latency, latency_t *summary)
+{
+    guint64 buckets[STATS_HISTOGRAM_BUCKETS];
+    histogram_t *histogram = NULL;
+    guint64 count = 0;
+    guint64 sum = 0;
+    guint i = 0;
+    guint b = 0;
+    guint last = 0;
+
+    if (summary != NULL)
+        {
+            memset(summary, 0, sizeof(latency_t));
+            memset(buckets, 0, sizeof(buckets));
+
+            if (stats != NULL && latency >= 0 && latency < STATS_NB_LATENCIES)
+                {
+                    for (i = 0; i < STATS_SHARDS; i++)
+                        {
+                            histogram = &stats->shards[i]->latencies[latency];
+                            sum = sum + atomic_read_guint64(&histogram->sum);
+
+                            for (b = 0; b < STATS_HISTOGRAM_BUCKETS; b++)
+                                {
+                                    buckets[b] = buckets[b] + atomic_read_guint64(&histogram->buckets[b]);
+                                }
+                        }
+
+                    /* count is computed from the buckets to stay coherent with them */
+                    for (b = 0; b < STATS_HISTOGRAM_BUCKETS; b++)
+                        {
+                            count = count + buckets[b];
+
+                            if (buckets[b] != 0)
+                                {
+                                    last = b;
+                                }
+                        }
+
+                    if (count > 0)
+                        {
+                            summary->count = count;
+                            summary->mean = sum / count;
+                            summary->p50 = get_histogram_percentile(buckets, count, 500);
+                            summary->p90 = get_histogram_percentile(buckets, count, 900);
+                            summary->p99 = get_histogram_percentile(buckets, count, 990);
+                            summary->p999 = get_histogram_percentile(buckets, count, 999);
+                            summary->max = get_histogram_bucket_upper_bound(last);
+                        }
+                }
+        }
+}
+
+
+/**
+ * @param latency is a histogram (STATS_LATENCY_GET_STATS...).
+ * @returns the name of the histogram as shown in /Stats.json (do not
+ *          free it).
+ */
+const gchar *get_latency_name(gint latency)
+{
+    if (latency >= 0 && latency < STATS_NB_LATENCIES)
+        {
+            return latency_names[latency];
+        }
+    else
+        {
+            return "unknown";
+        }
+}
+
+
 /**
  * Adds in stats_t structure one 'GET' request.
  * @param stats is a stats_t structure to keep some stats about
@@ -225,11 +400,8 @@ void free_stats_t(stats_t *stats)
  */
 void add_one_get_request(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->nb_request += 1;
-            stats->requests->get->nb_request +=1;
-        }
+    add_to_counter(stats, STATS_REQUESTS, 1);
+    add_to_counter(stats, STATS_GET_REQUESTS, 1);
 }
 
 
@@ -240,11 +412,8 @@ void add_one_get_request(stats_t *stats)
  */
 void add_one_post_request(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->nb_request += 1;
-            stats->requests->post->nb_request += 1;
-        }
+    add_to_counter(stats, STATS_REQUESTS, 1);
+    add_to_counter(stats, STATS_POST_REQUESTS, 1);
 }
 
 
@@ -255,11 +424,8 @@ void add_one_post_request(stats_t *stats)
  */
 void add_one_unknown_request(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->unknown != NULL)
-        {
-            stats->requests->nb_request += 1;
-            stats->requests->unknown->nb_request += 1;
-        }
+    add_to_counter(stats, STATS_REQUESTS, 1);
+    add_to_counter(stats, STATS_UNK_REQUESTS, 1);
 }
 
 
@@ -269,10 +435,7 @@ void add_one_unknown_request(stats_t *stats)
  */
 void add_one_saved_file(stats_t *stats)
 {
-    if (stats != NULL)
-        {
-            stats->nb_files += 1;
-        }
+    add_to_counter(stats, STATS_FILES, 1);
 }
 
 
@@ -284,10 +447,7 @@ void add_one_saved_file(stats_t *stats)
  */
 static void add_bytes_to_metadata_bytes(stats_t *stats, size_t nb_bytes)
 {
-    if (stats != NULL)
-        {
-            stats->nb_meta_bytes += (guint64) nb_bytes;
-        }
+    add_to_counter(stats, STATS_META_BYTES, (guint64) nb_bytes);
 }
 
 
@@ -299,10 +459,7 @@ static void add_bytes_to_metadata_bytes(stats_t *stats, size_t nb_bytes)
  */
 void add_file_size_to_total_size(stats_t *stats, guint64 size)
 {
-    if (stats != NULL)
-        {
-            stats->nb_total_bytes += size;
-        }
+    add_to_counter(stats, STATS_TOTAL_BYTES, size);
 }
 
 
@@ -314,44 +471,56 @@ void add_file_size_to_total_size(stats_t *stats, guint64 size)
  */
 void add_hash_size_to_dedup_bytes(stats_t *stats, hash_data_t *hash_data)
 {
-    if (stats != NULL && hash_data != NULL)
+    if (hash_data != NULL)
         {
-            stats->nb_dedup_bytes += hash_data->read;
+            add_to_counter(stats, STATS_DEDUP_BYTES, hash_data->read);
         }
 }
 
 
 /**
- * Adds one to the number of visits of /Stats.json url
+ * Counts one lookup in the block cache
  * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param hit is TRUE if the block was in the cache and FALSE otherwise.
  */
-void add_one_to_get_url_stats(stats_t *stats)
+void add_one_block_cache_lookup(stats_t *stats, gboolean hit)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
+    if (hit == TRUE)
         {
-            stats->requests->get->stats += 1;
+            add_to_counter(stats, STATS_CACHE_HITS, 1);
+        }
+    else
+        {
+            add_to_counter(stats, STATS_CACHE_MISSES, 1);
         }
 }
 
 
+/**
+ * Adds one to the number of visits of /Stats.json url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_get_url_stats(stats_t *stats)
+{
+    add_to_counter(stats, STATS_GET_STATS, 1);
+}
+
+
 /**
  * Adds one to the number of visits of /Version.json or /Version url
  * @param stats is a stats_t structure to keep some stats about server's usage.
- * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
+ * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
  *            .json
  */
 void add_one_to_get_url_version(stats_t *stats, gboolean txt)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
+    if (txt == TRUE)
         {
-            if (txt == TRUE)
-                {
-                    stats->requests->get->verstxt += 1;
-                }
-            else
-                {
-                    stats->requests->get->version += 1;
-                }
+            add_to_counter(stats, STATS_GET_VERSTXT, 1);
+        }
+    else
+        {
+            add_to_counter(stats, STATS_GET_VERSION, 1);
         }
 }
 
@@ -362,10 +531,7 @@ void add_one_to_get_url_version(stats_t *stats, gboolean txt)
  */
 void add_one_to_get_url_file_list(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->get->file_list += 1;
-        }
+    add_to_counter(stats, STATS_GET_FILE_LIST, 1);
 }
 
 
@@ -375,10 +541,7 @@ void add_one_to_get_url_file_list(stats_t *stats)
  */
 void add_one_to_get_url_data_hash(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->get->data_hash += 1;
-        }
+    add_to_counter(stats, STATS_GET_DATA_HASH, 1);
 }
 
 
@@ -388,10 +551,27 @@ void add_one_to_get_url_data_hash(stats_t *stats)
  */
 void add_one_to_get_url_data_hash_array(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
-        {
-            stats->requests->get->data_hash_array += 1;
-        }
+    add_to_counter(stats, STATS_GET_DATA_HASH_ARRAY, 1);
+}
+
+
+/**
+ * Adds one to the number of visits of /Data/Hash_Array.bin url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_get_url_data_hash_array_bin(stats_t *stats)
+{
+    add_to_counter(stats, STATS_GET_DATA_HASH_ARRAY_BIN, 1);
+}
+
+
+/**
+ * Adds one to the number of visits of /File/Archive.bin url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_get_url_file_archive_bin(stats_t *stats)
+{
+    add_to_counter(stats, STATS_GET_FILE_ARCHIVE_BIN, 1);
 }
 
 
@@ -399,21 +579,18 @@ void add_one_to_get_url_data_hash_array(stats_t *stats)
  * Adds one to the number of visits of unknown URL (if txt is FALSE then the
  * unknown URL ends with .json
  * @param stats is a stats_t structure to keep some stats about server's usage.
- * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
+ * @param txt is a boolean set to TRUE if the URL is a text one (not ending with
  *            .json
  */
 void add_one_to_get_url_unknown(stats_t *stats, gboolean txt)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->get != NULL)
+    if (txt == TRUE)
         {
-            if (txt == TRUE)
-                {
-                    stats->requests->get->unktxt += 1;
-                }
-            else
-                {
-                    stats->requests->get->unk += 1;
-                }
+            add_to_counter(stats, STATS_GET_UNKTXT, 1);
+        }
+    else
+        {
+            add_to_counter(stats, STATS_GET_UNK, 1);
         }
 }
 
@@ -426,11 +603,20 @@ void add_one_to_get_url_unknown(stats_t *stats, gboolean txt)
  */
 void add_length_and_one_to_post_url_meta(stats_t *stats, guint64 length)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->meta += 1;
-            add_bytes_to_metadata_bytes(stats, length);
-        }
+    add_to_counter(stats, STATS_POST_META, 1);
+    add_bytes_to_metadata_bytes(stats, length);
+}
+
+
+/**
+ * Adds one to the number of visits of /Meta_Array.json
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param length is the total length of the request.
+ */
+void add_length_and_one_to_post_url_meta_array(stats_t *stats, guint64 length)
+{
+    add_to_counter(stats, STATS_POST_META_ARRAY, 1);
+    add_bytes_to_metadata_bytes(stats, length);
 }
 
 
@@ -440,10 +626,7 @@ void add_length_and_one_to_post_url_meta(stats_t *stats, guint64 length)
  */
 void add_one_to_post_url_hash_array(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->hash_array += 1;
-        }
+    add_to_counter(stats, STATS_POST_HASH_ARRAY, 1);
 }
 
 
@@ -453,10 +636,7 @@ void add_one_to_post_url_hash_array(stats_t *stats)
  */
 void add_one_to_post_url_data(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->data += 1;
-        }
+    add_to_counter(stats, STATS_POST_DATA, 1);
 }
 
 
@@ -466,10 +646,17 @@ void add_one_to_post_url_data(stats_t *stats)
  */
 void add_one_to_post_url_data_array(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->data_array += 1;
-        }
+    add_to_counter(stats, STATS_POST_DATA_ARRAY, 1);
+}
+
+
+/**
+ * Adds one to the number of visits of /Data_Array.bin
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+void add_one_to_post_url_data_array_bin(stats_t *stats)
+{
+    add_to_counter(stats, STATS_POST_DATA_ARRAY_BIN, 1);
 }
 
 
@@ -479,8 +666,5 @@ void add_one_to_post_url_data_array(stats_t *stats)
  */
 void add_one_to_post_url_unknown(stats_t *stats)
 {
-    if (stats != NULL && stats->requests != NULL && stats->requests->post != NULL)
-        {
-            stats->requests->post->unk += 1;
-        }
+    add_to_counter(stats, STATS_POST_UNK, 1);
 }
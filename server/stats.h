@@ -24,58 +24,145 @@
  *
  * This file contains all the definitions of the functions and structures
  * that are used by 'cdpfglserver' Sauvegarde's server for its statistics.
+ *
+ * Counters and latency histograms are split into STATS_SHARDS cache line
+ * padded shards. Each thread updates (atomically) the shard it has been
+ * given and shards are only summed when statistics are read.
  */
 #ifndef _STATS_H_
 #define _STATS_H_
 
 #include "config.h"
 
+
 /**
- * @struct req_get_t
- * @brief structure to keep stats about 'GET' requests
+ * @def STATS_SHARDS
+ * Number of shards of counters. Threads are given a shard in a round
+ * robin way: threads that share a shard remain correct because every
+ * update is atomic.
  */
-typedef struct
-{
-    guint64 nb_request;       /** total number of 'GET' requests          */
-    guint64 stats;            /** number of GET /Stats.json URL           */
-    guint64 version;          /** number of GET /Version.json URL         */
-    guint64 verstxt;          /** number of GET /Version URL              */
-    guint64 file_list;        /** number of GET /File/List.json URL       */
-    guint64 data_hash;        /** number of GET /Data/0xxxx.json URL      */
-    guint64 data_hash_array;  /** number of GET /Data/Hash_Array.json URL */
-    guint64 unktxt;           /** number of GET to unknown text URL       */
-    guint64 unk;              /** number of GET to unknown json URL       */
-} req_get_t;
+#define STATS_SHARDS (16)
 
 
-typedef struct
-{
-    guint64 nb_request; /** total number of 'POST' requests                 */
-    guint64 meta;       /** Counts usage of 'POST' for /Meta.json URL       */
-    guint64 data;       /** Counts usage of 'POST' for /Data.json URL       */
-    guint64 data_array; /** Counts usage of 'POST' for /Data_Array.json URL */
-    guint64 hash_array; /** Counts usage of 'POST' for /Hash_Array.json URL */
-    guint64 unk;        /** Counts wrong usages (unknown urls)              */
-} req_post_t;
+/**
+ * @def STATS_CACHE_LINE
+ * Size of a cache line: shards are padded with it to avoid false sharing.
+ */
+#define STATS_CACHE_LINE (64)
+
 
+/**
+ * @def STATS_HISTOGRAM_SUB_BITS
+ * Latencies are recorded in microseconds into log-linear buckets (as HDR
+ * histograms do): each power of two is divided into 2^STATS_HISTOGRAM_SUB_BITS
+ * buckets, which gives a relative precision of 12.5%.
+ */
+#define STATS_HISTOGRAM_SUB_BITS (3)
 
+
+/**
+ * @def STATS_HISTOGRAM_MAX_BITS
+ * Latencies of 2^STATS_HISTOGRAM_MAX_BITS microseconds (about 19 hours)
+ * and above all go into the last bucket.
+ */
+#define STATS_HISTOGRAM_MAX_BITS (36)
+
+
+/**
+ * @def STATS_HISTOGRAM_BUCKETS
+ * Number of buckets of one latency histogram.
+ */
+#define STATS_HISTOGRAM_BUCKETS ((STATS_HISTOGRAM_MAX_BITS - STATS_HISTOGRAM_SUB_BITS + 1) << STATS_HISTOGRAM_SUB_BITS)
+
+
+/**
+ * Counters kept by the server.
+ */
+enum {
+    STATS_REQUESTS = 0,            /**< total number of requests                   */
+    STATS_GET_REQUESTS,            /**< total number of 'GET' requests             */
+    STATS_GET_STATS,               /**< number of GET /Stats.json URL              */
+    STATS_GET_VERSION,             /**< number of GET /Version.json URL            */
+    STATS_GET_VERSTXT,             /**< number of GET /Version URL                 */
+    STATS_GET_FILE_LIST,           /**< number of GET /File/List.json URL          */
+    STATS_GET_DATA_HASH,           /**< number of GET /Data/0xxxx.json URL         */
+    STATS_GET_DATA_HASH_ARRAY,     /**< number of GET /Data/Hash_Array.json URL    */
+    STATS_GET_DATA_HASH_ARRAY_BIN, /**< number of GET /Data/Hash_Array.bin URL     */
+    STATS_GET_FILE_ARCHIVE_BIN,    /**< number of GET /File/Archive.bin URL        */
+    STATS_GET_UNKTXT,              /**< number of GET to unknown text URL          */
+    STATS_GET_UNK,                 /**< number of GET to unknown json URL          */
+    STATS_POST_REQUESTS,           /**< total number of 'POST' requests            */
+    STATS_POST_META,               /**< number of POST /Meta.json URL              */
+    STATS_POST_META_ARRAY,         /**< number of POST /Meta_Array.json URL        */
+    STATS_POST_DATA,               /**< number of POST /Data.json URL              */
+    STATS_POST_DATA_ARRAY,         /**< number of POST /Data_Array.json URL        */
+    STATS_POST_DATA_ARRAY_BIN,     /**< number of POST /Data_Array.bin URL         */
+    STATS_POST_HASH_ARRAY,         /**< number of POST /Hash_Array.json URL        */
+    STATS_POST_UNK,                /**< number of POST to unknown urls             */
+    STATS_UNK_REQUESTS,            /**< total number of 'unknown' requests         */
+    STATS_FILES,                   /**< number of version of files saved           */
+    STATS_DEDUP_BYTES,             /**< number of bytes saved (the dedup ones)     */
+    STATS_TOTAL_BYTES,             /**< number of bytes of saved files (before dedup) */
+    STATS_META_BYTES,              /**< number of bytes of all the meta data saved */
+    STATS_CACHE_HITS,              /**< number of blocks found in the block cache  */
+    STATS_CACHE_MISSES,            /**< number of blocks read from the backend     */
+    STATS_NB_COUNTERS
+};
+
+
+/**
+ * Latency histograms kept by the server: one per endpoint and one per
+ * backend operation.
+ */
+enum {
+    STATS_LATENCY_GET_STATS = 0,           /**< GET /Stats.json                     */
+    STATS_LATENCY_GET_VERSION,             /**< GET /Version.json and /Version      */
+    STATS_LATENCY_GET_FILE_LIST,           /**< GET /File/List.json                 */
+    STATS_LATENCY_GET_DATA_HASH,           /**< GET /Data/0xxxx.json                */
+    STATS_LATENCY_GET_DATA_HASH_ARRAY,     /**< GET /Data/Hash_Array.json           */
+    STATS_LATENCY_GET_DATA_HASH_ARRAY_BIN, /**< GET /Data/Hash_Array.bin            */
+    STATS_LATENCY_GET_FILE_ARCHIVE_BIN,    /**< GET /File/Archive.bin               */
+    STATS_LATENCY_GET_UNK,                 /**< GET to unknown urls                 */
+    STATS_LATENCY_POST_META,               /**< POST /Meta.json                     */
+    STATS_LATENCY_POST_META_ARRAY,         /**< POST /Meta_Array.json               */
+    STATS_LATENCY_POST_DATA,               /**< POST /Data.json                     */
+    STATS_LATENCY_POST_DATA_ARRAY,         /**< POST /Data_Array.json               */
+    STATS_LATENCY_POST_DATA_ARRAY_BIN,     /**< POST /Data_Array.bin                */
+    STATS_LATENCY_POST_HASH_ARRAY,         /**< POST /Hash_Array.json               */
+    STATS_LATENCY_POST_UNK,                /**< POST to unknown urls                */
+    STATS_LATENCY_STORE_DATA,              /**< backend's store_data                */
+    STATS_LATENCY_BUILD_NEEDED_HASH_LIST,  /**< backend's build_needed_hash_list    */
+    STATS_LATENCY_RETRIEVE_DATA,           /**< backend's retrieve_data             */
+    STATS_NB_LATENCIES
+};
+
+
+/**
+ * @struct histogram_t
+ * @brief A log-linear histogram of latencies (in microseconds)
+ */
 typedef struct
 {
-    guint64 nb_request; /** total number of 'unknown requests */
-} req_unk_t;
+    guint64 buckets[STATS_HISTOGRAM_BUCKETS]; /**< number of latencies in each bucket */
+    guint64 count;                            /**< number of latencies recorded      */
+    guint64 sum;                              /**< sum of all latencies recorded     */
+} histogram_t;
 
 
 /**
- * @struct requests_t
- * @brief structure to keep track of request usages
+ * @struct stats_shard_t
+ * @brief One shard of the counters and histograms
+ *
+ * The padding at both ends keeps shards used by different threads on
+ * different cache lines.
  */
 typedef struct
 {
-    req_get_t *get;      /** keeps stats about 'GET' requests     */
-    req_post_t *post;    /** keeps stats about 'POST' requests    */
-    req_unk_t *unknown;  /** keeps stats about 'unknown' requests */
-    guint64 nb_request;  /** total number of requests             */
-} requests_t;
+    guint8 head[STATS_CACHE_LINE];                 /**< padding                */
+    guint64 counters[STATS_NB_COUNTERS];           /**< counters of this shard */
+    histogram_t latencies[STATS_NB_LATENCIES];     /**< latency histograms     */
+    guint8 tail[STATS_CACHE_LINE];                 /**< padding                */
+} stats_shard_t;
 
 
 /**
@@ -84,14 +171,27 @@ typedef struct
  */
 typedef struct
 {
-    requests_t *requests;
-    guint64 nb_files;        /**< nb_files is the number of version of files saved                                              */
-    guint64 nb_dedup_bytes;  /**< nb_dedup_bytes is the number of bytes saved by the server (the dedup ones)                    */
-    guint64 nb_total_bytes;  /**< nb_total_bytes is the number of bytes represented by file sizes of saved files (before dedup) */
-    guint64 nb_meta_bytes;   /**< nb_meta_bytes is the number of bytes of all the meta data saved                               */
+    stats_shard_t *shards[STATS_SHARDS]; /**< shards updated by threads                      */
+    gint next_shard;                     /**< shard to be given to the next thread (atomic) */
 } stats_t;
 
 
+/**
+ * @struct latency_t
+ * @brief Summary of a latency histogram (all values are in microseconds)
+ */
+typedef struct
+{
+    guint64 count;   /**< number of latencies recorded  */
+    guint64 mean;    /**< mean latency                  */
+    guint64 p50;     /**< median latency                */
+    guint64 p90;     /**< 90th percentile               */
+    guint64 p99;     /**< 99th percentile               */
+    guint64 p999;    /**< 99.9th percentile             */
+    guint64 max;     /**< upper bound of the last bucket used */
+} latency_t;
+
+
 /**
  * Creates a new stats_t structure initialized
  * with 0.
@@ -108,6 +208,41 @@ extern stats_t *new_stats_t(void);
 extern void free_stats_t(stats_t *stats);
 
 
+/**
+ * Gets the value of a counter (summed over all shards).
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param counter is the counter to read (STATS_REQUESTS...).
+ * @returns the value of the counter.
+ */
+extern guint64 get_stats_counter(stats_t *stats, gint counter);
+
+
+/**
+ * Records a latency in a histogram.
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the histogram to use (STATS_LATENCY_GET_STATS...).
+ * @param microseconds is the latency to record.
+ */
+extern void add_latency(stats_t *stats, gint latency, gint64 microseconds);
+
+
+/**
+ * Summarizes a latency histogram (summed over all shards).
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param latency is the histogram to summarize (STATS_LATENCY_GET_STATS...).
+ * @param[out] summary is filled with the summary of the histogram.
+ */
+extern void get_latency_summary(stats_t *stats, gint latency, latency_t *summary);
+
+
+/**
+ * @param latency is a histogram (STATS_LATENCY_GET_STATS...).
+ * @returns the name of the histogram as shown in /Stats.json (do not
+ *          free it).
+ */
+extern const gchar *get_latency_name(gint latency);
+
+
 /**
  * Adds in stats_t structure one 'GET' request.
  * @param stats is a stats_t structure to keep some stats about
@@ -157,6 +292,14 @@ extern void add_file_size_to_total_size(stats_t *stats, guint64 size);
 extern void add_hash_size_to_dedup_bytes(stats_t *stats, hash_data_t *hash_data);
 
 
+/**
+ * Counts one lookup in the block cache
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param hit is TRUE if the block was in the cache and FALSE otherwise.
+ */
+extern void add_one_block_cache_lookup(stats_t *stats, gboolean hit);
+
+
 /**
  * Adds one to the number of visits of /Stats.json url
  * @param stats is a stats_t structure to keep some stats about server's usage.
@@ -194,6 +337,20 @@ extern void add_one_to_get_url_data_hash(stats_t *stats);
 extern void add_one_to_get_url_data_hash_array(stats_t *stats);
 
 
+/**
+ * Adds one to the number of visits of /Data/Hash_Array.bin url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void add_one_to_get_url_data_hash_array_bin(stats_t *stats);
+
+
+/**
+ * Adds one to the number of visits of /File/Archive.bin url
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void add_one_to_get_url_file_archive_bin(stats_t *stats);
+
+
 /**
  * Adds one to the number of visits of unknown URL (if txt is FALSE then the
  * unknown URL ends with .json
@@ -212,6 +369,14 @@ extern void add_one_to_get_url_unknown(stats_t *stats, gboolean txt);
 extern void add_length_and_one_to_post_url_meta(stats_t *stats, guint64 length);
 
 
+/**
+ * Adds one to the number of visits of /Meta_Array.json
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ * @param length is the total length of the request.
+ */
+extern void add_length_and_one_to_post_url_meta_array(stats_t *stats, guint64 length);
+
+
 /**
  * Adds one to the number of visits of /Hash_Array.json
  * @param stats is a stats_t structure to keep some stats about server's usage.
@@ -233,6 +398,13 @@ extern void add_one_to_post_url_data(stats_t *stats);
 extern void add_one_to_post_url_data_array(stats_t *stats);
 
 
+/**
+ * Adds one to the number of visits of /Data_Array.bin
+ * @param stats is a stats_t structure to keep some stats about server's usage.
+ */
+extern void add_one_to_post_url_data_array_bin(stats_t *stats);
+
+
 /**
  * Adds one to the number of visits of an unknown url (wrong usages)
  * @param stats is a stats_t structure to keep some stats about server's usage.
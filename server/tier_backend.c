@@ -0,0 +1,265 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    tier_backend.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/tier_backend.c
+ *
+ * This file contains the functions of the tier backend. Blocks are
+ * stored, indexed and retrieved by pack_backend: store_data appends them
+ * to a pack file on the local (fast) tier and returns. When a pack file
+ * is sealed (pack-size has been reached) the migrator thread copies it
+ * as one big object into the cold directory and removes the local copy.
+ * The pack index stays on the local tier and covers both tiers: looking
+ * a hash up never goes to the cold tier. Only retrieving the data of a
+ * block that has been migrated reads the cold tier.
+ *
+ * A pack file is copied to XXXXXXXX.pack.part in the cold directory and
+ * then renamed so that the cold directory only contains complete pack
+ * files. If the server stops between the rename and the removal of the
+ * local copy, the local copy is removed at the next start.
+ *
+ * @note to translators: tier_backend is the name of the backend please
+ * do not translate this. Thanks.
+ */
+
+#include "server.h"
+
+static gboolean migrate_pack_file(pack_backend_t *pack_backend, guint32 pack);
+static void remove_migrated_hot_copies(pack_backend_t *pack_backend);
+static gpointer migrator_thread(gpointer user_data);
+
+
+/**
+ * Copies a sealed pack file into the cold directory.
+ * @param pack_backend is the pack backend structure.
+ * @param pack is the number of the pack file to be migrated.
+ * @returns TRUE if the pack file is now complete in the cold directory.
+ */
+static gboolean migrate_pack_file(pack_backend_t *pack_backend, guint32 pack)
+{
+    gchar *filename = NULL;
+    gchar *basename = NULL;
+    gchar *coldname = NULL;
+    gchar *partname = NULL;
+    GFile *hot_file = NULL;
+    GFile *cold_file = NULL;
+    GFile *part_file = NULL;
+    GError *error = NULL;
+    gboolean migrated = FALSE;
+    gint64 elapsed = 0;
+
+    filename = pack_get_hot_filename(pack_backend, pack);
+    basename = g_strdup_printf("%08x.pack", pack);
+    coldname = g_build_filename(pack_backend->cold, basename, NULL);
+    partname = g_strconcat(coldname, ".part", NULL);
+
+    hot_file = g_file_new_for_path(filename);
+    cold_file = g_file_new_for_path(coldname);
+    part_file = g_file_new_for_path(partname);
+
+    elapsed = trace_begin();
+
+    if (g_file_copy(hot_file, part_file, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error) == TRUE &&
+        g_file_move(part_file, cold_file, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error) == TRUE)
+        {
+            print_debug(_("tier_backend: %s moved to the cold tier (%" G_GUINT64_FORMAT " bytes)\n"), filename, get_file_size(cold_file));
+            migrated = TRUE;
+        }
+    else
+        {
+            print_error(__FILE__, __LINE__, _("Error: unable to move %s to the cold tier: %s\n"), filename, error != NULL ? error->message : "");
+            free_error(error);
+            g_file_delete(part_file, NULL, NULL);
+        }
+
+    trace_end(elapsed, "migrate_pack_file");
+
+    free_object(part_file);
+    free_object(cold_file);
+    free_object(hot_file);
+    free_variable(partname);
+    free_variable(coldname);
+    free_variable(basename);
+    free_variable(filename);
+
+    return migrated;
+}
+
+
+/**
+ * Removes local copies of pack files that are already in the cold
+ * directory (the server stopped before removing them).
+ * @param pack_backend is the pack backend structure.
+ */
+static void remove_migrated_hot_copies(pack_backend_t *pack_backend)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gchar *filename = NULL;
+
+    g_hash_table_iter_init(&iter, pack_backend->migrated);
+
+    while (g_hash_table_iter_next(&iter, &key, NULL) == TRUE)
+        {
+            filename = pack_get_hot_filename(pack_backend, GPOINTER_TO_UINT(key) - 1);
+
+            if (file_exists(filename) == TRUE)
+                {
+                    print_debug(_("tier_backend: removing %s already in the cold tier\n"), filename);
+                    g_remove(filename);
+                }
+
+            free_variable(filename);
+        }
+}
+
+
+/**
+ * Thread that moves sealed pack files (every pack file but the one
+ * blocks are appended to) to the cold directory in their order. It
+ * sleeps migrate_interval seconds between two looks unless a pack file
+ * is sealed or the backend ends.
+ * @param user_data is the pack_backend_t * structure of the backend.
+ * @returns NULL.
+ */
+static gpointer migrator_thread(gpointer user_data)
+{
+    pack_backend_t *pack_backend = (pack_backend_t *) user_data;
+    gchar *filename = NULL;
+    guint32 next = 0;
+    gboolean found = FALSE;
+
+    g_mutex_lock(&pack_backend->mutex);
+
+    while (pack_backend->stop == FALSE)
+        {
+            while (next < pack_backend->pack && g_hash_table_contains(pack_backend->migrated, GUINT_TO_POINTER(next + 1)) == TRUE)
+                {
+                    next = next + 1;
+                }
+
+            if (next < pack_backend->pack)
+                {
+                    /* A sealed pack file is never written again: it is copied without the lock */
+                    g_mutex_unlock(&pack_backend->mutex);
+
+                    filename = pack_get_hot_filename(pack_backend, next);
+                    found = file_exists(filename);
+
+                    if (found == FALSE || migrate_pack_file(pack_backend, next) == TRUE)
+                        {
+                            g_mutex_lock(&pack_backend->mutex);
+
+                            if (found == TRUE)
+                                {
+                                    /* From now on blocks of this pack file are read from the cold tier */
+                                    g_hash_table_add(pack_backend->migrated, GUINT_TO_POINTER(next + 1));
+                                }
+
+                            g_mutex_unlock(&pack_backend->mutex);
+
+                            if (found == TRUE)
+                                {
+                                    g_remove(filename);
+                                }
+
+                            next = next + 1;
+                            g_mutex_lock(&pack_backend->mutex);
+                        }
+                    else
+                        {
+                            /* Trying again later */
+                            g_mutex_lock(&pack_backend->mutex);
+                            g_cond_wait_until(&pack_backend->migrate_cond, &pack_backend->mutex, g_get_monotonic_time() + pack_backend->migrate_interval * G_TIME_SPAN_SECOND);
+                        }
+
+                    free_variable(filename);
+                }
+            else
+                {
+                    g_cond_wait_until(&pack_backend->migrate_cond, &pack_backend->mutex, g_get_monotonic_time() + pack_backend->migrate_interval * G_TIME_SPAN_SECOND);
+                }
+        }
+
+    g_mutex_unlock(&pack_backend->mutex);
+
+    return NULL;
+}
+
+
+/**
+ * Inits the backend as pack_backend from [Tier_Backend] group and
+ * starts the migrator thread if a cold directory is configured.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+void tier_init_backend(server_struct_t *server_struct)
+{
+    pack_backend_t *pack_backend = NULL;
+
+    pack_init_backend_from_group(server_struct, GN_TIER_BACKEND);
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+
+            if (pack_backend->cold != NULL)
+                {
+                    remove_migrated_hot_copies(pack_backend);
+                    print_debug(_("tier_backend: %u pack files in the cold tier %s\n"), g_hash_table_size(pack_backend->migrated), pack_backend->cold);
+                    pack_backend->migrator = g_thread_new("tier-migrator", migrator_thread, pack_backend);
+                }
+            else
+                {
+                    print_error(__FILE__, __LINE__, _("tier_backend: no cold-directory in [Tier_Backend]. Pack files will stay on the local tier.\n"));
+                }
+        }
+}
+
+
+/**
+ * Stops the migrator thread (a migration in progress is finished) and
+ * terminates the pack backend.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+void tier_terminate_backend(server_struct_t *server_struct)
+{
+    pack_backend_t *pack_backend = NULL;
+
+    if (server_struct != NULL && server_struct->backend != NULL && server_struct->backend->user_data != NULL)
+        {
+            pack_backend = server_struct->backend->user_data;
+
+            if (pack_backend->migrator != NULL)
+                {
+                    g_mutex_lock(&pack_backend->mutex);
+                    pack_backend->stop = TRUE;
+                    g_cond_signal(&pack_backend->migrate_cond);
+                    g_mutex_unlock(&pack_backend->mutex);
+
+                    g_thread_join(pack_backend->migrator);
+                    pack_backend->migrator = NULL;
+                }
+        }
+
+    pack_terminate_backend(server_struct);
+}
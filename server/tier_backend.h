@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    tier_backend.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file server/tier_backend.h
+ *
+ * This file contains all definitions for the functions of the tier
+ * backend. This backend is pack_backend whose pack files are written on
+ * a fast local tier and moved, once sealed, to a cold tier (an object
+ * store mounted in a directory for instance) by a migrator thread.
+ */
+
+#ifndef _SERVER_TIER_BACKEND_H_
+#define _SERVER_TIER_BACKEND_H_
+
+
+/**
+ * @def TIER_BACKEND_MIGRATE_INTERVAL
+ * Defines the default time (in seconds) between two looks of the
+ * migrator for sealed pack files. The migrator is also woken up each
+ * time a pack file is sealed.
+ */
+#define TIER_BACKEND_MIGRATE_INTERVAL (60)
+
+
+/**
+ * Inits the backend as pack_backend from [Tier_Backend] group and
+ * starts the migrator thread if a cold directory is configured.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+extern void tier_init_backend(server_struct_t *server_struct);
+
+
+/**
+ * Stops the migrator thread (a migration in progress is finished) and
+ * terminates the pack backend.
+ * @param server_struct is the server's main structure where all
+ *        informations needed by the program are stored.
+ */
+extern void tier_terminate_backend(server_struct_t *server_struct);
+
+#endif /* #ifndef _SERVER_TIER_BACKEND_H_ */
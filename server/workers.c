@@ -0,0 +1,292 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    workers.c
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file workers.c
+ *
+ * This file contains the data workers of 'cdpfglserver'. Blocks received
+ * by libmicrohttpd's threads are queued to the worker in charge of the
+ * first byte of their hash: with the file backend every block of a top
+ * level directory is written by the same thread. The amount of queued
+ * data is bounded so that a busy server slows clients down instead of
+ * buffering everything in memory. Queued blocks are recorded in the set
+ * of blocks in flight until they are stored so that no other client is
+ * asked for them meanwhile.
+ */
+
+#include "server.h"
+
+static guint get_worker_number(data_workers_t *workers, hash_data_t *hash_data);
+static gpointer data_worker_thread(gpointer user_data);
+
+
+/**
+ * @param workers is the data_workers_t structure.
+ * @param hash_data is the block to be stored.
+ * @returns the number of the worker in charge of hash_data's hash.
+ */
+static guint get_worker_number(data_workers_t *workers, hash_data_t *hash_data)
+{
+    if (hash_data->hash != NULL)
+        {
+            return hash_data->hash[0] % workers->nb_workers;
+        }
+    else
+        {
+            return 0;
+        }
+}
+
+
+/**
+ * Thread of one data worker: stores blocks of its queue with the backend
+ * until it pops itself (the stop request sent by free_data_workers_t).
+ * When the backend stores lists of blocks, the blocks already waiting in
+ * the queue (up to DATA_WORKER_BATCH) are given to it at once.
+ * @param user_data is the data_worker_t * structure of this worker.
+ * @returns NULL to fullfill the template needed to create a GThread
+ */
+static gpointer data_worker_thread(gpointer user_data)
+{
+    data_worker_t *worker = (data_worker_t *) user_data;
+    data_workers_t *workers = (data_workers_t *) worker->workers;
+    gpointer item = NULL;
+    hash_data_t *hash_data = NULL;
+    server_struct_t *server_struct = (server_struct_t *) workers->server_struct;
+    guint64 size = 0;
+    gint64 start = 0;
+    guint8 hashs[DATA_WORKER_BATCH * HASH_LEN];
+    gboolean has_hash[DATA_WORKER_BATCH];
+    GList *batch = NULL;
+    guint nb = 0;
+    guint i = 0;
+    gboolean stop = FALSE;
+
+    while (stop == FALSE)
+        {
+            item = g_async_queue_pop(worker->queue);
+            batch = NULL;
+            size = 0;
+            nb = 0;
+
+            while (item != NULL && item != worker)
+                {
+                    hash_data = (hash_data_t *) item;
+                    size = size + hash_data->read;
+                    has_hash[nb] = (hash_data->hash != NULL);
+
+                    if (has_hash[nb] == TRUE)
+                        {
+                            memcpy(hashs + nb * HASH_LEN, hash_data->hash, HASH_LEN);
+                        }
+
+                    batch = g_list_prepend(batch, hash_data);
+                    nb++;
+
+                    if (workers->backend->store_data_list != NULL && nb < DATA_WORKER_BATCH)
+                        {
+                            item = g_async_queue_try_pop(worker->queue);
+                        }
+                    else
+                        {
+                            item = NULL;
+                        }
+                }
+
+            stop = (item == worker);
+
+            if (nb > 0)
+                {
+                    /* blocks are freed by the backend */
+                    start = g_get_monotonic_time();
+
+                    if (workers->backend->store_data_list != NULL)
+                        {
+                            workers->backend->store_data_list(workers->server_struct, g_list_reverse(batch));
+                        }
+                    else
+                        {
+                            workers->backend->store_data(workers->server_struct, (hash_data_t *) batch->data);
+                            g_list_free(batch);
+                        }
+
+                    add_latency(server_struct->stats, STATS_LATENCY_STORE_DATA, (g_get_monotonic_time() - start) / nb);
+
+                    for (i = 0; i < nb; i++)
+                        {
+                            if (has_hash[i] == TRUE)
+                                {
+                                    inflight_stored(server_struct->inflight, hashs + i * HASH_LEN);
+                                }
+                        }
+
+                    g_mutex_lock(&workers->mutex);
+                    workers->queued = workers->queued - size;
+                    g_cond_broadcast(&workers->cond);
+                    g_mutex_unlock(&workers->mutex);
+                }
+        }
+
+    return NULL;
+}
+
+
+/**
+ * Creates the data workers and starts their threads.
+ * @param server_struct is the server_struct_t * structure given to the
+ *        backend's store_data function.
+ * @param backend is the backend used to store data (its store_data
+ *        function must not be NULL).
+ * @param nb_workers is the number of workers to start (at least 1).
+ * @param max_queued is the maximum number of bytes of data that may wait
+ *        to be stored.
+ * @param wait is TRUE if data_workers_push() has to wait while the
+ *        queues are full and FALSE if it must never block its caller.
+ * @returns a newly allocated data_workers_t structure that may be freed
+ *          with free_data_workers_t().
+ */
+data_workers_t *new_data_workers_t(void *server_struct, backend_t *backend, guint nb_workers, guint64 max_queued, gboolean wait)
+{
+    data_workers_t *workers = NULL;
+    gchar *name = NULL;
+    guint i = 0;
+
+    g_assert_nonnull(backend);
+    g_assert_nonnull(backend->store_data);
+
+    workers = (data_workers_t *) g_malloc0(sizeof(data_workers_t));
+    g_assert_nonnull(workers);
+
+    workers->server_struct = server_struct;
+    workers->backend = backend;
+    workers->nb_workers = MAX(nb_workers, 1);
+    workers->queued = 0;
+    workers->max_queued = max_queued;
+    workers->wait = wait;
+    g_mutex_init(&workers->mutex);
+    g_cond_init(&workers->cond);
+
+    workers->worker = (data_worker_t *) g_malloc0(workers->nb_workers * sizeof(data_worker_t));
+    g_assert_nonnull(workers->worker);
+
+    for (i = 0; i < workers->nb_workers; i++)
+        {
+            workers->worker[i].queue = g_async_queue_new();
+            workers->worker[i].workers = workers;
+            name = g_strdup_printf("data-%u", i);
+            workers->worker[i].thread = g_thread_new(name, data_worker_thread, &workers->worker[i]);
+            free_variable(name);
+        }
+
+    print_debug(_("%u data workers started\n"), workers->nb_workers);
+
+    return workers;
+}
+
+
+/**
+ * Stops the data workers once every queued block has been stored and
+ * frees the structure.
+ * @param workers is the data_workers_t structure to be freed.
+ */
+void free_data_workers_t(data_workers_t *workers)
+{
+    guint i = 0;
+
+    if (workers != NULL)
+        {
+            for (i = 0; i < workers->nb_workers; i++)
+                {
+                    g_async_queue_push(workers->worker[i].queue, &workers->worker[i]);
+                }
+
+            for (i = 0; i < workers->nb_workers; i++)
+                {
+                    g_thread_join(workers->worker[i].thread);
+                    g_async_queue_unref(workers->worker[i].queue);
+                }
+
+            g_mutex_clear(&workers->mutex);
+            g_cond_clear(&workers->cond);
+            free_variable(workers->worker);
+            free_variable(workers);
+        }
+}
+
+
+/**
+ * Queues a block to be stored by the worker in charge of its hash and
+ * records it as queued in the set of blocks in flight. Waits while the
+ * queues are full (unless workers do not wait). An empty queue always
+ * accepts a block so that a block bigger than max_queued can be stored.
+ * @param workers is the data_workers_t structure. When it is NULL (no
+ *        data store backend) the block is dropped.
+ * @param hash_data is the block to be stored. It is freed by the backend
+ *        (or here) and must not be used after this call.
+ */
+void data_workers_push(data_workers_t *workers, hash_data_t *hash_data)
+{
+    guint64 size = 0;
+    server_struct_t *server_struct = NULL;
+
+    if (workers != NULL && hash_data != NULL)
+        {
+            size = hash_data->read;
+            server_struct = (server_struct_t *) workers->server_struct;
+            inflight_queued(server_struct->inflight, hash_data->hash);
+
+            g_mutex_lock(&workers->mutex);
+
+            while (workers->wait == TRUE && workers->queued > 0 && workers->queued + size > workers->max_queued)
+                {
+                    g_cond_wait(&workers->cond, &workers->mutex);
+                }
+
+            workers->queued = workers->queued + size;
+            g_mutex_unlock(&workers->mutex);
+
+            g_async_queue_push(workers->worker[get_worker_number(workers, hash_data)].queue, hash_data);
+        }
+    else if (hash_data != NULL)
+        {
+            free_hash_data_t(hash_data);
+        }
+}
+
+
+/**
+ * @param workers is the data_workers_t structure (may be NULL).
+ * @returns TRUE if the queues are full ie if a request carrying data
+ *          should be refused until the workers have stored some.
+ */
+gboolean data_workers_are_full(data_workers_t *workers)
+{
+    gboolean full = FALSE;
+
+    if (workers != NULL)
+        {
+            g_mutex_lock(&workers->mutex);
+            full = (workers->queued > 0 && workers->queued >= workers->max_queued);
+            g_mutex_unlock(&workers->mutex);
+        }
+
+    return full;
+}
@@ -0,0 +1,142 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *    workers.h
+ *    This file is part of "Sauvegarde" project.
+ *
+ *    (C) Copyright 2019 Olivier Delhomme
+ *     e-mail : olivier.delhomme@free.fr
+ *
+ *    "Sauvegarde" is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    "Sauvegarde" is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with "Sauvegarde".  If not, see <http://www.gnu.org/licenses/>
+ */
+/**
+ * @file workers.h
+ *
+ * This file contains all the definitions of the functions and structures
+ * of the data workers: threads that store data blocks with the selected
+ * backend. Blocks are sharded between workers by the first byte of their
+ * hash so that one directory is always written by the same worker.
+ */
+#ifndef _SERVER_WORKERS_H_
+#define _SERVER_WORKERS_H_
+
+
+/**
+ * @def SERVER_DATA_WORKERS
+ * Defines the default number of data workers.
+ */
+#define SERVER_DATA_WORKERS (4)
+
+
+/**
+ * @def SERVER_QUEUE_SIZE
+ * Defines the default maximum size (in MB) of the data waiting to be
+ * stored by the data workers. When it is reached the threads that
+ * answer to clients wait before queueing more data.
+ */
+#define SERVER_QUEUE_SIZE (256)
+
+
+/**
+ * @def DATA_WORKER_BATCH
+ * Defines the maximum number of blocks already queued that a worker
+ * gives at once to a backend that stores lists of blocks.
+ */
+#define DATA_WORKER_BATCH (16)
+
+
+/**
+ * @struct data_worker_t
+ * @brief One data worker: a thread and its queue.
+ */
+typedef struct
+{
+    GAsyncQueue *queue;     /**< hash_data_t * to be stored by this worker                   */
+    GThread *thread;        /**< thread of the worker                                        */
+    gpointer workers;       /**< data_workers_t * this worker belongs to                     */
+} data_worker_t;
+
+
+/**
+ * @struct data_workers_t
+ * @brief Data workers and their bounded queues.
+ *
+ * Each worker has its own queue. The number of bytes queued for all the
+ * workers is bounded: data_workers_push() waits for the workers (and
+ * thus applies backpressure to libmicrohttpd's threads) until there is
+ * enough room. When pushes must not wait (a pool of threads serves every
+ * connection) requests are refused while data_workers_are_full() instead
+ * (even in the middle of a streamed request) and the bound may only be
+ * exceeded by one received part of a request per connection.
+ */
+typedef struct
+{
+    void *server_struct;    /**< server_struct_t * passed to the backend                     */
+    backend_t *backend;     /**< backend used to store data                                  */
+    guint nb_workers;       /**< number of workers                                           */
+    data_worker_t *worker;  /**< array of nb_workers workers                                 */
+    GMutex mutex;           /**< protects queued                                             */
+    GCond cond;             /**< signaled when queued decreases                              */
+    guint64 queued;         /**< number of bytes of data queued (not yet stored)             */
+    guint64 max_queued;     /**< maximum number of bytes of data that may be queued          */
+    gboolean wait;          /**< TRUE if data_workers_push() waits while queues are full     */
+} data_workers_t;
+
+
+/**
+ * Creates the data workers and starts their threads.
+ * @param server_struct is the server_struct_t * structure given to the
+ *        backend's store_data function.
+ * @param backend is the backend used to store data (its store_data
+ *        function must not be NULL).
+ * @param nb_workers is the number of workers to start (at least 1).
+ * @param max_queued is the maximum number of bytes of data that may wait
+ *        to be stored.
+ * @param wait is TRUE if data_workers_push() has to wait while the
+ *        queues are full and FALSE if it must never block its caller.
+ * @returns a newly allocated data_workers_t structure that may be freed
+ *          with free_data_workers_t().
+ */
+extern data_workers_t *new_data_workers_t(void *server_struct, backend_t *backend, guint nb_workers, guint64 max_queued, gboolean wait);
+
+
+/**
+ * Stops the data workers once every queued block has been stored and
+ * frees the structure.
+ * @param workers is the data_workers_t structure to be freed.
+ */
+extern void free_data_workers_t(data_workers_t *workers);
+
+
+/**
+ * Queues a block to be stored by the worker in charge of its hash and
+ * records it as queued in the set of blocks in flight. Waits while the
+ * queues are full (unless workers do not wait). An empty queue always
+ * accepts a block so that a block bigger than max_queued can be stored.
+ * @param workers is the data_workers_t structure. When it is NULL (no
+ *        data store backend) the block is dropped.
+ * @param hash_data is the block to be stored. It is freed by the backend
+ *        (or here) and must not be used after this call.
+ */
+extern void data_workers_push(data_workers_t *workers, hash_data_t *hash_data);
+
+
+/**
+ * @param workers is the data_workers_t structure (may be NULL).
+ * @returns TRUE if the queues are full ie if a request carrying data
+ *          should be refused until the workers have stored some.
+ */
+extern gboolean data_workers_are_full(data_workers_t *workers);
+
+
+#endif /* #ifndef _SERVER_WORKERS_H_ */